@@ -0,0 +1,42 @@
+#include "fuse/message_formatter.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+namespace tgfuse {
+namespace {
+
+// Text of @p size bytes in lines of ordinary prose (with the odd UTF-8 sequence)
+std::string make_text(std::size_t size) {
+    static const std::string line = "The quick brown fox jumps over the lazy dog. Съешь же ещё этих булок.\n";
+    std::string text;
+    text.reserve(size + line.size());
+    while (text.size() < size) {
+        text += line;
+    }
+    text.resize(size);
+    return text;
+}
+
+void BM_IsValidText(benchmark::State& state) {
+    auto text = make_text(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(MessageFormatter::is_valid_text(text.data(), text.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_IsValidText)->Range(64, 1 << 20);
+
+void BM_SplitMessage(benchmark::State& state) {
+    auto text = make_text(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        auto chunks = MessageFormatter::split_message(text);
+        benchmark::DoNotOptimize(chunks);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SplitMessage)->Range(1 << 10, 1 << 20);
+
+}  // namespace
+}  // namespace tgfuse
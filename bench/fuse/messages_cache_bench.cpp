@@ -0,0 +1,153 @@
+#include "fuse/messages_cache.hpp"
+
+#include "tg/bustache_formatters.hpp"
+#include "tg/formatters.hpp"
+#include "tg/message_template.hpp"
+
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+
+#include <bustache/render/string.hpp>
+
+#include <chrono>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace tgfuse {
+namespace {
+
+constexpr int64_t kMessagesPerChat = 200;
+
+const tg::User sender{42, "alice", "Alice", "Liddell", "", "", true, tg::UserStatus::ONLINE, 0, 0, 0};
+const tg::Chat chat{42, tg::ChatType::PRIVATE, "Alice Liddell", "alice", 0, 0};
+
+const tg::User& resolve_user(int64_t) { return sender; }
+const tg::Chat& resolve_chat(int64_t) { return chat; }
+
+int64_t now_seconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+// Recent messages of one chat, oldest first
+std::vector<tg::Message> make_messages(int64_t chat_id) {
+    auto now = now_seconds();
+    std::vector<tg::Message> messages;
+    messages.reserve(kMessagesPerChat);
+    for (int64_t i = 0; i < kMessagesPerChat; ++i) {
+        messages.push_back(tg::Message{
+            i + 1,
+            chat_id,
+            sender.id,
+            now - (kMessagesPerChat - i) * 60,
+            "Message number " + std::to_string(i) + ", long enough to look like an ordinary chat line",
+            std::nullopt,
+            i % 4 == 0
+        });
+    }
+    return messages;
+}
+
+const tg::Message& sample_message() {
+    static const auto messages = make_messages(chat.id);
+    return messages[1];  // Incoming, so the sender name is rendered
+}
+
+// Rendering one message: bustache vs the precompiled template vs the fmt formatter
+
+void BM_RenderBustache(benchmark::State& state) {
+    FormattedMessagesCache cache;
+    tg::MessageInfo info{sample_message(), sender, chat};
+    for (auto _ : state) {
+        auto text = bustache::to_string(cache.message_template()(info));
+        benchmark::DoNotOptimize(text);
+    }
+}
+BENCHMARK(BM_RenderBustache);
+
+void BM_RenderMessageTemplate(benchmark::State& state) {
+    auto tmpl = tg::MessageTemplate::compile(MessagesCacheConfig{}.message_format);
+    tg::MessageInfo info{sample_message(), sender, chat};
+    std::string text;
+    for (auto _ : state) {
+        text.clear();
+        tmpl->render_to(text, info);
+        benchmark::DoNotOptimize(text.data());
+    }
+}
+BENCHMARK(BM_RenderMessageTemplate);
+
+void BM_RenderFmt(benchmark::State& state) {
+    tg::MessageInfo info{sample_message(), sender, chat};
+    std::string text;
+    for (auto _ : state) {
+        text.clear();
+        fmt::format_to(std::back_inserter(text), "{}", info);
+        benchmark::DoNotOptimize(text.data());
+    }
+}
+BENCHMARK(BM_RenderFmt);
+
+// Formatting a whole chat into the cache
+void BM_MessagesCacheStore(benchmark::State& state) {
+    FormattedMessagesCache cache;
+    auto messages = make_messages(chat.id);
+    for (auto _ : state) {
+        auto text = cache.store(chat.id, messages, resolve_user, resolve_chat);
+        benchmark::DoNotOptimize(text);
+    }
+    state.SetItemsProcessed(state.iterations() * kMessagesPerChat);
+}
+BENCHMARK(BM_MessagesCacheStore);
+
+// Cache shared by the threads of the contention benchmarks
+// Holds 64 chats at most, so a working set of 128 keeps evicting (through the cold tier).
+FormattedMessagesCache& shared_cache() {
+    static FormattedMessagesCache cache([] {
+        MessagesCacheConfig config;
+        config.max_chats = 64;
+        return config;
+    }());
+    static const bool filled = [] {
+        auto messages = make_messages(chat.id);
+        for (int64_t chat_id = 1; chat_id <= 64; ++chat_id) {
+            cache.store(chat_id, messages, resolve_user, resolve_chat);
+        }
+        return true;
+    }();
+    (void)filled;
+    return cache;
+}
+
+// Hot-tier hits
+void BM_MessagesCacheGet(benchmark::State& state) {
+    auto& cache = shared_cache();
+    int64_t chat_id = state.thread_index();
+    for (auto _ : state) {
+        auto text = cache.get(chat_id % 32 + 1);
+        benchmark::DoNotOptimize(text);
+        chat_id += 7;
+    }
+}
+BENCHMARK(BM_MessagesCacheGet)->ThreadRange(1, 8)->UseRealTime();
+
+// Mostly reads over twice as many chats as fit, misses being reformatted and evicting others
+void BM_MessagesCacheGetStoreEvict(benchmark::State& state) {
+    auto& cache = shared_cache();
+    auto messages = make_messages(chat.id);
+    int64_t chat_id = state.thread_index();
+    for (auto _ : state) {
+        auto id = chat_id % 128 + 1;
+        auto text = cache.get(id);
+        if (!text) {
+            text = cache.store(id, messages, resolve_user, resolve_chat);
+        }
+        benchmark::DoNotOptimize(text);
+        chat_id += 13;
+    }
+}
+BENCHMARK(BM_MessagesCacheGetStoreEvict)->ThreadRange(1, 8)->UseRealTime();
+
+}  // namespace
+}  // namespace tgfuse
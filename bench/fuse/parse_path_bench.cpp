@@ -0,0 +1,56 @@
+#include "fuse/telegram_provider.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <iterator>
+#include <string>
+#include <string_view>
+
+namespace tgfuse {
+
+// Reaches the provider's private path parser (it needs no provider instance)
+struct ParsePathBench {
+    static auto parse(std::string_view path) { return TelegramDataProvider::parse_path(path); }
+};
+
+namespace {
+
+// One path per category family, as FUSE lookups and getattr calls hit them
+constexpr std::string_view kPaths[] = {
+    "/",
+    "/users",
+    "/users/alice",
+    "/users/alice/.info",
+    "/users/alice/messages",
+    "/groups/dev_chat/files",
+    "/groups/dev_chat/files/20241205-1430-report.pdf",
+    "/channels/news/media/20241205-1430-photo.jpg",
+    "/contacts/alice",
+    "/@alice",
+    "/text/@alice",
+    "/.uploads/12-report.pdf",
+    "/users/alice/../bob/./txt",
+    "/nonexistent/path",
+};
+
+void BM_ParsePath(benchmark::State& state) {
+    auto path = kPaths[state.range(0)];
+    state.SetLabel(std::string(path));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ParsePathBench::parse(path));
+    }
+}
+BENCHMARK(BM_ParsePath)->DenseRange(0, static_cast<int>(std::size(kPaths)) - 1);
+
+// A mixed stream of lookups, cycling through all of the above
+void BM_ParsePathMixed(benchmark::State& state) {
+    std::size_t next = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ParsePathBench::parse(kPaths[next]));
+        next = (next + 1) % std::size(kPaths);
+    }
+}
+BENCHMARK(BM_ParsePathMixed);
+
+}  // namespace
+}  // namespace tgfuse
@@ -0,0 +1,112 @@
+#include "tg/cache.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tg {
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr int64_t kDatabaseMessages = 100'000;
+constexpr int64_t kDisplayWindow = 48 * 3600;  // The provider's default max_history_age
+
+int64_t now_seconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+// @p count messages of one chat, @p spacing seconds apart and ending just before now
+std::vector<Message> make_messages(int64_t chat_id, int64_t first_id, int64_t count, int64_t spacing) {
+    auto now = now_seconds();
+    std::vector<Message> messages;
+    messages.reserve(static_cast<std::size_t>(count));
+    for (int64_t i = 0; i < count; ++i) {
+        messages.push_back(Message{
+            first_id + i,
+            chat_id,
+            1000 + i % 16,
+            now - (count - i) * spacing,
+            "Synthetic message " + std::to_string(first_id + i) + " with a line of ordinary text",
+            std::nullopt,
+            i % 5 == 0
+        });
+    }
+    return messages;
+}
+
+// Database file removed when the benchmark is done with it
+class TempDatabase {
+public:
+    explicit TempDatabase(const std::string& name)
+        : path_(fs::temp_directory_path() / ("tg_fuse_bench_" + name + ".db")) {
+        fs::remove(path_);
+        cache_ = std::make_unique<CacheManager>(path_.string());
+    }
+
+    ~TempDatabase() {
+        cache_.reset();
+        fs::remove(path_);
+        fs::remove(path_.string() + "-wal");
+        fs::remove(path_.string() + "-shm");
+    }
+
+    CacheManager& cache() { return *cache_; }
+
+private:
+    fs::path path_;
+    std::unique_ptr<CacheManager> cache_;
+};
+
+// 100k-message database split into chats of @p per_chat messages, built once per size
+CacheManager& display_database(int64_t per_chat) {
+    static std::map<int64_t, std::unique_ptr<TempDatabase>> databases;
+    auto& database = databases[per_chat];
+    if (!database) {
+        database = std::make_unique<TempDatabase>("display_" + std::to_string(per_chat));
+        auto spacing = std::max<int64_t>(1, kDisplayWindow / (2 * per_chat));
+        for (int64_t chat = 0; chat < kDatabaseMessages / per_chat; ++chat) {
+            database->cache().cache_messages(make_messages(chat + 1, chat * per_chat + 1, per_chat, spacing));
+        }
+    }
+    return database->cache();
+}
+
+void BM_CacheMessagesBulk(benchmark::State& state) {
+    TempDatabase database("bulk_insert");
+    auto count = state.range(0);
+    int64_t chat_id = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        ++chat_id;
+        auto messages = make_messages(chat_id, chat_id * count, count, 1);
+        state.ResumeTiming();
+
+        database.cache().cache_messages(messages);
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_CacheMessagesBulk)->Arg(1000)->Arg(10'000)->Arg(kDatabaseMessages)->Unit(benchmark::kMillisecond);
+
+void BM_GetMessagesForDisplay(benchmark::State& state) {
+    auto per_chat = state.range(0);
+    auto& cache = display_database(per_chat);
+    auto chats = kDatabaseMessages / per_chat;
+    int64_t chat = 0;
+    for (auto _ : state) {
+        auto messages = cache.get_messages_for_display(chat++ % chats + 1, kDisplayWindow);
+        benchmark::DoNotOptimize(messages);
+    }
+    state.SetItemsProcessed(state.iterations() * per_chat);
+}
+BENCHMARK(BM_GetMessagesForDisplay)->Arg(100)->Arg(1000)->Arg(10'000)->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+}  // namespace tg
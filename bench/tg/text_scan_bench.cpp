@@ -0,0 +1,56 @@
+#include "tg/text_scan.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+namespace tg {
+namespace {
+
+// Text of @p size bytes in lines of ordinary prose, half of each line Cyrillic
+std::string make_text(std::size_t size) {
+    static const std::string line = "The quick brown fox jumps over the lazy dog. Съешь же ещё этих булок.\n";
+    std::string text;
+    text.reserve(size + line.size());
+    while (text.size() < size) {
+        text += line;
+    }
+    text.resize(utf8_boundary(text, size));
+    return text;
+}
+
+// Arguments: kernel, size
+void BM_ScanText(benchmark::State& state) {
+    auto kernel = static_cast<TextKernel>(state.range(0));
+    if (!text_kernel_supported(kernel)) {
+        state.SkipWithError("Kernel not supported on this CPU");
+        return;
+    }
+    auto text = make_text(static_cast<std::size_t>(state.range(1)));
+    state.SetLabel(std::string(to_string(kernel)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(scan_text(text, kernel));
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(text.size()));
+}
+BENCHMARK(BM_ScanText)
+    ->ArgsProduct(
+        {{static_cast<int>(TextKernel::SCALAR),
+          static_cast<int>(TextKernel::SSE42),
+          static_cast<int>(TextKernel::AVX2),
+          static_cast<int>(TextKernel::NEON)},
+         {4096, 1 << 20, 100 << 20}}
+    );
+
+void BM_SplitText(benchmark::State& state) {
+    auto text = make_text(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        auto chunks = split_text(text, 4096);
+        benchmark::DoNotOptimize(chunks);
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(text.size()));
+}
+BENCHMARK(BM_SplitText)->Range(1 << 10, 1 << 20);
+
+}  // namespace
+}  // namespace tg
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "fuse/data_provider.hpp"
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tgfuse {
+
+/// Data provider serving several accounts side by side, one directory each
+///
+/// `/<account>/...` is `/...` of that account's provider, so one mount shows
+/// `/mnt/tg/work/users/alice` next to `/mnt/tg/home/users/bob`. Each provider
+/// sees its own directory as its mount point, which keeps its absolute
+/// symlinks pointing into it, and its kernel invalidations are prefixed with
+/// the directory. The root itself is read-only.
+class AccountsProvider : public DataProvider {
+public:
+    /// @param accounts Providers by account name (each name is one path component)
+    explicit AccountsProvider(std::map<std::string, std::shared_ptr<DataProvider>> accounts);
+    ~AccountsProvider() override = default;
+
+    // DataProvider interface implementation
+    [[nodiscard]] std::vector<Entry> list_directory(std::string_view path) override;
+    int visit_directory(std::string_view path, const EntryVisitor& visit) override;
+    [[nodiscard]] std::optional<Entry> get_entry(std::string_view path) override;
+    [[nodiscard]] bool exists(std::string_view path) override;
+    [[nodiscard]] bool is_directory(std::string_view path) override;
+    [[nodiscard]] bool is_symlink(std::string_view path) override;
+    [[nodiscard]] FileContent read_file(std::string_view path) override;
+    [[nodiscard]] std::string read_link(std::string_view path) override;
+    [[nodiscard]] std::string get_filesystem_name() const override { return "tg-fuse"; }
+
+    // Write operations
+    WriteResult write_file(std::string_view path, const char* data, std::size_t size, off_t offset) override;
+    int truncate_file(std::string_view path, off_t size) override;
+    [[nodiscard]] bool is_writable(std::string_view path) const override;
+    [[nodiscard]] bool is_append_only(std::string_view path) const override;
+
+    // File upload operations
+    int create_file(std::string_view path, mode_t mode, uint64_t& fh) override;
+    WriteResult
+    write_file(std::string_view path, const char* data, std::size_t size, off_t offset, uint64_t fh) override;
+    int release_file(std::string_view path, uint64_t fh) override;
+
+    // Mount point and invalidations, passed on to each account under its directory
+    void set_mount_point(std::string mount_point) override;
+    void set_invalidate_callback(InvalidateCallback callback) override;
+
+private:
+    /// An account's provider and a path within it
+    struct Route {
+        const std::string& name;
+        DataProvider* provider;
+        std::string path;  // "/" for the account's directory
+    };
+
+    /// The account @p path is in, or nullopt for the root and unknown accounts
+    [[nodiscard]] std::optional<Route> route(std::string_view path) const;
+
+    /// Whether @p path is the root directory
+    [[nodiscard]] static bool is_root(std::string_view path) { return path.empty() || path == "/"; }
+
+    /// Directory entry of an account, with the attributes of its provider's root
+    [[nodiscard]] Entry account_entry(const std::string& name, DataProvider& provider) const;
+
+    std::map<std::string, std::shared_ptr<DataProvider>> accounts_;
+};
+
+}  // namespace tgfuse
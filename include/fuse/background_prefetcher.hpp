@@ -2,46 +2,88 @@
 
 #include "fuse/messages_cache.hpp"
 #include "tg/cache.hpp"
-#include "tg/client.hpp"
-#include "tg/rate_limiter.hpp"
+#include "tg/timer_wheel.hpp"
 
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <functional>
+#include <map>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <set>
 #include <thread>
-#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace tgfuse {
 
 /// Priority for prefetch queue
 enum class PrefetchPriority { HIGH = 0, NORMAL = 1, LOW = 2 };
 
+/// What a prefetch job loads
+enum class PrefetchKind {
+    MESSAGES,  // Formatted messages into the TLRU cache
+    FILES      // The files/ and media/ listing into SQLite
+};
+
+class PrefetchPool;
+
 /// Configuration for BackgroundPrefetcher
 struct BackgroundPrefetcherConfig {
-    std::chrono::milliseconds rate_limit_interval{500};  // Min time between API requests
-    std::chrono::seconds prefetch_interval{300};         // Check for new chats every 5 min
-    std::chrono::seconds max_history_age{172800};        // 48h max message age
-    std::size_t min_messages{10};                        // Min messages to fetch per chat
-    bool exclude_archived{true};                         // Skip archived chats
+    std::size_t workers{2};                         // Jobs fetched at once (all share the client's rate limiter)
+    std::shared_ptr<PrefetchPool> pool;             // Workers shared with other accounts (replaces `workers`)
+    std::chrono::seconds prefetch_interval{300};    // Queue chats that changed every 5 min
+    std::size_t min_messages{10};                   // Min messages to fetch per chat
+    bool exclude_archived{true};                    // Skip archived chats
+    std::chrono::seconds access_half_life{1800};    // How fast a chat's access score fades
+    std::chrono::seconds activity_half_life{3600};  // How fast a chat's message rate estimate fades
+    std::chrono::seconds expiry_resolution{10};     // Granularity of the cache expiry timers
 };
 
-/// Background worker that prefetches messages for chats
+/// Background scheduler that prefetches chats before they are read
+///
+/// A pool of workers takes jobs most urgent first: by priority, then by a
+/// score combining how recently the chat was accessed, how many messages
+/// arrived since, and how busy the chat is. Listings queue what they show
+/// (the chats of a section, the files of an opened chat).
+///
+/// Background work never rescans every chat after startup. One scan queues
+/// the known chats that SQLite says are stale, ordered contacts → other
+/// users → groups → channels. After that, each prefetch_interval only queues
+/// the chats marked dirty by message events since the last cycle, and a
+/// timer wheel re-queues chats still in use when their formatted text
+/// expires. A cycle costs O(changed chats), not O(all chats).
+///
+/// Requests go through the client's rate limiter in the background lane, so
+/// they only use capacity interactive requests leave over; HIGH jobs are
+/// fetched in the interactive lane.
+///
+/// With a PrefetchPool in the config the jobs run on the pool's workers
+/// instead of threads of the prefetcher's own.
 ///
-/// Respects Telegram API rate limits to avoid flood bans.
-/// Prioritises fetching: contacts → other users → groups → channels
-/// Stores fetched messages in SQLite, updates chat stats.
+/// The prefetcher only keeps its own jobs from running twice. Loaders are
+/// expected to join a fetch of the same chat already started by a reader
+/// (the provider's go through its single flights) rather than repeat it,
+/// but never to make a reader wait for a background job's fetch.
 class BackgroundPrefetcher {
 public:
     using Priority = PrefetchPriority;
+    using Kind = PrefetchKind;
     using Config = BackgroundPrefetcherConfig;
+    using Clock = std::chrono::steady_clock;
+
+    /// Loads one chat's data into its cache (runs on a prefetch worker)
+    using Loader = std::function<void(int64_t chat_id)>;
 
     BackgroundPrefetcher(
-        tg::TelegramClient& client,
         FormattedMessagesCache& cache,
         tg::CacheManager& db_cache,
+        Loader load_messages,
+        Loader load_files,
         Config config = {}
     );
 
@@ -51,58 +93,176 @@ public:
     BackgroundPrefetcher(const BackgroundPrefetcher&) = delete;
     BackgroundPrefetcher& operator=(const BackgroundPrefetcher&) = delete;
 
-    /// Start background prefetch thread
+    /// Start the worker threads (or join the pool)
     void start();
 
-    /// Stop and join thread
+    /// Stop and join the workers, or wait for the pool's running jobs (queued jobs are dropped)
     void stop();
 
-    /// Queue a specific chat for priority fetch
+    /// Queue a chat's messages for fetching
     /// @param chat_id The chat to fetch
     /// @param priority Fetch priority (HIGH for on-demand, NORMAL for background)
     void queue_chat(int64_t chat_id, Priority priority = Priority::NORMAL);
 
+    /// Queue the messages of several chats (e.g. the ones a listing shows)
+    void queue_chats(const std::vector<int64_t>& chat_ids, Priority priority = Priority::NORMAL);
+
+    /// Queue a chat's file listing for fetching
+    void queue_files(int64_t chat_id, Priority priority = Priority::NORMAL);
+
+    /// A chat was opened or read
+    void record_access(int64_t chat_id);
+
+    /// A new message arrived in a chat
+    void record_message(int64_t chat_id);
+
+    /// A chat changed without a message reaching us (e.g. its last message was edited or deleted)
+    void mark_dirty(int64_t chat_id);
+
+    /// Current scheduling score of a chat (higher is fetched first)
+    [[nodiscard]] double score(int64_t chat_id) const;
+
+    /// Number of queued jobs (not counting the running ones)
+    [[nodiscard]] std::size_t queued() const;
+
     /// Check if prefetcher is running
     [[nodiscard]] bool is_running() const { return running_.load(); }
 
-    /// Set callback for user resolution (needed for formatting)
-    using UserResolver = std::function<const tg::User&(int64_t)>;
-    using ChatResolver = std::function<const tg::Chat&(int64_t)>;
+private:
+    friend class PrefetchPool;
+
+    using JobKey = std::pair<int64_t, Kind>;
 
-    void set_resolvers(UserResolver user_resolver, ChatResolver chat_resolver);
+    /// A queued job
+    struct Job {
+        Priority priority;
+        uint64_t sequence;  // Queue order, the last tie-breaker
+    };
 
-private:
-    /// Main prefetch loop (runs in background thread)
-    void prefetch_loop();
+    /// Decayed usage of one chat
+    struct ChatActivity {
+        double access{0.0};     // Accesses, fading with access_half_life
+        double messages{0.0};   // Message arrivals, fading with activity_half_life
+        std::size_t unseen{0};  // Messages since the last access
+        Clock::time_point updated;
+    };
+
+    /// What a worker does next
+    struct Work {
+        enum class Type { NONE, JOB, SCAN };
+
+        Type type{Type::NONE};
+        JobKey key{};
+        Priority priority{Priority::LOW};
+        Clock::time_point wake{Clock::time_point::max()};  // With NONE: when work may be due
+    };
+
+    /// Worker thread function
+    void worker_loop();
+
+    /// Take the next job, or the startup scan if it is due (mutex_ held)
+    [[nodiscard]] Work take_work_locked(Clock::time_point now);
+
+    /// Take the next work item without waiting (NONE once stopped)
+    [[nodiscard]] Work try_take_work();
+
+    /// Run taken work and release its job
+    void run_work(const Work& work);
+
+    /// Wake the workers (the pool's, if there is one); mutex_ must not be held
+    void notify_workers(bool all);
 
-    /// Fetch messages for a single chat
-    void fetch_chat_messages(int64_t chat_id);
+    /// Run one job
+    /// @return true if it loaded something (false if it was skipped or failed)
+    bool run_job(const JobKey& key, Priority priority);
+
+    /// Queue a job, raising the priority of one already queued (mutex_ held)
+    void enqueue_locked(const JobKey& key, Priority priority);
+
+    /// Queued job to run next (not already running), or pending_.end() (mutex_ held)
+    [[nodiscard]] std::map<JobKey, Job>::iterator next_job_locked();
+
+    /// Score of a chat (mutex_ held)
+    [[nodiscard]] double score_locked(int64_t chat_id, Clock::time_point now) const;
+
+    /// Fade a chat's activity up to @p now (mutex_ held)
+    void decay(ChatActivity& activity, Clock::time_point now) const;
+
+    /// Queue the chats that changed and the ones whose text expired, if due (mutex_ held)
+    void run_timers_locked(Clock::time_point now);
+
+    /// Startup scan: queue every known chat that SQLite says is stale
+    void initial_scan();
 
     /// Get ordered list of chats to fetch
     /// Order: contacts → users → groups → channels, each sorted by last_message_time DESC
     std::vector<int64_t> get_chats_to_fetch();
 
-    /// Check if a chat needs fetching
-    bool needs_fetch(int64_t chat_id);
-
-    tg::TelegramClient& client_;
     FormattedMessagesCache& cache_;
     tg::CacheManager& db_cache_;
+    Loader load_messages_;
+    Loader load_files_;
     Config config_;
-    tg::RateLimiter rate_limiter_;
 
-    UserResolver user_resolver_;
-    ChatResolver chat_resolver_;
-
-    std::thread worker_;
+    std::vector<std::thread> workers_;
     std::atomic<bool> running_{false};
     std::condition_variable cv_;
-    std::mutex mutex_;
+    mutable std::mutex mutex_;
+
+    std::map<JobKey, Job> pending_;                       // Queued jobs, one per chat and kind
+    std::set<JobKey> in_flight_;                          // Jobs a worker is running
+    std::unordered_map<int64_t, ChatActivity> activity_;  // Usage of chats seen so far
+    uint64_t next_sequence_{0};
 
-    // Priority queue: (priority, -last_message_time, chat_id)
-    // Using negative time so higher (more recent) times come first
-    using QueueEntry = std::tuple<Priority, int64_t, int64_t>;
-    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<>> queue_;
+    bool scanned_{false};                // The startup scan has run (or a worker is running it)
+    std::unordered_set<int64_t> dirty_;  // Chats changed since the last cycle
+    Clock::time_point next_cycle_;       // When dirty_ is queued next
+    tg::TimerWheel expiries_;            // When chats' formatted text expires
+};
+
+/// Prefetch workers shared by the accounts of one daemon
+///
+/// Each worker takes the next job of the attached prefetchers in turn, so
+/// every account's prefetching runs on the same few threads and one
+/// account's backlog can't keep the others waiting. Prefetchers attach in
+/// start() and detach in stop(). Thread-safe.
+class PrefetchPool {
+public:
+    using Clock = BackgroundPrefetcher::Clock;
+
+    /// @param workers Number of worker threads (at least one is started)
+    explicit PrefetchPool(std::size_t workers);
+    ~PrefetchPool();
+
+    // Disable copy
+    PrefetchPool(const PrefetchPool&) = delete;
+    PrefetchPool& operator=(const PrefetchPool&) = delete;
+
+    /// Start giving @p prefetcher's jobs to the workers
+    void attach(BackgroundPrefetcher& prefetcher);
+
+    /// Stop giving @p prefetcher's jobs to the workers; waits for its running ones
+    void detach(BackgroundPrefetcher& prefetcher);
+
+    /// Work was queued in an attached prefetcher
+    void wake();
+
+private:
+    struct Member {
+        BackgroundPrefetcher* prefetcher;
+        std::size_t running{0};  // Its jobs the workers are running
+    };
+
+    /// Worker thread function
+    void worker_loop();
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable cv_;  // Work was queued, a job finished, or stopping
+    std::vector<Member> members_;
+    std::size_t next_{0};   // Member whose turn it is
+    uint64_t epoch_{0};     // Bumped by wake()
+    bool stopping_{false};
 };
 
 }  // namespace tgfuse
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <string_view>
 
 namespace tgfuse {
@@ -11,12 +12,27 @@ inline constexpr std::string_view kGroupsDir = "groups";
 inline constexpr std::string_view kChannelsDir = "channels";
 inline constexpr std::string_view kInfoFile = ".info";
 inline constexpr std::string_view kMessagesFile = "messages";
+inline constexpr std::string_view kMessagesTailFile = "messages.tail";
+inline constexpr std::string_view kHistoryDir = "history";
 inline constexpr std::string_view kFilesDir = "files";
 inline constexpr std::string_view kMediaDir = "media";
 inline constexpr std::string_view kSelfSymlink = "self";
 inline constexpr std::string_view kUploadsDir = ".uploads";
+inline constexpr std::string_view kStatsFile = ".stats";
+inline constexpr std::string_view kStatsPrometheusFile = ".stats.prom";
+inline constexpr std::string_view kTraceFile = ".trace";
 inline constexpr std::string_view kTxtFile = "txt";
 inline constexpr std::string_view kTextDir = "text";
+inline constexpr std::string_view kSearchDir = "search";
+
+// Daemon control socket, in the data directory (~/.local/share/tg-fuse)
+inline constexpr std::string_view kControlSocketFile = "tg-fused.sock";
+
+// Most messages a /search/<query> file lists (newest first)
+inline constexpr int kSearchResultLimit = 500;
+
+// Newest messages in a chat's messages.tail
+inline constexpr int kMessagesTailCount = 100;
 
 // txt file buffer limits (for rate limit protection)
 // Telegram message limit is 4096 bytes, so ~10 messages worth = 40KB
@@ -26,4 +42,15 @@ inline constexpr std::size_t kTxtMaxBufferSize = 40 * 1024;  // 40KB max buffer
 // After this many milliseconds of no writes, flush the buffer
 inline constexpr int kTxtFlushTimeoutMs = 2000;  // 2 seconds
 
+// TDLib chat/user updates are coalesced for this long before being applied
+// to the entity snapshot (startup delivers thousands of them in bursts)
+inline constexpr int kEntityUpdateBatchMs = 200;
+
+// Media streaming: bytes past each read to keep downloading in the background.
+// Files at or below this size are simply downloaded whole.
+inline constexpr std::size_t kMediaReadAheadBytes = 4 * 1024 * 1024;  // 4MB
+
+// Media read-ahead: files up to this size are downloaded when their media/ directory is listed
+inline constexpr std::size_t kMediaPrefetchMaxBytes = 2 * 1024 * 1024;  // 2MB
+
 }  // namespace tgfuse
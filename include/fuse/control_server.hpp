@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace tgfuse {
+
+/// A command received on the control socket
+struct ControlRequest {
+    std::string account;  // Account the command is for (empty for the default one)
+    std::string command;
+    std::vector<std::string> args;
+};
+
+/// Reply to a control request
+struct ControlResponse {
+    enum class Status {
+        OK,
+        ERROR,     // body is the error message
+        UNSERVED,  // The daemon doesn't serve the requested account
+    };
+
+    Status status{Status::OK};
+    std::string body;
+
+    static ControlResponse ok(std::string body = {}) { return {Status::OK, std::move(body)}; }
+    static ControlResponse error(std::string message) { return {Status::ERROR, std::move(message)}; }
+    static ControlResponse unserved() { return {Status::UNSERVED, {}}; }
+};
+
+/// Unix-domain socket the tg-fuse CLI talks to a running daemon through
+///
+/// Saves the CLI opening the SQLite cache next to the daemon, where it
+/// contends for the WAL and its changes never reach the daemon's
+/// in-memory caches. Each connection carries one request and one reply:
+///
+///     request:  <account> TAB <command> [TAB <arg>]... LF
+///     reply:    "ok" | "error" | "unserved" LF, then the output (or the error message) until EOF
+///
+/// Requests are served one at a time on the server's own thread, so
+/// handlers should only queue slow work. The socket is only accessible to
+/// the daemon's user.
+class ControlServer {
+public:
+    using Handler = std::function<ControlResponse(const ControlRequest&)>;
+
+    explicit ControlServer(std::string socket_path);
+    ~ControlServer();
+
+    ControlServer(const ControlServer&) = delete;
+    ControlServer& operator=(const ControlServer&) = delete;
+
+    /// Serve @p command with @p handler (register before start())
+    void add_handler(std::string command, Handler handler);
+
+    /// Bind the socket and start serving
+    /// A socket left by a daemon that died is replaced; one a live daemon answers on is not.
+    /// @return false if the socket can't be bound
+    bool start();
+
+    /// Stop serving and remove the socket
+    void stop();
+
+    [[nodiscard]] const std::string& socket_path() const { return socket_path_; }
+
+private:
+    /// Accept connections until stopped
+    void serve();
+
+    /// Read one request from @p fd, run its handler and send the reply
+    void handle(int fd);
+
+    /// Reply of the handler registered for @p request
+    [[nodiscard]] ControlResponse dispatch(const ControlRequest& request) const;
+
+    /// Whether a daemon answers on the socket path
+    [[nodiscard]] bool socket_in_use() const;
+
+    std::string socket_path_;
+    std::map<std::string, Handler> handlers_;
+    int listen_fd_{-1};
+    int wake_fds_[2]{-1, -1};  // Self-pipe that wakes serve() to stop
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+};
+
+}  // namespace tgfuse
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "fuse/shared_text.hpp"
+
 #include <sys/stat.h>
 #include <cstdint>
 #include <ctime>
+#include <functional>
 #include <optional>
 #include <string>
 #include <vector>
@@ -61,9 +64,27 @@ struct Entry {
 };
 
 /// File content result
+///
+/// Content is either held in memory (`data`), shared with a cache
+/// (`shared`, served without copying), backed by a local file
+/// (`local_path`), in which case readers serve it directly from disk,
+/// or streamed on demand through `range_reader` (e.g. partially
+/// downloaded media).
 struct FileContent {
+    /// Fill buf with up to size bytes from offset
+    /// @return Bytes read (0 at EOF), or negative errno
+    using RangeReader = std::function<int(char* buf, std::size_t size, off_t offset)>;
+
     std::string data;
     bool readable{true};
+    SharedText shared;         // If set, content lives in this shared buffer and data is empty
+    std::string local_path;    // If set, content lives in this file and data is empty
+    RangeReader range_reader;  // If set, content is fetched on demand and data is empty
+    bool direct_io{false};     // Generated at open, so its size isn't known in advance: bypass the page cache
+
+    [[nodiscard]] bool is_shared() const { return static_cast<bool>(shared); }
+    [[nodiscard]] bool is_file_backed() const { return !local_path.empty(); }
+    [[nodiscard]] bool is_streamed() const { return static_cast<bool>(range_reader); }
 };
 
 /// Write operation result
@@ -73,6 +94,10 @@ struct WriteResult {
     std::string error_message;
 };
 
+/// Receives directory entries one at a time (the entry is only valid during the call)
+/// @return false to stop the listing
+using EntryVisitor = std::function<bool(const Entry& entry)>;
+
 /// Abstract data provider interface
 ///
 /// This interface defines the contract for filesystem data sources.
@@ -88,6 +113,21 @@ public:
     /// @return Vector of entries in the directory
     [[nodiscard]] virtual std::vector<Entry> list_directory(std::string_view path) = 0;
 
+    /// List a directory, handing entries to @p visit as they are produced
+    ///
+    /// Called once per opendir: readdir calls page through what that
+    /// captured. The default wraps list_directory; providers override it for
+    /// large directories to skip the intermediate vector.
+    /// @return 0 (also when @p visit stops early), or negative errno
+    virtual int visit_directory(std::string_view path, const EntryVisitor& visit) {
+        for (const auto& entry : list_directory(path)) {
+            if (!visit(entry)) {
+                break;
+            }
+        }
+        return 0;
+    }
+
     /// Get entry information for a path
     /// @param path Absolute path to the entry
     /// @return Entry information if exists, nullopt otherwise
@@ -214,6 +254,14 @@ public:
     /// Get the mount point
     [[nodiscard]] const std::string& get_mount_point() const { return mount_point_; }
 
+    /// Callback that drops the kernel's cached attributes, entry and data for a path
+    using InvalidateCallback = std::function<void(const std::string& path)>;
+
+    /// Set the kernel cache invalidation callback (installed by the VFS when mounting)
+    /// Providers whose content changes behind the kernel's back call it on updates
+    /// @param callback Invalidation callback, may be empty
+    virtual void set_invalidate_callback(InvalidateCallback callback) { (void)callback; }
+
 protected:
     std::string mount_point_;
 };
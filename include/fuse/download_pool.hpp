@@ -0,0 +1,97 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace tgfuse {
+
+/// Configuration for DownloadPool
+struct DownloadPoolConfig {
+    std::size_t workers{2};       // Downloads running at once (0 disables read-ahead)
+    std::size_t max_queued{256};  // Queued downloads kept; the oldest are dropped past this
+    std::size_t max_done{4096};   // Finished keys remembered so listings don't queue them again
+};
+
+/// Bounded pool for speculative downloads
+///
+/// Jobs are keyed (by remote file id), so a key queued, running or already
+/// finished is not queued again. Each batch goes ahead of what is still
+/// queued: the latest listing is what the user is looking at. Workers hold
+/// off while an interactive download is running, so read-ahead only uses
+/// the bandwidth reads leave over.
+class DownloadPool {
+public:
+    using Config = DownloadPoolConfig;
+
+    /// Download job (runs on a pool worker; a throw leaves the key retryable)
+    using Job = std::function<void()>;
+
+    /// Marks an interactive download for its lifetime (the pool yields meanwhile)
+    class InteractiveScope {
+    public:
+        explicit InteractiveScope(DownloadPool* pool);
+        ~InteractiveScope();
+
+        InteractiveScope(const InteractiveScope&) = delete;
+        InteractiveScope& operator=(const InteractiveScope&) = delete;
+
+    private:
+        DownloadPool* pool_;
+    };
+
+    explicit DownloadPool(Config config = {});
+    ~DownloadPool();
+
+    DownloadPool(const DownloadPool&) = delete;
+    DownloadPool& operator=(const DownloadPool&) = delete;
+
+    /// Start the worker threads
+    void start();
+
+    /// Stop and join the workers (queued jobs are dropped)
+    void stop();
+
+    /// Queue @p jobs, in order, ahead of the ones already queued
+    void queue(std::vector<std::pair<std::string, Job>> jobs);
+
+    /// An interactive download starts: keep the workers idle until the scope ends
+    [[nodiscard]] InteractiveScope interactive() { return InteractiveScope(this); }
+
+    /// Number of queued jobs
+    [[nodiscard]] std::size_t queued() const;
+
+private:
+    struct Entry {
+        std::string key;
+        Job job;
+    };
+
+    void worker_loop();
+
+    /// Remember @p key as finished, forgetting the oldest past max_done (mutex_ held)
+    void mark_done_locked(const std::string& key);
+
+    Config config_;
+
+    std::vector<std::thread> workers_;
+    bool running_{false};
+    std::condition_variable cv_;
+    mutable std::mutex mutex_;
+
+    std::deque<Entry> queue_;                       // Next job first
+    std::unordered_set<std::string> queued_;        // Keys in queue_
+    std::unordered_set<std::string> running_keys_;  // Keys a worker is running
+    std::unordered_set<std::string> done_;          // Finished keys
+    std::deque<std::string> done_order_;            // done_ oldest first, for trimming
+    std::size_t interactive_{0};                    // Interactive downloads in progress
+};
+
+}  // namespace tgfuse
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "fuse/platform.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace tgfuse {
+
+/// Inode number as seen by the kernel (matches fuse_ino_t)
+using InodeNumber = uint64_t;
+
+/// Stable inode table for the low-level FUSE backend
+///
+/// Maps kernel inode numbers to paths understood by FuseOperations and back.
+/// Every successful lookup (including readdirplus entries and create) bumps
+/// the node's lookup count; the kernel's forget drops it, and a node is
+/// released once the count reaches zero. The root inode is never released.
+/// Inode numbers are never reused while the table lives.
+class InodeTable {
+public:
+    static constexpr InodeNumber kRootInode = 1;
+
+    InodeTable();
+
+    /// Look up (or create) the child @p name of @p parent and count one lookup
+    /// @return Child inode number and path, or nullopt if @p parent is unknown
+    [[nodiscard]] std::optional<std::pair<InodeNumber, std::string>> acquire(InodeNumber parent, std::string_view name);
+
+    /// Drop @p count lookups of @p ino, releasing the node when none remain
+    void forget(InodeNumber ino, uint64_t count);
+
+    /// Path of a known inode
+    [[nodiscard]] std::optional<std::string> path(InodeNumber ino) const;
+
+    /// Path of a child of a known inode (does not create a node)
+    [[nodiscard]] std::optional<std::string> child_path(InodeNumber parent, std::string_view name) const;
+
+    /// Node currently bound to @p path
+    struct Binding {
+        InodeNumber ino;
+        InodeNumber parent;
+        std::string name;
+    };
+
+    /// Find the node bound to a path (for cache invalidation)
+    [[nodiscard]] std::optional<Binding> find(std::string_view path) const;
+
+    /// Number of live nodes (including the root)
+    [[nodiscard]] std::size_t size() const;
+
+private:
+    struct Node {
+        std::string path;
+        InodeNumber parent;
+        uint64_t lookups{0};
+    };
+
+    [[nodiscard]] static std::string join(const std::string& parent, std::string_view name);
+
+    std::unordered_map<InodeNumber, Node> nodes_;
+    std::unordered_map<std::string, InodeNumber> by_path_;
+    InodeNumber next_ino_{kRootInode + 1};
+    mutable std::mutex mutex_;
+};
+
+/// Options for a low-level FUSE session
+struct LowLevelOptions {
+    std::string mount_point;
+    bool debug{false};           // Enable FUSE debug output
+    bool allow_other{false};     // Allow other users to access mount
+    unsigned worker_threads{1};  // FUSE worker threads (1 = single-threaded session)
+    double attr_timeout{0.0};    // Seconds the kernel may cache attributes
+    double entry_timeout{0.0};   // Seconds the kernel may cache lookups
+    bool kernel_cache{false};    // Keep file data in the page cache across opens
+
+    /// Write size and caching negotiated with the kernel
+    ConnectionOptions connection;
+};
+
+/// Low-level (inode based) FUSE backend
+///
+/// Drives a fuse_lowlevel_ops session on top of the same FuseOperations
+/// implementation as the high-level PlatformAdapter. Lookups are answered
+/// once per name and then served by inode, readdirplus returns attributes
+/// with the listing, so deep walks avoid a separate lookup per entry.
+/// Only available with libfuse3; FUSE 2.x builds report -ENOSYS.
+class LowLevelAdapter {
+public:
+    /// Mount and run the session until unmounted or interrupted
+    /// @param impl Operations implementation (must outlive the session)
+    /// @param options Session options
+    /// @return 0 on clean exit, non-zero on failure
+    static int run(FuseOperations& impl, const LowLevelOptions& options);
+
+    /// Drop the kernel's cached entry, attributes and data for a path
+    /// @param path Absolute path inside the mount
+    /// @return 0 on success or if the kernel doesn't know the path, negative errno on error
+    static int invalidate_path(const char* path);
+
+    /// Check whether a low-level session is currently running
+    [[nodiscard]] static bool is_running();
+};
+
+}  // namespace tgfuse
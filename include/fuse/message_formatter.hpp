@@ -1,7 +1,7 @@
 #pragma once
 
 #include <cstddef>
-#include <string>
+#include <string_view>
 #include <vector>
 
 namespace tgfuse {
@@ -18,6 +18,7 @@ public:
     static std::size_t estimate_size(std::size_t message_count);
 
     /// Check if data appears to be valid text (not binary)
+    /// Text is well-formed UTF-8 without NULs and with few control characters (see tg::TextScan).
     /// @param data Data buffer
     /// @param size Size of data
     /// @return true if data is valid text
@@ -26,8 +27,8 @@ public:
     /// Split large text into chunks suitable for Telegram messages
     /// @param text Text to split
     /// @param max_size Maximum size per chunk (default 4096)
-    /// @return Vector of text chunks
-    static std::vector<std::string> split_message(const std::string& text, std::size_t max_size = 4096);
+    /// @return Chunks pointing into @p text, split at whitespace or else between characters
+    static std::vector<std::string_view> split_message(std::string_view text, std::size_t max_size = 4096);
 
     static constexpr std::size_t AVG_MESSAGE_SIZE = 150;  // Conservative estimate per message
     static constexpr std::size_t DEFAULT_FALLBACK_SIZE = 4096;
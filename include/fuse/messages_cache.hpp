@@ -1,15 +1,20 @@
 #pragma once
 
+#include "fuse/shared_text.hpp"
+#include "tg/message_template.hpp"
 #include "tg/types.hpp"
 
 #include <bustache/format.hpp>
 
 #include <chrono>
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -18,18 +23,23 @@
 namespace tgfuse {
 
 /// Callback type for resolving sender and chat information
-using UserResolver = std::function<const tg::User&(int64_t sender_id)>;
+/// A sender the user resolver doesn't know (nullptr) is rendered as "User <id>".
+using UserResolver = std::function<const tg::User*(int64_t sender_id)>;
 using ChatResolver = std::function<const tg::Chat&(int64_t chat_id)>;
 
 /// Configuration for the TLRU formatted messages cache
 struct MessagesCacheConfig {
     std::size_t max_chats = 100;                                    // Maximum number of chats in LRU
+    std::size_t max_bytes = 64 * 1024 * 1024;                       // Byte budget for formatted text (hot tier)
+    std::size_t cold_max_bytes = 16 * 1024 * 1024;                  // Compressed evicted text budget (0 = no cold tier)
     std::chrono::seconds format_ttl = std::chrono::hours{1};        // Formatted text staleness TTL (1 hour)
     std::chrono::seconds max_history_age = std::chrono::hours{48};  // Max age of messages to display
     std::size_t min_messages = 10;                                  // Minimum messages to fetch from API
 
     /// Mustache template for formatting individual messages
     /// Available placeholders: {{sender}}, {{time}}, {{message}}
+    /// Templates using only these render through tg::MessageTemplate; sections and
+    /// partials fall back to bustache, which is noticeably slower
     std::string message_format = "> **{{sender}}** [{{time}}]: {{message}}";
 };
 
@@ -41,20 +51,45 @@ struct MessagesCacheConfig {
 ///
 /// Key design decisions:
 /// - TLRU eviction: entries expire after format_ttl (1 hour default)
-/// - LRU eviction when over capacity
+/// - Weighted LRU eviction: entries are charged their size against max_bytes
+///   (and never exceed max_chats)
+/// - Optional cold tier: evicted entries that are still fresh are kept
+///   zlib-compressed (within cold_max_bytes) and re-served without reformatting
+/// - Content is handed out as SharedText: readers keep a stable view even if
+///   the entry is appended to, invalidated or evicted meanwhile
 /// - Raw messages stored in SQLite (not in this cache)
 /// - Thread-safe access with mutex protection
-/// - On new message: invalidate entry (lazy reformat on next read)
+/// - On new message: format only that message and append it; messages older
+///   than max_history_age are trimmed from the head via a per-message offset index
 class FormattedMessagesCache {
 public:
     using Config = MessagesCacheConfig;
 
+    /// Where one message ends in the formatted content
+    struct MessageExtent {
+        int64_t message_id;
+        int64_t timestamp;
+        std::size_t end;  // Offset just past the message's text in CacheEntry::content
+    };
+
     /// Cache entry for a single chat (formatted text only, no raw messages)
+    ///
+    /// Handed-out ranges of content are never modified: new text is appended
+    /// in place only while it fits the buffer's capacity, otherwise the live
+    /// part moves to a new buffer.
     struct CacheEntry {
-        std::string content;                                 // Formatted messages content
-        std::size_t message_count{0};                        // Number of messages in content
+        std::shared_ptr<std::string> content;                // Formatted messages content
+        std::size_t head{0};                                 // Bytes of content already trimmed (expired)
+        std::deque<MessageExtent> index;                     // Messages in content, oldest first
         int64_t newest_message_id{0};                        // ID of newest message (for append detection)
         std::chrono::steady_clock::time_point formatted_at;  // When this was formatted (for TTL)
+        std::size_t weight{0};                               // Bytes charged against max_bytes
+
+        /// Live (untrimmed) part of the content
+        [[nodiscard]] std::string_view view() const { return std::string_view(*content).substr(head); }
+
+        /// Shareable handle to the live part of the content
+        [[nodiscard]] SharedText share() const { return SharedText(content, head, content->size() - head); }
     };
 
     explicit FormattedMessagesCache(Config config = {});
@@ -66,8 +101,8 @@ public:
 
     /// Get formatted content for a chat (returns nullopt if not cached or stale)
     /// @param chat_id The chat ID
-    /// @return The formatted content, or nullopt if not cached or TTL expired
-    [[nodiscard]] std::optional<std::string_view> get(int64_t chat_id);
+    /// @return Handle to the formatted content, or nullopt if not cached or TTL expired
+    [[nodiscard]] std::optional<SharedText> get(int64_t chat_id);
 
     /// Get the content size for a chat (for fstat reporting)
     /// @param chat_id The chat ID
@@ -82,17 +117,47 @@ public:
     /// @return true if stale or not cached
     [[nodiscard]] bool is_stale(int64_t chat_id) const;
 
-    /// Store formatted content for a chat
-    /// Called after formatting messages from SQLite
+    /// Format messages and store them as a chat's content
+    /// Called after loading messages from SQLite or the API
+    /// @param chat_id The chat ID
+    /// @param messages Messages sorted oldest first (e.g. a tg::MessageBatch)
+    /// @param user_resolver Resolves message senders
+    /// @param chat_resolver Resolves the chat
+    /// @return Handle to the formatted content
+    SharedText store(
+        int64_t chat_id,
+        std::span<const tg::MessageView> messages,
+        const UserResolver& user_resolver,
+        const ChatResolver& chat_resolver
+    );
+
+    /// Append new messages to a chat's cached content, formatting only those
+    /// Expired messages are trimmed from the head at the same time.
     /// @param chat_id The chat ID
-    /// @param content The pre-formatted content string
-    /// @param message_count Number of messages in the content
-    /// @param newest_message_id ID of the newest message
-    void store(int64_t chat_id, std::string content, std::size_t message_count, int64_t newest_message_id);
+    /// @param messages New messages sorted oldest first
+    /// @return false if the chat isn't cached or the messages don't follow the
+    ///         cached ones (the entry is then invalidated and reformatted on next read)
+    bool append(
+        int64_t chat_id,
+        std::span<const tg::MessageView> messages,
+        const UserResolver& user_resolver,
+        const ChatResolver& chat_resolver
+    );
+
+    /// Format messages with the cache's template without storing them (e.g. search results)
+    [[nodiscard]] std::string render(
+        std::span<const tg::MessageView> messages,
+        const UserResolver& user_resolver,
+        const ChatResolver& chat_resolver
+    ) const;
 
     /// Invalidate cache for a specific chat (forces reformat on next read)
     void invalidate(int64_t chat_id);
 
+    /// Forget a sender's rendered display name (call when the user changes)
+    /// Content already formatted with the old name is left alone until reformatted.
+    void invalidate_sender(int64_t user_id);
+
     /// Clear all cached content
     void clear();
 
@@ -104,22 +169,90 @@ public:
 
     /// Get cache statistics
     struct Stats {
-        std::size_t chat_count;
-        std::size_t total_content_size;
+        std::size_t chat_count;          // Chats in the hot tier
+        std::size_t total_content_size;  // Formatted bytes served from the hot tier
+        std::size_t hot_bytes;           // Bytes charged against max_bytes (content and index)
+        std::size_t cold_chat_count;     // Chats in the cold tier
+        std::size_t cold_bytes;          // Compressed bytes in the cold tier
+        std::size_t cold_raw_bytes;      // Uncompressed size of the cold tier content
+        double compression_ratio;        // cold_raw_bytes / cold_bytes (0 when empty)
         std::size_t hit_count;
+        std::size_t cold_hit_count;  // Hits served by decompressing a cold entry
         std::size_t miss_count;
     };
     [[nodiscard]] Stats get_stats() const;
 
 private:
+    /// Evicted entry kept compressed
+    struct ColdEntry {
+        std::string compressed;  // zlib-compressed live content
+        std::size_t raw_size{0};
+        std::deque<MessageExtent> index;  // Rebased onto the live content
+        int64_t newest_message_id{0};
+        std::chrono::steady_clock::time_point formatted_at;
+    };
+
+    /// Bytes an entry is charged against max_bytes
+    [[nodiscard]] static std::size_t weight_of(const CacheEntry& entry);
+
+    /// Recompute an entry's weight after its content changed
+    void reweigh(CacheEntry& entry);
+
+    /// Insert an entry at the front of the hot LRU, making room first
+    /// @return The stored entry, or nullptr if it exceeds max_bytes on its own (it isn't cached)
+    CacheEntry* insert_hot(int64_t chat_id, CacheEntry entry);
+
+    /// Compress an entry into the cold tier (if enabled and the entry is still fresh)
+    void demote(int64_t chat_id, CacheEntry entry);
+
+    /// Decompress a cold entry back into the hot tier
+    /// @return The promoted entry, or nullptr if there is none or it can't be promoted
+    CacheEntry* promote(int64_t chat_id);
+
+    /// Remove a chat from the cold tier
+    void erase_cold(int64_t chat_id);
+
+    /// TTL check shared by both tiers
+    [[nodiscard]] bool expired(std::chrono::steady_clock::time_point formatted_at) const;
+
+    /// Render messages into @p text, recording their extents in @p index
+    ///
+    /// @p text is reserved once for the whole batch and every message is
+    /// written straight into it. Senders and chats are resolved once per
+    /// distinct id, not per message.
+    /// @param base Offset of @p text's start in the entry's content
+    void format_messages(
+        std::span<const tg::MessageView> messages,
+        const UserResolver& user_resolver,
+        const ChatResolver& chat_resolver,
+        std::string& text,
+        std::deque<MessageExtent>& index,
+        std::size_t base
+    ) const;
+
+    /// Append rendered text to an entry without touching handed-out ranges
+    static void append_text(CacheEntry& entry, std::string_view text, std::deque<MessageExtent>& extents);
+
+    /// Drop messages older than max_history_age from the head (keeping at least min_messages)
+    void trim_expired(CacheEntry& entry) const;
+
     /// Touch a chat to mark it as recently used (moves to front of LRU)
     void touch(int64_t chat_id);
 
-    /// Evict least recently used entries if over capacity
-    void evict_if_needed();
+    /// Evict least recently used entries until @p chats more entries of @p bytes fit
+    void evict_if_needed(std::size_t chats, std::size_t bytes);
 
     Config config_;
     bustache::format message_template_;  // Compiled template (thread-safe for reads)
+    std::optional<tg::MessageTemplate> fast_template_;  // Emitter form of the template, if it's simple enough
+
+    /// Look up (or render and remember) a sender's display name
+    [[nodiscard]] std::string sender_name(const tg::User& user) const;
+
+    // Rendered sender display names shared by all formatting passes (own lock:
+    // store() renders outside mutex_)
+    mutable std::unordered_map<int64_t, std::string> sender_names_;
+    mutable std::mutex sender_names_mutex_;
 
     // LRU list: front = most recently used, back = least recently used
     std::list<int64_t> lru_list_;
@@ -127,9 +260,17 @@ private:
     // Map from chat_id to (iterator in lru_list, cache entry)
     using LruIterator = std::list<int64_t>::iterator;
     std::unordered_map<int64_t, std::pair<LruIterator, CacheEntry>> cache_;
+    std::size_t hot_bytes_{0};
+
+    // Cold tier, with its own LRU
+    std::list<int64_t> cold_lru_list_;
+    std::unordered_map<int64_t, std::pair<LruIterator, ColdEntry>> cold_;
+    std::size_t cold_bytes_{0};
+    std::size_t cold_raw_bytes_{0};
 
     mutable std::mutex mutex_;
     mutable std::size_t hit_count_{0};
+    mutable std::size_t cold_hit_count_{0};
     mutable std::size_t miss_count_{0};
 };
 
@@ -2,6 +2,7 @@
 
 #include "fuse/data_provider.hpp"
 
+#include <chrono>
 #include <cstdint>
 #include <map>
 #include <mutex>
@@ -37,13 +38,33 @@ struct MockChannel {
     std::string description;
 };
 
+/// Size and simulated backend behaviour of the mock tree
+///
+/// With no users, groups or channels the small demo tree is served.
+struct MockProviderConfig {
+    std::size_t users{0};                  // Generated users (user0001, ...)
+    std::size_t groups{0};                 // Generated groups (group0001, ...)
+    std::size_t channels{0};               // Generated channels (channel0001, ...)
+    std::size_t messages_per_chat{20};     // Messages in every chat's messages file
+    std::chrono::microseconds latency{0};  // Simulated round trip of each backend call
+    std::chrono::microseconds jitter{0};   // Uniform spread around latency
+};
+
 /// Mock data provider implementation
 ///
-/// Provides a virtual filesystem with mock Telegram data for testing
-/// and development purposes.
+/// Provides a virtual filesystem with mock Telegram data for testing,
+/// development and load testing. Every chat directory holds .info,
+/// messages and an append-only txt file; text written to txt is
+/// appended to the chat's messages as if it had been sent.
+///
+/// Calls that would reach Telegram through the real provider (listing the
+/// chat directories, reading files, sending text) sleep for the configured
+/// latency, outside the provider's lock; lookups are served from memory.
 class MockDataProvider : public DataProvider {
 public:
-    MockDataProvider();
+    using Config = MockProviderConfig;
+
+    explicit MockDataProvider(Config config = {});
     ~MockDataProvider() override = default;
 
     // DataProvider interface implementation
@@ -56,6 +77,13 @@ public:
     [[nodiscard]] std::string read_link(std::string_view path) override;
     [[nodiscard]] std::string get_filesystem_name() const override { return "tg-fuse-mock"; }
 
+    // Write operations (txt files)
+    using DataProvider::write_file;  // The handle overload forwards here
+    WriteResult write_file(std::string_view path, const char* data, std::size_t size, off_t offset) override;
+    int truncate_file(std::string_view path, off_t size) override;
+    [[nodiscard]] bool is_writable(std::string_view path) const override;
+    [[nodiscard]] bool is_append_only(std::string_view path) const override;
+
     // Mock-specific methods for testing/configuration
     void add_user(const MockUser& user);
     void add_group(const MockGroup& group);
@@ -75,6 +103,8 @@ private:
         USER_INFO,
         GROUP_INFO,
         CHANNEL_INFO,
+        CHAT_MESSAGES,  // <section>/<name>/messages
+        CHAT_TXT,       // <section>/<name>/txt
         USER_SYMLINK,
         NOT_FOUND
     };
@@ -83,6 +113,7 @@ private:
     struct PathInfo {
         PathCategory category{PathCategory::NOT_FOUND};
         std::string entity_name;  // Username, group name, or channel name
+        std::string chat_key;     // For chat files: "<section>/<name>", the messages_ key
     };
 
     /// Parse a path into its components
@@ -100,10 +131,25 @@ private:
     /// Populate with default mock data
     void populate_default_data();
 
+    /// Populate with the users, groups and channels counted in config_
+    void populate_generated_data();
+
+    /// Give every chat a messages file of config_.messages_per_chat messages
+    void populate_messages();
+
+    /// Sleep for one simulated backend round trip
+    void simulate_latency() const;
+
+    /// Chat files of the chat directory @p chat_key
+    [[nodiscard]] std::vector<Entry> list_chat_files(const std::string& chat_key) const;
+
+    Config config_;
+
     // Mock data storage (keyed by name)
     std::map<std::string, MockUser> users_;
     std::map<std::string, MockGroup> groups_;
     std::map<std::string, MockChannel> channels_;
+    std::map<std::string, std::string> messages_;  // Formatted messages by chat key ("users/alice")
 
     mutable std::mutex mutex_;
 };
@@ -2,8 +2,15 @@
 
 #include "fuse/data_provider.hpp"
 #include "fuse/platform.hpp"
+#include "tg/metrics.hpp"
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace tgfuse {
 
@@ -11,6 +18,18 @@ namespace tgfuse {
 ///
 /// This class implements the FuseOperations interface by delegating
 /// to a DataProvider for actual filesystem data.
+///
+/// Files opened read-only get an immutable content snapshot pinned to
+/// their file handle, so sequential reads slice the same buffer instead
+/// of asking the provider to re-materialise the whole file per chunk.
+/// File-backed content (downloaded media) keeps an open descriptor
+/// instead and is served with pread(), never copied onto the heap;
+/// streamed content is fetched range by range through its reader.
+/// Likewise a directory is listed once per opendir handle, and readdir
+/// pages through that capture.
+///
+/// The main callbacks are timed into fuse_op_seconds histograms, labelled
+/// by operation, in the process-wide metrics registry.
 class DataProviderOperations : public FuseOperations {
 public:
     /// Construct operations with a data provider
@@ -21,7 +40,9 @@ public:
 
     // FuseOperations interface
     int getattr(const char* path, struct stat* stbuf) override;
-    int readdir(const char* path, DirFiller filler, off_t offset) override;
+    int opendir(const char* path, struct fuse_file_info* fi) override;
+    int readdir(const char* path, DirFiller filler, off_t offset, struct fuse_file_info* fi) override;
+    int releasedir(const char* path, struct fuse_file_info* fi) override;
     int readlink(const char* path, char* buf, size_t size) override;
     int open(const char* path, struct fuse_file_info* fi) override;
     int read(const char* path, char* buf, size_t size, off_t offset, struct fuse_file_info* fi) override;
@@ -47,7 +68,69 @@ public:
 #endif
 
 private:
+    /// Immutable file content shared between an open handle and in-flight reads
+    struct OpenFile {
+        FileContent content;
+        int fd{-1};  // Descriptor for file-backed content
+
+        explicit OpenFile(FileContent c, int descriptor = -1) : content(std::move(c)), fd(descriptor) {}
+        ~OpenFile();
+
+        OpenFile(const OpenFile&) = delete;
+        OpenFile& operator=(const OpenFile&) = delete;
+    };
+    using ContentSnapshot = std::shared_ptr<const OpenFile>;
+
+    /// Build a snapshot from provider content, opening the backing file if any
+    /// @return The snapshot, or nullptr if the backing file cannot be opened
+    [[nodiscard]] static ContentSnapshot make_snapshot(FileContent content);
+
+    /// Copy a slice of a snapshot into the read buffer
+    /// @return Bytes read, or negative errno
+    [[nodiscard]] static int read_snapshot(const OpenFile& file, char* buf, size_t size, off_t offset);
+
+    /// High bit marks snapshot handles so they never collide with provider upload handles
+    static constexpr uint64_t kSnapshotHandleBit = 1ULL << 63;
+
+    /// Check if a file handle refers to a content snapshot
+    [[nodiscard]] static bool is_snapshot_handle(uint64_t fh) { return (fh & kSnapshotHandleBit) != 0; }
+
+    /// Look up the snapshot pinned by a file handle
+    /// @return The snapshot, or nullptr if the handle is not a snapshot
+    [[nodiscard]] ContentSnapshot find_snapshot(uint64_t fh) const;
+
+    /// Directory entries captured at opendir, in listing order (. and .. aren't stored)
+    struct DirListing {
+        struct Item {
+            std::string name;
+            struct stat st;
+        };
+        std::vector<Item> items;
+    };
+    using ListingPtr = std::shared_ptr<const DirListing>;
+
+    /// Look up the listing captured for a directory handle
+    /// @return The listing, or nullptr if the handle has none
+    [[nodiscard]] ListingPtr find_listing(uint64_t fh) const;
+
     std::shared_ptr<DataProvider> provider_;
+
+    // Callback latencies (looked up once, recorded without locking)
+    tg::LatencyHistogram& getattr_latency_;
+    tg::LatencyHistogram& opendir_latency_;
+    tg::LatencyHistogram& readdir_latency_;
+    tg::LatencyHistogram& open_latency_;
+    tg::LatencyHistogram& read_latency_;
+    tg::LatencyHistogram& write_latency_;
+    tg::LatencyHistogram& release_latency_;
+
+    std::unordered_map<uint64_t, ContentSnapshot> snapshots_;
+    mutable std::mutex snapshots_mutex_;
+    std::atomic<uint64_t> next_snapshot_id_{1};
+
+    std::unordered_map<uint64_t, ListingPtr> listings_;  // By directory handle
+    mutable std::mutex listings_mutex_;
+    std::atomic<uint64_t> next_listing_id_{1};
 };
 
 }  // namespace tgfuse
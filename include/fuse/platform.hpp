@@ -30,11 +30,18 @@ constexpr FuseVersion get_fuse_version() {
 #endif
 }
 
+/// Kernel connection parameters negotiated when a session starts
+struct ConnectionOptions {
+    unsigned max_write{0};        // Largest write request in bytes (0 = libfuse default)
+    bool writeback_cache{false};  // Let the kernel buffer writes in the page cache (libfuse3 only)
+};
+
 /// Platform-independent directory filler function type
 /// @param name Entry name
-/// @param stbuf Optional stat buffer (can be nullptr)
-/// @return 0 on success, 1 to stop iteration
-using DirFiller = std::function<int(const char* name, const struct stat* stbuf)>;
+/// @param stbuf Optional stat buffer (can be nullptr); complete attributes serve readdirplus
+/// @param next_offset Offset readdir resumes from after this entry (nonzero for every entry or for none)
+/// @return 0 on success, 1 to stop iteration (buffer full)
+using DirFiller = std::function<int(const char* name, const struct stat* stbuf, off_t next_offset)>;
 
 /// Abstract FUSE operations interface
 ///
@@ -51,12 +58,25 @@ public:
     /// @return 0 on success, negative errno on error
     virtual int getattr(const char* path, struct stat* stbuf) = 0;
 
+    /// Open a directory
+    /// @param path Path to the directory
+    /// @param fi File info (fh field can be set)
+    /// @return 0 on success, negative errno on error
+    virtual int opendir(const char* path, struct fuse_file_info* fi) = 0;
+
     /// Read directory contents
     /// @param path Path to the directory
     /// @param filler Function to add entries
-    /// @param offset Directory offset
+    /// @param offset Directory offset: 0, or the next_offset of the last entry the previous call added
+    /// @param fi File info from opendir, or nullptr to list the directory afresh
     /// @return 0 on success, negative errno on error
-    virtual int readdir(const char* path, DirFiller filler, off_t offset) = 0;
+    virtual int readdir(const char* path, DirFiller filler, off_t offset, struct fuse_file_info* fi) = 0;
+
+    /// Release (close) a directory
+    /// @param path Path to the directory
+    /// @param fi File info from opendir
+    /// @return 0 on success, negative errno on error
+    virtual int releasedir(const char* path, struct fuse_file_info* fi) = 0;
 
     /// Read symlink target
     /// @param path Path to the symlink
@@ -190,6 +210,18 @@ public:
     /// @return Pointer to the current implementation
     static FuseOperations* get_implementation();
 
+    /// Drop the kernel's cached attributes, entry and data for a path
+    /// Safe to call from any thread; a no-op before the session starts or after it ends
+    /// @param path Absolute path inside the mount
+    /// @return 0 on success, negative errno on error (-ENOSYS if unsupported)
+    static int invalidate_path(const char* path);
+
+    /// Set the connection options the next high-level session negotiates in init()
+    static void set_connection_options(const ConnectionOptions& options);
+
+    /// Request @p options on a starting session's connection (from an init() callback)
+    static void apply_connection_options(struct fuse_conn_info* conn, const ConnectionOptions& options);
+
 private:
     static FuseOperations* current_impl_;
 };
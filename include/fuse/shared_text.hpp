@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace tgfuse {
+
+/// Read-only handle to (part of) a shared text buffer
+///
+/// The viewed range stays valid for as long as the handle lives, whatever
+/// happens to the cache it came from: owners only ever append past ranges
+/// they have handed out, or move on to a new buffer and let readers keep
+/// the old one.
+class SharedText {
+public:
+    SharedText() = default;
+
+    /// Take ownership of @p text
+    explicit SharedText(std::string text) : SharedText(std::make_shared<const std::string>(std::move(text))) {}
+
+    /// View the whole of @p buffer
+    explicit SharedText(std::shared_ptr<const std::string> buffer)
+        : data_(buffer->data()), size_(buffer->size()), buffer_(std::move(buffer)) {}
+
+    /// View [offset, offset + size) of @p buffer
+    SharedText(std::shared_ptr<const std::string> buffer, std::size_t offset, std::size_t size)
+        : data_(buffer->data() + offset), size_(size), buffer_(std::move(buffer)) {}
+
+    [[nodiscard]] std::string_view view() const { return {data_, size_}; }
+    [[nodiscard]] std::size_t size() const { return size_; }
+    [[nodiscard]] bool empty() const { return size_ == 0; }
+
+    /// Whether this refers to a buffer at all (an empty range still counts)
+    [[nodiscard]] explicit operator bool() const { return static_cast<bool>(buffer_); }
+
+private:
+    // Captured once: readers never touch the std::string object, which its owner may append to
+    const char* data_{nullptr};
+    std::size_t size_{0};
+    std::shared_ptr<const std::string> buffer_;
+};
+
+}  // namespace tgfuse
@@ -1,23 +1,69 @@
 #pragma once
 
+#include "fuse/background_prefetcher.hpp"
+#include "fuse/constants.hpp"
 #include "fuse/data_provider.hpp"
+#include "fuse/download_pool.hpp"
 #include "fuse/messages_cache.hpp"
+#include "fuse/text_send_queue.hpp"
+#include "fuse/upload_queue.hpp"
 #include "tg/client.hpp"
+#include "tg/metrics.hpp"
+#include "tg/sha256.hpp"
+#include "tg/single_flight.hpp"
+#include "tg/text_scan.hpp"
 #include "tg/types.hpp"
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstdint>
+#include <deque>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <set>
+#include <span>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace tgfuse {
 
+/// Read-ahead of small media when a media/ directory is listed
+struct MediaPrefetchConfig {
+    DownloadPoolConfig pool{};                          // Download workers (0 disables read-ahead) and queue bounds
+    std::size_t max_file_size{kMediaPrefetchMaxBytes};  // Largest file downloaded ahead of reads
+    std::size_t per_listing{64};                        // Newest files queued per listing
+};
+
+/// Disk budget for the files TDLib downloads when files/ and media/ entries are read
+struct FilesBudgetConfig {
+    std::size_t max_bytes{0};                  // Largest the downloaded files store may grow (0 = unlimited)
+    std::chrono::seconds check_interval{300};  // How often the store is measured against the budget
+    std::chrono::seconds hot_period{3600};     // Files read this recently are never evicted
+};
+
+/// Configuration for TelegramDataProvider
+struct TelegramProviderConfig {
+    bool stream_media{true};                             // Serve large files/ and media/ entries range by range
+    std::size_t media_read_ahead{kMediaReadAheadBytes};  // Bytes to keep downloading past each streamed read
+    MessagesCacheConfig messages_cache{};                // Formatted messages cache (budgets, TTLs, template)
+    UploadQueueConfig uploads{};                         // Upload scheduler (concurrency, listing retention)
+    TextSendQueueConfig text_sends{};                    // Pipelined text sends (per-chat in-flight window)
+    BackgroundPrefetcherConfig prefetch{};               // Predictive prefetching (0 workers disables it)
+    MediaPrefetchConfig media_prefetch{};                // Small media downloaded when media/ is listed
+    FilesBudgetConfig files_budget{};                    // Disk cap on downloads (coldest evicted first)
+    bool sync_uploads{false};                            // close() waits until the upload has been sent
+    bool warm_start{false};                              // Serve the persisted snapshot at once, reconcile later
+    std::chrono::seconds info_ttl{300};                  // Generated .info contents are reused this long (0 = never)
+};
+
 /// Telegram data provider implementation
 ///
 /// Provides a virtual filesystem backed by real Telegram data.
@@ -25,11 +71,14 @@ namespace tgfuse {
 /// user details and last seen status.
 class TelegramDataProvider : public DataProvider {
 public:
-    explicit TelegramDataProvider(tg::TelegramClient& client);
+    using Config = TelegramProviderConfig;
+
+    explicit TelegramDataProvider(tg::TelegramClient& client, Config config = {});
     ~TelegramDataProvider() override;
 
     // DataProvider interface implementation
     [[nodiscard]] std::vector<Entry> list_directory(std::string_view path) override;
+    int visit_directory(std::string_view path, const EntryVisitor& visit) override;
     [[nodiscard]] std::optional<Entry> get_entry(std::string_view path) override;
     [[nodiscard]] bool exists(std::string_view path) override;
     [[nodiscard]] bool is_directory(std::string_view path) override;
@@ -50,9 +99,37 @@ public:
     write_file(std::string_view path, const char* data, std::size_t size, off_t offset, uint64_t fh) override;
     int release_file(std::string_view path, uint64_t fh) override;
 
+    // Kernel cache invalidation on Telegram updates
+    void set_invalidate_callback(InvalidateCallback callback) override;
+
     /// Refresh user cache from Telegram
     void refresh_users();
 
+    // Control socket commands (see ControlServer); kernel invalidations go out with the next entity batch
+
+    /// Chat named by @p name: a directory name, @username, display name or title, or chat id
+    [[nodiscard]] std::optional<int64_t> find_chat(std::string_view name) const;
+
+    /// Drop a chat's formatted messages and file listing, so both are rebuilt on the next read
+    void invalidate_chat(int64_t chat_id);
+
+    /// Drop the file listing of a chat, or of every chat (nullopt)
+    /// @return Chats whose listing was dropped
+    std::size_t invalidate_files(std::optional<int64_t> chat_id);
+
+    /// Drop everything cached, in memory and in SQLite
+    void clear_caches();
+
+    /// Queue a chat's messages and files for prefetching
+    /// @return false if prefetching is disabled
+    bool prefetch_chat(int64_t chat_id);
+
+    /// Contents of /.stats, plus gauges of the cache database
+    [[nodiscard]] std::string control_stats() const;
+
+    /// Known users, one per line: id, @username, display name and [contact], tab-separated
+    [[nodiscard]] std::string users_report() const;
+
 private:
     /// Path category enumeration
     enum class PathCategory {
@@ -87,6 +164,10 @@ private:
         ROOT_SYMLINK,       // /@alice
         SELF_SYMLINK,       // /self
         UPLOADS_DIR,        // /.uploads (lists pending uploads)
+        UPLOAD_STATUS,      // /.uploads/12-report.pdf (progress of one upload)
+        STATS_JSON,         // /.stats (metrics as JSON)
+        STATS_PROMETHEUS,   // /.stats.prom (metrics in Prometheus text format)
+        TRACE_FILE,         // /.trace (recorded spans as a Chrome trace; only while tracing)
         // Upload categories (for cp operations)
         USER_UPLOAD,     // /users/alice/newfile.txt (auto-detect)
         GROUP_UPLOAD,    // /groups/chat/newfile.pdf (auto-detect)
@@ -95,19 +176,41 @@ private:
         USER_TXT,     // /users/alice/txt
         GROUP_TXT,    // /groups/chat/txt
         CHANNEL_TXT,  // /channels/news/txt
-        TEXT_DIR,     // /text
-        TEXT_SYMLINK  // /text/@alice
+        TEXT_DIR,       // /text
+        TEXT_SYMLINK,   // /text/@alice
+        SEARCH_DIR,     // /search (lists nothing; any name inside is a query)
+        SEARCH_RESULT,  // /search/quarterly report (cached messages matching the name)
+        // Windowed views of a chat's messages
+        USER_MESSAGES_TAIL,     // /users/alice/messages.tail (newest messages)
+        USER_HISTORY_DIR,       // /users/alice/history
+        USER_HISTORY_DAY,       // /users/alice/history/2024-12-05 (one day of messages)
+        GROUP_MESSAGES_TAIL,    // /groups/dev_chat/messages.tail
+        GROUP_HISTORY_DIR,      // /groups/dev_chat/history
+        GROUP_HISTORY_DAY,      // /groups/dev_chat/history/2024-12-05
+        CHANNEL_MESSAGES_TAIL,  // /channels/news/messages.tail
+        CHANNEL_HISTORY_DIR,    // /channels/news/history
+        CHANNEL_HISTORY_DAY,    // /channels/news/history/2024-12-05
+    };
+
+    /// Path categories of one chat section, so users/groups/channels share one parser
+    struct SectionCategories {
+        PathCategory dir, info, messages, files_dir, file, media_dir, media, txt, upload, tail, history_dir,
+            history_day;
     };
 
     /// Parsed path information
+    ///
+    /// The names are views into the path passed to parse_path() and must not outlive it.
     struct PathInfo {
         PathCategory category{PathCategory::NOT_FOUND};
-        std::string entity_name;      // Username or display name
-        std::string file_entry_name;  // For file paths: "20241205-1430-report.pdf"
+        std::string_view entity_name;      // Username or display name
+        std::string_view file_entry_name;  // For file paths: "20241205-1430-report.pdf"
     };
 
-    /// Parse a path into its components
-    [[nodiscard]] PathInfo parse_path(std::string_view path) const;
+    /// Parse a path into its components (no allocation, hashed component lookup)
+    [[nodiscard]] static PathInfo parse_path(std::string_view path);
+
+    friend struct ParsePathBench;  // bench/fuse/parse_path_bench.cpp
 
     /// Generate info content for a user
     [[nodiscard]] std::string generate_user_info(const tg::User& user) const;
@@ -115,9 +218,6 @@ private:
     /// Get directory name for a user (username or id)
     [[nodiscard]] std::string get_user_dir_name(const tg::User& user) const;
 
-    /// Find user by directory name
-    [[nodiscard]] const tg::User* find_user_by_dir_name(const std::string& dir_name) const;
-
     /// Check if user is a contact
     [[nodiscard]] bool is_user_contact(const tg::User& user) const { return user.is_contact; }
 
@@ -136,6 +236,9 @@ private:
     /// Ensure current user is loaded (lazy loading)
     void ensure_current_user_loaded();
 
+    /// Fetch the current user from TDLib, publish it and remember it for the next warm start
+    void load_current_user();
+
     /// Refresh group cache from Telegram
     void refresh_groups();
 
@@ -145,9 +248,6 @@ private:
     /// Get directory name for a group (username or sanitised title)
     [[nodiscard]] std::string get_group_dir_name(const tg::Chat& chat) const;
 
-    /// Find group by directory name
-    [[nodiscard]] const tg::Chat* find_group_by_dir_name(const std::string& dir_name) const;
-
     /// Generate info content for a group
     [[nodiscard]] std::string generate_group_info(const tg::Chat& chat) const;
 
@@ -160,17 +260,14 @@ private:
     /// Get directory name for a channel (username or sanitised title)
     [[nodiscard]] std::string get_channel_dir_name(const tg::Chat& chat) const;
 
-    /// Find channel by directory name
-    [[nodiscard]] const tg::Chat* find_channel_by_dir_name(const std::string& dir_name) const;
-
     /// Generate info content for a channel
     [[nodiscard]] std::string generate_channel_info(const tg::Chat& chat) const;
 
-    /// Fetch and format messages for a chat
-    [[nodiscard]] std::string fetch_and_format_messages(int64_t chat_id);
+    /// Fetch and format messages for a chat (shared with the messages cache, not copied)
+    [[nodiscard]] SharedText fetch_and_format_messages(int64_t chat_id);
 
     /// Format messages and store in cache
-    [[nodiscard]] std::string format_and_cache_messages(int64_t chat_id, const std::vector<tg::Message>& messages);
+    [[nodiscard]] SharedText format_and_cache_messages(int64_t chat_id, std::span<const tg::MessageView> messages);
 
     /// Get chat ID from path info
     [[nodiscard]] int64_t get_chat_id_from_path(const PathInfo& info) const;
@@ -178,6 +275,9 @@ private:
     /// Check if a path category is a messages file
     [[nodiscard]] bool is_messages_path(PathCategory category) const;
 
+    /// Check if a path category is a messages.tail file, a history directory or a day in one
+    [[nodiscard]] bool is_history_path(PathCategory category) const;
+
     /// Check if a path category is a files directory
     [[nodiscard]] bool is_files_dir_path(PathCategory category) const;
 
@@ -193,19 +293,39 @@ private:
     /// Estimate messages file size from cache
     [[nodiscard]] std::size_t estimate_messages_size(int64_t chat_id) const;
 
+    /// Make sure SQLite holds a chat's recent history, fetching it (without formatting) if it has none
+    void ensure_history_cached(int64_t chat_id);
+
+    /// Day buckets of a chat's cached history that hold messages, stale ones rendered to learn their size
+    [[nodiscard]] std::vector<tg::MessageBucket> history_buckets(int64_t chat_id);
+
+    /// The bucket behind a history/YYYY-MM-DD entry name (sized), or nullopt if the day has no messages
+    [[nodiscard]] std::optional<tg::MessageBucket> find_history_bucket(int64_t chat_id, std::string_view name);
+
+    /// Render one day of history, recording its size in the bucket index if it changed
+    [[nodiscard]] std::string render_history_day(int64_t chat_id, tg::MessageBucket& bucket);
+
+    /// Contents of messages.tail: the newest kMessagesTailCount cached messages
+    [[nodiscard]] std::string render_messages_tail(int64_t chat_id);
+
+    /// Entry of messages.tail, history/ or history/YYYY-MM-DD
+    [[nodiscard]] std::optional<Entry> get_history_entry(const PathInfo& info);
+
+    /// Add messages.tail and history/ to a chat directory listing
+    static void add_history_entries(std::time_t mtime, std::vector<Entry>& entries);
+
+    /// Entry name of the day bucket starting at @p day_start (YYYY-MM-DD, local time)
+    [[nodiscard]] static std::string history_day_name(int64_t day_start);
+
     /// Format a file entry name with timestamp prefix (YYYYMMDD-HHMM-filename)
     [[nodiscard]] std::string format_file_entry_name(const tg::FileListItem& item) const;
 
-    /// Parse a file entry name back to original filename and timestamp
-    [[nodiscard]] std::optional<std::pair<std::string, int64_t>> parse_file_entry_name(
-        const std::string& entry_name
-    ) const;
-
     /// Find a FileListItem by its formatted entry name
-    [[nodiscard]] const tg::FileListItem* find_file_by_entry_name(int64_t chat_id, const std::string& entry_name);
+    [[nodiscard]] std::optional<tg::FileListItem> find_file_by_entry_name(int64_t chat_id, std::string_view entry_name);
 
     /// Ensure files are loaded for a chat (lazy loading from API)
-    void ensure_files_loaded(int64_t chat_id);
+    /// @return The chat's sync row afterwards (nullopt if it was never synced)
+    std::optional<tg::FileListSync> ensure_files_loaded(int64_t chat_id);
 
     /// Get chat ID from path info for files categories
     [[nodiscard]] int64_t get_chat_id_for_files(const PathInfo& info) const;
@@ -213,7 +333,8 @@ private:
     /// Send a message to a chat, handling large messages
     [[nodiscard]] WriteResult send_message(int64_t chat_id, const char* data, std::size_t size);
 
-    /// Download a file and read its content
+    /// Download a file and return content backed by the local TDLib copy
+    /// Large files are streamed instead: each read downloads only its range plus read-ahead
     [[nodiscard]] FileContent download_and_read_file(const tg::FileListItem& file);
 
     /// Check if a path category is an upload target
@@ -235,7 +356,12 @@ private:
     enum class UploadAction { SEND_AS_TEXT, SEND_AS_MEDIA, SEND_AS_DOCUMENT };
 
     /// Detect upload action based on file content/extension
-    [[nodiscard]] UploadAction detect_upload_action(const std::string& path, const std::string& filename) const;
+    /// @param scanned The content's scan if all of it was scanned as it was written; otherwise the file is read
+    [[nodiscard]] UploadAction detect_upload_action(
+        const std::string& path,
+        const std::string& filename,
+        const tg::TextScanner* scanned = nullptr
+    ) const;
 
     /// Check if file contains valid UTF-8 text
     [[nodiscard]] bool is_valid_text_file(const std::string& path) const;
@@ -243,7 +369,7 @@ private:
     /// Send file content as text message(s)
     [[nodiscard]] int send_file_as_text(int64_t chat_id, const std::string& path);
 
-    /// Compute SHA256 hash of a file
+    /// Compute SHA256 hash of a file (streamed, for uploads not written in order)
     [[nodiscard]] std::string compute_file_hash(const std::string& path) const;
 
     /// Send file using cached remote file ID
@@ -256,35 +382,279 @@ private:
     );
 
     tg::TelegramClient& client_;
+    Config config_;
+
+    /// Immutable view of the cached users, groups and channels
+    ///
+    /// Readers grab the current snapshot and use it without locking; writers
+    /// copy it, apply their changes and publish the copy (RCU-style).
+    /// Lookups go through hash indexes over the maps, rebuilt before publishing.
+    struct EntitySnapshot {
+        std::map<std::string, tg::User> users;     // Keyed by directory name
+        std::map<std::string, tg::Chat> groups;    // Keyed by directory name
+        std::map<std::string, tg::Chat> channels;  // Keyed by directory name
+        std::optional<tg::User> current_user;      // Current user for /self symlink
+
+        /// User entry found by username
+        struct UserRef {
+            std::string_view dir_name;
+            const tg::User* user;
+        };
+
+        EntitySnapshot() = default;
+        /// Copies the entities only - the copy must be reindex()ed before lookups
+        EntitySnapshot(const EntitySnapshot& other);
+        EntitySnapshot& operator=(const EntitySnapshot&) = delete;
+
+        /// Rebuild the lookup indexes from the maps
+        void reindex();
+
+        [[nodiscard]] const tg::User* find_user(std::string_view dir_name) const;
+        [[nodiscard]] const tg::Chat* find_group(std::string_view dir_name) const;
+        [[nodiscard]] const tg::Chat* find_channel(std::string_view dir_name) const;
+
+        /// Find a user by username (without @)
+        [[nodiscard]] std::optional<UserRef> find_user_by_username(std::string_view username) const;
+
+        /// Find a user by Telegram id
+        [[nodiscard]] const tg::User* find_user_by_id(int64_t id) const;
+
+        /// Find a group or channel by chat id
+        [[nodiscard]] const tg::Chat* find_chat_by_id(int64_t id) const;
+
+    private:
+        // Indexes point into the maps above; keys are views of the map keys
+        std::unordered_map<std::string_view, const tg::User*> user_dirs_;
+        std::unordered_map<std::string_view, const tg::Chat*> group_dirs_;
+        std::unordered_map<std::string_view, const tg::Chat*> channel_dirs_;
+        std::unordered_map<std::string_view, UserRef> usernames_;
+        std::unordered_map<int64_t, const tg::User*> users_by_id_;
+        std::unordered_map<int64_t, const tg::Chat*> chats_by_id_;
+    };
+    using SnapshotPtr = std::shared_ptr<const EntitySnapshot>;
 
-    // Cached user data (keyed by directory name)
-    std::map<std::string, tg::User> users_;
-    mutable std::atomic<bool> users_loaded_;        // mutable for const-correctness with lazy loading
-    mutable std::optional<tg::User> current_user_;  // Cached current user for /self symlink
+    /// Get the current entity snapshot (never blocks on a refresh)
+    [[nodiscard]] SnapshotPtr snapshot() const;
 
-    // Cached group data (keyed by directory name)
-    std::map<std::string, tg::Chat> groups_;
-    mutable std::atomic<bool> groups_loaded_;
+    /// Copy the current snapshot, apply @p update to the copy and publish it
+    /// Writers are serialised; readers keep using the previous snapshot meanwhile
+    void update_snapshot(const std::function<void(EntitySnapshot&)>& update);
 
-    // Cached channel data (keyed by directory name)
-    std::map<std::string, tg::Chat> channels_;
+    SnapshotPtr snapshot_{std::make_shared<const EntitySnapshot>()};
+    mutable std::mutex snapshot_mutex_;  // Guards the snapshot_ pointer only
+    std::mutex snapshot_writer_mutex_;   // Serialises copy-modify-publish cycles
+
+    mutable std::atomic<bool> users_loaded_;  // mutable for const-correctness with lazy loading
+    mutable std::atomic<bool> groups_loaded_;
     std::atomic<bool> channels_loaded_;
 
+    // TDLib entity updates waiting to be applied to the snapshot in one batch
+    std::vector<tg::Chat> pending_chats_;
+    std::vector<tg::User> pending_users_;
+    std::set<std::string> pending_invalidations_;  // Paths whose kernel caches are stale
+    InvalidateCallback invalidate_callback_;
+    std::mutex pending_entities_mutex_;  // Guards the pending_* members and invalidate_callback_
+
+    // Background updater applying pending entity updates
+    std::thread entity_updater_thread_;
+    std::atomic<bool> entity_updater_running_{false};
+    std::condition_variable entity_updater_cv_;
+
+    /// Queue a chat update (new chat or changed chat) for the next batch
+    void queue_chat_update(const tg::Chat& chat);
+
+    /// Queue a user update for the next batch
+    void queue_user_update(const tg::User& user);
+
+    /// Start the background entity updater thread
+    void start_entity_updater();
+
+    /// Stop the background entity updater thread
+    void stop_entity_updater();
+
+    /// Background entity updater thread function
+    void entity_updater_loop();
+
+    /// Apply queued chat and user updates as incremental upserts in one snapshot
+    void apply_pending_entity_updates();
+
+    // Generated .info contents, by user or chat id (a private chat shares its user's id)
+    //
+    // Reading a .info may take two TDLib round-trips for the full user info,
+    // and read() asks for the content chunk by chunk. Entries are dropped when
+    // TDLib reports the entity changed, and rebuilt after info_ttl regardless
+    // (the last seen time changes without an update we follow).
+    struct CachedInfo {
+        std::string text;
+        std::chrono::steady_clock::time_point generated_at;
+        bool valid{false};       // text is current (cleared by invalidation)
+        uint64_t generation{0};  // Bumped when this id is invalidated, so a generation it overtook isn't stored
+    };
+    std::unordered_map<int64_t, CachedInfo> info_cache_;
+    std::mutex info_cache_mutex_;
+
+    // Fetches behind cache misses, one per key however many callers miss it at once
+    //
+    // The prefetcher's loaders go through the same calls, so a prefetch joins
+    // a read's fetch of the same chat. A read doesn't join a prefetch's: that
+    // one's requests run in the background lane, so the read sends its own
+    // (flights are ranked by the caller's RequestPriority). Each flight
+    // rechecks its cache first: a caller that missed just before another
+    // flight stored the result would otherwise fetch again.
+    tg::SingleFlight<int64_t, std::optional<tg::User>> user_info_flights_;         // Full user info, by user id
+    tg::SingleFlight<int64_t, SharedText> message_flights_;                        // Formatted messages, by chat id
+    tg::SingleFlight<int64_t, std::optional<tg::FileListSync>> file_list_flights_;  // File list syncs, by chat id
+    tg::SingleFlight<std::string, std::string> download_flights_;                  // Local paths, by file id
+
+    /// The .info content of entity @p id, generated by @p generate unless a fresh copy is cached
+    [[nodiscard]] std::string cached_info(int64_t id, const std::function<std::string()>& generate);
+
+    /// Forget the generated .info of entity @p id (every entity if nullopt)
+    void invalidate_info(std::optional<int64_t> id);
+
+    /// @p user with the full info (phone, status and bio) fetched if the snapshot lacks it
+    [[nodiscard]] tg::User with_full_info(const tg::User& user);
+
+    /// Queue a path for kernel cache invalidation (sent by the entity updater)
+    /// Never called inline from FUSE or TDLib threads - notifying the kernel there can deadlock
+    void queue_invalidation(std::string path);
+
+    /// Send queued invalidations to the kernel
+    void flush_invalidations();
+
+    /// Directory path of a chat inside the mount (e.g. "/users/alice"), if it is listed
+    [[nodiscard]] std::optional<std::string> chat_dir_path(const EntitySnapshot& snap, int64_t chat_id) const;
+
+    /// Immutable file list of one chat, indexed by entry name
+    ///
+    /// Built from SQLite once per sync of the list and shared by listings,
+    /// lookups and reads; a new attachment publishes an updated copy.
+    struct ChatFileIndex {
+        /// A file with its formatted entry name
+        struct IndexedFile {
+            tg::FileListItem item;
+            std::string entry_name;
+        };
+
+        std::optional<tg::FileListSync> sync;  // Sync row the index was built from
+        std::vector<IndexedFile> files;        // Newest first
+
+        ChatFileIndex() = default;
+        /// Copies the files only - the copy must be reindex()ed before lookups
+        ChatFileIndex(const ChatFileIndex& other) : sync(other.sync), files(other.files) {}
+        ChatFileIndex& operator=(const ChatFileIndex&) = delete;
+
+        /// Rebuild the entry name index from files
+        void reindex();
+
+        [[nodiscard]] const tg::FileListItem* find(std::string_view entry_name) const;
+
+    private:
+        // Keys are views of the entry names above; the newest file wins a name clash
+        std::unordered_map<std::string_view, const tg::FileListItem*> by_entry_name_;
+    };
+    using FileIndexPtr = std::shared_ptr<const ChatFileIndex>;
+
+    /// Published file index of a chat and the live appends it has seen
+    struct FileIndexSlot {
+        FileIndexPtr index;
+        uint64_t appends{0};                         // Bumped by every live append, so a rebuild racing one retries
+        std::chrono::steady_clock::time_point used;  // Last lookup, for LRU eviction
+    };
+
+    /// Current file index of a chat, synced from the API and rebuilt when the watermark moves
+    /// An index built from a recent sync is returned without touching SQLite
+    [[nodiscard]] FileIndexPtr file_index(int64_t chat_id);
+
+    /// Drop the least recently used file indexes beyond the limit (never keep_chat_id's)
+    /// Caller holds file_indexes_mutex_
+    void evict_file_indexes(int64_t keep_chat_id);
+
+    /// Add a newly received attachment to the chat's file index (if it has one)
+    void add_to_file_index(int64_t chat_id, const tg::FileListItem& item);
+
+    std::unordered_map<int64_t, FileIndexSlot> file_indexes_;
+    std::mutex file_indexes_mutex_;  // Guards file_indexes_ only
+
     // Formatted messages cache (RCU-style, updated on message notifications)
     std::unique_ptr<FormattedMessagesCache> messages_cache_;
 
+    // Fills messages_cache_ ahead of reads (null when disabled)
+    std::unique_ptr<BackgroundPrefetcher> prefetcher_;
+
+    /// Queue the chats a section listing shows for prefetching
+    void prefetch_listed_chats(const std::vector<int64_t>& chat_ids);
+
+    /// An opened chat directory: its messages are likely read next, then its files
+    void prefetch_opened_chat(int64_t chat_id);
+
     // Pending file upload tracking
+    //
+    // uploads_mutex_ only guards the map; each upload's I/O is serialised by its own
+    // mutex, so concurrent copies don't wait on each other's writes.
     struct PendingUpload {
         std::string temp_path;
         std::string original_filename;
         std::string virtual_path;  // Full virtual path for getattr lookups
         int64_t chat_id;
         tg::SendMode mode;
-        std::size_t bytes_written{0};
+        std::atomic<std::size_t> bytes_written{0};  // End of the written range (reported size)
+
+        std::mutex mutex;              // Guards the members below
+        int fd{-1};                    // Temp file, open from create to release; written with pwrite
+        off_t preallocated{0};         // Bytes reserved on disk ahead of the writes
+        tg::Sha256 hasher;             // Content digest, fed as sequential writes arrive
+        bool hashed_in_order{true};    // False once a write wasn't at the hashed end
+        bool scan_text{false};         // Whether the content decides if it's sent as text
+        tg::TextScanner text_scanner;  // Fed with the hasher when scan_text is set
+        int64_t stream_id{0};          // Streaming upload fed from the writes (0 = uploaded at release)
+        tg::SendMode stream_mode{tg::SendMode::DOCUMENT};
+
+        ~PendingUpload();
+
+        /// Close the temp file (the data stays on disk for the upload)
+        void close_file();
     };
-    std::map<uint64_t, PendingUpload> pending_uploads_;
+    using PendingUploadPtr = std::shared_ptr<PendingUpload>;
+    std::map<uint64_t, PendingUploadPtr> pending_uploads_;
     mutable std::mutex uploads_mutex_;
     std::atomic<uint64_t> next_upload_handle_{1};
+    UploadQueue upload_queue_;
+
+    // Downloads small media ahead of reads when a media/ directory is listed
+    DownloadPool media_downloads_;
+
+    // Sends messages and txt chunks in order, without waiting for each to reach Telegram
+    TextSendQueue text_sends_;
+
+    /// Queue the small media files of a listed media/ directory for download
+    void prefetch_listed_media(const ChatFileIndex& index);
+
+    /// Download file @p file_id into TDLib's cache, sharing a download already in progress
+    /// @return Local path of the downloaded file
+    /// @throws std::exception if the download fails
+    [[nodiscard]] std::string download_file(const std::string& file_id);
+
+    /// Count a read of @p file (or a read-ahead download if not @p hit) in its download stats
+    void record_download_access(const tg::FileListItem& file, bool hit);
+
+    // Background trimmer keeping downloaded files within the disk budget (only runs with a budget)
+    std::thread files_trimmer_thread_;
+    std::atomic<bool> files_trimmer_running_{false};
+    std::condition_variable files_trimmer_cv_;
+    std::mutex files_trimmer_mutex_;
+
+    /// Start the files trimmer thread (if a budget is set)
+    void start_files_trimmer();
+
+    /// Stop the files trimmer thread
+    void stop_files_trimmer();
+
+    /// Files trimmer thread function
+    void files_trimmer_loop();
+
+    /// Evict cold downloads until the files store fits the budget
+    void trim_downloaded_files();
 
     // Recently completed uploads (kept briefly for post-release operations like setxattr)
     struct CompletedUpload {
@@ -295,10 +665,41 @@ private:
     std::map<std::string, CompletedUpload> completed_uploads_;  // keyed by virtual_path
 
     /// Find a pending upload by virtual path
-    [[nodiscard]] const PendingUpload* find_pending_upload_by_path(std::string_view path) const;
+    [[nodiscard]] std::shared_ptr<const PendingUpload> find_pending_upload_by_path(std::string_view path) const;
+
+    /// How an upload to @p filename can be streamed while it is written
+    /// @return The send mode it will end up with, or nullopt if that depends on the content
+    [[nodiscard]] std::optional<tg::SendMode>
+    streaming_upload_mode(const std::string& filename, tg::SendMode mode) const;
+
+    /// Remove an upload's temp file and its directory
+    void remove_upload_temp(const PendingUpload& upload) const;
+
+    /// Send a released upload (runs on the upload queue)
+    /// @return 0 on success, or a negative errno
+    int send_upload(PendingUpload& upload, int64_t stream_id, std::size_t file_size, UploadProgress& progress);
+
+    /// Report a sent file's transfer progress until TDLib has finished with it
+    void wait_for_upload(int64_t message_id, UploadProgress& progress);
+
+    /// Status reports listed in /.uploads, keyed by entry name
+    [[nodiscard]] std::map<std::string, std::string> upload_status_files() const;
+
+    /// Contents of /search/<query>: matching cached messages, grouped under their chat's messages path
+    [[nodiscard]] std::string search_results(std::string_view query) const;
+
+    /// Contents of /.stats or /.stats.prom: the metrics registry plus the state of the caches and queues
+    [[nodiscard]] std::string stats_report(PathCategory category) const;
+
+    /// The metrics registry plus the state of the caches and queues
+    [[nodiscard]] tg::MetricsSnapshot collect_metrics() const;
+
+    /// Write a chunk of a pending upload to its temp file
+    [[nodiscard]] WriteResult write_upload(PendingUpload& upload, const char* data, std::size_t size, off_t offset);
 
     /// Find a recently completed upload by virtual path
-    [[nodiscard]] const CompletedUpload* find_completed_upload_by_path(std::string_view path) const;
+    /// @return A copy: the entry can be replaced or cleaned up by another FUSE thread once the lock is released
+    [[nodiscard]] std::optional<CompletedUpload> find_completed_upload_by_path(std::string_view path) const;
 
     /// Mark an upload as completed (moves from pending to completed)
     void mark_upload_completed(const std::string& virtual_path, const std::string& filename, std::size_t size);
@@ -312,10 +713,9 @@ private:
     // txt file state for streaming writes
     struct TxtWriteState {
         std::string buffer;               // Write buffer for streaming
-        std::string last_sent_content;    // For reading back
-        int64_t last_sent_message_id{0};  // For future edit support
-        std::chrono::steady_clock::time_point last_send_time;
+        std::string last_sent_content;  // For reading back
         std::chrono::steady_clock::time_point last_write_time;  // For timeout-based flushing
+        std::deque<std::future<int>> sends;  // Chunks handed to text_sends_, oldest first, until collected
     };
     std::map<int64_t, TxtWriteState> txt_states_;
     mutable std::mutex txt_states_mutex_;
@@ -344,12 +744,13 @@ private:
     /// Get or create txt state for a chat
     [[nodiscard]] TxtWriteState& get_or_create_txt_state(int64_t chat_id);
 
-    /// Process txt buffer - send if >= 4096 bytes or force_flush is true
+    /// Process txt buffer - queue chunks for sending if >= 4096 bytes or force_flush is true
     /// @return number of bytes consumed from buffer
     std::size_t process_txt_buffer(int64_t chat_id, bool force_flush);
 
-    /// Find valid UTF-8 boundary at or before max_pos
-    [[nodiscard]] std::size_t find_utf8_boundary(const std::string& str, std::size_t max_pos) const;
+    /// Drop the finished sends of @p state (txt_states_mutex_ held)
+    /// @return false if any of them didn't reach Telegram
+    bool collect_txt_sends(TxtWriteState& state);
 
     /// Get txt file size (for getattr)
     [[nodiscard]] std::size_t get_txt_file_size(int64_t chat_id) const;
@@ -357,25 +758,51 @@ private:
     /// Write to txt file (streaming buffer)
     [[nodiscard]] WriteResult write_txt_file(const PathInfo& info, const char* data, std::size_t size);
 
-    mutable std::mutex mutex_;
-
     /// Create user resolver function for message formatting
+    /// Returned references stay valid for as long as the resolver lives
     [[nodiscard]] UserResolver make_user_resolver() const;
 
     /// Create chat resolver function for message formatting
+    /// Returned references stay valid for as long as the resolver lives
     [[nodiscard]] ChatResolver make_chat_resolver() const;
 
     /// Set up message callback to update cache on new messages
     void setup_message_callback();
 
-    /// Set up chat callback to invalidate cache on new chats
+    /// Set up chat callbacks to queue incremental chat updates and mark changed chats for prefetching
     void setup_chat_callback();
 
-    /// Set up user callback to invalidate cache on new users
+    /// Set up user callback to queue incremental user updates
     void setup_user_callback();
 
     /// Preload data at startup (current user and chats)
     void preload_data();
+
+    // Warm start: the snapshot persisted by the last run is served until TDLib is ready
+    std::atomic<bool> reconciling_{false};  // Serving the persisted snapshot; TDLib not caught up yet
+    std::thread reconciler_thread_;
+    std::atomic<bool> reconciler_running_{false};
+    std::set<int64_t> warm_served_chats_;  // Chats whose messages/files were served from SQLite alone
+    std::mutex warm_served_mutex_;
+
+    /// Publish the users and chats persisted in SQLite (no TDLib calls)
+    /// @return false if nothing was persisted (first run)
+    bool restore_persisted_snapshot();
+
+    /// Start the background reconciler thread
+    void start_reconciler();
+
+    /// Stop the background reconciler thread
+    void stop_reconciler();
+
+    /// Wait for authorisation, then reload everything from TDLib and invalidate what changed
+    void reconciler_loop();
+
+    /// Queue kernel invalidations for what reconciling changed since @p before
+    void invalidate_reconciled(const EntitySnapshot& before);
+
+    /// Remember that @p chat_id was served from SQLite alone while reconciling
+    void note_warm_served(int64_t chat_id);
 };
 
 }  // namespace tgfuse
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace tgfuse {
+
+/// Configuration for TextSendQueue
+struct TextSendQueueConfig {
+    std::size_t workers{2};                    // Chats sending at once
+    std::size_t max_in_flight{8};              // Messages per chat handed to TDLib but not yet on Telegram
+    std::size_t max_retries{3};                // Attempts at a chunk refused with a rate limit
+    std::chrono::seconds confirm_timeout{60};  // A message not confirmed by then stops holding its slot
+};
+
+/// Ordered, pipelined sender of text messages
+///
+/// Chunks queued for a chat are handed to TDLib one after another by a
+/// single worker, so they appear in the chat in queue order, without
+/// waiting for each to reach Telegram first: up to max_in_flight messages
+/// per chat are outstanding, confirmed by the client's send callback.
+/// Chats send independently. No lock is held while a send runs.
+class TextSendQueue {
+public:
+    using Config = TextSendQueueConfig;
+
+    /// Hands one message to TDLib
+    /// @return Its pending message id (confirmed later through confirmed())
+    /// @throws On failure; tg::RateLimitException is retried
+    using Sender = std::function<int64_t(int64_t chat_id, const std::string& text)>;
+
+    explicit TextSendQueue(Sender sender, Config config = {});
+    ~TextSendQueue();
+
+    TextSendQueue(const TextSendQueue&) = delete;
+    TextSendQueue& operator=(const TextSendQueue&) = delete;
+
+    /// Start the worker threads
+    void start();
+
+    /// Send what is already queued and fits in its chat's window, then join the workers
+    ///
+    /// Chunks still queued behind a full window are failed.
+    void stop();
+
+    /// Queue @p chunks, in order, as messages to @p chat_id
+    /// @return 0 once every chunk is on Telegram, or a negative errno if any failed
+    std::future<int> enqueue(int64_t chat_id, std::vector<std::string> chunks);
+
+    /// A message reached Telegram (@p ok) or was refused (call from the client's send callback)
+    void confirmed(int64_t pending_message_id, bool ok);
+
+    /// Bytes queued for @p chat_id and not yet handed to TDLib
+    [[nodiscard]] std::size_t queued_bytes(int64_t chat_id) const;
+
+private:
+    /// One enqueue() call, completed when its last chunk is confirmed
+    struct Batch {
+        std::promise<int> result;
+        std::size_t remaining{0};
+        bool failed{false};
+    };
+    using BatchPtr = std::shared_ptr<Batch>;
+
+    struct Chunk {
+        std::string text;
+        BatchPtr batch;
+        uint64_t sequence;  // Queue order, for fairness between chats
+    };
+
+    /// A message handed to TDLib and waiting for its confirmation
+    struct InFlight {
+        int64_t chat_id;
+        BatchPtr batch;
+        std::chrono::steady_clock::time_point sent_at;
+    };
+
+    struct ChatQueue {
+        std::deque<Chunk> chunks;
+        std::size_t bytes{0};      // Text in chunks
+        std::size_t in_flight{0};  // Messages of this chat in in_flight_
+        bool sending{false};       // A worker is handing this chat's next chunk to TDLib
+    };
+
+    void worker_loop();
+
+    /// Chat whose next chunk may be sent now, or 0 (mutex_ held)
+    [[nodiscard]] int64_t take_next_locked();
+
+    /// Count one chunk of @p batch as done (mutex_ held)
+    void finish_chunk_locked(const BatchPtr& batch, bool ok);
+
+    /// Release slots of messages never confirmed within confirm_timeout (mutex_ held)
+    void expire_in_flight_locked(std::chrono::steady_clock::time_point now);
+
+    Sender sender_;
+    Config config_;
+
+    std::vector<std::thread> workers_;
+    bool running_{false};
+    bool stopping_{false};
+    std::condition_variable cv_;
+    mutable std::mutex mutex_;
+
+    std::map<int64_t, ChatQueue> chats_;               // Chats with queued or in-flight messages
+    std::unordered_map<int64_t, InFlight> in_flight_;  // Keyed by pending message id
+    std::deque<std::pair<int64_t, bool>> early_;       // Confirmations that beat their send's return
+    uint64_t next_sequence_{0};
+};
+
+}  // namespace tgfuse
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tgfuse {
+
+class UploadQueue;
+
+/// Configuration for UploadQueue
+struct UploadQueueConfig {
+    std::size_t max_concurrent{4};                // Uploads transferring at once
+    std::chrono::seconds finished_retention{60};  // How long finished uploads stay listed
+};
+
+/// Where a queued upload is
+enum class UploadState {
+    QUEUED,     // Waiting for a worker (or for an earlier upload to the same chat)
+    SENDING,    // Hashing, dedup lookup, sending the message
+    UPLOADING,  // Message queued in the chat, file transferring
+    DONE,
+    FAILED
+};
+
+/// Status of one upload, as listed in /.uploads
+struct UploadStatus {
+    uint64_t id{0};
+    int64_t chat_id{0};
+    std::string filename;
+    std::size_t size{0};
+    std::size_t uploaded{0};  // Bytes transferred so far
+    UploadState state{UploadState::QUEUED};
+    std::string error;  // Set when FAILED
+    std::chrono::steady_clock::time_point queued_at;
+    std::chrono::steady_clock::time_point started_at;
+    std::chrono::steady_clock::time_point finished_at;
+
+    /// Average transfer rate since the upload started, in bytes per second
+    [[nodiscard]] double throughput() const;
+};
+
+[[nodiscard]] const char* to_string(UploadState state);
+
+/// Handle through which a running upload job reports progress
+class UploadProgress {
+public:
+    /// Move to @p state (SENDING or UPLOADING)
+    void set_state(UploadState state);
+
+    /// Record @p bytes transferred so far
+    void set_uploaded(std::size_t bytes);
+
+    /// The message is queued in its chat: the next upload to the chat may start sending
+    void submitted();
+
+    /// Failure reason shown in the listing if the job returns an error
+    void set_error(std::string error);
+
+    /// The queue is shutting down: stop waiting for the transfer
+    [[nodiscard]] bool stopping() const;
+
+private:
+    friend class UploadQueue;
+
+    struct Entry;
+
+    UploadProgress(UploadQueue& queue, std::shared_ptr<Entry> entry) : queue_(queue), entry_(std::move(entry)) {}
+
+    UploadQueue& queue_;
+    std::shared_ptr<Entry> entry_;
+};
+
+/// Bounded scheduler for file uploads
+///
+/// Runs up to max_concurrent upload jobs at once. Jobs for one chat start in
+/// the order they were queued, and each waits for the previous one to submit
+/// its message, so messages keep their order in the chat; the transfers
+/// themselves overlap. Recently finished uploads stay listed for a while.
+class UploadQueue {
+public:
+    using Config = UploadQueueConfig;
+
+    /// Upload job: sends the file, reporting through @p progress
+    /// @return 0 on success, or a negative errno
+    using Job = std::function<int(UploadProgress& progress)>;
+
+    explicit UploadQueue(Config config = {});
+    ~UploadQueue();
+
+    UploadQueue(const UploadQueue&) = delete;
+    UploadQueue& operator=(const UploadQueue&) = delete;
+
+    /// Start the worker threads
+    void start();
+
+    /// Run what is already queued, then join the workers
+    void stop();
+
+    /// Queue @p job uploading @p filename (@p size bytes) to @p chat_id
+    /// @return The job's result once it has finished
+    std::future<int> enqueue(uint64_t id, int64_t chat_id, std::string filename, std::size_t size, Job job);
+
+    /// Queued, running and recently finished uploads, oldest first
+    [[nodiscard]] std::vector<UploadStatus> statuses() const;
+
+private:
+    friend class UploadProgress;
+
+    using EntryPtr = std::shared_ptr<UploadProgress::Entry>;
+
+    void worker_loop();
+
+    /// Next job that may start (its chat isn't still submitting), or null
+    [[nodiscard]] EntryPtr take_next();
+
+    /// Let the next upload to @p entry's chat go ahead
+    void release_chat(UploadProgress::Entry& entry);
+
+    /// Drop finished uploads older than the retention period
+    void prune_finished();
+
+    Config config_;
+
+    std::vector<std::thread> workers_;
+    bool running_{false};
+    bool stopping_{false};
+    std::condition_variable cv_;
+    mutable std::mutex mutex_;
+
+    std::map<int64_t, std::deque<EntryPtr>> waiting_;  // Queued jobs per chat, in order
+    std::set<int64_t> submitting_chats_;               // Chats with a job still before submitted()
+    std::deque<EntryPtr> entries_;                     // Every listed upload, in queue order
+    uint64_t next_sequence_{0};
+};
+
+}  // namespace tgfuse
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "fuse/data_provider.hpp"
+#include "fuse/lowlevel.hpp"
 #include "fuse/operations.hpp"
 #include "fuse/platform.hpp"
 
@@ -12,9 +13,17 @@ namespace tgfuse {
 /// VFS configuration
 struct VfsConfig {
     std::string mount_point;
-    bool foreground{true};    // Run in foreground (useful for debugging)
-    bool debug{false};        // Enable FUSE debug output
-    bool allow_other{false};  // Allow other users to access mount
+    bool foreground{true};       // Run in foreground (useful for debugging)
+    bool debug{false};           // Enable FUSE debug output
+    bool allow_other{false};     // Allow other users to access mount
+    unsigned worker_threads{1};  // FUSE worker threads (1 = single-threaded session)
+    double attr_timeout{0.0};    // Seconds the kernel may cache attributes (0 = always ask)
+    double entry_timeout{0.0};   // Seconds the kernel may cache name lookups (0 = always ask)
+    bool kernel_cache{false};    // Keep file data in the page cache across opens
+    bool low_level{false};       // Use the inode-based low-level FUSE API (libfuse3 only)
+
+    /// Write size and caching negotiated with the kernel
+    ConnectionOptions connection{.max_write = 1024 * 1024};
 };
 
 /// Virtual filesystem manager
@@ -50,6 +59,9 @@ public:
     [[nodiscard]] const DataProvider& provider() const { return *provider_; }
 
 private:
+    /// Run an inode-based low-level session instead of fuse_main
+    int mount_low_level(const VfsConfig& config);
+
     std::shared_ptr<DataProvider> provider_;
     std::unique_ptr<DataProviderOperations> operations_;
     VfsConfig config_;
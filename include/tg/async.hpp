@@ -1,9 +1,19 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <coroutine>
+#include <cstddef>
 #include <exception>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <variant>
+#include <vector>
 
 namespace tg {
 
@@ -13,33 +23,105 @@ class Task;
 
 namespace detail {
 
-// Promise type for Task coroutines
-template <typename T>
-class TaskPromise {
+// Blocks a non-coroutine caller until a task completes (possibly on another thread)
+class SyncWaiter {
 public:
-    using Handle = std::coroutine_handle<TaskPromise<T>>;
+    void notify() {
+        // Notify under the lock: the waiter may destroy us as soon as it sees done_
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+        cv_.notify_all();
+    }
 
-    Task<T> get_return_object() noexcept;
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return done_; });
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool done_ = false;
+};
 
+// Completion handling shared by all Task promises
+//
+// A task completes either into its awaiting coroutine (symmetric transfer) or
+// by waking a blocked get_result(). The waiter slot holds nullptr (running),
+// a SyncWaiter (someone is blocked), the late continuation (awaited after
+// resume()) or the promise itself (completed).
+class TaskPromiseBase {
+public:
     std::suspend_always initial_suspend() noexcept { return {}; }
 
-    auto final_suspend() noexcept {
-        struct FinalAwaiter {
-            bool await_ready() const noexcept { return false; }
+    auto final_suspend() noexcept { return FinalAwaiter{}; }
 
-            std::coroutine_handle<> await_suspend(std::coroutine_handle<TaskPromise<T>> h) noexcept {
-                auto& promise = h.promise();
-                if (promise.continuation_) {
-                    return promise.continuation_;
-                }
-                return std::noop_coroutine();
-            }
+    void set_continuation(std::coroutine_handle<> continuation) { continuation_ = continuation; }
 
-            void await_resume() noexcept {}
-        };
-        return FinalAwaiter{};
+    // Register the continuation of a task that is already running (started by resume())
+    // @return false if it completed meanwhile and the caller should just continue
+    bool set_late_continuation(std::coroutine_handle<> continuation) noexcept {
+        late_continuation_ = continuation;
+        void* expected = nullptr;
+        return waiter_.compare_exchange_strong(expected, &late_continuation_, std::memory_order_acq_rel);
     }
 
+    // Mark the coroutine body as started; true only for the first call
+    bool start() noexcept { return !std::exchange(started_, true); }
+
+    bool completed() const noexcept { return waiter_.load(std::memory_order_acquire) == this; }
+
+    // Block until the coroutine has finished
+    void wait() {
+        SyncWaiter waiter;
+        void* expected = nullptr;
+        if (waiter_.compare_exchange_strong(expected, &waiter, std::memory_order_acq_rel)) {
+            waiter.wait();
+        }
+    }
+
+private:
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+            return h.promise().complete();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    std::coroutine_handle<> complete() noexcept {
+        auto continuation = continuation_;
+        void* waiter = waiter_.exchange(this, std::memory_order_acq_rel);
+        if (continuation) {
+            return continuation;
+        }
+        if (waiter == &late_continuation_) {
+            return late_continuation_;
+        }
+        if (waiter) {
+            // Nothing may touch the frame after this: the waiter is free to destroy it
+            static_cast<SyncWaiter*>(waiter)->notify();
+        }
+        return std::noop_coroutine();
+    }
+
+    std::coroutine_handle<> continuation_;
+    std::coroutine_handle<> late_continuation_;
+    std::atomic<void*> waiter_{nullptr};
+    bool started_ = false;
+};
+
+// Promise type for Task coroutines
+template <typename T>
+class TaskPromise : public TaskPromiseBase {
+public:
+    using Handle = std::coroutine_handle<TaskPromise<T>>;
+
+    Task<T> get_return_object() noexcept;
+
     void unhandled_exception() noexcept { result_ = std::current_exception(); }
 
     // For co_return value
@@ -52,40 +134,18 @@ public:
         return std::get<T>(result_);
     }
 
-    void set_continuation(std::coroutine_handle<> continuation) { continuation_ = continuation; }
-
 private:
     std::variant<std::monostate, T, std::exception_ptr> result_;
-    std::coroutine_handle<> continuation_;
 };
 
 // Specialisation for void
 template <>
-class TaskPromise<void> {
+class TaskPromise<void> : public TaskPromiseBase {
 public:
     using Handle = std::coroutine_handle<TaskPromise<void>>;
 
     Task<void> get_return_object() noexcept;
 
-    std::suspend_always initial_suspend() noexcept { return {}; }
-
-    auto final_suspend() noexcept {
-        struct FinalAwaiter {
-            bool await_ready() const noexcept { return false; }
-
-            std::coroutine_handle<> await_suspend(std::coroutine_handle<TaskPromise<void>> h) noexcept {
-                auto& promise = h.promise();
-                if (promise.continuation_) {
-                    return promise.continuation_;
-                }
-                return std::noop_coroutine();
-            }
-
-            void await_resume() noexcept {}
-        };
-        return FinalAwaiter{};
-    }
-
     void unhandled_exception() noexcept { exception_ = std::current_exception(); }
 
     void return_void() noexcept {}
@@ -96,11 +156,8 @@ public:
         }
     }
 
-    void set_continuation(std::coroutine_handle<> continuation) { continuation_ = continuation; }
-
 private:
     std::exception_ptr exception_;
-    std::coroutine_handle<> continuation_;
 };
 
 }  // namespace detail
@@ -136,43 +193,53 @@ public:
     Task(const Task&) = delete;
     Task& operator=(const Task&) = delete;
 
-    // Awaitable interface
-    bool await_ready() const noexcept { return false; }
+    // Awaitable interface (a task is driven either by co_await or by resume()/get_result())
+    bool await_ready() const noexcept { return handle_.promise().completed(); }
 
     std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept {
-        // When this task is co_awaited, set up continuation to be resumed when this task completes
-        handle_.promise().set_continuation(continuation);
-        return handle_;
+        auto& promise = handle_.promise();
+        if (promise.start()) {
+            // When this task is co_awaited, set up continuation to be resumed when this task completes
+            promise.set_continuation(continuation);
+            return handle_;
+        }
+
+        // Already in flight (e.g. a prefetched page): wait for it unless it finished meanwhile
+        if (promise.set_late_continuation(continuation)) {
+            return std::noop_coroutine();
+        }
+        return continuation;
     }
 
+    // The result is moved out: a task is awaited (or waited on) once
     T await_resume() {
         if constexpr (std::is_void_v<T>) {
             handle_.promise().result();
         } else {
-            return handle_.promise().result();
+            return std::move(handle_.promise().result());
         }
     }
 
-    // Resume the task manually
+    // Start the task without waiting for it; it runs until its first suspension
+    // and then continues wherever the awaited operation completes
     void resume() {
-        if (handle_ && !handle_.done()) {
+        if (handle_ && handle_.promise().start()) {
             handle_.resume();
         }
     }
 
-    // Check if task is done
-    bool done() const { return handle_.done(); }
+    // Check if task is done (safe to call while it runs on another thread)
+    bool done() const { return handle_.promise().completed(); }
 
-    // Get the result (will throw if task threw an exception)
+    // Get the result, blocking until the task completes (will throw if task threw an exception)
     T get_result() {
-        while (!handle_.done()) {
-            handle_.resume();
-        }
+        resume();
+        handle_.promise().wait();
 
         if constexpr (std::is_void_v<T>) {
             handle_.promise().result();
         } else {
-            return handle_.promise().result();
+            return std::move(handle_.promise().result());
         }
     }
 
@@ -194,6 +261,218 @@ inline Task<void> TaskPromise<void>::get_return_object() noexcept { return Task<
 
 }  // namespace detail
 
+// Value a Task<T> contributes to a combinator result (void tasks contribute std::monostate)
+template <typename T>
+using TaskValue = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+// Result of when_any: which task finished first and what it returned
+template <typename T>
+struct WhenAnyResult {
+    std::size_t index;
+    TaskValue<T> value;
+};
+
+namespace detail {
+
+// Fire-and-forget coroutine driving one child of a combinator
+// Suspended until start(); destroys its own frame when it finishes.
+class DetachedTask {
+public:
+    struct promise_type {
+        DetachedTask get_return_object() noexcept {
+            return DetachedTask{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+
+    DetachedTask(DetachedTask&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    DetachedTask& operator=(DetachedTask&&) = delete;
+
+    ~DetachedTask() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    void start() { std::exchange(handle_, nullptr).resume(); }
+
+private:
+    explicit DetachedTask(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// Value or exception produced by a child task
+template <typename T>
+struct TaskOutcome {
+    std::optional<TaskValue<T>> value;
+    std::exception_ptr exception;
+
+    TaskValue<T> take() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*value);
+    }
+};
+
+// Run @p task to completion, store its outcome and then call @p on_done
+template <typename T, typename OnDone>
+DetachedTask drive(Task<T> task, TaskOutcome<T>& outcome, OnDone on_done) {
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await task;
+            outcome.value.emplace();
+        } else {
+            outcome.value.emplace(co_await task);
+        }
+    } catch (...) {
+        outcome.exception = std::current_exception();
+    }
+    on_done();
+}
+
+// Resumes the awaiting combinator once @p count arrivals have been signalled
+//
+// The awaiter holds one extra arrival until every child has been started, so
+// children finishing early (on any thread) can't resume it mid-start.
+class CompletionCounter {
+public:
+    explicit CompletionCounter(std::size_t count) : remaining_(count + 1) {}
+
+    void arrive() {
+        if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            continuation_.resume();
+        }
+    }
+
+    // Awaitable starting @p drivers and suspending until all arrivals are in
+    auto start(std::vector<DetachedTask>& drivers) {
+        struct Awaiter {
+            CompletionCounter& counter;
+            std::vector<DetachedTask>& drivers;
+
+            bool await_ready() const noexcept { return false; }
+
+            bool await_suspend(std::coroutine_handle<> continuation) {
+                counter.continuation_ = continuation;
+                for (auto& driver : drivers) {
+                    driver.start();
+                }
+                return counter.remaining_.fetch_sub(1, std::memory_order_acq_rel) != 1;
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        return Awaiter{*this, drivers};
+    }
+
+private:
+    std::atomic<std::size_t> remaining_;
+    std::coroutine_handle<> continuation_;
+};
+
+template <typename... Ts, std::size_t... Is>
+Task<std::tuple<TaskValue<Ts>...>> when_all_impl(std::index_sequence<Is...>, Task<Ts>... tasks) {
+    std::tuple<TaskOutcome<Ts>...> outcomes;
+    CompletionCounter counter(sizeof...(Ts));
+
+    std::vector<DetachedTask> drivers;
+    drivers.reserve(sizeof...(Ts));
+    (drivers.push_back(drive(std::move(tasks), std::get<Is>(outcomes), [&counter] { counter.arrive(); })), ...);
+
+    co_await counter.start(drivers);
+    co_return std::tuple<TaskValue<Ts>...>{std::get<Is>(outcomes).take()...};
+}
+
+}  // namespace detail
+
+/// Run tasks concurrently and wait for all of them
+///
+/// The tasks start when the returned task is awaited (or resumed) and may
+/// finish on different threads; the caller continues on the thread of the
+/// last one. If any task throws, the first exception in argument order is
+/// rethrown once all of them have finished.
+template <typename... Ts>
+Task<std::tuple<TaskValue<Ts>...>> when_all(Task<Ts>... tasks) {
+    return detail::when_all_impl(std::index_sequence_for<Ts...>{}, std::move(tasks)...);
+}
+
+/// Run a homogeneous batch of tasks concurrently and wait for all of them
+/// @return Results in the order of @p tasks
+template <typename T>
+Task<std::vector<TaskValue<T>>> when_all(std::vector<Task<T>> tasks) {
+    std::vector<detail::TaskOutcome<T>> outcomes(tasks.size());
+    detail::CompletionCounter counter(tasks.size());
+
+    std::vector<detail::DetachedTask> drivers;
+    drivers.reserve(tasks.size());
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+        drivers.push_back(detail::drive(std::move(tasks[i]), outcomes[i], [&counter] { counter.arrive(); }));
+    }
+
+    co_await counter.start(drivers);
+
+    std::vector<TaskValue<T>> results;
+    results.reserve(outcomes.size());
+    for (auto& outcome : outcomes) {
+        results.push_back(outcome.take());
+    }
+    co_return results;
+}
+
+/// Run tasks concurrently and continue with the first one to finish
+///
+/// The first finished task decides the result, whether it returned or threw.
+/// The remaining tasks keep running in the background and their results are
+/// discarded, so anything they reference must outlive them.
+template <typename T>
+Task<WhenAnyResult<T>> when_any(std::vector<Task<T>> tasks) {
+    if (tasks.empty()) {
+        throw std::invalid_argument("when_any requires at least one task");
+    }
+
+    // Shared with the children, which may outlive this coroutine
+    struct State {
+        explicit State(std::size_t count) : outcomes(count) {}
+
+        std::vector<detail::TaskOutcome<T>> outcomes;
+        std::atomic<bool> decided{false};
+        std::size_t winner{0};
+        detail::CompletionCounter counter{1};
+    };
+    auto state = std::make_shared<State>(tasks.size());
+
+    std::vector<detail::DetachedTask> drivers;
+    drivers.reserve(tasks.size());
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+        drivers.push_back(detail::drive(std::move(tasks[i]), state->outcomes[i], [state, i] {
+            if (!state->decided.exchange(true, std::memory_order_acq_rel)) {
+                state->winner = i;
+                state->counter.arrive();
+            }
+        }));
+    }
+
+    co_await state->counter.start(drivers);
+    co_return WhenAnyResult<T>{state->winner, state->outcomes[state->winner].take()};
+}
+
+/// Variadic form of when_any for tasks of the same type
+template <typename T, typename... Rest>
+requires(std::is_same_v<Rest, Task<T>> && ...)
+Task<WhenAnyResult<T>> when_any(Task<T> first, Rest... rest) {
+    std::vector<Task<T>> tasks;
+    tasks.reserve(1 + sizeof...(Rest));
+    tasks.push_back(std::move(first));
+    (tasks.push_back(std::move(rest)), ...);
+    co_return co_await when_any(std::move(tasks));
+}
+
 // Promise type for bridging TDLib callbacks to coroutines
 template <typename T>
 class TdPromise {
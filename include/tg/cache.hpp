@@ -1,14 +1,26 @@
 #pragma once
 
+#include "tg/message_batch.hpp"
 #include "tg/types.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <initializer_list>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 struct sqlite3;
+struct sqlite3_stmt;
 
 namespace tg {
 
@@ -22,9 +34,125 @@ struct ChatMessageStats {
     int64_t oldest_message_time{0};  // Timestamp of oldest message (for age check)
 };
 
+/// How far a chat's cached file list has been synced with Telegram
+struct FileListSync {
+    int64_t chat_id{0};
+    int64_t watermark{0};  // Newest message id searched; the list is complete up to here
+    int64_t synced_at{0};  // When the list was last synced (unix time)
+};
+
+/// Reads of a file downloaded into TDLib's files directory
+struct DownloadRecord {
+    std::string file_id;     // Remote file id
+    int64_t size{0};         // Bytes on disk
+    int64_t hits{0};         // Reads served from it (a delta when queued)
+    int64_t last_access{0};  // When it was last read or downloaded (unix time)
+};
+
+/// Totals over the tracked downloads
+struct DownloadStats {
+    std::size_t files{0};
+    int64_t bytes{0};
+    int64_t hits{0};
+};
+
+/// One calendar day (local time) of a chat's cached messages, with its rendered size
+///
+/// Any write of a message into the day marks the bucket stale and bumps its
+/// version. Whoever renders the day records its size and message count with
+/// store_message_bucket(), which only succeeds if the version is unchanged,
+/// so a size rendered before a concurrent write is never kept.
+struct MessageBucket {
+    int64_t start_ts{0};                      // Local midnight starting the day
+    int64_t end_ts{0};                        // Next local midnight (days are 23-25 hours)
+    int64_t version{0};                       // Write generation the size belongs to
+    std::optional<std::size_t> content_size;  // Rendered bytes, or nullopt while stale
+    std::size_t message_count{0};             // Messages rendered (0 while stale)
+    int64_t last_message_time{0};             // Timestamp of the day's newest message
+
+    [[nodiscard]] bool is_stale() const { return !content_size.has_value(); }
+};
+
+/// Start of the local calendar day containing @p timestamp
+[[nodiscard]] int64_t local_day_start(int64_t timestamp);
+
+/// Start of the local calendar day after the one starting at @p day_start
+[[nodiscard]] int64_t local_day_end(int64_t day_start);
+
+/// Write-behind queue settings
+struct WriteBehindConfig {
+    std::chrono::milliseconds flush_interval{100};  // Longest a queued write waits for its transaction
+    std::size_t max_batch_rows{500};                // Queued rows that trigger an early flush
+};
+
+/// Compact message store settings
+///
+/// With compact set, the background flusher periodically moves messages
+/// older than seal_after out of the per-row messages table into one
+/// compressed page per chat and page_span (see message_pages.hpp). Recent
+/// messages stay rows, so new messages and edits remain cheap single-row
+/// writes; an edit to a sealed message is a row that overrides the page
+/// until the next compaction folds it in. Pages are read whether or not
+/// compact is set.
+struct MessageStoreConfig {
+    bool compact{false};                                             // Seal old messages into compressed pages
+    std::chrono::seconds page_span{std::chrono::hours(1)};           // Time covered by one page
+    std::chrono::seconds seal_after{std::chrono::hours(1)};          // Messages younger than this stay rows
+    std::chrono::seconds compact_interval{std::chrono::minutes(5)};  // How often the flusher compacts
+    std::size_t dictionary_bytes{16 * 1024};                         // Preset dictionary trained once (0 disables)
+};
+
+/// Background database maintenance settings
+///
+/// The flusher runs a maintenance tick every interval once queued writes
+/// have been quiet for idle_after. A tick deletes at most delete_batch
+/// expired messages (see set_message_retention()), releases up to
+/// vacuum_pages free pages (if the database uses incremental auto-vacuum,
+/// see CacheManager::convert_vacuum_mode()),
+/// and runs a passive WAL checkpoint or PRAGMA optimize when theirs is
+/// due. Each step is a short transaction of its own, so no read or queued
+/// write waits on whole-database work.
+struct MaintenanceConfig {
+    std::chrono::milliseconds interval{std::chrono::seconds(2)};        // Between ticks
+    std::chrono::milliseconds idle_after{std::chrono::seconds(1)};      // Queued writes this recent postpone a tick
+    std::size_t delete_batch{500};                                      // Expired rows deleted per tick
+    std::size_t vacuum_pages{128};                                      // Free pages released per tick (0 disables)
+    std::chrono::seconds checkpoint_interval{std::chrono::minutes(1)};  // Passive WAL checkpoints
+    std::chrono::seconds optimize_interval{std::chrono::hours(1)};      // PRAGMA optimize
+};
+
+/// SQLite-backed persistent cache
+///
+/// Uses one writer connection plus a small pool of read-only connections, so
+/// lookups from FUSE threads run concurrently with each other and with writes
+/// (the database is in WAL mode). Every connection keeps its statements
+/// prepared for its lifetime and only resets them between calls.
+///
+/// High-rate writers (TDLib updates, history fetches) use the queue_* methods:
+/// rows are coalesced by key and committed by a background thread in one
+/// transaction per batch. Reads commit anything still queued before looking,
+/// so they see rows queued before them. Synchronous writes flush the queue
+/// before applying themselves, so ordering between the two paths is
+/// preserved. A batch that fails to commit stays queued and is retried with
+/// backoff; it's dropped (and logged) only after repeated failures.
 class CacheManager {
 public:
-    explicit CacheManager(const std::string& db_path);
+    /// Default upper bound for pooled read-only connections
+    static constexpr std::size_t kDefaultReaderConnections = 4;
+
+    /// Open (or create) the cache database
+    /// @param db_path Database file path
+    /// @param max_readers Read-only connections opened on demand; 0 serves reads from the writer
+    /// @param write_behind Batching of queued writes
+    /// @param message_store Compact storage of old messages
+    /// @param maintenance Background retention deletes, vacuuming and checkpoints
+    explicit CacheManager(
+        const std::string& db_path,
+        std::size_t max_readers = kDefaultReaderConnections,
+        WriteBehindConfig write_behind = {},
+        MessageStoreConfig message_store = {},
+        MaintenanceConfig maintenance = {}
+    );
     ~CacheManager();
 
     // Disable copy
@@ -59,6 +187,13 @@ public:
     void cache_file_list(int64_t chat_id, const std::vector<FileListItem>& files);
     std::vector<FileListItem> get_cached_file_list(int64_t chat_id, std::optional<MediaType> type = std::nullopt);
 
+    /// Store the files found by a sync of @p chat_id and record it as synced up to @p watermark
+    /// The watermark never moves back, so an older sync finishing late doesn't undo a newer one.
+    void sync_file_list(int64_t chat_id, const std::vector<FileListItem>& files, int64_t watermark);
+
+    /// Sync state of a chat's file list, or nullopt if it was never synced
+    std::optional<FileListSync> get_file_list_sync(int64_t chat_id);
+
     // Cache invalidation
     void invalidate_chat_messages(int64_t chat_id);
     void invalidate_chat_files(int64_t chat_id);
@@ -67,30 +202,234 @@ public:
 
     // Database maintenance
     void vacuum();
+
+    /// Whether the database predates incremental auto-vacuum (maintenance ticks then release no free pages)
+    [[nodiscard]] bool vacuum_mode_pending() const { return vacuum_mode_pending_; }
+
+    /// Switch an older database to incremental auto-vacuum with a one-off full VACUUM
+    /// Blocks every write for as long as it takes, so it is meant for startup, before the cache is in use.
+    /// @return false if the database already uses it
+    bool convert_vacuum_mode();
+
+    /// Delete every message older than @p older_than_timestamp, a batch per transaction
     void cleanup_old_messages(int64_t older_than_timestamp);
 
+    /// Have maintenance ticks delete cached messages older than @p max_age (0 keeps them all)
+    void set_message_retention(std::chrono::seconds max_age);
+
+    /// Delete at most @p limit message rows and pages that end before @p older_than, in one transaction
+    /// @return Rows and pages deleted (less than @p limit once nothing older is left)
+    std::size_t expire_messages(int64_t older_than, std::size_t limit);
+
+    /// Run one maintenance tick now (the flusher runs them while writes are quiet)
+    /// @return Expired rows and pages deleted
+    std::size_t run_maintenance();
+
     // Chat message statistics
     void update_chat_message_stats(const ChatMessageStats& stats);
     std::optional<ChatMessageStats> get_chat_message_stats(int64_t chat_id);
     std::vector<ChatMessageStats> get_all_chat_message_stats();
 
     // Get messages within time range for formatting (sorted by timestamp ASC)
-    std::vector<Message> get_messages_for_display(int64_t chat_id, int64_t max_age_seconds);
+    MessageBatch get_messages_for_display(int64_t chat_id, int64_t max_age_seconds);
+
+    /// Messages of @p chat_id with from_ts <= timestamp < to_ts, rows and pages, sorted by timestamp ASC
+    MessageBatch get_messages_in_range(int64_t chat_id, int64_t from_ts, int64_t to_ts);
+
+    /// Day buckets of @p chat_id ending after @p since, oldest first (stale ones included)
+    std::vector<MessageBucket> get_message_buckets(int64_t chat_id, int64_t since = 0);
+
+    /// Record the rendered size of a bucket read by get_message_buckets()
+    /// @return false if a message was written into the day since (the bucket stays stale)
+    bool store_message_bucket(int64_t chat_id, const MessageBucket& bucket);
 
     // Evict old messages from SQLite for a specific chat
     void evict_old_messages(int64_t chat_id, int64_t older_than_timestamp);
 
+    /// Seal messages older than MessageStoreConfig::seal_after into compressed pages
+    /// Runs from the flusher when compact is set; a no-op otherwise.
+    void compact_messages();
+
+    /// Cached messages matching a full-text query, newest first
+    ///
+    /// Every cached message (including sealed ones) is indexed as it is
+    /// stored, by its text and attachment filename.
+    /// @param query Words that must all appear; a trailing * matches a prefix
+    /// @param chat_id Search only this chat
+    /// @return Nothing if the query has no words or SQLite was built without FTS5
+    MessageBatch
+    search_messages(std::string_view query, std::optional<int64_t> chat_id = std::nullopt, int limit = 100);
+
     // Upload deduplication cache
     std::optional<std::string> get_cached_upload(const std::string& file_hash);
     void cache_upload(const std::string& file_hash, int64_t file_size, const std::string& remote_file_id);
     void invalidate_upload(const std::string& file_hash);
 
+    // Small persistent key/value state (e.g. the logged-in user for warm starts)
+    std::optional<std::string> get_setting(const std::string& key);
+    void set_setting(const std::string& key, const std::string& value);
+
+    // Downloaded files store: per-file access stats behind the disk budget
+    /// Coldest tracked downloads, least recently read first, that together free @p bytes_to_free
+    /// Files read at or after @p accessed_before are never returned (the hot working set).
+    std::vector<DownloadRecord> get_download_eviction_candidates(int64_t bytes_to_free, int64_t accessed_before);
+    DownloadStats get_download_stats();
+    void remove_download(const std::string& file_id);
+
+    // Write-behind queue (committed in batches by the background flusher)
+    void queue_user(const User& user);
+    void queue_chat(const Chat& chat);
+    void queue_message(const Message& msg);
+    void queue_messages(const std::vector<Message>& messages);
+    void queue_messages(std::vector<Message>&& messages);  // Moves the messages into the queue
+    void queue_chat_message_stats(const ChatMessageStats& stats);
+    void queue_file_item(int64_t chat_id, const FileListItem& item);
+
+    /// Record a read (or download) of a file: adds its hits, keeps the latest size and access time
+    void queue_download_access(const DownloadRecord& access);
+
+    /// Count a newly received message in its chat's stats
+    ///
+    /// Bumps message_count and last_message_time without a read-modify-write
+    /// on the caller's thread.
+    void queue_message_stats_increment(const Message& msg);
+
+    /// Commit everything queued so far before returning
+    ///
+    /// If the commit fails the rows stay queued for the flusher to retry.
+    void flush();
+
 private:
+    class Connection;  // sqlite3 handle with its prepared statement cache
+    class ReadLease;   // Connection borrowed for one read call
+
+    /// Stats delta from messages received in one chat since the last flush
+    struct StatsIncrement {
+        std::size_t count{0};
+        int64_t first_time{0};
+        int64_t last_time{0};
+    };
+
+    /// Writes queued since the last flush, coalesced by primary key
+    struct PendingWrites {
+        std::unordered_map<int64_t, User> users;
+        std::unordered_map<int64_t, Chat> chats;
+        std::map<std::pair<int64_t, int64_t>, Message> messages;  // Keyed by (chat_id, message_id)
+        std::unordered_map<int64_t, ChatMessageStats> stats;
+        std::unordered_map<int64_t, StatsIncrement> stats_increments;
+        std::map<std::pair<int64_t, int64_t>, FileListItem> files;  // Keyed by (chat_id, message_id)
+        std::unordered_map<std::string, DownloadRecord> downloads;  // Keyed by file_id, hits summed
+
+        [[nodiscard]] std::size_t rows() const;
+
+        /// Put back @p older, a batch taken before these rows were queued; rows queued since win
+        void merge_older(PendingWrites&& older);
+    };
+
     void init_database();
     void create_tables();
 
-    sqlite3* db_;
-    std::mutex mutex_;  // Protect concurrent access
+    /// Messages of @p chat_id in pages matching a page query bound to @p chat_id (?1) and @p bounds (?2, ?3...)
+    /// @param out A std::vector<Message>, or a MessageBatch the pages are inflated into
+    template <typename Out>
+    void read_pages(
+        Connection& conn,
+        const char* sql,
+        int64_t chat_id,
+        std::initializer_list<int64_t> bounds,
+        Out& out
+    );
+
+    /// A preset dictionary by id (cached after the first load; shared by all connections)
+    std::shared_ptr<const std::string> dictionary(Connection& conn, int64_t id);
+
+    /// Load the newest dictionary, or train one once enough messages are cached (caller holds writer_mutex_)
+    void ensure_dictionary();
+
+    /// Fold the rows of @p chat_id older than @p cutoff into its pages (caller holds writer_mutex_)
+    /// @return Messages sealed
+    std::size_t compact_chat(int64_t chat_id, int64_t cutoff);
+
+    /// Drop paged messages older than @p older_than, of one chat or all (caller holds writer_mutex_)
+    void trim_pages(int64_t older_than, std::optional<int64_t> chat_id);
+
+    /// Encode @p messages as the page of @p chat_id at @p start_ts, or drop the page if empty
+    void store_page(int64_t chat_id, int64_t start_ts, std::vector<Message>& messages);
+
+    /// Drop day buckets ending before @p older_than and mark the straddling one stale
+    /// (caller holds writer_mutex_)
+    void trim_buckets(int64_t older_than, std::optional<int64_t> chat_id);
+
+    /// Mark the day bucket holding @p timestamp stale, creating it if missing (caller holds writer_mutex_)
+    void touch_bucket(int64_t chat_id, int64_t timestamp);
+
+    /// Drop search entries older than @p older_than, of one chat or all (caller holds writer_mutex_)
+    void unindex_messages(int64_t older_than, std::optional<int64_t> chat_id);
+
+    // Row writers - the caller holds writer_mutex_
+    void store_user(const User& user);
+    void store_chat(const Chat& chat);
+    void store_message(const Message& msg);
+    void index_message(const Message& msg);
+    void store_file_item(int64_t chat_id, const FileListItem& item);
+    void store_chat_message_stats(const ChatMessageStats& stats);
+    void store_stats_increment(int64_t chat_id, const StatsIncrement& increment);
+    void store_download_access(const DownloadRecord& access);
+
+    /// Run @p body in one BEGIN IMMEDIATE/COMMIT (caller holds writer_mutex_)
+    template <typename Body>
+    void write_transaction(Body&& body);
+
+    /// Commit the queued writes (caller holds writer_mutex_)
+    ///
+    /// A batch that fails is merged back into pending_ and retried after a backoff.
+    void apply_pending_writes();
+
+    /// flush() unless nothing is queued or a failed batch is backing off (reads call this first)
+    void flush_queued();
+
+    /// Add to the queue and wake the flusher once a batch is full
+    template <typename Update>
+    void enqueue(Update&& update);
+
+    void write_behind_loop();
+
+    /// Take an idle reader, opening a new one while under max_readers_
+    Connection* acquire_reader();
+    void release_reader(Connection* reader);
+
+    std::string db_path_;
+    std::unique_ptr<Connection> writer_;
+    std::mutex writer_mutex_;  // Serialises use of writer_
+
+    std::size_t max_readers_;
+    std::vector<std::unique_ptr<Connection>> readers_;
+    std::vector<Connection*> idle_readers_;
+    std::mutex readers_mutex_;
+    std::condition_variable readers_cv_;
+
+    WriteBehindConfig write_behind_;
+    PendingWrites pending_;
+    std::mutex pending_mutex_;  // Lock order: writer_mutex_ before pending_mutex_
+    std::condition_variable pending_cv_;
+    std::size_t failed_flushes_{0};                   // Consecutive failed batches; guarded by pending_mutex_
+    std::chrono::steady_clock::time_point retry_at_;  // Backoff after a failed batch; guarded by pending_mutex_
+    bool stopping_{false};
+    std::thread flusher_;
+
+    MessageStoreConfig message_store_;
+    std::unordered_map<int64_t, std::shared_ptr<const std::string>> dictionaries_;  // By id
+    int64_t current_dictionary_{0};  // Dictionary new pages use (0 = none); guarded by writer_mutex_
+    std::mutex dictionaries_mutex_;
+
+    MaintenanceConfig maintenance_;
+    std::atomic<int64_t> retention_seconds_{0};              // Message retention (0 = keep all)
+    std::chrono::steady_clock::time_point last_queued_;      // Latest enqueue(); guarded by pending_mutex_
+    std::chrono::steady_clock::time_point next_checkpoint_;  // Guarded by writer_mutex_
+    std::chrono::steady_clock::time_point next_optimize_;    // Guarded by writer_mutex_
+    std::atomic<bool> vacuum_mode_pending_{false};  // Database predates incremental vacuum (convert_vacuum_mode())
+
+    bool search_enabled_{false};  // The FTS5 index exists (set once by create_tables)
 };
 
 }  // namespace tg
@@ -2,16 +2,54 @@
 
 #include "tg/async.hpp"
 #include "tg/cache.hpp"
+#include "tg/message_batch.hpp"
+#include "tg/rate_limiter.hpp"
 #include "tg/types.hpp"
 
 #include <chrono>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
 namespace tg {
 
+class TelegramClient;
+
+/// Threads and limits shared by the clients of several Telegram accounts
+///
+/// TDLib multiplexes every client of a process over one ClientManager. A
+/// hub runs the single receive loop for them, routing each response to its
+/// client by client id, and one dispatcher applying their queued updates.
+/// Clients created with the same hub also share its executor and rate
+/// limiter, so N accounts cost one set of threads and one request budget.
+/// The hub outlives its clients, which keep a reference to it.
+class ClientHub {
+public:
+    struct Config {
+        std::size_t executor_threads = 4;  // Threads resuming TDLib query continuations (0 = receive thread)
+        RateLimiterConfig rate_limits{};   // Pacing of the queries of every client
+    };
+
+    explicit ClientHub(const Config& config);
+    ~ClientHub();
+
+    // Disable copy
+    ClientHub(const ClientHub&) = delete;
+    ClientHub& operator=(const ClientHub&) = delete;
+
+    /// Limiter pacing the awaited TDLib queries of every client of the hub
+    RateLimiter& rate_limiter();
+    const RateLimiter& rate_limiter() const;
+
+private:
+    friend class TelegramClient;
+
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
 class TelegramClient {
 public:
     // Configuration for the client
@@ -28,9 +66,17 @@ public:
         bool use_chat_info_database = true;
         bool use_message_database = true;
         bool enable_storage_optimiser = true;
+        std::size_t executor_threads = 4;    // Threads resuming TDLib query continuations (0 = receive thread)
+        RateLimiterConfig rate_limits{};     // Pacing of TDLib queries
+        MessageStoreConfig message_store{};  // Compressed pages for old cached messages
+        MaintenanceConfig maintenance{};     // Background retention deletes, vacuuming and checkpoints
     };
 
+    /// Client with a hub of its own, built from executor_threads and rate_limits
     explicit TelegramClient(const Config& config);
+
+    /// Client sharing @p hub with other accounts (executor_threads and rate_limits are the hub's)
+    TelegramClient(const Config& config, std::shared_ptr<ClientHub> hub);
     ~TelegramClient();
 
     // Disable copy
@@ -43,6 +89,8 @@ public:
 
     // Authentication
     Task<AuthState> get_auth_state();
+    /// Wait up to @p timeout for authorisation to become ready; false on timeout
+    Task<bool> wait_until_ready(std::chrono::milliseconds timeout);
     Task<void> login(const std::string& phone);
     Task<void> submit_code(const std::string& code);
     Task<void> submit_password(const std::string& password);
@@ -61,7 +109,7 @@ public:
     // Entity lookup
     Task<std::optional<Chat>> resolve_username(const std::string& username);
     Task<std::optional<Chat>> get_chat(int64_t chat_id);
-    Task<std::optional<User>> get_user(int64_t user_id);
+    Task<std::optional<User>> get_user(int64_t user_id);  // Includes the bio
     Task<User> get_me();  // Get the current logged-in user
 
     // Messaging
@@ -75,9 +123,8 @@ public:
     /// @param chat_id Chat to fetch from
     /// @param min_messages Minimum messages to fetch
     /// @param max_age Maximum age of oldest message
-    /// @return Vector of messages (unsorted, caller should sort)
-    Task<std::vector<Message>>
-    get_messages_until(int64_t chat_id, std::size_t min_messages, std::chrono::seconds max_age);
+    /// @return The messages (unsorted, caller should sort); they are already queued to the cache
+    Task<MessageBatch> get_messages_until(int64_t chat_id, std::size_t min_messages, std::chrono::seconds max_age);
 
     // File operations
     Task<Message> send_file(int64_t chat_id, const std::string& path, SendMode mode = SendMode::AUTO);
@@ -86,10 +133,65 @@ public:
     send_file(int64_t chat_id, const std::string& path, SendMode mode, const std::string& file_hash, int64_t file_size);
     Task<Message>
     send_file_by_id(int64_t chat_id, const std::string& remote_file_id, const std::string& filename, SendMode mode);
-    Task<std::vector<FileListItem>> list_media(int64_t chat_id);
-    Task<std::vector<FileListItem>> list_files(int64_t chat_id);
+
+    /// Start uploading @p path to Telegram while it is still being written
+    ///
+    /// The upload runs ahead of the message that will carry it. Report the
+    /// contiguous prefix written so far with streaming_upload_progress() and the
+    /// final size with finish_streaming_upload(), then send it to a chat with
+    /// send_streaming_upload() - or drop it with cancel_streaming_upload().
+    /// @p path is named as the file should appear in the chat and must be in a
+    /// directory of its own: both are removed once the message is sent.
+    /// @return Upload ID, or 0 if TDLib didn't accept the upload
+    Task<int64_t> begin_streaming_upload(const std::string& path, SendMode mode);
+    void streaming_upload_progress(int64_t upload_id, int64_t available);
+    void finish_streaming_upload(int64_t upload_id, int64_t size);
+    void cancel_streaming_upload(int64_t upload_id);
+    /// Send a streaming upload (with hash for the upload deduplication cache)
+    Task<Message> send_streaming_upload(
+        int64_t chat_id,
+        int64_t upload_id,
+        SendMode mode,
+        const std::string& file_hash,
+        int64_t file_size
+    );
+
+    /// Upload progress of a file message sent with send_file() or send_streaming_upload()
+    /// @param message_id ID of the message as returned by the send
+    /// @return Progress while the upload is in flight, nullopt once it has finished (or failed)
+    [[nodiscard]] std::optional<FileUploadState> get_upload_state(int64_t message_id);
+
+    /// Media (photos, videos) and documents of a chat, newest first
+    /// @param after_message_id Only list files newer than this message (0 for the whole history)
+    Task<std::vector<FileListItem>> list_media(int64_t chat_id, int64_t after_message_id = 0);
+    Task<std::vector<FileListItem>> list_files(int64_t chat_id, int64_t after_message_id = 0);
     Task<std::string> download_file(const std::string& file_id, const std::string& destination_path = "");
 
+    /// Ensure a byte range of a file is available locally, downloading only that range
+    /// @param file_id Remote file ID
+    /// @param offset Start of the range
+    /// @param limit Number of bytes required (0 = up to the end of the file)
+    /// @param read_ahead Extra bytes past the range to keep downloading in the background
+    /// @return Download state; `available` counts contiguous local bytes from offset
+    Task<FileDownloadState>
+    download_file_range(const std::string& file_id, int64_t offset, int64_t limit, int64_t read_ahead = 0);
+
+    /// Stop tracking the download progress of a file read with download_file_range()
+    /// Call when the reader is done; reading the file again afterwards is fine
+    void release_file_range(const std::string& file_id);
+
+    /// Bytes of downloaded files TDLib keeps in files_directory
+    Task<int64_t> get_files_size();
+
+    /// Delete the local copy of a downloaded file (it stays available on Telegram)
+    /// @return true if a local copy was deleted
+    Task<bool> delete_local_file(const std::string& file_id);
+
+    /// Let TDLib delete its least recently used files until the store fits @p max_bytes
+    /// @param immunity Files used within this long are kept
+    /// @return Bytes left in the files store
+    Task<int64_t> optimize_storage(int64_t max_bytes, std::chrono::seconds immunity);
+
     // Chat status polling
     Task<ChatStatus> get_chat_status(int64_t chat_id);
 
@@ -100,10 +202,21 @@ public:
     CacheManager& cache() { return *cache_; }
     const CacheManager& cache() const { return *cache_; }
 
+    /// Limiter pacing every awaited TDLib query (the hub's, shared with its other clients)
+    /// Requests made on a thread take its RequestPriorityScope (interactive by default).
+    RateLimiter& rate_limiter();
+    const RateLimiter& rate_limiter() const;
+
     // Event callbacks
     using MessageCallback = std::function<void(const Message&)>;
     using ChatCallback = std::function<void(const Chat&)>;
     using UserCallback = std::function<void(const User&)>;
+    using UserFullInfoCallback = std::function<void(int64_t user_id, const std::string& bio)>;
+    using ChatActivityCallback = std::function<void(int64_t chat_id)>;
+    /// Outcome of a sent message, keyed by the pending id send_text() returned:
+    /// its server id, or 0 and the error if Telegram refused it
+    using MessageSendCallback =
+        std::function<void(int64_t pending_message_id, int64_t message_id, const std::string& error)>;
 
     /// Set callback for new messages
     /// The callback is called from the TDLib event loop thread
@@ -117,7 +230,21 @@ public:
     /// Called when TDLib sends updateUser events
     void set_user_callback(UserCallback callback);
 
+    /// Set callback for changed full user info (the bio)
+    /// Called when TDLib sends updateUserFullInfo events, for users whose full info was fetched
+    void set_user_full_info_callback(UserFullInfoCallback callback);
+
+    /// Set callback for chats whose last message changed
+    /// Called when TDLib sends updateChatLastMessage events (new, edited or deleted last messages)
+    void set_chat_activity_callback(ChatActivityCallback callback);
+
+    /// Set callback for sent messages reaching Telegram (or failing to)
+    /// Called when TDLib sends updateMessageSendSucceeded and updateMessageSendFailed events
+    void set_message_send_callback(MessageSendCallback callback);
+
 private:
+    friend class ClientHub;
+
     class Impl;
     Config config_;
     std::unique_ptr<CacheManager> cache_;
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace tg {
+
+/// Fixed-capacity table of pending requests, completed by id without locks
+///
+/// An id encodes the slot the entry lives in and the slot's generation,
+/// so a late or duplicate completion for a slot that has since been
+/// reused finds a different generation and is ignored. Free slots are kept
+/// on a lock-free stack: insert() pops one, and completing an entry pushes
+/// it back. Nothing allocates after construction.
+///
+/// Any thread may insert and take. The slot state is claimed with one
+/// compare-and-swap, so exactly one of take() and expire() gets each entry.
+template <typename Entry>
+class CompletionTable {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// @param capacity Entries pending at once (at most 2^32 - 1)
+    explicit CompletionTable(std::size_t capacity)
+        : slots_(std::make_unique<Slot[]>(capacity)), capacity_(static_cast<uint32_t>(capacity)) {
+        for (uint32_t index = capacity_; index > 0; --index) {
+            push_free(index - 1);
+        }
+    }
+
+    ~CompletionTable() = default;
+
+    CompletionTable(const CompletionTable&) = delete;
+    CompletionTable& operator=(const CompletionTable&) = delete;
+
+    /// Store @p entry until it is taken or @p deadline passes
+    /// @return Its id (never 0), or 0 if every slot is in use (@p entry is then left untouched)
+    [[nodiscard]] uint64_t insert(Entry&& entry, Clock::time_point deadline = Clock::time_point::max()) {
+        auto index = pop_free();
+        if (!index) {
+            return 0;
+        }
+
+        // The slot is ours until it is published as pending
+        auto& slot = slots_[*index];
+        slot.entry.emplace(std::move(entry));
+        slot.deadline.store(deadline.time_since_epoch().count(), std::memory_order_relaxed);
+        auto generation = slot.state.load(std::memory_order_relaxed) >> 1;
+        slot.state.store((generation << 1) | kPending, std::memory_order_release);
+        size_.fetch_add(1, std::memory_order_relaxed);
+        return (generation << 32) | (static_cast<uint64_t>(*index) + 1);
+    }
+
+    /// Remove and return the entry stored as @p id
+    /// @return nullopt if @p id is unknown, already taken or expired
+    [[nodiscard]] std::optional<Entry> take(uint64_t id) {
+        auto index = static_cast<uint32_t>(id & 0xffffffffu);
+        if (index == 0 || index > capacity_) {
+            return std::nullopt;
+        }
+        auto& slot = slots_[index - 1];
+        auto generation = id >> 32;
+        auto expected = (generation << 1) | kPending;
+        auto next = ((generation + 1) & 0xffffffffu) << 1;
+        if (!slot.state.compare_exchange_strong(expected, next, std::memory_order_acquire)) {
+            return std::nullopt;
+        }
+
+        std::optional<Entry> entry = std::move(slot.entry);
+        slot.entry.reset();
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        push_free(index - 1);
+        return entry;
+    }
+
+    /// Take every entry whose deadline is at or before @p now, passing each to @p on_expired
+    /// Scans the whole table; meant for a periodic sweep.
+    template <typename OnExpired>
+    void expire(Clock::time_point now, OnExpired&& on_expired) {
+        auto now_rep = now.time_since_epoch().count();
+        for (uint32_t index = 0; index < capacity_; ++index) {
+            auto& slot = slots_[index];
+            auto state = slot.state.load(std::memory_order_acquire);
+            if ((state & kPending) == 0 || slot.deadline.load(std::memory_order_relaxed) > now_rep) {
+                continue;
+            }
+            // A slot reused since the load has a new generation, so take() leaves it alone
+            if (auto entry = take(((state >> 1) << 32) | (static_cast<uint64_t>(index) + 1))) {
+                on_expired(std::move(*entry));
+            }
+        }
+    }
+
+    /// Entries pending right now
+    [[nodiscard]] std::size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] std::size_t capacity() const { return capacity_; }
+
+private:
+    static constexpr uint64_t kPending = 1;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> state{0};  // generation << 1 | pending
+        std::atomic<Clock::rep> deadline{0};
+        std::atomic<uint32_t> next_free{0};  // Free stack link: index + 1 of the next free slot (0 ends it)
+        std::optional<Entry> entry;
+    };
+
+    std::optional<uint32_t> pop_free() {
+        auto head = free_head_.load(std::memory_order_acquire);
+        while (true) {
+            auto top = static_cast<uint32_t>(head & 0xffffffffu);
+            if (top == 0) {
+                return std::nullopt;
+            }
+            // The tag in the upper half changes on every update, so a concurrently recycled top fails the CAS
+            uint64_t next = slots_[top - 1].next_free.load(std::memory_order_relaxed);
+            uint64_t desired = (((head >> 32) + 1) << 32) | next;
+            if (free_head_.compare_exchange_weak(head, desired, std::memory_order_acquire)) {
+                return top - 1;
+            }
+        }
+    }
+
+    void push_free(uint32_t index) {
+        auto head = free_head_.load(std::memory_order_relaxed);
+        uint64_t desired;
+        do {
+            slots_[index].next_free.store(static_cast<uint32_t>(head & 0xffffffffu), std::memory_order_relaxed);
+            desired = (((head >> 32) + 1) << 32) | (static_cast<uint64_t>(index) + 1);
+        } while (!free_head_.compare_exchange_weak(head, desired, std::memory_order_release));
+    }
+
+    std::unique_ptr<Slot[]> slots_;
+    uint32_t capacity_;
+    std::atomic<uint64_t> free_head_{0};  // tag << 32 | (index + 1) of the top free slot
+    std::atomic<std::size_t> size_{0};
+};
+
+}  // namespace tg
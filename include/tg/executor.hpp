@@ -0,0 +1,172 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tg {
+
+/// Where coroutine continuations (and other small jobs) run
+///
+/// TDLib responses don't resume their awaiting coroutine on the receiving
+/// thread; they are posted to an executor, so a caller can keep many
+/// requests in flight without parking a thread per request.
+class Executor {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Work = std::function<void()>;
+
+    virtual ~Executor() = default;
+
+    /// Run @p work as soon as possible
+    virtual void post(Work work) = 0;
+
+    /// Run @p work once @p delay has passed
+    virtual void post_after(Clock::duration delay, Work work) = 0;
+
+    /// Awaitable that continues the awaiting coroutine on this executor
+    [[nodiscard]] auto schedule() { return ScheduleAwaiter{*this, Clock::duration::zero()}; }
+
+    /// Awaitable that continues the awaiting coroutine on this executor after @p delay
+    [[nodiscard]] auto schedule_after(Clock::duration delay) { return ScheduleAwaiter{*this, delay}; }
+
+private:
+    struct ScheduleAwaiter {
+        Executor& executor;
+        Clock::duration delay;
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            if (delay > Clock::duration::zero()) {
+                executor.post_after(delay, [handle] { handle.resume(); });
+            } else {
+                executor.post([handle] { handle.resume(); });
+            }
+        }
+
+        void await_resume() const noexcept {}
+    };
+};
+
+/// Runs work on the posting thread
+///
+/// Used as the TDLib client's executor when no worker threads are configured:
+/// query responses then resume their coroutines on the receive thread.
+/// Delayed work blocks the posting thread for the delay.
+class InlineExecutor final : public Executor {
+public:
+    void post(Work work) override;
+    void post_after(Clock::duration delay, Work work) override;
+};
+
+/// Fixed-size thread pool with delayed work support
+///
+/// Work is run in FIFO order; delayed work becomes ready at its deadline.
+/// Destruction runs everything already ready, drops pending delayed work and
+/// joins the workers.
+class ThreadPoolExecutor final : public Executor {
+public:
+    /// @param threads Number of worker threads (at least one is started)
+    explicit ThreadPoolExecutor(std::size_t threads);
+    ~ThreadPoolExecutor() override;
+
+    // Disable copy
+    ThreadPoolExecutor(const ThreadPoolExecutor&) = delete;
+    ThreadPoolExecutor& operator=(const ThreadPoolExecutor&) = delete;
+
+    void post(Work work) override;
+    void post_after(Clock::duration delay, Work work) override;
+
+    /// Number of worker threads
+    [[nodiscard]] std::size_t size() const { return workers_.size(); }
+
+private:
+    void worker_loop();
+
+    std::vector<std::thread> workers_;
+    std::deque<Work> ready_;
+    std::multimap<Clock::time_point, Work> delayed_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_{false};
+};
+
+/// Work of one owner (e.g. a TDLib client) on an executor it shares with others
+///
+/// Work posted through the scope runs on the executor as usual. Before the
+/// owner goes away it closes the scope: delayed work that hasn't started is
+/// cancelled (its on_cancel runs instead), work already queued or running is
+/// waited for, and work posted afterwards is dropped. Once close() returns
+/// nothing of the scope runs, however long the executor lives on.
+class ExecutorScope {
+public:
+    using Clock = Executor::Clock;
+    using Work = Executor::Work;
+
+    explicit ExecutorScope(Executor& executor);
+
+    /// Closes the scope
+    ~ExecutorScope();
+
+    // Disable copy
+    ExecutorScope(const ExecutorScope&) = delete;
+    ExecutorScope& operator=(const ExecutorScope&) = delete;
+
+    /// Run @p work on the executor
+    /// @return false if the scope is closed: @p work was dropped
+    bool post(Work work);
+
+    /// Run @p work on the executor once @p delay has passed
+    /// @param on_cancel Run instead if the scope closes first: on the closing
+    ///        thread, or on this one if the scope is closed already
+    void post_after(Clock::duration delay, Work work, Work on_cancel = {});
+
+    /// Cancel delayed work, wait for queued and running work, and drop work posted from now on
+    /// Work of this scope that close() is called from isn't waited for.
+    void close();
+
+    /// Work posted and neither finished nor cancelled yet
+    [[nodiscard]] std::size_t pending() const;
+
+    /// Whether close() has been called
+    [[nodiscard]] bool closed() const;
+
+    /// Awaitable that continues the awaiting coroutine on the executor after @p delay
+    /// co_await yields false if the scope closed first; the coroutine then continues as on_cancel would
+    [[nodiscard]] auto schedule_after(Clock::duration delay) { return ScheduleAwaiter{*this, delay}; }
+
+private:
+    struct State;
+
+    struct ScheduleAwaiter {
+        ExecutorScope& scope;
+        Clock::duration delay;
+        bool cancelled{false};
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            scope.post_after(delay, [handle] { handle.resume(); }, [this, handle] {
+                cancelled = true;
+                handle.resume();
+            });
+        }
+
+        bool await_resume() const noexcept { return !cancelled; }
+    };
+
+    Executor& executor_;
+    std::shared_ptr<State> state_;  // Shared with the posted work, which may outlive the scope
+};
+
+}  // namespace tg
@@ -73,9 +73,9 @@ struct fmt::formatter<tg::ChatType> : fmt::formatter<std::string_view> {
 };
 
 template <>
-struct fmt::formatter<tg::MediaInfo> : fmt::formatter<std::string_view> {
+struct fmt::formatter<tg::MediaView> : fmt::formatter<std::string_view> {
     template <typename FormatContext>
-    auto format(const tg::MediaInfo& media, FormatContext& ctx) const -> decltype(ctx.out()) {
+    auto format(const tg::MediaView& media, FormatContext& ctx) const -> decltype(ctx.out()) {
         if (media.filename.empty()) {
             return fmt::format_to(ctx.out(), "[{}]", media.type);
         }
@@ -83,6 +83,9 @@ struct fmt::formatter<tg::MediaInfo> : fmt::formatter<std::string_view> {
     }
 };
 
+template <>
+struct fmt::formatter<tg::MediaInfo> : fmt::formatter<tg::MediaView> {};
+
 template <>
 struct fmt::formatter<tg::User> : fmt::formatter<std::string_view> {
     enum class Format : char {
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace tg {
+
+template <typename Signature, std::size_t Capacity = 48>
+class InplaceFunction;
+
+/// Move-only std::function replacement that never allocates
+///
+/// The callable is stored in a fixed buffer inside the object; one that
+/// doesn't fit is a compile error rather than a hidden heap allocation.
+template <typename R, typename... Args, std::size_t Capacity>
+class InplaceFunction<R(Args...), Capacity> {
+public:
+    InplaceFunction() noexcept = default;
+    InplaceFunction(std::nullptr_t) noexcept {}  // NOLINT(google-explicit-constructor)
+
+    template <typename F, typename D = std::decay_t<F>>
+        requires(!std::is_same_v<D, InplaceFunction> && std::is_invocable_r_v<R, D&, Args...>)
+    InplaceFunction(F&& f) {  // NOLINT(google-explicit-constructor)
+        static_assert(sizeof(D) <= Capacity, "Callable too large for this InplaceFunction");
+        static_assert(alignof(D) <= alignof(std::max_align_t), "Callable over-aligned for InplaceFunction");
+        static_assert(std::is_nothrow_move_constructible_v<D>, "Callable must be nothrow movable");
+        ::new (static_cast<void*>(storage_)) D(std::forward<F>(f));
+        ops_ = &kOps<D>;
+    }
+
+    InplaceFunction(InplaceFunction&& other) noexcept : ops_(other.ops_) {
+        if (ops_) {
+            ops_->move(other.storage_, storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    InplaceFunction& operator=(InplaceFunction&& other) noexcept {
+        if (this != &other) {
+            reset();
+            if (other.ops_) {
+                other.ops_->move(other.storage_, storage_);
+                ops_ = std::exchange(other.ops_, nullptr);
+            }
+        }
+        return *this;
+    }
+
+    InplaceFunction(const InplaceFunction&) = delete;
+    InplaceFunction& operator=(const InplaceFunction&) = delete;
+
+    ~InplaceFunction() { reset(); }
+
+    /// Destroy the stored callable, if any
+    void reset() noexcept {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+    /// Call the stored callable (must not be empty)
+    R operator()(Args... args) { return ops_->invoke(storage_, std::forward<Args>(args)...); }
+
+private:
+    struct Ops {
+        R (*invoke)(void* callable, Args&&... args);
+        void (*move)(void* from, void* to) noexcept;  // Move-constructs into @p to and destroys @p from
+        void (*destroy)(void* callable) noexcept;
+    };
+
+    template <typename D>
+    static constexpr Ops kOps{
+        [](void* callable, Args&&... args) -> R {
+            return std::invoke(*static_cast<D*>(callable), std::forward<Args>(args)...);
+        },
+        [](void* from, void* to) noexcept {
+            ::new (to) D(std::move(*static_cast<D*>(from)));
+            static_cast<D*>(from)->~D();
+        },
+        [](void* callable) noexcept { static_cast<D*>(callable)->~D(); },
+    };
+
+    alignas(std::max_align_t) unsigned char storage_[Capacity];
+    const Ops* ops_{nullptr};
+};
+
+}  // namespace tg
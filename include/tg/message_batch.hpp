@@ -0,0 +1,91 @@
+#pragma once
+
+#include "tg/types.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace tg {
+
+/// Messages of one bulk read, with their strings in an arena owned by the batch
+///
+/// As Message objects, every text, file id and filename of a page of
+/// history is an allocation of its own. A batch holds MessageViews whose
+/// strings are copied into a monotonic arena and freed all at once with
+/// it, so filling one costs a handful of block allocations. Mime types
+/// and filenames repeat within a chat ("image/jpeg", "photo.jpg") and are
+/// stored once per batch.
+///
+/// Views handed out stay valid as long as the batch, including across
+/// moves. A moved-from batch may only be destroyed or assigned to.
+class MessageBatch {
+public:
+    using iterator = MessageView*;
+    using const_iterator = const MessageView*;
+
+    MessageBatch();
+    ~MessageBatch();
+
+    MessageBatch(MessageBatch&& other) noexcept;
+    MessageBatch& operator=(MessageBatch&& other) noexcept;
+
+    MessageBatch(const MessageBatch&) = delete;
+    MessageBatch& operator=(const MessageBatch&) = delete;
+
+    /// Append a copy of @p message, its strings copied into the arena
+    MessageView& push_back(const MessageView& message);
+
+    /// Append @p message as is: its strings must already live in this batch (see allocate())
+    MessageView& adopt(const MessageView& message);
+
+    /// Uninitialised arena bytes that live as long as the batch
+    [[nodiscard]] char* allocate(std::size_t size);
+
+    void reserve(std::size_t count);
+
+    /// Remove the messages in [first, last)
+    iterator erase(const_iterator first, const_iterator last);
+
+    [[nodiscard]] std::size_t size() const { return state_->messages.size(); }
+    [[nodiscard]] bool empty() const { return state_->messages.empty(); }
+
+    [[nodiscard]] MessageView& operator[](std::size_t index) { return state_->messages[index]; }
+    [[nodiscard]] const MessageView& operator[](std::size_t index) const { return state_->messages[index]; }
+
+    [[nodiscard]] const MessageView& front() const { return state_->messages.front(); }
+    [[nodiscard]] const MessageView& back() const { return state_->messages.back(); }
+
+    [[nodiscard]] iterator begin() { return state_->messages.data(); }
+    [[nodiscard]] iterator end() { return begin() + size(); }
+    [[nodiscard]] const_iterator begin() const { return state_->messages.data(); }
+    [[nodiscard]] const_iterator end() const { return begin() + size(); }
+    [[nodiscard]] MessageView* data() { return begin(); }
+    [[nodiscard]] const MessageView* data() const { return begin(); }
+
+    /// Owning copies of the messages, in batch order
+    [[nodiscard]] std::vector<Message> to_messages() const;
+
+private:
+    /// Arena and everything allocated from it, kept together so a move only moves the pointer
+    struct State {
+        static constexpr std::size_t kFirstBlock = 16 * 1024;  // A page of short messages
+
+        std::pmr::monotonic_buffer_resource arena{kFirstBlock};
+        std::pmr::vector<MessageView> messages{&arena};
+        std::pmr::unordered_set<std::string_view> interned{&arena};  // Mime types and filenames
+    };
+
+    /// Copy of @p value in the arena
+    std::string_view store(std::string_view value);
+
+    /// Shared copy of @p value in the arena (one per distinct value)
+    std::string_view intern(std::string_view value);
+
+    std::unique_ptr<State> state_;
+};
+
+}  // namespace tg
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "tg/types.hpp"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tg {
+
+class MessageBatch;
+
+/// Compact encoding of a run of one chat's messages (a cache page)
+///
+/// Messages are written as varint/zigzag deltas (ids and timestamps are
+/// close together in a page) followed by their strings, and the result is
+/// deflated with an optional preset dictionary. Short pages compress
+/// poorly on their own; a dictionary trained on earlier messages (see
+/// train_message_dictionary) supplies the phrases and media metadata they
+/// have in common.
+
+/// Encode and compress @p messages (all from one chat; the chat id is not stored)
+/// @throws DatabaseException if compression fails
+[[nodiscard]] std::string encode_message_page(const std::vector<Message>& messages, std::string_view dictionary = {});
+
+/// Decompress a page and append its messages, tagged with @p chat_id, to @p out
+/// @param dictionary The dictionary the page was encoded with
+/// @throws DatabaseException if the page is corrupt or needs a different dictionary
+void decode_message_page(
+    std::string_view page,
+    int64_t chat_id,
+    std::vector<Message>& out,
+    std::string_view dictionary = {}
+);
+
+/// Decompress a page into @p out's arena and append its messages, without a copy of their strings
+/// @throws DatabaseException if the page is corrupt or needs a different dictionary
+void decode_message_page(std::string_view page, int64_t chat_id, MessageBatch& out, std::string_view dictionary = {});
+
+/// Build a preset dictionary of at most @p max_size bytes from sample messages
+/// Picks the substrings (words and media metadata) that save the most bytes
+/// across the samples, most valuable last as deflate prefers.
+[[nodiscard]] std::string train_message_dictionary(const std::vector<Message>& samples, std::size_t max_size);
+
+}  // namespace tg
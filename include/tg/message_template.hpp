@@ -0,0 +1,62 @@
+#pragma once
+
+#include "tg/types.hpp"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tg {
+
+/// Message template pre-compiled to a sequence of typed emitters
+///
+/// Covers the mustache subset used for message files: literal text plus the
+/// {{sender}}, {{time}} and {{message}} variables (also as {{{name}}} or
+/// {{&name}}). Unknown variables render as nothing, as they do in bustache.
+/// Rendering appends straight to the caller's buffer through the fmt
+/// formatters, with no per-message temporaries.
+///
+/// Templates using anything else (sections, partials, comments, delimiter
+/// changes) don't compile; callers fall back to bustache for those.
+class MessageTemplate {
+public:
+    /// Compile @p source
+    /// @return The compiled template, or nullopt if it needs a full mustache engine
+    [[nodiscard]] static std::optional<MessageTemplate> compile(std::string_view source);
+
+    /// Append @p info rendered with this template to @p out
+    void render_to(std::string& out, const MessageInfo& info) const;
+
+    /// Same, with the sender's display name already rendered (see sender_name())
+    /// Lets a formatting pass render each distinct sender once rather than per message.
+    void render_to(std::string& out, const MessageInfo& info, std::string_view sender_name) const;
+
+    /// Display name {{sender}} renders for incoming messages from @p user
+    [[nodiscard]] static std::string sender_name(const User& user);
+
+    /// Rough rendered size of @p message, for reserving output buffers
+    [[nodiscard]] std::size_t estimate_size(const MessageView& message) const;
+
+private:
+    enum class Emitter { LITERAL, SENDER, TIME, MESSAGE };
+
+    struct Segment {
+        Emitter emitter;
+        std::size_t offset{0};  // Literal text range in literals_
+        std::size_t size{0};
+    };
+
+    MessageTemplate() = default;
+
+    void add_literal(std::string_view text);
+    void render(std::string& out, const MessageInfo& info, const std::string_view* sender_name) const;
+
+    std::string literals_;
+    std::vector<Segment> segments_;
+    std::size_t fixed_size_{0};  // Estimated bytes per message excluding the message text
+    bool has_message_{false};    // Whether the message text is rendered at all
+};
+
+}  // namespace tg
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace tg {
+
+/// Identity of one metric: its name and an optional label
+struct MetricKey {
+    std::string name;   // e.g. "fuse_op_seconds"
+    std::string label;  // Label name (empty for none), e.g. "op"
+    std::string value;  // Label value, e.g. "getattr"
+
+    auto operator<=>(const MetricKey&) const = default;
+};
+
+/// Buckets of a LatencyHistogram: bucket i counts samples under 2^i microseconds,
+/// except the last one, which takes everything from 2^25 us (~34 s) up
+inline constexpr std::size_t kLatencyBuckets = 27;
+
+namespace detail {
+
+/// Counters are striped over this many cache lines, so threads rarely share one
+inline constexpr std::size_t kMetricShards = 16;
+
+/// Stripe of the calling thread (threads are spread over the stripes round robin)
+[[nodiscard]] std::size_t metric_shard();
+
+}  // namespace detail
+
+/// Merged state of a LatencyHistogram
+struct HistogramSnapshot {
+    std::array<uint64_t, kLatencyBuckets> buckets{};  // Samples per bucket (not cumulative)
+    uint64_t count{0};
+    uint64_t sum_us{0};  // Total recorded latency, microseconds
+
+    /// Upper bound of bucket @p i in microseconds
+    [[nodiscard]] static uint64_t bucket_bound_us(std::size_t i) { return uint64_t{1} << i; }
+
+    /// Latency under which a fraction @p q of the samples fell (a bucket bound, 0 when empty)
+    [[nodiscard]] uint64_t quantile_us(double q) const;
+};
+
+/// Latency histogram with power-of-two buckets
+///
+/// record() is two relaxed atomic increments on the calling thread's stripe:
+/// no lock, and no cache line shared with threads on other stripes. Stripes
+/// are only summed when a snapshot is taken.
+class LatencyHistogram {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void record(Clock::duration elapsed);
+
+    [[nodiscard]] HistogramSnapshot snapshot() const;
+
+private:
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, kLatencyBuckets> buckets{};
+        std::atomic<uint64_t> sum_us{0};
+    };
+    std::array<Shard, detail::kMetricShards> shards_;
+};
+
+/// Monotonic counter, striped like LatencyHistogram
+class Counter {
+public:
+    void add(uint64_t n = 1) { shards_[detail::metric_shard()].value.fetch_add(n, std::memory_order_relaxed); }
+
+    [[nodiscard]] uint64_t value() const;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+    std::array<Shard, detail::kMetricShards> shards_;
+};
+
+/// Records the time from construction to destruction (nothing for a null histogram)
+class LatencyTimer {
+public:
+    explicit LatencyTimer(LatencyHistogram* histogram)
+        : histogram_(histogram), start_(LatencyHistogram::Clock::now()) {}
+
+    ~LatencyTimer() {
+        if (histogram_) {
+            histogram_->record(LatencyHistogram::Clock::now() - start_);
+        }
+    }
+
+    LatencyTimer(const LatencyTimer&) = delete;
+    LatencyTimer& operator=(const LatencyTimer&) = delete;
+
+private:
+    LatencyHistogram* histogram_;
+    LatencyHistogram::Clock::time_point start_;
+};
+
+/// Point-in-time copy of every metric, plus gauges added by the exporter
+struct MetricsSnapshot {
+    struct Histogram {
+        MetricKey key;
+        HistogramSnapshot data;
+    };
+    struct Value {
+        MetricKey key;
+        double value;
+    };
+
+    std::vector<Histogram> histograms;
+    std::vector<Value> counters;
+    std::vector<Value> gauges;  // Current state of other components (cache sizes, queue depths)
+
+    void add_gauge(MetricKey key, double value) { gauges.push_back({std::move(key), value}); }
+
+    /// Add a counter kept elsewhere (e.g. a component's own hit count)
+    void add_counter(MetricKey key, double value) { counters.push_back({std::move(key), value}); }
+
+    /// JSON object with count, sum and p50/p90/p99 per histogram
+    [[nodiscard]] std::string to_json() const;
+
+    /// Prometheus text exposition format (names prefixed with "tgfuse_")
+    [[nodiscard]] std::string to_prometheus() const;
+};
+
+/// Registry of named histograms and counters
+///
+/// Lookups take a mutex, so instrumented code looks its metrics up once
+/// and keeps the reference; recording never touches the registry.
+class Metrics {
+public:
+    /// Process-wide registry the instrumented layers record into
+    static Metrics& global();
+
+    /// Histogram for @p key, created on first use (valid as long as the registry)
+    [[nodiscard]] LatencyHistogram& histogram(const MetricKey& key);
+
+    /// Counter for @p key, created on first use (valid as long as the registry)
+    [[nodiscard]] Counter& counter(const MetricKey& key);
+
+    /// Merge every metric's stripes
+    [[nodiscard]] MetricsSnapshot snapshot() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::map<MetricKey, std::unique_ptr<LatencyHistogram>> histograms_;
+    std::map<MetricKey, std::unique_ptr<Counter>> counters_;
+};
+
+}  // namespace tg
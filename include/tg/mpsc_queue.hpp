@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+namespace tg {
+
+/// Unbounded lock-free multi-producer single-consumer queue
+///
+/// A linked list with a dummy node: producers swap themselves in as the
+/// newest node with one atomic exchange and never wait for each other or
+/// for the consumer. Only one thread may pop. Items pushed by one thread
+/// are popped in the order that thread pushed them.
+///
+/// The consumer can sleep while the queue is empty: read epoch(), drain
+/// with try_pop(), then wait() on the epoch read before draining. A push
+/// (or notify()) after that read makes wait() return.
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : head_(new Node), tail_(head_.load(std::memory_order_relaxed)) {}
+
+    ~MpscQueue() {
+        while (try_pop()) {
+        }
+        delete tail_;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /// Append @p value (any thread)
+    void push(T value) {
+        auto* node = new Node;
+        node->value.emplace(std::move(value));
+        Node* previous = head_.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+        notify();
+    }
+
+    /// Take the oldest item (consumer thread only)
+    /// May miss an item whose push() has not returned yet; its notification then wakes wait().
+    [[nodiscard]] std::optional<T> try_pop() {
+        Node* next = tail_->next.load(std::memory_order_acquire);
+        if (!next) {
+            return std::nullopt;
+        }
+        std::optional<T> value = std::move(next->value);
+        next->value.reset();  // next becomes the dummy node
+        delete tail_;
+        tail_ = next;
+        return value;
+    }
+
+    /// Counter bumped by every push() and notify()
+    [[nodiscard]] uint32_t epoch() const { return epoch_.load(std::memory_order_acquire); }
+
+    /// Block until the epoch differs from @p epoch (consumer thread only)
+    void wait(uint32_t epoch) const { epoch_.wait(epoch, std::memory_order_acquire); }
+
+    /// Wake the consumer without pushing (e.g. to shut it down)
+    void notify() {
+        epoch_.fetch_add(1, std::memory_order_release);
+        epoch_.notify_one();
+    }
+
+private:
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        std::optional<T> value;
+    };
+
+    std::atomic<Node*> head_;  // Newest node (producers)
+    Node* tail_;               // Dummy node before the oldest item (consumer)
+    std::atomic<uint32_t> epoch_{0};
+};
+
+}  // namespace tg
@@ -1,25 +1,58 @@
 #pragma once
 
+#include <array>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <mutex>
+#include <optional>
+#include <string_view>
 
 namespace tg {
 
+/// Priority lanes for Telegram API requests, most urgent first
+enum class RequestPriority {
+    INTERACTIVE = 0,  // A filesystem operation is waiting on it
+    UPLOAD = 1,       // Sending released uploads
+    BACKGROUND = 2    // Prefetching and other speculative work
+};
+
+inline constexpr std::size_t kRequestPriorities = 3;
+
 /// Configuration for RateLimiter
 struct RateLimiterConfig {
-    std::size_t max_requests_per_second = 2;       // Conservative default for background tasks
-    std::chrono::milliseconds min_interval{500};   // Minimum time between requests
-    std::chrono::milliseconds burst_window{1000};  // Window for burst detection
+    double requests_per_second{20.0};           // Sustained request rate (token refill)
+    std::size_t burst{40};                      // Bucket size: requests allowed back to back
+    std::size_t upload_reserve{4};              // Tokens uploads leave for interactive requests
+    std::size_t background_reserve{16};         // Tokens background requests leave for the other lanes
+    double min_rate_fraction{0.1};              // FLOOD_WAIT never cuts the rate below this share
+    std::chrono::seconds recovery_period{300};  // Time to climb back to the full rate after a back-off
+};
+
+/// Counters from RateLimiter::stats()
+struct RateLimiterStats {
+    std::array<std::uint64_t, kRequestPriorities> granted{};             // Requests let through, per priority
+    std::array<std::uint64_t, kRequestPriorities> delayed{};             // Times a request had to wait, per priority
+    std::array<std::chrono::microseconds, kRequestPriorities> waited{};  // Total time requests were held back
+    std::uint64_t flood_waits{0};                                        // FLOOD_WAIT responses reported
+    double current_rate{0.0};                                            // Requests per second allowed now
+    double tokens{0.0};                                                  // Tokens left in the bucket
+    std::chrono::milliseconds paused_for{0};                             // Remaining FLOOD_WAIT pause
 };
 
-/// Simple rate limiter to avoid Telegram API flood bans
+/// Token bucket rate limiter shared by every Telegram API request
 ///
-/// Uses a token bucket algorithm with configurable rate.
-/// Thread-safe and blocking when rate limit is exceeded.
+/// Tokens refill at the configured rate up to the burst size. Lower priority
+/// lanes only take a token while the bucket holds more than their reserve,
+/// so interactive requests keep getting through while prefetching stalls.
+/// A reported FLOOD_WAIT stops all lanes for the retry period and halves the
+/// rate, which then recovers linearly over recovery_period.
+/// Thread-safe.
 class RateLimiter {
 public:
     using Config = RateLimiterConfig;
+    using Priority = RequestPriority;
+    using Clock = std::chrono::steady_clock;
 
     explicit RateLimiter(Config config = {});
     ~RateLimiter() = default;
@@ -28,24 +61,72 @@ public:
     RateLimiter(const RateLimiter&) = delete;
     RateLimiter& operator=(const RateLimiter&) = delete;
 
-    /// Wait until we can make a request (blocks if rate limit exceeded)
-    void acquire();
+    /// Wait until a request at @p priority may be made (blocks the calling thread)
+    void acquire(Priority priority = Priority::BACKGROUND);
 
     /// Try to acquire without blocking
     /// @return true if acquired, false if would exceed rate limit
-    bool try_acquire();
+    bool try_acquire(Priority priority = Priority::BACKGROUND);
+
+    /// Take a token for @p priority if one is available
+    /// For callers that wait without blocking (e.g. rescheduling on an executor).
+    /// @return Zero if taken, otherwise how long to wait before trying again
+    [[nodiscard]] Clock::duration reserve(Priority priority);
+
+    /// A request was refused with FLOOD_WAIT: pause for @p retry_after and back off
+    void report_flood_wait(std::chrono::seconds retry_after);
+
+    /// Time left of a reported FLOOD_WAIT, during which no lane gets a token (zero if none)
+    [[nodiscard]] Clock::duration paused_for() const;
+
+    /// Current counters
+    [[nodiscard]] RateLimiterStats stats() const;
 
     /// Get current configuration
-    [[nodiscard]] const Config& get_config() const { return config_; }
+    [[nodiscard]] Config get_config() const;
 
     /// Update configuration (thread-safe)
     void set_config(Config config);
 
 private:
+    /// reserve() with mutex_ held
+    [[nodiscard]] Clock::duration reserve_locked(Priority priority);
+
+    /// Add the tokens accrued since the last refill (none during a pause)
+    void refill(Clock::time_point now);
+
+    /// Tokens @p priority must leave in the bucket
+    [[nodiscard]] double reserve_for(Priority priority) const;
+
     Config config_;
-    std::chrono::steady_clock::time_point last_request_;
-    std::mutex mutex_;
+    double rate_;    // Current refill rate, below the configured one after a back-off
+    double tokens_;  // Available tokens (fractional while refilling)
+    Clock::time_point last_refill_;
+    Clock::time_point paused_until_;
+    RateLimiterStats stats_;
+    mutable std::mutex mutex_;
     std::condition_variable cv_;
 };
 
+/// Retry delay of a Telegram rate limit error
+/// Accepts both "FLOOD_WAIT_12" and TDLib's "Too Many Requests: retry after 12".
+/// @return The delay, or nullopt if @p message isn't a rate limit error
+[[nodiscard]] std::optional<std::chrono::seconds> parse_retry_after(std::string_view message);
+
+/// Priority of Telegram requests made on the calling thread
+[[nodiscard]] RequestPriority current_request_priority();
+
+/// Sets the calling thread's request priority for its lifetime
+class RequestPriorityScope {
+public:
+    explicit RequestPriorityScope(RequestPriority priority);
+    ~RequestPriorityScope();
+
+    RequestPriorityScope(const RequestPriorityScope&) = delete;
+    RequestPriorityScope& operator=(const RequestPriorityScope&) = delete;
+
+private:
+    RequestPriority previous_;
+};
+
 }  // namespace tg
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace tg {
+
+/// Incremental SHA-256 digest (OpenSSL EVP)
+///
+/// Used as the upload dedup key: fed chunk by chunk as an upload is written,
+/// so the file never has to be read back or held in memory to be hashed.
+class Sha256 {
+public:
+    Sha256();
+    ~Sha256();
+
+    Sha256(Sha256&&) noexcept;
+    Sha256& operator=(Sha256&&) noexcept;
+
+    /// Add @p size bytes at @p data to the digest
+    void update(const void* data, std::size_t size);
+    void update(std::string_view data) { update(data.data(), data.size()); }
+
+    /// Finish the digest and reset for reuse
+    /// @return Lowercase hex digest (64 characters)
+    [[nodiscard]] std::string finish();
+
+    /// Number of bytes hashed since construction (or the last finish())
+    [[nodiscard]] std::size_t size() const { return size_; }
+
+    /// Digest of the file at @p path, read in fixed-size chunks
+    /// @return Hex digest, or nullopt if the file can't be read
+    [[nodiscard]] static std::optional<std::string> hash_file(const std::string& path);
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+    std::size_t size_{0};
+};
+
+}  // namespace tg
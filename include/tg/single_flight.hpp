@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace tg {
+
+/// Coalesces concurrent fetches of the same key into one
+///
+/// The first caller for a key runs the fetch; callers that arrive while it
+/// is in flight wait for it and get a copy of its result (or its
+/// exception) instead of sending the same request again. Nothing is kept
+/// once the fetch completes: the next call after that fetches afresh, so
+/// caching the result is left to the caller.
+///
+/// Each call has a rank, lower being more urgent (e.g. a RequestPriority).
+/// A call only waits for a fetch of the same or a more urgent rank: one
+/// that found a less urgent fetch in flight runs its own, and the calls
+/// after it join that one. A prefetch can share a read's fetch, but a
+/// read is never paced at the prefetch's rate.
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class SingleFlight {
+public:
+    SingleFlight() = default;
+
+    SingleFlight(const SingleFlight&) = delete;
+    SingleFlight& operator=(const SingleFlight&) = delete;
+
+    /// Result of @p fetch() for @p key, shared with every concurrent call for the same key
+    /// @param rank Urgency of the call (lower is more urgent)
+    /// @throws Whatever the fetch that served the call threw
+    template <typename Fetch>
+    Value run(const Key& key, Fetch&& fetch, int rank = 0) {
+        std::promise<Value> promise;
+        uint64_t id = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto it = flights_.find(key);
+            if (it != flights_.end() && it->second.rank <= rank) {
+                auto result = it->second.result;
+                lock.unlock();
+                shared_.fetch_add(1, std::memory_order_relaxed);
+                return result.get();
+            }
+            // Overtakes a less urgent flight, which runs on for the calls already waiting for it
+            id = ++next_id_;
+            flights_.insert_or_assign(key, Flight{promise.get_future().share(), rank, id});
+        }
+
+        // Removed before it's completed, so a call that comes after the result starts a new fetch
+        auto finish = [&] {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (auto it = flights_.find(key); it != flights_.end() && it->second.id == id) {
+                flights_.erase(it);
+            }
+        };
+        try {
+            Value value = std::forward<Fetch>(fetch)();
+            finish();
+            promise.set_value(value);
+            return value;
+        } catch (...) {
+            finish();
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+    /// Keys being fetched right now
+    [[nodiscard]] std::size_t in_flight() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return flights_.size();
+    }
+
+    /// Calls served by another call's fetch so far
+    [[nodiscard]] uint64_t shared_count() const { return shared_.load(std::memory_order_relaxed); }
+
+private:
+    struct Flight {
+        std::shared_future<Value> result;
+        int rank;
+        uint64_t id;  // Tells the flight apart from one that overtook it
+    };
+
+    mutable std::mutex mutex_;
+    std::map<Key, Flight, Compare> flights_;  // The most urgent flight of each key
+    uint64_t next_id_{0};
+    std::atomic<uint64_t> shared_{0};
+};
+
+}  // namespace tg
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tg {
+
+/// Vectorised text classification and splitting
+///
+/// Decides whether written data is text (the txt files and uploads sent as
+/// messages) and where to cut it into messages. scan() validates UTF-8 and
+/// counts control characters in one pass, with the kernel for the CPU it
+/// runs on picked once at startup: AVX2 or SSE4.2 on x86, NEON on AArch64,
+/// a word-at-a-time scalar loop elsewhere. UTF-8 validation is the lookup
+/// table algorithm of Keiser and Lemire, so mostly non-ASCII text runs at
+/// the same speed as ASCII.
+
+/// Instruction set a text kernel is written for
+enum class TextKernel {
+    SCALAR,
+    SSE42,
+    AVX2,
+    NEON,
+};
+
+/// What a scan of a buffer found
+struct TextScan {
+    std::size_t size{0};             // Bytes scanned
+    std::size_t control_chars{0};    // Bytes below 0x20 other than tab, LF and CR, NULs included
+    std::size_t nul_chars{0};        // NUL bytes (definitely binary)
+    std::size_t incomplete_tail{0};  // Bytes of a multi-byte sequence the data ends in the middle of
+    bool valid_utf8{true};           // Everything before the incomplete tail is well-formed UTF-8
+
+    /// Whether the data reads as text: valid UTF-8 without NULs, and at most
+    /// one control character in 20 (one in total below 20 bytes)
+    /// An incomplete tail counts against it: the data isn't valid as a whole.
+    [[nodiscard]] bool is_text() const;
+};
+
+/// Scan @p data with the fastest kernel the CPU supports
+[[nodiscard]] TextScan scan_text(std::string_view data);
+
+/// Scan @p data with @p kernel (for tests and benchmarks)
+/// @pre text_kernel_supported(kernel)
+[[nodiscard]] TextScan scan_text(std::string_view data, TextKernel kernel);
+
+/// Kernel scan_text() and the searches below dispatch to
+[[nodiscard]] TextKernel active_text_kernel();
+
+/// Whether @p kernel is compiled in and the CPU can run it
+[[nodiscard]] bool text_kernel_supported(TextKernel kernel);
+
+[[nodiscard]] std::string_view to_string(TextKernel kernel);
+
+/// Scan of data fed in pieces, e.g. an upload as its writes arrive
+///
+/// Multi-byte sequences may straddle update() calls. Once the data is known
+/// not to be text (a NUL or malformed UTF-8) later updates are only counted.
+class TextScanner {
+public:
+    void update(const char* data, std::size_t size);
+    void update(std::string_view data) { update(data.data(), data.size()); }
+
+    /// Totals so far; a sequence cut off by the last update is the incomplete tail
+    [[nodiscard]] TextScan result() const;
+
+    /// Whether everything fed so far reads as text
+    [[nodiscard]] bool is_text() const { return result().is_text(); }
+
+    /// Whether more data could still make it read as text
+    [[nodiscard]] bool may_be_text() const { return totals_.valid_utf8 && totals_.nul_chars == 0; }
+
+    /// Bytes fed since construction
+    [[nodiscard]] std::size_t size() const { return totals_.size + carry_size_; }
+
+    /// Scan of the file at @p path, read in fixed-size chunks and stopped
+    /// early once it can't be text
+    /// @return nullopt if the file can't be read
+    [[nodiscard]] static std::optional<TextScan> scan_file(const std::string& path);
+
+private:
+    TextScan totals_;
+    char carry_[4]{};  // Start of a sequence the last update cut off
+    std::size_t carry_size_{0};
+};
+
+/// Largest position at or before @p max_pos that doesn't split a UTF-8 sequence
+/// @return data.size() if @p max_pos is past the end
+[[nodiscard]] std::size_t utf8_boundary(std::string_view data, std::size_t max_pos);
+
+/// Position of the last LF in @p data, or npos
+[[nodiscard]] std::size_t find_last_newline(std::string_view data);
+
+/// Position of the last space, tab or LF in @p data, or npos
+[[nodiscard]] std::size_t find_last_whitespace(std::string_view data);
+
+/// Split @p text into chunks of at most @p max_size bytes
+/// Chunks end before the last whitespace that fits (which is dropped), or at
+/// a UTF-8 boundary if there is none. The chunks point into @p text.
+[[nodiscard]] std::vector<std::string_view> split_text(std::string_view text, std::size_t max_size);
+
+}  // namespace tg
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace tg {
+
+/// Hashed timer wheel for many coarse deadlines
+///
+/// Deadlines are rounded up to the wheel's resolution and hashed into a
+/// ring of slots. Advancing only visits the slots that came due, so the
+/// cost follows the number of expiries rather than of scheduled keys.
+/// Each key has at most one deadline: scheduling it again replaces it.
+/// Not thread-safe.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit TimerWheel(Clock::duration resolution, std::size_t slots = 256, Clock::time_point start = Clock::now());
+
+    /// Expire @p key at (or shortly after) @p deadline
+    void schedule(int64_t key, Clock::time_point deadline);
+
+    /// Drop @p key's deadline, if any
+    void cancel(int64_t key);
+
+    /// Check if @p key has a deadline
+    [[nodiscard]] bool contains(int64_t key) const { return deadlines_.count(key) != 0; }
+
+    /// Number of keys with a deadline
+    [[nodiscard]] std::size_t size() const { return deadlines_.size(); }
+
+    [[nodiscard]] bool empty() const { return deadlines_.empty(); }
+
+    /// When the next slot comes due (advance() before then finds nothing)
+    [[nodiscard]] Clock::time_point next_tick() const;
+
+    /// Move the wheel to @p now
+    /// @return Keys whose deadline has passed (they are no longer scheduled)
+    std::vector<int64_t> advance(Clock::time_point now);
+
+private:
+    struct Timer {
+        int64_t key;
+        uint64_t tick;  // Absolute tick the timer fires on
+    };
+
+    Clock::duration resolution_;
+    Clock::time_point start_;
+    uint64_t next_tick_{0};  // First tick not processed yet
+    std::vector<std::vector<Timer>> slots_;
+
+    // Live deadline of each key; slot entries that don't match are stale and dropped when visited
+    std::unordered_map<int64_t, uint64_t> deadlines_;
+};
+
+}  // namespace tg
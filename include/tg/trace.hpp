@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tg {
+
+/// One finished span
+struct TraceEvent {
+    const char* category{nullptr};  // Static (or interned) strings only
+    const char* name{nullptr};
+    int64_t start_ns{0};     // Steady clock
+    int64_t duration_ns{0};  // Steady clock
+    uint64_t request{0};     // Request the span belongs to (0 for none)
+    uint32_t thread{0};      // Small per-process thread number
+};
+
+/// Opt-in span recorder with a lock-free ring buffer
+///
+/// Disabled, a span costs one relaxed atomic load. Enabled, recording a
+/// span claims a ring slot with one atomic increment and fills it under a
+/// per-slot sequence number, so writers never wait for each other or for a
+/// dump: a dump skips slots that are being overwritten. The ring keeps the
+/// latest events; older ones are overwritten.
+///
+/// Spans are correlated by a request id kept per thread (see
+/// TraceRequestScope) and carried across co_await by the client.
+class Tracer {
+public:
+    /// Process-wide tracer the instrumented layers record into
+    static Tracer& global();
+
+    Tracer() = default;
+    ~Tracer() = default;
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    /// Start recording into a ring of @p capacity events
+    /// The ring is allocated by the first call; later calls only re-enable it.
+    void enable(std::size_t capacity);
+
+    /// Stop recording (the recorded events stay available)
+    void disable() { enabled_.store(false, std::memory_order_relaxed); }
+
+    [[nodiscard]] bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    /// Record a span that started at @p start_ns and ends now
+    void record(const char* category, const char* name, int64_t start_ns, uint64_t request);
+
+    /// Record a finished event
+    void record(const TraceEvent& event);
+
+    /// Recorded events, oldest first
+    [[nodiscard]] std::vector<TraceEvent> events() const;
+
+    /// Events in the Chrome trace event format (loads in chrome://tracing and Perfetto)
+    [[nodiscard]] std::string chrome_trace_json() const;
+
+    /// Stable copy of a dynamic span name (e.g. a query type); cheap after the first call per name
+    [[nodiscard]] const char* intern(std::string_view name);
+
+    /// A new request id (never 0)
+    [[nodiscard]] uint64_t next_request_id() { return next_request_.fetch_add(1, std::memory_order_relaxed); }
+
+    /// Steady clock now, in nanoseconds
+    [[nodiscard]] static int64_t now_ns();
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};  // Odd while being written, 2 * (index + 1) once written
+        std::atomic<const char*> category{nullptr};
+        std::atomic<const char*> name{nullptr};
+        std::atomic<int64_t> start_ns{0};
+        std::atomic<int64_t> duration_ns{0};
+        std::atomic<uint64_t> request{0};
+        std::atomic<uint32_t> thread{0};
+    };
+
+    std::atomic<bool> enabled_{false};
+    std::unique_ptr<Slot[]> slots_;
+    std::size_t capacity_{0};
+    std::atomic<uint64_t> head_{0};  // Events recorded so far
+    std::atomic<uint64_t> next_request_{1};
+
+    std::mutex intern_mutex_;
+    std::set<std::string, std::less<>> interned_;
+};
+
+/// Request id of the calling thread (0 outside a traced request)
+[[nodiscard]] uint64_t current_trace_request();
+
+/// Sets the calling thread's trace request id for its lifetime (restoring the previous one)
+class TraceRequestScope {
+public:
+    /// Start a new request (only while tracing is enabled)
+    TraceRequestScope();
+
+    /// Continue @p request (e.g. on the thread a coroutine resumes on)
+    explicit TraceRequestScope(uint64_t request);
+
+    ~TraceRequestScope();
+
+    TraceRequestScope(const TraceRequestScope&) = delete;
+    TraceRequestScope& operator=(const TraceRequestScope&) = delete;
+
+private:
+    uint64_t previous_;
+};
+
+/// Records the time from construction to destruction as a span of the current request
+class TraceSpan {
+public:
+    /// @param category, name Static strings (or Tracer::intern() results)
+    TraceSpan(const char* category, const char* name)
+        : category_(category), name_(name), start_ns_(Tracer::global().enabled() ? Tracer::now_ns() : 0) {}
+
+    ~TraceSpan() {
+        if (start_ns_ != 0) {
+            Tracer::global().record(category_, name_, start_ns_, current_trace_request());
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* category_;
+    const char* name_;
+    int64_t start_ns_;  // 0 when tracing was off at the start
+};
+
+}  // namespace tg
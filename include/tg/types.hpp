@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace tg {
@@ -130,8 +131,49 @@ struct Message {
     std::string format_for_display() const;
 };
 
+/// Non-owning view of an attachment (of a MediaInfo, or stored in a MessageBatch)
+struct MediaView {
+    MediaType type{MediaType::DOCUMENT};
+    std::string_view file_id;
+    std::string_view filename;
+    std::string_view mime_type;
+    int64_t file_size{0};
+    std::optional<std::string_view> local_path;
+    std::optional<int32_t> width;
+    std::optional<int32_t> height;
+    std::optional<int32_t> duration;
+
+    MediaView() = default;
+    MediaView(const MediaInfo& media);  // NOLINT(google-explicit-constructor)
+
+    /// Owning copy
+    [[nodiscard]] MediaInfo to_media_info() const;
+};
+
+/// Non-owning view of a message (of a Message, or stored in a MessageBatch)
+///
+/// Formatting reads messages through views, so a Message and a batch
+/// entry render the same way. A view is only valid while what it views is.
+struct MessageView {
+    int64_t id{0};
+    int64_t chat_id{0};
+    int64_t sender_id{0};
+    int64_t timestamp{0};
+    std::string_view text;
+    std::optional<MediaView> media;
+    bool is_outgoing{false};
+
+    MessageView() = default;
+    MessageView(const Message& message);  // NOLINT(google-explicit-constructor)
+
+    bool has_media() const { return media.has_value(); }
+
+    /// Owning copy
+    [[nodiscard]] Message to_message() const;
+};
+
 struct MessageInfo {
-    const Message& message;
+    MessageView message;
     const User& sender;
     const Chat& chat;
 };
@@ -148,6 +190,19 @@ struct FileListItem {
     std::string get_size_string() const;
 };
 
+/// Local download state of a (possibly partially downloaded) file
+struct FileDownloadState {
+    std::string local_path;  // Current local path (may change once the download completes)
+    int64_t size{0};         // Total file size, 0 if unknown
+    int64_t available{0};    // Contiguous bytes available locally from the requested offset
+    bool completed{false};   // Whole file is downloaded
+};
+
+struct FileUploadState {
+    int64_t size{0};      // Total file size, 0 if unknown
+    int64_t uploaded{0};  // Bytes uploaded so far
+};
+
 struct ChatStatus {
     int64_t last_message_id;
     int64_t last_message_timestamp;
@@ -160,4 +215,7 @@ MediaType detect_media_type(const std::string& filename, const std::string& mime
 bool is_media_type(MediaType type);     // true for PHOTO, VIDEO, ANIMATION
 bool is_document_type(MediaType type);  // true for DOCUMENT, AUDIO, etc.
 
+// File list entry for a message's attachment (nullopt if it has none)
+std::optional<FileListItem> make_file_list_item(const Message& message);
+
 }  // namespace tg
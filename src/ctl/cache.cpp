@@ -1,10 +1,16 @@
 #include "cache.hpp"
 #include "config.hpp"
+#include "control.hpp"
 
+#include "fuse/constants.hpp"
 #include "tg/cache.hpp"
 #include "tg/types.hpp"
 
+#include <nlohmann/json.hpp>
+
 #include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 
 namespace tgfuse::ctl {
@@ -54,9 +60,70 @@ int64_t find_chat_id_from_cache(tg::CacheManager& cache, const std::string& enti
     return 0;
 }
 
+/// Metric name with its labels, as printed by print_live_metrics
+std::string metric_name(const nlohmann::json& metric) {
+    std::string name = metric.value("name", "");
+    auto labels = metric.value("labels", nlohmann::json::object());
+    for (const auto& label : labels.items()) {
+        name += " " + label.key() + "=" + label.value().get<std::string>();
+    }
+    return name;
+}
+
+/// Print the metrics of a /.stats report
+void print_metrics(const nlohmann::json& stats) {
+    for (const auto& histogram : stats.value("histograms", nlohmann::json::array())) {
+        std::cout << "  " << std::left << std::setw(48) << metric_name(histogram) << std::right << " count "
+                  << histogram.value("count", uint64_t{0}) << ", p50 " << histogram.value("p50_seconds", 0.0) * 1000
+                  << " ms, p99 " << histogram.value("p99_seconds", 0.0) * 1000 << " ms\n";
+    }
+    for (const auto* section : {"counters", "gauges"}) {
+        for (const auto& metric : stats.value(section, nlohmann::json::array())) {
+            std::cout << "  " << std::left << std::setw(48) << metric_name(metric) << std::right << " "
+                      << metric.value("value", 0.0) << "\n";
+        }
+    }
+}
+
+/// Print the metrics from a mounted filesystem's /.stats
+/// @return false if the file can't be read
+bool print_live_metrics(const std::filesystem::path& mount_point) {
+    std::ifstream file(mount_point / kStatsFile);
+    if (!file) {
+        return false;
+    }
+
+    auto stats = nlohmann::json::parse(file, nullptr, false);
+    if (stats.is_discarded()) {
+        return false;
+    }
+
+    std::cout << "Live metrics (" << mount_point.string() << "):\n";
+    print_metrics(stats);
+    return true;
+}
+
+/// Print the error of a daemon reply
+/// @return Exit code: 0 if the command succeeded
+int report_failure(const DaemonReply& reply) {
+    if (reply.ok) {
+        return 0;
+    }
+    std::cerr << "Error: " << reply.body << "\n";
+    return 1;
+}
+
 }  // namespace
 
 int exec_cache_clear_files(const std::string& entity_name) {
+    // A running daemon drops its in-memory listing too
+    if (auto reply = query_daemon("clear-files", {entity_name})) {
+        if (reply->ok) {
+            std::cout << "File cache cleared for '" << entity_name << "'\n";
+        }
+        return report_failure(*reply);
+    }
+
     auto config = load_config();
     if (!config) {
         std::cerr << "Error: Not configured. Run 'tg-fuse login' first.\n";
@@ -92,6 +159,13 @@ int exec_cache_clear_files(const std::string& entity_name) {
 }
 
 int exec_cache_clear_all_files() {
+    if (auto reply = query_daemon("clear-files")) {
+        if (reply->ok) {
+            std::cout << "Cleared file cache for " << reply->body << " chats.\n";
+        }
+        return report_failure(*reply);
+    }
+
     auto config = load_config();
     if (!config) {
         std::cerr << "Error: Not configured. Run 'tg-fuse login' first.\n";
@@ -132,6 +206,13 @@ int exec_cache_clear_all_files() {
 }
 
 int exec_cache_clear_all() {
+    if (auto reply = query_daemon("clear-all")) {
+        if (reply->ok) {
+            std::cout << "All caches cleared.\n";
+        }
+        return report_failure(*reply);
+    }
+
     auto config = load_config();
     if (!config) {
         std::cerr << "Error: Not configured. Run 'tg-fuse login' first.\n";
@@ -158,7 +239,33 @@ int exec_cache_clear_all() {
     }
 }
 
-int exec_cache_stats() {
+int exec_cache_invalidate(const std::string& entity_name) {
+    if (auto reply = query_daemon("invalidate", {entity_name})) {
+        if (reply->ok) {
+            std::cout << "Caches invalidated for '" << entity_name << "' (chat_id: " << reply->body << ")\n";
+        }
+        return report_failure(*reply);
+    }
+
+    // Without a daemon nothing is held in memory, so only the file listing goes
+    return exec_cache_clear_files(entity_name);
+}
+
+int exec_cache_stats(const std::string& mount_point) {
+    if (auto reply = query_daemon("stats")) {
+        if (report_failure(*reply) != 0) {
+            return 1;
+        }
+        auto stats = nlohmann::json::parse(reply->body, nullptr, false);
+        if (stats.is_discarded()) {
+            std::cerr << "Error: Malformed statistics from tg-fused\n";
+            return 1;
+        }
+        std::cout << "Live statistics (tg-fused):\n";
+        print_metrics(stats);
+        return 0;
+    }
+
     auto config = load_config();
     if (!config) {
         std::cerr << "Error: Not configured. Run 'tg-fuse login' first.\n";
@@ -193,10 +300,20 @@ int exec_cache_stats() {
         std::cout << "  Total cached messages: " << total_messages << "\n";
         std::cout << "  Total content size: " << (total_content_size / 1024) << " KB\n";
 
+        auto downloads = cache.get_download_stats();
+        std::cout << "  Tracked downloads: " << downloads.files << " (" << (downloads.bytes / 1024) << " KB, "
+                  << downloads.hits << " reads)\n";
+
         // Show database file size
         auto file_size = std::filesystem::file_size(db_path);
         std::cout << "  Database file size: " << (file_size / 1024) << " KB\n";
 
+        if (!mount_point.empty() && !print_live_metrics(mount_point)) {
+            std::cerr << "Error: No metrics at " << (std::filesystem::path(mount_point) / kStatsFile).string()
+                      << " (is the filesystem mounted there?)\n";
+            return 1;
+        }
+
         return 0;
 
     } catch (const std::exception& e) {
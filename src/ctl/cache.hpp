@@ -4,6 +4,8 @@
 
 namespace tgfuse::ctl {
 
+// Each command goes through a running tg-fused when there is one, and opens the cache database otherwise
+
 /// Clear file cache for a specific chat (user/group/channel)
 int exec_cache_clear_files(const std::string& entity_name);
 
@@ -13,7 +15,11 @@ int exec_cache_clear_all_files();
 /// Clear all caches (messages, files, etc.)
 int exec_cache_clear_all();
 
-/// Show cache statistics
-int exec_cache_stats();
+/// Drop a chat's cached messages and file listing in the running daemon (only the listing without one)
+int exec_cache_invalidate(const std::string& entity_name);
+
+/// Show cache statistics (the running daemon's, or the cache database's without one)
+/// @param mount_point If not empty, also show the live metrics of the filesystem mounted there
+int exec_cache_stats(const std::string& mount_point = {});
 
 }  // namespace tgfuse::ctl
@@ -1,5 +1,7 @@
 #include "config.hpp"
 
+#include "fuse/constants.hpp"
+
 #include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/spdlog.h>
 #include <nlohmann/json.hpp>
@@ -7,6 +9,7 @@
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <utility>
 
 namespace tgfuse::ctl {
 
@@ -36,11 +39,28 @@ std::filesystem::path get_xdg_data_home() {
     return ".local/share";
 }
 
+std::string& current_account() {
+    static std::string account;
+    return account;
+}
+
 }  // namespace
 
+void set_account(std::string account) { current_account() = std::move(account); }
+
+const std::string& get_account() { return current_account(); }
+
 std::filesystem::path get_config_dir() { return get_xdg_config_home() / "tg-fuse"; }
 
-std::filesystem::path get_data_dir() { return get_xdg_data_home() / "tg-fuse"; }
+std::filesystem::path get_data_dir() {
+    auto data_dir = get_xdg_data_home() / "tg-fuse";
+    if (!current_account().empty()) {
+        return data_dir / "accounts" / current_account();
+    }
+    return data_dir;
+}
+
+std::filesystem::path get_control_socket_path() { return get_xdg_data_home() / "tg-fuse" / kControlSocketFile; }
 
 std::filesystem::path get_config_path() { return get_config_dir() / "config.json"; }
 
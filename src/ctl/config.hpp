@@ -18,9 +18,18 @@ struct Config {
 /// Get XDG config directory (~/.config/tg-fuse)
 std::filesystem::path get_config_dir();
 
-/// Get XDG data directory (~/.local/share/tg-fuse)
+/// Act on a named account of a multi-account daemon (empty for the default account)
+void set_account(std::string account);
+
+/// Account set with set_account() (empty for the default account)
+const std::string& get_account();
+
+/// Get XDG data directory (~/.local/share/tg-fuse, or accounts/<name> in it for a named account)
 std::filesystem::path get_data_dir();
 
+/// Control socket of a running tg-fused (in ~/.local/share/tg-fuse for every account)
+std::filesystem::path get_control_socket_path();
+
 /// Get config file path (~/.config/tg-fuse/config.json)
 std::filesystem::path get_config_path();
 
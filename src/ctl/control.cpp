@@ -0,0 +1,152 @@
+#include "control.hpp"
+#include "config.hpp"
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+
+namespace tgfuse::ctl {
+
+namespace {
+
+constexpr int kReplyTimeoutSeconds = 30;  // Stats of a big cache take a moment
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+/// Closes a socket when it goes out of scope
+struct SocketScope {
+    int fd;
+    ~SocketScope() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+};
+
+bool send_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+        auto sent = ::send(fd, data.data(), data.size(), kSendFlags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix(static_cast<std::size_t>(sent));
+    }
+    return true;
+}
+
+int daemon_not_running() {
+    std::cerr << "Error: tg-fused is not running"
+              << (get_account().empty() ? std::string() : " for account '" + get_account() + "'") << ".\n";
+    return 1;
+}
+
+}  // namespace
+
+std::optional<DaemonReply> query_daemon(const std::string& command, const std::vector<std::string>& args) {
+    // One tab-separated line: account, command, arguments
+    std::string request = get_account() + "\t" + command;
+    for (const auto& arg : args) {
+        if (arg.find_first_of("\t\n") != std::string::npos) {
+            return DaemonReply{false, "Arguments can't contain tabs or newlines"};
+        }
+        request += "\t" + arg;
+    }
+    request += "\n";
+
+    auto socket_path = get_control_socket_path().string();
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        return std::nullopt;
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    SocketScope socket{::socket(AF_UNIX, SOCK_STREAM, 0)};
+    if (socket.fd < 0 || ::connect(socket.fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        return std::nullopt;  // No daemon (or one that died and left its socket)
+    }
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    ::setsockopt(socket.fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    timeval timeout{kReplyTimeoutSeconds, 0};
+    ::setsockopt(socket.fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (!send_all(socket.fd, request)) {
+        return DaemonReply{false, std::string("Failed to send to tg-fused: ") + std::strerror(errno)};
+    }
+    ::shutdown(socket.fd, SHUT_WR);
+
+    std::string reply;
+    char buffer[4096];
+    while (true) {
+        auto received = ::recv(socket.fd, buffer, sizeof(buffer), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0) {
+            return DaemonReply{false, std::string("No reply from tg-fused: ") + std::strerror(errno)};
+        }
+        if (received == 0) {
+            break;
+        }
+        reply.append(buffer, static_cast<std::size_t>(received));
+    }
+
+    // Status line, then the output until the daemon closes the connection
+    auto newline = reply.find('\n');
+    auto status = reply.substr(0, newline);
+    auto body = newline == std::string::npos ? std::string() : reply.substr(newline + 1);
+    if (status == "unserved") {
+        return std::nullopt;
+    }
+    if (status != "ok" && status != "error") {
+        return DaemonReply{false, "Unexpected reply from tg-fused"};
+    }
+    return DaemonReply{status == "ok", std::move(body)};
+}
+
+int exec_prefetch(const std::string& entity_name) {
+    auto reply = query_daemon("prefetch", {entity_name});
+    if (!reply) {
+        return daemon_not_running();
+    }
+    if (!reply->ok) {
+        std::cerr << "Error: " << reply->body << "\n";
+        return 1;
+    }
+    std::cout << "Prefetching '" << entity_name << "' (chat_id: " << reply->body << ")\n";
+    return 0;
+}
+
+int exec_log_level(const std::string& level) {
+    auto reply = level.empty() ? query_daemon("log-level") : query_daemon("log-level", {level});
+    if (!reply) {
+        return daemon_not_running();
+    }
+    if (!reply->ok) {
+        std::cerr << "Error: " << reply->body << "\n";
+        return 1;
+    }
+    if (level.empty()) {
+        std::cout << "Log level: " << reply->body;
+    } else {
+        std::cout << "Log level changed from " << reply->body.substr(0, reply->body.find('\n')) << " to " << level
+                  << "\n";
+    }
+    return 0;
+}
+
+}  // namespace tgfuse::ctl
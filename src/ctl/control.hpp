@@ -0,0 +1,25 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace tgfuse::ctl {
+
+/// Reply of a running tg-fused to a control command
+struct DaemonReply {
+    bool ok{false};
+    std::string body;  // Output, or the error message
+};
+
+/// Run @p command in the tg-fused serving the current account, over its control socket
+/// @return nullopt if no running daemon serves the account (fall back to the cache database then)
+std::optional<DaemonReply> query_daemon(const std::string& command, const std::vector<std::string>& args = {});
+
+/// Queue a chat's messages and files for prefetching in the running daemon
+int exec_prefetch(const std::string& entity_name);
+
+/// Show the running daemon's log level, or change it to @p level (trace, debug, info, warn, error, off)
+int exec_log_level(const std::string& level);
+
+}  // namespace tgfuse::ctl
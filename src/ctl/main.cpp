@@ -1,6 +1,8 @@
 #include "cache.hpp"
 #include "config.hpp"
+#include "control.hpp"
 #include "login.hpp"
+#include "trace.hpp"
 #include "users.hpp"
 
 #include <spdlog/spdlog.h>
@@ -97,6 +99,9 @@ int main(int argc, char* argv[]) {
     int verbosity = 0;
     app.add_flag("-v,--verbose", verbosity, "Increase verbosity (-v, -vv, -vvv)");
 
+    std::string account;
+    app.add_option("--account", account, "Account to act on, as named to tg-fused --account");
+
     // Mount subcommand
     auto* mount_cmd = app.add_subcommand("mount", "Mount the Telegram filesystem");
 
@@ -139,8 +144,36 @@ int main(int argc, char* argv[]) {
     // cache clear-all
     cache_cmd->add_subcommand("clear-all", "Clear all caches (messages, files, etc.)");
 
-    // cache stats
-    cache_cmd->add_subcommand("stats", "Show cache statistics");
+    // cache invalidate <entity>
+    auto* cache_invalidate_cmd =
+        cache_cmd->add_subcommand("invalidate", "Drop a chat's cached messages and files in the running daemon");
+    std::string invalidate_entity_name;
+    cache_invalidate_cmd->add_option("entity", invalidate_entity_name, "Username or display name of the chat")
+        ->required();
+
+    // cache stats [--mount <mount_point>]
+    auto* cache_stats_cmd = cache_cmd->add_subcommand("stats", "Show cache statistics");
+    std::string stats_mount_point;
+    cache_stats_cmd->add_option(
+        "-m,--mount", stats_mount_point, "Mount point of a running filesystem, to show its live metrics"
+    );
+
+    // trace <mount_point> [-o <file>]
+    auto* trace_cmd = app.add_subcommand("trace", "Save the trace recorded by a running filesystem");
+    std::string trace_mount_point;
+    std::string trace_output;
+    trace_cmd->add_option("mount_point", trace_mount_point, "Mount point of the filesystem")->required();
+    trace_cmd->add_option("-o,--output", trace_output, "File to write the Chrome trace to (default: stdout)");
+
+    // prefetch <entity>
+    auto* prefetch_cmd = app.add_subcommand("prefetch", "Have the running daemon fetch a chat ahead of reads");
+    std::string prefetch_entity_name;
+    prefetch_cmd->add_option("entity", prefetch_entity_name, "Username or display name of the chat")->required();
+
+    // log-level [level]
+    auto* log_level_cmd = app.add_subcommand("log-level", "Show or change the running daemon's log level");
+    std::string log_level;
+    log_level_cmd->add_option("level", log_level, "New level: trace, debug, info, warn, error or off");
 
     // Config subcommand with nested subcommands
     auto* config_cmd = app.add_subcommand("config", "Manage configuration");
@@ -154,6 +187,7 @@ int main(int argc, char* argv[]) {
     config_set_cmd->add_option("--api-hash", api_hash, "Telegram API hash")->required();
 
     CLI11_PARSE(app, argc, argv);
+    tgfuse::ctl::set_account(account);
 
     // Configure logging based on verbosity
     if (verbosity >= 2) {
@@ -181,6 +215,18 @@ int main(int argc, char* argv[]) {
         return tgfuse::ctl::exec_status();
     }
 
+    if (trace_cmd->parsed()) {
+        return tgfuse::ctl::exec_trace(trace_mount_point, trace_output);
+    }
+
+    if (prefetch_cmd->parsed()) {
+        return tgfuse::ctl::exec_prefetch(prefetch_entity_name);
+    }
+
+    if (log_level_cmd->parsed()) {
+        return tgfuse::ctl::exec_log_level(log_level);
+    }
+
     if (config_set_cmd->parsed()) {
         return tgfuse::ctl::exec_config_set(api_id, api_hash);
     }
@@ -200,6 +246,10 @@ int main(int argc, char* argv[]) {
         return tgfuse::ctl::exec_cache_clear_files(cache_entity_name);
     }
 
+    if (cache_invalidate_cmd->parsed()) {
+        return tgfuse::ctl::exec_cache_invalidate(invalidate_entity_name);
+    }
+
     if (cache_cmd->got_subcommand("clear-all-files")) {
         return tgfuse::ctl::exec_cache_clear_all_files();
     }
@@ -209,7 +259,7 @@ int main(int argc, char* argv[]) {
     }
 
     if (cache_cmd->got_subcommand("stats")) {
-        return tgfuse::ctl::exec_cache_stats();
+        return tgfuse::ctl::exec_cache_stats(stats_mount_point);
     }
 
     return 0;
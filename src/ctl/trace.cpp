@@ -0,0 +1,35 @@
+#include "trace.hpp"
+
+#include "fuse/constants.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace tgfuse::ctl {
+
+int exec_trace(const std::string& mount_point, const std::string& output) {
+    auto trace_path = std::filesystem::path(mount_point) / kTraceFile;
+    std::ifstream trace(trace_path, std::ios::binary);
+    if (!trace) {
+        std::cerr << "Error: No trace at " << trace_path.string()
+                  << " (is the filesystem mounted there with --trace-events?)\n";
+        return 1;
+    }
+
+    if (output.empty()) {
+        std::cout << trace.rdbuf();
+        return 0;
+    }
+
+    std::ofstream file(output, std::ios::binary);
+    file << trace.rdbuf();
+    if (!file) {
+        std::cerr << "Error: Failed to write " << output << "\n";
+        return 1;
+    }
+    std::cout << "Trace saved to " << output << " (open it in chrome://tracing or ui.perfetto.dev)\n";
+    return 0;
+}
+
+}  // namespace tgfuse::ctl
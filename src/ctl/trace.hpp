@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+namespace tgfuse::ctl {
+
+/// Save the trace recorded by a running filesystem (tg-fused --trace-events)
+/// @param mount_point Where the filesystem is mounted
+/// @param output File to write the Chrome trace to (stdout if empty)
+int exec_trace(const std::string& mount_point, const std::string& output);
+
+}  // namespace tgfuse::ctl
@@ -1,5 +1,6 @@
 #include "users.hpp"
 #include "config.hpp"
+#include "control.hpp"
 
 #include "tg/client.hpp"
 #include "tg/exceptions.hpp"
@@ -8,6 +9,7 @@
 #include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <chrono>
 #include <filesystem>
 #include <iostream>
@@ -38,6 +40,17 @@ tg::TelegramClient::Config make_client_config(const Config& config) {
 }  // namespace
 
 int exec_users_list() {
+    // A running daemon holds the TDLib database, so ask it instead of starting a client
+    if (auto reply = query_daemon("users")) {
+        if (!reply->ok) {
+            std::cerr << "Error: " << reply->body << "\n";
+            return 1;
+        }
+        auto count = std::count(reply->body.begin(), reply->body.end(), '\n');
+        std::cout << "Found " << count << " users:\n" << reply->body;
+        return 0;
+    }
+
     auto config = load_config();
     if (!config) {
         std::cerr << "Error: Not configured. Run 'tg-fuse login' first.\n";
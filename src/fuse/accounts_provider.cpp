@@ -0,0 +1,181 @@
+#include "fuse/accounts_provider.hpp"
+
+#include <cerrno>
+#include <utility>
+
+namespace tgfuse {
+
+AccountsProvider::AccountsProvider(std::map<std::string, std::shared_ptr<DataProvider>> accounts)
+    : accounts_(std::move(accounts)) {}
+
+std::optional<AccountsProvider::Route> AccountsProvider::route(std::string_view path) const {
+    if (is_root(path)) {
+        return std::nullopt;
+    }
+    auto name = path.substr(1);
+    std::string_view rest = "/";
+    if (auto slash = name.find('/'); slash != std::string_view::npos) {
+        rest = name.substr(slash);
+        name = name.substr(0, slash);
+    }
+
+    auto it = accounts_.find(std::string(name));
+    if (it == accounts_.end()) {
+        return std::nullopt;
+    }
+    return Route{it->first, it->second.get(), std::string(rest)};
+}
+
+Entry AccountsProvider::account_entry(const std::string& name, DataProvider& provider) const {
+    auto entry = provider.get_entry("/").value_or(Entry::directory(name));
+    entry.name = name;
+    return entry;
+}
+
+std::vector<Entry> AccountsProvider::list_directory(std::string_view path) {
+    if (is_root(path)) {
+        std::vector<Entry> entries;
+        entries.reserve(accounts_.size());
+        for (const auto& [name, provider] : accounts_) {
+            entries.push_back(account_entry(name, *provider));
+        }
+        return entries;
+    }
+    if (auto account = route(path)) {
+        return account->provider->list_directory(account->path);
+    }
+    return {};
+}
+
+int AccountsProvider::visit_directory(std::string_view path, const EntryVisitor& visit) {
+    if (is_root(path)) {
+        return DataProvider::visit_directory(path, visit);
+    }
+    if (auto account = route(path)) {
+        return account->provider->visit_directory(account->path, visit);
+    }
+    return -ENOENT;
+}
+
+std::optional<Entry> AccountsProvider::get_entry(std::string_view path) {
+    if (is_root(path)) {
+        return Entry::directory("");
+    }
+    auto account = route(path);
+    if (!account) {
+        return std::nullopt;
+    }
+    if (account->path == "/") {
+        return account_entry(account->name, *account->provider);
+    }
+    return account->provider->get_entry(account->path);
+}
+
+bool AccountsProvider::exists(std::string_view path) {
+    if (is_root(path)) {
+        return true;
+    }
+    auto account = route(path);
+    return account && account->provider->exists(account->path);
+}
+
+bool AccountsProvider::is_directory(std::string_view path) {
+    if (is_root(path)) {
+        return true;
+    }
+    auto account = route(path);
+    return account && account->provider->is_directory(account->path);
+}
+
+bool AccountsProvider::is_symlink(std::string_view path) {
+    auto account = route(path);
+    return account && account->provider->is_symlink(account->path);
+}
+
+FileContent AccountsProvider::read_file(std::string_view path) {
+    if (auto account = route(path)) {
+        return account->provider->read_file(account->path);
+    }
+    FileContent content;
+    content.readable = false;
+    return content;
+}
+
+std::string AccountsProvider::read_link(std::string_view path) {
+    if (auto account = route(path)) {
+        return account->provider->read_link(account->path);
+    }
+    return {};
+}
+
+WriteResult AccountsProvider::write_file(std::string_view path, const char* data, std::size_t size, off_t offset) {
+    if (auto account = route(path)) {
+        return account->provider->write_file(account->path, data, size, offset);
+    }
+    return WriteResult{false, 0, "No such account"};
+}
+
+int AccountsProvider::truncate_file(std::string_view path, off_t size) {
+    if (auto account = route(path)) {
+        return account->provider->truncate_file(account->path, size);
+    }
+    return -ENOENT;
+}
+
+bool AccountsProvider::is_writable(std::string_view path) const {
+    auto account = route(path);
+    return account && account->provider->is_writable(account->path);
+}
+
+bool AccountsProvider::is_append_only(std::string_view path) const {
+    auto account = route(path);
+    return account && account->provider->is_append_only(account->path);
+}
+
+int AccountsProvider::create_file(std::string_view path, mode_t mode, uint64_t& fh) {
+    if (auto account = route(path)) {
+        return account->provider->create_file(account->path, mode, fh);
+    }
+    return -EACCES;
+}
+
+WriteResult AccountsProvider::write_file(
+    std::string_view path,
+    const char* data,
+    std::size_t size,
+    off_t offset,
+    uint64_t fh
+) {
+    if (auto account = route(path)) {
+        return account->provider->write_file(account->path, data, size, offset, fh);
+    }
+    return WriteResult{false, 0, "No such account"};
+}
+
+int AccountsProvider::release_file(std::string_view path, uint64_t fh) {
+    if (auto account = route(path)) {
+        return account->provider->release_file(account->path, fh);
+    }
+    return 0;
+}
+
+void AccountsProvider::set_mount_point(std::string mount_point) {
+    for (const auto& [name, provider] : accounts_) {
+        provider->set_mount_point(mount_point.empty() ? std::string() : mount_point + "/" + name);
+    }
+    DataProvider::set_mount_point(std::move(mount_point));
+}
+
+void AccountsProvider::set_invalidate_callback(InvalidateCallback callback) {
+    for (const auto& [name, provider] : accounts_) {
+        if (!callback) {
+            provider->set_invalidate_callback(nullptr);
+            continue;
+        }
+        provider->set_invalidate_callback([callback, prefix = "/" + name](const std::string& path) {
+            callback(path == "/" ? prefix : prefix + path);
+        });
+    }
+}
+
+}  // namespace tgfuse
@@ -1,31 +1,48 @@
 #include "fuse/background_prefetcher.hpp"
 
-#include "tg/formatters.hpp"
+#include "tg/rate_limiter.hpp"
 
-#include <fmt/format.h>
-#include <fmt/ranges.h>
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <cmath>
 
 namespace tgfuse {
 
+namespace {
+
+// Score weights: an access counts for more than a few new messages
+constexpr double kAccessWeight = 4.0;
+constexpr double kUnseenWeight = 1.0;
+constexpr double kActivityWeight = 1.0;
+
+// Score a chat needs for its expired text to be refreshed (one access, two half-lives ago)
+constexpr double kRefreshScore = 1.0;
+
+/// @p value after fading for @p elapsed with the given half-life
+double faded(double value, std::chrono::steady_clock::duration elapsed, std::chrono::seconds half_life) {
+    if (value == 0.0 || half_life.count() <= 0) {
+        return value;
+    }
+    std::chrono::duration<double> seconds = elapsed;
+    return value * std::exp2(-seconds.count() / static_cast<double>(half_life.count()));
+}
+
+}  // namespace
+
 BackgroundPrefetcher::BackgroundPrefetcher(
-    tg::TelegramClient& client,
     FormattedMessagesCache& cache,
     tg::CacheManager& db_cache,
+    Loader load_messages,
+    Loader load_files,
     Config config
 )
-    : client_(client),
-      cache_(cache),
+    : cache_(cache),
       db_cache_(db_cache),
+      load_messages_(std::move(load_messages)),
+      load_files_(std::move(load_files)),
       config_(std::move(config)),
-      rate_limiter_(
-          tg::RateLimiter::Config{
-              .max_requests_per_second = 2,
-              .min_interval = config_.rate_limit_interval,
-          }
-      ) {}
+      expiries_(config_.expiry_resolution) {}
 
 BackgroundPrefetcher::~BackgroundPrefetcher() { stop(); }
 
@@ -34,8 +51,22 @@ void BackgroundPrefetcher::start() {
         return;  // Already running
     }
 
-    spdlog::info("BackgroundPrefetcher: starting");
-    worker_ = std::thread([this]() { prefetch_loop(); });
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        next_cycle_ = Clock::now() + config_.prefetch_interval;
+    }
+
+    if (config_.pool) {
+        spdlog::info("BackgroundPrefetcher: using the shared worker pool");
+        config_.pool->attach(*this);
+        return;
+    }
+
+    auto threads = std::max<std::size_t>(1, config_.workers);
+    spdlog::info("BackgroundPrefetcher: starting {} workers", threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back([this]() { worker_loop(); });
+    }
 }
 
 void BackgroundPrefetcher::stop() {
@@ -44,137 +75,314 @@ void BackgroundPrefetcher::stop() {
     }
 
     spdlog::info("BackgroundPrefetcher: stopping");
+    if (config_.pool) {
+        config_.pool->detach(*this);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.clear();
+    }
     cv_.notify_all();
 
-    if (worker_.joinable()) {
-        worker_.join();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
     }
+    workers_.clear();
 }
 
 void BackgroundPrefetcher::queue_chat(int64_t chat_id, Priority priority) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    queue_.emplace(priority, -std::time(nullptr), chat_id);
-    cv_.notify_one();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        enqueue_locked({chat_id, Kind::MESSAGES}, priority);
+    }
+    notify_workers(false);
     spdlog::debug("BackgroundPrefetcher: queued chat {} with priority {}", chat_id, static_cast<int>(priority));
 }
 
-void BackgroundPrefetcher::set_resolvers(UserResolver user_resolver, ChatResolver chat_resolver) {
+void BackgroundPrefetcher::queue_chats(const std::vector<int64_t>& chat_ids, Priority priority) {
+    if (chat_ids.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto chat_id : chat_ids) {
+            enqueue_locked({chat_id, Kind::MESSAGES}, priority);
+        }
+    }
+    notify_workers(true);
+}
+
+void BackgroundPrefetcher::queue_files(int64_t chat_id, Priority priority) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        enqueue_locked({chat_id, Kind::FILES}, priority);
+    }
+    notify_workers(false);
+}
+
+void BackgroundPrefetcher::record_access(int64_t chat_id) {
     std::lock_guard<std::mutex> lock(mutex_);
-    user_resolver_ = std::move(user_resolver);
-    chat_resolver_ = std::move(chat_resolver);
+    auto now = Clock::now();
+    auto& activity = activity_[chat_id];
+    decay(activity, now);
+    activity.access += 1.0;
+    activity.unseen = 0;
+
+    // The read fills the cache if it has to; refresh the text when it expires
+    if (!expiries_.contains(chat_id)) {
+        expiries_.schedule(chat_id, now + cache_.get_config().format_ttl);
+    }
 }
 
-void BackgroundPrefetcher::prefetch_loop() {
-    spdlog::debug("BackgroundPrefetcher: loop started");
+void BackgroundPrefetcher::record_message(int64_t chat_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& activity = activity_[chat_id];
+    decay(activity, Clock::now());
+    activity.messages += 1.0;
+    ++activity.unseen;
+    dirty_.insert(chat_id);
+}
 
-    while (running_.load()) {
-        int64_t chat_id = 0;
+void BackgroundPrefetcher::mark_dirty(int64_t chat_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dirty_.insert(chat_id);
+}
 
-        {
-            std::unique_lock<std::mutex> lock(mutex_);
+double BackgroundPrefetcher::score(int64_t chat_id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return score_locked(chat_id, Clock::now());
+}
 
-            // Wait for work or timeout
-            if (queue_.empty()) {
-                cv_.wait_for(lock, config_.prefetch_interval, [this]() { return !running_.load() || !queue_.empty(); });
+std::size_t BackgroundPrefetcher::queued() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size();
+}
 
-                if (!running_.load()) {
-                    break;
-                }
+void BackgroundPrefetcher::worker_loop() {
+    spdlog::debug("BackgroundPrefetcher: worker started");
 
-                // If still empty after timeout, scan for chats to prefetch
-                if (queue_.empty()) {
-                    auto chats = get_chats_to_fetch();
-                    for (auto id : chats) {
-                        queue_.emplace(Priority::LOW, -std::time(nullptr), id);
-                    }
-                    spdlog::debug("BackgroundPrefetcher: queued {} chats for prefetch", chats.size());
+    while (running_.load()) {
+        Work work;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (running_.load()) {
+                work = take_work_locked(Clock::now());
+                if (work.type != Work::Type::NONE) {
+                    break;
                 }
+                cv_.wait_until(lock, work.wake);
             }
-
-            if (!queue_.empty()) {
-                auto [priority, neg_time, id] = queue_.top();
-                queue_.pop();
-                chat_id = id;
+            if (!running_.load()) {
+                break;
             }
         }
+        run_work(work);
+    }
+
+    spdlog::debug("BackgroundPrefetcher: worker stopped");
+}
 
-        if (chat_id != 0 && needs_fetch(chat_id)) {
-            rate_limiter_.acquire();
-            fetch_chat_messages(chat_id);
+BackgroundPrefetcher::Work BackgroundPrefetcher::take_work_locked(Clock::time_point now) {
+    run_timers_locked(now);
+
+    Work work;
+    auto job = next_job_locked();
+    if (job != pending_.end()) {
+        work.type = Work::Type::JOB;
+        work.key = job->first;
+        work.priority = job->second.priority;
+        pending_.erase(job);
+        in_flight_.insert(work.key);
+        if (work.key.second == Kind::MESSAGES) {
+            dirty_.erase(work.key.first);  // Changes from here on mark it again
         }
+        return work;
+    }
+    if (!scanned_ && now >= next_cycle_) {
+        // Nothing queued and the startup scan is due: this worker runs it
+        scanned_ = true;
+        next_cycle_ = now + config_.prefetch_interval;
+        work.type = Work::Type::SCAN;
+        return work;
     }
 
-    spdlog::debug("BackgroundPrefetcher: loop stopped");
+    work.wake = expiries_.empty() ? next_cycle_ : std::min(next_cycle_, expiries_.next_tick());
+    return work;
 }
 
-void BackgroundPrefetcher::fetch_chat_messages(int64_t chat_id) {
-    spdlog::debug("BackgroundPrefetcher: fetching messages for chat {}", chat_id);
+BackgroundPrefetcher::Work BackgroundPrefetcher::try_take_work() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_.load()) {
+        return {};
+    }
+    return take_work_locked(Clock::now());
+}
 
-    try {
-        // Fetch messages from Telegram API
-        auto max_age = std::chrono::duration_cast<std::chrono::seconds>(config_.max_history_age);
-        auto task = client_.get_messages_until(chat_id, config_.min_messages, max_age);
-        auto messages = task.get_result();
+void BackgroundPrefetcher::run_work(const Work& work) {
+    if (work.type == Work::Type::SCAN) {
+        initial_scan();
+        return;
+    }
+
+    bool loaded = run_job(work.key, work.priority);
 
-        if (messages.empty()) {
-            spdlog::debug("BackgroundPrefetcher: no messages for chat {}", chat_id);
-            return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_.erase(work.key);
+
+        // Chats in use get their text refreshed when it expires
+        auto [chat_id, kind] = work.key;
+        if (loaded && kind == Kind::MESSAGES && activity_.count(chat_id) != 0) {
+            expiries_.schedule(chat_id, Clock::now() + cache_.get_config().format_ttl);
         }
+    }
+    notify_workers(false);  // A job for the same chat may be waiting for this one
+}
+
+void BackgroundPrefetcher::notify_workers(bool all) {
+    if (config_.pool) {
+        config_.pool->wake();
+    } else if (all) {
+        cv_.notify_all();
+    } else {
+        cv_.notify_one();
+    }
+}
+
+bool BackgroundPrefetcher::run_job(const JobKey& key, Priority priority) {
+    auto [chat_id, kind] = key;
+
+    if (kind == Kind::MESSAGES && !cache_.is_stale(chat_id)) {
+        return false;  // Already served from the cache
+    }
+
+    tg::RequestPriorityScope scope(
+        priority == Priority::HIGH ? tg::RequestPriority::INTERACTIVE : tg::RequestPriority::BACKGROUND
+    );
 
-        // Store messages in SQLite
-        for (const auto& msg : messages) {
-            db_cache_.cache_message(msg);
+    spdlog::debug(
+        "BackgroundPrefetcher: fetching {} for chat {}", kind == Kind::MESSAGES ? "messages" : "files", chat_id
+    );
+    try {
+        const auto& load = kind == Kind::MESSAGES ? load_messages_ : load_files_;
+        if (load) {
+            load(chat_id);
         }
+        return true;
+    } catch (const std::exception& e) {
+        spdlog::warn("BackgroundPrefetcher: failed to fetch chat {}: {}", chat_id, e.what());
+        return false;
+    }
+}
 
-        // Sort by timestamp for stats calculation
-        std::sort(messages.begin(), messages.end(), [](const tg::Message& a, const tg::Message& b) {
-            return a.timestamp < b.timestamp;
-        });
+void BackgroundPrefetcher::enqueue_locked(const JobKey& key, Priority priority) {
+    if (!running_.load()) {
+        return;
+    }
+    auto [it, inserted] = pending_.try_emplace(key, Job{priority, next_sequence_});
+    if (inserted) {
+        ++next_sequence_;
+    } else {
+        it->second.priority = std::min(it->second.priority, priority);
+    }
+}
 
-        // Format messages for cache (if we have resolvers)
-        std::string content;
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            if (user_resolver_ && chat_resolver_) {
-                std::vector<tg::MessageInfo> infos;
-                infos.reserve(messages.size());
-                for (const auto& msg : messages) {
-                    infos.push_back({msg, user_resolver_(msg.sender_id), chat_resolver_(chat_id)});
-                }
-                content = fmt::format("{}\n", fmt::join(infos, "\n"));
-            }
+std::map<BackgroundPrefetcher::JobKey, BackgroundPrefetcher::Job>::iterator BackgroundPrefetcher::next_job_locked() {
+    // Linear scan: scores change with time, and the queue holds at most a few jobs per chat
+    auto now = Clock::now();
+    auto best = pending_.end();
+    double best_score = 0.0;
+    for (auto it = pending_.begin(); it != pending_.end(); ++it) {
+        if (in_flight_.count(it->first) != 0) {
+            continue;
+        }
+        double job_score = score_locked(it->first.first, now);
+        if (best == pending_.end() || it->second.priority < best->second.priority ||
+            (it->second.priority == best->second.priority &&
+             (job_score > best_score || (job_score == best_score && it->second.sequence < best->second.sequence)))) {
+            best = it;
+            best_score = job_score;
         }
+    }
+    return best;
+}
 
-        // Update chat message stats
-        tg::ChatMessageStats stats;
-        stats.chat_id = chat_id;
-        stats.message_count = messages.size();
-        stats.content_size = content.size();
-        stats.last_message_time = messages.back().timestamp;
-        stats.oldest_message_time = messages.front().timestamp;
-        stats.last_fetch_time = std::time(nullptr);
-        db_cache_.update_chat_message_stats(stats);
+double BackgroundPrefetcher::score_locked(int64_t chat_id, Clock::time_point now) const {
+    auto it = activity_.find(chat_id);
+    if (it == activity_.end()) {
+        return 0.0;
+    }
+    const auto& activity = it->second;
+    auto elapsed = now - activity.updated;
+    return kAccessWeight * faded(activity.access, elapsed, config_.access_half_life) +
+           kUnseenWeight * std::log1p(static_cast<double>(activity.unseen)) +
+           kActivityWeight * std::log1p(faded(activity.messages, elapsed, config_.activity_half_life));
+}
+
+void BackgroundPrefetcher::decay(ChatActivity& activity, Clock::time_point now) const {
+    auto elapsed = now - activity.updated;
+    activity.access = faded(activity.access, elapsed, config_.access_half_life);
+    activity.messages = faded(activity.messages, elapsed, config_.activity_half_life);
+    activity.updated = now;
+}
 
-        // Store formatted content in TLRU cache
-        if (!content.empty()) {
-            cache_.store(chat_id, std::move(content), messages.size(), messages.back().id);
+void BackgroundPrefetcher::run_timers_locked(Clock::time_point now) {
+    for (auto chat_id : expiries_.advance(now)) {
+        // Refresh only while the chat is still in use; idle chats wait for a change or a read
+        if (score_locked(chat_id, now) >= kRefreshScore) {
+            enqueue_locked({chat_id, Kind::MESSAGES}, Priority::LOW);
         }
+    }
 
-        // Evict old messages from SQLite
-        auto cutoff = std::chrono::system_clock::now() - config_.max_history_age;
-        auto cutoff_ts = std::chrono::duration_cast<std::chrono::seconds>(cutoff.time_since_epoch()).count();
-        db_cache_.evict_old_messages(chat_id, cutoff_ts);
+    if (scanned_ && now >= next_cycle_) {
+        for (auto chat_id : dirty_) {
+            enqueue_locked({chat_id, Kind::MESSAGES}, Priority::LOW);
+        }
+        if (!dirty_.empty()) {
+            spdlog::debug("BackgroundPrefetcher: queued {} changed chats", dirty_.size());
+        }
+        dirty_.clear();
+        next_cycle_ = now + config_.prefetch_interval;
+    }
+}
 
-        spdlog::debug(
-            "BackgroundPrefetcher: fetched {} messages for chat {}, {} bytes",
-            messages.size(),
-            chat_id,
-            stats.content_size
-        );
+void BackgroundPrefetcher::initial_scan() {
+    auto chats = get_chats_to_fetch();
 
+    // One query for every chat's stats rather than one per chat
+    std::unordered_map<int64_t, tg::ChatMessageStats> stats;
+    try {
+        for (auto& chat_stats : db_cache_.get_all_chat_message_stats()) {
+            stats.emplace(chat_stats.chat_id, std::move(chat_stats));
+        }
     } catch (const std::exception& e) {
-        spdlog::warn("BackgroundPrefetcher: failed to fetch chat {}: {}", chat_id, e.what());
+        spdlog::warn("BackgroundPrefetcher: failed to load chat stats: {}", e.what());
+    }
+
+    auto now = std::time(nullptr);
+    std::vector<int64_t> stale;
+    for (auto chat_id : chats) {
+        auto it = stats.find(chat_id);
+        if (it == stats.end() || it->second.message_count < config_.min_messages ||
+            now - it->second.last_fetch_time > static_cast<int64_t>(config_.prefetch_interval.count())) {
+            stale.push_back(chat_id);
+        }
     }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto chat_id : stale) {
+            enqueue_locked({chat_id, Kind::MESSAGES}, Priority::LOW);
+        }
+        for (auto chat_id : dirty_) {
+            enqueue_locked({chat_id, Kind::MESSAGES}, Priority::LOW);
+        }
+        dirty_.clear();
+    }
+    notify_workers(true);
+    spdlog::debug("BackgroundPrefetcher: queued {} of {} chats for prefetch", stale.size(), chats.size());
 }
 
 std::vector<int64_t> BackgroundPrefetcher::get_chats_to_fetch() {
@@ -230,25 +438,98 @@ std::vector<int64_t> BackgroundPrefetcher::get_chats_to_fetch() {
     return result;
 }
 
-bool BackgroundPrefetcher::needs_fetch(int64_t chat_id) {
-    auto stats = db_cache_.get_chat_message_stats(chat_id);
-    if (!stats) {
-        return true;  // Never fetched
+PrefetchPool::PrefetchPool(std::size_t workers) {
+    auto threads = std::max<std::size_t>(1, workers);
+    spdlog::info("PrefetchPool: starting {} workers", threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back([this]() { worker_loop(); });
     }
+}
 
-    // Check if we have enough messages
-    if (stats->message_count < config_.min_messages) {
-        return true;
+PrefetchPool::~PrefetchPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
     }
+}
 
-    // Check if cache is stale (not fetched recently)
-    auto now = std::time(nullptr);
-    auto age = now - stats->last_fetch_time;
-    if (age > static_cast<int64_t>(config_.prefetch_interval.count())) {
-        return true;
+void PrefetchPool::attach(BackgroundPrefetcher& prefetcher) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        members_.push_back(Member{&prefetcher});
+        ++epoch_;
     }
+    cv_.notify_all();
+}
 
-    return false;
+void PrefetchPool::detach(BackgroundPrefetcher& prefetcher) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto member = [&] {
+        return std::find_if(members_.begin(), members_.end(), [&](const Member& m) {
+            return m.prefetcher == &prefetcher;
+        });
+    };
+    cv_.wait(lock, [&] { return member() == members_.end() || member()->running == 0; });
+    if (auto it = member(); it != members_.end()) {
+        members_.erase(it);
+    }
+}
+
+void PrefetchPool::wake() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++epoch_;
+    }
+    cv_.notify_all();  // Also wakes detach(), so never just one
+}
+
+void PrefetchPool::worker_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        auto seen = epoch_;
+        auto wake = Clock::time_point::max();
+
+        // Offer the turn to each prefetcher once, starting after the one that ran last
+        BackgroundPrefetcher* prefetcher = nullptr;
+        BackgroundPrefetcher::Work work;
+        for (std::size_t n = 0; n < members_.size(); ++n) {
+            auto index = (next_ + n) % members_.size();
+            work = members_[index].prefetcher->try_take_work();
+            if (work.type != BackgroundPrefetcher::Work::Type::NONE) {
+                prefetcher = members_[index].prefetcher;
+                ++members_[index].running;
+                next_ = index + 1;
+                break;
+            }
+            wake = std::min(wake, work.wake);
+        }
+
+        if (!prefetcher) {
+            auto woken = [&] { return stopping_ || epoch_ != seen; };
+            if (wake == Clock::time_point::max()) {
+                cv_.wait(lock, woken);
+            } else {
+                cv_.wait_until(lock, wake, woken);
+            }
+            continue;
+        }
+
+        lock.unlock();
+        prefetcher->run_work(work);
+        lock.lock();
+
+        // detach() waits for this, so the member is still there
+        for (auto& member : members_) {
+            if (member.prefetcher == prefetcher) {
+                --member.running;
+            }
+        }
+        cv_.notify_all();
+    }
 }
 
 }  // namespace tgfuse
@@ -0,0 +1,249 @@
+#include "fuse/control_server.hpp"
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+
+namespace tgfuse {
+
+namespace {
+
+constexpr std::size_t kMaxRequestBytes = 64 * 1024;
+constexpr int kClientTimeoutSeconds = 5;  // A client that stops talking can't hold the server up
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;  // A client gone mid-reply is an error, not a SIGPIPE
+#else
+constexpr int kSendFlags = 0;  // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+/// Address of the socket at @p path, or false if the path doesn't fit in one
+bool make_address(const std::string& path, sockaddr_un& address) {
+    address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+/// Tab-separated fields of a request line
+std::vector<std::string> split_fields(std::string_view line) {
+    std::vector<std::string> fields;
+    while (true) {
+        auto tab = line.find('\t');
+        fields.emplace_back(line.substr(0, tab));
+        if (tab == std::string_view::npos) {
+            return fields;
+        }
+        line.remove_prefix(tab + 1);
+    }
+}
+
+bool send_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+        auto sent = ::send(fd, data.data(), data.size(), kSendFlags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix(static_cast<std::size_t>(sent));
+    }
+    return true;
+}
+
+std::string_view to_string(ControlResponse::Status status) {
+    switch (status) {
+        case ControlResponse::Status::OK:
+            return "ok";
+        case ControlResponse::Status::ERROR:
+            return "error";
+        case ControlResponse::Status::UNSERVED:
+            return "unserved";
+    }
+    return "error";
+}
+
+}  // namespace
+
+ControlServer::ControlServer(std::string socket_path) : socket_path_(std::move(socket_path)) {}
+
+ControlServer::~ControlServer() { stop(); }
+
+void ControlServer::add_handler(std::string command, Handler handler) {
+    handlers_[std::move(command)] = std::move(handler);
+}
+
+bool ControlServer::start() {
+    if (running_) {
+        return true;
+    }
+
+    sockaddr_un address;
+    if (!make_address(socket_path_, address)) {
+        spdlog::error("Control socket path is too long: {}", socket_path_);
+        return false;
+    }
+    if (socket_in_use()) {
+        spdlog::warn("Another daemon is serving the control socket at {}", socket_path_);
+        return false;
+    }
+    ::unlink(socket_path_.c_str());  // Left behind by a daemon that died
+
+    listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        spdlog::error("Failed to create the control socket: {}", std::strerror(errno));
+        return false;
+    }
+    ::fcntl(listen_fd_, F_SETFD, FD_CLOEXEC);
+
+    // Restricted to the daemon's user before it listens, so nobody else can connect in between
+    if (::bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::chmod(socket_path_.c_str(), S_IRUSR | S_IWUSR) != 0 || ::listen(listen_fd_, 8) != 0 ||
+        ::pipe(wake_fds_) != 0) {
+        spdlog::error("Failed to open the control socket at {}: {}", socket_path_, std::strerror(errno));
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        ::unlink(socket_path_.c_str());
+        return false;
+    }
+
+    running_ = true;
+    thread_ = std::thread([this] { serve(); });
+    spdlog::info("Control socket: {}", socket_path_);
+    return true;
+}
+
+void ControlServer::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    [[maybe_unused]] auto written = ::write(wake_fds_[1], "x", 1);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    ::close(listen_fd_);
+    ::close(wake_fds_[0]);
+    ::close(wake_fds_[1]);
+    listen_fd_ = wake_fds_[0] = wake_fds_[1] = -1;
+    ::unlink(socket_path_.c_str());
+}
+
+void ControlServer::serve() {
+    while (running_) {
+        pollfd fds[2] = {{listen_fd_, POLLIN, 0}, {wake_fds_[0], POLLIN, 0}};
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            spdlog::error("Control socket poll failed: {}", std::strerror(errno));
+            return;
+        }
+        if (fds[1].revents != 0) {
+            return;
+        }
+        if ((fds[0].revents & POLLIN) == 0) {
+            continue;
+        }
+
+        int fd = ::accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        handle(fd);
+        ::close(fd);
+    }
+}
+
+void ControlServer::handle(int fd) {
+    timeval timeout{kClientTimeoutSeconds, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+    auto reply = [fd](const ControlResponse& response) {
+        send_all(fd, fmt::format("{}\n{}", to_string(response.status), response.body));
+    };
+
+    // The request ends at the first newline (or when the client shuts down its side)
+    std::string line;
+    char buffer[1024];
+    while (line.find('\n') == std::string::npos) {
+        auto received = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            break;
+        }
+        line.append(buffer, static_cast<std::size_t>(received));
+        if (line.size() > kMaxRequestBytes) {
+            reply(ControlResponse::error("Request too long"));
+            return;
+        }
+    }
+    line.erase(std::min(line.find('\n'), line.size()));
+
+    auto fields = split_fields(line);
+    if (fields.size() < 2 || fields[1].empty()) {
+        reply(ControlResponse::error("Malformed request"));
+        return;
+    }
+
+    ControlRequest request;
+    request.account = std::move(fields[0]);
+    request.command = std::move(fields[1]);
+    request.args.assign(std::make_move_iterator(fields.begin() + 2), std::make_move_iterator(fields.end()));
+
+    spdlog::debug("Control request: {} (account '{}')", request.command, request.account);
+    reply(dispatch(request));
+}
+
+ControlResponse ControlServer::dispatch(const ControlRequest& request) const {
+    auto it = handlers_.find(request.command);
+    if (it == handlers_.end()) {
+        return ControlResponse::error(fmt::format("Unknown command '{}'", request.command));
+    }
+    try {
+        return it->second(request);
+    } catch (const std::exception& e) {
+        spdlog::error("Control command {} failed: {}", request.command, e.what());
+        return ControlResponse::error(e.what());
+    }
+}
+
+bool ControlServer::socket_in_use() const {
+    sockaddr_un address;
+    if (!make_address(socket_path_, address)) {
+        return false;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    bool answered = ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+    ::close(fd);
+    return answered;
+}
+
+}  // namespace tgfuse
@@ -0,0 +1,143 @@
+#include "fuse/download_pool.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+namespace tgfuse {
+
+DownloadPool::InteractiveScope::InteractiveScope(DownloadPool* pool) : pool_(pool) {
+    if (pool_) {
+        std::lock_guard<std::mutex> lock(pool_->mutex_);
+        ++pool_->interactive_;
+    }
+}
+
+DownloadPool::InteractiveScope::~InteractiveScope() {
+    if (pool_) {
+        {
+            std::lock_guard<std::mutex> lock(pool_->mutex_);
+            --pool_->interactive_;
+        }
+        pool_->cv_.notify_all();
+    }
+}
+
+DownloadPool::DownloadPool(Config config) : config_(std::move(config)) {}
+
+DownloadPool::~DownloadPool() { stop(); }
+
+void DownloadPool::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_ || config_.workers == 0) {
+        return;
+    }
+    running_ = true;
+
+    spdlog::info("DownloadPool: starting {} workers", config_.workers);
+    for (std::size_t i = 0; i < config_.workers; ++i) {
+        workers_.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+void DownloadPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+        queue_.clear();
+        queued_.clear();
+    }
+    spdlog::info("DownloadPool: stopping");
+    cv_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers_.clear();
+}
+
+void DownloadPool::queue(std::vector<std::pair<std::string, Job>> jobs) {
+    std::size_t added = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+
+        // Insert in reverse at the front, so the batch runs in its own order
+        for (auto it = jobs.rbegin(); it != jobs.rend(); ++it) {
+            auto& [key, job] = *it;
+            if (queued_.count(key) > 0 || running_keys_.count(key) > 0 || done_.count(key) > 0) {
+                continue;
+            }
+            queued_.insert(key);
+            queue_.push_front({std::move(key), std::move(job)});
+            ++added;
+        }
+
+        // Drop what was queued longest ago: those listings are out of view by now
+        while (queue_.size() > config_.max_queued) {
+            queued_.erase(queue_.back().key);
+            queue_.pop_back();
+        }
+    }
+
+    if (added > 0) {
+        spdlog::debug("DownloadPool: queued {} downloads", added);
+        cv_.notify_all();
+    }
+}
+
+std::size_t DownloadPool::queued() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
+
+void DownloadPool::worker_loop() {
+    while (true) {
+        Entry entry;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return !running_ || (!queue_.empty() && interactive_ == 0); });
+            if (!running_) {
+                break;
+            }
+            entry = std::move(queue_.front());
+            queue_.pop_front();
+            queued_.erase(entry.key);
+            running_keys_.insert(entry.key);
+        }
+
+        bool ok = false;
+        try {
+            entry.job();
+            ok = true;
+        } catch (const std::exception& e) {
+            spdlog::debug("DownloadPool: download of {} failed: {}", entry.key, e.what());
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_keys_.erase(entry.key);
+        if (ok) {
+            mark_done_locked(entry.key);
+        }
+    }
+}
+
+void DownloadPool::mark_done_locked(const std::string& key) {
+    if (!done_.insert(key).second) {
+        return;
+    }
+    done_order_.push_back(key);
+    while (done_order_.size() > std::max<std::size_t>(1, config_.max_done)) {
+        done_.erase(done_order_.front());
+        done_order_.pop_front();
+    }
+}
+
+}  // namespace tgfuse
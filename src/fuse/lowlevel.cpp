@@ -0,0 +1,641 @@
+#include "fuse/lowlevel.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#if TG_FUSE_VERSION == 3
+#include <fuse3/fuse_lowlevel.h>
+#endif
+
+namespace tgfuse {
+
+//------------------------------------------------------------------------------
+// InodeTable
+//------------------------------------------------------------------------------
+
+InodeTable::InodeTable() {
+    // The root is pinned with a lookup the kernel never forgets
+    nodes_.emplace(kRootInode, Node{"/", kRootInode, 1});
+    by_path_.emplace("/", kRootInode);
+}
+
+std::string InodeTable::join(const std::string& parent, std::string_view name) {
+    std::string path;
+    path.reserve(parent.size() + 1 + name.size());
+    path = parent;
+    if (path.back() != '/') {
+        path += '/';
+    }
+    path += name;
+    return path;
+}
+
+std::optional<std::pair<InodeNumber, std::string>> InodeTable::acquire(InodeNumber parent, std::string_view name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto parent_it = nodes_.find(parent);
+    if (parent_it == nodes_.end()) {
+        return std::nullopt;
+    }
+
+    auto path = join(parent_it->second.path, name);
+    auto [it, inserted] = by_path_.try_emplace(path, next_ino_);
+    if (inserted) {
+        nodes_.emplace(next_ino_, Node{path, parent, 0});
+        ++next_ino_;
+    }
+    ++nodes_.at(it->second).lookups;
+    return std::make_pair(it->second, std::move(path));
+}
+
+void InodeTable::forget(InodeNumber ino, uint64_t count) {
+    if (ino == kRootInode) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = nodes_.find(ino);
+    if (it == nodes_.end()) {
+        return;
+    }
+    auto& node = it->second;
+    node.lookups = count >= node.lookups ? 0 : node.lookups - count;
+    if (node.lookups == 0) {
+        by_path_.erase(node.path);
+        nodes_.erase(it);
+    }
+}
+
+std::optional<std::string> InodeTable::path(InodeNumber ino) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = nodes_.find(ino);
+    if (it == nodes_.end()) {
+        return std::nullopt;
+    }
+    return it->second.path;
+}
+
+std::optional<std::string> InodeTable::child_path(InodeNumber parent, std::string_view name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = nodes_.find(parent);
+    if (it == nodes_.end()) {
+        return std::nullopt;
+    }
+    return join(it->second.path, name);
+}
+
+std::optional<InodeTable::Binding> InodeTable::find(std::string_view path) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = by_path_.find(std::string(path));
+    if (it == by_path_.end()) {
+        return std::nullopt;
+    }
+    const auto& node = nodes_.at(it->second);
+    auto slash = node.path.rfind('/');
+    return Binding{it->second, node.parent, node.path.substr(slash + 1)};
+}
+
+std::size_t InodeTable::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nodes_.size();
+}
+
+//------------------------------------------------------------------------------
+// LowLevelAdapter
+//------------------------------------------------------------------------------
+
+#if TG_FUSE_VERSION == 3
+
+namespace {
+
+/// State of the running session (one per process, like PlatformAdapter)
+struct Session {
+    FuseOperations& impl;
+    LowLevelOptions options;
+    InodeTable inodes;
+    struct fuse_session* se{nullptr};
+};
+
+std::atomic<Session*> current_session{nullptr};
+
+Session& session() { return *current_session.load(); }
+
+/// Directory listing captured at opendir, served by offset
+struct DirHandle {
+    struct Item {
+        std::string name;
+        struct stat st;
+    };
+    std::vector<Item> items;
+};
+
+DirHandle* dir_handle(struct fuse_file_info* fi) { return reinterpret_cast<DirHandle*>(fi->fh); }
+
+/// Stat a path through the operations implementation
+/// @return 0 on success, negative errno on error
+int stat_path(const std::string& path, InodeNumber ino, struct stat* st) {
+    int rc = session().impl.getattr(path.c_str(), st);
+    if (rc == 0) {
+        st->st_ino = ino;
+    }
+    return rc;
+}
+
+/// Resolve a child entry, counting a lookup on success
+/// @return 0 on success, negative errno on error
+int lookup_child(InodeNumber parent, const char* name, struct fuse_entry_param* entry) {
+    auto& s = session();
+    std::memset(entry, 0, sizeof(*entry));
+
+    auto path = s.inodes.child_path(parent, name);
+    if (!path) {
+        return -ENOENT;
+    }
+    // Stat first so failed lookups never create nodes
+    int rc = s.impl.getattr(path->c_str(), &entry->attr);
+    if (rc != 0) {
+        return rc;
+    }
+
+    auto node = s.inodes.acquire(parent, name);
+    if (!node) {
+        return -ENOENT;
+    }
+    entry->ino = node->first;
+    entry->attr.st_ino = node->first;
+    entry->attr_timeout = s.options.attr_timeout;
+    entry->entry_timeout = s.options.entry_timeout;
+    return 0;
+}
+
+/// Reply with an error for an inode the table doesn't know
+std::optional<std::string> path_or_reply(fuse_req_t req, fuse_ino_t ino) {
+    auto path = session().inodes.path(ino);
+    if (!path) {
+        fuse_reply_err(req, ESTALE);
+    }
+    return path;
+}
+
+void ll_lookup(fuse_req_t req, fuse_ino_t parent, const char* name) {
+    struct fuse_entry_param entry;
+    int rc = lookup_child(parent, name, &entry);
+    if (rc != 0) {
+        fuse_reply_err(req, -rc);
+        return;
+    }
+    fuse_reply_entry(req, &entry);
+}
+
+void ll_forget(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup) {
+    session().inodes.forget(ino, nlookup);
+    fuse_reply_none(req);
+}
+
+void ll_forget_multi(fuse_req_t req, size_t count, struct fuse_forget_data* forgets) {
+    for (size_t i = 0; i < count; ++i) {
+        session().inodes.forget(forgets[i].ino, forgets[i].nlookup);
+    }
+    fuse_reply_none(req);
+}
+
+void ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+    (void)fi;  // Unused
+    auto path = path_or_reply(req, ino);
+    if (!path) {
+        return;
+    }
+
+    struct stat st;
+    int rc = stat_path(*path, ino, &st);
+    if (rc != 0) {
+        fuse_reply_err(req, -rc);
+        return;
+    }
+    fuse_reply_attr(req, &st, session().options.attr_timeout);
+}
+
+void ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat* attr, int to_set, struct fuse_file_info* fi) {
+    (void)fi;  // Unused
+    auto path = path_or_reply(req, ino);
+    if (!path) {
+        return;
+    }
+    auto& impl = session().impl;
+
+    int rc = 0;
+    if (to_set & FUSE_SET_ATTR_SIZE) {
+        rc = impl.truncate(path->c_str(), attr->st_size);
+    }
+    if (rc == 0 && (to_set & FUSE_SET_ATTR_MODE)) {
+        rc = impl.chmod(path->c_str(), attr->st_mode);
+    }
+    if (rc == 0 && (to_set & (FUSE_SET_ATTR_UID | FUSE_SET_ATTR_GID))) {
+        uid_t uid = (to_set & FUSE_SET_ATTR_UID) ? attr->st_uid : static_cast<uid_t>(-1);
+        gid_t gid = (to_set & FUSE_SET_ATTR_GID) ? attr->st_gid : static_cast<gid_t>(-1);
+        rc = impl.chown(path->c_str(), uid, gid);
+    }
+    if (rc == 0 && (to_set & (FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME))) {
+        struct timespec ts[2];
+        ts[0].tv_nsec = UTIME_OMIT;
+        ts[1].tv_nsec = UTIME_OMIT;
+        if (to_set & FUSE_SET_ATTR_ATIME) {
+            ts[0] = (to_set & FUSE_SET_ATTR_ATIME_NOW) ? timespec{0, UTIME_NOW} : attr->st_atim;
+        }
+        if (to_set & FUSE_SET_ATTR_MTIME) {
+            ts[1] = (to_set & FUSE_SET_ATTR_MTIME_NOW) ? timespec{0, UTIME_NOW} : attr->st_mtim;
+        }
+        rc = impl.utimens(path->c_str(), ts);
+    }
+    if (rc != 0) {
+        fuse_reply_err(req, -rc);
+        return;
+    }
+
+    struct stat st;
+    rc = stat_path(*path, ino, &st);
+    if (rc != 0) {
+        fuse_reply_err(req, -rc);
+        return;
+    }
+    fuse_reply_attr(req, &st, session().options.attr_timeout);
+}
+
+void ll_readlink(fuse_req_t req, fuse_ino_t ino) {
+    auto path = path_or_reply(req, ino);
+    if (!path) {
+        return;
+    }
+
+    char buf[PATH_MAX];
+    int rc = session().impl.readlink(path->c_str(), buf, sizeof(buf));
+    if (rc != 0) {
+        fuse_reply_err(req, -rc);
+        return;
+    }
+    fuse_reply_readlink(req, buf);
+}
+
+void ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+    auto path = path_or_reply(req, ino);
+    if (!path) {
+        return;
+    }
+
+    int rc = session().impl.open(path->c_str(), fi);
+    if (rc != 0) {
+        fuse_reply_err(req, -rc);
+        return;
+    }
+    if (session().options.kernel_cache && !fi->direct_io) {
+        fi->keep_cache = 1;
+    }
+    fuse_reply_open(req, fi);
+}
+
+void ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, struct fuse_file_info* fi) {
+    auto path = path_or_reply(req, ino);
+    if (!path) {
+        return;
+    }
+
+    std::vector<char> buf(size);
+    int rc = session().impl.read(path->c_str(), buf.data(), size, offset, fi);
+    if (rc < 0) {
+        fuse_reply_err(req, -rc);
+        return;
+    }
+    fuse_reply_buf(req, buf.data(), static_cast<size_t>(rc));
+}
+
+void ll_write(fuse_req_t req, fuse_ino_t ino, const char* buf, size_t size, off_t offset, struct fuse_file_info* fi) {
+    auto path = path_or_reply(req, ino);
+    if (!path) {
+        return;
+    }
+
+    int rc = session().impl.write(path->c_str(), buf, size, offset, fi);
+    if (rc < 0) {
+        fuse_reply_err(req, -rc);
+        return;
+    }
+    fuse_reply_write(req, static_cast<size_t>(rc));
+}
+
+void ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+    auto path = session().inodes.path(ino);
+    int rc = path ? session().impl.release(path->c_str(), fi) : -ESTALE;
+    fuse_reply_err(req, rc < 0 ? -rc : 0);
+}
+
+void ll_create(fuse_req_t req, fuse_ino_t parent, const char* name, mode_t mode, struct fuse_file_info* fi) {
+    auto& s = session();
+    auto path = s.inodes.child_path(parent, name);
+    if (!path) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    int rc = s.impl.create(path->c_str(), mode, fi);
+    if (rc != 0) {
+        fuse_reply_err(req, -rc);
+        return;
+    }
+
+    struct fuse_entry_param entry;
+    std::memset(&entry, 0, sizeof(entry));
+    if (s.impl.getattr(path->c_str(), &entry.attr) != 0) {
+        // Provider may not list the file until it is released
+        entry.attr.st_mode = S_IFREG | (mode & 07777);
+        entry.attr.st_nlink = 1;
+    }
+    auto node = s.inodes.acquire(parent, name);
+    if (!node) {
+        // The parent went away meanwhile: close what create() opened, as the kernel never will
+        s.impl.release(path->c_str(), fi);
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    entry.ino = node->first;
+    entry.attr.st_ino = node->first;
+    entry.attr_timeout = s.options.attr_timeout;
+    entry.entry_timeout = s.options.entry_timeout;
+    fuse_reply_create(req, &entry, fi);
+}
+
+void ll_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+    auto path = path_or_reply(req, ino);
+    if (!path) {
+        return;
+    }
+
+    auto handle = std::make_unique<DirHandle>();
+    // The whole listing is captured at once (offset 0): later readdir calls page through the capture
+    auto filler = [&handle](const char* name, const struct stat* stbuf, off_t) -> int {
+        auto& item = handle->items.emplace_back();
+        item.name = name;
+        if (stbuf) {
+            item.st = *stbuf;
+        } else {
+            std::memset(&item.st, 0, sizeof(item.st));
+            item.st.st_mode = S_IFDIR;
+        }
+        return 0;
+    };
+
+    int rc = session().impl.readdir(path->c_str(), filler, 0, nullptr);
+    if (rc != 0) {
+        fuse_reply_err(req, -rc);
+        return;
+    }
+    fi->fh = reinterpret_cast<uint64_t>(handle.release());
+    fuse_reply_open(req, fi);
+}
+
+/// Fill a readdir(plus) reply from a captured listing
+void reply_directory(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, struct fuse_file_info* fi, bool plus) {
+    auto& s = session();
+    auto* handle = dir_handle(fi);
+    auto path = s.inodes.path(ino);
+    if (!handle || !path) {
+        fuse_reply_err(req, EBADF);
+        return;
+    }
+
+    std::vector<char> buf(size);
+    size_t used = 0;
+    for (auto i = static_cast<size_t>(offset); i < handle->items.size(); ++i) {
+        const auto& item = handle->items[i];
+        char* out = buf.data() + used;
+        size_t remaining = size - used;
+        auto next = static_cast<off_t>(i + 1);
+
+        size_t entry_size;
+        if (!plus) {
+            entry_size = fuse_add_direntry(req, out, remaining, item.name.c_str(), &item.st, next);
+        } else {
+            struct fuse_entry_param entry;
+            std::memset(&entry, 0, sizeof(entry));
+            entry.attr = item.st;
+
+            // . and .. carry no lookup; a zero ino tells the kernel to skip the dentry
+            bool counted = false;
+            if (item.name != "." && item.name != "..") {
+                auto child = s.inodes.child_path(ino, item.name);
+                if (child && s.impl.getattr(child->c_str(), &entry.attr) == 0) {
+                    if (auto node = s.inodes.acquire(ino, item.name)) {
+                        entry.ino = node->first;
+                        entry.attr.st_ino = node->first;
+                        entry.attr_timeout = s.options.attr_timeout;
+                        entry.entry_timeout = s.options.entry_timeout;
+                        counted = true;
+                    }
+                }
+            }
+
+            entry_size = fuse_add_direntry_plus(req, out, remaining, item.name.c_str(), &entry, next);
+            if (entry_size > remaining && counted) {
+                // Didn't fit - the kernel won't see this lookup
+                s.inodes.forget(entry.ino, 1);
+            }
+        }
+
+        if (entry_size > remaining) {
+            break;  // Buffer full
+        }
+        used += entry_size;
+    }
+
+    fuse_reply_buf(req, buf.data(), used);
+}
+
+void ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, struct fuse_file_info* fi) {
+    reply_directory(req, ino, size, offset, fi, false);
+}
+
+void ll_readdirplus(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, struct fuse_file_info* fi) {
+    reply_directory(req, ino, size, offset, fi, true);
+}
+
+void ll_releasedir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+    (void)ino;  // Unused
+    delete dir_handle(fi);
+    fuse_reply_err(req, 0);
+}
+
+void ll_setxattr(fuse_req_t req, fuse_ino_t ino, const char* name, const char* value, size_t size, int flags) {
+    auto path = path_or_reply(req, ino);
+    if (!path) {
+        return;
+    }
+    int rc = session().impl.setxattr(path->c_str(), name, value, size, flags);
+    fuse_reply_err(req, rc < 0 ? -rc : 0);
+}
+
+void ll_getxattr(fuse_req_t req, fuse_ino_t ino, const char* name, size_t size) {
+    auto path = path_or_reply(req, ino);
+    if (!path) {
+        return;
+    }
+
+    std::vector<char> buf(size);
+    int rc = session().impl.getxattr(path->c_str(), name, size ? buf.data() : nullptr, size);
+    if (rc < 0) {
+        fuse_reply_err(req, -rc);
+    } else if (size == 0) {
+        fuse_reply_xattr(req, static_cast<size_t>(rc));
+    } else {
+        fuse_reply_buf(req, buf.data(), static_cast<size_t>(rc));
+    }
+}
+
+void ll_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size) {
+    auto path = path_or_reply(req, ino);
+    if (!path) {
+        return;
+    }
+
+    std::vector<char> buf(size);
+    int rc = session().impl.listxattr(path->c_str(), size ? buf.data() : nullptr, size);
+    if (rc < 0) {
+        fuse_reply_err(req, -rc);
+    } else if (size == 0) {
+        fuse_reply_xattr(req, static_cast<size_t>(rc));
+    } else {
+        fuse_reply_buf(req, buf.data(), static_cast<size_t>(rc));
+    }
+}
+
+void ll_init(void* userdata, struct fuse_conn_info* conn) {
+    auto* state = static_cast<Session*>(userdata);
+    PlatformAdapter::apply_connection_options(conn, state->options.connection);
+}
+
+struct fuse_lowlevel_ops make_operations() {
+    struct fuse_lowlevel_ops ops;
+    std::memset(&ops, 0, sizeof(ops));
+
+    ops.init = ll_init;
+    ops.lookup = ll_lookup;
+    ops.forget = ll_forget;
+    ops.forget_multi = ll_forget_multi;
+    ops.getattr = ll_getattr;
+    ops.setattr = ll_setattr;
+    ops.readlink = ll_readlink;
+    ops.open = ll_open;
+    ops.read = ll_read;
+    ops.write = ll_write;
+    ops.release = ll_release;
+    ops.create = ll_create;
+    ops.opendir = ll_opendir;
+    ops.readdir = ll_readdir;
+    ops.readdirplus = ll_readdirplus;
+    ops.releasedir = ll_releasedir;
+    ops.setxattr = ll_setxattr;
+    ops.getxattr = ll_getxattr;
+    ops.listxattr = ll_listxattr;
+
+    return ops;
+}
+
+}  // namespace
+
+int LowLevelAdapter::run(FuseOperations& impl, const LowLevelOptions& options) {
+    std::vector<std::string> args_storage{"tg-fused"};
+    if (options.debug) {
+        args_storage.push_back("-d");
+    }
+    if (options.allow_other) {
+        args_storage.push_back("-o");
+        args_storage.push_back("allow_other");
+    }
+
+    std::vector<char*> argv;
+    for (auto& arg : args_storage) {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+    struct fuse_args args = FUSE_ARGS_INIT(static_cast<int>(argv.size() - 1), argv.data());
+
+    Session state{impl, options, {}, nullptr};
+    auto ops = make_operations();
+
+    state.se = fuse_session_new(&args, &ops, sizeof(ops), &state);
+    if (!state.se) {
+        spdlog::error("Failed to create low-level FUSE session");
+        return 1;
+    }
+    current_session.store(&state);
+
+    int result = 1;
+    if (fuse_set_signal_handlers(state.se) != 0) {
+        spdlog::error("Failed to install FUSE signal handlers");
+    } else {
+        if (fuse_session_mount(state.se, options.mount_point.c_str()) != 0) {
+            spdlog::error("Failed to mount low-level FUSE session at {}", options.mount_point);
+        } else {
+            spdlog::info("Low-level FUSE session mounted at {}", options.mount_point);
+            if (options.worker_threads <= 1) {
+                result = fuse_session_loop(state.se);
+            } else {
+                // libfuse grows the pool on demand; this caps how many idle workers it keeps
+                struct fuse_loop_config loop_config;
+                std::memset(&loop_config, 0, sizeof(loop_config));
+                loop_config.max_idle_threads = options.worker_threads;
+                result = fuse_session_loop_mt(state.se, &loop_config);
+            }
+            fuse_session_unmount(state.se);
+        }
+        fuse_remove_signal_handlers(state.se);
+    }
+
+    current_session.store(nullptr);
+    fuse_session_destroy(state.se);
+    spdlog::debug("Low-level session ended with {} live inodes", state.inodes.size());
+    return result;
+}
+
+int LowLevelAdapter::invalidate_path(const char* path) {
+    auto* state = current_session.load();
+    if (!state) {
+        return 0;
+    }
+
+    auto binding = state->inodes.find(path);
+    if (!binding) {
+        return 0;  // The kernel holds no reference to it
+    }
+
+    int rc = fuse_lowlevel_notify_inval_inode(state->se, binding->ino, 0, 0);
+    if (rc == 0 && binding->ino != InodeTable::kRootInode) {
+        rc = fuse_lowlevel_notify_inval_entry(state->se, binding->parent, binding->name.c_str(), binding->name.size());
+    }
+    return rc == -ENOENT ? 0 : rc;
+}
+
+bool LowLevelAdapter::is_running() { return current_session.load() != nullptr; }
+
+#else
+
+int LowLevelAdapter::run(FuseOperations& impl, const LowLevelOptions& options) {
+    (void)impl;
+    (void)options;
+    spdlog::error("The low-level FUSE backend requires libfuse3");
+    return -ENOSYS;
+}
+
+int LowLevelAdapter::invalidate_path(const char* path) {
+    (void)path;
+    return -ENOSYS;
+}
+
+bool LowLevelAdapter::is_running() { return false; }
+
+#endif
+
+}  // namespace tgfuse
@@ -1,96 +1,223 @@
 #include "fuse/messages_cache.hpp"
 
+#include "tg/bustache_formatters.hpp"
+
 #include <spdlog/spdlog.h>
 
+#include <bustache/render/string.hpp>
+#include <zlib.h>
+
 #include <algorithm>
 
 namespace tgfuse {
 
+namespace {
+
+// Bound on remembered sender names; the table is simply dropped when it fills up
+constexpr std::size_t kMaxSenderNames = 16384;
+
+// Favour speed: the cold tier is about re-serving without reformatting, not maximum density
+constexpr int kColdCompressionLevel = Z_BEST_SPEED;
+
+std::optional<std::string> compress_text(std::string_view text) {
+    uLongf size = compressBound(static_cast<uLong>(text.size()));
+    std::string compressed(size, '\0');
+    int rc = compress2(
+        reinterpret_cast<Bytef*>(compressed.data()),
+        &size,
+        reinterpret_cast<const Bytef*>(text.data()),
+        static_cast<uLong>(text.size()),
+        kColdCompressionLevel
+    );
+    if (rc != Z_OK) {
+        return std::nullopt;
+    }
+    compressed.resize(size);
+    compressed.shrink_to_fit();
+    return compressed;
+}
+
+std::optional<std::string> decompress_text(const std::string& compressed, std::size_t raw_size) {
+    std::string text(raw_size, '\0');
+    uLongf size = static_cast<uLongf>(raw_size);
+    int rc = uncompress(
+        reinterpret_cast<Bytef*>(text.data()),
+        &size,
+        reinterpret_cast<const Bytef*>(compressed.data()),
+        static_cast<uLong>(compressed.size())
+    );
+    if (rc != Z_OK || size != raw_size) {
+        return std::nullopt;
+    }
+    return text;
+}
+
+}  // namespace
+
 FormattedMessagesCache::FormattedMessagesCache(Config config)
-    : config_(std::move(config)), message_template_(config_.message_format) {}
+    : config_(std::move(config)),
+      message_template_(config_.message_format),
+      fast_template_(tg::MessageTemplate::compile(config_.message_format)) {
+    if (!fast_template_) {
+        spdlog::info("FormattedMessagesCache: message format needs full mustache rendering (slower)");
+    }
+}
 
-std::optional<std::string_view> FormattedMessagesCache::get(int64_t chat_id) {
+std::optional<SharedText> FormattedMessagesCache::get(int64_t chat_id) {
     std::lock_guard<std::mutex> lock(mutex_);
 
+    CacheEntry* entry = nullptr;
     auto it = cache_.find(chat_id);
-    if (it == cache_.end()) {
+    if (it != cache_.end()) {
+        // Check TTL - if stale, return nullopt (caller should reformat)
+        if (expired(it->second.second.formatted_at)) {
+            ++miss_count_;
+            spdlog::debug("FormattedMessagesCache: TTL expired for chat {}", chat_id);
+            return std::nullopt;
+        }
+        ++hit_count_;
+        touch(chat_id);
+        entry = &it->second.second;
+    } else if ((entry = promote(chat_id))) {
+        ++cold_hit_count_;
+    } else {
         ++miss_count_;
         return std::nullopt;
     }
 
-    // Check TTL - if stale, return nullopt (caller should reformat)
-    auto now = std::chrono::steady_clock::now();
-    if ((now - it->second.second.formatted_at) > config_.format_ttl) {
-        ++miss_count_;
-        spdlog::debug("FormattedMessagesCache: TTL expired for chat {}", chat_id);
-        return std::nullopt;
-    }
+    trim_expired(*entry);
+    reweigh(*entry);
+    auto content = entry->share();
 
-    ++hit_count_;
-    touch(chat_id);
-    return std::string_view(it->second.second.content);
+    // Reweighing can leave the tier over budget (e.g. a promoted entry); this may demote the entry itself
+    evict_if_needed(0, 0);
+    return content;
 }
 
 std::size_t FormattedMessagesCache::get_content_size(int64_t chat_id) const {
     std::lock_guard<std::mutex> lock(mutex_);
 
     auto it = cache_.find(chat_id);
-    if (it == cache_.end()) {
-        return 0;
+    if (it != cache_.end()) {
+        return it->second.second.view().size();
+    }
+    auto cold_it = cold_.find(chat_id);
+    if (cold_it != cold_.end()) {
+        return cold_it->second.second.raw_size;
     }
-    return it->second.second.content.size();
+    return 0;
 }
 
 bool FormattedMessagesCache::contains(int64_t chat_id) const {
     std::lock_guard<std::mutex> lock(mutex_);
-    return cache_.find(chat_id) != cache_.end();
+    return cache_.find(chat_id) != cache_.end() || cold_.find(chat_id) != cold_.end();
 }
 
 bool FormattedMessagesCache::is_stale(int64_t chat_id) const {
     std::lock_guard<std::mutex> lock(mutex_);
 
     auto it = cache_.find(chat_id);
-    if (it == cache_.end()) {
-        return true;  // Not cached = stale
+    if (it != cache_.end()) {
+        return expired(it->second.second.formatted_at);
     }
-
-    auto now = std::chrono::steady_clock::now();
-    return (now - it->second.second.formatted_at) > config_.format_ttl;
+    auto cold_it = cold_.find(chat_id);
+    if (cold_it != cold_.end()) {
+        return expired(cold_it->second.second.formatted_at);
+    }
+    return true;  // Not cached = stale
 }
 
-void FormattedMessagesCache::store(
+SharedText FormattedMessagesCache::store(
     int64_t chat_id,
-    std::string content,
-    std::size_t message_count,
-    int64_t newest_message_id
+    std::span<const tg::MessageView> messages,
+    const UserResolver& user_resolver,
+    const ChatResolver& chat_resolver
 ) {
+    // Render outside the lock
+    CacheEntry entry;
+    entry.content = std::make_shared<std::string>();
+    format_messages(messages, user_resolver, chat_resolver, *entry.content, entry.index, 0);
+    entry.newest_message_id = messages.empty() ? 0 : messages.back().id;
+    entry.formatted_at = std::chrono::steady_clock::now();
+    auto content = entry.share();
+
     std::lock_guard<std::mutex> lock(mutex_);
-    evict_if_needed();
 
     // Remove old entry if exists
     auto it = cache_.find(chat_id);
     if (it != cache_.end()) {
+        hot_bytes_ -= it->second.second.weight;
         lru_list_.erase(it->second.first);
         cache_.erase(it);
     }
+    erase_cold(chat_id);
 
-    // Create new entry
-    CacheEntry entry;
-    entry.content = std::move(content);
-    entry.message_count = message_count;
-    entry.newest_message_id = newest_message_id;
-    entry.formatted_at = std::chrono::steady_clock::now();
+    spdlog::debug(
+        "FormattedMessagesCache: stored chat {} with {} messages, {} bytes",
+        chat_id,
+        entry.index.size(),
+        entry.content->size()
+    );
 
-    // Add to LRU
-    lru_list_.push_front(chat_id);
-    cache_[chat_id] = {lru_list_.begin(), std::move(entry)};
+    insert_hot(chat_id, std::move(entry));
+    return content;
+}
+
+bool FormattedMessagesCache::append(
+    int64_t chat_id,
+    std::span<const tg::MessageView> messages,
+    const UserResolver& user_resolver,
+    const ChatResolver& chat_resolver
+) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // A compressed copy can't be appended to; drop it so it isn't served without the new messages
+    erase_cold(chat_id);
+
+    auto it = cache_.find(chat_id);
+    if (it == cache_.end()) {
+        return false;
+    }
+    auto& entry = it->second.second;
+
+    // Only messages newer than the cached ones can be appended; redelivered ones are skipped
+    std::vector<tg::MessageView> fresh;
+    for (const auto& msg : messages) {
+        if (msg.id == entry.newest_message_id) {
+            continue;
+        }
+        if (msg.id < entry.newest_message_id) {
+            spdlog::debug("FormattedMessagesCache: out-of-order message {} for chat {}", msg.id, chat_id);
+            hot_bytes_ -= entry.weight;
+            lru_list_.erase(it->second.first);
+            cache_.erase(it);
+            return false;
+        }
+        fresh.push_back(msg);
+    }
+    if (fresh.empty()) {
+        return true;
+    }
+
+    // One message at a time in practice, so rendering under the lock is cheap
+    std::string text;
+    std::deque<MessageExtent> extents;
+    format_messages(fresh, user_resolver, chat_resolver, text, extents, 0);
+    append_text(entry, text, extents);
+    entry.newest_message_id = fresh.back().id;
+    trim_expired(entry);
+    reweigh(entry);
 
     spdlog::debug(
-        "FormattedMessagesCache: stored chat {} with {} messages, {} bytes",
+        "FormattedMessagesCache: appended {} messages to chat {}, {} bytes",
+        fresh.size(),
         chat_id,
-        message_count,
-        cache_[chat_id].second.content.size()
+        entry.view().size()
     );
+
+    // The entry grew: stay within the byte budget (this may demote the entry itself)
+    evict_if_needed(0, 0);
+    return true;
 }
 
 void FormattedMessagesCache::invalidate(int64_t chat_id) {
@@ -98,16 +225,32 @@ void FormattedMessagesCache::invalidate(int64_t chat_id) {
 
     auto it = cache_.find(chat_id);
     if (it != cache_.end()) {
+        hot_bytes_ -= it->second.second.weight;
         lru_list_.erase(it->second.first);
         cache_.erase(it);
         spdlog::debug("FormattedMessagesCache: invalidated chat {}", chat_id);
     }
+    erase_cold(chat_id);
+}
+
+void FormattedMessagesCache::invalidate_sender(int64_t user_id) {
+    std::lock_guard<std::mutex> lock(sender_names_mutex_);
+    sender_names_.erase(user_id);
 }
 
 void FormattedMessagesCache::clear() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    lru_list_.clear();
-    cache_.clear();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lru_list_.clear();
+        cache_.clear();
+        hot_bytes_ = 0;
+        cold_lru_list_.clear();
+        cold_.clear();
+        cold_bytes_ = 0;
+        cold_raw_bytes_ = 0;
+    }
+    std::lock_guard<std::mutex> lock(sender_names_mutex_);
+    sender_names_.clear();
 }
 
 FormattedMessagesCache::Stats FormattedMessagesCache::get_stats() const {
@@ -117,13 +260,270 @@ FormattedMessagesCache::Stats FormattedMessagesCache::get_stats() const {
     stats.chat_count = cache_.size();
     stats.total_content_size = 0;
     for (const auto& [id, pair] : cache_) {
-        stats.total_content_size += pair.second.content.size();
+        stats.total_content_size += pair.second.view().size();
     }
+    stats.hot_bytes = hot_bytes_;
+    stats.cold_chat_count = cold_.size();
+    stats.cold_bytes = cold_bytes_;
+    stats.cold_raw_bytes = cold_raw_bytes_;
+    stats.compression_ratio =
+        cold_bytes_ > 0 ? static_cast<double>(cold_raw_bytes_) / static_cast<double>(cold_bytes_) : 0.0;
     stats.hit_count = hit_count_;
+    stats.cold_hit_count = cold_hit_count_;
     stats.miss_count = miss_count_;
     return stats;
 }
 
+std::string FormattedMessagesCache::render(
+    std::span<const tg::MessageView> messages,
+    const UserResolver& user_resolver,
+    const ChatResolver& chat_resolver
+) const {
+    std::string text;
+    std::deque<MessageExtent> index;
+    format_messages(messages, user_resolver, chat_resolver, text, index, 0);
+    return text;
+}
+
+void FormattedMessagesCache::format_messages(
+    std::span<const tg::MessageView> messages,
+    const UserResolver& user_resolver,
+    const ChatResolver& chat_resolver,
+    std::string& text,
+    std::deque<MessageExtent>& index,
+    std::size_t base
+) const {
+    if (fast_template_) {
+        std::size_t estimate = 0;
+        for (const auto& msg : messages) {
+            estimate += fast_template_->estimate_size(msg) + 1;
+        }
+        text.reserve(text.size() + estimate);
+    }
+
+    // Per-pass sender table: each distinct sender is resolved (and its name rendered) once
+    struct Sender {
+        const tg::User* user;
+        std::string name;
+    };
+    std::unordered_map<int64_t, Sender> senders;
+    std::deque<tg::User> unknown_users;  // Placeholders for senders the resolver doesn't know
+    const tg::Chat* chat = nullptr;
+    int64_t chat_id = 0;
+
+    for (const auto& msg : messages) {
+        auto [sender, inserted] = senders.try_emplace(msg.sender_id);
+        if (inserted) {
+            const auto* user = user_resolver(msg.sender_id);
+            bool known = user != nullptr;
+            if (!known) {
+                auto& unknown = unknown_users.emplace_back();
+                unknown.id = msg.sender_id;
+                unknown.first_name = "User";
+                unknown.last_name = std::to_string(msg.sender_id);
+                user = &unknown;
+            }
+            sender->second.user = user;
+            if (fast_template_) {
+                // A placeholder name isn't remembered: the sender may be known by the next pass
+                sender->second.name = known ? sender_name(*user) : tg::MessageTemplate::sender_name(*user);
+            }
+        }
+        // A pass is for one chat in practice; resolve again only if it changes
+        if (!chat || msg.chat_id != chat_id) {
+            chat = &chat_resolver(msg.chat_id);
+            chat_id = msg.chat_id;
+        }
+
+        tg::MessageInfo info{msg, *sender->second.user, *chat};
+        if (fast_template_) {
+            fast_template_->render_to(text, info, sender->second.name);
+        } else {
+            text += bustache::to_string(message_template_(info));
+        }
+        text += '\n';
+        index.push_back({msg.id, msg.timestamp, base + text.size()});
+    }
+}
+
+std::string FormattedMessagesCache::sender_name(const tg::User& user) const {
+    std::lock_guard<std::mutex> lock(sender_names_mutex_);
+    auto it = sender_names_.find(user.id);
+    if (it != sender_names_.end()) {
+        return it->second;
+    }
+    if (sender_names_.size() >= kMaxSenderNames) {
+        sender_names_.clear();
+    }
+    return sender_names_.emplace(user.id, tg::MessageTemplate::sender_name(user)).first->second;
+}
+
+void FormattedMessagesCache::append_text(CacheEntry& entry, std::string_view text, std::deque<MessageExtent>& extents) {
+    auto& buffer = *entry.content;
+    if (buffer.size() + text.size() <= buffer.capacity()) {
+        // Fits without reallocating: bytes handed out so far stay where they are
+        for (auto& extent : extents) {
+            extent.end += buffer.size();
+        }
+        buffer.append(text);
+    } else {
+        // Move the live part to a new buffer with room to grow; readers keep the old one
+        auto live = entry.view();
+        auto next = std::make_shared<std::string>();
+        next->reserve(2 * (live.size() + text.size()));
+        next->append(live);
+        next->append(text);
+
+        for (auto& extent : entry.index) {
+            extent.end -= entry.head;
+        }
+        for (auto& extent : extents) {
+            extent.end += live.size();
+        }
+        entry.content = std::move(next);
+        entry.head = 0;
+    }
+    entry.index.insert(entry.index.end(), extents.begin(), extents.end());
+}
+
+void FormattedMessagesCache::trim_expired(CacheEntry& entry) const {
+    // Caller must hold mutex_ (or own the entry)
+    auto cutoff = std::chrono::system_clock::now() - config_.max_history_age;
+    auto cutoff_ts = std::chrono::duration_cast<std::chrono::seconds>(cutoff.time_since_epoch()).count();
+
+    while (entry.index.size() > config_.min_messages && entry.index.front().timestamp < cutoff_ts) {
+        entry.head = entry.index.front().end;
+        entry.index.pop_front();
+    }
+
+    // Compact once the dead prefix dominates, so trimming stays amortised O(1)
+    // (only when no reader holds the buffer; otherwise the next reallocation drops it)
+    if (entry.head > 0 && entry.head >= entry.content->size() / 2 && entry.content.use_count() == 1) {
+        entry.content->erase(0, entry.head);
+        for (auto& extent : entry.index) {
+            extent.end -= entry.head;
+        }
+        entry.head = 0;
+    }
+}
+
+std::size_t FormattedMessagesCache::weight_of(const CacheEntry& entry) {
+    return entry.content->capacity() + entry.index.size() * sizeof(MessageExtent);
+}
+
+void FormattedMessagesCache::reweigh(CacheEntry& entry) {
+    // Caller must hold mutex_; entry must be in the hot tier
+    hot_bytes_ -= entry.weight;
+    entry.weight = weight_of(entry);
+    hot_bytes_ += entry.weight;
+}
+
+bool FormattedMessagesCache::expired(std::chrono::steady_clock::time_point formatted_at) const {
+    return (std::chrono::steady_clock::now() - formatted_at) > config_.format_ttl;
+}
+
+FormattedMessagesCache::CacheEntry* FormattedMessagesCache::insert_hot(int64_t chat_id, CacheEntry entry) {
+    // Caller must hold mutex_; chat_id must not be in the hot tier
+    entry.weight = weight_of(entry);
+    if (entry.weight > config_.max_bytes) {
+        spdlog::debug(
+            "FormattedMessagesCache: chat {} ({} bytes) exceeds the {} byte budget, not cached",
+            chat_id,
+            entry.weight,
+            config_.max_bytes
+        );
+        return nullptr;
+    }
+
+    evict_if_needed(1, entry.weight);
+
+    hot_bytes_ += entry.weight;
+    lru_list_.push_front(chat_id);
+    auto& slot = cache_[chat_id];
+    slot = {lru_list_.begin(), std::move(entry)};
+    return &slot.second;
+}
+
+void FormattedMessagesCache::demote(int64_t chat_id, CacheEntry entry) {
+    // Caller must hold mutex_
+    if (config_.cold_max_bytes == 0 || expired(entry.formatted_at)) {
+        return;
+    }
+
+    auto live = entry.view();
+    auto compressed = compress_text(live);
+    if (!compressed || compressed->size() > config_.cold_max_bytes) {
+        return;
+    }
+
+    ColdEntry cold;
+    cold.compressed = std::move(*compressed);
+    cold.raw_size = live.size();
+    cold.index = std::move(entry.index);
+    for (auto& extent : cold.index) {
+        extent.end -= entry.head;
+    }
+    cold.newest_message_id = entry.newest_message_id;
+    cold.formatted_at = entry.formatted_at;
+
+    erase_cold(chat_id);
+    while (!cold_lru_list_.empty() && cold_bytes_ + cold.compressed.size() > config_.cold_max_bytes) {
+        erase_cold(cold_lru_list_.back());
+    }
+
+    spdlog::debug(
+        "FormattedMessagesCache: demoted chat {} to cold tier, {} -> {} bytes",
+        chat_id,
+        cold.raw_size,
+        cold.compressed.size()
+    );
+
+    cold_bytes_ += cold.compressed.size();
+    cold_raw_bytes_ += cold.raw_size;
+    cold_lru_list_.push_front(chat_id);
+    cold_[chat_id] = {cold_lru_list_.begin(), std::move(cold)};
+}
+
+FormattedMessagesCache::CacheEntry* FormattedMessagesCache::promote(int64_t chat_id) {
+    // Caller must hold mutex_
+    auto it = cold_.find(chat_id);
+    if (it == cold_.end()) {
+        return nullptr;
+    }
+
+    auto& cold = it->second.second;
+    std::optional<std::string> content;
+    if (!expired(cold.formatted_at)) {
+        content = decompress_text(cold.compressed, cold.raw_size);
+    }
+    if (!content) {
+        erase_cold(chat_id);
+        return nullptr;
+    }
+
+    CacheEntry entry;
+    entry.content = std::make_shared<std::string>(std::move(*content));
+    entry.index = std::move(cold.index);
+    entry.newest_message_id = cold.newest_message_id;
+    entry.formatted_at = cold.formatted_at;
+    erase_cold(chat_id);
+
+    spdlog::debug("FormattedMessagesCache: promoted chat {} from cold tier", chat_id);
+    return insert_hot(chat_id, std::move(entry));
+}
+
+void FormattedMessagesCache::erase_cold(int64_t chat_id) {
+    // Caller must hold mutex_
+    auto it = cold_.find(chat_id);
+    if (it == cold_.end()) {
+        return;
+    }
+    cold_bytes_ -= it->second.second.compressed.size();
+    cold_raw_bytes_ -= it->second.second.raw_size;
+    cold_lru_list_.erase(it->second.first);
+    cold_.erase(it);
+}
+
 void FormattedMessagesCache::touch(int64_t chat_id) {
     // Caller must hold mutex_
     auto it = cache_.find(chat_id);
@@ -134,13 +534,17 @@ void FormattedMessagesCache::touch(int64_t chat_id) {
     }
 }
 
-void FormattedMessagesCache::evict_if_needed() {
+void FormattedMessagesCache::evict_if_needed(std::size_t chats, std::size_t bytes) {
     // Caller must hold mutex_
-    while (cache_.size() >= config_.max_chats && !lru_list_.empty()) {
+    while (!lru_list_.empty() &&
+           (cache_.size() + chats > config_.max_chats || hot_bytes_ + bytes > config_.max_bytes)) {
         int64_t victim = lru_list_.back();
         lru_list_.pop_back();
-        cache_.erase(victim);
+
+        auto node = cache_.extract(victim);
+        hot_bytes_ -= node.mapped().second.weight;
         spdlog::debug("FormattedMessagesCache: evicted chat {}", victim);
+        demote(victim, std::move(node.mapped().second));
     }
 }
 
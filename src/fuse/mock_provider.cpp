@@ -1,11 +1,55 @@
 #include "fuse/mock_provider.hpp"
 
 #include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <random>
 #include <sstream>
+#include <thread>
 
 namespace tgfuse {
 
-MockDataProvider::MockDataProvider() { populate_default_data(); }
+namespace {
+
+constexpr const char* kMessageTexts[] = {
+    "Hi!",
+    "Are we still on for tomorrow?",
+    "Sure, see you at ten",
+    "Here is the report I mentioned, let me know if anything is missing",
+    "Thanks",
+    "Has anyone tried the new build? It seems a lot faster on my machine, especially when listing large chats",
+    "Lunch?",
+    "I will be a few minutes late",
+};
+
+/// Name with a zero-padded number (user0001)
+std::string numbered(const char* prefix, std::size_t number) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%s%04zu", prefix, number);
+    return name;
+}
+
+/// One formatted message line, in the real provider's default format
+std::string format_message(std::string_view sender, int minutes, std::string_view text) {
+    char time[8];
+    std::snprintf(time, sizeof(time), "%02d:%02d", minutes / 60 % 24, minutes % 60);
+    std::string line = "> **";
+    line.append(sender).append("** [").append(time).append("]: ").append(text).append("\n");
+    return line;
+}
+
+}  // namespace
+
+MockDataProvider::MockDataProvider(Config config) : config_(config) {
+    if (config_.users == 0 && config_.groups == 0 && config_.channels == 0) {
+        populate_default_data();
+    } else {
+        populate_generated_data();
+    }
+    populate_messages();
+}
 
 void MockDataProvider::populate_default_data() {
     // Add default mock users
@@ -64,19 +108,106 @@ void MockDataProvider::populate_default_data() {
     };
 }
 
+void MockDataProvider::populate_generated_data() {
+    for (std::size_t i = 1; i <= config_.users; ++i) {
+        auto name = numbered("user", i);
+        users_[name] = MockUser{
+            .username = name,
+            .display_name = "Mock User " + std::to_string(i),
+            .user_id = static_cast<std::int64_t>(100000000 + i),
+            .status = i % 3 == 0 ? "Offline" : "Online",
+            .last_seen = "Recently"
+        };
+    }
+    for (std::size_t i = 1; i <= config_.groups; ++i) {
+        auto name = numbered("group", i);
+        groups_[name] = MockGroup{
+            .name = name,
+            .title = "Mock Group " + std::to_string(i),
+            .group_id = -static_cast<std::int64_t>(1001000000000 + i),
+            .member_count = static_cast<int>(2 + i % 50),
+            .description = "Generated group"
+        };
+    }
+    for (std::size_t i = 1; i <= config_.channels; ++i) {
+        auto name = numbered("channel", i);
+        channels_[name] = MockChannel{
+            .name = name,
+            .title = "Mock Channel " + std::to_string(i),
+            .channel_id = -static_cast<std::int64_t>(1009000000000 + i),
+            .subscriber_count = static_cast<int>(100 * i),
+            .description = "Generated channel"
+        };
+    }
+}
+
+void MockDataProvider::populate_messages() {
+    constexpr std::size_t kTexts = std::size(kMessageTexts);
+    auto add_chat = [this](const std::string& key, const std::string& other, std::size_t seed) {
+        std::string text;
+        for (std::size_t i = 0; i < config_.messages_per_chat; ++i) {
+            auto sender = (i + seed) % 2 == 0 ? std::string_view("You") : std::string_view(other);
+            text += format_message(sender, static_cast<int>(i * 7 + seed), kMessageTexts[(i * 3 + seed) % kTexts]);
+        }
+        messages_[key] = std::move(text);
+    };
+
+    std::size_t seed = 0;
+    for (const auto& [name, user] : users_) {
+        add_chat("users/" + name, user.display_name, seed++);
+    }
+    for (const auto& [name, group] : groups_) {
+        add_chat("groups/" + name, "Member " + std::to_string(group.member_count), seed++);
+    }
+    for (const auto& [name, channel] : channels_) {
+        add_chat("channels/" + name, channel.title, seed++);
+    }
+}
+
+void MockDataProvider::simulate_latency() const {
+    if (config_.latency.count() <= 0 && config_.jitter.count() <= 0) {
+        return;
+    }
+
+    auto delay = config_.latency;
+    if (config_.jitter.count() > 0) {
+        thread_local std::minstd_rand random(
+            static_cast<std::minstd_rand::result_type>(std::hash<std::thread::id>{}(std::this_thread::get_id()))
+        );
+        std::uniform_int_distribution<std::int64_t> spread(-config_.jitter.count(), config_.jitter.count());
+        delay += std::chrono::microseconds(spread(random));
+    }
+    if (delay.count() > 0) {
+        std::this_thread::sleep_for(delay);
+    }
+}
+
+std::vector<Entry> MockDataProvider::list_chat_files(const std::string& chat_key) const {
+    std::vector<Entry> entries;
+    auto it = messages_.find(chat_key);
+    if (it != messages_.end()) {
+        entries.push_back(Entry::file("messages", it->second.size()));
+        entries.push_back(Entry::file("txt", 0, 0600));
+    }
+    return entries;
+}
+
 void MockDataProvider::add_user(const MockUser& user) {
     std::lock_guard<std::mutex> lock(mutex_);
     users_[user.username] = user;
+    messages_.try_emplace("users/" + user.username);
 }
 
 void MockDataProvider::add_group(const MockGroup& group) {
     std::lock_guard<std::mutex> lock(mutex_);
     groups_[group.name] = group;
+    messages_.try_emplace("groups/" + group.name);
 }
 
 void MockDataProvider::add_channel(const MockChannel& channel) {
     std::lock_guard<std::mutex> lock(mutex_);
     channels_[channel.name] = channel;
+    messages_.try_emplace("channels/" + channel.name);
 }
 
 void MockDataProvider::clear_all() {
@@ -84,6 +215,7 @@ void MockDataProvider::clear_all() {
     users_.clear();
     groups_.clear();
     channels_.clear();
+    messages_.clear();
 }
 
 MockDataProvider::PathInfo MockDataProvider::parse_path(std::string_view path) const {
@@ -128,6 +260,15 @@ MockDataProvider::PathInfo MockDataProvider::parse_path(std::string_view path) c
         return info;
     }
 
+    // messages and txt inside a chat directory (whether the chat exists is up to the caller)
+    if (components.size() == 3 && (components[2] == "messages" || components[2] == "txt") &&
+        (components[0] == "users" || components[0] == "groups" || components[0] == "channels")) {
+        info.category = components[2] == "messages" ? PathCategory::CHAT_MESSAGES : PathCategory::CHAT_TXT;
+        info.entity_name = components[1];
+        info.chat_key = components[0] + "/" + components[1];
+        return info;
+    }
+
     // Check for top-level directories
     if (components[0] == "users") {
         if (components.size() == 1) {
@@ -165,11 +306,14 @@ MockDataProvider::PathInfo MockDataProvider::parse_path(std::string_view path) c
 }
 
 std::vector<Entry> MockDataProvider::list_directory(std::string_view path) {
+    auto info = parse_path(path);
+    if (info.category != PathCategory::ROOT) {
+        simulate_latency();  // Chat lists and chat contents come from the backend
+    }
+
     std::lock_guard<std::mutex> lock(mutex_);
     std::vector<Entry> entries;
 
-    auto info = parse_path(path);
-
     switch (info.category) {
         case PathCategory::ROOT:
             // Top-level directories
@@ -204,6 +348,9 @@ std::vector<Entry> MockDataProvider::list_directory(std::string_view path) {
             if (users_.count(info.entity_name)) {
                 auto content = generate_user_info(users_.at(info.entity_name));
                 entries.push_back(Entry::file(".info", content.size()));
+                for (auto& entry : list_chat_files("users/" + info.entity_name)) {
+                    entries.push_back(std::move(entry));
+                }
             }
             break;
 
@@ -211,6 +358,9 @@ std::vector<Entry> MockDataProvider::list_directory(std::string_view path) {
             if (groups_.count(info.entity_name)) {
                 auto content = generate_group_info(groups_.at(info.entity_name));
                 entries.push_back(Entry::file(".info", content.size()));
+                for (auto& entry : list_chat_files("groups/" + info.entity_name)) {
+                    entries.push_back(std::move(entry));
+                }
             }
             break;
 
@@ -218,6 +368,9 @@ std::vector<Entry> MockDataProvider::list_directory(std::string_view path) {
             if (channels_.count(info.entity_name)) {
                 auto content = generate_channel_info(channels_.at(info.entity_name));
                 entries.push_back(Entry::file(".info", content.size()));
+                for (auto& entry : list_chat_files("channels/" + info.entity_name)) {
+                    entries.push_back(std::move(entry));
+                }
             }
             break;
 
@@ -290,6 +443,15 @@ std::optional<Entry> MockDataProvider::get_entry(std::string_view path) {
             }
             break;
 
+        case PathCategory::CHAT_MESSAGES:
+        case PathCategory::CHAT_TXT:
+            for (auto& entry : list_chat_files(info.chat_key)) {
+                if (entry.name == (info.category == PathCategory::CHAT_TXT ? "txt" : "messages")) {
+                    return entry;
+                }
+            }
+            break;
+
         default:
             break;
     }
@@ -310,9 +472,10 @@ bool MockDataProvider::is_symlink(std::string_view path) {
 }
 
 FileContent MockDataProvider::read_file(std::string_view path) {
-    std::lock_guard<std::mutex> lock(mutex_);
     auto info = parse_path(path);
+    simulate_latency();
 
+    std::lock_guard<std::mutex> lock(mutex_);
     FileContent content;
     content.readable = false;
 
@@ -338,6 +501,17 @@ FileContent MockDataProvider::read_file(std::string_view path) {
             }
             break;
 
+        case PathCategory::CHAT_MESSAGES:
+            if (auto it = messages_.find(info.chat_key); it != messages_.end()) {
+                content.data = it->second;
+                content.readable = true;
+            }
+            break;
+
+        case PathCategory::CHAT_TXT:
+            content.readable = messages_.count(info.chat_key) > 0;  // Always reads empty
+            break;
+
         default:
             break;
     }
@@ -356,6 +530,49 @@ std::string MockDataProvider::read_link(std::string_view path) {
     return "";
 }
 
+WriteResult MockDataProvider::write_file(std::string_view path, const char* data, std::size_t size, off_t offset) {
+    (void)offset;  // Append-only
+
+    auto info = parse_path(path);
+    if (info.category != PathCategory::CHAT_TXT) {
+        return WriteResult{false, 0, "Write not supported"};
+    }
+
+    simulate_latency();  // Sending the message
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = messages_.find(info.chat_key);
+    if (it == messages_.end()) {
+        return WriteResult{false, 0, "Chat not found"};
+    }
+
+    std::string_view text(data, size);
+    while (!text.empty() && text.back() == '\n') {
+        text.remove_suffix(1);
+    }
+    if (!text.empty()) {
+        auto now = std::time(nullptr);
+        std::tm local{};
+        localtime_r(&now, &local);
+        it->second += format_message("You", local.tm_hour * 60 + local.tm_min, text);
+    }
+    return WriteResult{true, static_cast<int>(size), {}};
+}
+
+int MockDataProvider::truncate_file(std::string_view path, off_t size) {
+    (void)size;
+    // Shells truncate txt before writing to it; there is nothing buffered to drop
+    return parse_path(path).category == PathCategory::CHAT_TXT ? 0 : -EACCES;
+}
+
+bool MockDataProvider::is_writable(std::string_view path) const {
+    return parse_path(path).category == PathCategory::CHAT_TXT;
+}
+
+bool MockDataProvider::is_append_only(std::string_view path) const {
+    return parse_path(path).category == PathCategory::CHAT_TXT;
+}
+
 std::string MockDataProvider::generate_user_info(const MockUser& user) const {
     std::ostringstream oss;
     oss << "Username: " << user.username << "\n";
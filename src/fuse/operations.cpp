@@ -1,5 +1,9 @@
 #include "fuse/operations.hpp"
 
+#include "tg/trace.hpp"
+
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
 #include <unistd.h>
 #include <algorithm>
 #include <cerrno>
@@ -11,74 +15,144 @@ namespace {
 // Cache the effective uid/gid at startup
 const uid_t effective_uid = geteuid();
 const gid_t effective_gid = getegid();
-}  // namespace
 
-DataProviderOperations::DataProviderOperations(std::shared_ptr<DataProvider> provider)
-    : provider_(std::move(provider)) {}
+// Histogram timing one kind of FUSE callback
+tg::LatencyHistogram& op_latency(const char* op) {
+    return tg::Metrics::global().histogram({"fuse_op_seconds", "op", op});
+}
 
-int DataProviderOperations::getattr(const char* path, struct stat* stbuf) {
-    std::memset(stbuf, 0, sizeof(struct stat));
+// Times one FUSE callback and, while tracing, records it as the root span of a new request
+class OpScope {
+public:
+    OpScope(tg::LatencyHistogram& latency, const char* op) : timer_(&latency), span_("fuse", op) {}
 
-    auto entry = provider_->get_entry(path);
-    if (!entry) {
-        return -ENOENT;
-    }
+private:
+    tg::LatencyTimer timer_;
+    tg::TraceRequestScope request_;
+    tg::TraceSpan span_;
+};
 
-    if (entry->is_directory()) {
-        stbuf->st_mode = S_IFDIR | entry->mode;
+// Attributes of a provider entry, as getattr reports them
+void fill_stat(const Entry& entry, struct stat* stbuf) {
+    std::memset(stbuf, 0, sizeof(struct stat));
+    if (entry.is_directory()) {
+        stbuf->st_mode = S_IFDIR | entry.mode;
         stbuf->st_nlink = 2;
-    } else if (entry->is_symlink()) {
-        stbuf->st_mode = S_IFLNK | entry->mode;
+    } else if (entry.is_symlink()) {
+        stbuf->st_mode = S_IFLNK | entry.mode;
         stbuf->st_nlink = 1;
-        stbuf->st_size = static_cast<off_t>(entry->link_target.size());
+        stbuf->st_size = static_cast<off_t>(entry.link_target.size());
     } else {
-        stbuf->st_mode = S_IFREG | entry->mode;
+        stbuf->st_mode = S_IFREG | entry.mode;
         stbuf->st_nlink = 1;
-        stbuf->st_size = static_cast<off_t>(entry->size);
+        stbuf->st_size = static_cast<off_t>(entry.size);
     }
 
     stbuf->st_uid = effective_uid;
     stbuf->st_gid = effective_gid;
-    stbuf->st_atime = entry->atime;
-    stbuf->st_mtime = entry->mtime;
-    stbuf->st_ctime = entry->ctime;
+    stbuf->st_atime = entry.atime;
+    stbuf->st_mtime = entry.mtime;
+    stbuf->st_ctime = entry.ctime;
+}
+
+// Directory offsets: . and .. are followed by 1 and 2, listing entry i by i + 3
+constexpr off_t kFirstEntryOffset = 2;
+}  // namespace
+
+DataProviderOperations::DataProviderOperations(std::shared_ptr<DataProvider> provider)
+    : provider_(std::move(provider)),
+      getattr_latency_(op_latency("getattr")),
+      opendir_latency_(op_latency("opendir")),
+      readdir_latency_(op_latency("readdir")),
+      open_latency_(op_latency("open")),
+      read_latency_(op_latency("read")),
+      write_latency_(op_latency("write")),
+      release_latency_(op_latency("release")) {}
+
+int DataProviderOperations::getattr(const char* path, struct stat* stbuf) {
+    OpScope scope(getattr_latency_, "getattr");
 
+    auto entry = provider_->get_entry(path);
+    if (!entry) {
+        std::memset(stbuf, 0, sizeof(struct stat));
+        return -ENOENT;
+    }
+
+    fill_stat(*entry, stbuf);
     return 0;
 }
 
-int DataProviderOperations::readdir(const char* path, DirFiller filler, off_t offset) {
-    (void)offset;  // We don't use offset-based iteration
+int DataProviderOperations::opendir(const char* path, struct fuse_file_info* fi) {
+    OpScope scope(opendir_latency_, "opendir");
 
     if (!provider_->is_directory(path)) {
         return -ENOTDIR;
     }
 
-    // Add . and ..
-    filler(".", nullptr);
-    filler("..", nullptr);
-
-    // Get entries from provider
-    auto entries = provider_->list_directory(path);
-    for (const auto& entry : entries) {
-        struct stat st;
-        std::memset(&st, 0, sizeof(st));
-
-        if (entry.is_directory()) {
-            st.st_mode = S_IFDIR | entry.mode;
-        } else if (entry.is_symlink()) {
-            st.st_mode = S_IFLNK | entry.mode;
-        } else {
-            st.st_mode = S_IFREG | entry.mode;
-            st.st_size = static_cast<off_t>(entry.size);
-        }
-        st.st_uid = effective_uid;
-        st.st_gid = effective_gid;
+    // Listed once per handle: readdir calls page through the capture however many buffers it takes,
+    // and entries don't shift under a reader when the directory changes
+    auto listing = std::make_shared<DirListing>();
+    int rc = provider_->visit_directory(path, [&listing](const Entry& entry) {
+        auto& item = listing->items.emplace_back();
+        item.name = entry.name;
+        fill_stat(entry, &item.st);
+        return true;
+    });
+    if (rc != 0) {
+        return rc;
+    }
+    uint64_t fh = next_listing_id_++;
+
+    std::lock_guard<std::mutex> lock(listings_mutex_);
+    listings_.emplace(fh, std::move(listing));
+    fi->fh = fh;
+    return 0;
+}
 
-        if (filler(entry.name.c_str(), &st) != 0) {
-            break;  // Buffer full
+int DataProviderOperations::readdir(const char* path, DirFiller filler, off_t offset, struct fuse_file_info* fi) {
+    OpScope scope(readdir_latency_, "readdir");
+
+    auto listing = fi ? find_listing(fi->fh) : nullptr;
+    if (!listing && offset == 0 && !provider_->is_directory(path)) {
+        return -ENOTDIR;
+    }
+
+    // Every entry carries its offset, so a full buffer is resumed from the next entry
+    if (offset < 1 && filler(".", nullptr, 1) != 0) {
+        return 0;
+    }
+    if (offset < kFirstEntryOffset && filler("..", nullptr, kFirstEntryOffset) != 0) {
+        return 0;
+    }
+
+    auto next = std::max(offset, kFirstEntryOffset);
+    auto position = static_cast<std::size_t>(next - kFirstEntryOffset);
+    if (listing) {
+        for (auto i = position; i < listing->items.size(); ++i) {
+            const auto& item = listing->items[i];
+            if (filler(item.name.c_str(), &item.st, ++next) != 0) {
+                break;
+            }
         }
+        return 0;
     }
 
+    // No handle (the low-level backend captures its own listing): list afresh
+    struct stat st;
+    return provider_->visit_directory(path, [&](const Entry& entry) {
+        if (position > 0) {
+            --position;
+            return true;
+        }
+        fill_stat(entry, &st);
+        return filler(entry.name.c_str(), &st, ++next) == 0;
+    });
+}
+
+int DataProviderOperations::releasedir(const char* path, struct fuse_file_info* fi) {
+    (void)path;  // Unused
+    std::lock_guard<std::mutex> lock(listings_mutex_);
+    listings_.erase(fi->fh);
     return 0;
 }
 
@@ -101,6 +175,8 @@ int DataProviderOperations::readlink(const char* path, char* buf, size_t size) {
 }
 
 int DataProviderOperations::open(const char* path, struct fuse_file_info* fi) {
+    OpScope scope(open_latency_, "open");
+
     auto entry = provider_->get_entry(path);
 
     // For files that don't exist yet but we're opening for write+create,
@@ -127,20 +203,99 @@ int DataProviderOperations::open(const char* path, struct fuse_file_info* fi) {
         }
         // For append-only files, force O_APPEND behaviour
         // (the actual append semantics are handled in write_file)
+        return 0;
+    }
+
+    // Read-only regular file: materialise content once and pin it to the handle
+    if (entry->is_file()) {
+        auto content = provider_->read_file(path);
+        if (content.readable) {
+            // Read to EOF rather than to a size reported by an earlier getattr
+            fi->direct_io = content.direct_io ? 1 : 0;
+            auto snapshot = make_snapshot(std::move(content));
+            if (!snapshot) {
+                return -EIO;
+            }
+            uint64_t fh = kSnapshotHandleBit | next_snapshot_id_++;
+
+            std::lock_guard<std::mutex> lock(snapshots_mutex_);
+            snapshots_.emplace(fh, std::move(snapshot));
+            fi->fh = fh;
+        }
     }
 
     return 0;
 }
 
 int DataProviderOperations::read(const char* path, char* buf, size_t size, off_t offset, struct fuse_file_info* fi) {
-    (void)fi;  // Unused
+    OpScope scope(read_latency_, "read");
+
+    // Serve from the snapshot pinned at open() when available
+    auto snapshot = fi ? find_snapshot(fi->fh) : nullptr;
+    if (!snapshot) {
+        auto content = provider_->read_file(path);
+        if (!content.readable) {
+            return -ENOENT;
+        }
+        snapshot = make_snapshot(std::move(content));
+        if (!snapshot) {
+            return -EIO;
+        }
+    }
 
-    auto content = provider_->read_file(path);
-    if (!content.readable) {
-        return -ENOENT;
+    return read_snapshot(*snapshot, buf, size, offset);
+}
+
+int DataProviderOperations::release(const char* path, struct fuse_file_info* fi) {
+    OpScope scope(release_latency_, "release");
+
+    if (is_snapshot_handle(fi->fh)) {
+        {
+            std::lock_guard<std::mutex> lock(snapshots_mutex_);
+            snapshots_.erase(fi->fh);
+        }
+        // Snapshot handles are ours - the provider only sees a plain read-only release
+        return provider_->release_file(path, 0);
+    }
+    return provider_->release_file(path, fi->fh);
+}
+
+DataProviderOperations::OpenFile::~OpenFile() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+DataProviderOperations::ContentSnapshot DataProviderOperations::make_snapshot(FileContent content) {
+    if (!content.is_file_backed() || content.is_streamed()) {
+        return std::make_shared<const OpenFile>(std::move(content));
+    }
+
+    int fd = ::open(content.local_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        spdlog::error("Failed to open backing file {}: {}", content.local_path, std::strerror(errno));
+        return nullptr;
+    }
+    return std::make_shared<const OpenFile>(std::move(content), fd);
+}
+
+int DataProviderOperations::read_snapshot(const OpenFile& file, char* buf, size_t size, off_t offset) {
+    if (file.content.is_streamed()) {
+        return file.content.range_reader(buf, size, offset);
+    }
+
+    if (file.fd >= 0) {
+        // Serve directly from the local file - no heap copy of the content
+        ssize_t n;
+        do {
+            n = ::pread(file.fd, buf, size, offset);
+        } while (n < 0 && errno == EINTR);
+        return n < 0 ? -errno : static_cast<int>(n);
     }
 
-    size_t len = content.data.size();
+    // Shared (cached) content is read in place, like owned data
+    std::string_view data = file.content.is_shared() ? file.content.shared.view() : file.content.data;
+    size_t len = data.size();
     if (static_cast<size_t>(offset) >= len) {
         return 0;  // EOF
     }
@@ -148,12 +303,30 @@ int DataProviderOperations::read(const char* path, char* buf, size_t size, off_t
     size_t available = len - static_cast<size_t>(offset);
     size_t to_read = std::min(size, available);
 
-    std::memcpy(buf, content.data.c_str() + offset, to_read);
+    std::memcpy(buf, data.data() + offset, to_read);
     return static_cast<int>(to_read);
 }
 
-int DataProviderOperations::release(const char* path, struct fuse_file_info* fi) {
-    return provider_->release_file(path, fi->fh);
+DataProviderOperations::ContentSnapshot DataProviderOperations::find_snapshot(uint64_t fh) const {
+    if (!is_snapshot_handle(fh)) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(snapshots_mutex_);
+    auto it = snapshots_.find(fh);
+    if (it == snapshots_.end()) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+DataProviderOperations::ListingPtr DataProviderOperations::find_listing(uint64_t fh) const {
+    std::lock_guard<std::mutex> lock(listings_mutex_);
+    auto it = listings_.find(fh);
+    if (it == listings_.end()) {
+        return nullptr;
+    }
+    return it->second;
 }
 
 int DataProviderOperations::write(
@@ -163,6 +336,8 @@ int DataProviderOperations::write(
     off_t offset,
     struct fuse_file_info* fi
 ) {
+    OpScope scope(write_latency_, "write");
+
     // Check if this is a file upload with a valid file handle
     if (fi && fi->fh != 0) {
         auto result = provider_->write_file(path, buf, size, offset, fi->fh);
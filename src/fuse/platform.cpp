@@ -1,10 +1,21 @@
 #include "fuse/platform.hpp"
 
+#include <spdlog/spdlog.h>
+
+#include <atomic>
 #include <cerrno>
 #include <cstring>
 
 namespace tgfuse {
 
+namespace {
+// Running FUSE session, captured in init() for cache invalidation from other threads
+std::atomic<struct fuse*> current_session{nullptr};
+
+// Connection tuning for the next high-level session (set before fuse_main)
+ConnectionOptions connection_options;
+}  // namespace
+
 // Static member definition
 FuseOperations* PlatformAdapter::current_impl_ = nullptr;
 
@@ -12,11 +23,67 @@ void PlatformAdapter::set_implementation(FuseOperations* impl) { current_impl_ =
 
 FuseOperations* PlatformAdapter::get_implementation() { return current_impl_; }
 
+int PlatformAdapter::invalidate_path(const char* path) {
+#if TG_FUSE_VERSION == 3
+    auto* session = current_session.load();
+    if (!session) {
+        return 0;
+    }
+    return fuse_invalidate_path(session, path);
+#else
+    // FUSE 2.x has no path invalidation - macOS relies on the attr/entry timeouts
+    (void)path;
+    return -ENOSYS;
+#endif
+}
+
+void PlatformAdapter::set_connection_options(const ConnectionOptions& options) { connection_options = options; }
+
+void PlatformAdapter::apply_connection_options(struct fuse_conn_info* conn, const ConnectionOptions& options) {
+    if (options.max_write > 0) {
+        // libfuse clamps this to its receive buffer; larger writes mean fewer round trips per copy
+        conn->max_write = options.max_write;
+    }
+#if TG_FUSE_VERSION == 2
+#ifdef FUSE_CAP_BIG_WRITES
+    // Without big_writes FUSE 2.x splits every write into page-sized requests
+    if (conn->capable & FUSE_CAP_BIG_WRITES) {
+        conn->want |= FUSE_CAP_BIG_WRITES;
+    }
+#endif
+    if (options.writeback_cache) {
+        spdlog::warn("Writeback cache needs libfuse3, ignoring");
+    }
+#else
+    // Writes larger than a page are always allowed with libfuse3 (big_writes is implied)
+    if (options.writeback_cache) {
+        if (conn->capable & FUSE_CAP_WRITEBACK_CACHE) {
+            conn->want |= FUSE_CAP_WRITEBACK_CACHE;
+        } else {
+            spdlog::warn("Kernel doesn't support the FUSE writeback cache, ignoring");
+        }
+    }
+#endif
+    spdlog::debug("FUSE connection: max_write={} writeback_cache={}", conn->max_write, options.writeback_cache);
+}
+
+static void fuse_destroy_wrapper(void* private_data) {
+    (void)private_data;  // Unused
+    current_session.store(nullptr);
+}
+
 // Platform-specific callback wrappers
 
 #if TG_FUSE_VERSION == 2
 // macFUSE (FUSE 2.x) callbacks
 
+static void* fuse_init_wrapper(struct fuse_conn_info* conn) {
+    PlatformAdapter::apply_connection_options(conn, connection_options);
+    auto* context = fuse_get_context();
+    current_session.store(context->fuse);
+    return context->private_data;
+}
+
 static int fuse_getattr_wrapper(const char* path, struct stat* stbuf) {
     auto* impl = PlatformAdapter::get_implementation();
     if (!impl) {
@@ -25,20 +92,35 @@ static int fuse_getattr_wrapper(const char* path, struct stat* stbuf) {
     return impl->getattr(path, stbuf);
 }
 
+static int fuse_opendir_wrapper(const char* path, struct fuse_file_info* fi) {
+    auto* impl = PlatformAdapter::get_implementation();
+    if (!impl) {
+        return -ENOENT;
+    }
+    return impl->opendir(path, fi);
+}
+
 static int
 fuse_readdir_wrapper(const char* path, void* buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info* fi) {
-    (void)fi;  // Unused
     auto* impl = PlatformAdapter::get_implementation();
     if (!impl) {
         return -ENOENT;
     }
 
     // Wrap the filler function
-    auto dir_filler = [buf, filler](const char* name, const struct stat* stbuf) -> int {
-        return filler(buf, name, stbuf, 0);
+    auto dir_filler = [buf, filler](const char* name, const struct stat* stbuf, off_t next_offset) -> int {
+        return filler(buf, name, stbuf, next_offset);
     };
 
-    return impl->readdir(path, dir_filler, offset);
+    return impl->readdir(path, dir_filler, offset, fi);
+}
+
+static int fuse_releasedir_wrapper(const char* path, struct fuse_file_info* fi) {
+    auto* impl = PlatformAdapter::get_implementation();
+    if (!impl) {
+        return -ENOENT;
+    }
+    return impl->releasedir(path, fi);
 }
 
 static int fuse_readlink_wrapper(const char* path, char* buf, size_t size) {
@@ -179,6 +261,14 @@ static int fuse_fsetattr_x_wrapper(const char* path, struct setattr_x* attr, str
 #else
 // libfuse3 callbacks
 
+static void* fuse_init_wrapper(struct fuse_conn_info* conn, struct fuse_config* cfg) {
+    (void)cfg;  // Cache timeouts come from the mount options
+    PlatformAdapter::apply_connection_options(conn, connection_options);
+    auto* context = fuse_get_context();
+    current_session.store(context->fuse);
+    return context->private_data;
+}
+
 static int fuse_getattr_wrapper(const char* path, struct stat* stbuf, struct fuse_file_info* fi) {
     (void)fi;  // Unused
     auto* impl = PlatformAdapter::get_implementation();
@@ -188,6 +278,14 @@ static int fuse_getattr_wrapper(const char* path, struct stat* stbuf, struct fus
     return impl->getattr(path, stbuf);
 }
 
+static int fuse_opendir_wrapper(const char* path, struct fuse_file_info* fi) {
+    auto* impl = PlatformAdapter::get_implementation();
+    if (!impl) {
+        return -ENOENT;
+    }
+    return impl->opendir(path, fi);
+}
+
 static int fuse_readdir_wrapper(
     const char* path,
     void* buf,
@@ -196,19 +294,26 @@ static int fuse_readdir_wrapper(
     struct fuse_file_info* fi,
     enum fuse_readdir_flags flags
 ) {
-    (void)fi;     // Unused
-    (void)flags;  // Unused
     auto* impl = PlatformAdapter::get_implementation();
     if (!impl) {
         return -ENOENT;
     }
 
-    // Wrap the filler function
-    auto dir_filler = [buf, filler](const char* name, const struct stat* stbuf) -> int {
-        return filler(buf, name, stbuf, 0, static_cast<enum fuse_fill_dir_flags>(0));
+    // Wrap the filler function; with readdirplus the listed attributes spare the kernel a getattr per entry
+    auto fill_flags = (flags & FUSE_READDIR_PLUS) ? FUSE_FILL_DIR_PLUS : static_cast<enum fuse_fill_dir_flags>(0);
+    auto dir_filler = [buf, filler, fill_flags](const char* name, const struct stat* stbuf, off_t next_offset) -> int {
+        return filler(buf, name, stbuf, next_offset, stbuf ? fill_flags : static_cast<enum fuse_fill_dir_flags>(0));
     };
 
-    return impl->readdir(path, dir_filler, offset);
+    return impl->readdir(path, dir_filler, offset, fi);
+}
+
+static int fuse_releasedir_wrapper(const char* path, struct fuse_file_info* fi) {
+    auto* impl = PlatformAdapter::get_implementation();
+    if (!impl) {
+        return -ENOENT;
+    }
+    return impl->releasedir(path, fi);
 }
 
 static int fuse_readlink_wrapper(const char* path, char* buf, size_t size) {
@@ -327,8 +432,12 @@ struct fuse_operations PlatformAdapter::get_operations(FuseOperations& impl) {
     struct fuse_operations ops;
     std::memset(&ops, 0, sizeof(ops));
 
+    ops.init = fuse_init_wrapper;
+    ops.destroy = fuse_destroy_wrapper;
     ops.getattr = fuse_getattr_wrapper;
+    ops.opendir = fuse_opendir_wrapper;
     ops.readdir = fuse_readdir_wrapper;
+    ops.releasedir = fuse_releasedir_wrapper;
     ops.readlink = fuse_readlink_wrapper;
     ops.open = fuse_open_wrapper;
     ops.read = fuse_read_wrapper;
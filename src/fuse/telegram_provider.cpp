@@ -2,75 +2,331 @@
 
 #include "fuse/constants.hpp"
 #include "fuse/message_formatter.hpp"
-#include "tg/bustache_formatters.hpp"
 #include "tg/exceptions.hpp"
 #include "tg/formatters.hpp"
+#include "tg/metrics.hpp"
+#include "tg/text_scan.hpp"
+#include "tg/trace.hpp"
 
 #include <fmt/format.h>
 #include <fmt/ranges.h>
 #include <spdlog/spdlog.h>
-#include <bustache/render/string.hpp>
 
+#include <fcntl.h>
+#include <unistd.h>
 #include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
 #include <chrono>
+#include <cstring>
+#include <deque>
+#include <limits>
 #include <filesystem>
 #include <fstream>
 #include <set>
 #include <sstream>
 #include <thread>
+#include <unordered_map>
 
 namespace tgfuse {
 
-TelegramDataProvider::TelegramDataProvider(tg::TelegramClient& client)
+namespace {
+
+// Disk space reserved ahead of upload writes: at least this much, at most this far past the written end
+constexpr off_t kUploadPreallocateMin = 8 * 1024 * 1024;
+constexpr off_t kUploadPreallocateMax = 256 * 1024 * 1024;
+
+// How often a queued upload's transfer progress is refreshed
+constexpr auto kUploadProgressInterval = std::chrono::milliseconds(250);
+
+// How long a chat's file list is trusted before it is synced again (new files also arrive live)
+constexpr std::chrono::seconds kFileSyncInterval{60};
+
+// How many chats keep a file index in memory; the least recently used one is dropped beyond that
+constexpr std::size_t kMaxFileIndexes = 256;
+
+// Whether a sync row is younger than kFileSyncInterval (a sync would not be attempted yet)
+bool synced_recently(const std::optional<tg::FileListSync>& sync) {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return sync && std::chrono::duration_cast<std::chrono::seconds>(now).count() - sync->synced_at <
+                       kFileSyncInterval.count();
+}
+
+// Cache setting remembering the logged-in user, so a warm start can show self before TDLib is up
+constexpr const char* kCurrentUserSetting = "current_user_id";
+
+// How long a warm-started mount waits for authorisation before warning that it may never come
+constexpr std::chrono::seconds kWarmStartReadyWarning{30};
+
+// Rank of the calling thread's fetches in a single flight: a read never waits for a prefetch's fetch
+int flight_rank() { return static_cast<int>(tg::current_request_priority()); }
+
+/// On-demand reader for a file that is downloaded range by range
+///
+/// Each read asks TDLib for just the requested bytes (plus read-ahead)
+/// and blocks until they are local, then serves them with pread().
+class MediaStream {
+public:
+    MediaStream(tg::TelegramClient& client, std::string file_id, int64_t size, std::size_t read_ahead)
+        : client_(client), file_id_(std::move(file_id)), size_(size), read_ahead_(read_ahead) {}
+
+    ~MediaStream() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+        client_.release_file_range(file_id_);
+    }
+
+    MediaStream(const MediaStream&) = delete;
+    MediaStream& operator=(const MediaStream&) = delete;
+
+    int read(char* buf, std::size_t size, off_t offset) {
+        if (size == 0 || (size_ > 0 && offset >= size_)) {
+            return 0;  // EOF
+        }
+
+        tg::FileDownloadState state;
+        try {
+            state = client_
+                        .download_file_range(
+                            file_id_, offset, static_cast<int64_t>(size), static_cast<int64_t>(read_ahead_)
+                        )
+                        .get_result();
+        } catch (const std::exception& e) {
+            spdlog::error("Failed to download range {}+{} of {}: {}", offset, size, file_id_, e.what());
+            return -EIO;
+        }
+
+        if (state.available <= 0) {
+            return 0;
+        }
+        std::size_t to_read = std::min(size, static_cast<std::size_t>(state.available));
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        // TDLib moves the file once the download completes - follow it
+        if (fd_ < 0 || state.local_path != path_) {
+            int fd = ::open(state.local_path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                spdlog::error("Failed to open {}: {}", state.local_path, std::strerror(errno));
+                return -EIO;
+            }
+            if (fd_ >= 0) {
+                ::close(fd_);
+            }
+            fd_ = fd;
+            path_ = state.local_path;
+        }
+
+        ssize_t n;
+        do {
+            n = ::pread(fd_, buf, to_read, offset);
+        } while (n < 0 && errno == EINTR);
+        return n < 0 ? -errno : static_cast<int>(n);
+    }
+
+private:
+    tg::TelegramClient& client_;
+    std::string file_id_;
+    int64_t size_;
+    std::size_t read_ahead_;
+
+    std::mutex mutex_;
+    std::string path_;
+    int fd_{-1};
+};
+
+}  // namespace
+
+TelegramDataProvider::TelegramDataProvider(tg::TelegramClient& client, Config config)
     : client_(client),
+      config_(std::move(config)),
       users_loaded_(false),
       groups_loaded_(false),
       channels_loaded_(false),
-      messages_cache_(std::make_unique<FormattedMessagesCache>()) {
+      messages_cache_(std::make_unique<FormattedMessagesCache>(config_.messages_cache)),
+      prefetcher_(
+          config_.prefetch.workers > 0 ? std::make_unique<BackgroundPrefetcher>(
+                                             *messages_cache_,
+                                             client_.cache(),
+                                             [this](int64_t chat_id) { (void)fetch_and_format_messages(chat_id); },
+                                             [this](int64_t chat_id) { ensure_files_loaded(chat_id); },
+                                             config_.prefetch
+                                         )
+                                       : nullptr
+      ),
+      upload_queue_(config_.uploads),
+      media_downloads_(config_.media_prefetch.pool),
+      text_sends_(
+          [this](int64_t chat_id, const std::string& text) { return client_.send_text(chat_id, text).get_result().id; },
+          config_.text_sends
+      ) {
+    // Nothing older is ever displayed; the cache deletes it in the background
+    client_.cache().set_message_retention(config_.messages_cache.max_history_age);
+
     setup_message_callback();
     setup_chat_callback();
     setup_user_callback();
 
-    // Preload current user and trigger chat loading early
-    // This speeds up initial directory listings
-    preload_data();
+    // Start applying queued chat/user updates to the entity snapshot
+    start_entity_updater();
+
+    if (config_.warm_start && restore_persisted_snapshot()) {
+        // Serve the last run's entities now; TDLib catches up in the background
+        start_reconciler();
+    } else {
+        if (config_.warm_start) {
+            spdlog::info("Warm start: nothing persisted yet, waiting for Telegram");
+            (void)client_.wait_until_ready(kWarmStartReadyWarning).get_result();
+        }
+        // Preload current user and trigger chat loading early
+        // This speeds up initial directory listings
+        preload_data();
+    }
 
     // Start background flusher for txt buffers
+    text_sends_.start();
     start_txt_flusher();
+
+    upload_queue_.start();
+    media_downloads_.start();
+    start_files_trimmer();
+    if (prefetcher_) {
+        prefetcher_->start();
+    }
+}
+
+TelegramDataProvider::~TelegramDataProvider() {
+    stop_reconciler();
+    if (prefetcher_) {
+        prefetcher_->stop();
+    }
+    media_downloads_.stop();
+    stop_files_trimmer();
+    upload_queue_.stop();  // Sends what was already released
+    stop_entity_updater();
+    stop_txt_flusher();
+    text_sends_.stop();  // Hands the last flushed chunks to TDLib
+}
+
+TelegramDataProvider::EntitySnapshot::EntitySnapshot(const EntitySnapshot& other)
+    : users(other.users), groups(other.groups), channels(other.channels), current_user(other.current_user) {}
+
+void TelegramDataProvider::EntitySnapshot::reindex() {
+    user_dirs_.clear();
+    group_dirs_.clear();
+    channel_dirs_.clear();
+    usernames_.clear();
+    users_by_id_.clear();
+    chats_by_id_.clear();
+
+    user_dirs_.reserve(users.size());
+    users_by_id_.reserve(users.size());
+    for (const auto& [dir_name, user] : users) {
+        user_dirs_.emplace(dir_name, &user);
+        users_by_id_.emplace(user.id, &user);
+        if (!user.username.empty()) {
+            usernames_.emplace(user.username, UserRef{dir_name, &user});
+        }
+    }
+
+    group_dirs_.reserve(groups.size());
+    channel_dirs_.reserve(channels.size());
+    chats_by_id_.reserve(groups.size() + channels.size());
+    for (const auto& [dir_name, chat] : groups) {
+        group_dirs_.emplace(dir_name, &chat);
+        chats_by_id_.emplace(chat.id, &chat);
+    }
+    for (const auto& [dir_name, chat] : channels) {
+        channel_dirs_.emplace(dir_name, &chat);
+        chats_by_id_.emplace(chat.id, &chat);
+    }
+}
+
+const tg::User* TelegramDataProvider::EntitySnapshot::find_user(std::string_view dir_name) const {
+    auto it = user_dirs_.find(dir_name);
+    return it != user_dirs_.end() ? it->second : nullptr;
+}
+
+const tg::Chat* TelegramDataProvider::EntitySnapshot::find_group(std::string_view dir_name) const {
+    auto it = group_dirs_.find(dir_name);
+    return it != group_dirs_.end() ? it->second : nullptr;
+}
+
+const tg::Chat* TelegramDataProvider::EntitySnapshot::find_channel(std::string_view dir_name) const {
+    auto it = channel_dirs_.find(dir_name);
+    return it != channel_dirs_.end() ? it->second : nullptr;
+}
+
+std::optional<TelegramDataProvider::EntitySnapshot::UserRef>
+TelegramDataProvider::EntitySnapshot::find_user_by_username(std::string_view username) const {
+    auto it = usernames_.find(username);
+    if (it == usernames_.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+const tg::User* TelegramDataProvider::EntitySnapshot::find_user_by_id(int64_t id) const {
+    auto it = users_by_id_.find(id);
+    return it != users_by_id_.end() ? it->second : nullptr;
+}
+
+const tg::Chat* TelegramDataProvider::EntitySnapshot::find_chat_by_id(int64_t id) const {
+    auto it = chats_by_id_.find(id);
+    return it != chats_by_id_.end() ? it->second : nullptr;
+}
+
+TelegramDataProvider::SnapshotPtr TelegramDataProvider::snapshot() const {
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    return snapshot_;
 }
 
-TelegramDataProvider::~TelegramDataProvider() { stop_txt_flusher(); }
+void TelegramDataProvider::update_snapshot(const std::function<void(EntitySnapshot&)>& update) {
+    std::lock_guard<std::mutex> writer_lock(snapshot_writer_mutex_);
+
+    // Copy outside snapshot_mutex_ so readers only ever wait for a pointer swap
+    auto next = std::make_shared<EntitySnapshot>(*snapshot());
+    update(*next);
+    next->reindex();
+
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    snapshot_ = std::move(next);
+}
 
 void TelegramDataProvider::refresh_users() {
     try {
         // TDLib tasks are thread-safe; get_result() blocks until completion
         auto users_task = client_.get_users();
         auto users_list = users_task.get_result();
+        bool loaded = !users_list.empty();
 
-        // Mutex protects the users_ map during modification
-        std::lock_guard<std::mutex> lock(mutex_);
-        users_.clear();
-
+        // Build the new map without blocking readers, then publish it
+        std::map<std::string, tg::User> users;
         for (auto& user : users_list) {
             auto dir_name = get_user_dir_name(user);
-            users_[dir_name] = std::move(user);
+            users[dir_name] = std::move(user);
         }
 
-        // Always include current user (self) in the users list
-        if (current_user_.has_value()) {
-            auto dir_name = get_user_dir_name(*current_user_);
-            if (users_.find(dir_name) == users_.end()) {
-                users_[dir_name] = *current_user_;
-                spdlog::debug("Added current user {} to users list", dir_name);
+        std::size_t count = 0;
+        update_snapshot([&](EntitySnapshot& snap) {
+            // Always include current user (self) in the users list
+            if (snap.current_user.has_value()) {
+                auto dir_name = get_user_dir_name(*snap.current_user);
+                if (users.emplace(dir_name, *snap.current_user).second) {
+                    spdlog::debug("Added current user {} to users list", dir_name);
+                }
             }
-        }
+            snap.users = std::move(users);
+            count = snap.users.size();
+        });
 
         // Only mark as fully loaded if we got some users
         // Otherwise allow retry on next access
-        if (!users_list.empty()) {
+        if (loaded) {
             users_loaded_ = true;
         }
-        spdlog::info("Loaded {} users from Telegram", users_.size());
+        spdlog::info("Loaded {} users from Telegram", count);
     } catch (const std::exception& e) {
         spdlog::error("Failed to refresh users: {}", e.what());
         // Don't mark as loaded on error - allow retry
@@ -79,34 +335,35 @@ void TelegramDataProvider::refresh_users() {
 
 void TelegramDataProvider::ensure_users_loaded() {
     // users_loaded_ is std::atomic<bool>, so this check is thread-safe.
-    // Multiple threads may enter refresh_users() concurrently on first access,
-    // but the mutex inside refresh_users() ensures only one actually populates the cache.
+    // Multiple threads may enter refresh_users() concurrently on first access;
+    // each publishes a complete snapshot, so readers never see a partial map.
     if (!users_loaded_) {
         refresh_users();
     }
 }
 
 void TelegramDataProvider::ensure_current_user_loaded() {
-    // Check without lock first for performance
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (current_user_.has_value()) {
-            return;
-        }
+    // A warm start serves the persisted self; the reconciler fetches it once TDLib is ready
+    if (snapshot()->current_user.has_value() || reconciling_) {
+        return;
     }
+    load_current_user();
+}
 
+void TelegramDataProvider::load_current_user() {
     try {
         auto me_task = client_.get_me();
         auto me = me_task.get_result();
 
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            current_user_ = std::move(me);
-            spdlog::debug("Loaded current user: {}", current_user_->display_name());
-        }
+        spdlog::debug("Loaded current user: {}", me.display_name());
+        client_.cache().set_setting(kCurrentUserSetting, std::to_string(me.id));
 
-        // Invalidate users cache so current user gets added on next refresh
-        users_loaded_ = false;
+        // Publish self and add it to the users list in the same snapshot
+        auto dir_name = get_user_dir_name(me);
+        update_snapshot([&](EntitySnapshot& snap) {
+            snap.users.insert_or_assign(dir_name, me);
+            snap.current_user = std::move(me);
+        });
     } catch (const std::exception& e) {
         spdlog::error("Failed to get current user: {}", e.what());
     }
@@ -129,6 +386,151 @@ void TelegramDataProvider::preload_data() {
     }
 }
 
+bool TelegramDataProvider::restore_persisted_snapshot() {
+    auto started = std::chrono::steady_clock::now();
+
+    // Self first, so refresh_users() lists it along with the private chats
+    try {
+        if (auto id = client_.cache().get_setting(kCurrentUserSetting)) {
+            if (auto me = client_.cache().get_cached_user(std::stoll(*id))) {
+                update_snapshot([&](EntitySnapshot& snap) { snap.current_user = std::move(*me); });
+            }
+        }
+    } catch (const std::exception& e) {
+        spdlog::warn("Warm start: failed to restore the current user: {}", e.what());
+    }
+
+    // All three read SQLite only
+    refresh_users();
+    refresh_groups();
+    refresh_channels();
+
+    auto snap = snapshot();
+    if (snap->users.empty() && snap->groups.empty() && snap->channels.empty()) {
+        return false;
+    }
+
+    reconciling_ = true;
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    spdlog::info(
+        "Warm start: serving {} users, {} groups and {} channels from the cache ({} ms)",
+        snap->users.size(),
+        snap->groups.size(),
+        snap->channels.size(),
+        elapsed.count()
+    );
+    return true;
+}
+
+void TelegramDataProvider::start_reconciler() {
+    reconciler_running_ = true;
+    reconciler_thread_ = std::thread(&TelegramDataProvider::reconciler_loop, this);
+}
+
+void TelegramDataProvider::stop_reconciler() {
+    reconciler_running_ = false;
+    if (reconciler_thread_.joinable()) {
+        reconciler_thread_.join();
+    }
+}
+
+void TelegramDataProvider::reconciler_loop() {
+    // Short waits, so unmounting before authorisation completes isn't held up
+    auto warn_at = std::chrono::steady_clock::now() + kWarmStartReadyWarning;
+    while (reconciler_running_) {
+        try {
+            if (client_.wait_until_ready(std::chrono::milliseconds(250)).get_result()) {
+                break;
+            }
+        } catch (const std::exception& e) {
+            spdlog::error("Warm start: failed to wait for Telegram: {}", e.what());
+            return;
+        }
+        if (std::chrono::steady_clock::now() >= warn_at) {
+            spdlog::warn("Warm start: Telegram is not authorised yet, still serving the cache (run 'tg-fuse login'?)");
+            warn_at = std::chrono::time_point<std::chrono::steady_clock>::max();
+        }
+    }
+    if (!reconciler_running_) {
+        return;
+    }
+
+    spdlog::info("Warm start: Telegram ready, reconciling the cached snapshot");
+    auto before = snapshot();
+    reconciling_ = false;
+
+    load_current_user();
+    preload_data();
+
+    // TDLib has replayed its chats into SQLite; rebuild the lists to also drop chats that are gone
+    refresh_users();
+    refresh_groups();
+    refresh_channels();
+    invalidate_reconciled(*before);
+}
+
+void TelegramDataProvider::invalidate_reconciled(const EntitySnapshot& before) {
+    auto after = snapshot();
+
+    // Entity updates during the replay already invalidated what changed; this covers removals and renames
+    auto diff = [this](std::string_view section, const auto& old_entries, const auto& new_entries) {
+        bool changed = false;
+        auto stale = [&](const std::string& dir_name) {
+            auto dir = fmt::format("/{}/{}", section, dir_name);
+            queue_invalidation(dir + "/" + std::string(kInfoFile));
+            queue_invalidation(std::move(dir));
+            changed = true;
+        };
+        for (const auto& [dir_name, entity] : old_entries) {
+            auto it = new_entries.find(dir_name);
+            if (it == new_entries.end() || it->second.id != entity.id) {
+                stale(dir_name);
+            }
+        }
+        for (const auto& [dir_name, entity] : new_entries) {
+            if (!old_entries.contains(dir_name)) {
+                stale(dir_name);
+            }
+        }
+        if (changed) {
+            queue_invalidation(fmt::format("/{}", section));
+        }
+        return changed;
+    };
+
+    if (diff(kUsersDir, before.users, after->users)) {
+        for (auto section : {kContactsDir, kTextDir}) {
+            queue_invalidation(fmt::format("/{}", section));
+        }
+    }
+    diff(kGroupsDir, before.groups, after->groups);
+    diff(kChannelsDir, before.channels, after->channels);
+    if (!before.current_user || !after->current_user || before.current_user->id != after->current_user->id) {
+        queue_invalidation(fmt::format("/{}", kSelfSymlink));
+    }
+
+    // Chats served from SQLite alone while reconciling may have missed history and file syncs
+    std::set<int64_t> chats;
+    {
+        std::lock_guard<std::mutex> lock(warm_served_mutex_);
+        chats.swap(warm_served_chats_);
+    }
+    for (auto chat_id : chats) {
+        messages_cache_->invalidate(chat_id);
+        if (auto dir = chat_dir_path(*after, chat_id)) {
+            queue_invalidation(*dir + "/" + std::string(kMessagesFile));
+            queue_invalidation(*dir + "/" + std::string(kFilesDir));
+            queue_invalidation(*dir + "/" + std::string(kMediaDir));
+        }
+    }
+    spdlog::info("Warm start: reconciled ({} chats served from the cache meanwhile)", chats.size());
+}
+
+void TelegramDataProvider::note_warm_served(int64_t chat_id) {
+    std::lock_guard<std::mutex> lock(warm_served_mutex_);
+    warm_served_chats_.insert(chat_id);
+}
+
 std::filesystem::path TelegramDataProvider::sanitise_for_path(const std::string& name) const {
     std::string result;
     result.reserve(name.size());
@@ -329,31 +731,24 @@ std::string TelegramDataProvider::make_symlink_target(const std::string& relativ
     return (base / relative_path).string();
 }
 
-const tg::User* TelegramDataProvider::find_user_by_dir_name(const std::string& dir_name) const {
-    auto it = users_.find(dir_name);
-    if (it != users_.end()) {
-        return &it->second;
-    }
-    return nullptr;
-}
-
 void TelegramDataProvider::refresh_groups() {
     try {
         auto groups_task = client_.get_groups();
         auto groups_list = groups_task.get_result();
 
-        std::lock_guard<std::mutex> lock(mutex_);
-        groups_.clear();
-
+        std::map<std::string, tg::Chat> groups;
         for (auto& group : groups_list) {
             auto dir_name = get_group_dir_name(group);
-            groups_[dir_name] = std::move(group);
+            groups[dir_name] = std::move(group);
         }
+        std::size_t count = groups.size();
+
+        update_snapshot([&](EntitySnapshot& snap) { snap.groups = std::move(groups); });
 
         if (!groups_list.empty()) {
             groups_loaded_ = true;
         }
-        spdlog::info("Loaded {} groups from Telegram", groups_.size());
+        spdlog::info("Loaded {} groups from Telegram", count);
     } catch (const std::exception& e) {
         spdlog::error("Failed to refresh groups: {}", e.what());
     }
@@ -376,14 +771,6 @@ std::string TelegramDataProvider::get_group_dir_name(const tg::Chat& chat) const
     return std::to_string(chat.id);
 }
 
-const tg::Chat* TelegramDataProvider::find_group_by_dir_name(const std::string& dir_name) const {
-    auto it = groups_.find(dir_name);
-    if (it != groups_.end()) {
-        return &it->second;
-    }
-    return nullptr;
-}
-
 std::string TelegramDataProvider::generate_group_info(const tg::Chat& chat) const {
     std::ostringstream oss;
 
@@ -408,18 +795,19 @@ void TelegramDataProvider::refresh_channels() {
         auto channels_task = client_.get_channels();
         auto channels_list = channels_task.get_result();
 
-        std::lock_guard<std::mutex> lock(mutex_);
-        channels_.clear();
-
+        std::map<std::string, tg::Chat> channels;
         for (auto& channel : channels_list) {
             auto dir_name = get_channel_dir_name(channel);
-            channels_[dir_name] = std::move(channel);
+            channels[dir_name] = std::move(channel);
         }
+        std::size_t count = channels.size();
+
+        update_snapshot([&](EntitySnapshot& snap) { snap.channels = std::move(channels); });
 
         if (!channels_list.empty()) {
             channels_loaded_ = true;
         }
-        spdlog::info("Loaded {} channels from Telegram", channels_.size());
+        spdlog::info("Loaded {} channels from Telegram", count);
     } catch (const std::exception& e) {
         spdlog::error("Failed to refresh channels: {}", e.what());
     }
@@ -442,14 +830,6 @@ std::string TelegramDataProvider::get_channel_dir_name(const tg::Chat& chat) con
     return std::to_string(chat.id);
 }
 
-const tg::Chat* TelegramDataProvider::find_channel_by_dir_name(const std::string& dir_name) const {
-    auto it = channels_.find(dir_name);
-    if (it != channels_.end()) {
-        return &it->second;
-    }
-    return nullptr;
-}
-
 std::string TelegramDataProvider::generate_channel_info(const tg::Chat& chat) const {
     std::ostringstream oss;
 
@@ -468,185 +848,277 @@ std::string TelegramDataProvider::generate_channel_info(const tg::Chat& chat) co
     return oss.str();
 }
 
-TelegramDataProvider::PathInfo TelegramDataProvider::parse_path(std::string_view path) const {
-    PathInfo info;
+namespace {
 
-    if (path.empty() || path == "/") {
-        info.category = PathCategory::ROOT;
-        return info;
-    }
+/// Top-level sections of the filesystem that contain per-chat directories
+enum class ChatSection { USERS, GROUPS, CHANNELS };
+
+/// Leaves inside a chat directory (/users/alice/<leaf>)
+enum class ChatLeaf { INFO, MESSAGES, FILES, MEDIA, TXT, TAIL, HISTORY };
 
-    // Use std::filesystem::path for normalisation and component parsing
-    std::filesystem::path fs_path(path);
-    fs_path = fs_path.lexically_normal();
+const std::unordered_map<std::string_view, ChatSection>& chat_sections() {
+    static const std::unordered_map<std::string_view, ChatSection> sections{
+        {kUsersDir, ChatSection::USERS},
+        {kGroupsDir, ChatSection::GROUPS},
+        {kChannelsDir, ChatSection::CHANNELS},
+    };
+    return sections;
+}
+
+const std::unordered_map<std::string_view, ChatLeaf>& chat_leaves() {
+    static const std::unordered_map<std::string_view, ChatLeaf> leaves{
+        {kInfoFile, ChatLeaf::INFO},
+        {kMessagesFile, ChatLeaf::MESSAGES},
+        {kFilesDir, ChatLeaf::FILES},
+        {kMediaDir, ChatLeaf::MEDIA},
+        {kTxtFile, ChatLeaf::TXT},
+        {kMessagesTailFile, ChatLeaf::TAIL},
+        {kHistoryDir, ChatLeaf::HISTORY},
+    };
+    return leaves;
+}
+
+/// Split a path into normalised components without allocating
+/// @return number of components, or max + 1 if the path is deeper than @p max
+std::size_t split_path(std::string_view path, std::string_view* components, std::size_t max) {
+    std::size_t count = 0;
+    while (!path.empty()) {
+        auto slash = path.find('/');
+        auto component = path.substr(0, slash);
+        path = slash == std::string_view::npos ? std::string_view{} : path.substr(slash + 1);
 
-    // Collect path components (skip root)
-    std::vector<std::string> components;
-    for (const auto& component : fs_path) {
-        auto str = component.string();
-        if (str != "/" && !str.empty()) {
-            components.push_back(str);
+        if (component.empty() || component == ".") {
+            continue;
+        }
+        if (component == "..") {
+            if (count > 0) {
+                --count;
+            }
+            continue;
         }
+        if (count == max) {
+            return max + 1;
+        }
+        components[count++] = component;
     }
+    return count;
+}
 
-    if (components.empty()) {
-        info.category = PathCategory::ROOT;
+}  // namespace
+
+TelegramDataProvider::PathInfo TelegramDataProvider::parse_path(std::string_view path) {
+    static constexpr std::size_t kMaxDepth = 4;
+
+    static constexpr SectionCategories kSectionCategories[] = {
+        {PathCategory::USER_DIR,
+         PathCategory::USER_INFO,
+         PathCategory::USER_MESSAGES,
+         PathCategory::USER_FILES_DIR,
+         PathCategory::USER_FILE,
+         PathCategory::USER_MEDIA_DIR,
+         PathCategory::USER_MEDIA,
+         PathCategory::USER_TXT,
+         PathCategory::USER_UPLOAD,
+         PathCategory::USER_MESSAGES_TAIL,
+         PathCategory::USER_HISTORY_DIR,
+         PathCategory::USER_HISTORY_DAY},
+        {PathCategory::GROUP_DIR,
+         PathCategory::GROUP_INFO,
+         PathCategory::GROUP_MESSAGES,
+         PathCategory::GROUP_FILES_DIR,
+         PathCategory::GROUP_FILE,
+         PathCategory::GROUP_MEDIA_DIR,
+         PathCategory::GROUP_MEDIA,
+         PathCategory::GROUP_TXT,
+         PathCategory::GROUP_UPLOAD,
+         PathCategory::GROUP_MESSAGES_TAIL,
+         PathCategory::GROUP_HISTORY_DIR,
+         PathCategory::GROUP_HISTORY_DAY},
+        {PathCategory::CHANNEL_DIR,
+         PathCategory::CHANNEL_INFO,
+         PathCategory::CHANNEL_MESSAGES,
+         PathCategory::CHANNEL_FILES_DIR,
+         PathCategory::CHANNEL_FILE,
+         PathCategory::CHANNEL_MEDIA_DIR,
+         PathCategory::CHANNEL_MEDIA,
+         PathCategory::CHANNEL_TXT,
+         PathCategory::CHANNEL_UPLOAD,
+         PathCategory::CHANNEL_MESSAGES_TAIL,
+         PathCategory::CHANNEL_HISTORY_DIR,
+         PathCategory::CHANNEL_HISTORY_DAY},
+    };
+
+    PathInfo info;
+
+    std::string_view components[kMaxDepth];
+    auto count = split_path(path, components, kMaxDepth);
+    if (count > kMaxDepth) {
         return info;
     }
 
-    // Check for user symlink at root level (starts with @)
-    if (components.size() == 1 && !components[0].empty() && components[0][0] == '@') {
-        info.category = PathCategory::ROOT_SYMLINK;
-        info.entity_name = components[0].substr(1);  // Remove @
+    if (count == 0) {
+        info.category = PathCategory::ROOT;
         return info;
     }
 
-    // Check for /self symlink
-    if (components.size() == 1 && components[0] == kSelfSymlink) {
-        info.category = PathCategory::SELF_SYMLINK;
-        return info;
+    const auto& first = components[0];
+
+    if (count == 1) {
+        // Check for user symlink at root level (starts with @)
+        if (first[0] == '@') {
+            info.category = PathCategory::ROOT_SYMLINK;
+            info.entity_name = first.substr(1);  // Remove @
+            return info;
+        }
+        if (first == kSelfSymlink) {
+            info.category = PathCategory::SELF_SYMLINK;
+            return info;
+        }
+        if (first == kUploadsDir) {
+            info.category = PathCategory::UPLOADS_DIR;
+            return info;
+        }
+        if (first == kStatsFile) {
+            info.category = PathCategory::STATS_JSON;
+            return info;
+        }
+        if (first == kStatsPrometheusFile) {
+            info.category = PathCategory::STATS_PROMETHEUS;
+            return info;
+        }
+        if (first == kTraceFile && tg::Tracer::global().enabled()) {
+            info.category = PathCategory::TRACE_FILE;
+            return info;
+        }
     }
 
-    // Check for /.uploads directory
-    if (components.size() == 1 && components[0] == kUploadsDir) {
-        info.category = PathCategory::UPLOADS_DIR;
+    if (first == kUploadsDir) {
+        if (count == 2) {
+            info.category = PathCategory::UPLOAD_STATUS;
+            info.file_entry_name = components[1];
+        }
         return info;
     }
 
     // Check for /text directory
-    if (components[0] == kTextDir) {
-        if (components.size() == 1) {
+    if (first == kTextDir) {
+        if (count == 1) {
             info.category = PathCategory::TEXT_DIR;
-            return info;
-        }
-        if (components.size() == 2) {
+        } else if (count == 2) {
             info.category = PathCategory::TEXT_SYMLINK;
             // Strip @ prefix if present
-            if (!components[1].empty() && components[1][0] == '@') {
-                info.entity_name = components[1].substr(1);
-            } else {
-                info.entity_name = components[1];
-            }
-            return info;
+            info.entity_name = components[1][0] == '@' ? components[1].substr(1) : components[1];
         }
+        return info;
     }
 
-    // Check for top-level directories
-    if (components[0] == kUsersDir) {
-        if (components.size() == 1) {
-            info.category = PathCategory::USERS_DIR;
-        } else if (components.size() == 2) {
-            info.category = PathCategory::USER_DIR;
-            info.entity_name = components[1];
-        } else if (components.size() == 3) {
-            info.entity_name = components[1];
-            if (components[2] == kInfoFile) {
-                info.category = PathCategory::USER_INFO;
-            } else if (components[2] == kMessagesFile) {
-                info.category = PathCategory::USER_MESSAGES;
-            } else if (components[2] == kFilesDir) {
-                info.category = PathCategory::USER_FILES_DIR;
-            } else if (components[2] == kMediaDir) {
-                info.category = PathCategory::USER_MEDIA_DIR;
-            } else if (components[2] == kTxtFile) {
-                info.category = PathCategory::USER_TXT;
-            } else {
-                // Unknown file in user directory - could be an upload
-                info.file_entry_name = components[2];
-                info.category = PathCategory::USER_UPLOAD;
-            }
-        } else if (components.size() == 4 && components[2] == kFilesDir) {
-            info.entity_name = components[1];
-            info.file_entry_name = components[3];
-            info.category = PathCategory::USER_FILE;
-        } else if (components.size() == 4 && components[2] == kMediaDir) {
-            info.entity_name = components[1];
-            info.file_entry_name = components[3];
-            info.category = PathCategory::USER_MEDIA;
+    // Check for /search directory (any name inside is a query)
+    if (first == kSearchDir) {
+        if (count == 1) {
+            info.category = PathCategory::SEARCH_DIR;
+        } else if (count == 2) {
+            info.category = PathCategory::SEARCH_RESULT;
+            info.file_entry_name = components[1];
         }
-    } else if (components[0] == kContactsDir) {
-        if (components.size() == 1) {
+        return info;
+    }
+
+    if (first == kContactsDir) {
+        if (count == 1) {
             info.category = PathCategory::CONTACTS_DIR;
-        } else if (components.size() == 2) {
+        } else if (count == 2) {
             info.category = PathCategory::CONTACT_SYMLINK;
             info.entity_name = components[1];
         }
-    } else if (components[0] == kGroupsDir) {
-        if (components.size() == 1) {
-            info.category = PathCategory::GROUPS_DIR;
-        } else if (components.size() == 2) {
-            info.category = PathCategory::GROUP_DIR;
-            info.entity_name = components[1];
-        } else if (components.size() == 3) {
-            info.entity_name = components[1];
-            if (components[2] == kInfoFile) {
-                info.category = PathCategory::GROUP_INFO;
-            } else if (components[2] == kMessagesFile) {
-                info.category = PathCategory::GROUP_MESSAGES;
-            } else if (components[2] == kFilesDir) {
-                info.category = PathCategory::GROUP_FILES_DIR;
-            } else if (components[2] == kMediaDir) {
-                info.category = PathCategory::GROUP_MEDIA_DIR;
-            } else if (components[2] == kTxtFile) {
-                info.category = PathCategory::GROUP_TXT;
-            } else {
-                // Unknown file in group directory - could be an upload
-                info.file_entry_name = components[2];
-                info.category = PathCategory::GROUP_UPLOAD;
-            }
-        } else if (components.size() == 4 && components[2] == kFilesDir) {
-            info.entity_name = components[1];
-            info.file_entry_name = components[3];
-            info.category = PathCategory::GROUP_FILE;
-        } else if (components.size() == 4 && components[2] == kMediaDir) {
-            info.entity_name = components[1];
-            info.file_entry_name = components[3];
-            info.category = PathCategory::GROUP_MEDIA;
-        }
-    } else if (components[0] == kChannelsDir) {
-        if (components.size() == 1) {
-            info.category = PathCategory::CHANNELS_DIR;
-        } else if (components.size() == 2) {
-            info.category = PathCategory::CHANNEL_DIR;
-            info.entity_name = components[1];
-        } else if (components.size() == 3) {
-            info.entity_name = components[1];
-            if (components[2] == kInfoFile) {
-                info.category = PathCategory::CHANNEL_INFO;
-            } else if (components[2] == kMessagesFile) {
-                info.category = PathCategory::CHANNEL_MESSAGES;
-            } else if (components[2] == kFilesDir) {
-                info.category = PathCategory::CHANNEL_FILES_DIR;
-            } else if (components[2] == kMediaDir) {
-                info.category = PathCategory::CHANNEL_MEDIA_DIR;
-            } else if (components[2] == kTxtFile) {
-                info.category = PathCategory::CHANNEL_TXT;
-            } else {
-                // Unknown file in channel directory - could be an upload
-                info.file_entry_name = components[2];
-                info.category = PathCategory::CHANNEL_UPLOAD;
-            }
-        } else if (components.size() == 4 && components[2] == kFilesDir) {
-            info.entity_name = components[1];
-            info.file_entry_name = components[3];
-            info.category = PathCategory::CHANNEL_FILE;
-        } else if (components.size() == 4 && components[2] == kMediaDir) {
-            info.entity_name = components[1];
-            info.file_entry_name = components[3];
-            info.category = PathCategory::CHANNEL_MEDIA;
+        return info;
+    }
+
+    auto section = chat_sections().find(first);
+    if (section == chat_sections().end()) {
+        return info;
+    }
+
+    if (count == 1) {
+        switch (section->second) {
+            case ChatSection::USERS:
+                info.category = PathCategory::USERS_DIR;
+                break;
+            case ChatSection::GROUPS:
+                info.category = PathCategory::GROUPS_DIR;
+                break;
+            case ChatSection::CHANNELS:
+                info.category = PathCategory::CHANNELS_DIR;
+                break;
+        }
+        return info;
+    }
+
+    const auto& categories = kSectionCategories[static_cast<std::size_t>(section->second)];
+    info.entity_name = components[1];
+
+    if (count == 2) {
+        info.category = categories.dir;
+        return info;
+    }
+
+    auto leaf = chat_leaves().find(components[2]);
+    if (count == 3) {
+        if (leaf == chat_leaves().end()) {
+            // Unknown file in chat directory - could be an upload
+            info.file_entry_name = components[2];
+            info.category = categories.upload;
+            return info;
+        }
+        switch (leaf->second) {
+            case ChatLeaf::INFO:
+                info.category = categories.info;
+                break;
+            case ChatLeaf::MESSAGES:
+                info.category = categories.messages;
+                break;
+            case ChatLeaf::FILES:
+                info.category = categories.files_dir;
+                break;
+            case ChatLeaf::MEDIA:
+                info.category = categories.media_dir;
+                break;
+            case ChatLeaf::TXT:
+                info.category = categories.txt;
+                break;
+            case ChatLeaf::TAIL:
+                info.category = categories.tail;
+                break;
+            case ChatLeaf::HISTORY:
+                info.category = categories.history_dir;
+                break;
         }
+        return info;
     }
 
+    // count == 4: entries under files/, media/ and history/
+    if (leaf != chat_leaves().end() && leaf->second == ChatLeaf::FILES) {
+        info.file_entry_name = components[3];
+        info.category = categories.file;
+    } else if (leaf != chat_leaves().end() && leaf->second == ChatLeaf::MEDIA) {
+        info.file_entry_name = components[3];
+        info.category = categories.media;
+    } else if (leaf != chat_leaves().end() && leaf->second == ChatLeaf::HISTORY) {
+        info.file_entry_name = components[3];
+        info.category = categories.history_day;
+    } else {
+        info.entity_name = {};
+    }
     return info;
 }
 
 std::vector<Entry> TelegramDataProvider::list_directory(std::string_view path) {
+    tg::TraceSpan span("provider", "list_directory");
     ensure_users_loaded();
     ensure_current_user_loaded();
     ensure_groups_loaded();
     ensure_channels_loaded();
 
-    std::unique_lock<std::mutex> lock(mutex_);
+    auto snap = snapshot();
     std::vector<Entry> entries;
 
     auto info = parse_path(path);
@@ -660,14 +1132,30 @@ std::vector<Entry> TelegramDataProvider::list_directory(std::string_view path) {
             entries.push_back(Entry::directory(std::string(kChannelsDir)));
             entries.push_back(Entry::directory(std::string(kUploadsDir)));
             entries.push_back(Entry::directory(std::string(kTextDir)));
-            // Self symlink pointing to current user's directory
-            if (current_user_) {
-                auto dir_name = get_user_dir_name(*current_user_);
-                auto target = (std::filesystem::path(kUsersDir) / dir_name).string();
-                entries.push_back(Entry::symlink(std::string(kSelfSymlink), make_symlink_target(target)));
+            entries.push_back(Entry::directory(std::string(kSearchDir)));
+            // Reports are generated when opened and read with direct_io, so they are listed empty
+            for (auto name : {kStatsFile, kStatsPrometheusFile}) {
+                auto entry = Entry::file(std::string(name), 0, 0444);
+                entry.mtime = std::time(nullptr);
+                entry.atime = entry.mtime;
+                entry.ctime = entry.mtime;
+                entries.push_back(std::move(entry));
             }
-            // User symlinks at root (contacts with usernames only)
-            for (const auto& [name, user] : users_) {
+            if (tg::Tracer::global().enabled()) {
+                auto entry = Entry::file(std::string(kTraceFile), 0, 0444);
+                entry.mtime = std::time(nullptr);
+                entry.atime = entry.mtime;
+                entry.ctime = entry.mtime;
+                entries.push_back(std::move(entry));
+            }
+            // Self symlink pointing to current user's directory
+            if (snap->current_user) {
+                auto dir_name = get_user_dir_name(*snap->current_user);
+                auto target = (std::filesystem::path(kUsersDir) / dir_name).string();
+                entries.push_back(Entry::symlink(std::string(kSelfSymlink), make_symlink_target(target)));
+            }
+            // User symlinks at root (contacts with usernames only)
+            for (const auto& [name, user] : snap->users) {
                 if (is_user_contact(user) && has_username(user)) {
                     auto target = (std::filesystem::path(kUsersDir) / name).string();
                     entries.push_back(Entry::symlink("@" + user.username, make_symlink_target(target)));
@@ -676,11 +1164,11 @@ std::vector<Entry> TelegramDataProvider::list_directory(std::string_view path) {
             break;
 
         case PathCategory::UPLOADS_DIR: {
-            // List pending uploads from temp directory
-            std::lock_guard<std::mutex> upload_lock(uploads_mutex_);
-            for (const auto& [fh, upload] : pending_uploads_) {
-                auto entry = Entry::file(upload.original_filename, upload.bytes_written, 0644);
-                entry.mtime = std::time(nullptr);
+            // One status report per upload being written, queued or recently sent
+            auto now = std::time(nullptr);
+            for (const auto& [name, status] : upload_status_files()) {
+                auto entry = Entry::file(name, status.size(), 0444);
+                entry.mtime = now;
                 entry.atime = entry.mtime;
                 entry.ctime = entry.mtime;
                 entries.push_back(std::move(entry));
@@ -690,7 +1178,7 @@ std::vector<Entry> TelegramDataProvider::list_directory(std::string_view path) {
 
         case PathCategory::TEXT_DIR:
             // Symlinks to txt files for all users with usernames
-            for (const auto& [name, user] : users_) {
+            for (const auto& [name, user] : snap->users) {
                 if (has_username(user)) {
                     auto target = (std::filesystem::path(kUsersDir) / name / kTxtFile).string();
                     entries.push_back(Entry::symlink("@" + user.username, make_symlink_target(target)));
@@ -698,31 +1186,22 @@ std::vector<Entry> TelegramDataProvider::list_directory(std::string_view path) {
             }
             break;
 
-        case PathCategory::USERS_DIR:
-            for (const auto& [name, user] : users_) {
-                auto entry = Entry::directory(name);
-                // Set mtime to last message timestamp
-                if (user.last_message_timestamp > 0) {
-                    entry.mtime = static_cast<std::time_t>(user.last_message_timestamp);
-                    entry.atime = entry.mtime;
-                    entry.ctime = entry.mtime;
-                }
-                entries.push_back(std::move(entry));
-            }
+        case PathCategory::SEARCH_DIR:
+            // Queries aren't listed - they are looked up by name
             break;
 
+        case PathCategory::USERS_DIR:
         case PathCategory::CONTACTS_DIR:
-            // Symlinks to users directory for contacts only
-            for (const auto& [name, user] : users_) {
-                if (is_user_contact(user)) {
-                    auto target = (std::filesystem::path(kUsersDir) / name).string();
-                    entries.push_back(Entry::symlink(name, make_symlink_target(target)));
-                }
-            }
+        case PathCategory::GROUPS_DIR:
+        case PathCategory::CHANNELS_DIR:
+            visit_directory(path, [&entries](const Entry& entry) {
+                entries.push_back(entry);
+                return true;
+            });
             break;
 
         case PathCategory::USER_DIR: {
-            auto* user = find_user_by_dir_name(info.entity_name);
+            auto* user = snap->find_user(info.entity_name);
             if (user) {
                 // .info file
                 auto info_entry = Entry::file(std::string(kInfoFile), 4096);
@@ -742,6 +1221,9 @@ std::vector<Entry> TelegramDataProvider::list_directory(std::string_view path) {
                 }
                 entries.push_back(std::move(msg_entry));
 
+                // messages.tail and history/ (day by day)
+                add_history_entries(static_cast<std::time_t>(user->last_message_timestamp), entries);
+
                 // txt file for sending messages (mode 0600 = read/write)
                 auto txt_entry = Entry::file(std::string(kTxtFile), get_txt_file_size(user->id), 0600);
                 if (user->last_message_timestamp > 0) {
@@ -771,24 +1253,14 @@ std::vector<Entry> TelegramDataProvider::list_directory(std::string_view path) {
 
                 // Add pending/completed uploads in this directory
                 add_uploads_to_listing(path, entries);
-            }
-            break;
-        }
 
-        case PathCategory::GROUPS_DIR:
-            for (const auto& [name, group] : groups_) {
-                auto entry = Entry::directory(name);
-                if (group.last_message_timestamp > 0) {
-                    entry.mtime = static_cast<std::time_t>(group.last_message_timestamp);
-                    entry.atime = entry.mtime;
-                    entry.ctime = entry.mtime;
-                }
-                entries.push_back(std::move(entry));
+                prefetch_opened_chat(user->id);
             }
             break;
+        }
 
         case PathCategory::GROUP_DIR: {
-            auto* group = find_group_by_dir_name(info.entity_name);
+            auto* group = snap->find_group(info.entity_name);
             if (group) {
                 // .info file
                 auto info_entry = Entry::file(std::string(kInfoFile), 4096);
@@ -808,6 +1280,9 @@ std::vector<Entry> TelegramDataProvider::list_directory(std::string_view path) {
                 }
                 entries.push_back(std::move(msg_entry));
 
+                // messages.tail and history/ (day by day)
+                add_history_entries(static_cast<std::time_t>(group->last_message_timestamp), entries);
+
                 // txt file for sending messages (only if user can send messages)
                 if (group->can_send_messages) {
                     auto txt_entry = Entry::file(std::string(kTxtFile), get_txt_file_size(group->id), 0600);
@@ -839,24 +1314,14 @@ std::vector<Entry> TelegramDataProvider::list_directory(std::string_view path) {
 
                 // Add pending/completed uploads in this directory
                 add_uploads_to_listing(path, entries);
-            }
-            break;
-        }
 
-        case PathCategory::CHANNELS_DIR:
-            for (const auto& [name, channel] : channels_) {
-                auto entry = Entry::directory(name);
-                if (channel.last_message_timestamp > 0) {
-                    entry.mtime = static_cast<std::time_t>(channel.last_message_timestamp);
-                    entry.atime = entry.mtime;
-                    entry.ctime = entry.mtime;
-                }
-                entries.push_back(std::move(entry));
+                prefetch_opened_chat(group->id);
             }
             break;
+        }
 
         case PathCategory::CHANNEL_DIR: {
-            auto* channel = find_channel_by_dir_name(info.entity_name);
+            auto* channel = snap->find_channel(info.entity_name);
             if (channel) {
                 // .info file
                 auto info_entry = Entry::file(std::string(kInfoFile), 4096);
@@ -876,6 +1341,9 @@ std::vector<Entry> TelegramDataProvider::list_directory(std::string_view path) {
                 }
                 entries.push_back(std::move(msg_entry));
 
+                // messages.tail and history/ (day by day)
+                add_history_entries(static_cast<std::time_t>(channel->last_message_timestamp), entries);
+
                 // txt file for sending messages (only if user can send messages)
                 if (channel->can_send_messages) {
                     auto txt_entry = Entry::file(std::string(kTxtFile), get_txt_file_size(channel->id), 0600);
@@ -907,120 +1375,174 @@ std::vector<Entry> TelegramDataProvider::list_directory(std::string_view path) {
 
                 // Add pending/completed uploads in this directory
                 add_uploads_to_listing(path, entries);
+
+                prefetch_opened_chat(channel->id);
             }
             break;
         }
 
         case PathCategory::USER_FILES_DIR:
         case PathCategory::GROUP_FILES_DIR:
-        case PathCategory::CHANNEL_FILES_DIR: {
-            // Get chat ID while holding lock
-            int64_t chat_id = 0;
-            if (info.category == PathCategory::USER_FILES_DIR) {
-                auto* user = find_user_by_dir_name(info.entity_name);
-                chat_id = user ? user->id : 0;
-            } else if (info.category == PathCategory::GROUP_FILES_DIR) {
-                auto* group = find_group_by_dir_name(info.entity_name);
-                chat_id = group ? group->id : 0;
-            } else {
-                auto* channel = find_channel_by_dir_name(info.entity_name);
-                chat_id = channel ? channel->id : 0;
-            }
+        case PathCategory::CHANNEL_FILES_DIR:
+        case PathCategory::USER_MEDIA_DIR:
+        case PathCategory::GROUP_MEDIA_DIR:
+        case PathCategory::CHANNEL_MEDIA_DIR:
+            visit_directory(path, [&entries](const Entry& entry) {
+                entries.push_back(entry);
+                return true;
+            });
+            break;
 
+        case PathCategory::USER_HISTORY_DIR:
+        case PathCategory::GROUP_HISTORY_DIR:
+        case PathCategory::CHANNEL_HISTORY_DIR: {
+            // One file per day, sized from the bucket index; only days never sized are rendered
+            auto chat_id = get_chat_id_from_path(info);
             if (chat_id != 0) {
-                // Get cached files
-                auto files = client_.cache().get_cached_file_list(chat_id);
-
-                // If no cached files, release lock and fetch from API
-                if (files.empty()) {
-                    lock.unlock();
-                    ensure_files_loaded(chat_id);
-                    lock.lock();
-                    files = client_.cache().get_cached_file_list(chat_id);
-                }
-
-                for (const auto& file : files) {
-                    // Only show documents in files/ directory (not photos/videos)
-                    if (!tg::is_document_type(file.type)) {
-                        continue;
-                    }
-                    auto entry = Entry::file(
-                        format_file_entry_name(file), static_cast<std::size_t>(file.file_size > 0 ? file.file_size : 0)
-                    );
-                    entry.mtime = static_cast<std::time_t>(file.timestamp);
+                ensure_history_cached(chat_id);
+                for (const auto& bucket : history_buckets(chat_id)) {
+                    auto entry = Entry::file(history_day_name(bucket.start_ts), *bucket.content_size, 0400);
+                    entry.mtime = static_cast<std::time_t>(bucket.last_message_time);
                     entry.atime = entry.mtime;
                     entry.ctime = entry.mtime;
                     entries.push_back(std::move(entry));
                 }
-
-                // Add pending/completed uploads in this directory
-                add_uploads_to_listing(path, entries);
             }
             break;
         }
 
+        default:
+            break;
+    }
+
+    return entries;
+}
+
+int TelegramDataProvider::visit_directory(std::string_view path, const EntryVisitor& visit) {
+    tg::TraceSpan span("provider", "visit_directory");
+    auto info = parse_path(path);
+
+    // Section listings: one entry per chat, with the chats actually listed queued for prefetching
+    auto visit_section = [&](const auto& chats, auto&& listed_in, auto&& make_entry) {
+        std::vector<int64_t> listed;
+        for (const auto& [name, chat] : chats) {
+            if (!listed_in(chat)) {
+                continue;
+            }
+            listed.push_back(chat.id);
+            if (!visit(make_entry(name, chat))) {
+                break;
+            }
+        }
+        prefetch_listed_chats(listed);
+        return 0;
+    };
+    auto every_chat = [](const auto&) { return true; };
+    auto chat_dir = [](const std::string& name, const auto& chat) {
+        auto entry = Entry::directory(name);
+        // Set mtime to last message timestamp
+        if (chat.last_message_timestamp > 0) {
+            entry.mtime = static_cast<std::time_t>(chat.last_message_timestamp);
+            entry.atime = entry.mtime;
+            entry.ctime = entry.mtime;
+        }
+        return entry;
+    };
+
+    switch (info.category) {
+        case PathCategory::USERS_DIR: {
+            ensure_users_loaded();
+            auto snap = snapshot();
+            return visit_section(snap->users, every_chat, chat_dir);
+        }
+
+        case PathCategory::CONTACTS_DIR: {
+            // Symlinks to users directory for contacts only
+            ensure_users_loaded();
+            auto snap = snapshot();
+            return visit_section(
+                snap->users,
+                [this](const tg::User& user) { return is_user_contact(user); },
+                [this](const std::string& name, const tg::User&) {
+                    auto target = (std::filesystem::path(kUsersDir) / name).string();
+                    return Entry::symlink(name, make_symlink_target(target));
+                }
+            );
+        }
+
+        case PathCategory::GROUPS_DIR: {
+            ensure_groups_loaded();
+            auto snap = snapshot();
+            return visit_section(snap->groups, every_chat, chat_dir);
+        }
+
+        case PathCategory::CHANNELS_DIR: {
+            ensure_channels_loaded();
+            auto snap = snapshot();
+            return visit_section(snap->channels, every_chat, chat_dir);
+        }
+
+        case PathCategory::USER_FILES_DIR:
+        case PathCategory::GROUP_FILES_DIR:
+        case PathCategory::CHANNEL_FILES_DIR:
         case PathCategory::USER_MEDIA_DIR:
         case PathCategory::GROUP_MEDIA_DIR:
         case PathCategory::CHANNEL_MEDIA_DIR: {
-            // Get chat ID while holding lock
-            int64_t chat_id = 0;
-            if (info.category == PathCategory::USER_MEDIA_DIR) {
-                auto* user = find_user_by_dir_name(info.entity_name);
-                chat_id = user ? user->id : 0;
-            } else if (info.category == PathCategory::GROUP_MEDIA_DIR) {
-                auto* group = find_group_by_dir_name(info.entity_name);
-                chat_id = group ? group->id : 0;
-            } else {
-                auto* channel = find_channel_by_dir_name(info.entity_name);
-                chat_id = channel ? channel->id : 0;
+            ensure_users_loaded();
+            ensure_groups_loaded();
+            ensure_channels_loaded();
+            auto chat_id = get_chat_id_for_files(info);
+            if (chat_id == 0) {
+                return 0;
             }
 
-            if (chat_id != 0) {
-                // Get cached files
-                auto files = client_.cache().get_cached_file_list(chat_id);
-
-                // If no cached files, release lock and fetch from API
-                if (files.empty()) {
-                    lock.unlock();
-                    ensure_files_loaded(chat_id);
-                    lock.lock();
-                    files = client_.cache().get_cached_file_list(chat_id);
-                }
+            auto index = file_index(chat_id);
+            bool media = info.category == PathCategory::USER_MEDIA_DIR ||
+                         info.category == PathCategory::GROUP_MEDIA_DIR ||
+                         info.category == PathCategory::CHANNEL_MEDIA_DIR;
+            if (media) {
+                // A file manager reads every file for thumbnails next: fetch the small ones now
+                prefetch_listed_media(*index);
+            }
 
-                for (const auto& file : files) {
-                    // Only show media in media/ directory (photos/videos/animations)
-                    if (!tg::is_media_type(file.type)) {
-                        continue;
-                    }
-                    auto entry = Entry::file(
-                        format_file_entry_name(file), static_cast<std::size_t>(file.file_size > 0 ? file.file_size : 0)
-                    );
-                    entry.mtime = static_cast<std::time_t>(file.timestamp);
-                    entry.atime = entry.mtime;
-                    entry.ctime = entry.mtime;
-                    entries.push_back(std::move(entry));
+            for (const auto& [file, entry_name] : index->files) {
+                // Documents go in files/, photos/videos/animations in media/
+                if (!(media ? tg::is_media_type(file.type) : tg::is_document_type(file.type))) {
+                    continue;
+                }
+                auto entry = Entry::file(entry_name, static_cast<std::size_t>(file.file_size > 0 ? file.file_size : 0));
+                entry.mtime = static_cast<std::time_t>(file.timestamp);
+                entry.atime = entry.mtime;
+                entry.ctime = entry.mtime;
+                if (!visit(entry)) {
+                    return 0;
                 }
+            }
 
-                // Add pending/completed uploads in this directory
-                add_uploads_to_listing(path, entries);
+            // Pending/completed uploads in this directory come last
+            std::vector<Entry> uploads;
+            add_uploads_to_listing(path, uploads);
+            for (const auto& entry : uploads) {
+                if (!visit(entry)) {
+                    break;
+                }
             }
-            break;
+            return 0;
         }
 
         default:
-            break;
+            return DataProvider::visit_directory(path, visit);
     }
-
-    return entries;
 }
 
 std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
+    tg::TraceSpan span("provider", "get_entry");
     ensure_users_loaded();
     ensure_current_user_loaded();
     ensure_groups_loaded();
     ensure_channels_loaded();
 
-    std::unique_lock<std::mutex> lock(mutex_);
+    auto snap = snapshot();
     auto info = parse_path(path);
 
     switch (info.category) {
@@ -1042,24 +1564,66 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
         case PathCategory::UPLOADS_DIR:
             return Entry::directory(std::string(kUploadsDir));
 
+        case PathCategory::UPLOAD_STATUS: {
+            auto files = upload_status_files();
+            auto it = files.find(std::string(info.file_entry_name));
+            if (it != files.end()) {
+                auto entry = Entry::file(it->first, it->second.size(), 0444);
+                entry.mtime = std::time(nullptr);
+                entry.atime = entry.mtime;
+                entry.ctime = entry.mtime;
+                return entry;
+            }
+            break;
+        }
+
+        case PathCategory::STATS_JSON:
+        case PathCategory::STATS_PROMETHEUS: {
+            auto name = info.category == PathCategory::STATS_JSON ? kStatsFile : kStatsPrometheusFile;
+            auto entry = Entry::file(std::string(name), 0, 0444);  // Sized by reading it, see read_file
+            entry.mtime = std::time(nullptr);
+            entry.atime = entry.mtime;
+            entry.ctime = entry.mtime;
+            return entry;
+        }
+
+        case PathCategory::TRACE_FILE: {
+            auto entry = Entry::file(std::string(kTraceFile), 0, 0444);  // Sized by reading it, like .stats
+            entry.mtime = std::time(nullptr);
+            entry.atime = entry.mtime;
+            entry.ctime = entry.mtime;
+            return entry;
+        }
+
         case PathCategory::TEXT_DIR:
             return Entry::directory(std::string(kTextDir));
 
+        case PathCategory::SEARCH_DIR:
+            return Entry::directory(std::string(kSearchDir));
+
+        case PathCategory::SEARCH_RESULT: {
+            // Any query exists; it's only run when opened (read with direct_io, so stat doesn't search)
+            auto entry = Entry::file(std::string(info.file_entry_name), 0, 0444);
+            entry.mtime = std::time(nullptr);
+            entry.atime = entry.mtime;
+            entry.ctime = entry.mtime;
+            return entry;
+        }
+
         case PathCategory::TEXT_SYMLINK: {
             // Symlink from /text/@username to /users/<dir_name>/txt
-            for (const auto& [dir_name, user] : users_) {
-                if (user.username == info.entity_name && is_user_contact(user)) {
-                    auto target = (std::filesystem::path(kUsersDir) / dir_name / kTxtFile).string();
-                    return Entry::symlink("@" + user.username, make_symlink_target(target));
-                }
+            auto ref = snap->find_user_by_username(info.entity_name);
+            if (ref && is_user_contact(*ref->user)) {
+                auto target = (std::filesystem::path(kUsersDir) / ref->dir_name / kTxtFile).string();
+                return Entry::symlink("@" + ref->user->username, make_symlink_target(target));
             }
             break;
         }
 
         case PathCategory::USER_DIR: {
-            auto* user = find_user_by_dir_name(info.entity_name);
+            auto* user = snap->find_user(info.entity_name);
             if (user) {
-                auto entry = Entry::directory(info.entity_name);
+                auto entry = Entry::directory(std::string(info.entity_name));
                 if (user->last_message_timestamp > 0) {
                     entry.mtime = static_cast<std::time_t>(user->last_message_timestamp);
                     entry.atime = entry.mtime;
@@ -1071,7 +1635,7 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
         }
 
         case PathCategory::USER_INFO: {
-            auto* user = find_user_by_dir_name(info.entity_name);
+            auto* user = snap->find_user(info.entity_name);
             if (user) {
                 // Use a large fixed size since content is generated dynamically
                 // (bio and other fields are fetched lazily in read_file)
@@ -1087,9 +1651,9 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
         }
 
         case PathCategory::GROUP_DIR: {
-            auto* group = find_group_by_dir_name(info.entity_name);
+            auto* group = snap->find_group(info.entity_name);
             if (group) {
-                auto entry = Entry::directory(info.entity_name);
+                auto entry = Entry::directory(std::string(info.entity_name));
                 if (group->last_message_timestamp > 0) {
                     entry.mtime = static_cast<std::time_t>(group->last_message_timestamp);
                     entry.atime = entry.mtime;
@@ -1101,7 +1665,7 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
         }
 
         case PathCategory::GROUP_INFO: {
-            auto* group = find_group_by_dir_name(info.entity_name);
+            auto* group = snap->find_group(info.entity_name);
             if (group) {
                 auto entry = Entry::file(std::string(kInfoFile), 4096);
                 if (group->last_message_timestamp > 0) {
@@ -1115,9 +1679,9 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
         }
 
         case PathCategory::CHANNEL_DIR: {
-            auto* channel = find_channel_by_dir_name(info.entity_name);
+            auto* channel = snap->find_channel(info.entity_name);
             if (channel) {
-                auto entry = Entry::directory(info.entity_name);
+                auto entry = Entry::directory(std::string(info.entity_name));
                 if (channel->last_message_timestamp > 0) {
                     entry.mtime = static_cast<std::time_t>(channel->last_message_timestamp);
                     entry.atime = entry.mtime;
@@ -1129,7 +1693,7 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
         }
 
         case PathCategory::CHANNEL_INFO: {
-            auto* channel = find_channel_by_dir_name(info.entity_name);
+            auto* channel = snap->find_channel(info.entity_name);
             if (channel) {
                 auto entry = Entry::file(std::string(kInfoFile), 4096);
                 if (channel->last_message_timestamp > 0) {
@@ -1143,7 +1707,7 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
         }
 
         case PathCategory::USER_MESSAGES: {
-            auto* user = find_user_by_dir_name(info.entity_name);
+            auto* user = snap->find_user(info.entity_name);
             if (user) {
                 auto entry = Entry::file("messages", estimate_messages_size(user->id), 0400);
                 if (user->last_message_timestamp > 0) {
@@ -1157,7 +1721,7 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
         }
 
         case PathCategory::USER_TXT: {
-            auto* user = find_user_by_dir_name(info.entity_name);
+            auto* user = snap->find_user(info.entity_name);
             if (user) {
                 auto entry = Entry::file(std::string(kTxtFile), get_txt_file_size(user->id), 0600);
                 if (user->last_message_timestamp > 0) {
@@ -1171,7 +1735,7 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
         }
 
         case PathCategory::GROUP_MESSAGES: {
-            auto* group = find_group_by_dir_name(info.entity_name);
+            auto* group = snap->find_group(info.entity_name);
             if (group) {
                 auto entry = Entry::file("messages", estimate_messages_size(group->id), 0400);
                 if (group->last_message_timestamp > 0) {
@@ -1185,7 +1749,7 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
         }
 
         case PathCategory::GROUP_TXT: {
-            auto* group = find_group_by_dir_name(info.entity_name);
+            auto* group = snap->find_group(info.entity_name);
             // Only expose txt if user can send messages
             if (group && group->can_send_messages) {
                 auto entry = Entry::file(std::string(kTxtFile), get_txt_file_size(group->id), 0600);
@@ -1200,7 +1764,7 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
         }
 
         case PathCategory::CHANNEL_MESSAGES: {
-            auto* channel = find_channel_by_dir_name(info.entity_name);
+            auto* channel = snap->find_channel(info.entity_name);
             if (channel) {
                 auto entry = Entry::file("messages", estimate_messages_size(channel->id), 0400);
                 if (channel->last_message_timestamp > 0) {
@@ -1214,7 +1778,7 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
         }
 
         case PathCategory::CHANNEL_TXT: {
-            auto* channel = find_channel_by_dir_name(info.entity_name);
+            auto* channel = snap->find_channel(info.entity_name);
             // Only expose txt if user can send messages
             if (channel && channel->can_send_messages) {
                 auto entry = Entry::file(std::string(kTxtFile), get_txt_file_size(channel->id), 0600);
@@ -1228,11 +1792,22 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
             break;
         }
 
+        case PathCategory::USER_MESSAGES_TAIL:
+        case PathCategory::USER_HISTORY_DIR:
+        case PathCategory::USER_HISTORY_DAY:
+        case PathCategory::GROUP_MESSAGES_TAIL:
+        case PathCategory::GROUP_HISTORY_DIR:
+        case PathCategory::GROUP_HISTORY_DAY:
+        case PathCategory::CHANNEL_MESSAGES_TAIL:
+        case PathCategory::CHANNEL_HISTORY_DIR:
+        case PathCategory::CHANNEL_HISTORY_DAY:
+            return get_history_entry(info);
+
         case PathCategory::CONTACT_SYMLINK: {
-            auto* user = find_user_by_dir_name(info.entity_name);
+            auto* user = snap->find_user(info.entity_name);
             if (user && is_user_contact(*user)) {
                 auto target = (std::filesystem::path(kUsersDir) / info.entity_name).string();
-                return Entry::symlink(info.entity_name, make_symlink_target(target));
+                return Entry::symlink(std::string(info.entity_name), make_symlink_target(target));
             }
             break;
         }
@@ -1241,18 +1816,17 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
             // Root symlinks are only for users with actual usernames
             // info.entity_name is the username (without @)
             // Find user by username, not by dir_name
-            for (const auto& [dir_name, user] : users_) {
-                if (user.username == info.entity_name && is_user_contact(user)) {
-                    auto target = (std::filesystem::path(kUsersDir) / dir_name).string();
-                    return Entry::symlink("@" + user.username, make_symlink_target(target));
-                }
+            auto ref = snap->find_user_by_username(info.entity_name);
+            if (ref && is_user_contact(*ref->user)) {
+                auto target = (std::filesystem::path(kUsersDir) / ref->dir_name).string();
+                return Entry::symlink("@" + ref->user->username, make_symlink_target(target));
             }
             break;
         }
 
         case PathCategory::SELF_SYMLINK: {
-            if (current_user_) {
-                auto dir_name = get_user_dir_name(*current_user_);
+            if (snap->current_user) {
+                auto dir_name = get_user_dir_name(*snap->current_user);
                 auto target = (std::filesystem::path(kUsersDir) / dir_name).string();
                 return Entry::symlink(std::string(kSelfSymlink), make_symlink_target(target));
             }
@@ -1265,11 +1839,11 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
             // Verify the parent entity exists
             bool exists = false;
             if (info.category == PathCategory::USER_FILES_DIR) {
-                exists = find_user_by_dir_name(info.entity_name) != nullptr;
+                exists = snap->find_user(info.entity_name) != nullptr;
             } else if (info.category == PathCategory::GROUP_FILES_DIR) {
-                exists = find_group_by_dir_name(info.entity_name) != nullptr;
+                exists = snap->find_group(info.entity_name) != nullptr;
             } else {
-                exists = find_channel_by_dir_name(info.entity_name) != nullptr;
+                exists = snap->find_channel(info.entity_name) != nullptr;
             }
             if (exists) {
                 return Entry::directory(std::string(kFilesDir));
@@ -1280,32 +1854,23 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
         case PathCategory::USER_FILE:
         case PathCategory::GROUP_FILE:
         case PathCategory::CHANNEL_FILE: {
-            // Get chat ID while holding lock
+            // Resolve chat ID from the snapshot
             int64_t chat_id = 0;
             if (info.category == PathCategory::USER_FILE) {
-                auto* user = find_user_by_dir_name(info.entity_name);
+                auto* user = snap->find_user(info.entity_name);
                 chat_id = user ? user->id : 0;
             } else if (info.category == PathCategory::GROUP_FILE) {
-                auto* group = find_group_by_dir_name(info.entity_name);
+                auto* group = snap->find_group(info.entity_name);
                 chat_id = group ? group->id : 0;
             } else {
-                auto* channel = find_channel_by_dir_name(info.entity_name);
+                auto* channel = snap->find_channel(info.entity_name);
                 chat_id = channel ? channel->id : 0;
             }
 
             if (chat_id != 0) {
-                // Check cache first
-                auto files = client_.cache().get_cached_file_list(chat_id);
-                if (files.empty()) {
-                    // Release lock and fetch from API
-                    lock.unlock();
-                    ensure_files_loaded(chat_id);
-                    lock.lock();
-                    files = client_.cache().get_cached_file_list(chat_id);
-                }
-
-                // Find the file by entry name
-                auto* file = find_file_by_entry_name(chat_id, info.file_entry_name);
+                // Find the file by entry name, syncing from the API if stale
+                // (no locks held - the snapshot stays valid)
+                auto file = find_file_by_entry_name(chat_id, info.file_entry_name);
                 // Only return documents (not photos/videos)
                 if (file && tg::is_document_type(file->type)) {
                     auto entry = Entry::file(
@@ -1327,11 +1892,11 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
             // Verify the parent entity exists
             bool exists = false;
             if (info.category == PathCategory::USER_MEDIA_DIR) {
-                exists = find_user_by_dir_name(info.entity_name) != nullptr;
+                exists = snap->find_user(info.entity_name) != nullptr;
             } else if (info.category == PathCategory::GROUP_MEDIA_DIR) {
-                exists = find_group_by_dir_name(info.entity_name) != nullptr;
+                exists = snap->find_group(info.entity_name) != nullptr;
             } else {
-                exists = find_channel_by_dir_name(info.entity_name) != nullptr;
+                exists = snap->find_channel(info.entity_name) != nullptr;
             }
             if (exists) {
                 return Entry::directory(std::string(kMediaDir));
@@ -1342,32 +1907,23 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
         case PathCategory::USER_MEDIA:
         case PathCategory::GROUP_MEDIA:
         case PathCategory::CHANNEL_MEDIA: {
-            // Get chat ID while holding lock
+            // Resolve chat ID from the snapshot
             int64_t chat_id = 0;
             if (info.category == PathCategory::USER_MEDIA) {
-                auto* user = find_user_by_dir_name(info.entity_name);
+                auto* user = snap->find_user(info.entity_name);
                 chat_id = user ? user->id : 0;
             } else if (info.category == PathCategory::GROUP_MEDIA) {
-                auto* group = find_group_by_dir_name(info.entity_name);
+                auto* group = snap->find_group(info.entity_name);
                 chat_id = group ? group->id : 0;
             } else {
-                auto* channel = find_channel_by_dir_name(info.entity_name);
+                auto* channel = snap->find_channel(info.entity_name);
                 chat_id = channel ? channel->id : 0;
             }
 
             if (chat_id != 0) {
-                // Check cache first
-                auto files = client_.cache().get_cached_file_list(chat_id);
-                if (files.empty()) {
-                    // Release lock and fetch from API
-                    lock.unlock();
-                    ensure_files_loaded(chat_id);
-                    lock.lock();
-                    files = client_.cache().get_cached_file_list(chat_id);
-                }
-
-                // Find the file by entry name
-                auto* file = find_file_by_entry_name(chat_id, info.file_entry_name);
+                // Find the file by entry name, syncing from the API if stale
+                // (no locks held - the snapshot stays valid)
+                auto file = find_file_by_entry_name(chat_id, info.file_entry_name);
                 // Only return media (photos/videos/animations)
                 if (file && tg::is_media_type(file->type)) {
                     auto entry = Entry::file(
@@ -1388,9 +1944,7 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
     }
 
     // Check if this is a pending upload (file being created)
-    // We need to release the main lock before checking uploads_mutex_ to avoid deadlock
-    lock.unlock();
-    if (auto* upload = find_pending_upload_by_path(path)) {
+    if (auto upload = find_pending_upload_by_path(path)) {
         // Return a synthetic entry for the file being uploaded
         auto filename = std::filesystem::path(upload->virtual_path).filename().string();
         auto entry = Entry::file(filename, upload->bytes_written, 0644);
@@ -1401,7 +1955,7 @@ std::optional<Entry> TelegramDataProvider::get_entry(std::string_view path) {
     }
 
     // Check if this is a recently completed upload (for post-release operations like setxattr)
-    if (auto* completed = find_completed_upload_by_path(path)) {
+    if (auto completed = find_completed_upload_by_path(path)) {
         auto entry = Entry::file(completed->filename, completed->size, 0644);
         entry.mtime = std::time(nullptr);
         entry.atime = entry.mtime;
@@ -1425,6 +1979,7 @@ bool TelegramDataProvider::is_symlink(std::string_view path) {
 }
 
 FileContent TelegramDataProvider::read_file(std::string_view path) {
+    tg::TraceSpan span("provider", "read_file");
     ensure_users_loaded();
     ensure_groups_loaded();
     ensure_channels_loaded();
@@ -1435,89 +1990,81 @@ FileContent TelegramDataProvider::read_file(std::string_view path) {
     content.readable = false;
 
     if (info.category == PathCategory::USER_INFO) {
-        tg::User user_copy;
-        bool found = false;
-
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            auto* user = find_user_by_dir_name(info.entity_name);
-            if (user) {
-                user_copy = *user;
-                found = true;
-            }
-        }
-
-        if (found) {
-            // Fetch full user info lazily if not already loaded
-            if (user_copy.phone_number.empty() && user_copy.status == tg::UserStatus::UNKNOWN) {
-                try {
-                    auto user_task = client_.get_user(user_copy.id);
-                    auto full_user = user_task.get_result();
-                    if (full_user) {
-                        // Preserve last_message info from chat
-                        full_user->last_message_id = user_copy.last_message_id;
-                        full_user->last_message_timestamp = user_copy.last_message_timestamp;
-                        user_copy = *full_user;
-
-                        // Cache for future reads
-                        std::lock_guard<std::mutex> lock(mutex_);
-                        auto it = users_.find(info.entity_name);
-                        if (it != users_.end()) {
-                            it->second = user_copy;
-                        }
-                    }
-                } catch (const std::exception& e) {
-                    spdlog::debug("Failed to fetch user info for {}: {}", user_copy.id, e.what());
-                }
-            }
-
-            // Fetch bio lazily if not already loaded
-            if (user_copy.bio.empty()) {
-                try {
-                    auto bio_task = client_.get_user_bio(user_copy.id);
-                    user_copy.bio = bio_task.get_result();
-
-                    // Cache the bio for future reads
-                    if (!user_copy.bio.empty()) {
-                        std::lock_guard<std::mutex> lock(mutex_);
-                        auto it = users_.find(info.entity_name);
-                        if (it != users_.end()) {
-                            it->second.bio = user_copy.bio;
-                        }
-                    }
-                } catch (const std::exception& e) {
-                    spdlog::debug("Failed to fetch bio for user {}: {}", user_copy.id, e.what());
-                }
-            }
-
-            content.data = generate_user_info(user_copy);
+        if (auto* user = snapshot()->find_user(info.entity_name)) {
+            auto user_copy = *user;
+            content.data = cached_info(user_copy.id, [&] { return generate_user_info(with_full_info(user_copy)); });
+            content.readable = true;
+        }
+    } else if (info.category == PathCategory::UPLOAD_STATUS) {
+        auto files = upload_status_files();
+        auto it = files.find(std::string(info.file_entry_name));
+        if (it != files.end()) {
+            content.data = std::move(it->second);
             content.readable = true;
         }
+    } else if (info.category == PathCategory::STATS_JSON || info.category == PathCategory::STATS_PROMETHEUS) {
+        // Counters move between getattr and read: a size reported in advance would cut the report short
+        content.data = stats_report(info.category);
+        content.direct_io = true;
+        content.readable = true;
+    } else if (info.category == PathCategory::TRACE_FILE) {
+        // Longer at read than at getattr, if only by the spans of the getattr and the open
+        content.data = tg::Tracer::global().chrome_trace_json();
+        content.direct_io = true;
+        content.readable = true;
+    } else if (info.category == PathCategory::SEARCH_RESULT) {
+        // Run once per open: messages arriving later change the results, not this snapshot
+        content.data = search_results(info.file_entry_name);
+        content.direct_io = true;
+        content.readable = true;
     } else if (info.category == PathCategory::GROUP_INFO) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto* group = find_group_by_dir_name(info.entity_name);
+        auto snap = snapshot();
+        auto* group = snap->find_group(info.entity_name);
         if (group) {
-            content.data = generate_group_info(*group);
+            content.data = cached_info(group->id, [&] { return generate_group_info(*group); });
             content.readable = true;
         }
     } else if (info.category == PathCategory::CHANNEL_INFO) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto* channel = find_channel_by_dir_name(info.entity_name);
+        auto snap = snapshot();
+        auto* channel = snap->find_channel(info.entity_name);
         if (channel) {
-            content.data = generate_channel_info(*channel);
+            content.data = cached_info(channel->id, [&] { return generate_channel_info(*channel); });
             content.readable = true;
         }
     } else if (is_messages_path(info.category)) {
         int64_t chat_id = get_chat_id_from_path(info);
         if (chat_id != 0) {
-            content.data = fetch_and_format_messages(chat_id);
+            if (prefetcher_) {
+                prefetcher_->record_access(chat_id);
+            }
+            content.shared = fetch_and_format_messages(chat_id);
             content.readable = true;
         }
+    } else if (is_history_path(info.category)) {
+        // Rendered from SQLite by range: the newest messages, or one day
+        int64_t chat_id = get_chat_id_from_path(info);
+        if (chat_id != 0) {
+            if (prefetcher_) {
+                prefetcher_->record_access(chat_id);
+            }
+            ensure_history_cached(chat_id);
+            bool tail = info.category == PathCategory::USER_MESSAGES_TAIL ||
+                        info.category == PathCategory::GROUP_MESSAGES_TAIL ||
+                        info.category == PathCategory::CHANNEL_MESSAGES_TAIL;
+            if (tail) {
+                // Every message arriving after the open would make a size reported earlier too short
+                content.data = render_messages_tail(chat_id);
+                content.direct_io = true;
+                content.readable = true;
+            } else if (auto bucket = find_history_bucket(chat_id, info.file_entry_name)) {
+                content.data = render_history_day(chat_id, *bucket);
+                content.readable = true;
+            }
+        }
     } else if (is_file_path(info.category)) {
         int64_t chat_id = get_chat_id_for_files(info);
         if (chat_id != 0) {
-            ensure_files_loaded(chat_id);
-            auto* file = find_file_by_entry_name(chat_id, info.file_entry_name);
+            auto file = find_file_by_entry_name(chat_id, info.file_entry_name);
             if (file && tg::is_document_type(file->type)) {
                 content = download_and_read_file(*file);
             }
@@ -1525,8 +2072,7 @@ FileContent TelegramDataProvider::read_file(std::string_view path) {
     } else if (is_media_path(info.category)) {
         int64_t chat_id = get_chat_id_for_files(info);
         if (chat_id != 0) {
-            ensure_files_loaded(chat_id);
-            auto* file = find_file_by_entry_name(chat_id, info.file_entry_name);
+            auto file = find_file_by_entry_name(chat_id, info.file_entry_name);
             if (file && tg::is_media_type(file->type)) {
                 content = download_and_read_file(*file);
             }
@@ -1552,36 +2098,34 @@ FileContent TelegramDataProvider::read_file(std::string_view path) {
 std::string TelegramDataProvider::read_link(std::string_view path) {
     ensure_current_user_loaded();
 
-    std::lock_guard<std::mutex> lock(mutex_);
+    auto snap = snapshot();
     auto info = parse_path(path);
 
     if (info.category == PathCategory::ROOT_SYMLINK) {
         // Find user by username
-        for (const auto& [dir_name, user] : users_) {
-            if (user.username == info.entity_name && is_user_contact(user)) {
-                auto target = (std::filesystem::path(kUsersDir) / dir_name).string();
-                return make_symlink_target(target);
-            }
+        auto ref = snap->find_user_by_username(info.entity_name);
+        if (ref && is_user_contact(*ref->user)) {
+            auto target = (std::filesystem::path(kUsersDir) / ref->dir_name).string();
+            return make_symlink_target(target);
         }
     } else if (info.category == PathCategory::CONTACT_SYMLINK) {
-        auto* user = find_user_by_dir_name(info.entity_name);
+        auto* user = snap->find_user(info.entity_name);
         if (user && is_user_contact(*user)) {
             auto target = (std::filesystem::path(kUsersDir) / info.entity_name).string();
             return make_symlink_target(target);
         }
     } else if (info.category == PathCategory::SELF_SYMLINK) {
-        if (current_user_) {
-            auto dir_name = get_user_dir_name(*current_user_);
+        if (snap->current_user) {
+            auto dir_name = get_user_dir_name(*snap->current_user);
             auto target = (std::filesystem::path(kUsersDir) / dir_name).string();
             return make_symlink_target(target);
         }
     } else if (info.category == PathCategory::TEXT_SYMLINK) {
         // Symlink from /text/@username to /users/<dir_name>/txt
-        for (const auto& [dir_name, user] : users_) {
-            if (user.username == info.entity_name && is_user_contact(user)) {
-                auto target = (std::filesystem::path(kUsersDir) / dir_name / kTxtFile).string();
-                return make_symlink_target(target);
-            }
+        auto ref = snap->find_user_by_username(info.entity_name);
+        if (ref && is_user_contact(*ref->user)) {
+            auto target = (std::filesystem::path(kUsersDir) / ref->dir_name / kTxtFile).string();
+            return make_symlink_target(target);
         }
     }
 
@@ -1618,11 +2162,120 @@ std::string TelegramDataProvider::generate_user_info(const tg::User& user) const
     return oss.str();
 }
 
+tg::User TelegramDataProvider::with_full_info(const tg::User& user) {
+    bool need_full = user.phone_number.empty() && user.status == tg::UserStatus::UNKNOWN;
+    if (!need_full && !user.bio.empty()) {
+        return user;
+    }
+
+    // Concurrent reads of the same .info (a cat and an ls -l, or a scan of every .info) share one fetch
+    auto fetch = [&]() -> std::optional<tg::User> {
+        try {
+            if (!need_full) {
+                // Only the bio is missing
+                auto with_bio = user;
+                with_bio.bio = client_.get_user_bio(user.id).get_result();
+                return with_bio;
+            }
+            // get_user fetches the bio alongside, so no separate bio request is needed
+            auto full_user = client_.get_user(user.id).get_result();
+            if (full_user) {
+                // Preserve last_message info from chat
+                full_user->last_message_id = user.last_message_id;
+                full_user->last_message_timestamp = user.last_message_timestamp;
+                if (full_user->bio.empty()) {
+                    full_user->bio = user.bio;
+                }
+            }
+            return full_user;
+        } catch (const std::exception& e) {
+            spdlog::debug("Failed to fetch user info for {}: {}", user.id, e.what());
+            return std::nullopt;
+        }
+    };
+    auto fetched = user_info_flights_.run(user.id, fetch, flight_rank());
+    if (!fetched) {
+        return user;
+    }
+
+    // Cache for future reads (merged into the next snapshot)
+    if (need_full || !fetched->bio.empty()) {
+        queue_user_update(*fetched);
+    }
+    return *fetched;
+}
+
+std::string TelegramDataProvider::cached_info(int64_t id, const std::function<std::string()>& generate) {
+    static auto& hits = tg::Metrics::global().counter({"info_cache_lookups_total", "result", "hit"});
+    static auto& misses = tg::Metrics::global().counter({"info_cache_lookups_total", "result", "miss"});
+
+    auto now = std::chrono::steady_clock::now();
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(info_cache_mutex_);
+        auto& slot = info_cache_[id];
+        if (slot.valid && now - slot.generated_at < config_.info_ttl) {
+            hits.add(1);
+            return slot.text;
+        }
+        generation = slot.generation;
+    }
+    misses.add(1);
+
+    // Generated unlocked: it may wait on TDLib. Only an invalidation of this id makes it stale.
+    auto text = generate();
+    if (config_.info_ttl.count() > 0) {
+        std::lock_guard<std::mutex> lock(info_cache_mutex_);
+        auto& slot = info_cache_[id];
+        if (slot.generation == generation) {
+            slot.text = text;
+            slot.generated_at = now;
+            slot.valid = true;
+        }
+    }
+    return text;
+}
+
+void TelegramDataProvider::invalidate_info(std::optional<int64_t> id) {
+    // Slots stay, so a generation already running for the id sees the bump
+    auto invalidate = [](CachedInfo& slot) {
+        ++slot.generation;
+        slot.valid = false;
+        std::string().swap(slot.text);
+    };
+
+    std::lock_guard<std::mutex> lock(info_cache_mutex_);
+    if (!id) {
+        for (auto& [slot_id, slot] : info_cache_) {
+            invalidate(slot);
+        }
+    } else if (auto it = info_cache_.find(*id); it != info_cache_.end()) {
+        invalidate(it->second);
+    }
+}
+
 bool TelegramDataProvider::is_messages_path(PathCategory category) const {
     return category == PathCategory::USER_MESSAGES || category == PathCategory::GROUP_MESSAGES ||
            category == PathCategory::CHANNEL_MESSAGES;
 }
 
+bool TelegramDataProvider::is_history_path(PathCategory category) const {
+    switch (category) {
+        case PathCategory::USER_MESSAGES_TAIL:
+        case PathCategory::USER_HISTORY_DIR:
+        case PathCategory::USER_HISTORY_DAY:
+        case PathCategory::GROUP_MESSAGES_TAIL:
+        case PathCategory::GROUP_HISTORY_DIR:
+        case PathCategory::GROUP_HISTORY_DAY:
+        case PathCategory::CHANNEL_MESSAGES_TAIL:
+        case PathCategory::CHANNEL_HISTORY_DIR:
+        case PathCategory::CHANNEL_HISTORY_DAY:
+            return true;
+        default:
+            return false;
+    }
+}
+
 bool TelegramDataProvider::is_files_dir_path(PathCategory category) const {
     return category == PathCategory::USER_FILES_DIR || category == PathCategory::GROUP_FILES_DIR ||
            category == PathCategory::CHANNEL_FILES_DIR;
@@ -1645,138 +2298,358 @@ bool TelegramDataProvider::is_media_path(PathCategory category) const {
 
 std::string TelegramDataProvider::format_file_entry_name(const tg::FileListItem& item) const {
     std::time_t time = static_cast<std::time_t>(item.timestamp);
-    std::tm* tm = std::localtime(&time);
+    std::tm tm{};
+    localtime_r(&time, &tm);  // std::localtime shares one buffer between FUSE threads
     return fmt::format(
         "{:04d}{:02d}{:02d}-{:02d}{:02d}-{}",
-        tm->tm_year + 1900,
-        tm->tm_mon + 1,
-        tm->tm_mday,
-        tm->tm_hour,
-        tm->tm_min,
+        tm.tm_year + 1900,
+        tm.tm_mon + 1,
+        tm.tm_mday,
+        tm.tm_hour,
+        tm.tm_min,
         item.filename
     );
 }
 
-std::optional<std::pair<std::string, int64_t>> TelegramDataProvider::parse_file_entry_name(
-    const std::string& entry_name
-) const {
-    // Format: YYYYMMDD-HHMM-filename
-    // Minimum length: 8 + 1 + 4 + 1 + 1 = 15 (e.g., "20241205-1430-a")
-    if (entry_name.size() < 15) {
-        return std::nullopt;
-    }
-
-    // Check format: YYYYMMDD-HHMM-
-    if (entry_name[8] != '-' || entry_name[13] != '-') {
-        return std::nullopt;
+void TelegramDataProvider::ChatFileIndex::reindex() {
+    by_entry_name_.clear();
+    by_entry_name_.reserve(files.size());
+    for (const auto& file : files) {
+        by_entry_name_.emplace(file.entry_name, &file.item);
     }
+}
 
-    // Parse date and time
-    try {
-        int year = std::stoi(entry_name.substr(0, 4));
-        int month = std::stoi(entry_name.substr(4, 2));
-        int day = std::stoi(entry_name.substr(6, 2));
-        int hour = std::stoi(entry_name.substr(9, 2));
-        int minute = std::stoi(entry_name.substr(11, 2));
-
-        // Extract filename
-        std::string filename = entry_name.substr(14);
-
-        // Convert to timestamp
-        std::tm tm = {};
-        tm.tm_year = year - 1900;
-        tm.tm_mon = month - 1;
-        tm.tm_mday = day;
-        tm.tm_hour = hour;
-        tm.tm_min = minute;
-        tm.tm_isdst = -1;
-
-        int64_t timestamp = static_cast<int64_t>(std::mktime(&tm));
-        return std::make_pair(filename, timestamp);
-    } catch (...) {
-        return std::nullopt;
-    }
+const tg::FileListItem* TelegramDataProvider::ChatFileIndex::find(std::string_view entry_name) const {
+    auto it = by_entry_name_.find(entry_name);
+    return it != by_entry_name_.end() ? it->second : nullptr;
 }
 
-const tg::FileListItem* TelegramDataProvider::find_file_by_entry_name(int64_t chat_id, const std::string& entry_name) {
-    // Parse the entry name to get original filename and timestamp
-    auto parsed = parse_file_entry_name(entry_name);
-    if (!parsed) {
-        return nullptr;
+TelegramDataProvider::FileIndexPtr TelegramDataProvider::file_index(int64_t chat_id) {
+    // Built from a recent sync: nothing would be fetched, and live appends update the index in place
+    {
+        std::lock_guard<std::mutex> lock(file_indexes_mutex_);
+        if (auto it = file_indexes_.find(chat_id);
+            it != file_indexes_.end() && it->second.index && synced_recently(it->second.index->sync)) {
+            it->second.used = std::chrono::steady_clock::now();
+            return it->second.index;
+        }
     }
 
-    const auto& [filename, timestamp] = *parsed;
-
-    // Get cached files
-    auto files = client_.cache().get_cached_file_list(chat_id);
+    // A resync that found nothing new keeps the watermark, and with it the index
+    auto sync = ensure_files_loaded(chat_id);
+    auto same_sync = [&sync](const ChatFileIndex& index) {
+        return index.sync.has_value() == sync.has_value() && (!sync || index.sync->watermark == sync->watermark);
+    };
 
-    // Find matching file (match by filename and approximate timestamp within same minute)
-    for (const auto& file : files) {
-        if (file.filename == filename) {
-            // Check if timestamp matches within the same minute
-            int64_t file_minute = file.timestamp / 60;
-            int64_t target_minute = timestamp / 60;
-            if (file_minute == target_minute) {
-                // Store in a static to return pointer (safe because we're under mutex)
-                static tg::FileListItem found_file;
-                found_file = file;
-                return &found_file;
+    while (true) {
+        uint64_t appends = 0;
+        {
+            std::lock_guard<std::mutex> lock(file_indexes_mutex_);
+            auto& slot = file_indexes_[chat_id];
+            slot.used = std::chrono::steady_clock::now();
+            if (slot.index && same_sync(*slot.index)) {
+                return slot.index;
             }
+            appends = slot.appends;
+            evict_file_indexes(chat_id);
+        }
+
+        // Build without the lock; live appends are queued to SQLite first, so flushing picks them up
+        client_.cache().flush();
+        auto index = std::make_shared<ChatFileIndex>();
+        index->sync = sync;
+        auto items = client_.cache().get_cached_file_list(chat_id);
+        index->files.reserve(items.size());
+        for (auto& item : items) {
+            auto entry_name = format_file_entry_name(item);
+            index->files.push_back({std::move(item), std::move(entry_name)});
+        }
+        index->reindex();
+
+        std::lock_guard<std::mutex> lock(file_indexes_mutex_);
+        auto it = file_indexes_.find(chat_id);
+        if (it == file_indexes_.end()) {
+            // Evicted while building, so an invalidation may have been missed: serve it but don't keep it
+            return index;
+        }
+        auto& slot = it->second;
+        if (slot.appends == appends) {
+            slot.index = std::move(index);
+            spdlog::debug("Indexed {} files for chat {}", slot.index->files.size(), chat_id);
+            return slot.index;
         }
+        // A file arrived while building: it may have missed the flush, build again
     }
+}
 
-    return nullptr;
+void TelegramDataProvider::evict_file_indexes(int64_t keep_chat_id) {
+    while (file_indexes_.size() > kMaxFileIndexes) {
+        auto oldest = file_indexes_.end();
+        for (auto it = file_indexes_.begin(); it != file_indexes_.end(); ++it) {
+            if (it->first != keep_chat_id && (oldest == file_indexes_.end() || it->second.used < oldest->second.used)) {
+                oldest = it;
+            }
+        }
+        if (oldest == file_indexes_.end()) {
+            return;
+        }
+        spdlog::debug("Dropping the file index of chat {}", oldest->first);
+        file_indexes_.erase(oldest);
+    }
 }
 
-void TelegramDataProvider::ensure_files_loaded(int64_t chat_id) {
-    // Check if we have cached files
-    auto files = client_.cache().get_cached_file_list(chat_id);
-    if (!files.empty()) {
-        return;  // Already have cached files
+void TelegramDataProvider::add_to_file_index(int64_t chat_id, const tg::FileListItem& item) {
+    std::lock_guard<std::mutex> lock(file_indexes_mutex_);
+    auto it = file_indexes_.find(chat_id);
+    if (it == file_indexes_.end()) {
+        return;  // Not indexed yet: the first lookup builds it from SQLite
     }
 
-    // Fetch from Telegram API
-    try {
-        spdlog::debug("Fetching files for chat {} from API", chat_id);
+    auto& slot = it->second;
+    ++slot.appends;
+    if (!slot.index) {
+        return;
+    }
 
-        // Fetch both documents and media (cache all, filter at display time)
-        auto files_task = client_.list_files(chat_id);
-        auto media_task = client_.list_media(chat_id);
+    // Publish a copy with the file first (the list is newest first); readers keep the old one
+    auto index = std::make_shared<ChatFileIndex>(*slot.index);
+    std::erase_if(index->files, [&item](const auto& file) { return file.item.message_id == item.message_id; });
+    index->files.insert(index->files.begin(), {item, format_file_entry_name(item)});
+    index->reindex();
+    slot.index = std::move(index);
+}
 
-        auto file_list = files_task.get_result();
-        auto media_list = media_task.get_result();
+std::optional<tg::FileListItem> TelegramDataProvider::find_file_by_entry_name(
+    int64_t chat_id,
+    std::string_view entry_name
+) {
+    auto index = file_index(chat_id);
+    if (const auto* file = index->find(entry_name)) {
+        return *file;
+    }
+    return std::nullopt;
+}
 
-        // Combine both lists
-        file_list.insert(file_list.end(), media_list.begin(), media_list.end());
+void TelegramDataProvider::prefetch_listed_chats(const std::vector<int64_t>& chat_ids) {
+    if (prefetcher_) {
+        prefetcher_->queue_chats(chat_ids);
+    }
+}
 
-        // Cache the results
-        if (!file_list.empty()) {
-            client_.cache().cache_file_list(chat_id, file_list);
-            spdlog::info("Cached {} files for chat {}", file_list.size(), chat_id);
-        }
-    } catch (const std::exception& e) {
-        spdlog::error("Failed to fetch files for chat {}: {}", chat_id, e.what());
+void TelegramDataProvider::prefetch_opened_chat(int64_t chat_id) {
+    if (prefetcher_) {
+        prefetcher_->record_access(chat_id);
+        prefetcher_->queue_chat(chat_id, PrefetchPriority::HIGH);
+        prefetcher_->queue_files(chat_id);
     }
 }
 
-FileContent TelegramDataProvider::download_and_read_file(const tg::FileListItem& file) {
+std::optional<tg::FileListSync> TelegramDataProvider::ensure_files_loaded(int64_t chat_id) {
+    tg::TraceSpan span("provider", "ensure_files_loaded");
+
+    // Synced recently: new files since then were appended live by the message callback
+    auto sync = client_.cache().get_file_list_sync(chat_id);
+    if (synced_recently(sync)) {
+        return sync;
+    }
+
+    // Warm start: keep serving the persisted list until TDLib is ready, then sync
+    if (reconciling_) {
+        note_warm_served(chat_id);
+        return sync;
+    }
+
+    // One sync per chat however many listings (and the prefetcher) find it due at once
+    auto sync_files = [&]() -> std::optional<tg::FileListSync> {
+        // A flight that finished since the lookup above has synced the chat already
+        auto current = client_.cache().get_file_list_sync(chat_id);
+        if (synced_recently(current)) {
+            return current;
+        }
+
+        // Fetch only the files newer than the last sync (the whole history on the first one)
+        int64_t after = current ? current->watermark : 0;
+        try {
+            spdlog::debug("Fetching files for chat {} after message {} from API", chat_id, after);
+
+            // Fetch both documents and media concurrently (cache all, filter at display time)
+            auto [file_list, media_list] =
+                tg::when_all(client_.list_files(chat_id, after), client_.list_media(chat_id, after)).get_result();
+
+            // Combine both lists
+            file_list.insert(file_list.end(), media_list.begin(), media_list.end());
+
+            int64_t watermark = after;
+            for (const auto& file : file_list) {
+                watermark = std::max(watermark, file.message_id);
+            }
+
+            // Store the new files and the watermark (also when nothing was found, so the chat isn't searched again)
+            client_.cache().sync_file_list(chat_id, file_list, watermark);
+            if (!file_list.empty()) {
+                spdlog::info("Cached {} new files for chat {}", file_list.size(), chat_id);
+            }
+        } catch (const std::exception& e) {
+            spdlog::error("Failed to fetch files for chat {}: {}", chat_id, e.what());
+            return current;
+        }
+        return client_.cache().get_file_list_sync(chat_id);
+    };
+    return file_list_flights_.run(chat_id, sync_files, flight_rank());
+}
+
+void TelegramDataProvider::prefetch_listed_media(const ChatFileIndex& index) {
+    const auto& policy = config_.media_prefetch;
+    if (policy.pool.workers == 0 || policy.per_listing == 0) {
+        return;
+    }
+
+    // Newest first, like the listing; larger files are streamed on read anyway
+    std::vector<std::pair<std::string, DownloadPool::Job>> jobs;
+    for (const auto& [file, entry_name] : index.files) {
+        if (jobs.size() >= policy.per_listing) {
+            break;
+        }
+        if (!tg::is_media_type(file.type) || file.file_id.empty() || file.file_size <= 0 ||
+            file.file_size > static_cast<int64_t>(policy.max_file_size)) {
+            continue;
+        }
+        jobs.emplace_back(file.file_id, [this, file]() {
+            tg::RequestPriorityScope priority(tg::RequestPriority::BACKGROUND);
+            (void)download_file(file.file_id);
+            record_download_access(file, false);
+        });
+    }
+    media_downloads_.queue(std::move(jobs));
+}
+
+std::string TelegramDataProvider::download_file(const std::string& file_id) {
+    // Concurrent reads share a download, and a read-ahead job joins a read's (but not the other way round)
+    auto download = [&] { return client_.download_file(file_id).get_result(); };
+    return download_flights_.run(file_id, download, flight_rank());
+}
+
+void TelegramDataProvider::record_download_access(const tg::FileListItem& file, bool hit) {
+    auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch());
+    client_.cache().queue_download_access({file.file_id, file.file_size, hit ? 1 : 0, now.count()});
+}
+
+void TelegramDataProvider::start_files_trimmer() {
+    if (config_.files_budget.max_bytes == 0) {
+        return;
+    }
+    files_trimmer_running_ = true;
+    files_trimmer_thread_ = std::thread(&TelegramDataProvider::files_trimmer_loop, this);
+    spdlog::debug("Started files trimmer thread ({} MB budget)", config_.files_budget.max_bytes / (1024 * 1024));
+}
+
+void TelegramDataProvider::stop_files_trimmer() {
+    if (files_trimmer_running_) {
+        files_trimmer_running_ = false;
+        files_trimmer_cv_.notify_all();
+        if (files_trimmer_thread_.joinable()) {
+            files_trimmer_thread_.join();
+        }
+        spdlog::debug("Stopped files trimmer thread");
+    }
+}
+
+void TelegramDataProvider::files_trimmer_loop() {
+    tg::RequestPriorityScope priority(tg::RequestPriority::BACKGROUND);
+    while (files_trimmer_running_) {
+        {
+            std::unique_lock<std::mutex> lock(files_trimmer_mutex_);
+            files_trimmer_cv_.wait_for(lock, config_.files_budget.check_interval, [this]() {
+                return !files_trimmer_running_;
+            });
+        }
+        if (!files_trimmer_running_) {
+            break;
+        }
+
+        try {
+            trim_downloaded_files();
+        } catch (const std::exception& e) {
+            spdlog::warn("Failed to trim downloaded files: {}", e.what());
+        }
+    }
+}
+
+void TelegramDataProvider::trim_downloaded_files() {
+    const auto& budget = config_.files_budget;
+    auto max_bytes = static_cast<int64_t>(budget.max_bytes);
+    auto used = client_.get_files_size().get_result();
+    if (used <= max_bytes) {
+        return;
+    }
+
+    // Least recently read first, never the hot working set
+    client_.cache().flush();
+    auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch());
+    auto hot_since = (now - budget.hot_period).count();
+    auto candidates = client_.cache().get_download_eviction_candidates(used - max_bytes, hot_since);
+
+    int64_t freed = 0;
+    std::size_t evicted = 0;
+    for (const auto& candidate : candidates) {
+        if (!files_trimmer_running_) {
+            return;
+        }
+        try {
+            if (client_.delete_local_file(candidate.file_id).get_result()) {
+                freed += candidate.size;
+                ++evicted;
+            }
+        } catch (const std::exception& e) {
+            spdlog::debug("Failed to delete downloaded file {}: {}", candidate.file_id, e.what());
+        }
+        client_.cache().remove_download(candidate.file_id);  // Gone, or no longer ours to track
+    }
+    spdlog::info(
+        "Evicted {} cold downloads ({} KB) to fit the {} MB files budget",
+        evicted,
+        freed / 1024,
+        max_bytes / (1024 * 1024)
+    );
+
+    // Still over: the rest is files we don't track (thumbnails, downloads from before tracking)
+    if (used - freed > max_bytes) {
+        auto left = client_.optimize_storage(max_bytes, budget.hot_period).get_result();
+        spdlog::info("TDLib storage optimiser left {} MB of downloaded files", left / (1024 * 1024));
+    }
+}
+
+FileContent TelegramDataProvider::download_and_read_file(const tg::FileListItem& file) {
     FileContent content;
     content.readable = false;
 
+    if (config_.stream_media && file.file_size > static_cast<int64_t>(config_.media_read_ahead)) {
+        spdlog::debug("Streaming {} (id: {}, {} bytes)", file.filename, file.file_id, file.file_size);
+        auto stream = std::make_shared<MediaStream>(client_, file.file_id, file.file_size, config_.media_read_ahead);
+        record_download_access(file, true);
+        content.range_reader = [this, stream](char* buf, std::size_t size, off_t offset) {
+            auto busy = media_downloads_.interactive();
+            return stream->read(buf, size, offset);
+        };
+        content.readable = true;
+        return content;
+    }
+
     try {
         spdlog::debug("Downloading {} (id: {})", file.filename, file.file_id);
 
-        auto local_path = client_.download_file(file.file_id).get_result();
+        auto busy = media_downloads_.interactive();  // Read-ahead waits until this read has its file
+        auto local_path = download_file(file.file_id);
+        record_download_access(file, true);
 
-        std::ifstream ifs(local_path, std::ios::binary);
-        if (ifs) {
-            std::ostringstream oss;
-            oss << ifs.rdbuf();
-            content.data = oss.str();
+        // Hand out the TDLib cache path; the FUSE layer serves it with pread()
+        std::error_code ec;
+        if (std::filesystem::is_regular_file(local_path, ec)) {
+            content.local_path = std::move(local_path);
             content.readable = true;
-            spdlog::debug("Read {} bytes from {}", content.data.size(), local_path);
+            spdlog::debug("Serving {} from {}", file.filename, content.local_path);
         } else {
-            spdlog::error("Failed to open downloaded file: {}", local_path);
+            spdlog::error("Downloaded file is not accessible: {}", local_path);
         }
     } catch (const std::exception& e) {
         spdlog::error("Failed to download {}: {}", file.filename, e.what());
@@ -1786,28 +2659,28 @@ FileContent TelegramDataProvider::download_and_read_file(const tg::FileListItem&
 }
 
 int64_t TelegramDataProvider::get_chat_id_for_files(const PathInfo& info) const {
-    std::lock_guard<std::mutex> lock(mutex_);
+    auto snap = snapshot();
 
     switch (info.category) {
         case PathCategory::USER_FILES_DIR:
         case PathCategory::USER_FILE:
         case PathCategory::USER_MEDIA_DIR:
         case PathCategory::USER_MEDIA: {
-            auto* user = find_user_by_dir_name(info.entity_name);
+            auto* user = snap->find_user(info.entity_name);
             return user ? user->id : 0;
         }
         case PathCategory::GROUP_FILES_DIR:
         case PathCategory::GROUP_FILE:
         case PathCategory::GROUP_MEDIA_DIR:
         case PathCategory::GROUP_MEDIA: {
-            auto* group = find_group_by_dir_name(info.entity_name);
+            auto* group = snap->find_group(info.entity_name);
             return group ? group->id : 0;
         }
         case PathCategory::CHANNEL_FILES_DIR:
         case PathCategory::CHANNEL_FILE:
         case PathCategory::CHANNEL_MEDIA_DIR:
         case PathCategory::CHANNEL_MEDIA: {
-            auto* channel = find_channel_by_dir_name(info.entity_name);
+            auto* channel = snap->find_channel(info.entity_name);
             return channel ? channel->id : 0;
         }
         default:
@@ -1816,19 +2689,28 @@ int64_t TelegramDataProvider::get_chat_id_for_files(const PathInfo& info) const
 }
 
 int64_t TelegramDataProvider::get_chat_id_from_path(const PathInfo& info) const {
-    std::lock_guard<std::mutex> lock(mutex_);
+    auto snap = snapshot();
 
     switch (info.category) {
-        case PathCategory::USER_MESSAGES: {
-            auto* user = find_user_by_dir_name(info.entity_name);
+        case PathCategory::USER_MESSAGES:
+        case PathCategory::USER_MESSAGES_TAIL:
+        case PathCategory::USER_HISTORY_DIR:
+        case PathCategory::USER_HISTORY_DAY: {
+            auto* user = snap->find_user(info.entity_name);
             return user ? user->id : 0;
         }
-        case PathCategory::GROUP_MESSAGES: {
-            auto* group = find_group_by_dir_name(info.entity_name);
+        case PathCategory::GROUP_MESSAGES:
+        case PathCategory::GROUP_MESSAGES_TAIL:
+        case PathCategory::GROUP_HISTORY_DIR:
+        case PathCategory::GROUP_HISTORY_DAY: {
+            auto* group = snap->find_group(info.entity_name);
             return group ? group->id : 0;
         }
-        case PathCategory::CHANNEL_MESSAGES: {
-            auto* channel = find_channel_by_dir_name(info.entity_name);
+        case PathCategory::CHANNEL_MESSAGES:
+        case PathCategory::CHANNEL_MESSAGES_TAIL:
+        case PathCategory::CHANNEL_HISTORY_DIR:
+        case PathCategory::CHANNEL_HISTORY_DAY: {
+            auto* channel = snap->find_channel(info.entity_name);
             return channel ? channel->id : 0;
         }
         default:
@@ -1849,117 +2731,278 @@ std::size_t TelegramDataProvider::estimate_messages_size(int64_t chat_id) const
         return stats->content_size;
     }
 
+    // Sized day buckets overlapping the window (the first counted whole, so this errs large)
+    auto cutoff = std::chrono::system_clock::now() - messages_cache_->get_config().max_history_age;
+    auto cutoff_ts = std::chrono::duration_cast<std::chrono::seconds>(cutoff.time_since_epoch()).count();
+    std::size_t indexed_size = 0;
+    for (const auto& bucket : client_.cache().get_message_buckets(chat_id, cutoff_ts)) {
+        indexed_size += bucket.content_size.value_or(0);
+    }
+    if (indexed_size > 0) {
+        return indexed_size;
+    }
+
     // Default for unknown chats - use a reasonable default that allows reading
     return 4096;
 }
 
-std::string TelegramDataProvider::fetch_and_format_messages(int64_t chat_id) {
-    // Try to get from TLRU cache first (returns nullopt if stale or not cached)
-    auto cached = messages_cache_->get(chat_id);
-    if (cached) {
-        spdlog::debug("fetch_and_format_messages: TLRU hit for chat {}, size {}", chat_id, cached->size());
-        return std::string(*cached);
+void TelegramDataProvider::ensure_history_cached(int64_t chat_id) {
+    client_.cache().flush();  // Incoming messages are queued write-behind
+    if (reconciling_ || !client_.cache().get_message_buckets(chat_id).empty()) {
+        return;
     }
 
-    // TLRU miss - try to get messages from SQLite first
     const auto& config = messages_cache_->get_config();
-    auto max_age_secs = static_cast<int64_t>(config.max_history_age.count());
-    auto messages = client_.cache().get_messages_for_display(chat_id, max_age_secs);
+    try {
+        // Queued for SQLite page by page; nothing is formatted until a view is read
+        auto task = client_.get_messages_until(chat_id, config.min_messages, config.max_history_age);
+        (void)task.get_result();
+        client_.cache().flush();
+    } catch (const std::exception& e) {
+        spdlog::error("Failed to fetch history for chat {}: {}", chat_id, e.what());
+        return;
+    }
 
-    // If SQLite has enough messages, format and cache
-    if (!messages.empty() && messages.size() >= config.min_messages) {
-        spdlog::debug(
-            "fetch_and_format_messages: formatting {} messages from SQLite for chat {}", messages.size(), chat_id
-        );
-        return format_and_cache_messages(chat_id, messages);
+    // Sizes listed before the fetch are out of date
+    if (auto dir = chat_dir_path(*snapshot(), chat_id)) {
+        queue_invalidation(*dir + "/" + std::string(kMessagesTailFile));
+        queue_invalidation(*dir + "/" + std::string(kHistoryDir));
     }
+}
 
-    // Not enough in SQLite - fetch from Telegram API
-    try {
-        spdlog::debug("fetch_and_format_messages: fetching from API for chat {}", chat_id);
-        auto task = client_.get_messages_until(chat_id, config.min_messages, config.max_history_age);
-        messages = task.get_result();
+std::vector<tg::MessageBucket> TelegramDataProvider::history_buckets(int64_t chat_id) {
+    client_.cache().flush();
+    auto buckets = client_.cache().get_message_buckets(chat_id);
+    for (auto& bucket : buckets) {
+        if (bucket.is_stale()) {
+            (void)render_history_day(chat_id, bucket);
+        }
+    }
+    std::erase_if(buckets, [](const tg::MessageBucket& bucket) { return bucket.message_count == 0; });
+    return buckets;
+}
+
+std::optional<tg::MessageBucket> TelegramDataProvider::find_history_bucket(int64_t chat_id, std::string_view name) {
+    if (name.size() != 10 || name[4] != '-' || name[7] != '-') {
+        return std::nullopt;
+    }
+    auto number = [&](std::size_t pos, std::size_t len) {
+        int value = -1;
+        auto [end, ec] = std::from_chars(name.data() + pos, name.data() + pos + len, value);
+        return ec == std::errc() && end == name.data() + pos + len ? value : -1;
+    };
 
-        // Store raw messages in SQLite
-        for (const auto& msg : messages) {
-            client_.cache().cache_message(msg);
+    std::tm tm{};
+    tm.tm_year = number(0, 4) - 1900;
+    tm.tm_mon = number(5, 2) - 1;
+    tm.tm_mday = number(8, 2);
+    tm.tm_hour = 12;  // Midday is on the right day whatever the DST shift
+    tm.tm_isdst = -1;
+    auto start = tg::local_day_start(static_cast<int64_t>(std::mktime(&tm)));
+    if (history_day_name(start) != name) {
+        return std::nullopt;  // Not a date, or not in canonical form (2024-02-31, 2024-2-01)
+    }
+
+    client_.cache().flush();
+    auto buckets = client_.cache().get_message_buckets(chat_id, start);
+    if (buckets.empty() || buckets.front().start_ts != start) {
+        return std::nullopt;
+    }
+    auto bucket = buckets.front();
+    if (bucket.is_stale()) {
+        (void)render_history_day(chat_id, bucket);
+    }
+    if (bucket.message_count == 0) {
+        return std::nullopt;
+    }
+    return bucket;
+}
+
+std::string TelegramDataProvider::render_history_day(int64_t chat_id, tg::MessageBucket& bucket) {
+    tg::TraceSpan span("provider", "render_history_day");
+
+    auto messages = client_.cache().get_messages_in_range(chat_id, bucket.start_ts, bucket.end_ts);
+    auto text = messages_cache_->render(messages, make_user_resolver(), make_chat_resolver());
+    if (bucket.content_size == text.size() && bucket.message_count == messages.size()) {
+        return text;
+    }
+
+    bool was_sized = !bucket.is_stale();
+    bucket.content_size = text.size();
+    bucket.message_count = messages.size();
+    bucket.last_message_time = messages.empty() ? 0 : messages.back().timestamp;
+    if (client_.cache().store_message_bucket(chat_id, bucket) && was_sized) {
+        // Rendered differently from what was indexed (e.g. a sender renamed): the kernel holds the old size
+        if (auto dir = chat_dir_path(*snapshot(), chat_id)) {
+            queue_invalidation(*dir + "/" + std::string(kHistoryDir) + "/" + history_day_name(bucket.start_ts));
         }
+    }
+    return text;
+}
 
-        // Sort by timestamp for display (oldest first)
-        std::sort(messages.begin(), messages.end(), [](const tg::Message& a, const tg::Message& b) {
-            return a.timestamp < b.timestamp;
-        });
+std::string TelegramDataProvider::render_messages_tail(int64_t chat_id) {
+    client_.cache().flush();
+    auto newest = client_.cache().get_last_n_messages(chat_id, kMessagesTailCount);
+    std::vector<tg::MessageView> messages(newest.rbegin(), newest.rend());  // Oldest first
+    return messages_cache_->render(messages, make_user_resolver(), make_chat_resolver());
+}
 
-        // Format and cache
-        auto content = format_and_cache_messages(chat_id, messages);
+std::optional<Entry> TelegramDataProvider::get_history_entry(const PathInfo& info) {
+    auto chat_id = get_chat_id_from_path(info);
+    if (chat_id == 0) {
+        return std::nullopt;
+    }
 
-        // Evict old messages from SQLite
-        auto cutoff = std::chrono::system_clock::now() - config.max_history_age;
-        auto cutoff_ts = std::chrono::duration_cast<std::chrono::seconds>(cutoff.time_since_epoch()).count();
-        client_.cache().evict_old_messages(chat_id, cutoff_ts);
+    // The tail and the directory change with the chat's last message
+    int64_t last_message = 0;
+    auto snap = snapshot();
+    if (auto* user = snap->find_user_by_id(chat_id)) {
+        last_message = user->last_message_timestamp;
+    } else if (auto* chat = snap->find_chat_by_id(chat_id)) {
+        last_message = chat->last_message_timestamp;
+    }
+    auto stamped = [last_message](Entry entry) {
+        if (last_message > 0) {
+            entry.mtime = static_cast<std::time_t>(last_message);
+            entry.atime = entry.mtime;
+            entry.ctime = entry.mtime;
+        }
+        return entry;
+    };
 
-        return content;
-    } catch (const std::exception& e) {
-        spdlog::error("Failed to fetch messages for chat {}: {}", chat_id, e.what());
-        return "";
+    switch (info.category) {
+        case PathCategory::USER_MESSAGES_TAIL:
+        case PathCategory::GROUP_MESSAGES_TAIL:
+        case PathCategory::CHANNEL_MESSAGES_TAIL:
+            return stamped(Entry::file(std::string(kMessagesTailFile), 0, 0400));  // Rendered at open
+        case PathCategory::USER_HISTORY_DIR:
+        case PathCategory::GROUP_HISTORY_DIR:
+        case PathCategory::CHANNEL_HISTORY_DIR:
+            return stamped(Entry::directory(std::string(kHistoryDir)));
+        default:
+            break;
     }
+
+    auto bucket = find_history_bucket(chat_id, info.file_entry_name);
+    if (!bucket) {
+        return std::nullopt;
+    }
+    auto entry = Entry::file(std::string(info.file_entry_name), *bucket->content_size, 0400);
+    entry.mtime = static_cast<std::time_t>(bucket->last_message_time);
+    entry.atime = entry.mtime;
+    entry.ctime = entry.mtime;
+    return entry;
 }
 
-UserResolver TelegramDataProvider::make_user_resolver() const {
-    // Static fallback user for unknown senders
-    static tg::User unknown_user;
+void TelegramDataProvider::add_history_entries(std::time_t mtime, std::vector<Entry>& entries) {
+    // messages.tail is rendered when opened and read with direct_io, so it's listed empty
+    auto tail_entry = Entry::file(std::string(kMessagesTailFile), 0, 0400);
+    auto history_entry = Entry::directory(std::string(kHistoryDir));
+    if (mtime > 0) {
+        for (auto* entry : {&tail_entry, &history_entry}) {
+            entry->mtime = mtime;
+            entry->atime = mtime;
+            entry->ctime = mtime;
+        }
+    }
+    entries.push_back(std::move(tail_entry));
+    entries.push_back(std::move(history_entry));
+}
 
-    return [this](int64_t sender_id) -> const tg::User& {
-        // Try to find sender in users cache
-        std::lock_guard<std::mutex> lock(mutex_);
-        for (const auto& [name, user] : users_) {
-            if (user.id == sender_id) {
-                return user;
-            }
+std::string TelegramDataProvider::history_day_name(int64_t day_start) {
+    std::time_t time = static_cast<std::time_t>(day_start);
+    std::tm tm{};
+    localtime_r(&time, &tm);
+    return fmt::format("{:04d}-{:02d}-{:02d}", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+}
+
+SharedText TelegramDataProvider::fetch_and_format_messages(int64_t chat_id) {
+    tg::TraceSpan span("provider", "fetch_and_format_messages");
+
+    // Try to get from TLRU cache first (returns nullopt if stale or not cached)
+    auto cached = messages_cache_->get(chat_id);
+    if (cached) {
+        spdlog::debug("fetch_and_format_messages: TLRU hit for chat {}, size {}", chat_id, cached->size());
+        return std::move(*cached);
+    }
+
+    // Readers missing together (and a prefetch of the same chat) share one fetch and one formatting pass
+    auto fetch = [&]() -> SharedText {
+        // A flight that finished since the lookup above has cached the text already
+        if (auto fresh = messages_cache_->get(chat_id)) {
+            return std::move(*fresh);
+        }
+
+        // TLRU miss - try to get messages from SQLite first
+        const auto& config = messages_cache_->get_config();
+        auto max_age_secs = static_cast<int64_t>(config.max_history_age.count());
+        client_.cache().flush();  // Incoming messages are queued write-behind
+        auto messages = client_.cache().get_messages_for_display(chat_id, max_age_secs);
+
+        // Warm start: whatever SQLite has is served until TDLib is ready (the reconciler refetches it)
+        if (reconciling_ && messages.size() < config.min_messages) {
+            note_warm_served(chat_id);
+            return messages.empty() ? SharedText{std::string()} : format_and_cache_messages(chat_id, messages);
+        }
+
+        // If SQLite has enough messages, format and cache
+        if (!messages.empty() && messages.size() >= config.min_messages) {
+            spdlog::debug(
+                "fetch_and_format_messages: formatting {} messages from SQLite for chat {}", messages.size(), chat_id
+            );
+            return format_and_cache_messages(chat_id, messages);
         }
 
-        // Fallback for unknown senders
-        unknown_user.id = sender_id;
-        unknown_user.first_name = "User";
-        unknown_user.last_name = std::to_string(sender_id);
-        return unknown_user;
+        // Not enough in SQLite - fetch from Telegram API
+        try {
+            spdlog::debug("fetch_and_format_messages: fetching from API for chat {}", chat_id);
+            auto task = client_.get_messages_until(chat_id, config.min_messages, config.max_history_age);
+            messages = task.get_result();  // Also queued for SQLite, page by page
+
+            // Sort by timestamp for display (oldest first)
+            std::sort(messages.begin(), messages.end(), [](const tg::MessageView& a, const tg::MessageView& b) {
+                return a.timestamp < b.timestamp;
+            });
+
+            // Messages past max_history_age are expired from SQLite by the cache's maintenance ticks
+            return format_and_cache_messages(chat_id, messages);
+        } catch (const std::exception& e) {
+            spdlog::error("Failed to fetch messages for chat {}: {}", chat_id, e.what());
+            return SharedText{std::string()};
+        }
     };
+    return message_flights_.run(chat_id, fetch, flight_rank());
+}
+
+UserResolver TelegramDataProvider::make_user_resolver() const {
+    // The captured snapshot keeps the returned pointers valid across refreshes
+    return [snap = snapshot()](int64_t sender_id) { return snap->find_user_by_id(sender_id); };
 }
 
 ChatResolver TelegramDataProvider::make_chat_resolver() const {
-    // Static fallback chat for unknown chats
-    static tg::Chat unknown_chat;
+    // Synthesised chats (private chats, unknown chats) owned by this resolver
+    auto synthetic_chats = std::make_shared<std::deque<tg::Chat>>();
 
-    return [this](int64_t chat_id) -> const tg::Chat& {
+    // The captured snapshot keeps the returned references valid across refreshes
+    return [snap = snapshot(), synthetic_chats](int64_t chat_id) -> const tg::Chat& {
         // Try to find chat in users cache (private chats)
-        std::lock_guard<std::mutex> lock(mutex_);
-        for (const auto& [name, user] : users_) {
-            if (user.id == chat_id) {
-                // Create a chat from user data
-                static tg::Chat user_chat;
-                user_chat.id = user.id;
-                user_chat.type = tg::ChatType::PRIVATE;
-                user_chat.title = user.display_name();
-                user_chat.username = user.username;
-                return user_chat;
-            }
-        }
-
-        // Try groups
-        for (const auto& [name, chat] : groups_) {
-            if (chat.id == chat_id) {
-                return chat;
-            }
+        if (auto* user = snap->find_user_by_id(chat_id)) {
+            // Create a chat from user data
+            auto& user_chat = synthetic_chats->emplace_back();
+            user_chat.id = user->id;
+            user_chat.type = tg::ChatType::PRIVATE;
+            user_chat.title = user->display_name();
+            user_chat.username = user->username;
+            return user_chat;
         }
 
-        // Try channels
-        for (const auto& [name, chat] : channels_) {
-            if (chat.id == chat_id) {
-                return chat;
-            }
+        // Try groups and channels
+        if (auto* chat = snap->find_chat_by_id(chat_id)) {
+            return *chat;
         }
 
         // Fallback for unknown chats
+        auto& unknown_chat = synthetic_chats->emplace_back();
         unknown_chat.id = chat_id;
         unknown_chat.title = "Chat " + std::to_string(chat_id);
         return unknown_chat;
@@ -1967,94 +3010,93 @@ ChatResolver TelegramDataProvider::make_chat_resolver() const {
 }
 
 void TelegramDataProvider::setup_message_callback() {
+    client_.set_message_send_callback([this](int64_t pending_message_id, int64_t message_id, const std::string& error) {
+        if (!error.empty()) {
+            spdlog::error("Message {} could not be sent: {}", pending_message_id, error);
+        }
+        text_sends_.confirmed(pending_message_id, message_id != 0);
+    });
+
     client_.set_message_callback([this](const tg::Message& message) {
-        // Store message in SQLite
-        client_.cache().cache_message(message);
-
-        // Update chat message stats
-        auto stats = client_.cache().get_chat_message_stats(message.chat_id);
-        tg::ChatMessageStats new_stats;
-        new_stats.chat_id = message.chat_id;
-        new_stats.message_count = stats ? stats->message_count + 1 : 1;
-        new_stats.content_size = stats ? stats->content_size : 0;  // Will be updated on next format
-        new_stats.last_message_time = message.timestamp;
-        new_stats.oldest_message_time = stats ? stats->oldest_message_time : message.timestamp;
-        new_stats.last_fetch_time = stats ? stats->last_fetch_time : 0;
-        client_.cache().update_chat_message_stats(new_stats);
-
-        // Invalidate TLRU cache for this chat (forces reformat on next read)
-        messages_cache_->invalidate(message.chat_id);
-        spdlog::debug("New message {} for chat {}, cache invalidated", message.id, message.chat_id);
+        // The client has already queued the message row; count it in the chat's stats
+        // (content_size is updated on the next format)
+        client_.cache().queue_message_stats_increment(message);
+        if (prefetcher_) {
+            prefetcher_->record_message(message.chat_id);
+        }
+
+        // Format just this message onto the cached content (if the chat is cached)
+        tg::MessageView view(message);
+        if (messages_cache_->append(message.chat_id, {&view, 1}, make_user_resolver(), make_chat_resolver())) {
+            spdlog::debug("New message {} for chat {}, appended to cache", message.id, message.chat_id);
+        }
+
+        // Append new attachments to the cached file list; the sync watermark only moves
+        // on a search, so files missed while offline are still found by the next sync
+        if (auto item = tg::make_file_list_item(message)) {
+            client_.cache().queue_file_item(message.chat_id, *item);
+            add_to_file_index(message.chat_id, *item);
+        }
+
+        // The kernel may hold the old messages size and file listings
+        if (auto dir = chat_dir_path(*snapshot(), message.chat_id)) {
+            queue_invalidation(*dir + "/" + std::string(kMessagesFile));
+            queue_invalidation(*dir + "/" + std::string(kMessagesTailFile));
+            queue_invalidation(*dir + "/" + std::string(kHistoryDir));
+            queue_invalidation(
+                *dir + "/" + std::string(kHistoryDir) + "/" + history_day_name(tg::local_day_start(message.timestamp))
+            );
+            if (message.has_media()) {
+                queue_invalidation(*dir + "/" + std::string(kFilesDir));
+                queue_invalidation(*dir + "/" + std::string(kMediaDir));
+            }
+        }
     });
 }
 
 void TelegramDataProvider::setup_chat_callback() {
     client_.set_chat_callback([this](const tg::Chat& chat) {
-        // Invalidate the appropriate cache based on chat type
-        switch (chat.type) {
-            case tg::ChatType::PRIVATE:
-                // Private chats show up in users list, invalidate users cache
-                users_loaded_ = false;
-                spdlog::debug("New private chat {}, users cache invalidated", chat.id);
-                break;
-            case tg::ChatType::GROUP:
-            case tg::ChatType::SUPERGROUP:
-                groups_loaded_ = false;
-                spdlog::debug("New group/supergroup {}, groups cache invalidated", chat.id);
-                break;
-            case tg::ChatType::CHANNEL:
-                channels_loaded_ = false;
-                spdlog::debug("New channel {}, channels cache invalidated", chat.id);
-                break;
+        // Upserted into the snapshot by the entity updater - no full refresh
+        invalidate_info(chat.id);
+        queue_chat_update(chat);
+    });
+
+    client_.set_chat_activity_callback([this](int64_t chat_id) {
+        // Last message edited, deleted or sent elsewhere: the prefetcher rechecks the chat next cycle
+        if (prefetcher_) {
+            prefetcher_->mark_dirty(chat_id);
         }
     });
 }
 
 void TelegramDataProvider::setup_user_callback() {
     client_.set_user_callback([this](const tg::User& user) {
-        // Check if this is the current user (self) - update current_user_ if IDs match
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            if (current_user_.has_value() && current_user_->id == user.id) {
-                current_user_ = user;
-                spdlog::debug("Updated current user info: {}", user.display_name());
-            }
-        }
+        // Merged into the snapshot by the entity updater (including self)
+        invalidate_info(user.id);
+        queue_user_update(user);
+    });
 
-        // Invalidate users cache when we get new user info
-        // This ensures we pick up new contacts and the current user
-        users_loaded_ = false;
-        spdlog::debug("User {} updated, users cache invalidated", user.id);
+    client_.set_user_full_info_callback([this](int64_t user_id, const std::string& bio) {
+        invalidate_info(user_id);
+        if (auto* user = snapshot()->find_user_by_id(user_id); user && user->bio != bio) {
+            auto updated = *user;
+            updated.bio = bio;
+            queue_user_update(updated);
+        }
     });
 }
 
-std::string TelegramDataProvider::format_and_cache_messages(int64_t chat_id, const std::vector<tg::Message>& messages) {
+SharedText TelegramDataProvider::format_and_cache_messages(
+    int64_t chat_id,
+    std::span<const tg::MessageView> messages
+) {
     if (messages.empty()) {
-        return "";
-    }
-
-    // Format all messages
-    std::vector<tg::MessageInfo> infos;
-    infos.reserve(messages.size());
-
-    auto user_resolver = make_user_resolver();
-    auto chat_resolver = make_chat_resolver();
-
-    for (const auto& msg : messages) {
-        infos.push_back({msg, user_resolver(msg.sender_id), chat_resolver(chat_id)});
-    }
-
-    // Format messages using bustache template
-    std::string content;
-    const auto& tmpl = messages_cache_->message_template();
-    for (const auto& info : infos) {
-        content += bustache::to_string(tmpl(info));
-        content += '\n';
+        return SharedText{std::string()};
     }
 
-    // Store in TLRU cache
-    int64_t newest_id = messages.empty() ? 0 : messages.back().id;
-    messages_cache_->store(chat_id, content, messages.size(), newest_id);
+    // Format and store in TLRU cache
+    // Resolvers pin the entity snapshot, so resolved references stay valid while rendering
+    auto content = messages_cache_->store(chat_id, messages, make_user_resolver(), make_chat_resolver());
 
     // Update stats in SQLite
     tg::ChatMessageStats stats;
@@ -2064,7 +3106,7 @@ std::string TelegramDataProvider::format_and_cache_messages(int64_t chat_id, con
     stats.last_message_time = messages.back().timestamp;
     stats.oldest_message_time = messages.front().timestamp;
     stats.last_fetch_time = std::time(nullptr);
-    client_.cache().update_chat_message_stats(stats);
+    client_.cache().queue_chat_message_stats(stats);
 
     return content;
 }
@@ -2162,24 +3204,23 @@ WriteResult TelegramDataProvider::send_message(int64_t chat_id, const char* data
     spdlog::debug("send_message: sending text '{}'", text.substr(0, 100));
 
     // Split message if too large
-    auto chunks = MessageFormatter::split_message(text);
-
-    try {
-        for (const auto& chunk : chunks) {
-            auto task = client_.send_text(chat_id, chunk);
-            task.get_result();  // Wait for completion
-        }
-
-        spdlog::debug("Sent {} message(s) to chat {}", chunks.size(), chat_id);
-        return WriteResult{true, static_cast<int>(size), ""};
-    } catch (const std::exception& e) {
-        spdlog::error("Failed to send message to chat {}: {}", chat_id, e.what());
-        return WriteResult{false, 0, e.what()};
+    auto pieces = MessageFormatter::split_message(text);
+    std::vector<std::string> chunks(pieces.begin(), pieces.end());
+
+    // Wait until every chunk is on Telegram, so a failed send shows up as a failed write
+    auto chunk_count = chunks.size();
+    int result = text_sends_.enqueue(chat_id, std::move(chunks)).get();
+    if (result != 0) {
+        spdlog::error("Failed to send message to chat {}", chat_id);
+        return WriteResult{false, 0, "Failed to send message"};
     }
+
+    spdlog::debug("Sent {} message(s) to chat {}", chunk_count, chat_id);
+    return WriteResult{true, static_cast<int>(size), ""};
 }
 
 int64_t TelegramDataProvider::get_chat_id_for_upload(const PathInfo& info) const {
-    std::lock_guard<std::mutex> lock(mutex_);
+    auto snap = snapshot();
 
     switch (info.category) {
         case PathCategory::USER_UPLOAD:
@@ -2187,7 +3228,7 @@ int64_t TelegramDataProvider::get_chat_id_for_upload(const PathInfo& info) const
         case PathCategory::USER_FILE:
         case PathCategory::USER_MEDIA_DIR:
         case PathCategory::USER_MEDIA: {
-            auto* user = find_user_by_dir_name(info.entity_name);
+            auto* user = snap->find_user(info.entity_name);
             return user ? user->id : 0;
         }
         case PathCategory::GROUP_UPLOAD:
@@ -2195,7 +3236,7 @@ int64_t TelegramDataProvider::get_chat_id_for_upload(const PathInfo& info) const
         case PathCategory::GROUP_FILE:
         case PathCategory::GROUP_MEDIA_DIR:
         case PathCategory::GROUP_MEDIA: {
-            auto* group = find_group_by_dir_name(info.entity_name);
+            auto* group = snap->find_group(info.entity_name);
             return group ? group->id : 0;
         }
         case PathCategory::CHANNEL_UPLOAD:
@@ -2203,7 +3244,7 @@ int64_t TelegramDataProvider::get_chat_id_for_upload(const PathInfo& info) const
         case PathCategory::CHANNEL_FILE:
         case PathCategory::CHANNEL_MEDIA_DIR:
         case PathCategory::CHANNEL_MEDIA: {
-            auto* channel = find_channel_by_dir_name(info.entity_name);
+            auto* channel = snap->find_channel(info.entity_name);
             return channel ? channel->id : 0;
         }
         default:
@@ -2235,6 +3276,23 @@ bool TelegramDataProvider::is_valid_media_extension(const std::string& filename)
     return media_extensions.count(ext) > 0;
 }
 
+std::optional<tg::SendMode>
+TelegramDataProvider::streaming_upload_mode(const std::string& filename, tg::SendMode mode) const {
+    if (mode != tg::SendMode::AUTO) {
+        return mode;
+    }
+
+    // .txt and .md may become text messages, which only the content decides
+    auto ext = std::filesystem::path(filename).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext == ".txt" || ext == ".md") {
+        return std::nullopt;
+    }
+    // Without a text extension the action doesn't depend on the (still empty) file
+    return detect_upload_action(std::string(), filename) == UploadAction::SEND_AS_MEDIA ? tg::SendMode::MEDIA
+                                                                                         : tg::SendMode::DOCUMENT;
+}
+
 std::string TelegramDataProvider::extract_original_filename(const std::string& entry_name) const {
     // Strip YYYYMMDD-HHMM- prefix if present
     if (entry_name.size() > 14 && entry_name[8] == '-' && entry_name[13] == '-') {
@@ -2247,8 +3305,11 @@ std::filesystem::path TelegramDataProvider::get_upload_temp_dir() const {
     return std::filesystem::temp_directory_path() / "tg-fuse" / "uploads";
 }
 
-TelegramDataProvider::UploadAction
-TelegramDataProvider::detect_upload_action(const std::string& path, const std::string& filename) const {
+TelegramDataProvider::UploadAction TelegramDataProvider::detect_upload_action(
+    const std::string& path,
+    const std::string& filename,
+    const tg::TextScanner* scanned
+) const {
     namespace fs = std::filesystem;
     auto ext = fs::path(filename).extension().string();
     std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
@@ -2264,8 +3325,8 @@ TelegramDataProvider::detect_upload_action(const std::string& path, const std::s
     }
 
     if (text_extensions.count(ext)) {
-        // Verify it's actually valid UTF-8 text
-        if (is_valid_text_file(path)) {
+        // Verify it's actually valid UTF-8 text, from the writes if they were all scanned
+        if (scanned ? scanned->is_text() : is_valid_text_file(path)) {
             return UploadAction::SEND_AS_TEXT;
         }
     }
@@ -2274,16 +3335,9 @@ TelegramDataProvider::detect_upload_action(const std::string& path, const std::s
 }
 
 bool TelegramDataProvider::is_valid_text_file(const std::string& path) const {
-    std::ifstream ifs(path, std::ios::binary);
-    if (!ifs) {
-        return false;
-    }
-
-    // Read file content
-    std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-
-    // Use existing text validation
-    return MessageFormatter::is_valid_text(content.data(), content.size());
+    // Read in chunks, and only until a NUL or malformed UTF-8 shows it's binary
+    auto scan = tg::TextScanner::scan_file(path);
+    return scan && scan->is_text();
 }
 
 int TelegramDataProvider::send_file_as_text(int64_t chat_id, const std::string& path) {
@@ -2305,17 +3359,7 @@ int TelegramDataProvider::send_file_as_text(int64_t chat_id, const std::string&
 }
 
 std::string TelegramDataProvider::compute_file_hash(const std::string& path) const {
-    std::ifstream ifs(path, std::ios::binary);
-    if (!ifs) {
-        return "";
-    }
-
-    // Simple hash using std::hash on file content
-    // For production, consider using OpenSSL SHA256
-    std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-
-    std::size_t hash = std::hash<std::string>{}(content);
-    return fmt::format("{:016x}", hash);
+    return tg::Sha256::hash_file(path).value_or("");
 }
 
 bool TelegramDataProvider::send_file_by_remote_id(
@@ -2355,7 +3399,7 @@ int TelegramDataProvider::create_file(std::string_view path, mode_t mode, uint64
     } else if (is_media_dir_path(info.category) || is_media_path(info.category)) {
         upload_mode = tg::SendMode::MEDIA;
         // Validate media type - reject non-media files in media/ directory
-        if (!is_valid_media_extension(info.file_entry_name)) {
+        if (!is_valid_media_extension(std::string(info.file_entry_name))) {
             spdlog::warn("Rejected non-media file in media/: {}", info.file_entry_name);
             return -EINVAL;
         }
@@ -2363,7 +3407,7 @@ int TelegramDataProvider::create_file(std::string_view path, mode_t mode, uint64
     // USER_UPLOAD, GROUP_UPLOAD, CHANNEL_UPLOAD remain AUTO
 
     // Extract filename (strip timestamp prefix if present)
-    std::string filename = extract_original_filename(info.file_entry_name);
+    std::string filename = extract_original_filename(std::string(info.file_entry_name));
 
     // Create temp directory and file
     auto temp_dir = get_upload_temp_dir();
@@ -2374,20 +3418,46 @@ int TelegramDataProvider::create_file(std::string_view path, mode_t mode, uint64
         return -EIO;
     }
 
-    auto temp_path = temp_dir / fmt::format("{}_{}", next_upload_handle_.load(), filename);
+    // Claim the handle first; each upload gets a directory of its own, so concurrent creates
+    // of the same name get distinct temp files that still carry the original name
+    fh = next_upload_handle_++;
+    auto upload_dir = temp_dir / std::to_string(fh);
+    std::filesystem::create_directory(upload_dir, ec);
+    if (ec) {
+        spdlog::error("Failed to create upload directory: {}", ec.message());
+        return -EIO;
+    }
+    auto temp_path = upload_dir / filename;
+
+    auto upload = std::make_shared<PendingUpload>();
+    upload->temp_path = temp_path.string();
+    upload->original_filename = filename;
+    upload->virtual_path = std::string(path);
+    upload->chat_id = chat_id;
+    upload->mode = upload_mode;
+    upload->fd = ::open(upload->temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (upload->fd < 0) {
+        spdlog::error("Failed to create temp file {}: {}", upload->temp_path, std::strerror(errno));
+        remove_upload_temp(*upload);
+        return -EIO;
+    }
+
+    // When the send mode is already known, start sending while the file is still being written
+    if (auto stream_mode = streaming_upload_mode(filename, upload_mode)) {
+        try {
+            upload->stream_id = client_.begin_streaming_upload(upload->temp_path, *stream_mode).get_result();
+            upload->stream_mode = *stream_mode;
+        } catch (const std::exception& e) {
+            spdlog::warn("Can't stream upload of {}, sending at release: {}", filename, e.what());
+        }
+    } else {
+        upload->scan_text = true;  // The content decides: classify it as it's written
+    }
 
     // Track pending upload
-    fh = next_upload_handle_++;
     {
         std::lock_guard<std::mutex> lock(uploads_mutex_);
-        pending_uploads_[fh] = PendingUpload{
-            .temp_path = temp_path.string(),
-            .original_filename = filename,
-            .virtual_path = std::string(path),
-            .chat_id = chat_id,
-            .mode = upload_mode,
-            .bytes_written = 0
-        };
+        pending_uploads_[fh] = std::move(upload);
     }
 
     spdlog::debug("create_file: path={}, fh={}, temp={}", path, fh, temp_path.string());
@@ -2396,95 +3466,216 @@ int TelegramDataProvider::create_file(std::string_view path, mode_t mode, uint64
 
 WriteResult
 TelegramDataProvider::write_file(std::string_view path, const char* data, std::size_t size, off_t offset, uint64_t fh) {
-    // Check if this is a pending upload
+    // Check if this is a pending upload; the map lock is dropped before any I/O
+    PendingUploadPtr upload;
     {
         std::lock_guard<std::mutex> lock(uploads_mutex_);
         auto it = pending_uploads_.find(fh);
         if (it != pending_uploads_.end()) {
-            auto& upload = it->second;
-
-            // Write to temp file
-            std::ofstream ofs(upload.temp_path, std::ios::binary | (offset == 0 ? std::ios::trunc : std::ios::app));
-            if (!ofs) {
-                spdlog::error("Failed to open temp file: {}", upload.temp_path);
-                return WriteResult{false, 0, "Failed to open temp file"};
-            }
-            ofs.seekp(offset);
-            ofs.write(data, static_cast<std::streamsize>(size));
-            upload.bytes_written += size;
-
-            spdlog::debug("write_file: fh={}, offset={}, size={}, total={}", fh, offset, size, upload.bytes_written);
-            return WriteResult{true, static_cast<int>(size), ""};
+            upload = it->second;
         }
     }
+    if (upload) {
+        return write_upload(*upload, data, size, offset);
+    }
 
     // Fall through to existing message handling
     return write_file(path, data, size, offset);
 }
 
-int TelegramDataProvider::release_file(std::string_view path, uint64_t fh) {
-    // Handle txt file flush
-    auto info = parse_path(path);
-    if (is_txt_path(info.category)) {
-        int64_t chat_id = get_chat_id_for_txt(info);
-        if (chat_id != 0) {
-            std::lock_guard<std::mutex> lock(txt_states_mutex_);
-            process_txt_buffer(chat_id, true);  // Force flush remaining buffer
+WriteResult
+TelegramDataProvider::write_upload(PendingUpload& upload, const char* data, std::size_t size, off_t offset) {
+    std::lock_guard<std::mutex> lock(upload.mutex);
+    if (upload.fd < 0) {
+        return WriteResult{false, 0, "Upload already released"};
+    }
+
+    auto end = offset + static_cast<off_t>(size);
+#ifdef __linux__
+    // Reserve disk space ahead of the writes (doubling, without changing the file size)
+    // so a large copy isn't allocated block by block
+    if (end > upload.preallocated) {
+        auto target = std::clamp<off_t>(2 * end, kUploadPreallocateMin, end + kUploadPreallocateMax);
+        if (::fallocate(upload.fd, FALLOC_FL_KEEP_SIZE, 0, target) == 0) {
+            upload.preallocated = target;
+        } else {
+            upload.preallocated = std::numeric_limits<off_t>::max();  // Unsupported here: stop trying
         }
-        return 0;
+    }
+#endif
+
+    std::size_t written = 0;
+    while (written < size) {
+        auto rc = ::pwrite(upload.fd, data + written, size - written, offset + static_cast<off_t>(written));
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            spdlog::error("Failed to write temp file {}: {}", upload.temp_path, std::strerror(errno));
+            return WriteResult{false, 0, "Failed to write temp file"};
+        }
+        written += static_cast<std::size_t>(rc);
+    }
+
+    // Hash sequential writes as they come; anything else is hashed from the file at release
+    if (upload.hashed_in_order && static_cast<std::size_t>(offset) == upload.hasher.size()) {
+        upload.hasher.update(data, size);
+        if (upload.scan_text) {
+            upload.text_scanner.update(data, size);
+        }
+    } else if (upload.hashed_in_order) {
+        spdlog::debug("write_file: {} written out of order, hashing at release", upload.virtual_path);
+        upload.hashed_in_order = false;
+    }
+
+    // The streaming upload is fed the sequentially written prefix; otherwise the file goes at release
+    if (upload.stream_id != 0 && upload.hashed_in_order) {
+        client_.streaming_upload_progress(upload.stream_id, static_cast<int64_t>(upload.hasher.size()));
+    } else if (upload.stream_id != 0) {
+        client_.cancel_streaming_upload(upload.stream_id);
+        upload.stream_id = 0;
+    }
+
+    if (static_cast<std::size_t>(end) > upload.bytes_written) {
+        upload.bytes_written = static_cast<std::size_t>(end);
+    }
+
+    spdlog::trace(
+        "write_file: {} offset={}, size={}, total={}", upload.virtual_path, offset, size, upload.bytes_written.load()
+    );
+    return WriteResult{true, static_cast<int>(size), ""};
+}
+
+TelegramDataProvider::PendingUpload::~PendingUpload() { close_file(); }
+
+void TelegramDataProvider::PendingUpload::close_file() {
+    if (fd < 0) {
+        return;
+    }
+#ifdef __linux__
+    // Give back the space reserved past the end of what was written
+    struct stat st;
+    if (preallocated > 0 && preallocated != std::numeric_limits<off_t>::max() && ::fstat(fd, &st) == 0 &&
+        st.st_size < preallocated) {
+        ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, st.st_size, preallocated - st.st_size);
+    }
+#endif
+    ::close(fd);
+    fd = -1;
+}
+
+int TelegramDataProvider::release_file(std::string_view path, uint64_t fh) {
+    // Handle txt file flush
+    auto info = parse_path(path);
+    if (is_txt_path(info.category)) {
+        int64_t chat_id = get_chat_id_for_txt(info);
+        if (chat_id != 0) {
+            std::lock_guard<std::mutex> lock(txt_states_mutex_);
+            process_txt_buffer(chat_id, true);  // Force flush remaining buffer
+        }
+        return 0;
     }
 
     // Clean up old completed uploads periodically
     cleanup_completed_uploads();
 
-    PendingUpload upload;
-    std::string virtual_path;
+    PendingUploadPtr upload;
     {
         std::lock_guard<std::mutex> lock(uploads_mutex_);
         auto it = pending_uploads_.find(fh);
         if (it == pending_uploads_.end()) {
             return 0;  // Not an upload
         }
-        virtual_path = it->second.virtual_path;  // Save before move
         upload = std::move(it->second);
         pending_uploads_.erase(it);
     }
+    const std::string& virtual_path = upload->virtual_path;
 
-    spdlog::debug("release_file: fh={}, file={}, bytes_written={}", fh, upload.original_filename, upload.bytes_written);
+    // Writes still in flight on other FUSE threads finish first
+    int64_t stream_id = 0;
+    {
+        std::lock_guard<std::mutex> lock(upload->mutex);
+        upload->close_file();
+        stream_id = upload->stream_id;
+    }
+
+    spdlog::debug(
+        "release_file: fh={}, file={}, bytes_written={}", fh, upload->original_filename, upload->bytes_written.load()
+    );
 
     // Check file exists and get size
     std::error_code ec;
-    auto file_size = std::filesystem::file_size(upload.temp_path, ec);
+    auto file_size = std::filesystem::file_size(upload->temp_path, ec);
     if (ec) {
         spdlog::error("Failed to get file size: {}", ec.message());
-        std::filesystem::remove(upload.temp_path, ec);
+        if (stream_id != 0) {
+            client_.cancel_streaming_upload(stream_id);
+        }
+        remove_upload_temp(*upload);
         return -EIO;
     }
 
     // Check file size limit
     if (static_cast<int64_t>(file_size) > tg::kMaxFileSizeRegular) {
-        std::filesystem::remove(upload.temp_path, ec);
+        if (stream_id != 0) {
+            client_.cancel_streaming_upload(stream_id);
+        }
+        remove_upload_temp(*upload);
         spdlog::error("File too large: {} bytes (limit: {} bytes)", file_size, tg::kMaxFileSizeRegular);
         return -EFBIG;
     }
 
+    // The rest runs on the upload queue; the file stays visible for post-release operations meanwhile
+    mark_upload_completed(virtual_path, upload->original_filename, file_size);
+    auto result = upload_queue_.enqueue(
+        fh,
+        upload->chat_id,
+        upload->original_filename,
+        file_size,
+        [this, upload, stream_id, file_size](UploadProgress& progress) {
+            tg::RequestPriorityScope scope(tg::RequestPriority::UPLOAD);
+            return send_upload(*upload, stream_id, file_size, progress);
+        }
+    );
+    return config_.sync_uploads ? result.get() : 0;
+}
+
+int TelegramDataProvider::send_upload(
+    PendingUpload& upload,
+    int64_t stream_id,
+    std::size_t file_size,
+    UploadProgress& progress
+) {
+    auto cancel_stream = [&] {
+        if (stream_id != 0) {
+            client_.cancel_streaming_upload(stream_id);
+            stream_id = 0;
+        }
+    };
+
     // Handle AUTO mode - detect content type
     if (upload.mode == tg::SendMode::AUTO) {
-        auto detected = detect_upload_action(upload.temp_path, upload.original_filename);
+        bool scanned = upload.scan_text && upload.hashed_in_order && upload.text_scanner.size() == file_size;
+        auto detected =
+            detect_upload_action(upload.temp_path, upload.original_filename, scanned ? &upload.text_scanner : nullptr);
         if (detected == UploadAction::SEND_AS_TEXT) {
             // Read file and send as text message(s)
+            cancel_stream();
             int result = send_file_as_text(upload.chat_id, upload.temp_path);
-            if (result == 0) {
-                mark_upload_completed(virtual_path, upload.original_filename, file_size);
-            }
+            remove_upload_temp(upload);
             return result;
         }
         // Convert UploadAction to SendMode for file uploads
         upload.mode = (detected == UploadAction::SEND_AS_MEDIA) ? tg::SendMode::MEDIA : tg::SendMode::DOCUMENT;
     }
+    if (upload.mode != upload.stream_mode) {
+        cancel_stream();  // Streamed as the wrong kind of file
+    }
 
-    // Compute file hash for deduplication cache
-    std::string file_hash = compute_file_hash(upload.temp_path);
+    // File hash for the deduplication cache: normally already digested from the writes
+    std::string file_hash = upload.hashed_in_order && upload.hasher.size() == file_size
+                                ? upload.hasher.finish()
+                                : compute_file_hash(upload.temp_path);
 
     // Check upload cache for existing remote file ID
     auto cached_remote_id = client_.cache().get_cached_upload(file_hash);
@@ -2496,8 +3687,8 @@ int TelegramDataProvider::release_file(std::string_view path, uint64_t fh) {
         // Send using cached remote file ID
         if (send_file_by_remote_id(upload.chat_id, *cached_remote_id, upload.original_filename, upload.mode)) {
             // Success - clean up temp file immediately since no upload needed
-            std::filesystem::remove(upload.temp_path, ec);
-            mark_upload_completed(virtual_path, upload.original_filename, file_size);
+            cancel_stream();
+            remove_upload_temp(upload);
             return 0;
         }
 
@@ -2506,15 +3697,39 @@ int TelegramDataProvider::release_file(std::string_view path, uint64_t fh) {
         client_.cache().invalidate_upload(file_hash);
     }
 
-    // Upload new file - rename to original filename so TDLib uses correct name
-    auto upload_path = std::filesystem::path(upload.temp_path).parent_path() / upload.original_filename;
+    // Streaming upload: most of the file is usually on its way already
+    if (stream_id != 0) {
+        try {
+            client_.finish_streaming_upload(stream_id, static_cast<int64_t>(file_size));
+            spdlog::info(
+                "Uploading {} to chat {} as {} (streamed)",
+                upload.original_filename,
+                upload.chat_id,
+                upload.mode == tg::SendMode::MEDIA ? "media" : "document"
+            );
+            auto task = client_.send_streaming_upload(upload.chat_id, stream_id, upload.mode, file_hash, file_size);
+            auto msg = task.get_result();
+            // The TelegramClient removes the temp file and its directory once the message is sent
+            progress.submitted();
+            wait_for_upload(msg.id, progress);
+            return 0;
+        } catch (const std::exception& e) {
+            spdlog::warn("Streaming upload of {} failed, uploading again: {}", upload.original_filename, e.what());
+            cancel_stream();
+        }
+    }
+
+    // Upload new file - move it out of its directory under the original filename so TDLib uses the correct name
+    auto upload_path = get_upload_temp_dir() / upload.original_filename;
+    std::error_code ec;
     spdlog::debug("Renaming {} -> {}", upload.temp_path, upload_path.string());
     std::filesystem::rename(upload.temp_path, upload_path, ec);
     if (ec) {
         spdlog::error("Failed to rename temp file: {}", ec.message());
-        std::filesystem::remove(upload.temp_path, ec);
+        remove_upload_temp(upload);
         return -EIO;
     }
+    remove_upload_temp(upload);  // Just the directory now
 
     // Verify file exists after rename
     if (!std::filesystem::exists(upload_path)) {
@@ -2522,6 +3737,7 @@ int TelegramDataProvider::release_file(std::string_view path, uint64_t fh) {
         return -EIO;
     }
 
+    tg::Message msg;
     try {
         std::string path_str = upload_path.string();
         spdlog::info(
@@ -2533,9 +3749,10 @@ int TelegramDataProvider::release_file(std::string_view path, uint64_t fh) {
         );
         // Pass file hash and size for caching in updateMessageSendSucceeded
         auto task = client_.send_file(upload.chat_id, path_str, upload.mode, file_hash, file_size);
-        auto msg = task.get_result();
+        msg = task.get_result();
     } catch (const std::exception& e) {
         spdlog::error("Failed to send file: {}", e.what());
+        progress.set_error(e.what());
         std::filesystem::remove(upload_path, ec);
         return -EIO;
     }
@@ -2543,31 +3760,349 @@ int TelegramDataProvider::release_file(std::string_view path, uint64_t fh) {
     // Note: Do NOT delete the file here. TDLib uploads asynchronously and still
     // needs access to the file. The TelegramClient will delete it when
     // updateMessageSendSucceeded is received.
-    mark_upload_completed(virtual_path, upload.original_filename, file_size);
+    progress.submitted();
+    wait_for_upload(msg.id, progress);
     return 0;
 }
 
-const TelegramDataProvider::PendingUpload* TelegramDataProvider::find_pending_upload_by_path(
+void TelegramDataProvider::wait_for_upload(int64_t message_id, UploadProgress& progress) {
+    // TDLib reports the transfer through updateFile; poll it until the message has been sent
+    while (!progress.stopping()) {
+        auto state = client_.get_upload_state(message_id);
+        if (!state) {
+            return;
+        }
+        progress.set_uploaded(static_cast<std::size_t>(state->uploaded));
+        std::this_thread::sleep_for(kUploadProgressInterval);
+    }
+}
+
+std::map<std::string, std::string> TelegramDataProvider::upload_status_files() const {
+    std::map<std::string, std::string> files;
+    {
+        std::lock_guard<std::mutex> lock(uploads_mutex_);
+        for (const auto& [fh, upload] : pending_uploads_) {
+            files.emplace(
+                fmt::format("{}-{}", fh, upload->original_filename),
+                fmt::format(
+                    "file: {}\nchat: {}\nstate: writing\nwritten: {}\n",
+                    upload->original_filename,
+                    upload->chat_id,
+                    upload->bytes_written.load()
+                )
+            );
+        }
+    }
+
+    for (const auto& status : upload_queue_.statuses()) {
+        auto report = fmt::format(
+            "file: {}\nchat: {}\nstate: {}\nsize: {}\nuploaded: {} ({}%)\nrate: {:.1f} KiB/s\n",
+            status.filename,
+            status.chat_id,
+            to_string(status.state),
+            status.size,
+            status.uploaded,
+            status.size > 0 ? status.uploaded * 100 / status.size : 100,
+            status.throughput() / 1024.0
+        );
+        if (!status.error.empty()) {
+            report += fmt::format("error: {}\n", status.error);
+        }
+        files.emplace(fmt::format("{}-{}", status.id, status.filename), std::move(report));
+    }
+    return files;
+}
+
+std::string TelegramDataProvider::search_results(std::string_view query) const {
+    tg::TraceSpan span("provider", "search_results");
+
+    tg::MessageBatch hits;
+    try {
+        client_.cache().flush();  // Incoming messages are queued write-behind
+        hits = client_.cache().search_messages(query, std::nullopt, kSearchResultLimit);
+    } catch (const std::exception& e) {
+        spdlog::warn("Search for '{}' failed: {}", query, e.what());
+        return {};
+    }
+
+    // One block per chat, the chat with the newest match first
+    std::vector<int64_t> chat_order;
+    std::unordered_map<int64_t, std::vector<tg::MessageView>> by_chat;  // Views into hits
+    for (const auto& msg : hits) {
+        auto [it, inserted] = by_chat.try_emplace(msg.chat_id);
+        if (inserted) {
+            chat_order.push_back(msg.chat_id);
+        }
+        it->second.push_back(msg);
+    }
+
+    auto snap = snapshot();
+    auto user_resolver = make_user_resolver();
+    auto chat_resolver = make_chat_resolver();
+    std::string text;
+    for (auto chat_id : chat_order) {
+        // Oldest first within a chat, as in its messages file
+        auto& messages = by_chat[chat_id];
+        std::reverse(messages.begin(), messages.end());
+
+        auto dir = chat_dir_path(*snap, chat_id);
+        if (!text.empty()) {
+            text += '\n';
+        }
+        auto label = dir ? *dir + "/" + std::string(kMessagesFile) : fmt::format("chat {}", chat_id);
+        text += fmt::format("==> {} <==\n", label);
+        text += messages_cache_->render(messages, user_resolver, chat_resolver);
+    }
+    return text;
+}
+
+std::string TelegramDataProvider::stats_report(PathCategory category) const {
+    auto snapshot = collect_metrics();
+    return category == PathCategory::STATS_PROMETHEUS ? snapshot.to_prometheus() : snapshot.to_json();
+}
+
+tg::MetricsSnapshot TelegramDataProvider::collect_metrics() const {
+    auto snapshot = tg::Metrics::global().snapshot();
+
+    auto cache = messages_cache_->get_stats();
+    snapshot.add_gauge({"messages_cache_chats", "tier", "hot"}, static_cast<double>(cache.chat_count));
+    snapshot.add_gauge({"messages_cache_chats", "tier", "cold"}, static_cast<double>(cache.cold_chat_count));
+    snapshot.add_gauge({"messages_cache_bytes", "tier", "hot"}, static_cast<double>(cache.hot_bytes));
+    snapshot.add_gauge({"messages_cache_bytes", "tier", "cold"}, static_cast<double>(cache.cold_bytes));
+    snapshot.add_counter({"messages_cache_lookups_total", "result", "hit"}, static_cast<double>(cache.hit_count));
+    snapshot.add_counter(
+        {"messages_cache_lookups_total", "result", "cold_hit"}, static_cast<double>(cache.cold_hit_count)
+    );
+    snapshot.add_counter({"messages_cache_lookups_total", "result", "miss"}, static_cast<double>(cache.miss_count));
+
+    // Calls served by a concurrent call's fetch instead of a request of their own
+    snapshot.add_counter({"fetches_coalesced_total", "kind", "messages"}, message_flights_.shared_count());
+    snapshot.add_counter({"fetches_coalesced_total", "kind", "files"}, file_list_flights_.shared_count());
+    snapshot.add_counter({"fetches_coalesced_total", "kind", "download"}, download_flights_.shared_count());
+    snapshot.add_counter({"fetches_coalesced_total", "kind", "user_info"}, user_info_flights_.shared_count());
+
+    if (prefetcher_) {
+        snapshot.add_gauge({"prefetch_queued", "", ""}, static_cast<double>(prefetcher_->queued()));
+    }
+    snapshot.add_gauge({"media_prefetch_queued", "", ""}, static_cast<double>(media_downloads_.queued()));
+
+    std::map<std::string, std::size_t> uploads;
+    for (const auto& status : upload_queue_.statuses()) {
+        ++uploads[to_string(status.state)];
+    }
+    for (const auto& [state, count] : uploads) {
+        snapshot.add_gauge({"uploads", "state", state}, static_cast<double>(count));
+    }
+
+    // Rate limiter, per priority lane
+    constexpr std::array<const char*, tg::kRequestPriorities> kLanes = {"interactive", "upload", "background"};
+    auto limiter = client_.rate_limiter().stats();
+    for (std::size_t lane = 0; lane < tg::kRequestPriorities; ++lane) {
+        snapshot.add_counter({"rate_limiter_granted_total", "lane", kLanes[lane]}, limiter.granted[lane]);
+        snapshot.add_counter({"rate_limiter_delayed_total", "lane", kLanes[lane]}, limiter.delayed[lane]);
+        snapshot.add_counter(
+            {"rate_limiter_wait_seconds_total", "lane", kLanes[lane]},
+            std::chrono::duration<double>(limiter.waited[lane]).count()
+        );
+    }
+    snapshot.add_counter({"rate_limiter_flood_waits_total", "", ""}, limiter.flood_waits);
+    snapshot.add_gauge({"rate_limiter_rate", "", ""}, limiter.current_rate);
+    snapshot.add_gauge({"rate_limiter_tokens", "", ""}, limiter.tokens);
+    return snapshot;
+}
+
+std::optional<int64_t> TelegramDataProvider::find_chat(std::string_view name) const {
+    auto snap = snapshot();
+    auto bare = name.starts_with('@') ? name.substr(1) : name;
+
+    if (auto ref = snap->find_user_by_username(bare)) {
+        return ref->user->id;
+    }
+    for (auto dir_name : {name, bare}) {
+        if (const auto* user = snap->find_user(dir_name)) {
+            return user->id;
+        }
+        if (const auto* group = snap->find_group(dir_name)) {
+            return group->id;
+        }
+        if (const auto* channel = snap->find_channel(dir_name)) {
+            return channel->id;
+        }
+    }
+
+    int64_t id = 0;
+    auto [end, ec] = std::from_chars(name.data(), name.data() + name.size(), id);
+    if (ec == std::errc{} && end == name.data() + name.size() &&
+        (snap->find_user_by_id(id) || snap->find_chat_by_id(id))) {
+        return id;
+    }
+
+    // Names as shown in Telegram, for chats whose directory name differs
+    for (const auto& [dir_name, user] : snap->users) {
+        if (user.display_name() == name) {
+            return user.id;
+        }
+    }
+    for (const auto* chats : {&snap->groups, &snap->channels}) {
+        for (const auto& [dir_name, chat] : *chats) {
+            if (chat.title == name || (!chat.username.empty() && chat.username == bare)) {
+                return chat.id;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+void TelegramDataProvider::invalidate_chat(int64_t chat_id) {
+    messages_cache_->invalidate(chat_id);
+    invalidate_info(chat_id);
+    invalidate_files(chat_id);
+    if (auto dir = chat_dir_path(*snapshot(), chat_id)) {
+        queue_invalidation(*dir + "/" + std::string(kMessagesFile));
+    }
+    spdlog::info("Invalidated the caches of chat {}", chat_id);
+}
+
+std::size_t TelegramDataProvider::invalidate_files(std::optional<int64_t> chat_id) {
+    auto snap = snapshot();
+    std::vector<int64_t> chats;
+    if (chat_id) {
+        chats.push_back(*chat_id);
+    } else {
+        for (const auto& [dir_name, user] : snap->users) {
+            chats.push_back(user.id);
+        }
+        for (const auto* section : {&snap->groups, &snap->channels}) {
+            for (const auto& [dir_name, chat] : *section) {
+                chats.push_back(chat.id);
+            }
+        }
+    }
+
+    for (auto id : chats) {
+        client_.cache().invalidate_chat_files(id);
+        {
+            // Bumping appends makes an index being built against the old listing start over
+            std::lock_guard<std::mutex> lock(file_indexes_mutex_);
+            if (auto it = file_indexes_.find(id); it != file_indexes_.end()) {
+                it->second.index.reset();
+                ++it->second.appends;
+            }
+        }
+        if (auto dir = chat_dir_path(*snap, id)) {
+            queue_invalidation(*dir + "/" + std::string(kFilesDir));
+            queue_invalidation(*dir + "/" + std::string(kMediaDir));
+        }
+    }
+    return chats.size();
+}
+
+void TelegramDataProvider::clear_caches() {
+    client_.cache().clear_all();
+    messages_cache_->clear();
+    invalidate_info(std::nullopt);
+    {
+        std::lock_guard<std::mutex> lock(file_indexes_mutex_);
+        for (auto& [chat_id, slot] : file_indexes_) {
+            slot.index.reset();
+            ++slot.appends;
+        }
+    }
+
+    auto snap = snapshot();
+    auto invalidate_dir = [this](const std::string& dir) {
+        for (auto entry : {kMessagesFile, kMessagesTailFile, kHistoryDir, kFilesDir, kMediaDir}) {
+            queue_invalidation(dir + "/" + std::string(entry));
+        }
+    };
+    for (const auto& [dir_name, user] : snap->users) {
+        invalidate_dir(fmt::format("/{}/{}", kUsersDir, dir_name));
+    }
+    for (const auto& [dir_name, chat] : snap->groups) {
+        invalidate_dir(fmt::format("/{}/{}", kGroupsDir, dir_name));
+    }
+    for (const auto& [dir_name, chat] : snap->channels) {
+        invalidate_dir(fmt::format("/{}/{}", kChannelsDir, dir_name));
+    }
+    spdlog::info("Cleared all caches");
+}
+
+bool TelegramDataProvider::prefetch_chat(int64_t chat_id) {
+    if (!prefetcher_) {
+        return false;
+    }
+    prefetcher_->queue_chat(chat_id, PrefetchPriority::HIGH);
+    prefetcher_->queue_files(chat_id);
+    return true;
+}
+
+std::string TelegramDataProvider::control_stats() const {
+    auto metrics = collect_metrics();
+
+    auto snap = snapshot();
+    metrics.add_gauge({"cache_entities", "kind", "users"}, static_cast<double>(snap->users.size()));
+    metrics.add_gauge({"cache_entities", "kind", "groups"}, static_cast<double>(snap->groups.size()));
+    metrics.add_gauge({"cache_entities", "kind", "channels"}, static_cast<double>(snap->channels.size()));
+
+    std::size_t messages = 0;
+    std::size_t content_bytes = 0;
+    for (const auto& stats : client_.cache().get_all_chat_message_stats()) {
+        messages += stats.message_count;
+        content_bytes += stats.content_size;
+    }
+    metrics.add_gauge({"cache_messages", "", ""}, static_cast<double>(messages));
+    metrics.add_gauge({"cache_message_bytes", "", ""}, static_cast<double>(content_bytes));
+
+    auto downloads = client_.cache().get_download_stats();
+    metrics.add_gauge({"cache_downloads", "", ""}, static_cast<double>(downloads.files));
+    metrics.add_gauge({"cache_download_bytes", "", ""}, static_cast<double>(downloads.bytes));
+    metrics.add_counter({"cache_download_reads_total", "", ""}, static_cast<double>(downloads.hits));
+
+    return metrics.to_json();
+}
+
+std::string TelegramDataProvider::users_report() const {
+    auto snap = snapshot();
+    std::string report;
+    for (const auto& [dir_name, user] : snap->users) {
+        report += fmt::format(
+            "{}\t{}\t{}{}\n",
+            user.id,
+            user.username.empty() ? std::string() : "@" + user.username,
+            user.display_name(),
+            user.is_contact ? "\t[contact]" : ""
+        );
+    }
+    return report;
+}
+
+void TelegramDataProvider::remove_upload_temp(const PendingUpload& upload) const {
+    std::error_code ec;
+    std::filesystem::remove(upload.temp_path, ec);
+    std::filesystem::remove(std::filesystem::path(upload.temp_path).parent_path(), ec);
+}
+
+std::shared_ptr<const TelegramDataProvider::PendingUpload> TelegramDataProvider::find_pending_upload_by_path(
     std::string_view path
 ) const {
     std::lock_guard<std::mutex> lock(uploads_mutex_);
     for (const auto& [fh, upload] : pending_uploads_) {
-        if (upload.virtual_path == path) {
-            return &upload;
+        if (upload->virtual_path == path) {
+            return upload;
         }
     }
     return nullptr;
 }
 
-const TelegramDataProvider::CompletedUpload* TelegramDataProvider::find_completed_upload_by_path(
+std::optional<TelegramDataProvider::CompletedUpload> TelegramDataProvider::find_completed_upload_by_path(
     std::string_view path
 ) const {
     std::lock_guard<std::mutex> lock(uploads_mutex_);
     auto it = completed_uploads_.find(std::string(path));
     if (it != completed_uploads_.end()) {
-        return &it->second;
+        return it->second;
     }
-    return nullptr;
+    return std::nullopt;
 }
 
 void TelegramDataProvider::mark_upload_completed(
@@ -2611,12 +4146,12 @@ void TelegramDataProvider::add_uploads_to_listing(std::string_view dir_path, std
     // Add pending uploads in this directory
     for (const auto& [fh, upload] : pending_uploads_) {
         // Check if this upload's virtual_path starts with dir_prefix
-        if (upload.virtual_path.size() > dir_prefix.size() &&
-            upload.virtual_path.compare(0, dir_prefix.size(), dir_prefix) == 0) {
+        if (upload->virtual_path.size() > dir_prefix.size() &&
+            upload->virtual_path.compare(0, dir_prefix.size(), dir_prefix) == 0) {
             // Extract filename (part after dir_prefix, should not contain /)
-            auto remaining = upload.virtual_path.substr(dir_prefix.size());
+            auto remaining = upload->virtual_path.substr(dir_prefix.size());
             if (remaining.find('/') == std::string::npos) {
-                auto entry = Entry::file(upload.original_filename, upload.bytes_written, 0644);
+                auto entry = Entry::file(upload->original_filename, upload->bytes_written, 0644);
                 entry.mtime = std::time(nullptr);
                 entry.atime = entry.mtime;
                 entry.ctime = entry.mtime;
@@ -2652,17 +4187,19 @@ bool TelegramDataProvider::is_txt_path(PathCategory category) const {
 }
 
 int64_t TelegramDataProvider::get_chat_id_for_txt(const PathInfo& info) const {
+    auto snap = snapshot();
+
     switch (info.category) {
         case PathCategory::USER_TXT: {
-            auto* user = find_user_by_dir_name(info.entity_name);
+            auto* user = snap->find_user(info.entity_name);
             return user ? user->id : 0;
         }
         case PathCategory::GROUP_TXT: {
-            auto* group = find_group_by_dir_name(info.entity_name);
+            auto* group = snap->find_group(info.entity_name);
             return group ? group->id : 0;
         }
         case PathCategory::CHANNEL_TXT: {
-            auto* channel = find_channel_by_dir_name(info.entity_name);
+            auto* channel = snap->find_channel(info.entity_name);
             return channel ? channel->id : 0;
         }
         default:
@@ -2685,25 +4222,6 @@ std::size_t TelegramDataProvider::get_txt_file_size(int64_t chat_id) const {
     return 0;
 }
 
-std::size_t TelegramDataProvider::find_utf8_boundary(const std::string& str, std::size_t max_pos) const {
-    if (max_pos >= str.size()) {
-        return str.size();
-    }
-
-    // Walk backwards from max_pos to find a valid UTF-8 character boundary
-    std::size_t pos = max_pos;
-    while (pos > 0) {
-        unsigned char c = static_cast<unsigned char>(str[pos]);
-        // UTF-8 continuation bytes start with 10xxxxxx
-        if ((c & 0xC0) != 0x80) {
-            // Found start of a character or ASCII byte
-            return pos;
-        }
-        --pos;
-    }
-    return 0;
-}
-
 std::size_t TelegramDataProvider::process_txt_buffer(int64_t chat_id, bool force_flush) {
     // Must be called with txt_states_mutex_ held
     auto it = txt_states_.find(chat_id);
@@ -2714,7 +4232,6 @@ std::size_t TelegramDataProvider::process_txt_buffer(int64_t chat_id, bool force
     auto& state = it->second;
     constexpr std::size_t kMaxChunkSize = 4096;
     constexpr std::size_t kNewlineSearchWindow = 100;
-    constexpr auto kMinSendInterval = std::chrono::milliseconds(1000);  // 1 second between sends
 
     // Only process if buffer is large enough or force_flush is true
     if (state.buffer.size() < kMaxChunkSize && !force_flush) {
@@ -2725,49 +4242,30 @@ std::size_t TelegramDataProvider::process_txt_buffer(int64_t chat_id, bool force
         return 0;
     }
 
-    // Rate limit: wait if we sent too recently
-    auto now = std::chrono::steady_clock::now();
-    auto time_since_last_send = now - state.last_send_time;
-    if (state.last_send_time.time_since_epoch().count() > 0 && time_since_last_send < kMinSendInterval) {
-        auto wait_time = kMinSendInterval - time_since_last_send;
-        spdlog::debug(
-            "txt: Rate limiting - waiting {}ms before next send",
-            std::chrono::duration_cast<std::chrono::milliseconds>(wait_time).count()
-        );
-        std::this_thread::sleep_for(wait_time);
-    }
-
-    std::size_t bytes_consumed = 0;
+    // Chunks are cut from a view of the buffer, which is only erased from once at the end
+    std::string_view rest(state.buffer);
+    std::vector<std::string> chunks;
 
-    while (!state.buffer.empty()) {
+    while (!rest.empty()) {
         std::size_t chunk_end;
 
-        if (state.buffer.size() <= kMaxChunkSize) {
+        if (rest.size() <= kMaxChunkSize) {
             // Buffer is small enough - take all of it (only on force_flush)
             if (!force_flush) {
                 break;
             }
-            chunk_end = state.buffer.size();
+            chunk_end = rest.size();
         } else {
             // Find split point: prefer newline in last 100 bytes of 4096
-            chunk_end = kMaxChunkSize;
-
-            // Search for last newline in the window [kMaxChunkSize - kNewlineSearchWindow, kMaxChunkSize)
-            std::size_t search_start = kMaxChunkSize > kNewlineSearchWindow ? kMaxChunkSize - kNewlineSearchWindow : 0;
-            std::size_t last_newline = std::string::npos;
-
-            for (std::size_t i = search_start; i < kMaxChunkSize && i < state.buffer.size(); ++i) {
-                if (state.buffer[i] == '\n') {
-                    last_newline = i;
-                }
-            }
+            constexpr std::size_t kSearchStart = kMaxChunkSize - kNewlineSearchWindow;
+            auto last_newline = tg::find_last_newline(rest.substr(kSearchStart, kNewlineSearchWindow));
 
-            if (last_newline != std::string::npos) {
+            if (last_newline != std::string_view::npos) {
                 // Split after the newline
-                chunk_end = last_newline + 1;
+                chunk_end = kSearchStart + last_newline + 1;
             } else {
                 // No newline found, split at UTF-8 boundary
-                chunk_end = find_utf8_boundary(state.buffer, kMaxChunkSize);
+                chunk_end = tg::utf8_boundary(rest, kMaxChunkSize);
             }
         }
 
@@ -2776,94 +4274,59 @@ std::size_t TelegramDataProvider::process_txt_buffer(int64_t chat_id, bool force
             break;
         }
 
-        // Extract chunk and send
-        std::string chunk = state.buffer.substr(0, chunk_end);
-        state.buffer.erase(0, chunk_end);
-        bytes_consumed += chunk_end;
+        auto chunk = rest.substr(0, chunk_end);
+        rest.remove_prefix(chunk_end);
 
         // Trim trailing newline for the message (Telegram doesn't need it)
         while (!chunk.empty() && (chunk.back() == '\n' || chunk.back() == '\r')) {
-            chunk.pop_back();
+            chunk.remove_suffix(1);
         }
 
-        if (chunk.empty()) {
-            continue;
-        }
-
-        // Send the message with rate limit handling
-        try {
-            spdlog::debug("txt: Sending {} bytes to chat {}", chunk.size(), chat_id);
-            auto task = client_.send_text(chat_id, chunk);
-            auto msg = task.get_result();
-
-            state.last_sent_content = chunk;
-            state.last_sent_message_id = msg.id;
-            state.last_send_time = std::chrono::steady_clock::now();
-
-            spdlog::info("txt: Sent message {} to chat {}", msg.id, chat_id);
-        } catch (const tg::RateLimitException& e) {
-            spdlog::warn("txt: Rate limit hit for chat {}: {}", chat_id, e.what());
-            // Put the chunk back in the buffer and stop
-            state.buffer = chunk + state.buffer;
-            bytes_consumed -= chunk_end;
-            // Signal rate limit to caller
-            throw;
-        } catch (const std::exception& e) {
-            spdlog::error("txt: Failed to send message to chat {}: {}", chat_id, e.what());
-            // Don't re-add to buffer - just log and continue
+        if (!chunk.empty()) {
+            chunks.emplace_back(chunk);
         }
 
         // If we're not force flushing and buffer is now small, stop
-        if (!force_flush && state.buffer.size() < kMaxChunkSize) {
+        if (!force_flush && rest.size() < kMaxChunkSize) {
             break;
         }
+    }
 
-        // Rate limit between multiple chunks
-        if (!state.buffer.empty()) {
-            std::this_thread::sleep_for(kMinSendInterval);
-        }
+    std::size_t bytes_consumed = state.buffer.size() - rest.size();
+    state.buffer.erase(0, bytes_consumed);
+
+    if (!chunks.empty()) {
+        // Queued in order behind this chat's earlier chunks; the queue paces and retries the sends
+        spdlog::debug("txt: Queueing {} message(s) for chat {}", chunks.size(), chat_id);
+        state.last_sent_content = chunks.back();
+        state.sends.push_back(text_sends_.enqueue(chat_id, std::move(chunks)));
     }
 
     return bytes_consumed;
 }
 
+bool TelegramDataProvider::collect_txt_sends(TxtWriteState& state) {
+    bool ok = true;
+    while (!state.sends.empty() && state.sends.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        ok = state.sends.front().get() == 0 && ok;
+        state.sends.pop_front();
+    }
+    return ok;
+}
+
 WriteResult TelegramDataProvider::write_txt_file(const PathInfo& info, const char* data, std::size_t size) {
     int64_t chat_id = get_chat_id_for_txt(info);
     if (chat_id == 0) {
         return WriteResult{false, 0, "Chat not found"};
     }
 
-    // Validate UTF-8
-    std::string_view input(data, size);
-    for (std::size_t i = 0; i < size;) {
-        unsigned char c = static_cast<unsigned char>(data[i]);
-        std::size_t char_len = 1;
-
-        if ((c & 0x80) == 0) {
-            // ASCII
-            char_len = 1;
-        } else if ((c & 0xE0) == 0xC0) {
-            char_len = 2;
-        } else if ((c & 0xF0) == 0xE0) {
-            char_len = 3;
-        } else if ((c & 0xF8) == 0xF0) {
-            char_len = 4;
-        } else {
-            return WriteResult{false, 0, "Invalid UTF-8 data"};
-        }
-
-        if (i + char_len > size) {
-            return WriteResult{false, 0, "Incomplete UTF-8 sequence"};
-        }
-
-        // Validate continuation bytes
-        for (std::size_t j = 1; j < char_len; ++j) {
-            if ((static_cast<unsigned char>(data[i + j]) & 0xC0) != 0x80) {
-                return WriteResult{false, 0, "Invalid UTF-8 continuation byte"};
-            }
-        }
-
-        i += char_len;
+    // Validate UTF-8; each write must end on a character boundary
+    auto scan = tg::scan_text(std::string_view(data, size));
+    if (!scan.valid_utf8) {
+        return WriteResult{false, 0, "Invalid UTF-8 data"};
+    }
+    if (scan.incomplete_tail != 0) {
+        return WriteResult{false, 0, "Incomplete UTF-8 sequence"};
     }
 
     // Append to buffer and process
@@ -2871,14 +4334,17 @@ WriteResult TelegramDataProvider::write_txt_file(const PathInfo& info, const cha
         std::lock_guard<std::mutex> lock(txt_states_mutex_);
         auto& state = txt_states_[chat_id];
 
-        // Check buffer limit before appending (rate limit protection)
-        if (state.buffer.size() + size > kTxtMaxBufferSize) {
+        // Writes return before their text is sent: a send that failed since fails the next write
+        if (!collect_txt_sends(state)) {
+            spdlog::error("txt: earlier messages to chat {} failed to send", chat_id);
+            return WriteResult{false, 0, "Failed to send earlier messages"};
+        }
+
+        // Check buffer limit before appending, counting text still waiting to be sent (rate limit protection)
+        auto buffered = state.buffer.size() + text_sends_.queued_bytes(chat_id);
+        if (buffered + size > kTxtMaxBufferSize) {
             spdlog::warn(
-                "txt buffer overflow for chat {}: {} + {} > {} bytes",
-                chat_id,
-                state.buffer.size(),
-                size,
-                kTxtMaxBufferSize
+                "txt buffer overflow for chat {}: {} + {} > {} bytes", chat_id, buffered, size, kTxtMaxBufferSize
             );
             return WriteResult{false, 0, "Buffer full (rate limited), try again later"};
         }
@@ -2960,4 +4426,272 @@ void TelegramDataProvider::txt_flusher_loop() {
     }
 }
 
+void TelegramDataProvider::queue_chat_update(const tg::Chat& chat) {
+    {
+        std::lock_guard<std::mutex> lock(pending_entities_mutex_);
+        pending_chats_.push_back(chat);
+    }
+    spdlog::debug("Chat {} queued for snapshot update", chat.id);
+}
+
+void TelegramDataProvider::queue_user_update(const tg::User& user) {
+    {
+        std::lock_guard<std::mutex> lock(pending_entities_mutex_);
+        pending_users_.push_back(user);
+    }
+    spdlog::debug("User {} queued for snapshot update", user.id);
+}
+
+void TelegramDataProvider::start_entity_updater() {
+    entity_updater_running_ = true;
+    entity_updater_thread_ = std::thread(&TelegramDataProvider::entity_updater_loop, this);
+    spdlog::debug("Started entity updater thread");
+}
+
+void TelegramDataProvider::stop_entity_updater() {
+    if (entity_updater_running_) {
+        entity_updater_running_ = false;
+        entity_updater_cv_.notify_all();
+        if (entity_updater_thread_.joinable()) {
+            entity_updater_thread_.join();
+        }
+        spdlog::debug("Stopped entity updater thread");
+    }
+}
+
+void TelegramDataProvider::entity_updater_loop() {
+    while (entity_updater_running_) {
+        {
+            std::unique_lock<std::mutex> lock(pending_entities_mutex_);
+            entity_updater_cv_.wait_for(lock, std::chrono::milliseconds(kEntityUpdateBatchMs), [this] {
+                return !entity_updater_running_;
+            });
+        }
+
+        if (!entity_updater_running_) {
+            break;
+        }
+
+        try {
+            apply_pending_entity_updates();
+        } catch (const std::exception& e) {
+            spdlog::error("Failed to apply entity updates: {}", e.what());
+        }
+        flush_invalidations();
+    }
+}
+
+void TelegramDataProvider::apply_pending_entity_updates() {
+    std::vector<tg::Chat> chats;
+    std::vector<tg::User> users;
+    {
+        std::lock_guard<std::mutex> lock(pending_entities_mutex_);
+        chats.swap(pending_chats_);
+        users.swap(pending_users_);
+    }
+
+    if (chats.empty() && users.empty()) {
+        return;
+    }
+
+    // Private chats are listed as users - resolve them before touching the snapshot
+    std::vector<tg::User> chat_users;
+    for (const auto& chat : chats) {
+        if (chat.type != tg::ChatType::PRIVATE) {
+            continue;
+        }
+        // For private chats, user_id equals positive chat_id
+        int64_t user_id = chat.id > 0 ? chat.id : -chat.id;
+
+        tg::User user;
+        if (auto cached_user = client_.cache().get_cached_user(user_id)) {
+            user = std::move(*cached_user);
+        } else {
+            // Fallback: use chat info
+            user.id = user_id;
+            user.first_name = chat.title;
+        }
+        user.last_message_id = chat.last_message_id;
+        user.last_message_timestamp = chat.last_message_timestamp;
+        chat_users.push_back(std::move(user));
+    }
+
+    // Users are moved into the snapshot; keep their ids for the sender names
+    std::vector<int64_t> updated_user_ids;
+    updated_user_ids.reserve(chat_users.size() + users.size());
+    for (const auto* batch : {&chat_users, &users}) {
+        for (const auto& user : *batch) {
+            updated_user_ids.push_back(user.id);
+        }
+    }
+
+    std::vector<std::string> changed_paths;
+    bool users_changed = false;
+    update_snapshot([&](EntitySnapshot& snap) {
+        // Per-batch id -> directory name indexes, so each upsert avoids a scan
+        auto index = [](const auto& entities) {
+            std::unordered_map<int64_t, std::string> keys;
+            keys.reserve(entities.size());
+            for (const auto& [name, entity] : entities) {
+                keys.emplace(entity.id, name);
+            }
+            return keys;
+        };
+        auto user_keys = index(snap.users);
+        auto group_keys = index(snap.groups);
+        auto channel_keys = index(snap.channels);
+
+        // Remove the entry currently stored for @p id, handing it back (entries may be re-keyed on rename)
+        auto take = [](auto& entities, auto& keys, int64_t id) {
+            std::optional<typename std::remove_reference_t<decltype(entities)>::mapped_type> taken;
+            auto key = keys.find(id);
+            if (key == keys.end()) {
+                return taken;
+            }
+            auto it = entities.find(key->second);
+            if (it != entities.end() && it->second.id == id) {
+                taken = std::move(it->second);
+                entities.erase(it);
+            }
+            keys.erase(key);
+            return taken;
+        };
+
+        // Kernel entries to drop once the snapshot is published
+        auto stale_entry = [&](std::string_view section, const std::string& dir_name) {
+            auto dir = fmt::format("/{}/{}", section, dir_name);
+            changed_paths.push_back(dir + "/" + std::string(kInfoFile));
+            changed_paths.push_back(std::move(dir));
+        };
+
+        auto upsert_user = [&](tg::User user, bool from_chat) {
+            auto previous = take(snap.users, user_keys, user.id);
+            if (previous) {
+                auto previous_dir = get_user_dir_name(*previous);
+                stale_entry(kUsersDir, previous_dir);
+                changed_paths.push_back(fmt::format("/{}/{}", kContactsDir, previous_dir));
+                // updateUser carries no chat state or full info - keep what we already had
+                if (!from_chat) {
+                    user.last_message_id = previous->last_message_id;
+                    user.last_message_timestamp = previous->last_message_timestamp;
+                }
+                if (user.bio.empty()) {
+                    user.bio = previous->bio;
+                }
+                if (user.phone_number.empty()) {
+                    user.phone_number = previous->phone_number;
+                }
+            }
+
+            bool is_self = snap.current_user.has_value() && snap.current_user->id == user.id;
+            if (is_self) {
+                snap.current_user = user;
+                spdlog::debug("Updated current user info: {}", user.display_name());
+            }
+
+            // Only private chat partners (and self) are listed under users/
+            if (!previous && !from_chat && !is_self) {
+                return;
+            }
+            auto dir_name = get_user_dir_name(user);
+            stale_entry(kUsersDir, dir_name);
+            changed_paths.push_back(fmt::format("/{}/{}", kContactsDir, dir_name));
+            user_keys[user.id] = dir_name;
+            snap.users.insert_or_assign(dir_name, std::move(user));
+            users_changed = true;
+        };
+
+        for (auto& user : chat_users) {
+            upsert_user(std::move(user), true);
+        }
+        for (auto& user : users) {
+            upsert_user(std::move(user), false);
+        }
+
+        for (auto& chat : chats) {
+            if (chat.is_group()) {
+                if (auto previous = take(snap.groups, group_keys, chat.id)) {
+                    stale_entry(kGroupsDir, get_group_dir_name(*previous));
+                }
+                auto dir_name = get_group_dir_name(chat);
+                stale_entry(kGroupsDir, dir_name);
+                group_keys[chat.id] = dir_name;
+                snap.groups.insert_or_assign(dir_name, std::move(chat));
+                changed_paths.push_back(fmt::format("/{}", kGroupsDir));
+            } else if (chat.is_channel()) {
+                if (auto previous = take(snap.channels, channel_keys, chat.id)) {
+                    stale_entry(kChannelsDir, get_channel_dir_name(*previous));
+                }
+                auto dir_name = get_channel_dir_name(chat);
+                stale_entry(kChannelsDir, dir_name);
+                channel_keys[chat.id] = dir_name;
+                snap.channels.insert_or_assign(dir_name, std::move(chat));
+                changed_paths.push_back(fmt::format("/{}", kChannelsDir));
+            }
+        }
+    });
+
+    // Only now that the snapshot is published: a pass re-rendering a name
+    // from the previous snapshot would otherwise cache the stale one again
+    for (auto user_id : updated_user_ids) {
+        messages_cache_->invalidate_sender(user_id);
+    }
+    if (users_changed) {
+        for (auto section : {kUsersDir, kContactsDir, kTextDir}) {
+            changed_paths.push_back(fmt::format("/{}", section));
+        }
+    }
+    for (auto& path : changed_paths) {
+        queue_invalidation(std::move(path));
+    }
+
+    spdlog::debug("Applied {} chat and {} user updates to entity snapshot", chats.size(), users.size());
+}
+
+void TelegramDataProvider::set_invalidate_callback(InvalidateCallback callback) {
+    std::lock_guard<std::mutex> lock(pending_entities_mutex_);
+    invalidate_callback_ = std::move(callback);
+    if (!invalidate_callback_) {
+        pending_invalidations_.clear();
+    }
+}
+
+void TelegramDataProvider::queue_invalidation(std::string path) {
+    std::lock_guard<std::mutex> lock(pending_entities_mutex_);
+    if (invalidate_callback_) {
+        pending_invalidations_.insert(std::move(path));
+    }
+}
+
+void TelegramDataProvider::flush_invalidations() {
+    std::set<std::string> paths;
+    InvalidateCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(pending_entities_mutex_);
+        if (pending_invalidations_.empty() || !invalidate_callback_) {
+            return;
+        }
+        paths.swap(pending_invalidations_);
+        callback = invalidate_callback_;
+    }
+
+    for (const auto& path : paths) {
+        callback(path);
+    }
+    spdlog::debug("Invalidated {} kernel cache entries", paths.size());
+}
+
+std::optional<std::string> TelegramDataProvider::chat_dir_path(const EntitySnapshot& snap, int64_t chat_id) const {
+    if (auto* user = snap.find_user_by_id(chat_id)) {
+        return fmt::format("/{}/{}", kUsersDir, get_user_dir_name(*user));
+    }
+    if (auto* chat = snap.find_chat_by_id(chat_id)) {
+        if (chat->is_channel()) {
+            return fmt::format("/{}/{}", kChannelsDir, get_channel_dir_name(*chat));
+        }
+        return fmt::format("/{}/{}", kGroupsDir, get_group_dir_name(*chat));
+    }
+    return std::nullopt;
+}
+
 }  // namespace tgfuse
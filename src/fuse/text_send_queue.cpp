@@ -0,0 +1,250 @@
+#include "fuse/text_send_queue.hpp"
+
+#include "tg/exceptions.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cerrno>
+
+namespace tgfuse {
+
+namespace {
+
+// Confirmations kept for sends that haven't returned yet (older ones belong to messages sent elsewhere)
+constexpr std::size_t kMaxEarlyConfirmations = 256;
+
+}  // namespace
+
+TextSendQueue::TextSendQueue(Sender sender, Config config) : sender_(std::move(sender)), config_(std::move(config)) {}
+
+TextSendQueue::~TextSendQueue() { stop(); }
+
+void TextSendQueue::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    stopping_ = false;
+
+    auto threads = std::max<std::size_t>(1, config_.workers);
+    spdlog::debug("TextSendQueue: starting {} workers", threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+void TextSendQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        stopping_ = true;
+    }
+    cv_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers_.clear();
+
+    // Nobody is left to wait for confirmations: TDLib still delivers what it was handed
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& [pending_id, message] : in_flight_) {
+        finish_chunk_locked(message.batch, true);
+    }
+    in_flight_.clear();
+
+    // Chunks held back by a full window when the workers stopped are never sent
+    for (auto& [chat_id, chat] : chats_) {
+        if (!chat.chunks.empty()) {
+            spdlog::warn("TextSendQueue: dropping {} unsent messages to chat {}", chat.chunks.size(), chat_id);
+        }
+        for (auto& chunk : chat.chunks) {
+            finish_chunk_locked(chunk.batch, false);
+        }
+    }
+    chats_.clear();
+    running_ = false;
+}
+
+std::future<int> TextSendQueue::enqueue(int64_t chat_id, std::vector<std::string> chunks) {
+    auto batch = std::make_shared<Batch>();
+    auto result = batch->result.get_future();
+    if (chunks.empty()) {
+        batch->result.set_value(0);
+        return result;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_ || stopping_) {
+            batch->result.set_value(-ESHUTDOWN);
+            return result;
+        }
+
+        batch->remaining = chunks.size();
+        auto& chat = chats_[chat_id];
+        for (auto& text : chunks) {
+            chat.bytes += text.size();
+            chat.chunks.push_back({std::move(text), batch, next_sequence_++});
+        }
+    }
+    cv_.notify_one();
+    return result;
+}
+
+void TextSendQueue::confirmed(int64_t pending_message_id, bool ok) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = in_flight_.find(pending_message_id);
+        if (it == in_flight_.end()) {
+            // Either not ours, or the worker hasn't recorded the send yet
+            early_.emplace_back(pending_message_id, ok);
+            if (early_.size() > kMaxEarlyConfirmations) {
+                early_.pop_front();
+            }
+            return;
+        }
+
+        auto chat = chats_.find(it->second.chat_id);
+        if (chat != chats_.end()) {
+            if (chat->second.in_flight > 0) {
+                --chat->second.in_flight;
+            }
+            if (chat->second.chunks.empty() && chat->second.in_flight == 0 && !chat->second.sending) {
+                chats_.erase(chat);
+            }
+        }
+        finish_chunk_locked(it->second.batch, ok);
+        in_flight_.erase(it);
+    }
+    cv_.notify_all();
+}
+
+std::size_t TextSendQueue::queued_bytes(int64_t chat_id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = chats_.find(chat_id);
+    return it != chats_.end() ? it->second.bytes : 0;
+}
+
+void TextSendQueue::worker_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        int64_t chat_id = 0;
+        cv_.wait_for(lock, std::chrono::seconds(1), [this, &chat_id]() {
+            chat_id = take_next_locked();
+            return chat_id != 0 || stopping_;
+        });
+        expire_in_flight_locked(std::chrono::steady_clock::now());
+        if (chat_id == 0) {
+            if (stopping_) {
+                break;  // Nothing more can be handed to TDLib now; stop() fails what is left
+            }
+            continue;
+        }
+
+        auto& chat = chats_[chat_id];
+        auto chunk = std::move(chat.chunks.front());
+        chat.chunks.pop_front();
+        chat.bytes -= chunk.text.size();
+        chat.sending = true;
+        lock.unlock();
+
+        // Hand the chunk to TDLib; chunks of a chat never overlap here, so they keep their order
+        int64_t pending_id = 0;
+        bool failed = false;
+        for (std::size_t attempt = 1;; ++attempt) {
+            try {
+                pending_id = sender_(chat_id, chunk.text);
+                break;
+            } catch (const tg::RateLimitException& e) {
+                // The client's rate limiter holds the retry back until the FLOOD_WAIT is over
+                if (attempt >= std::max<std::size_t>(1, config_.max_retries)) {
+                    spdlog::error("TextSendQueue: giving up on a message to chat {}: {}", chat_id, e.what());
+                    failed = true;
+                    break;
+                }
+                spdlog::warn("TextSendQueue: rate limited sending to chat {}, retrying", chat_id);
+            } catch (const std::exception& e) {
+                spdlog::error("TextSendQueue: failed to send to chat {}: {}", chat_id, e.what());
+                failed = true;
+                break;
+            }
+        }
+
+        lock.lock();
+        auto& sent_chat = chats_[chat_id];
+        sent_chat.sending = false;
+        if (failed) {
+            finish_chunk_locked(chunk.batch, false);
+        } else {
+            auto early = std::find_if(early_.begin(), early_.end(), [pending_id](const auto& confirmation) {
+                return confirmation.first == pending_id;
+            });
+            if (early != early_.end()) {
+                finish_chunk_locked(chunk.batch, early->second);
+                early_.erase(early);
+            } else {
+                in_flight_.emplace(pending_id, InFlight{chat_id, chunk.batch, std::chrono::steady_clock::now()});
+                ++sent_chat.in_flight;
+            }
+        }
+        if (sent_chat.chunks.empty() && sent_chat.in_flight == 0) {
+            chats_.erase(chat_id);
+        }
+        cv_.notify_all();
+    }
+}
+
+int64_t TextSendQueue::take_next_locked() {
+    // Oldest queued chunk of a chat that isn't sending and has room in its window
+    int64_t best = 0;
+    uint64_t best_sequence = 0;
+    for (const auto& [chat_id, chat] : chats_) {
+        if (chat.chunks.empty() || chat.sending || chat.in_flight >= std::max<std::size_t>(1, config_.max_in_flight)) {
+            continue;
+        }
+        if (best == 0 || chat.chunks.front().sequence < best_sequence) {
+            best = chat_id;
+            best_sequence = chat.chunks.front().sequence;
+        }
+    }
+    return best;
+}
+
+void TextSendQueue::finish_chunk_locked(const BatchPtr& batch, bool ok) {
+    if (!ok) {
+        batch->failed = true;
+    }
+    if (batch->remaining > 0 && --batch->remaining == 0) {
+        batch->result.set_value(batch->failed ? -EIO : 0);
+    }
+}
+
+void TextSendQueue::expire_in_flight_locked(std::chrono::steady_clock::time_point now) {
+    for (auto it = in_flight_.begin(); it != in_flight_.end();) {
+        if (now - it->second.sent_at < config_.confirm_timeout) {
+            ++it;
+            continue;
+        }
+        spdlog::warn("TextSendQueue: message {} to chat {} was never confirmed", it->first, it->second.chat_id);
+        auto chat = chats_.find(it->second.chat_id);
+        if (chat != chats_.end()) {
+            if (chat->second.in_flight > 0) {
+                --chat->second.in_flight;
+            }
+            if (chat->second.chunks.empty() && chat->second.in_flight == 0 && !chat->second.sending) {
+                chats_.erase(chat);
+            }
+        }
+        finish_chunk_locked(it->second.batch, false);
+        it = in_flight_.erase(it);
+    }
+}
+
+}  // namespace tgfuse
@@ -0,0 +1,240 @@
+#include "fuse/upload_queue.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace tgfuse {
+
+struct UploadProgress::Entry {
+    UploadStatus status;   // Guarded by the queue mutex
+    uint64_t sequence{0};  // Queue order
+    UploadQueue::Job job;
+    std::promise<int> result;
+    bool chat_released{false};
+};
+
+double UploadStatus::throughput() const {
+    if (state == UploadState::QUEUED) {
+        return 0.0;
+    }
+    auto end = (state == UploadState::DONE || state == UploadState::FAILED) ? finished_at
+                                                                            : std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = end - started_at;
+    return elapsed.count() > 0.0 ? static_cast<double>(uploaded) / elapsed.count() : 0.0;
+}
+
+const char* to_string(UploadState state) {
+    switch (state) {
+        case UploadState::QUEUED:
+            return "queued";
+        case UploadState::SENDING:
+            return "sending";
+        case UploadState::UPLOADING:
+            return "uploading";
+        case UploadState::DONE:
+            return "done";
+        case UploadState::FAILED:
+            return "failed";
+    }
+    return "unknown";
+}
+
+void UploadProgress::set_state(UploadState state) {
+    std::lock_guard<std::mutex> lock(queue_.mutex_);
+    entry_->status.state = state;
+}
+
+void UploadProgress::set_uploaded(std::size_t bytes) {
+    std::lock_guard<std::mutex> lock(queue_.mutex_);
+    entry_->status.uploaded = bytes;
+}
+
+void UploadProgress::submitted() {
+    {
+        std::lock_guard<std::mutex> lock(queue_.mutex_);
+        entry_->status.state = UploadState::UPLOADING;
+    }
+    queue_.release_chat(*entry_);
+}
+
+void UploadProgress::set_error(std::string error) {
+    std::lock_guard<std::mutex> lock(queue_.mutex_);
+    entry_->status.error = std::move(error);
+}
+
+bool UploadProgress::stopping() const {
+    std::lock_guard<std::mutex> lock(queue_.mutex_);
+    return queue_.stopping_;
+}
+
+UploadQueue::UploadQueue(Config config) : config_(std::move(config)) {}
+
+UploadQueue::~UploadQueue() { stop(); }
+
+void UploadQueue::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    stopping_ = false;
+
+    auto threads = std::max<std::size_t>(1, config_.max_concurrent);
+    spdlog::info("UploadQueue: starting {} workers", threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+void UploadQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        stopping_ = true;
+    }
+    spdlog::info("UploadQueue: stopping");
+    cv_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers_.clear();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+}
+
+std::future<int>
+UploadQueue::enqueue(uint64_t id, int64_t chat_id, std::string filename, std::size_t size, Job job) {
+    auto entry = std::make_shared<UploadProgress::Entry>();
+    entry->status.id = id;
+    entry->status.chat_id = chat_id;
+    entry->status.filename = std::move(filename);
+    entry->status.size = size;
+    entry->status.queued_at = std::chrono::steady_clock::now();
+    entry->job = std::move(job);
+    auto result = entry->result.get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        prune_finished();
+        entry->sequence = next_sequence_++;
+        waiting_[chat_id].push_back(entry);
+        entries_.push_back(std::move(entry));
+    }
+    cv_.notify_one();
+    return result;
+}
+
+std::vector<UploadStatus> UploadQueue::statuses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+
+    std::vector<UploadStatus> result;
+    result.reserve(entries_.size());
+    for (const auto& entry : entries_) {
+        const auto& status = entry->status;
+        bool finished = status.state == UploadState::DONE || status.state == UploadState::FAILED;
+        if (!finished || now - status.finished_at <= config_.finished_retention) {
+            result.push_back(status);
+        }
+    }
+    return result;
+}
+
+void UploadQueue::worker_loop() {
+    while (true) {
+        EntryPtr entry;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this, &entry]() {
+                entry = take_next();
+                return entry || (stopping_ && waiting_.empty());
+            });
+            if (!entry) {
+                break;  // Stopping with nothing left to run
+            }
+            entry->status.state = UploadState::SENDING;
+            entry->status.started_at = std::chrono::steady_clock::now();
+        }
+
+        UploadProgress progress(*this, entry);
+        int result = -EIO;
+        try {
+            result = entry->job(progress);
+        } catch (const std::exception& e) {
+            spdlog::error("UploadQueue: upload of {} failed: {}", entry->status.filename, e.what());
+            progress.set_error(e.what());
+        }
+        release_chat(*entry);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& status = entry->status;
+            status.state = result == 0 ? UploadState::DONE : UploadState::FAILED;
+            status.finished_at = std::chrono::steady_clock::now();
+            if (result == 0) {
+                status.uploaded = status.size;
+            } else if (status.error.empty()) {
+                status.error = std::strerror(-result);
+            }
+            entry->job = nullptr;
+        }
+        entry->result.set_value(result);
+    }
+}
+
+UploadQueue::EntryPtr UploadQueue::take_next() {
+    // Oldest queued job whose chat has no upload still submitting its message
+    auto best = waiting_.end();
+    for (auto it = waiting_.begin(); it != waiting_.end(); ++it) {
+        if (submitting_chats_.count(it->first) == 0 &&
+            (best == waiting_.end() || it->second.front()->sequence < best->second.front()->sequence)) {
+            best = it;
+        }
+    }
+    if (best == waiting_.end()) {
+        return nullptr;
+    }
+
+    auto entry = std::move(best->second.front());
+    best->second.pop_front();
+    submitting_chats_.insert(best->first);
+    if (best->second.empty()) {
+        waiting_.erase(best);
+    }
+    return entry;
+}
+
+void UploadQueue::release_chat(UploadProgress::Entry& entry) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (entry.chat_released) {
+            return;
+        }
+        entry.chat_released = true;
+        submitting_chats_.erase(entry.status.chat_id);
+    }
+    cv_.notify_all();
+}
+
+void UploadQueue::prune_finished() {
+    auto now = std::chrono::steady_clock::now();
+    while (!entries_.empty()) {
+        const auto& status = entries_.front()->status;
+        bool finished = status.state == UploadState::DONE || status.state == UploadState::FAILED;
+        if (!finished || now - status.finished_at <= config_.finished_retention) {
+            break;
+        }
+        entries_.pop_front();
+    }
+}
+
+}  // namespace tgfuse
@@ -1,5 +1,6 @@
 #include "fuse/vfs.hpp"
 
+#include <fmt/format.h>
 #include <spdlog/spdlog.h>
 
 #include <csignal>
@@ -21,6 +22,13 @@ int VirtualFilesystem::mount(const VfsConfig& config) {
 
     spdlog::info("Mounting {} at {}", provider_->get_filesystem_name(), config.mount_point);
 
+    if (config.low_level) {
+        if (get_fuse_version() == FuseVersion::FUSE3) {
+            return mount_low_level(config);
+        }
+        spdlog::warn("Low-level FUSE backend needs libfuse3, using the high-level API");
+    }
+
     // Build FUSE arguments
     std::vector<std::string> args_storage;
     std::vector<char*> argv;
@@ -41,8 +49,18 @@ int VirtualFilesystem::mount(const VfsConfig& config) {
         args_storage.push_back("-d");
     }
 
-    // Single-threaded mode (simpler for now)
-    args_storage.push_back("-s");
+    // Threading: a single worker serialises all requests; more workers let a slow
+    // chat (download, history fetch) block only its own callers
+    if (config.worker_threads <= 1) {
+        args_storage.push_back("-s");
+    } else {
+#if TG_FUSE_VERSION == 3
+        // fuse_main runs fuse_loop_mt; cap its worker pool
+        args_storage.push_back("-o");
+        args_storage.push_back(fmt::format("max_threads={}", config.worker_threads));
+#endif
+        spdlog::info("Multi-threaded FUSE session with {} workers", config.worker_threads);
+    }
 
     // Allow other users (if requested)
     if (config.allow_other) {
@@ -50,10 +68,34 @@ int VirtualFilesystem::mount(const VfsConfig& config) {
         args_storage.push_back("allow_other");
     }
 
-    // Disable kernel caching of directory entries and attributes
-    // This ensures ls shows fresh data when chats are updated
+    // Kernel caching of entries and attributes. Providers invalidate paths when
+    // Telegram updates change them, so positive entries can be cached; negative
+    // lookups never are, as uploads create names the kernel hasn't seen yet
     args_storage.push_back("-o");
-    args_storage.push_back("attr_timeout=0,entry_timeout=0,negative_timeout=0");
+    args_storage.push_back(fmt::format(
+        "attr_timeout={},entry_timeout={},negative_timeout=0", config.attr_timeout, config.entry_timeout
+    ));
+    if (config.kernel_cache) {
+        args_storage.push_back("-o");
+        args_storage.push_back("kernel_cache");
+    }
+    spdlog::debug(
+        "Kernel cache: attr_timeout={}s entry_timeout={}s kernel_cache={}",
+        config.attr_timeout,
+        config.entry_timeout,
+        config.kernel_cache
+    );
+
+    // Negotiated in init(): big writes let a large copy through in ~1 MiB requests
+    PlatformAdapter::set_connection_options(config.connection);
+
+    provider_->set_invalidate_callback([](const std::string& path) {
+        int rc = PlatformAdapter::invalidate_path(path.c_str());
+        // -ENOENT just means the kernel never looked the path up
+        if (rc != 0 && rc != -ENOENT && rc != -ENOSYS) {
+            spdlog::debug("Failed to invalidate {}: {}", path, std::strerror(-rc));
+        }
+    });
 
     // Convert to char* array
     for (auto& arg : args_storage) {
@@ -77,9 +119,39 @@ int VirtualFilesystem::mount(const VfsConfig& config) {
     int result = fuse_main(argc, argv.data(), &ops, nullptr);
 
     mounted_ = false;
+    provider_->set_invalidate_callback(nullptr);
     spdlog::info("FUSE main loop exited with code {}", result);
 
     return result;
 }
 
+int VirtualFilesystem::mount_low_level(const VfsConfig& config) {
+    LowLevelOptions options;
+    options.mount_point = config.mount_point;
+    options.debug = config.debug;
+    options.allow_other = config.allow_other;
+    options.worker_threads = config.worker_threads;
+    options.attr_timeout = config.attr_timeout;
+    options.entry_timeout = config.entry_timeout;
+    options.kernel_cache = config.kernel_cache;
+    options.connection = config.connection;
+
+    provider_->set_invalidate_callback([](const std::string& path) {
+        int rc = LowLevelAdapter::invalidate_path(path.c_str());
+        if (rc != 0) {
+            spdlog::debug("Failed to invalidate {}: {}", path, std::strerror(-rc));
+        }
+    });
+
+    mounted_ = true;
+    spdlog::debug("Starting low-level FUSE session ({} workers)", config.worker_threads);
+    int result = LowLevelAdapter::run(*operations_, options);
+    mounted_ = false;
+
+    provider_->set_invalidate_callback(nullptr);
+    spdlog::info("Low-level FUSE session exited with code {}", result);
+
+    return result;
+}
+
 }  // namespace tgfuse
@@ -1,15 +1,21 @@
+#include <fmt/format.h>
 #include <spdlog/sinks/rotating_file_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 #include <CLI/CLI.hpp>
 #include <nlohmann/json.hpp>
 
+#include "fuse/accounts_provider.hpp"
+#include "fuse/constants.hpp"
+#include "fuse/control_server.hpp"
 #include "fuse/mock_provider.hpp"
 #include "fuse/telegram_provider.hpp"
 #include "fuse/vfs.hpp"
 #include "tg/client.hpp"
+#include "tg/trace.hpp"
 #include "tg/types.hpp"
 
+#include <pthread.h>
 #include <pwd.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -18,9 +24,14 @@
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <set>
+#include <string>
 #include <thread>
+#include <vector>
 
 namespace {
 
@@ -38,6 +49,27 @@ struct DaemonConfig {
     bool mock_mode{false};
     bool allow_other{false};
     bool flush_logs{false};  // Flush logs on every message (useful for debugging)
+    std::size_t read_ahead_kb{tgfuse::kMediaReadAheadBytes / 1024};  // Media streaming read-ahead window
+    unsigned threads{4};                                              // FUSE worker threads (1 = single-threaded)
+    double attr_timeout{1.0};                                         // Kernel attribute cache lifetime (seconds)
+    double entry_timeout{1.0};                                        // Kernel name lookup cache lifetime (seconds)
+    bool kernel_cache{false};                                         // Keep file data cached across opens
+    bool low_level{false};                                            // Inode-based low-level FUSE backend
+    std::size_t messages_cache_mb{64};                                // Formatted messages byte budget
+    std::size_t cold_cache_mb{16};                                    // Compressed evicted messages (0 disables)
+    unsigned max_write_kb{1024};                                      // Largest FUSE write request
+    bool writeback_cache{false};                                      // Kernel-buffered writes
+    std::size_t upload_concurrency{4};                                // Uploads transferring at once
+    bool sync_uploads{false};                                         // close() waits for the upload to be sent
+    std::size_t prefetch_workers{2};                                  // Background prefetch threads (0 disables)
+    std::size_t media_prefetch_kb{2048};                              // Largest media read ahead on listing (0 off)
+    std::size_t files_budget_mb{0};                                   // Disk cap on downloaded files (0 = unlimited)
+    std::size_t trace_events{0};                                      // Trace ring size in events (0 disables)
+    tgfuse::MockProviderConfig mock;                                  // Size and latency of the --mock tree
+    bool warm_start{false};                                           // Mount from the cache, reconcile later
+    bool compact_messages{false};                                     // Seal old cached messages into pages
+    std::vector<std::string> accounts;                                // Mounted side by side (empty: the default)
+    bool convert_cache{false};                                        // Switch an old cache to incremental vacuum
 };
 
 /// API configuration from config file
@@ -66,6 +98,9 @@ fs::path get_data_directory() {
     return fs::path("/tmp") / "tg-fuse";
 }
 
+/// Get the data directory of a named account (~/.local/share/tg-fuse/accounts/<name>)
+fs::path get_account_directory(const std::string& account) { return get_data_directory() / "accounts" / account; }
+
 /// Get the config directory for tg-fuse (~/.config/tg-fuse)
 fs::path get_config_directory() {
     if (const char* xdg_config = std::getenv("XDG_CONFIG_HOME"); xdg_config && *xdg_config) {
@@ -116,16 +151,17 @@ std::optional<ApiConfig> load_api_config() {
 }
 
 /// Create TelegramClient configuration
-tg::TelegramClient::Config make_client_config(const ApiConfig& api_config) {
-    auto data_dir = get_data_directory();
-
+/// @param data_dir Where the account keeps its TDLib database, cache and files (logs are shared)
+tg::TelegramClient::Config
+make_client_config(const DaemonConfig& daemon_config, const ApiConfig& api_config, const fs::path& data_dir) {
     tg::TelegramClient::Config config;
     config.api_id = api_config.api_id;
     config.api_hash = api_config.api_hash;
     config.database_directory = (data_dir / "tdlib").string();
     config.cache_directory = (data_dir / "cache").string();
     config.files_directory = (data_dir / "files").string();
-    config.logs_directory = (data_dir / "logs").string();
+    config.logs_directory = (get_data_directory() / "logs").string();
+    config.message_store.compact = daemon_config.compact_messages;
 
     fs::create_directories(config.database_directory);
     fs::create_directories(config.cache_directory);
@@ -134,6 +170,11 @@ tg::TelegramClient::Config make_client_config(const ApiConfig& api_config) {
     return config;
 }
 
+/// Hub settings of the clients built from @p client_config
+tg::ClientHub::Config make_hub_config(const tg::TelegramClient::Config& client_config) {
+    return tg::ClientHub::Config{client_config.executor_threads, client_config.rate_limits};
+}
+
 //------------------------------------------------------------------------------
 // Logging
 //------------------------------------------------------------------------------
@@ -231,15 +272,120 @@ int daemonise() {
     return 0;
 }
 
+//------------------------------------------------------------------------------
+// Tracing
+//------------------------------------------------------------------------------
+
+/// Start recording spans and dump them to the data directory on SIGUSR2
+/// Must run before any other thread starts so that they all inherit the
+/// blocked signal, leaving the dump thread as the only one that takes it.
+void start_tracing(std::size_t events) {
+    tg::Tracer::global().enable(events);
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::thread([signals] {
+        auto trace_dir = get_data_directory() / "traces";
+        for (unsigned dump = 1;; ++dump) {
+            int received = 0;
+            if (sigwait(&signals, &received) != 0) {
+                return;
+            }
+
+            std::error_code ec;
+            fs::create_directories(trace_dir, ec);
+            auto path = trace_dir / fmt::format("trace-{}-{}.json", ::getpid(), dump);
+            std::ofstream file(path);
+            file << tg::Tracer::global().chrome_trace_json();
+            if (file) {
+                spdlog::info("Trace written to {}", path.string());
+            } else {
+                spdlog::error("Failed to write trace to {}", path.string());
+            }
+        }
+    }).detach();
+}
+
 //------------------------------------------------------------------------------
 // Daemon context - holds all runtime state
 //------------------------------------------------------------------------------
 
 struct DaemonContext {
-    std::unique_ptr<tg::TelegramClient> telegram_client;
+    std::vector<std::unique_ptr<tg::TelegramClient>> telegram_clients;  // One per account
+    std::map<std::string, std::shared_ptr<tgfuse::TelegramDataProvider>> accounts;  // By name ("" for the default)
     std::shared_ptr<tgfuse::DataProvider> provider;
 };
 
+/// Provider configuration from the command line (budgets apply to each account)
+tgfuse::TelegramDataProvider::Config make_provider_config(const DaemonConfig& config) {
+    tgfuse::TelegramDataProvider::Config provider_config;
+    provider_config.media_read_ahead = config.read_ahead_kb * 1024;
+    provider_config.stream_media = config.read_ahead_kb > 0;
+    provider_config.messages_cache.max_bytes = config.messages_cache_mb * 1024 * 1024;
+    provider_config.messages_cache.cold_max_bytes = config.cold_cache_mb * 1024 * 1024;
+    provider_config.uploads.max_concurrent = config.upload_concurrency;
+    provider_config.sync_uploads = config.sync_uploads;
+    provider_config.prefetch.workers = config.prefetch_workers;
+    if (config.media_prefetch_kb == 0) {
+        provider_config.media_prefetch.pool.workers = 0;
+    }
+    provider_config.media_prefetch.max_file_size = config.media_prefetch_kb * 1024;
+    provider_config.files_budget.max_bytes = config.files_budget_mb * 1024 * 1024;
+    provider_config.warm_start = config.warm_start;
+    return provider_config;
+}
+
+/// Start an account's client and check that it is logged in
+/// @param name Account name for messages (empty for the default account)
+/// @return false if it isn't authenticated (the client is stopped again)
+bool start_client(const DaemonConfig& config, tg::TelegramClient& client, const std::string& name) {
+    auto label = name.empty() ? std::string("Telegram client") : fmt::format("Telegram client of '{}'", name);
+    auto login = name.empty() ? std::string("tg-fuse login") : fmt::format("tg-fuse --account {} login", name);
+
+    // Converting rewrites the whole database, so it happens before mounting, and only when asked to
+    if (client.cache().vacuum_mode_pending()) {
+        if (config.convert_cache) {
+            client.cache().convert_vacuum_mode();
+        } else {
+            spdlog::info("The cache of {} doesn't release free pages; restart with --convert-cache to fix", label);
+        }
+    }
+
+    spdlog::info("Starting {}...", label);
+    client.start().get_result();
+
+    if (config.warm_start) {
+        // The provider serves the cache and waits for authorisation in the background
+        spdlog::info("Warm start: mounting before Telegram is ready");
+        return true;
+    }
+
+    // Give TDLib a moment to initialise
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    // Check authentication state
+    auto auth_state = client.get_auth_state().get_result();
+    if (auth_state != tg::AuthState::READY) {
+        spdlog::error("{} is not authenticated. Run '{}' first.", label, login);
+        client.stop().get_result();
+        return false;
+    }
+
+    spdlog::info("Authenticated with Telegram");
+    return true;
+}
+
+/// Stop every started client
+void stop_clients(DaemonContext& ctx) {
+    for (auto& client : ctx.telegram_clients) {
+        spdlog::info("Stopping Telegram client...");
+        client->stop().get_result();
+    }
+}
+
 //------------------------------------------------------------------------------
 // Initialisation - called AFTER daemonising
 //------------------------------------------------------------------------------
@@ -260,12 +406,29 @@ std::optional<DaemonContext> initialise(const DaemonConfig& config) {
     spdlog::debug("Foreground: {}", config.foreground);
     spdlog::debug("Verbosity: {}", config.verbosity);
     spdlog::debug("Mock mode: {}", config.mock_mode);
+    spdlog::debug("Worker threads: {}", config.threads);
+    spdlog::debug(
+        "Kernel cache: attr {}s, entry {}s, data {}", config.attr_timeout, config.entry_timeout, config.kernel_cache
+    );
+
+    if (config.trace_events > 0) {
+        start_tracing(config.trace_events);
+        spdlog::info("Tracing the last {} events (kill -USR2 {} to dump)", config.trace_events, ::getpid());
+    }
 
     DaemonContext ctx;
 
     if (config.mock_mode) {
         spdlog::info("Running in mock mode");
-        ctx.provider = std::make_shared<tgfuse::MockDataProvider>();
+        if (config.accounts.empty()) {
+            ctx.provider = std::make_shared<tgfuse::MockDataProvider>(config.mock);
+            return ctx;
+        }
+        std::map<std::string, std::shared_ptr<tgfuse::DataProvider>> accounts;
+        for (const auto& name : config.accounts) {
+            accounts[name] = std::make_shared<tgfuse::MockDataProvider>(config.mock);
+        }
+        ctx.provider = std::make_shared<tgfuse::AccountsProvider>(std::move(accounts));
         return ctx;
     }
 
@@ -276,30 +439,159 @@ std::optional<DaemonContext> initialise(const DaemonConfig& config) {
         return std::nullopt;
     }
 
-    // Create and start Telegram client
-    auto client_config = make_client_config(*api_config);
-    ctx.telegram_client = std::make_unique<tg::TelegramClient>(client_config);
+    if (config.accounts.empty()) {
+        // Create and start Telegram client
+        auto client_config = make_client_config(config, *api_config, get_data_directory());
+        ctx.telegram_clients.push_back(std::make_unique<tg::TelegramClient>(client_config));
+        if (!start_client(config, *ctx.telegram_clients.back(), "")) {
+            return std::nullopt;
+        }
 
-    spdlog::info("Starting Telegram client...");
-    ctx.telegram_client->start().get_result();
+        auto provider =
+            std::make_shared<tgfuse::TelegramDataProvider>(*ctx.telegram_clients.back(), make_provider_config(config));
+        ctx.accounts[""] = provider;
+        ctx.provider = std::move(provider);
+        return ctx;
+    }
 
-    // Give TDLib a moment to initialise
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    // Every account's client shares one TDLib receive loop, executor and rate limiter,
+    // and every account's prefetcher the same workers
+    std::shared_ptr<tg::ClientHub> hub;
+    auto provider_config = make_provider_config(config);
+    if (config.prefetch_workers > 0) {
+        provider_config.prefetch.pool = std::make_shared<tgfuse::PrefetchPool>(config.prefetch_workers);
+    }
 
-    // Check authentication state
-    auto auth_state = ctx.telegram_client->get_auth_state().get_result();
-    if (auth_state != tg::AuthState::READY) {
-        spdlog::error("Not authenticated. Run 'tg-fuse login' first.");
-        ctx.telegram_client->stop().get_result();
-        return std::nullopt;
+    std::map<std::string, std::shared_ptr<tgfuse::DataProvider>> accounts;
+    for (const auto& name : config.accounts) {
+        auto client_config = make_client_config(config, *api_config, get_account_directory(name));
+        if (!hub) {
+            // Set up as a single account's own hub would be (the settings are the same for every account)
+            hub = std::make_shared<tg::ClientHub>(make_hub_config(client_config));
+        }
+        ctx.telegram_clients.push_back(std::make_unique<tg::TelegramClient>(client_config, hub));
+        if (!start_client(config, *ctx.telegram_clients.back(), name)) {
+            ctx.telegram_clients.pop_back();
+            ctx.accounts.clear();
+            accounts.clear();
+            stop_clients(ctx);
+            return std::nullopt;
+        }
+        auto provider = std::make_shared<tgfuse::TelegramDataProvider>(*ctx.telegram_clients.back(), provider_config);
+        ctx.accounts[name] = provider;
+        accounts[name] = std::move(provider);
     }
+    spdlog::info("Serving {} accounts", accounts.size());
+    ctx.provider = std::make_shared<tgfuse::AccountsProvider>(std::move(accounts));
 
-    spdlog::info("Authenticated with Telegram");
+    return ctx;
+}
 
-    // Create TelegramDataProvider
-    ctx.provider = std::make_shared<tgfuse::TelegramDataProvider>(*ctx.telegram_client);
+//------------------------------------------------------------------------------
+// Control socket - lets the tg-fuse CLI act on the running daemon
+//------------------------------------------------------------------------------
 
-    return ctx;
+using AccountCommand =
+    std::function<tgfuse::ControlResponse(tgfuse::TelegramDataProvider&, const tgfuse::ControlRequest&)>;
+
+/// Handler running @p command on the account a request names
+///
+/// Accounts this daemon doesn't serve are reported as such, so the CLI
+/// falls back to the cache database (mock providers serve none).
+tgfuse::ControlServer::Handler account_handler(DaemonContext& ctx, AccountCommand command) {
+    return [&ctx, command = std::move(command)](const tgfuse::ControlRequest& request) {
+        auto it = ctx.accounts.find(request.account);
+        if (request.account.empty() && ctx.accounts.size() == 1) {
+            it = ctx.accounts.begin();
+        }
+        if (it == ctx.accounts.end()) {
+            if (request.account.empty() && !ctx.accounts.empty()) {
+                return tgfuse::ControlResponse::error("Several accounts are mounted, choose one with --account");
+            }
+            return tgfuse::ControlResponse::unserved();
+        }
+        return command(*it->second, request);
+    };
+}
+
+/// Handler running @p command on the chat named by a request's first argument
+tgfuse::ControlServer::Handler chat_handler(
+    DaemonContext& ctx,
+    std::function<tgfuse::ControlResponse(tgfuse::TelegramDataProvider&, int64_t chat_id)> command
+) {
+    auto find_chat = [command = std::move(command)](
+                         tgfuse::TelegramDataProvider& provider, const tgfuse::ControlRequest& request
+                     ) {
+        if (request.args.empty()) {
+            return tgfuse::ControlResponse::error("No chat given");
+        }
+        auto chat_id = provider.find_chat(request.args[0]);
+        if (!chat_id) {
+            return tgfuse::ControlResponse::error(fmt::format("Chat '{}' not found", request.args[0]));
+        }
+        return command(provider, *chat_id);
+    };
+    return account_handler(ctx, std::move(find_chat));
+}
+
+/// Register the commands the tg-fuse CLI sends
+void register_control_commands(tgfuse::ControlServer& server, DaemonContext& ctx) {
+    using tgfuse::ControlRequest;
+    using tgfuse::ControlResponse;
+    using tgfuse::TelegramDataProvider;
+
+    auto stats = [](TelegramDataProvider& provider, const ControlRequest&) {
+        return ControlResponse::ok(provider.control_stats());
+    };
+    auto users = [](TelegramDataProvider& provider, const ControlRequest&) {
+        return ControlResponse::ok(provider.users_report());
+    };
+    auto invalidate = [](TelegramDataProvider& provider, int64_t chat_id) {
+        provider.invalidate_chat(chat_id);
+        return ControlResponse::ok(std::to_string(chat_id));
+    };
+    auto clear_files = [](TelegramDataProvider& provider, const ControlRequest& request) {
+        std::optional<int64_t> chat_id;
+        if (!request.args.empty()) {
+            chat_id = provider.find_chat(request.args[0]);
+            if (!chat_id) {
+                return ControlResponse::error(fmt::format("Chat '{}' not found", request.args[0]));
+            }
+        }
+        return ControlResponse::ok(std::to_string(provider.invalidate_files(chat_id)));
+    };
+    auto clear_all = [](TelegramDataProvider& provider, const ControlRequest&) {
+        provider.clear_caches();
+        return ControlResponse::ok();
+    };
+    auto prefetch = [](TelegramDataProvider& provider, int64_t chat_id) {
+        if (!provider.prefetch_chat(chat_id)) {
+            return ControlResponse::error("Prefetching is disabled (--prefetch-workers 0)");
+        }
+        return ControlResponse::ok(std::to_string(chat_id));
+    };
+
+    server.add_handler("stats", account_handler(ctx, stats));
+    server.add_handler("users", account_handler(ctx, users));
+    server.add_handler("invalidate", chat_handler(ctx, invalidate));
+    server.add_handler("clear-files", account_handler(ctx, clear_files));
+    server.add_handler("clear-all", account_handler(ctx, clear_all));
+    server.add_handler("prefetch", chat_handler(ctx, prefetch));
+
+    // Daemon-wide: every account logs through the same logger
+    server.add_handler("log-level", [](const tgfuse::ControlRequest& request) {
+        auto previous = spdlog::level::to_string_view(spdlog::get_level());
+        if (request.args.empty()) {
+            return ControlResponse::ok(fmt::format("{}\n", previous));
+        }
+        auto level = spdlog::level::from_str(request.args[0]);
+        if (level == spdlog::level::off && request.args[0] != "off") {
+            return ControlResponse::error(fmt::format("Unknown log level '{}'", request.args[0]));
+        }
+        spdlog::set_level(level);
+        spdlog::info("Log level changed from {} to {}", previous, request.args[0]);
+        return ControlResponse::ok(fmt::format("{}\n", previous));
+    });
 }
 
 //------------------------------------------------------------------------------
@@ -319,16 +611,26 @@ int run(const DaemonConfig& config, DaemonContext& ctx) {
     vfs_config.foreground = true;  // Always true after daemonisation
     vfs_config.debug = config.verbosity >= 2;
     vfs_config.allow_other = config.allow_other;
+    vfs_config.worker_threads = config.threads;
+    vfs_config.attr_timeout = config.attr_timeout;
+    vfs_config.entry_timeout = config.entry_timeout;
+    vfs_config.kernel_cache = config.kernel_cache;
+    vfs_config.low_level = config.low_level;
+    vfs_config.connection.max_write = config.max_write_kb * 1024;
+    vfs_config.connection.writeback_cache = config.writeback_cache;
+
+    // The filesystem works without it; the CLI then falls back to the cache database
+    tgfuse::ControlServer control((get_data_directory() / tgfuse::kControlSocketFile).string());
+    register_control_commands(control, ctx);
+    control.start();
 
     spdlog::info("Mounting filesystem at: {}", config.mount_point);
 
     int result = vfs.mount(vfs_config);
+    control.stop();
 
-    // Cleanup Telegram client
-    if (ctx.telegram_client) {
-        spdlog::info("Stopping Telegram client...");
-        ctx.telegram_client->stop().get_result();
-    }
+    // Cleanup Telegram clients
+    stop_clients(ctx);
 
     spdlog::info("tg-fused exiting with code: {}", result);
     return result;
@@ -354,8 +656,72 @@ int main(int argc, char* argv[]) {
     app.add_flag("--flush-logs", config.flush_logs, "Flush logs immediately (useful for debugging)");
     app.add_flag("--mock", config.mock_mode, "Use mock data (no Telegram connection)");
     app.add_flag("--allow-other", config.allow_other, "Allow other users to access the mount");
+    app.add_option("--read-ahead", config.read_ahead_kb, "Media streaming read-ahead in KB (0 disables streaming)")
+        ->capture_default_str();
+    app.add_option("-j,--threads", config.threads, "FUSE worker threads (1 = single-threaded)")
+        ->capture_default_str()
+        ->check(CLI::Range(1u, 64u));
+    app.add_option("--attr-timeout", config.attr_timeout, "Seconds the kernel caches file attributes (0 disables)")
+        ->capture_default_str()
+        ->check(CLI::NonNegativeNumber);
+    app.add_option("--entry-timeout", config.entry_timeout, "Seconds the kernel caches name lookups (0 disables)")
+        ->capture_default_str()
+        ->check(CLI::NonNegativeNumber);
+    app.add_flag("--kernel-cache", config.kernel_cache, "Keep file contents in the kernel page cache across opens");
+    app.add_flag("--low-level", config.low_level, "Use the inode-based low-level FUSE API (Linux only)");
+    app.add_option("--messages-cache", config.messages_cache_mb, "Memory budget for formatted messages in MB")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+    app.add_option("--cold-cache", config.cold_cache_mb, "Budget for compressed evicted messages in MB (0 disables)")
+        ->capture_default_str();
+    app.add_option("--max-write", config.max_write_kb, "Largest write request the kernel sends, in KB")
+        ->capture_default_str()
+        ->check(CLI::Range(4u, 1024u));
+    app.add_flag("--writeback-cache", config.writeback_cache, "Let the kernel buffer writes before sending (Linux)");
+    app.add_option("--upload-concurrency", config.upload_concurrency, "Uploads transferring to Telegram at once")
+        ->capture_default_str()
+        ->check(CLI::Range(std::size_t{1}, std::size_t{32}));
+    app.add_flag("--sync-uploads", config.sync_uploads, "Make close() wait until an upload has been sent");
+    app.add_option("--prefetch-workers", config.prefetch_workers, "Chats prefetched at once (0 disables prefetching)")
+        ->capture_default_str()
+        ->check(CLI::Range(std::size_t{0}, std::size_t{16}));
+    app.add_option("--media-prefetch-kb", config.media_prefetch_kb, "Media read ahead on listing, max KB (0 off)")
+        ->capture_default_str()
+        ->check(CLI::Range(std::size_t{0}, std::size_t{64 * 1024}));
+    app.add_option("--files-budget-mb", config.files_budget_mb, "Disk cap on downloaded files (0 = unlimited)")
+        ->capture_default_str();
+    app.add_option("--trace-events", config.trace_events, "Record the last N trace events (0 disables tracing)")
+        ->capture_default_str();
+    app.add_flag("--warm-start", config.warm_start, "Mount from the cached snapshot, sync with Telegram meanwhile");
+    app.add_flag("--compact-messages", config.compact_messages, "Store cached messages older than an hour compressed");
+    app.add_flag("--convert-cache", config.convert_cache, "Convert an older cache to incremental vacuum (slow)");
+    app.add_option("--account", config.accounts, "Mount this account at <mount_point>/<name> (repeat for several)")
+        ->check([](const std::string& name) {
+            return name.empty() || name == "." || name == ".." || name.find('/') != std::string::npos
+                       ? std::string("Account names must be a single path component")
+                       : std::string();
+        });
+
+    // Mock tree shape, for load testing without a Telegram account
+    int64_t mock_latency_us = 0;
+    int64_t mock_jitter_us = 0;
+    app.add_option("--mock-users", config.mock.users, "Users generated by --mock (no users/groups/channels: demo)");
+    app.add_option("--mock-groups", config.mock.groups, "Groups generated by --mock");
+    app.add_option("--mock-channels", config.mock.channels, "Channels generated by --mock");
+    app.add_option("--mock-messages", config.mock.messages_per_chat, "Messages in each --mock chat")
+        ->capture_default_str();
+    app.add_option("--mock-latency-us", mock_latency_us, "Simulated backend latency of --mock, in microseconds")
+        ->check(CLI::NonNegativeNumber);
+    app.add_option("--mock-jitter-us", mock_jitter_us, "Uniform jitter around --mock-latency-us, in microseconds")
+        ->check(CLI::NonNegativeNumber);
 
     CLI11_PARSE(app, argc, argv);
+    if (std::set<std::string>(config.accounts.begin(), config.accounts.end()).size() != config.accounts.size()) {
+        std::cerr << "Error: An account is given more than once\n";
+        return 1;
+    }
+    config.mock.latency = std::chrono::microseconds(mock_latency_us);
+    config.mock.jitter = std::chrono::microseconds(mock_jitter_us);
 
     // Pre-flight checks BEFORE daemonising (so errors go to stderr)
     if (!config.mock_mode) {
@@ -0,0 +1,454 @@
+#include <fmt/format.h>
+#include <CLI/CLI.hpp>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// Operations the generator issues
+enum class Op { STAT, READDIR, READ, WRITE };
+
+constexpr std::size_t kOps = 4;
+constexpr std::array<const char*, kOps> kOpNames = {"stat", "readdir", "read", "write"};
+
+using OpWeights = std::array<unsigned, kOps>;
+
+/// Command line configuration
+struct LoadConfig {
+    std::string mount_point;
+    bool existing{false};      // Drive an already mounted filesystem
+    bool allow_writes{false};  // Permit writes to an existing mount (they send messages)
+    unsigned threads{8};       // Client threads issuing operations
+    double duration{10.0};     // Seconds to run for
+    std::string mix{"stat=60,readdir=15,read=20,write=5"};
+    unsigned fuse_threads{4};  // tg-fused -j (1 = single-threaded mount)
+    std::size_t users{1000};   // Mock tree shape
+    std::size_t groups{100};
+    std::size_t channels{50};
+    std::size_t messages{200};
+    int64_t latency_us{0};     // Mock backend latency and jitter
+    int64_t jitter_us{0};
+    bool verbose{false};       // Keep the daemon's output
+};
+
+/// Paths each operation picks from
+struct Targets {
+    std::vector<std::string> stat;     // Chat directories and their files
+    std::vector<std::string> readdir;  // Sections and chat directories
+    std::vector<std::string> read;     // .info and messages files
+    std::vector<std::string> write;    // txt files
+};
+
+/// Latencies and failures of one operation, per thread
+struct OpSamples {
+    std::vector<int64_t> latency_ns;
+    uint64_t errors{0};
+};
+
+using ThreadSamples = std::array<OpSamples, kOps>;
+
+/// Parse "stat=60,readdir=15,read=20,write=5" (unnamed operations get 0)
+std::optional<OpWeights> parse_mix(const std::string& mix) {
+    OpWeights weights{};
+    std::stringstream stream(mix);
+    std::string part;
+    while (std::getline(stream, part, ',')) {
+        auto eq = part.find('=');
+        if (eq == std::string::npos) {
+            return std::nullopt;
+        }
+        auto name = part.substr(0, eq);
+        auto op = std::find(kOpNames.begin(), kOpNames.end(), name);
+        if (op == kOpNames.end()) {
+            return std::nullopt;
+        }
+        try {
+            auto weight = static_cast<unsigned>(std::stoul(part.substr(eq + 1)));
+            weights[static_cast<std::size_t>(op - kOpNames.begin())] = weight;
+        } catch (const std::exception&) {
+            return std::nullopt;
+        }
+    }
+    for (auto weight : weights) {
+        if (weight > 0) {
+            return weights;
+        }
+    }
+    return std::nullopt;
+}
+
+/// tg-fused next to this executable, or from PATH
+std::string find_daemon_path(const char* argv0) {
+    std::string path(argv0);
+    auto pos = path.rfind('/');
+    if (pos != std::string::npos) {
+        return path.substr(0, pos + 1) + "tg-fused";
+    }
+    return "tg-fused";
+}
+
+/// Whether a filesystem other than the parent's is mounted at @p mount_point
+bool is_mounted(const std::string& mount_point) {
+    struct stat mount_stat{};
+    struct stat parent_stat{};
+    if (::stat(mount_point.c_str(), &mount_stat) != 0 || ::stat((mount_point + "/..").c_str(), &parent_stat) != 0) {
+        return false;
+    }
+    return mount_stat.st_dev != parent_stat.st_dev;
+}
+
+/// Start tg-fused in mock mode on the mount point
+/// @return The daemon's pid once the filesystem is mounted, nullopt on failure
+std::optional<pid_t> spawn_daemon(const LoadConfig& config, const char* argv0) {
+    std::vector<std::string> args = {
+        find_daemon_path(argv0),
+        config.mount_point,
+        "-f",
+        "--mock",
+        "-j", std::to_string(config.fuse_threads),
+        "--mock-users", std::to_string(config.users),
+        "--mock-groups", std::to_string(config.groups),
+        "--mock-channels", std::to_string(config.channels),
+        "--mock-messages", std::to_string(config.messages),
+        "--mock-latency-us", std::to_string(config.latency_us),
+        "--mock-jitter-us", std::to_string(config.jitter_us),
+    };
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "Error: fork failed: " << std::strerror(errno) << "\n";
+        return std::nullopt;
+    }
+    if (pid == 0) {
+        if (!config.verbose) {
+            int null = ::open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+        }
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+
+    auto deadline = Clock::now() + std::chrono::seconds(10);
+    while (Clock::now() < deadline) {
+        int status = 0;
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            std::cerr << "Error: " << args[0] << " exited before mounting (status " << status << ")\n";
+            return std::nullopt;
+        }
+        if (is_mounted(config.mount_point)) {
+            return pid;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    std::cerr << "Error: " << config.mount_point << " was not mounted within 10 seconds\n";
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+    return std::nullopt;
+}
+
+/// Unmount by stopping the daemon (FUSE unmounts on SIGTERM)
+void stop_daemon(pid_t pid) {
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+}
+
+/// Names in a directory, without . and ..
+std::vector<std::string> list_names(const std::string& path) {
+    std::vector<std::string> names;
+    if (DIR* dir = opendir(path.c_str())) {
+        while (auto* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..") {
+                names.push_back(std::move(name));
+            }
+        }
+        closedir(dir);
+    }
+    return names;
+}
+
+/// Build the target lists from the chat sections (chat directories aren't listed, to keep startup cheap)
+Targets discover(const std::string& mount_point) {
+    Targets targets;
+    for (const char* section : {"users", "groups", "channels"}) {
+        auto section_path = mount_point + "/" + section;
+        targets.readdir.push_back(section_path);
+        for (const auto& name : list_names(section_path)) {
+            auto chat = section_path + "/" + name;
+            targets.readdir.push_back(chat);
+            targets.stat.push_back(chat);
+            for (const char* file : {".info", "messages"}) {
+                targets.stat.push_back(chat + "/" + file);
+                targets.read.push_back(chat + "/" + file);
+            }
+            if (std::strcmp(section, "channels") != 0) {
+                targets.write.push_back(chat + "/txt");
+            }
+        }
+    }
+    return targets;
+}
+
+bool do_stat(const std::string& path) {
+    struct stat st{};
+    return ::stat(path.c_str(), &st) == 0;
+}
+
+bool do_readdir(const std::string& path) {
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return false;
+    }
+    while (readdir(dir)) {
+    }
+    closedir(dir);
+    return true;
+}
+
+bool do_read(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    char buffer[64 * 1024];
+    ssize_t n = 0;
+    while ((n = ::read(fd, buffer, sizeof(buffer))) > 0) {
+    }
+    ::close(fd);
+    return n == 0;
+}
+
+bool do_write(const std::string& path, uint64_t sequence) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+    if (fd < 0) {
+        return false;
+    }
+    auto line = fmt::format("load test message {}\n", sequence);
+    bool written = ::write(fd, line.data(), line.size()) == static_cast<ssize_t>(line.size());
+    return ::close(fd) == 0 && written;
+}
+
+/// Issue operations picked by @p weights until @p stop is set
+void run_worker(
+    unsigned index,
+    const Targets& targets,
+    const OpWeights& weights,
+    const std::atomic<bool>& stop,
+    ThreadSamples& samples
+) {
+    std::minstd_rand random(index * 7919 + 1);
+    std::discrete_distribution<std::size_t> pick_op(weights.begin(), weights.end());
+    const std::array<const std::vector<std::string>*, kOps> paths = {
+        &targets.stat, &targets.readdir, &targets.read, &targets.write
+    };
+
+    uint64_t sequence = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+        auto op = pick_op(random);
+        const auto& candidates = *paths[op];
+        const auto& path = candidates[random() % candidates.size()];
+
+        auto start = Clock::now();
+        bool ok = false;
+        switch (static_cast<Op>(op)) {
+            case Op::STAT:
+                ok = do_stat(path);
+                break;
+            case Op::READDIR:
+                ok = do_readdir(path);
+                break;
+            case Op::READ:
+                ok = do_read(path);
+                break;
+            case Op::WRITE:
+                ok = do_write(path, ++sequence);
+                break;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+
+        samples[op].latency_ns.push_back(elapsed);
+        if (!ok) {
+            ++samples[op].errors;
+        }
+    }
+}
+
+/// Latency at quantile @p q of sorted samples, in microseconds
+double percentile_us(const std::vector<int64_t>& sorted, double q) {
+    auto index = static_cast<std::size_t>(q * static_cast<double>(sorted.size() - 1));
+    return static_cast<double>(sorted[index]) / 1e3;
+}
+
+void print_report(const std::vector<ThreadSamples>& per_thread, double seconds) {
+    std::cout << fmt::format(
+        "{:<8} {:>10} {:>11} {:>8} {:>10} {:>10} {:>10} {:>10} {:>10}\n",
+        "op", "count", "ops/s", "errors", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us"
+    );
+
+    uint64_t total = 0;
+    for (std::size_t op = 0; op < kOps; ++op) {
+        std::vector<int64_t> latencies;
+        uint64_t errors = 0;
+        for (const auto& samples : per_thread) {
+            latencies.insert(latencies.end(), samples[op].latency_ns.begin(), samples[op].latency_ns.end());
+            errors += samples[op].errors;
+        }
+        if (latencies.empty()) {
+            continue;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        total += latencies.size();
+
+        std::cout << fmt::format(
+            "{:<8} {:>10} {:>11.0f} {:>8} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f}\n",
+            kOpNames[op],
+            latencies.size(),
+            static_cast<double>(latencies.size()) / seconds,
+            errors,
+            percentile_us(latencies, 0.50),
+            percentile_us(latencies, 0.90),
+            percentile_us(latencies, 0.99),
+            percentile_us(latencies, 0.999),
+            static_cast<double>(latencies.back()) / 1e3
+        );
+    }
+    std::cout << fmt::format("{:<8} {:>10} {:>11.0f}\n", "total", total, static_cast<double>(total) / seconds);
+}
+
+/// Drive the mounted filesystem
+int run_load(const LoadConfig& config, const OpWeights& requested) {
+    auto targets = discover(config.mount_point);
+    if (targets.readdir.size() <= 3) {
+        std::cerr << "Error: No chats found under " << config.mount_point << "\n";
+        return 1;
+    }
+
+    // Operations without targets (e.g. no writable chats) are dropped from the mix
+    auto weights = requested;
+    const std::array<std::size_t, kOps> available = {
+        targets.stat.size(), targets.readdir.size(), targets.read.size(), targets.write.size()
+    };
+    for (std::size_t op = 0; op < kOps; ++op) {
+        if (available[op] == 0) {
+            weights[op] = 0;
+        }
+    }
+    // std::discrete_distribution needs a positive total weight
+    if (std::all_of(weights.begin(), weights.end(), [](auto weight) { return weight == 0; })) {
+        std::cerr << "Error: Nothing to drive under " << config.mount_point
+                  << ": every operation in the mix has a zero weight or no targets\n";
+        return 1;
+    }
+
+    std::cout << fmt::format(
+        "Driving {} with {} threads for {}s ({} chats)\n",
+        config.mount_point,
+        config.threads,
+        config.duration,
+        targets.readdir.size() - 3
+    );
+
+    std::atomic<bool> stop{false};
+    std::vector<ThreadSamples> samples(config.threads);
+    std::vector<std::thread> workers;
+    auto start = Clock::now();
+    for (unsigned i = 0; i < config.threads; ++i) {
+        workers.emplace_back([&, i] { run_worker(i, targets, weights, stop, samples[i]); });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(config.duration));
+    stop.store(true, std::memory_order_relaxed);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    print_report(samples, seconds);
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    CLI::App app{"tg-fuse-load - FUSE load generator over the mock data provider"};
+
+    LoadConfig config;
+
+    app.add_option("mount_point", config.mount_point, "Directory to mount the mock filesystem on")
+        ->required()
+        ->check(CLI::ExistingDirectory);
+    app.add_flag("--existing", config.existing, "Drive a filesystem already mounted there instead of mounting");
+    app.add_flag("--allow-writes", config.allow_writes, "Allow writes to an --existing mount (they send messages)");
+    app.add_option("-t,--threads", config.threads, "Client threads issuing operations")
+        ->capture_default_str()
+        ->check(CLI::Range(1u, 1024u));
+    app.add_option("-d,--duration", config.duration, "Seconds to run for")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+    app.add_option("-m,--mix", config.mix, "Operation weights: stat=N,readdir=N,read=N,write=N")
+        ->capture_default_str();
+    app.add_option("-j,--fuse-threads", config.fuse_threads, "FUSE worker threads of the mount (1 = single-threaded)")
+        ->capture_default_str();
+    app.add_option("--users", config.users, "Mock users")->capture_default_str();
+    app.add_option("--groups", config.groups, "Mock groups")->capture_default_str();
+    app.add_option("--channels", config.channels, "Mock channels")->capture_default_str();
+    app.add_option("--messages", config.messages, "Messages in each mock chat")->capture_default_str();
+    app.add_option("--latency-us", config.latency_us, "Simulated backend latency, in microseconds")
+        ->check(CLI::NonNegativeNumber);
+    app.add_option("--jitter-us", config.jitter_us, "Uniform jitter around the latency, in microseconds")
+        ->check(CLI::NonNegativeNumber);
+    app.add_flag("-v,--verbose", config.verbose, "Show the daemon's output");
+
+    CLI11_PARSE(app, argc, argv);
+
+    auto weights = parse_mix(config.mix);
+    if (!weights) {
+        std::cerr << "Error: Invalid --mix '" << config.mix << "'\n";
+        return 1;
+    }
+    if (config.existing && !config.allow_writes) {
+        (*weights)[static_cast<std::size_t>(Op::WRITE)] = 0;
+    }
+
+    if (config.existing) {
+        return run_load(config, *weights);
+    }
+
+    if (is_mounted(config.mount_point)) {
+        std::cerr << "Error: Something is already mounted at " << config.mount_point << " (use --existing)\n";
+        return 1;
+    }
+    auto daemon = spawn_daemon(config, argv[0]);
+    if (!daemon) {
+        return 1;
+    }
+    int result = run_load(config, *weights);
+    stop_daemon(*daemon);
+    return result;
+}
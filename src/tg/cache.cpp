@@ -1,16 +1,37 @@
 #include "tg/cache.hpp"
 
 #include "tg/exceptions.hpp"
+#include "tg/message_pages.hpp"
+#include "tg/metrics.hpp"
+#include "tg/trace.hpp"
 
 #include <spdlog/spdlog.h>
 #include <sqlite3.h>
 
+#include <algorithm>
+#include <cctype>
 #include <chrono>
+#include <ctime>
+#include <limits>
+#include <map>
+#include <set>
+#include <string_view>
+#include <unordered_set>
 
 namespace tg {
 
 namespace {
 
+// How long a connection waits on a locked database before giving up
+constexpr int kBusyTimeoutMs = 5000;
+
+// Failed write-behind batches retried before one is dropped; the wait doubles from flush_interval each time
+constexpr std::size_t kMaxFlushAttempts = 8;
+
+// Recent messages a preset dictionary is trained on, and the fewest worth training on
+constexpr int kDictionarySamples = 2000;
+constexpr std::size_t kMinDictionarySamples = 200;
+
 // Helper to execute SQL with error handling
 void exec_sql(sqlite3* db, const char* sql) {
     char* err_msg = nullptr;
@@ -34,29 +55,391 @@ int media_type_to_int(MediaType type) { return static_cast<int>(type); }
 // Helper to convert int to MediaType
 MediaType int_to_media_type(int value) { return static_cast<MediaType>(value); }
 
+// In-memory databases are private to their connection, so they can't be pooled
+bool is_memory_database(const std::string& path) {
+    return path.empty() || path == ":memory:" || path.starts_with("file::memory:");
+}
+
+// Statement timing label: the verb and the table, e.g. "select messages"
+std::string statement_label(std::string_view sql) {
+    std::vector<std::string> words;
+    std::string word;
+    for (char c : sql) {
+        if (std::isalnum(static_cast<unsigned char>(c)) || c == '_') {
+            word += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        } else if (!word.empty()) {
+            words.push_back(std::move(word));
+            word.clear();
+        }
+    }
+    if (!word.empty()) {
+        words.push_back(std::move(word));
+    }
+    if (words.empty()) {
+        return "unknown";
+    }
+
+    const auto& verb = words[0];
+    if (verb == "update" && words.size() > 1) {
+        return verb + " " + words[1];
+    }
+    for (std::size_t i = 1; i + 1 < words.size(); ++i) {
+        if (words[i] == "from" || words[i] == "into") {
+            return verb + " " + words[i + 1];
+        }
+    }
+    return verb;
+}
+
+// Cached statement with the histogram and span name its executions are recorded under
+struct PreparedStatement {
+    sqlite3_stmt* stmt;
+    LatencyHistogram* latency;
+    const char* trace_name;
+};
+
+// Resets a cached statement on scope exit so it is ready for the next call
+// (the time in between is recorded as the statement's latency and trace span)
+class StatementScope {
+public:
+    explicit StatementScope(PreparedStatement statement)
+        : stmt_(statement.stmt), timer_(statement.latency), span_("sqlite", statement.trace_name) {}
+    ~StatementScope() {
+        sqlite3_reset(stmt_);
+        sqlite3_clear_bindings(stmt_);
+    }
+
+    StatementScope(const StatementScope&) = delete;
+    StatementScope& operator=(const StatementScope&) = delete;
+
+    sqlite3_stmt* get() const { return stmt_; }
+
+private:
+    sqlite3_stmt* stmt_;
+    LatencyTimer timer_;
+    TraceSpan span_;
+};
+
+// Text column as a string (NULL reads as empty)
+std::string column_string(sqlite3_stmt* stmt, int col) {
+    const auto* text = sqlite3_column_text(stmt, col);
+    return text ? reinterpret_cast<const char*>(text) : std::string{};
+}
+
+// Text of a column, valid until the statement steps again
+std::string_view column_view(sqlite3_stmt* stmt, int col) {
+    const auto* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, col));
+    return text ? std::string_view(text, sqlite3_column_bytes(stmt, col)) : std::string_view{};
+}
+
+User read_user(sqlite3_stmt* stmt) {
+    User user;
+    user.id = sqlite3_column_int64(stmt, 0);
+    user.username = column_string(stmt, 1);
+    user.first_name = column_string(stmt, 2);
+    user.last_name = column_string(stmt, 3);
+    user.phone_number = column_string(stmt, 4);
+    user.is_contact = sqlite3_column_int(stmt, 5) != 0;
+    user.last_message_id = sqlite3_column_int64(stmt, 6);
+    user.last_message_timestamp = sqlite3_column_int64(stmt, 7);
+    return user;
+}
+
+Chat read_chat(sqlite3_stmt* stmt) {
+    Chat chat;
+    chat.id = sqlite3_column_int64(stmt, 0);
+    chat.type = int_to_chat_type(sqlite3_column_int(stmt, 1));
+    chat.title = column_string(stmt, 2);
+    chat.username = column_string(stmt, 3);
+    chat.last_message_id = sqlite3_column_int64(stmt, 4);
+    chat.last_message_timestamp = sqlite3_column_int64(stmt, 5);
+    chat.can_send_messages = sqlite3_column_int(stmt, 6) != 0;
+    return chat;
+}
+
+// The message in the current row, viewing the row's text (valid until the statement steps again)
+MessageView view_message(sqlite3_stmt* stmt) {
+    MessageView msg;
+    msg.id = sqlite3_column_int64(stmt, 0);
+    msg.chat_id = sqlite3_column_int64(stmt, 1);
+    msg.sender_id = sqlite3_column_int64(stmt, 2);
+    msg.timestamp = sqlite3_column_int64(stmt, 3);
+    msg.text = column_view(stmt, 4);
+    msg.is_outgoing = sqlite3_column_int(stmt, 5) != 0;
+
+    if (sqlite3_column_type(stmt, 6) != SQLITE_NULL) {
+        MediaView media;
+        media.type = int_to_media_type(sqlite3_column_int(stmt, 6));
+        media.file_id = column_view(stmt, 7);
+        media.filename = column_view(stmt, 8);
+        media.mime_type = column_view(stmt, 9);
+        media.file_size = sqlite3_column_int64(stmt, 10);
+
+        if (sqlite3_column_type(stmt, 11) != SQLITE_NULL) {
+            media.local_path = column_view(stmt, 11);
+        }
+        if (sqlite3_column_type(stmt, 12) != SQLITE_NULL) {
+            media.width = sqlite3_column_int(stmt, 12);
+        }
+        if (sqlite3_column_type(stmt, 13) != SQLITE_NULL) {
+            media.height = sqlite3_column_int(stmt, 13);
+        }
+        if (sqlite3_column_type(stmt, 14) != SQLITE_NULL) {
+            media.duration = sqlite3_column_int(stmt, 14);
+        }
+
+        msg.media = media;
+    }
+
+    return msg;
+}
+
+Message read_message(sqlite3_stmt* stmt) { return view_message(stmt).to_message(); }
+
+FileListItem read_file_item(sqlite3_stmt* stmt) {
+    FileListItem item;
+    item.message_id = sqlite3_column_int64(stmt, 0);
+    item.filename = column_string(stmt, 2);
+    item.file_size = sqlite3_column_int64(stmt, 3);
+    item.timestamp = sqlite3_column_int64(stmt, 4);
+    item.type = int_to_media_type(sqlite3_column_int(stmt, 5));
+    item.file_id = column_string(stmt, 6);
+    return item;
+}
+
+// Decode the page in column @p col of the current row, appending its messages to @p out
+template <typename Out>
+void read_page(sqlite3_stmt* stmt, int col, int64_t chat_id, std::string_view dictionary, Out& out) {
+    const auto* data = static_cast<const char*>(sqlite3_column_blob(stmt, col));
+    decode_message_page(std::string_view(data, sqlite3_column_bytes(stmt, col)), chat_id, out, dictionary);
+}
+
+// Page a timestamp falls in: the start of its span-aligned bucket
+int64_t page_start(int64_t timestamp, int64_t span) {
+    auto start = timestamp - timestamp % span;
+    return start > timestamp ? start - span : start;
+}
+
+// FTS5 query matching every word of @p query literally (a trailing * keeps prefix matching)
+std::string fts_query(std::string_view query) {
+    static constexpr std::string_view kSpace = " \t\r\n";
+    std::string match;
+    for (auto start = query.find_first_not_of(kSpace); start != std::string_view::npos;
+         start = query.find_first_not_of(kSpace, start)) {
+        auto end = std::min(query.find_first_of(kSpace, start), query.size());
+        auto word = query.substr(start, end - start);
+        start = end;
+
+        bool prefix = word.size() > 1 && word.back() == '*';
+        if (prefix) {
+            word.remove_suffix(1);
+        }
+        if (!match.empty()) {
+            match += ' ';
+        }
+        match += '"';
+        for (char c : word) {
+            match += c;
+            if (c == '"') {
+                match += '"';
+            }
+        }
+        match += prefix ? "\"*" : "\"";
+    }
+    return match;
+}
+
+// Add the paged messages that have no row; rows are newer (edits since sealing)
+void merge_paged(std::vector<Message>& rows, std::vector<Message>&& paged) {
+    std::unordered_set<int64_t> ids;
+    for (const auto& msg : rows) {
+        ids.insert(msg.id);
+    }
+    for (auto& msg : paged) {
+        if (!ids.contains(msg.id)) {
+            rows.push_back(std::move(msg));
+        }
+    }
+}
+
+ChatMessageStats read_chat_message_stats(sqlite3_stmt* stmt) {
+    ChatMessageStats stats;
+    stats.chat_id = sqlite3_column_int64(stmt, 0);
+    stats.message_count = static_cast<std::size_t>(sqlite3_column_int64(stmt, 1));
+    stats.content_size = static_cast<std::size_t>(sqlite3_column_int64(stmt, 2));
+    stats.last_message_time = sqlite3_column_int64(stmt, 3);
+    stats.last_fetch_time = sqlite3_column_int64(stmt, 4);
+    stats.oldest_message_time = sqlite3_column_int64(stmt, 5);
+    return stats;
+}
+
+MessageBucket read_message_bucket(sqlite3_stmt* stmt) {
+    MessageBucket bucket;
+    bucket.start_ts = sqlite3_column_int64(stmt, 0);
+    bucket.end_ts = sqlite3_column_int64(stmt, 1);
+    bucket.version = sqlite3_column_int64(stmt, 2);
+    if (sqlite3_column_type(stmt, 3) != SQLITE_NULL) {
+        bucket.content_size = static_cast<std::size_t>(sqlite3_column_int64(stmt, 3));
+    }
+    bucket.message_count = static_cast<std::size_t>(sqlite3_column_int64(stmt, 4));
+    bucket.last_message_time = sqlite3_column_int64(stmt, 5);
+    return bucket;
+}
+
 }  // namespace
 
-CacheManager::CacheManager(const std::string& db_path) : db_(nullptr) {
-    int rc = sqlite3_open(db_path.c_str(), &db_);
-    if (rc != SQLITE_OK) {
-        throw DatabaseException("Failed to open database: " + std::string(sqlite3_errmsg(db_)));
+int64_t local_day_start(int64_t timestamp) {
+    auto time = static_cast<std::time_t>(timestamp);
+    std::tm tm{};
+    localtime_r(&time, &tm);  // std::localtime shares one buffer between threads
+    tm.tm_hour = 0;
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+    return static_cast<int64_t>(std::mktime(&tm));
+}
+
+int64_t local_day_end(int64_t day_start) {
+    // 30 hours on is always within the next day, whatever the DST shift
+    return local_day_start(day_start + 30 * 3600);
+}
+
+/// One SQLite connection and the statements prepared on it
+///
+/// Statements are compiled on first use and kept until the connection closes.
+/// Not thread-safe: the owner serialises access (writer mutex or reader pool).
+class CacheManager::Connection {
+public:
+    Connection(const std::string& path, int flags) {
+        int rc = sqlite3_open_v2(path.c_str(), &db_, flags | SQLITE_OPEN_NOMUTEX, nullptr);
+        if (rc != SQLITE_OK) {
+            std::string error = db_ ? sqlite3_errmsg(db_) : sqlite3_errstr(rc);
+            sqlite3_close(db_);
+            throw DatabaseException("Failed to open database: " + error);
+        }
+        sqlite3_busy_timeout(db_, kBusyTimeoutMs);
+    }
+
+    ~Connection() {
+        for (auto& [sql, statement] : statements_) {
+            sqlite3_finalize(statement.stmt);
+        }
+        sqlite3_close(db_);
+    }
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    [[nodiscard]] sqlite3* handle() const { return db_; }
+
+    /// Prepared statement for @p sql, compiled on first use
+    /// @throws DatabaseException if the statement doesn't compile
+    PreparedStatement prepare(std::string_view sql) {
+        auto it = statements_.find(sql);
+        if (it != statements_.end()) {
+            return it->second;
+        }
+
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v3(db_, sql.data(), static_cast<int>(sql.size()), SQLITE_PREPARE_PERSISTENT, &stmt,
+                               nullptr) != SQLITE_OK) {
+            throw DatabaseException("Failed to prepare statement: " + std::string(sqlite3_errmsg(db_)));
+        }
+        auto label = statement_label(sql);
+        auto& latency = Metrics::global().histogram({"sqlite_statement_seconds", "statement", label});
+        PreparedStatement statement{stmt, &latency, Tracer::global().intern(label)};
+        statements_.emplace(std::string(sql), statement);
+        return statement;
+    }
+
+private:
+    sqlite3* db_{nullptr};
+    std::map<std::string, PreparedStatement, std::less<>> statements_;
+};
+
+/// Read connection borrowed from the pool for the duration of one call
+///
+/// Commits queued writes first, so the read sees them. Falls back to the
+/// writer connection (holding the writer mutex) when the pool is disabled.
+class CacheManager::ReadLease {
+public:
+    explicit ReadLease(CacheManager& cache) : cache_(cache) {
+        cache.flush_queued();
+        reader_ = cache.acquire_reader();
+        if (!reader_) {
+            writer_lock_ = std::unique_lock<std::mutex>(cache.writer_mutex_);
+        }
+    }
+
+    ~ReadLease() {
+        if (reader_) {
+            cache_.release_reader(reader_);
+        }
     }
 
+    ReadLease(const ReadLease&) = delete;
+    ReadLease& operator=(const ReadLease&) = delete;
+
+    Connection* operator->() const { return reader_ ? reader_ : cache_.writer_.get(); }
+    Connection& operator*() const { return *operator->(); }
+
+private:
+    CacheManager& cache_;
+    Connection* reader_{nullptr};
+    std::unique_lock<std::mutex> writer_lock_;
+};
+
+CacheManager::CacheManager(
+    const std::string& db_path,
+    std::size_t max_readers,
+    WriteBehindConfig write_behind,
+    MessageStoreConfig message_store,
+    MaintenanceConfig maintenance
+)
+    : db_path_(db_path),
+      writer_(std::make_unique<Connection>(db_path, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)),
+      max_readers_(is_memory_database(db_path) ? 0 : max_readers),
+      write_behind_(write_behind),
+      message_store_(message_store),
+      maintenance_(maintenance),
+      last_queued_(std::chrono::steady_clock::now()),
+      next_checkpoint_(last_queued_ + maintenance_.checkpoint_interval),
+      next_optimize_(last_queued_ + maintenance_.optimize_interval) {
     spdlog::info("Opened cache database: {}", db_path);
     init_database();
+
+    flusher_ = std::thread([this] { write_behind_loop(); });
 }
 
 CacheManager::~CacheManager() {
-    if (db_) {
-        sqlite3_close(db_);
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        stopping_ = true;
+    }
+    pending_cv_.notify_one();
+    if (flusher_.joinable()) {
+        flusher_.join();
     }
+
+    // Commit whatever arrived after the flusher's last batch
+    flush();
 }
 
 void CacheManager::init_database() {
+    // Deletes leave free pages for maintenance ticks to release a few at a time, instead of a blocking VACUUM.
+    // Only new databases take the setting at once; older ones need convert_vacuum_mode().
+    exec_sql(writer_->handle(), "PRAGMA auto_vacuum=INCREMENTAL;");
+    {
+        StatementScope scope(writer_->prepare("PRAGMA auto_vacuum"));
+        constexpr int kIncremental = 2;
+        vacuum_mode_pending_ = !is_memory_database(db_path_) && sqlite3_step(scope.get()) == SQLITE_ROW &&
+                               sqlite3_column_int(scope.get(), 0) != kIncremental;
+    }
+
     // Enable WAL mode for better concurrency
-    exec_sql(db_, "PRAGMA journal_mode=WAL;");
-    exec_sql(db_, "PRAGMA synchronous=NORMAL;");
-    exec_sql(db_, "PRAGMA foreign_keys=ON;");
+    exec_sql(writer_->handle(), "PRAGMA journal_mode=WAL;");
+    exec_sql(writer_->handle(), "PRAGMA synchronous=NORMAL;");
+    exec_sql(writer_->handle(), "PRAGMA foreign_keys=ON;");
 
     create_tables();
 }
@@ -111,6 +494,7 @@ void CacheManager::create_tables() {
         );
 
         CREATE INDEX IF NOT EXISTS idx_messages_chat_timestamp ON messages(chat_id, timestamp DESC);
+        CREATE INDEX IF NOT EXISTS idx_messages_timestamp ON messages(timestamp);
         CREATE INDEX IF NOT EXISTS idx_messages_media ON messages(chat_id, media_type) WHERE media_type IS NOT NULL;
 
         CREATE TABLE IF NOT EXISTS files (
@@ -127,6 +511,20 @@ void CacheManager::create_tables() {
         CREATE INDEX IF NOT EXISTS idx_files_chat_type ON files(chat_id, type);
         CREATE INDEX IF NOT EXISTS idx_files_timestamp ON files(chat_id, timestamp DESC);
 
+        CREATE TABLE IF NOT EXISTS file_sync (
+            chat_id INTEGER PRIMARY KEY,
+            watermark INTEGER NOT NULL DEFAULT 0,
+            synced_at INTEGER NOT NULL DEFAULT 0
+        );
+
+        CREATE TABLE IF NOT EXISTS downloads (
+            file_id TEXT PRIMARY KEY,
+            size INTEGER NOT NULL DEFAULT 0,
+            hits INTEGER NOT NULL DEFAULT 0,
+            last_access INTEGER NOT NULL DEFAULT 0
+        );
+        CREATE INDEX IF NOT EXISTS idx_downloads_last_access ON downloads(last_access);
+
         CREATE TABLE IF NOT EXISTS chat_message_stats (
             chat_id INTEGER PRIMARY KEY,
             message_count INTEGER NOT NULL DEFAULT 0,
@@ -143,15 +541,461 @@ void CacheManager::create_tables() {
             created_at INTEGER NOT NULL DEFAULT (strftime('%s', 'now'))
         );
         CREATE INDEX IF NOT EXISTS idx_upload_cache_size ON upload_cache(file_size);
+
+        CREATE TABLE IF NOT EXISTS settings (
+            key TEXT PRIMARY KEY,
+            value TEXT NOT NULL
+        );
+
+        CREATE TABLE IF NOT EXISTS message_pages (
+            chat_id INTEGER NOT NULL,
+            start_ts INTEGER NOT NULL,
+            end_ts INTEGER NOT NULL,
+            first_id INTEGER NOT NULL,
+            last_id INTEGER NOT NULL,
+            message_count INTEGER NOT NULL,
+            dictionary_id INTEGER NOT NULL DEFAULT 0,
+            data BLOB NOT NULL,
+            PRIMARY KEY (chat_id, start_ts)
+        );
+        CREATE INDEX IF NOT EXISTS idx_message_pages_ids ON message_pages(chat_id, last_id);
+        CREATE INDEX IF NOT EXISTS idx_message_pages_end ON message_pages(end_ts);
+
+        CREATE TABLE IF NOT EXISTS message_dictionaries (
+            id INTEGER PRIMARY KEY,
+            data BLOB NOT NULL
+        );
+
+        CREATE TABLE IF NOT EXISTS message_buckets (
+            chat_id INTEGER NOT NULL,
+            start_ts INTEGER NOT NULL,
+            end_ts INTEGER NOT NULL,
+            version INTEGER NOT NULL DEFAULT 0,
+            content_size INTEGER,
+            message_count INTEGER NOT NULL DEFAULT 0,
+            last_message_time INTEGER NOT NULL DEFAULT 0,
+            PRIMARY KEY (chat_id, start_ts)
+        );
     )";
 
-    exec_sql(db_, schema);
+    exec_sql(writer_->handle(), schema);
+
+    // Full-text index of messages, in a table of its own so sealing rows into pages leaves it alone
+    const char* search_schema = R"(
+        CREATE TABLE IF NOT EXISTS message_search_keys (
+            id INTEGER PRIMARY KEY,
+            chat_id INTEGER NOT NULL,
+            message_id INTEGER NOT NULL,
+            timestamp INTEGER NOT NULL,
+            UNIQUE (chat_id, message_id)
+        );
+        CREATE INDEX IF NOT EXISTS idx_message_search_keys_timestamp ON message_search_keys(timestamp);
+
+        CREATE VIRTUAL TABLE IF NOT EXISTS message_search USING fts5(
+            text, filename, tokenize = 'unicode61 remove_diacritics 2'
+        );
+    )";
+    try {
+        exec_sql(writer_->handle(), search_schema);
+        search_enabled_ = true;
+    } catch (const DatabaseException& e) {
+        spdlog::warn("Message search disabled (SQLite without FTS5?): {}", e.what());
+    }
+
+    // Databases from before the index: index the cached rows once
+    if (search_enabled_) {
+        StatementScope scope(writer_->prepare(
+            "SELECT EXISTS (SELECT 1 FROM messages) AND NOT EXISTS (SELECT 1 FROM message_search_keys)"
+        ));
+        if (sqlite3_step(scope.get()) == SQLITE_ROW && sqlite3_column_int(scope.get(), 0) != 0) {
+            write_transaction([&] {
+                exec_sql(writer_->handle(), R"(
+                    INSERT INTO message_search_keys (chat_id, message_id, timestamp)
+                    SELECT chat_id, id, timestamp FROM messages
+                )");
+                exec_sql(writer_->handle(), R"(
+                    INSERT INTO message_search (rowid, text, filename)
+                    SELECT k.id, m.text, m.media_filename FROM message_search_keys k
+                    JOIN messages m ON m.chat_id = k.chat_id AND m.id = k.message_id
+                )");
+            });
+            spdlog::info("Indexed cached messages for search");
+        }
+    }
+
+    // Databases from before the day buckets: create them stale, to be sized on first listing
+    StatementScope buckets_scope(writer_->prepare(R"(
+        SELECT (EXISTS (SELECT 1 FROM messages) OR EXISTS (SELECT 1 FROM message_pages))
+               AND NOT EXISTS (SELECT 1 FROM message_buckets)
+    )"));
+    if (sqlite3_step(buckets_scope.get()) == SQLITE_ROW && sqlite3_column_int(buckets_scope.get(), 0) != 0) {
+        std::set<std::pair<int64_t, int64_t>> days;
+        {
+            StatementScope scope(writer_->prepare("SELECT DISTINCT chat_id, timestamp FROM messages"));
+            while (sqlite3_step(scope.get()) == SQLITE_ROW) {
+                auto day = local_day_start(sqlite3_column_int64(scope.get(), 1));
+                days.emplace(sqlite3_column_int64(scope.get(), 0), day);
+            }
+        }
+        {
+            // A page may start on a day it holds no messages of; that bucket renders empty and stays unlisted
+            StatementScope scope(writer_->prepare("SELECT chat_id, start_ts, end_ts FROM message_pages"));
+            while (sqlite3_step(scope.get()) == SQLITE_ROW) {
+                auto chat_id = sqlite3_column_int64(scope.get(), 0);
+                days.emplace(chat_id, local_day_start(sqlite3_column_int64(scope.get(), 1)));
+                days.emplace(chat_id, local_day_start(sqlite3_column_int64(scope.get(), 2)));
+            }
+        }
+        write_transaction([&] {
+            for (const auto& [chat_id, day] : days) {
+                touch_bucket(chat_id, day);
+            }
+        });
+        spdlog::info("Created {} message day buckets", days.size());
+    }
     spdlog::debug("Cache database schema initialised");
 }
 
+CacheManager::Connection* CacheManager::acquire_reader() {
+    std::unique_lock<std::mutex> lock(readers_mutex_);
+    while (idle_readers_.empty()) {
+        if (readers_.size() < max_readers_) {
+            try {
+                readers_.push_back(std::make_unique<Connection>(db_path_, SQLITE_OPEN_READONLY));
+                return readers_.back().get();
+            } catch (const DatabaseException& e) {
+                // Keep the readers we already have; with none, reads share the writer
+                spdlog::warn("Cache reader connection unavailable: {}", e.what());
+                max_readers_ = readers_.size();
+            }
+        }
+        if (max_readers_ == 0) {
+            return nullptr;
+        }
+        readers_cv_.wait(lock);
+    }
+
+    Connection* reader = idle_readers_.back();
+    idle_readers_.pop_back();
+    return reader;
+}
+
+void CacheManager::release_reader(Connection* reader) {
+    {
+        std::lock_guard<std::mutex> lock(readers_mutex_);
+        idle_readers_.push_back(reader);
+    }
+    readers_cv_.notify_one();
+}
+
+std::size_t CacheManager::PendingWrites::rows() const {
+    return users.size() + chats.size() + messages.size() + stats.size() + stats_increments.size() + files.size() +
+           downloads.size();
+}
+
+void CacheManager::PendingWrites::merge_older(PendingWrites&& older) {
+    for (auto& [id, user] : older.users) {
+        users.try_emplace(id, std::move(user));
+    }
+    for (auto& [id, chat] : older.chats) {
+        chats.try_emplace(id, std::move(chat));
+    }
+    for (auto& [key, msg] : older.messages) {
+        messages.try_emplace(key, std::move(msg));
+    }
+    for (auto& [key, item] : older.files) {
+        files.try_emplace(key, std::move(item));
+    }
+
+    // A full row queued since already accounts for everything before it; otherwise the older
+    // row stays the base and both increments apply on top of it
+    for (const auto& [chat_id, increment] : older.stats_increments) {
+        if (stats.count(chat_id) != 0) {
+            continue;
+        }
+        auto& merged = stats_increments[chat_id];
+        if (merged.count == 0) {
+            merged = increment;
+        } else {
+            merged.count += increment.count;
+            merged.first_time = increment.first_time;
+        }
+    }
+    for (auto& [chat_id, row] : older.stats) {
+        stats.try_emplace(chat_id, std::move(row));
+    }
+
+    for (auto& [file_id, access] : older.downloads) {
+        auto [it, inserted] = downloads.try_emplace(file_id, std::move(access));
+        if (!inserted) {
+            it->second.hits += access.hits;
+            it->second.last_access = std::max(it->second.last_access, access.last_access);
+        }
+    }
+}
+
+template <typename Update>
+void CacheManager::enqueue(Update&& update) {
+    bool batch_full;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        update(pending_);
+        batch_full = pending_.rows() >= write_behind_.max_batch_rows;
+        last_queued_ = std::chrono::steady_clock::now();
+    }
+    if (batch_full) {
+        pending_cv_.notify_one();
+    }
+}
+
+void CacheManager::queue_user(const User& user) {
+    enqueue([&](PendingWrites& pending) { pending.users.insert_or_assign(user.id, user); });
+}
+
+void CacheManager::queue_chat(const Chat& chat) {
+    enqueue([&](PendingWrites& pending) { pending.chats.insert_or_assign(chat.id, chat); });
+}
+
+void CacheManager::queue_message(const Message& msg) {
+    enqueue([&](PendingWrites& pending) { pending.messages.insert_or_assign({msg.chat_id, msg.id}, msg); });
+}
+
+void CacheManager::queue_messages(const std::vector<Message>& messages) {
+    enqueue([&](PendingWrites& pending) {
+        for (const auto& msg : messages) {
+            pending.messages.insert_or_assign({msg.chat_id, msg.id}, msg);
+        }
+    });
+}
+
+void CacheManager::queue_messages(std::vector<Message>&& messages) {
+    enqueue([&](PendingWrites& pending) {
+        for (auto& msg : messages) {
+            pending.messages.insert_or_assign({msg.chat_id, msg.id}, std::move(msg));
+        }
+    });
+}
+
+void CacheManager::queue_chat_message_stats(const ChatMessageStats& stats) {
+    enqueue([&](PendingWrites& pending) {
+        // Replaces the row outright, so earlier increments are already accounted for
+        pending.stats.insert_or_assign(stats.chat_id, stats);
+        pending.stats_increments.erase(stats.chat_id);
+    });
+}
+
+void CacheManager::queue_file_item(int64_t chat_id, const FileListItem& item) {
+    enqueue([&](PendingWrites& pending) { pending.files.insert_or_assign({chat_id, item.message_id}, item); });
+}
+
+void CacheManager::queue_download_access(const DownloadRecord& access) {
+    enqueue([&](PendingWrites& pending) {
+        auto [it, inserted] = pending.downloads.try_emplace(access.file_id, access);
+        if (!inserted) {
+            auto& queued = it->second;
+            queued.size = access.size;
+            queued.hits += access.hits;
+            queued.last_access = std::max(queued.last_access, access.last_access);
+        }
+    });
+}
+
+void CacheManager::queue_message_stats_increment(const Message& msg) {
+    enqueue([&](PendingWrites& pending) {
+        auto& increment = pending.stats_increments[msg.chat_id];
+        if (increment.count == 0) {
+            increment.first_time = msg.timestamp;
+        }
+        ++increment.count;
+        increment.last_time = msg.timestamp;
+    });
+}
+
+void CacheManager::flush() {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
+}
+
+void CacheManager::flush_queued() {
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        if (pending_.rows() == 0 || std::chrono::steady_clock::now() < retry_at_) {
+            return;
+        }
+    }
+    flush();
+}
+
+template <typename Body>
+void CacheManager::write_transaction(Body&& body) {
+    exec_sql(writer_->handle(), "BEGIN IMMEDIATE");
+    try {
+        body();
+        exec_sql(writer_->handle(), "COMMIT");
+    } catch (...) {
+        sqlite3_exec(writer_->handle(), "ROLLBACK", nullptr, nullptr, nullptr);
+        throw;
+    }
+}
+
+void CacheManager::apply_pending_writes() {
+    PendingWrites batch;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        if (pending_.rows() == 0) {
+            return;
+        }
+        batch = std::exchange(pending_, PendingWrites{});
+    }
+
+    try {
+        write_transaction([&] {
+            for (const auto& [id, user] : batch.users) {
+                store_user(user);
+            }
+            for (const auto& [id, chat] : batch.chats) {
+                store_chat(chat);
+            }
+            for (const auto& [key, msg] : batch.messages) {
+                store_message(msg);
+            }
+            // Full rows before increments: an increment queued after a full row builds on it
+            for (const auto& [chat_id, stats] : batch.stats) {
+                store_chat_message_stats(stats);
+            }
+            for (const auto& [chat_id, increment] : batch.stats_increments) {
+                store_stats_increment(chat_id, increment);
+            }
+            for (const auto& [key, item] : batch.files) {
+                store_file_item(key.first, item);
+            }
+            for (const auto& [file_id, access] : batch.downloads) {
+                store_download_access(access);
+            }
+        });
+        spdlog::trace("Flushed {} queued cache writes", batch.rows());
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        failed_flushes_ = 0;
+    } catch (const DatabaseException& e) {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        if (++failed_flushes_ >= kMaxFlushAttempts) {
+            spdlog::error(
+                "Dropping {} queued cache writes after {} failed flushes: {}", batch.rows(), failed_flushes_, e.what()
+            );
+            failed_flushes_ = 0;
+            return;
+        }
+        spdlog::warn(
+            "Failed to flush {} queued cache writes (attempt {}), will retry: {}", batch.rows(), failed_flushes_,
+            e.what()
+        );
+        retry_at_ = std::chrono::steady_clock::now() + write_behind_.flush_interval * (1 << failed_flushes_);
+        pending_.merge_older(std::move(batch));
+    }
+}
+
+void CacheManager::write_behind_loop() {
+    auto next_compaction = std::chrono::steady_clock::now() + message_store_.compact_interval;
+    auto next_maintenance = std::chrono::steady_clock::now() + maintenance_.interval;
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+    while (!stopping_) {
+        pending_cv_.wait_for(lock, write_behind_.flush_interval, [this] {
+            return stopping_ ||
+                   (pending_.rows() >= write_behind_.max_batch_rows && std::chrono::steady_clock::now() >= retry_at_);
+        });
+        if (stopping_) {
+            continue;
+        }
+
+        if (message_store_.compact && std::chrono::steady_clock::now() >= next_compaction) {
+            lock.unlock();
+            try {
+                compact_messages();
+            } catch (const DatabaseException& e) {
+                spdlog::error("Failed to compact cached messages: {}", e.what());
+            }
+            next_compaction = std::chrono::steady_clock::now() + message_store_.compact_interval;
+            lock.lock();
+        }
+
+        // Maintenance waits for a lull in queued writes (TDLib updates, history fetches)
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_maintenance && pending_.rows() == 0 && now - last_queued_ >= maintenance_.idle_after) {
+            lock.unlock();
+            try {
+                run_maintenance();
+            } catch (const DatabaseException& e) {
+                spdlog::error("Cache database maintenance failed: {}", e.what());
+            }
+            next_maintenance = std::chrono::steady_clock::now() + maintenance_.interval;
+            lock.lock();
+        }
+        if (pending_.rows() == 0 || std::chrono::steady_clock::now() < retry_at_) {
+            continue;
+        }
+
+        // The writer lock is taken first so flush() can't return while a batch is in flight
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> writer_lock(writer_mutex_);
+            apply_pending_writes();
+        }
+        lock.lock();
+    }
+}
+
+void CacheManager::store_stats_increment(int64_t chat_id, const StatsIncrement& increment) {
+    const char* sql = R"(
+        INSERT INTO chat_message_stats
+        (chat_id, message_count, content_size, last_message_time, last_fetch_time, oldest_message_time)
+        VALUES (?, ?, 0, ?, 0, ?)
+        ON CONFLICT(chat_id) DO UPDATE SET
+            message_count = message_count + excluded.message_count,
+            last_message_time = excluded.last_message_time
+    )";
+
+    StatementScope scope(writer_->prepare(sql));
+    sqlite3_stmt* stmt = scope.get();
+
+    sqlite3_bind_int64(stmt, 1, chat_id);
+    sqlite3_bind_int64(stmt, 2, static_cast<int64_t>(increment.count));
+    sqlite3_bind_int64(stmt, 3, increment.last_time);
+    sqlite3_bind_int64(stmt, 4, increment.first_time);
+
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        throw DatabaseException("Failed to update chat message stats");
+    }
+}
+
+void CacheManager::store_download_access(const DownloadRecord& access) {
+    const char* sql = R"(
+        INSERT INTO downloads (file_id, size, hits, last_access) VALUES (?, ?, ?, ?)
+        ON CONFLICT(file_id) DO UPDATE SET
+            size = excluded.size,
+            hits = hits + excluded.hits,
+            last_access = MAX(last_access, excluded.last_access)
+    )";
+
+    StatementScope scope(writer_->prepare(sql));
+    sqlite3_stmt* stmt = scope.get();
+
+    sqlite3_bind_text(stmt, 1, access.file_id.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 2, access.size);
+    sqlite3_bind_int64(stmt, 3, access.hits);
+    sqlite3_bind_int64(stmt, 4, access.last_access);
+
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        throw DatabaseException("Failed to record download access");
+    }
+}
+
 void CacheManager::cache_user(const User& user) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
+    store_user(user);
+}
 
+void CacheManager::store_user(const User& user) {
     const char* sql = R"(
         INSERT OR REPLACE INTO users
         (id, username, first_name, last_name, phone_number, is_contact,
@@ -159,10 +1003,8 @@ void CacheManager::cache_user(const User& user) {
         VALUES (?, ?, ?, ?, ?, ?, ?, ?, strftime('%s', 'now'))
     )";
 
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(writer_->prepare(sql));
+    sqlite3_stmt* stmt = scope.get();
 
     sqlite3_bind_int64(stmt, 1, user.id);
     sqlite3_bind_text(stmt, 2, user.username.c_str(), -1, SQLITE_TRANSIENT);
@@ -174,117 +1016,66 @@ void CacheManager::cache_user(const User& user) {
     sqlite3_bind_int64(stmt, 8, user.last_message_timestamp);
 
     if (sqlite3_step(stmt) != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
         throw DatabaseException("Failed to cache user");
     }
-
-    sqlite3_finalize(stmt);
 }
 
 std::optional<User> CacheManager::get_cached_user(int64_t id) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    ReadLease reader(*this);
 
-    const char* sql = "SELECT * FROM users WHERE id = ?";
-    sqlite3_stmt* stmt;
-
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(reader->prepare("SELECT * FROM users WHERE id = ?"));
+    sqlite3_stmt* stmt = scope.get();
 
     sqlite3_bind_int64(stmt, 1, id);
 
     if (sqlite3_step(stmt) == SQLITE_ROW) {
-        User user;
-        user.id = sqlite3_column_int64(stmt, 0);
-        user.username = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        user.first_name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        user.last_name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        user.phone_number = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        user.is_contact = sqlite3_column_int(stmt, 5) != 0;
-        user.last_message_id = sqlite3_column_int64(stmt, 6);
-        user.last_message_timestamp = sqlite3_column_int64(stmt, 7);
-
-        sqlite3_finalize(stmt);
-        return user;
+        return read_user(stmt);
     }
-
-    sqlite3_finalize(stmt);
     return std::nullopt;
 }
 
 std::optional<User> CacheManager::get_cached_user_by_username(const std::string& username) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    ReadLease reader(*this);
 
-    const char* sql = "SELECT * FROM users WHERE username = ?";
-    sqlite3_stmt* stmt;
-
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(reader->prepare("SELECT * FROM users WHERE username = ?"));
+    sqlite3_stmt* stmt = scope.get();
 
     sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
 
     if (sqlite3_step(stmt) == SQLITE_ROW) {
-        User user;
-        user.id = sqlite3_column_int64(stmt, 0);
-        user.username = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        user.first_name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        user.last_name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        user.phone_number = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        user.is_contact = sqlite3_column_int(stmt, 5) != 0;
-        user.last_message_id = sqlite3_column_int64(stmt, 6);
-        user.last_message_timestamp = sqlite3_column_int64(stmt, 7);
-
-        sqlite3_finalize(stmt);
-        return user;
+        return read_user(stmt);
     }
-
-    sqlite3_finalize(stmt);
     return std::nullopt;
 }
 
 std::vector<User> CacheManager::get_all_cached_users() {
-    std::lock_guard<std::mutex> lock(mutex_);
-
-    const char* sql = "SELECT * FROM users ORDER BY username";
-    sqlite3_stmt* stmt;
+    ReadLease reader(*this);
 
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(reader->prepare("SELECT * FROM users ORDER BY username"));
+    sqlite3_stmt* stmt = scope.get();
 
     std::vector<User> users;
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        User user;
-        user.id = sqlite3_column_int64(stmt, 0);
-        user.username = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        user.first_name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        user.last_name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        user.phone_number = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        user.is_contact = sqlite3_column_int(stmt, 5) != 0;
-        user.last_message_id = sqlite3_column_int64(stmt, 6);
-        user.last_message_timestamp = sqlite3_column_int64(stmt, 7);
-
-        users.push_back(std::move(user));
+        users.push_back(read_user(stmt));
     }
-
-    sqlite3_finalize(stmt);
     return users;
 }
 
 void CacheManager::cache_chat(const Chat& chat) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
+    store_chat(chat);
+}
 
+void CacheManager::store_chat(const Chat& chat) {
     const char* sql = R"(
         INSERT OR REPLACE INTO chats
         (id, type, title, username, last_message_id, last_message_timestamp, can_send_messages, updated_at)
         VALUES (?, ?, ?, ?, ?, ?, ?, strftime('%s', 'now'))
     )";
 
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(writer_->prepare(sql));
+    sqlite3_stmt* stmt = scope.get();
 
     sqlite3_bind_int64(stmt, 1, chat.id);
     sqlite3_bind_int(stmt, 2, chat_type_to_int(chat.type));
@@ -295,134 +1086,73 @@ void CacheManager::cache_chat(const Chat& chat) {
     sqlite3_bind_int(stmt, 7, chat.can_send_messages ? 1 : 0);
 
     if (sqlite3_step(stmt) != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
         throw DatabaseException("Failed to cache chat");
     }
-
-    sqlite3_finalize(stmt);
 }
 
 std::optional<Chat> CacheManager::get_cached_chat(int64_t id) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    ReadLease reader(*this);
 
-    const char* sql = "SELECT * FROM chats WHERE id = ?";
-    sqlite3_stmt* stmt;
-
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(reader->prepare("SELECT * FROM chats WHERE id = ?"));
+    sqlite3_stmt* stmt = scope.get();
 
     sqlite3_bind_int64(stmt, 1, id);
 
     if (sqlite3_step(stmt) == SQLITE_ROW) {
-        Chat chat;
-        chat.id = sqlite3_column_int64(stmt, 0);
-        chat.type = int_to_chat_type(sqlite3_column_int(stmt, 1));
-        chat.title = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        chat.username = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        chat.last_message_id = sqlite3_column_int64(stmt, 4);
-        chat.last_message_timestamp = sqlite3_column_int64(stmt, 5);
-        chat.can_send_messages = sqlite3_column_int(stmt, 6) != 0;
-
-        sqlite3_finalize(stmt);
-        return chat;
+        return read_chat(stmt);
     }
-
-    sqlite3_finalize(stmt);
     return std::nullopt;
 }
 
 std::optional<Chat> CacheManager::get_cached_chat_by_username(const std::string& username) {
-    std::lock_guard<std::mutex> lock(mutex_);
-
-    const char* sql = "SELECT * FROM chats WHERE username = ?";
-    sqlite3_stmt* stmt;
+    ReadLease reader(*this);
 
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(reader->prepare("SELECT * FROM chats WHERE username = ?"));
+    sqlite3_stmt* stmt = scope.get();
 
     sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
 
     if (sqlite3_step(stmt) == SQLITE_ROW) {
-        Chat chat;
-        chat.id = sqlite3_column_int64(stmt, 0);
-        chat.type = int_to_chat_type(sqlite3_column_int(stmt, 1));
-        chat.title = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        chat.username = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        chat.last_message_id = sqlite3_column_int64(stmt, 4);
-        chat.last_message_timestamp = sqlite3_column_int64(stmt, 5);
-        chat.can_send_messages = sqlite3_column_int(stmt, 6) != 0;
-
-        sqlite3_finalize(stmt);
-        return chat;
+        return read_chat(stmt);
     }
-
-    sqlite3_finalize(stmt);
     return std::nullopt;
 }
 
 std::vector<Chat> CacheManager::get_all_cached_chats() {
-    std::lock_guard<std::mutex> lock(mutex_);
-
-    const char* sql = "SELECT * FROM chats ORDER BY last_message_timestamp DESC";
-    sqlite3_stmt* stmt;
+    ReadLease reader(*this);
 
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(reader->prepare("SELECT * FROM chats ORDER BY last_message_timestamp DESC"));
+    sqlite3_stmt* stmt = scope.get();
 
     std::vector<Chat> chats;
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        Chat chat;
-        chat.id = sqlite3_column_int64(stmt, 0);
-        chat.type = int_to_chat_type(sqlite3_column_int(stmt, 1));
-        chat.title = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        chat.username = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        chat.last_message_id = sqlite3_column_int64(stmt, 4);
-        chat.last_message_timestamp = sqlite3_column_int64(stmt, 5);
-        chat.can_send_messages = sqlite3_column_int(stmt, 6) != 0;
-
-        chats.push_back(std::move(chat));
+        chats.push_back(read_chat(stmt));
     }
-
-    sqlite3_finalize(stmt);
     return chats;
 }
 
 std::vector<Chat> CacheManager::get_cached_chats_by_type(ChatType type) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    ReadLease reader(*this);
 
-    const char* sql = "SELECT * FROM chats WHERE type = ? ORDER BY last_message_timestamp DESC";
-    sqlite3_stmt* stmt;
-
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(reader->prepare("SELECT * FROM chats WHERE type = ? ORDER BY last_message_timestamp DESC"));
+    sqlite3_stmt* stmt = scope.get();
 
     sqlite3_bind_int(stmt, 1, chat_type_to_int(type));
 
     std::vector<Chat> chats;
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        Chat chat;
-        chat.id = sqlite3_column_int64(stmt, 0);
-        chat.type = int_to_chat_type(sqlite3_column_int(stmt, 1));
-        chat.title = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        chat.username = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        chat.last_message_id = sqlite3_column_int64(stmt, 4);
-        chat.last_message_timestamp = sqlite3_column_int64(stmt, 5);
-        chat.can_send_messages = sqlite3_column_int(stmt, 6) != 0;
-
-        chats.push_back(std::move(chat));
+        chats.push_back(read_chat(stmt));
     }
-
-    sqlite3_finalize(stmt);
     return chats;
 }
 
 void CacheManager::cache_message(const Message& msg) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
+    store_message(msg);
+}
 
+void CacheManager::store_message(const Message& msg) {
     const char* sql = R"(
         INSERT OR REPLACE INTO messages
         (id, chat_id, sender_id, timestamp, text, is_outgoing,
@@ -431,10 +1161,8 @@ void CacheManager::cache_message(const Message& msg) {
         VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
     )";
 
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(writer_->prepare(sql));
+    sqlite3_stmt* stmt = scope.get();
 
     sqlite3_bind_int64(stmt, 1, msg.id);
     sqlite3_bind_int64(stmt, 2, msg.chat_id);
@@ -443,6 +1171,7 @@ void CacheManager::cache_message(const Message& msg) {
     sqlite3_bind_text(stmt, 5, msg.text.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_int(stmt, 6, msg.is_outgoing ? 1 : 0);
 
+    // Unbound parameters are NULL - clear_bindings on reset guarantees that for reuse
     if (msg.media) {
         sqlite3_bind_int(stmt, 7, media_type_to_int(msg.media->type));
         sqlite3_bind_text(stmt, 8, msg.media->file_id.c_str(), -1, SQLITE_TRANSIENT);
@@ -452,152 +1181,260 @@ void CacheManager::cache_message(const Message& msg) {
 
         if (msg.media->local_path) {
             sqlite3_bind_text(stmt, 12, msg.media->local_path->c_str(), -1, SQLITE_TRANSIENT);
-        } else {
-            sqlite3_bind_null(stmt, 12);
         }
-
         if (msg.media->width) {
             sqlite3_bind_int(stmt, 13, *msg.media->width);
-        } else {
-            sqlite3_bind_null(stmt, 13);
         }
-
         if (msg.media->height) {
             sqlite3_bind_int(stmt, 14, *msg.media->height);
-        } else {
-            sqlite3_bind_null(stmt, 14);
         }
-
         if (msg.media->duration) {
             sqlite3_bind_int(stmt, 15, *msg.media->duration);
-        } else {
-            sqlite3_bind_null(stmt, 15);
-        }
-    } else {
-        for (int i = 7; i <= 15; ++i) {
-            sqlite3_bind_null(stmt, i);
         }
     }
 
     if (sqlite3_step(stmt) != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
         throw DatabaseException("Failed to cache message");
     }
-
-    sqlite3_finalize(stmt);
+    index_message(msg);
+    touch_bucket(msg.chat_id, msg.timestamp);
+}
+
+void CacheManager::touch_bucket(int64_t chat_id, int64_t timestamp) {
+    const char* sql = R"(
+        INSERT INTO message_buckets (chat_id, start_ts, end_ts) VALUES (?1, ?2, ?3)
+        ON CONFLICT (chat_id, start_ts) DO UPDATE SET version = version + 1, content_size = NULL, message_count = 0
+    )";
+    auto start_ts = local_day_start(timestamp);
+    StatementScope scope(writer_->prepare(sql));
+    sqlite3_bind_int64(scope.get(), 1, chat_id);
+    sqlite3_bind_int64(scope.get(), 2, start_ts);
+    sqlite3_bind_int64(scope.get(), 3, local_day_end(start_ts));
+    if (sqlite3_step(scope.get()) != SQLITE_DONE) {
+        throw DatabaseException("Failed to update message day bucket");
+    }
+}
+
+void CacheManager::index_message(const Message& msg) {
+    if (!search_enabled_) {
+        return;
+    }
+
+    const char* sql = R"(
+        INSERT INTO message_search_keys (chat_id, message_id, timestamp) VALUES (?, ?, ?)
+        ON CONFLICT (chat_id, message_id) DO UPDATE SET timestamp = excluded.timestamp
+        RETURNING id
+    )";
+    int64_t key = 0;
+    {
+        StatementScope scope(writer_->prepare(sql));
+        sqlite3_stmt* stmt = scope.get();
+        sqlite3_bind_int64(stmt, 1, msg.chat_id);
+        sqlite3_bind_int64(stmt, 2, msg.id);
+        sqlite3_bind_int64(stmt, 3, msg.timestamp);
+        if (sqlite3_step(stmt) != SQLITE_ROW) {
+            throw DatabaseException("Failed to index message");
+        }
+        key = sqlite3_column_int64(stmt, 0);
+    }
+
+    // An edit replaces the indexed text
+    StatementScope scope(
+        writer_->prepare("INSERT OR REPLACE INTO message_search (rowid, text, filename) VALUES (?, ?, ?)")
+    );
+    sqlite3_stmt* stmt = scope.get();
+    sqlite3_bind_int64(stmt, 1, key);
+    sqlite3_bind_text(stmt, 2, msg.text.c_str(), -1, SQLITE_TRANSIENT);
+    if (msg.media) {
+        sqlite3_bind_text(stmt, 3, msg.media->filename.c_str(), -1, SQLITE_TRANSIENT);
+    }
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        throw DatabaseException("Failed to index message");
+    }
+}
+
+void CacheManager::unindex_messages(int64_t older_than, std::optional<int64_t> chat_id) {
+    if (!search_enabled_) {
+        return;
+    }
+
+    for (const char* sql : {
+             R"(DELETE FROM message_search WHERE rowid IN
+                (SELECT id FROM message_search_keys WHERE timestamp < ?1 AND (?2 IS NULL OR chat_id = ?2)))",
+             "DELETE FROM message_search_keys WHERE timestamp < ?1 AND (?2 IS NULL OR chat_id = ?2)",
+         }) {
+        StatementScope scope(writer_->prepare(sql));
+        sqlite3_bind_int64(scope.get(), 1, older_than);
+        if (chat_id) {
+            sqlite3_bind_int64(scope.get(), 2, *chat_id);
+        }
+        sqlite3_step(scope.get());
+    }
+}
+
+MessageBatch CacheManager::search_messages(std::string_view query, std::optional<int64_t> chat_id, int limit) {
+    auto match = fts_query(query);
+    if (!search_enabled_ || match.empty()) {
+        return {};
+    }
+
+    ReadLease reader(*this);
+
+    std::vector<std::pair<int64_t, int64_t>> hits;  // (chat id, message id), newest first
+    {
+        const char* sql = R"(
+            SELECT k.chat_id, k.message_id FROM message_search s
+            JOIN message_search_keys k ON k.id = s.rowid
+            WHERE message_search MATCH ?1 AND (?2 IS NULL OR k.chat_id = ?2)
+            ORDER BY k.timestamp DESC LIMIT ?3
+        )";
+        StatementScope scope(reader->prepare(sql));
+        sqlite3_stmt* stmt = scope.get();
+        sqlite3_bind_text(stmt, 1, match.c_str(), -1, SQLITE_TRANSIENT);
+        if (chat_id) {
+            sqlite3_bind_int64(stmt, 2, *chat_id);
+        }
+        sqlite3_bind_int(stmt, 3, limit);
+
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            hits.emplace_back(sqlite3_column_int64(stmt, 0), sqlite3_column_int64(stmt, 1));
+        }
+        if (rc != SQLITE_DONE) {
+            throw DatabaseException("Failed to search messages: " + std::string(sqlite3_errmsg(reader->handle())));
+        }
+    }
+
+    // Hits are rows, or sealed in pages (each decoded once per search)
+    MessageBatch messages;
+    messages.reserve(hits.size());
+    std::map<std::pair<int64_t, int64_t>, MessageBatch> pages;
+    for (auto [hit_chat, hit_id] : hits) {
+        {
+            StatementScope scope(reader->prepare("SELECT * FROM messages WHERE chat_id = ? AND id = ?"));
+            sqlite3_bind_int64(scope.get(), 1, hit_chat);
+            sqlite3_bind_int64(scope.get(), 2, hit_id);
+            if (sqlite3_step(scope.get()) == SQLITE_ROW) {
+                messages.push_back(view_message(scope.get()));
+                continue;
+            }
+        }
+
+        const char* sql = R"(
+            SELECT start_ts, dictionary_id, data FROM message_pages
+            WHERE chat_id = ?1 AND first_id <= ?2 AND last_id >= ?2
+        )";
+        StatementScope scope(reader->prepare(sql));
+        sqlite3_stmt* stmt = scope.get();
+        sqlite3_bind_int64(stmt, 1, hit_chat);
+        sqlite3_bind_int64(stmt, 2, hit_id);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            auto [it, decoded] = pages.try_emplace({hit_chat, sqlite3_column_int64(stmt, 0)});
+            if (decoded) {
+                read_page(stmt, 2, hit_chat, *dictionary(*reader, sqlite3_column_int64(stmt, 1)), it->second);
+            }
+            auto found = std::find_if(it->second.begin(), it->second.end(), [&](const MessageView& msg) {
+                return msg.id == hit_id;
+            });
+            if (found != it->second.end()) {
+                messages.push_back(*found);
+                break;
+            }
+        }
+    }
+    return messages;
 }
 
 void CacheManager::cache_messages(const std::vector<Message>& messages) {
-    for (const auto& msg : messages) {
-        cache_message(msg);
-    }
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
+    write_transaction([&] {
+        for (const auto& msg : messages) {
+            store_message(msg);
+        }
+    });
 }
 
 std::optional<Message> CacheManager::get_cached_message(int64_t chat_id, int64_t message_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
-
-    const char* sql = "SELECT * FROM messages WHERE chat_id = ? AND id = ?";
-    sqlite3_stmt* stmt;
+    ReadLease reader(*this);
 
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
-
-    sqlite3_bind_int64(stmt, 1, chat_id);
-    sqlite3_bind_int64(stmt, 2, message_id);
+    {
+        StatementScope scope(reader->prepare("SELECT * FROM messages WHERE chat_id = ? AND id = ?"));
+        sqlite3_stmt* stmt = scope.get();
 
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        Message msg;
-        msg.id = sqlite3_column_int64(stmt, 0);
-        msg.chat_id = sqlite3_column_int64(stmt, 1);
-        msg.sender_id = sqlite3_column_int64(stmt, 2);
-        msg.timestamp = sqlite3_column_int64(stmt, 3);
-        msg.text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        msg.is_outgoing = sqlite3_column_int(stmt, 5) != 0;
-
-        if (sqlite3_column_type(stmt, 6) != SQLITE_NULL) {
-            MediaInfo media;
-            media.type = int_to_media_type(sqlite3_column_int(stmt, 6));
-            media.file_id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 7));
-            media.filename = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 8));
-            media.mime_type = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 9));
-            media.file_size = sqlite3_column_int64(stmt, 10);
-
-            if (sqlite3_column_type(stmt, 11) != SQLITE_NULL) {
-                media.local_path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 11));
-            }
-            if (sqlite3_column_type(stmt, 12) != SQLITE_NULL) {
-                media.width = sqlite3_column_int(stmt, 12);
-            }
-            if (sqlite3_column_type(stmt, 13) != SQLITE_NULL) {
-                media.height = sqlite3_column_int(stmt, 13);
-            }
-            if (sqlite3_column_type(stmt, 14) != SQLITE_NULL) {
-                media.duration = sqlite3_column_int(stmt, 14);
-            }
+        sqlite3_bind_int64(stmt, 1, chat_id);
+        sqlite3_bind_int64(stmt, 2, message_id);
 
-            msg.media = std::move(media);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            return read_message(stmt);
         }
-
-        sqlite3_finalize(stmt);
-        return msg;
     }
 
-    sqlite3_finalize(stmt);
+    // Sealed pages: only those whose id range covers the message
+    const char* sql = R"(
+        SELECT dictionary_id, data FROM message_pages
+        WHERE chat_id = ?1 AND first_id <= ?2 AND last_id >= ?2
+    )";
+    std::vector<Message> paged;
+    read_pages(*reader, sql, chat_id, {message_id}, paged);
+    auto it = std::find_if(paged.begin(), paged.end(), [&](const Message& msg) { return msg.id == message_id; });
+    if (it != paged.end()) {
+        return std::move(*it);
+    }
     return std::nullopt;
 }
 
 std::vector<Message> CacheManager::get_cached_messages(int64_t chat_id, int limit) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    ReadLease reader(*this);
 
-    const char* sql = "SELECT * FROM messages WHERE chat_id = ? ORDER BY timestamp DESC LIMIT ?";
-    sqlite3_stmt* stmt;
+    std::vector<Message> messages;
+    {
+        StatementScope scope(
+            reader->prepare("SELECT * FROM messages WHERE chat_id = ? ORDER BY timestamp DESC LIMIT ?")
+        );
+        sqlite3_stmt* stmt = scope.get();
+
+        sqlite3_bind_int64(stmt, 1, chat_id);
+        sqlite3_bind_int(stmt, 2, limit);
 
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            messages.push_back(read_message(stmt));
+        }
     }
 
+    // Newest pages first, until the messages at or after the last page read are enough; older pages can't
+    // contribute to the newest @p limit
+    StatementScope scope(reader->prepare(
+        "SELECT dictionary_id, data, start_ts FROM message_pages WHERE chat_id = ? ORDER BY start_ts DESC"
+    ));
+    sqlite3_stmt* stmt = scope.get();
     sqlite3_bind_int64(stmt, 1, chat_id);
-    sqlite3_bind_int(stmt, 2, limit);
 
-    std::vector<Message> messages;
+    std::vector<Message> paged;
+    bool any_paged = false;
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        Message msg;
-        msg.id = sqlite3_column_int64(stmt, 0);
-        msg.chat_id = sqlite3_column_int64(stmt, 1);
-        msg.sender_id = sqlite3_column_int64(stmt, 2);
-        msg.timestamp = sqlite3_column_int64(stmt, 3);
-        msg.text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        msg.is_outgoing = sqlite3_column_int(stmt, 5) != 0;
-
-        if (sqlite3_column_type(stmt, 6) != SQLITE_NULL) {
-            MediaInfo media;
-            media.type = int_to_media_type(sqlite3_column_int(stmt, 6));
-            media.file_id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 7));
-            media.filename = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 8));
-            media.mime_type = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 9));
-            media.file_size = sqlite3_column_int64(stmt, 10);
-
-            if (sqlite3_column_type(stmt, 11) != SQLITE_NULL) {
-                media.local_path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 11));
-            }
-            if (sqlite3_column_type(stmt, 12) != SQLITE_NULL) {
-                media.width = sqlite3_column_int(stmt, 12);
-            }
-            if (sqlite3_column_type(stmt, 13) != SQLITE_NULL) {
-                media.height = sqlite3_column_int(stmt, 13);
-            }
-            if (sqlite3_column_type(stmt, 14) != SQLITE_NULL) {
-                media.duration = sqlite3_column_int(stmt, 14);
-            }
-
-            msg.media = std::move(media);
+        any_paged = true;
+        read_page(stmt, 1, chat_id, *dictionary(*reader, sqlite3_column_int64(stmt, 0)), paged);
+
+        auto start_ts = sqlite3_column_int64(stmt, 2);
+        auto is_newer = [&](const Message& msg) { return msg.timestamp >= start_ts; };
+        auto newer = std::count_if(paged.begin(), paged.end(), is_newer) +
+                     std::count_if(messages.begin(), messages.end(), is_newer);
+        if (newer >= limit) {
+            break;
         }
-
-        messages.push_back(std::move(msg));
+    }
+    if (!any_paged) {
+        return messages;
     }
 
-    sqlite3_finalize(stmt);
+    merge_paged(messages, std::move(paged));
+    std::sort(messages.begin(), messages.end(), [](const Message& a, const Message& b) {
+        return a.timestamp != b.timestamp ? a.timestamp > b.timestamp : a.id > b.id;
+    });
+    if (limit >= 0 && messages.size() > static_cast<std::size_t>(limit)) {
+        messages.resize(static_cast<std::size_t>(limit));
+    }
     return messages;
 }
 
@@ -606,7 +1443,8 @@ std::vector<Message> CacheManager::get_last_n_messages(int64_t chat_id, int n) {
 }
 
 void CacheManager::update_chat_status(int64_t chat_id, int64_t last_message_id, int64_t last_message_timestamp) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
 
     const char* sql = R"(
         UPDATE chats
@@ -614,36 +1452,33 @@ void CacheManager::update_chat_status(int64_t chat_id, int64_t last_message_id,
         WHERE id = ?
     )";
 
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(writer_->prepare(sql));
+    sqlite3_stmt* stmt = scope.get();
 
     sqlite3_bind_int64(stmt, 1, last_message_id);
     sqlite3_bind_int64(stmt, 2, last_message_timestamp);
     sqlite3_bind_int64(stmt, 3, chat_id);
 
     if (sqlite3_step(stmt) != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
         throw DatabaseException("Failed to update chat status");
     }
-
-    sqlite3_finalize(stmt);
 }
 
 void CacheManager::cache_file_item(int64_t chat_id, const FileListItem& item) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
+    store_file_item(chat_id, item);
+}
 
+void CacheManager::store_file_item(int64_t chat_id, const FileListItem& item) {
     const char* sql = R"(
         INSERT OR REPLACE INTO files
         (message_id, chat_id, filename, file_size, timestamp, type, file_id)
         VALUES (?, ?, ?, ?, ?, ?, ?)
     )";
 
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(writer_->prepare(sql));
+    sqlite3_stmt* stmt = scope.get();
 
     sqlite3_bind_int64(stmt, 1, item.message_id);
     sqlite3_bind_int64(stmt, 2, chat_id);
@@ -654,32 +1489,29 @@ void CacheManager::cache_file_item(int64_t chat_id, const FileListItem& item) {
     sqlite3_bind_text(stmt, 7, item.file_id.c_str(), -1, SQLITE_TRANSIENT);
 
     if (sqlite3_step(stmt) != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
         throw DatabaseException("Failed to cache file item");
     }
-
-    sqlite3_finalize(stmt);
 }
 
 void CacheManager::cache_file_list(int64_t chat_id, const std::vector<FileListItem>& files) {
-    for (const auto& item : files) {
-        cache_file_item(chat_id, item);
-    }
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
+    write_transaction([&] {
+        for (const auto& item : files) {
+            store_file_item(chat_id, item);
+        }
+    });
 }
 
 std::vector<FileListItem> CacheManager::get_cached_file_list(int64_t chat_id, std::optional<MediaType> type) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    ReadLease reader(*this);
 
-    std::string sql = "SELECT * FROM files WHERE chat_id = ?";
-    if (type) {
-        sql += " AND type = ?";
-    }
-    sql += " ORDER BY timestamp DESC";
+    // Two fixed statements rather than one built per call, so both stay prepared
+    const char* sql = type ? "SELECT * FROM files WHERE chat_id = ? AND type = ? ORDER BY timestamp DESC"
+                           : "SELECT * FROM files WHERE chat_id = ? ORDER BY timestamp DESC";
 
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(reader->prepare(sql));
+    sqlite3_stmt* stmt = scope.get();
 
     sqlite3_bind_int64(stmt, 1, chat_id);
     if (type) {
@@ -688,107 +1520,272 @@ std::vector<FileListItem> CacheManager::get_cached_file_list(int64_t chat_id, st
 
     std::vector<FileListItem> items;
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        FileListItem item;
-        item.message_id = sqlite3_column_int64(stmt, 0);
-        item.filename = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        item.file_size = sqlite3_column_int64(stmt, 3);
-        item.timestamp = sqlite3_column_int64(stmt, 4);
-        item.type = int_to_media_type(sqlite3_column_int(stmt, 5));
-        item.file_id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 6));
-
-        items.push_back(std::move(item));
+        items.push_back(read_file_item(stmt));
     }
-
-    sqlite3_finalize(stmt);
     return items;
 }
 
-void CacheManager::invalidate_chat_messages(int64_t chat_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    const char* sql = "DELETE FROM messages WHERE chat_id = ?";
+void CacheManager::sync_file_list(int64_t chat_id, const std::vector<FileListItem>& files, int64_t watermark) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
+    write_transaction([&] {
+        for (const auto& item : files) {
+            store_file_item(chat_id, item);
+        }
 
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+        const char* sql = R"(
+            INSERT INTO file_sync (chat_id, watermark, synced_at) VALUES (?, ?, strftime('%s', 'now'))
+            ON CONFLICT(chat_id) DO UPDATE SET
+                watermark = MAX(watermark, excluded.watermark),
+                synced_at = excluded.synced_at
+        )";
+
+        StatementScope scope(writer_->prepare(sql));
+        sqlite3_stmt* stmt = scope.get();
+
+        sqlite3_bind_int64(stmt, 1, chat_id);
+        sqlite3_bind_int64(stmt, 2, watermark);
+
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            throw DatabaseException("Failed to record file list sync");
+        }
+    });
+}
+
+std::optional<FileListSync> CacheManager::get_file_list_sync(int64_t chat_id) {
+    ReadLease reader(*this);
+
+    StatementScope scope(reader->prepare("SELECT chat_id, watermark, synced_at FROM file_sync WHERE chat_id = ?"));
+    sqlite3_stmt* stmt = scope.get();
 
     sqlite3_bind_int64(stmt, 1, chat_id);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        return std::nullopt;
+    }
+    FileListSync sync;
+    sync.chat_id = sqlite3_column_int64(stmt, 0);
+    sync.watermark = sqlite3_column_int64(stmt, 1);
+    sync.synced_at = sqlite3_column_int64(stmt, 2);
+    return sync;
+}
+
+void CacheManager::invalidate_chat_messages(int64_t chat_id) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
+
+    StatementScope scope(writer_->prepare("DELETE FROM messages WHERE chat_id = ?"));
+    sqlite3_bind_int64(scope.get(), 1, chat_id);
+    sqlite3_step(scope.get());
+
+    StatementScope pages_scope(writer_->prepare("DELETE FROM message_pages WHERE chat_id = ?"));
+    sqlite3_bind_int64(pages_scope.get(), 1, chat_id);
+    sqlite3_step(pages_scope.get());
+
+    StatementScope buckets_scope(writer_->prepare("DELETE FROM message_buckets WHERE chat_id = ?"));
+    sqlite3_bind_int64(buckets_scope.get(), 1, chat_id);
+    sqlite3_step(buckets_scope.get());
+
+    unindex_messages(std::numeric_limits<int64_t>::max(), chat_id);
 }
 
 void CacheManager::invalidate_chat_files(int64_t chat_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    const char* sql = "DELETE FROM files WHERE chat_id = ?";
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
 
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(writer_->prepare("DELETE FROM files WHERE chat_id = ?"));
+    sqlite3_bind_int64(scope.get(), 1, chat_id);
+    sqlite3_step(scope.get());
 
-    sqlite3_bind_int64(stmt, 1, chat_id);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    // The next listing syncs from scratch
+    StatementScope sync_scope(writer_->prepare("DELETE FROM file_sync WHERE chat_id = ?"));
+    sqlite3_bind_int64(sync_scope.get(), 1, chat_id);
+    sqlite3_step(sync_scope.get());
 }
 
 void CacheManager::invalidate_chat(int64_t chat_id) {
     invalidate_chat_messages(chat_id);
     invalidate_chat_files(chat_id);
 
-    std::lock_guard<std::mutex> lock(mutex_);
-    const char* sql = "DELETE FROM chats WHERE id = ?";
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
 
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
-
-    sqlite3_bind_int64(stmt, 1, chat_id);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    StatementScope scope(writer_->prepare("DELETE FROM chats WHERE id = ?"));
+    sqlite3_bind_int64(scope.get(), 1, chat_id);
+    sqlite3_step(scope.get());
 }
 
 void CacheManager::clear_all() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    exec_sql(db_, "DELETE FROM users");
-    exec_sql(db_, "DELETE FROM chats");
-    exec_sql(db_, "DELETE FROM messages");
-    exec_sql(db_, "DELETE FROM files");
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
+    exec_sql(writer_->handle(), "DELETE FROM users");
+    exec_sql(writer_->handle(), "DELETE FROM chats");
+    exec_sql(writer_->handle(), "DELETE FROM messages");
+    exec_sql(writer_->handle(), "DELETE FROM message_pages");
+    exec_sql(writer_->handle(), "DELETE FROM message_buckets");
+    unindex_messages(std::numeric_limits<int64_t>::max(), std::nullopt);
+    exec_sql(writer_->handle(), "DELETE FROM files");
+    exec_sql(writer_->handle(), "DELETE FROM file_sync");
+
+    // Dictionaries are trained on message text, so they go with it
+    exec_sql(writer_->handle(), "DELETE FROM message_dictionaries");
+    std::lock_guard<std::mutex> dictionaries_lock(dictionaries_mutex_);
+    dictionaries_.clear();
+    current_dictionary_ = 0;
 }
 
 void CacheManager::vacuum() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    exec_sql(db_, "VACUUM");
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
+    exec_sql(writer_->handle(), "VACUUM");
+}
+
+bool CacheManager::convert_vacuum_mode() {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    if (!vacuum_mode_pending_) {
+        return false;
+    }
+
+    // A full VACUUM is what switches an existing database to incremental mode
+    spdlog::info("Converting the cache database to incremental vacuum...");
+    auto started = std::chrono::steady_clock::now();
+    apply_pending_writes();
+    exec_sql(writer_->handle(), "VACUUM");
+    vacuum_mode_pending_ = false;
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    spdlog::info("Converted the cache database to incremental vacuum in {} ms", elapsed.count());
+    return true;
 }
 
 void CacheManager::cleanup_old_messages(int64_t older_than_timestamp) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    // Batches keep each transaction (and the writer lock) short
+    auto batch = std::max<std::size_t>(1, maintenance_.delete_batch);
+    while (expire_messages(older_than_timestamp, batch) == batch) {
+    }
 
-    const char* sql = "DELETE FROM messages WHERE timestamp < ?";
-    sqlite3_stmt* stmt;
+    // Pages straddling the cutoff keep their newer messages
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    write_transaction([&] {
+        trim_pages(older_than_timestamp, std::nullopt);
+        trim_buckets(older_than_timestamp, std::nullopt);
+        unindex_messages(older_than_timestamp, std::nullopt);
+    });
+}
+
+void CacheManager::set_message_retention(std::chrono::seconds max_age) { retention_seconds_ = max_age.count(); }
+
+std::size_t CacheManager::expire_messages(int64_t older_than, std::size_t limit) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
+
+    std::size_t rows = 0;
+    std::size_t pages = 0;
+    write_transaction([&] {
+        std::set<int64_t> chats;
+
+        // Oldest first along idx_messages_timestamp, so a batch only reads the rows it deletes
+        std::vector<std::pair<int64_t, int64_t>> expired_rows;  // (rowid, chat id)
+        {
+            StatementScope scope(
+                writer_->prepare("SELECT rowid, chat_id FROM messages WHERE timestamp < ? ORDER BY timestamp LIMIT ?")
+            );
+            sqlite3_bind_int64(scope.get(), 1, older_than);
+            sqlite3_bind_int64(scope.get(), 2, static_cast<int64_t>(limit));
+            while (sqlite3_step(scope.get()) == SQLITE_ROW) {
+                expired_rows.emplace_back(sqlite3_column_int64(scope.get(), 0), sqlite3_column_int64(scope.get(), 1));
+            }
+        }
+        for (const auto& [rowid, chat_id] : expired_rows) {
+            StatementScope scope(writer_->prepare("DELETE FROM messages WHERE rowid = ?"));
+            sqlite3_bind_int64(scope.get(), 1, rowid);
+            sqlite3_step(scope.get());
+            chats.insert(chat_id);
+        }
+        rows = expired_rows.size();
+
+        // Then whole pages whose newest message has expired, with what is left of the batch
+        std::vector<std::pair<int64_t, int64_t>> expired_pages;  // (chat id, start)
+        if (rows < limit) {
+            StatementScope scope(
+                writer_->prepare("SELECT chat_id, start_ts FROM message_pages WHERE end_ts < ? LIMIT ?")
+            );
+            sqlite3_bind_int64(scope.get(), 1, older_than);
+            sqlite3_bind_int64(scope.get(), 2, static_cast<int64_t>(limit - rows));
+            while (sqlite3_step(scope.get()) == SQLITE_ROW) {
+                expired_pages.emplace_back(sqlite3_column_int64(scope.get(), 0), sqlite3_column_int64(scope.get(), 1));
+            }
+        }
+        for (const auto& [chat_id, start_ts] : expired_pages) {
+            StatementScope scope(writer_->prepare("DELETE FROM message_pages WHERE chat_id = ? AND start_ts = ?"));
+            sqlite3_bind_int64(scope.get(), 1, chat_id);
+            sqlite3_bind_int64(scope.get(), 2, start_ts);
+            sqlite3_step(scope.get());
+            chats.insert(chat_id);
+        }
+        pages = expired_pages.size();
+
+        for (auto chat_id : chats) {
+            trim_buckets(older_than, chat_id);
+            unindex_messages(older_than, chat_id);
+        }
+    });
+
+    if (rows + pages > 0) {
+        static auto& expired_messages = Metrics::global().counter({"cache_expired_total", "kind", "messages"});
+        static auto& expired_pages = Metrics::global().counter({"cache_expired_total", "kind", "pages"});
+        expired_messages.add(rows);
+        expired_pages.add(pages);
+        spdlog::debug("Expired {} cached messages and {} pages (older than {})", rows, pages, older_than);
+    }
+    return rows + pages;
+}
+
+std::size_t CacheManager::run_maintenance() {
+    std::size_t expired = 0;
+    if (auto retention = retention_seconds_.load(); retention > 0) {
+        // Aligned to a page boundary, so pages before it hold nothing newer, and the day it falls in
+        // is marked stale once per page span rather than on every tick
+        auto span = std::max<int64_t>(1, message_store_.page_span.count());
+        auto now = std::chrono::system_clock::now();
+        auto now_ts = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
+        expired = expire_messages(page_start(now_ts - retention, span), maintenance_.delete_batch);
+    }
 
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    if (!vacuum_mode_pending_ && maintenance_.vacuum_pages > 0) {
+        auto sql = fmt::format("PRAGMA incremental_vacuum({})", maintenance_.vacuum_pages);
+        exec_sql(writer_->handle(), sql.c_str());
     }
 
-    sqlite3_bind_int64(stmt, 1, older_than_timestamp);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    auto now = std::chrono::steady_clock::now();
+    if (now >= next_checkpoint_) {
+        // Passive copies what it can without waiting for readers, and keeps the WAL from growing
+        exec_sql(writer_->handle(), "PRAGMA wal_checkpoint(PASSIVE)");
+        next_checkpoint_ = now + maintenance_.checkpoint_interval;
+    }
+    if (now >= next_optimize_) {
+        exec_sql(writer_->handle(), "PRAGMA optimize");
+        next_optimize_ = now + maintenance_.optimize_interval;
+    }
+    return expired;
 }
 
 void CacheManager::update_chat_message_stats(const ChatMessageStats& stats) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
+    store_chat_message_stats(stats);
+}
 
+void CacheManager::store_chat_message_stats(const ChatMessageStats& stats) {
     const char* sql = R"(
         INSERT OR REPLACE INTO chat_message_stats
         (chat_id, message_count, content_size, last_message_time, last_fetch_time, oldest_message_time)
         VALUES (?, ?, ?, ?, ?, ?)
     )";
 
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(writer_->prepare(sql));
+    sqlite3_stmt* stmt = scope.get();
 
     sqlite3_bind_int64(stmt, 1, stats.chat_id);
     sqlite3_bind_int64(stmt, 2, static_cast<int64_t>(stats.message_count));
@@ -798,178 +1795,484 @@ void CacheManager::update_chat_message_stats(const ChatMessageStats& stats) {
     sqlite3_bind_int64(stmt, 6, stats.oldest_message_time);
 
     if (sqlite3_step(stmt) != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
         throw DatabaseException("Failed to update chat message stats");
     }
-
-    sqlite3_finalize(stmt);
 }
 
 std::optional<ChatMessageStats> CacheManager::get_chat_message_stats(int64_t chat_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
-
-    const char* sql = "SELECT * FROM chat_message_stats WHERE chat_id = ?";
-    sqlite3_stmt* stmt;
+    ReadLease reader(*this);
 
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(reader->prepare("SELECT * FROM chat_message_stats WHERE chat_id = ?"));
+    sqlite3_stmt* stmt = scope.get();
 
     sqlite3_bind_int64(stmt, 1, chat_id);
 
     if (sqlite3_step(stmt) == SQLITE_ROW) {
-        ChatMessageStats stats;
-        stats.chat_id = sqlite3_column_int64(stmt, 0);
-        stats.message_count = static_cast<std::size_t>(sqlite3_column_int64(stmt, 1));
-        stats.content_size = static_cast<std::size_t>(sqlite3_column_int64(stmt, 2));
-        stats.last_message_time = sqlite3_column_int64(stmt, 3);
-        stats.last_fetch_time = sqlite3_column_int64(stmt, 4);
-        stats.oldest_message_time = sqlite3_column_int64(stmt, 5);
-
-        sqlite3_finalize(stmt);
-        return stats;
+        return read_chat_message_stats(stmt);
     }
-
-    sqlite3_finalize(stmt);
     return std::nullopt;
 }
 
 std::vector<ChatMessageStats> CacheManager::get_all_chat_message_stats() {
-    std::lock_guard<std::mutex> lock(mutex_);
+    ReadLease reader(*this);
 
-    const char* sql = "SELECT * FROM chat_message_stats ORDER BY last_message_time DESC";
-    sqlite3_stmt* stmt;
-
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(reader->prepare("SELECT * FROM chat_message_stats ORDER BY last_message_time DESC"));
+    sqlite3_stmt* stmt = scope.get();
 
     std::vector<ChatMessageStats> result;
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        ChatMessageStats stats;
-        stats.chat_id = sqlite3_column_int64(stmt, 0);
-        stats.message_count = static_cast<std::size_t>(sqlite3_column_int64(stmt, 1));
-        stats.content_size = static_cast<std::size_t>(sqlite3_column_int64(stmt, 2));
-        stats.last_message_time = sqlite3_column_int64(stmt, 3);
-        stats.last_fetch_time = sqlite3_column_int64(stmt, 4);
-        stats.oldest_message_time = sqlite3_column_int64(stmt, 5);
-
-        result.push_back(std::move(stats));
+        result.push_back(read_chat_message_stats(stmt));
     }
-
-    sqlite3_finalize(stmt);
     return result;
 }
 
-std::vector<Message> CacheManager::get_messages_for_display(int64_t chat_id, int64_t max_age_seconds) {
-    std::lock_guard<std::mutex> lock(mutex_);
-
+MessageBatch CacheManager::get_messages_for_display(int64_t chat_id, int64_t max_age_seconds) {
     auto now = std::chrono::system_clock::now();
     auto cutoff = now - std::chrono::seconds(max_age_seconds);
     auto cutoff_ts = std::chrono::duration_cast<std::chrono::seconds>(cutoff.time_since_epoch()).count();
+    return get_messages_in_range(chat_id, cutoff_ts, std::numeric_limits<int64_t>::max());
+}
 
-    const char* sql = "SELECT * FROM messages WHERE chat_id = ? AND timestamp >= ? ORDER BY timestamp ASC";
-    sqlite3_stmt* stmt;
+MessageBatch CacheManager::get_messages_in_range(int64_t chat_id, int64_t from_ts, int64_t to_ts) {
+    ReadLease reader(*this);
+
+    MessageBatch messages;
+    {
+        const char* sql = R"(
+            SELECT * FROM messages WHERE chat_id = ?1 AND timestamp >= ?2 AND timestamp < ?3 ORDER BY timestamp ASC
+        )";
+        StatementScope scope(reader->prepare(sql));
+        sqlite3_stmt* stmt = scope.get();
+
+        sqlite3_bind_int64(stmt, 1, chat_id);
+        sqlite3_bind_int64(stmt, 2, from_ts);
+        sqlite3_bind_int64(stmt, 3, to_ts);
+
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            messages.push_back(view_message(stmt));
+        }
+    }
+
+    // Sealed pages are inflated into the batch after the rows
+    auto rows = messages.size();
+    read_pages(
+        *reader, "SELECT dictionary_id, data FROM message_pages WHERE chat_id = ?1 AND end_ts >= ?2 AND start_ts < ?3",
+        chat_id, {from_ts, to_ts}, messages
+    );
+    if (messages.size() == rows) {
+        return messages;
+    }
 
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
+    // Drop paged messages outside the range, and those that have a row (edits since sealing)
+    std::vector<int64_t> row_ids;
+    row_ids.reserve(rows);
+    for (std::size_t i = 0; i < rows; ++i) {
+        row_ids.push_back(messages[i].id);
     }
+    std::sort(row_ids.begin(), row_ids.end());
+    auto paged_end = std::remove_if(messages.begin() + rows, messages.end(), [&](const MessageView& msg) {
+        return msg.timestamp < from_ts || msg.timestamp >= to_ts ||
+               std::binary_search(row_ids.begin(), row_ids.end(), msg.id);
+    });
+    messages.erase(paged_end, messages.end());
+
+    std::sort(messages.begin(), messages.end(), [](const MessageView& a, const MessageView& b) {
+        return a.timestamp != b.timestamp ? a.timestamp < b.timestamp : a.id < b.id;
+    });
+    return messages;
+}
+
+std::vector<MessageBucket> CacheManager::get_message_buckets(int64_t chat_id, int64_t since) {
+    ReadLease reader(*this);
 
+    const char* sql = R"(
+        SELECT start_ts, end_ts, version, content_size, message_count, last_message_time FROM message_buckets
+        WHERE chat_id = ?1 AND end_ts > ?2 ORDER BY start_ts ASC
+    )";
+    StatementScope scope(reader->prepare(sql));
+    sqlite3_stmt* stmt = scope.get();
     sqlite3_bind_int64(stmt, 1, chat_id);
-    sqlite3_bind_int64(stmt, 2, cutoff_ts);
+    sqlite3_bind_int64(stmt, 2, since);
 
-    std::vector<Message> messages;
+    std::vector<MessageBucket> buckets;
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        Message msg;
-        msg.id = sqlite3_column_int64(stmt, 0);
-        msg.chat_id = sqlite3_column_int64(stmt, 1);
-        msg.sender_id = sqlite3_column_int64(stmt, 2);
-        msg.timestamp = sqlite3_column_int64(stmt, 3);
-        if (sqlite3_column_text(stmt, 4)) {
-            msg.text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        }
-        msg.is_outgoing = sqlite3_column_int(stmt, 5) != 0;
-
-        if (sqlite3_column_type(stmt, 6) != SQLITE_NULL) {
-            MediaInfo media;
-            media.type = int_to_media_type(sqlite3_column_int(stmt, 6));
-            if (sqlite3_column_text(stmt, 7)) {
-                media.file_id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 7));
-            }
-            if (sqlite3_column_text(stmt, 8)) {
-                media.filename = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 8));
-            }
-            if (sqlite3_column_text(stmt, 9)) {
-                media.mime_type = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 9));
-            }
-            media.file_size = sqlite3_column_int64(stmt, 10);
+        buckets.push_back(read_message_bucket(stmt));
+    }
+    return buckets;
+}
 
-            if (sqlite3_column_type(stmt, 11) != SQLITE_NULL) {
-                media.local_path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 11));
-            }
-            if (sqlite3_column_type(stmt, 12) != SQLITE_NULL) {
-                media.width = sqlite3_column_int(stmt, 12);
-            }
-            if (sqlite3_column_type(stmt, 13) != SQLITE_NULL) {
-                media.height = sqlite3_column_int(stmt, 13);
-            }
-            if (sqlite3_column_type(stmt, 14) != SQLITE_NULL) {
-                media.duration = sqlite3_column_int(stmt, 14);
-            }
+bool CacheManager::store_message_bucket(int64_t chat_id, const MessageBucket& bucket) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();  // Queued messages bump the version first
 
-            msg.media = std::move(media);
-        }
+    const char* sql = R"(
+        UPDATE message_buckets SET content_size = ?3, message_count = ?4, last_message_time = ?5
+        WHERE chat_id = ?1 AND start_ts = ?2 AND version = ?6
+    )";
+    StatementScope scope(writer_->prepare(sql));
+    sqlite3_stmt* stmt = scope.get();
+    sqlite3_bind_int64(stmt, 1, chat_id);
+    sqlite3_bind_int64(stmt, 2, bucket.start_ts);
+    sqlite3_bind_int64(stmt, 3, static_cast<int64_t>(bucket.content_size.value_or(0)));
+    sqlite3_bind_int64(stmt, 4, static_cast<int64_t>(bucket.message_count));
+    sqlite3_bind_int64(stmt, 5, bucket.last_message_time);
+    sqlite3_bind_int64(stmt, 6, bucket.version);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        throw DatabaseException("Failed to store message day bucket");
+    }
+    return sqlite3_changes(writer_->handle()) > 0;
+}
 
-        messages.push_back(std::move(msg));
+void CacheManager::trim_buckets(int64_t older_than, std::optional<int64_t> chat_id) {
+    {
+        StatementScope scope(
+            writer_->prepare("DELETE FROM message_buckets WHERE end_ts <= ?1 AND (?2 IS NULL OR chat_id = ?2)")
+        );
+        sqlite3_bind_int64(scope.get(), 1, older_than);
+        if (chat_id) {
+            sqlite3_bind_int64(scope.get(), 2, *chat_id);
+        }
+        sqlite3_step(scope.get());
     }
 
-    sqlite3_finalize(stmt);
-    return messages;
+    // The day the cutoff falls in lost its older messages
+    const char* sql = R"(
+        UPDATE message_buckets SET version = version + 1, content_size = NULL, message_count = 0
+        WHERE start_ts < ?1 AND end_ts > ?1 AND (?2 IS NULL OR chat_id = ?2)
+    )";
+    StatementScope scope(writer_->prepare(sql));
+    sqlite3_bind_int64(scope.get(), 1, older_than);
+    if (chat_id) {
+        sqlite3_bind_int64(scope.get(), 2, *chat_id);
+    }
+    sqlite3_step(scope.get());
 }
 
 void CacheManager::evict_old_messages(int64_t chat_id, int64_t older_than_timestamp) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        apply_pending_writes();
+
+        write_transaction([&] {
+            StatementScope scope(writer_->prepare("DELETE FROM messages WHERE chat_id = ? AND timestamp < ?"));
+            sqlite3_bind_int64(scope.get(), 1, chat_id);
+            sqlite3_bind_int64(scope.get(), 2, older_than_timestamp);
+            sqlite3_step(scope.get());
+
+            trim_pages(older_than_timestamp, chat_id);
+            trim_buckets(older_than_timestamp, chat_id);
+            unindex_messages(older_than_timestamp, chat_id);
+        });
+    }
 
-    const char* sql = "DELETE FROM messages WHERE chat_id = ? AND timestamp < ?";
-    sqlite3_stmt* stmt;
+    spdlog::debug("Evicted old messages from chat {} (older than {})", chat_id, older_than_timestamp);
+}
+
+void CacheManager::compact_messages() {
+    if (!message_store_.compact) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
+
+    auto span = std::max<int64_t>(1, message_store_.page_span.count());
+    auto sealed_before = std::chrono::system_clock::now() - message_store_.seal_after;
+    auto sealed_ts = std::chrono::duration_cast<std::chrono::seconds>(sealed_before.time_since_epoch()).count();
+    auto cutoff = page_start(sealed_ts, span);
 
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
+    ensure_dictionary();
+
+    std::vector<int64_t> chats;
+    {
+        StatementScope scope(writer_->prepare("SELECT DISTINCT chat_id FROM messages WHERE timestamp < ?"));
+        sqlite3_bind_int64(scope.get(), 1, cutoff);
+        while (sqlite3_step(scope.get()) == SQLITE_ROW) {
+            chats.push_back(sqlite3_column_int64(scope.get(), 0));
+        }
+    }
+
+    // One transaction per chat, so a bad page holds back only its own chat
+    std::size_t sealed = 0;
+    for (auto chat_id : chats) {
+        try {
+            sealed += compact_chat(chat_id, cutoff);
+        } catch (const DatabaseException& e) {
+            spdlog::warn("Failed to compact messages of chat {}: {}", chat_id, e.what());
+        }
+    }
+    if (sealed > 0) {
+        spdlog::debug("Sealed {} messages of {} chats into pages", sealed, chats.size());
+    }
+}
+
+std::size_t CacheManager::compact_chat(int64_t chat_id, int64_t cutoff) {
+    auto span = std::max<int64_t>(1, message_store_.page_span.count());
+
+    std::map<int64_t, std::vector<Message>> buckets;
+    std::size_t sealed = 0;
+    {
+        StatementScope scope(writer_->prepare("SELECT * FROM messages WHERE chat_id = ? AND timestamp < ?"));
+        sqlite3_bind_int64(scope.get(), 1, chat_id);
+        sqlite3_bind_int64(scope.get(), 2, cutoff);
+        while (sqlite3_step(scope.get()) == SQLITE_ROW) {
+            auto msg = read_message(scope.get());
+            buckets[page_start(msg.timestamp, span)].push_back(std::move(msg));
+            ++sealed;
+        }
+    }
+
+    write_transaction([&] {
+        for (auto& [start_ts, rows] : buckets) {
+            std::vector<Message> page;
+            read_pages(
+                *writer_, "SELECT dictionary_id, data FROM message_pages WHERE chat_id = ?1 AND start_ts = ?2",
+                chat_id, {start_ts}, page
+            );
+            merge_paged(rows, std::move(page));
+            store_page(chat_id, start_ts, rows);
+        }
+
+        StatementScope scope(writer_->prepare("DELETE FROM messages WHERE chat_id = ? AND timestamp < ?"));
+        sqlite3_bind_int64(scope.get(), 1, chat_id);
+        sqlite3_bind_int64(scope.get(), 2, cutoff);
+        if (sqlite3_step(scope.get()) != SQLITE_DONE) {
+            throw DatabaseException("Failed to remove sealed messages");
+        }
+    });
+    return sealed;
+}
+
+void CacheManager::store_page(int64_t chat_id, int64_t start_ts, std::vector<Message>& messages) {
+    if (messages.empty()) {
+        StatementScope scope(writer_->prepare("DELETE FROM message_pages WHERE chat_id = ? AND start_ts = ?"));
+        sqlite3_bind_int64(scope.get(), 1, chat_id);
+        sqlite3_bind_int64(scope.get(), 2, start_ts);
+        sqlite3_step(scope.get());
+        return;
     }
 
+    std::sort(messages.begin(), messages.end(), [](const Message& a, const Message& b) {
+        return a.timestamp != b.timestamp ? a.timestamp < b.timestamp : a.id < b.id;
+    });
+    auto [first, last] = std::minmax_element(messages.begin(), messages.end(), [](const Message& a, const Message& b) {
+        return a.id < b.id;
+    });
+    auto data = encode_message_page(messages, *dictionary(*writer_, current_dictionary_));
+
+    const char* sql = R"(
+        INSERT OR REPLACE INTO message_pages
+        (chat_id, start_ts, end_ts, first_id, last_id, message_count, dictionary_id, data)
+        VALUES (?, ?, ?, ?, ?, ?, ?, ?)
+    )";
+    StatementScope scope(writer_->prepare(sql));
+    sqlite3_stmt* stmt = scope.get();
     sqlite3_bind_int64(stmt, 1, chat_id);
-    sqlite3_bind_int64(stmt, 2, older_than_timestamp);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    sqlite3_bind_int64(stmt, 2, start_ts);
+    sqlite3_bind_int64(stmt, 3, messages.back().timestamp);
+    sqlite3_bind_int64(stmt, 4, first->id);
+    sqlite3_bind_int64(stmt, 5, last->id);
+    sqlite3_bind_int64(stmt, 6, static_cast<int64_t>(messages.size()));
+    sqlite3_bind_int64(stmt, 7, current_dictionary_);
+    sqlite3_bind_blob(stmt, 8, data.data(), static_cast<int>(data.size()), SQLITE_TRANSIENT);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        throw DatabaseException("Failed to store message page");
+    }
+}
 
-    spdlog::debug("Evicted old messages from chat {} (older than {})", chat_id, older_than_timestamp);
+void CacheManager::trim_pages(int64_t older_than, std::optional<int64_t> chat_id) {
+    {
+        StatementScope scope(
+            writer_->prepare("DELETE FROM message_pages WHERE end_ts < ?1 AND (?2 IS NULL OR chat_id = ?2)")
+        );
+        sqlite3_bind_int64(scope.get(), 1, older_than);
+        if (chat_id) {
+            sqlite3_bind_int64(scope.get(), 2, *chat_id);
+        }
+        sqlite3_step(scope.get());
+    }
+
+    // Pages straddling the cutoff keep their newer messages
+    std::vector<std::pair<std::pair<int64_t, int64_t>, std::vector<Message>>> straddling;
+    {
+        const char* sql = R"(
+            SELECT chat_id, start_ts, dictionary_id, data FROM message_pages
+            WHERE start_ts < ?1 AND end_ts >= ?1 AND (?2 IS NULL OR chat_id = ?2)
+        )";
+        StatementScope scope(writer_->prepare(sql));
+        sqlite3_stmt* stmt = scope.get();
+        sqlite3_bind_int64(stmt, 1, older_than);
+        if (chat_id) {
+            sqlite3_bind_int64(stmt, 2, *chat_id);
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            auto page_chat = sqlite3_column_int64(stmt, 0);
+            auto& [key, messages] = straddling.emplace_back();
+            key = {page_chat, sqlite3_column_int64(stmt, 1)};
+            read_page(stmt, 3, page_chat, *dictionary(*writer_, sqlite3_column_int64(stmt, 2)), messages);
+        }
+    }
+
+    for (auto& [key, messages] : straddling) {
+        std::erase_if(messages, [&](const Message& msg) { return msg.timestamp < older_than; });
+        store_page(key.first, key.second, messages);
+    }
 }
 
-std::optional<std::string> CacheManager::get_cached_upload(const std::string& file_hash) {
-    std::lock_guard<std::mutex> lock(mutex_);
+template <typename Out>
+void CacheManager::read_pages(
+    Connection& conn,
+    const char* sql,
+    int64_t chat_id,
+    std::initializer_list<int64_t> bounds,
+    Out& out
+) {
+    StatementScope scope(conn.prepare(sql));
+    sqlite3_stmt* stmt = scope.get();
+    sqlite3_bind_int64(stmt, 1, chat_id);
+    int index = 2;
+    for (auto bound : bounds) {
+        sqlite3_bind_int64(stmt, index++, bound);
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        read_page(stmt, 1, chat_id, *dictionary(conn, sqlite3_column_int64(stmt, 0)), out);
+    }
+}
 
-    const char* sql = "SELECT remote_file_id FROM upload_cache WHERE file_hash = ?";
-    sqlite3_stmt* stmt;
+std::shared_ptr<const std::string> CacheManager::dictionary(Connection& conn, int64_t id) {
+    static const auto kNone = std::make_shared<const std::string>();
+    if (id == 0) {
+        return kNone;
+    }
+
+    std::lock_guard<std::mutex> lock(dictionaries_mutex_);
+    if (auto it = dictionaries_.find(id); it != dictionaries_.end()) {
+        return it->second;
+    }
+
+    StatementScope scope(conn.prepare("SELECT data FROM message_dictionaries WHERE id = ?"));
+    sqlite3_bind_int64(scope.get(), 1, id);
+    if (sqlite3_step(scope.get()) != SQLITE_ROW) {
+        throw DatabaseException("Message page dictionary " + std::to_string(id) + " is missing");
+    }
+    const auto* data = static_cast<const char*>(sqlite3_column_blob(scope.get(), 0));
+    auto dictionary = std::make_shared<const std::string>(data, sqlite3_column_bytes(scope.get(), 0));
+    dictionaries_.emplace(id, dictionary);
+    return dictionary;
+}
+
+void CacheManager::ensure_dictionary() {
+    if (current_dictionary_ != 0 || message_store_.dictionary_bytes == 0) {
+        return;
+    }
+
+    {
+        StatementScope scope(writer_->prepare("SELECT id FROM message_dictionaries ORDER BY id DESC LIMIT 1"));
+        if (sqlite3_step(scope.get()) == SQLITE_ROW) {
+            current_dictionary_ = sqlite3_column_int64(scope.get(), 0);
+            return;
+        }
+    }
+
+    std::vector<Message> samples;
+    {
+        StatementScope scope(writer_->prepare("SELECT * FROM messages ORDER BY timestamp DESC LIMIT ?"));
+        sqlite3_bind_int(scope.get(), 1, kDictionarySamples);
+        while (sqlite3_step(scope.get()) == SQLITE_ROW) {
+            samples.push_back(read_message(scope.get()));
+        }
+    }
+    // Too few messages to say what's common; pages go without until there are more
+    if (samples.size() < kMinDictionarySamples) {
+        return;
+    }
+
+    auto trained = train_message_dictionary(samples, message_store_.dictionary_bytes);
+    if (trained.empty()) {
+        return;
+    }
+    StatementScope scope(writer_->prepare("INSERT INTO message_dictionaries (data) VALUES (?)"));
+    sqlite3_bind_blob(scope.get(), 1, trained.data(), static_cast<int>(trained.size()), SQLITE_TRANSIENT);
+    if (sqlite3_step(scope.get()) != SQLITE_DONE) {
+        throw DatabaseException("Failed to store message page dictionary");
+    }
+    current_dictionary_ = sqlite3_last_insert_rowid(writer_->handle());
+    spdlog::info("Trained a {} byte message dictionary on {} messages", trained.size(), samples.size());
+}
+
+std::vector<DownloadRecord>
+CacheManager::get_download_eviction_candidates(int64_t bytes_to_free, int64_t accessed_before) {
+    std::vector<DownloadRecord> result;
+    if (bytes_to_free <= 0) {
+        return result;
+    }
+
+    ReadLease reader(*this);
+
+    StatementScope scope(reader->prepare(
+        "SELECT file_id, size, hits, last_access FROM downloads WHERE last_access < ? "
+        "ORDER BY last_access ASC, hits ASC"
+    ));
+    sqlite3_stmt* stmt = scope.get();
+
+    sqlite3_bind_int64(stmt, 1, accessed_before);
+
+    int64_t freed = 0;
+    while (freed < bytes_to_free && sqlite3_step(stmt) == SQLITE_ROW) {
+        DownloadRecord record;
+        record.file_id = column_string(stmt, 0);
+        record.size = sqlite3_column_int64(stmt, 1);
+        record.hits = sqlite3_column_int64(stmt, 2);
+        record.last_access = sqlite3_column_int64(stmt, 3);
+        freed += record.size;
+        result.push_back(std::move(record));
+    }
+    return result;
+}
+
+DownloadStats CacheManager::get_download_stats() {
+    ReadLease reader(*this);
 
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
+    StatementScope scope(reader->prepare("SELECT COUNT(*), TOTAL(size), TOTAL(hits) FROM downloads"));
+    sqlite3_stmt* stmt = scope.get();
+
+    DownloadStats stats;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        stats.files = static_cast<std::size_t>(sqlite3_column_int64(stmt, 0));
+        stats.bytes = static_cast<int64_t>(sqlite3_column_double(stmt, 1));
+        stats.hits = static_cast<int64_t>(sqlite3_column_double(stmt, 2));
     }
+    return stats;
+}
+
+void CacheManager::remove_download(const std::string& file_id) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
+
+    StatementScope scope(writer_->prepare("DELETE FROM downloads WHERE file_id = ?"));
+    sqlite3_bind_text(scope.get(), 1, file_id.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_step(scope.get());
+}
+
+std::optional<std::string> CacheManager::get_cached_upload(const std::string& file_hash) {
+    ReadLease reader(*this);
+
+    StatementScope scope(reader->prepare("SELECT remote_file_id FROM upload_cache WHERE file_hash = ?"));
+    sqlite3_stmt* stmt = scope.get();
 
     sqlite3_bind_text(stmt, 1, file_hash.c_str(), -1, SQLITE_TRANSIENT);
 
     if (sqlite3_step(stmt) == SQLITE_ROW) {
-        std::string remote_id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        sqlite3_finalize(stmt);
+        std::string remote_id = column_string(stmt, 0);
         spdlog::debug("Found cached upload for hash {}", file_hash.substr(0, 16));
         return remote_id;
     }
-
-    sqlite3_finalize(stmt);
     return std::nullopt;
 }
 
 void CacheManager::cache_upload(const std::string& file_hash, int64_t file_size, const std::string& remote_file_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
 
     const char* sql = R"(
         INSERT OR REPLACE INTO upload_cache
@@ -977,44 +2280,65 @@ void CacheManager::cache_upload(const std::string& file_hash, int64_t file_size,
         VALUES (?, ?, ?, strftime('%s', 'now'))
     )";
 
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw DatabaseException("Failed to prepare statement");
-    }
+    StatementScope scope(writer_->prepare(sql));
+    sqlite3_stmt* stmt = scope.get();
 
     sqlite3_bind_text(stmt, 1, file_hash.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_int64(stmt, 2, file_size);
     sqlite3_bind_text(stmt, 3, remote_file_id.c_str(), -1, SQLITE_TRANSIENT);
 
     if (sqlite3_step(stmt) != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
         throw DatabaseException("Failed to cache upload");
     }
 
-    sqlite3_finalize(stmt);
     spdlog::debug("Cached upload: hash={}, size={}, remote_id={}", file_hash.substr(0, 16), file_size, remote_file_id);
 }
 
 void CacheManager::invalidate_upload(const std::string& file_hash) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
 
-    const char* sql = "DELETE FROM upload_cache WHERE file_hash = ?";
-
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+    PreparedStatement prepared{};
+    try {
+        prepared = writer_->prepare("DELETE FROM upload_cache WHERE file_hash = ?");
+    } catch (const DatabaseException&) {
         spdlog::error("Failed to prepare invalidate_upload statement");
         return;
     }
 
-    sqlite3_bind_text(stmt, 1, file_hash.c_str(), -1, SQLITE_TRANSIENT);
+    StatementScope scope(prepared);
+    sqlite3_bind_text(scope.get(), 1, file_hash.c_str(), -1, SQLITE_TRANSIENT);
 
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
+    if (sqlite3_step(scope.get()) != SQLITE_DONE) {
         spdlog::error("Failed to invalidate upload cache entry");
     } else {
         spdlog::debug("Invalidated upload cache: hash={}", file_hash.substr(0, 16));
     }
+}
+
+std::optional<std::string> CacheManager::get_setting(const std::string& key) {
+    ReadLease reader(*this);
+
+    StatementScope scope(reader->prepare("SELECT value FROM settings WHERE key = ?"));
+    sqlite3_bind_text(scope.get(), 1, key.c_str(), -1, SQLITE_TRANSIENT);
+
+    if (sqlite3_step(scope.get()) == SQLITE_ROW) {
+        return column_string(scope.get(), 0);
+    }
+    return std::nullopt;
+}
+
+void CacheManager::set_setting(const std::string& key, const std::string& value) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    apply_pending_writes();
 
-    sqlite3_finalize(stmt);
+    StatementScope scope(writer_->prepare("INSERT OR REPLACE INTO settings (key, value) VALUES (?, ?)"));
+    sqlite3_bind_text(scope.get(), 1, key.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(scope.get(), 2, value.c_str(), -1, SQLITE_TRANSIENT);
+
+    if (sqlite3_step(scope.get()) != SQLITE_DONE) {
+        throw DatabaseException("Failed to store setting " + key);
+    }
 }
 
 }  // namespace tg
@@ -1,5 +1,12 @@
 #include "tg/client.hpp"
+#include "tg/completion_table.hpp"
 #include "tg/exceptions.hpp"
+#include "tg/executor.hpp"
+#include "tg/inplace_function.hpp"
+#include "tg/metrics.hpp"
+#include "tg/mpsc_queue.hpp"
+#include "tg/rate_limiter.hpp"
+#include "tg/trace.hpp"
 
 #include <td/telegram/Client.h>
 #include <td/telegram/td_api.h>
@@ -7,14 +14,31 @@
 
 #include <spdlog/spdlog.h>
 
+#include <cxxabi.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <atomic>
+#include <cerrno>
+#include <cstdlib>
 #include <condition_variable>
+#include <coroutine>
+#include <cstring>
+#include <exception>
 #include <filesystem>
 #include <fstream>
-#include <future>
+#include <iterator>
+#include <limits>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <thread>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
 
 namespace tg {
 
@@ -64,18 +88,19 @@ std::pair<UserStatus, int64_t> convert_user_status(const td_api::UserStatus* sta
     }
 }
 
-User convert_user(const td_api::user& user) {
+// Conversions consume the TDLib object, moving its strings out rather than copying them
+User convert_user(td_api::object_ptr<td_api::user> user) {
     User result;
-    result.id = user.id_;
-    if (user.usernames_ && !user.usernames_->active_usernames_.empty()) {
-        result.username = user.usernames_->active_usernames_[0];
+    result.id = user->id_;
+    if (user->usernames_ && !user->usernames_->active_usernames_.empty()) {
+        result.username = std::move(user->usernames_->active_usernames_[0]);
     }
-    result.first_name = user.first_name_;
-    result.last_name = user.last_name_;
-    result.phone_number = user.phone_number_;
-    result.is_contact = user.is_contact_;
+    result.first_name = std::move(user->first_name_);
+    result.last_name = std::move(user->last_name_);
+    result.phone_number = std::move(user->phone_number_);
+    result.is_contact = user->is_contact_;
 
-    auto [status, last_seen] = convert_user_status(user.status_.get());
+    auto [status, last_seen] = convert_user_status(user->status_.get());
     result.status = status;
     result.last_seen = last_seen;
 
@@ -105,16 +130,16 @@ MediaType convert_message_content_type(const td_api::MessageContent& content) {
     }
 }
 
-std::optional<MediaInfo> extract_media_info(const td_api::MessageContent& content) {
+std::optional<MediaInfo> extract_media_info(td_api::MessageContent& content) {
     MediaInfo info;
 
     switch (content.get_id()) {
         case td_api::messagePhoto::ID: {
-            auto& photo = static_cast<const td_api::messagePhoto&>(content);
+            auto& photo = static_cast<td_api::messagePhoto&>(content);
             if (!photo.photo_->sizes_.empty()) {
                 auto& largest = photo.photo_->sizes_.back();
                 info.type = MediaType::PHOTO;
-                info.file_id = largest->photo_->remote_->id_;
+                info.file_id = std::move(largest->photo_->remote_->id_);
                 info.filename = "photo.jpg";
                 info.mime_type = "image/jpeg";
                 info.file_size = largest->photo_->size_;
@@ -125,11 +150,11 @@ std::optional<MediaInfo> extract_media_info(const td_api::MessageContent& conten
         }
 
         case td_api::messageVideo::ID: {
-            auto& video = static_cast<const td_api::messageVideo&>(content);
+            auto& video = static_cast<td_api::messageVideo&>(content);
             info.type = MediaType::VIDEO;
-            info.file_id = video.video_->video_->remote_->id_;
-            info.filename = video.video_->file_name_;
-            info.mime_type = video.video_->mime_type_;
+            info.file_id = std::move(video.video_->video_->remote_->id_);
+            info.filename = std::move(video.video_->file_name_);
+            info.mime_type = std::move(video.video_->mime_type_);
             info.file_size = video.video_->video_->size_;
             info.width = video.video_->width_;
             info.height = video.video_->height_;
@@ -138,43 +163,43 @@ std::optional<MediaInfo> extract_media_info(const td_api::MessageContent& conten
         }
 
         case td_api::messageDocument::ID: {
-            auto& doc = static_cast<const td_api::messageDocument&>(content);
+            auto& doc = static_cast<td_api::messageDocument&>(content);
             info.type = MediaType::DOCUMENT;
-            info.file_id = doc.document_->document_->remote_->id_;
-            info.filename = doc.document_->file_name_;
-            info.mime_type = doc.document_->mime_type_;
+            info.file_id = std::move(doc.document_->document_->remote_->id_);
+            info.filename = std::move(doc.document_->file_name_);
+            info.mime_type = std::move(doc.document_->mime_type_);
             info.file_size = doc.document_->document_->size_;
             return info;
         }
 
         case td_api::messageAudio::ID: {
-            auto& audio = static_cast<const td_api::messageAudio&>(content);
+            auto& audio = static_cast<td_api::messageAudio&>(content);
             info.type = MediaType::AUDIO;
-            info.file_id = audio.audio_->audio_->remote_->id_;
-            info.filename = audio.audio_->file_name_;
-            info.mime_type = audio.audio_->mime_type_;
+            info.file_id = std::move(audio.audio_->audio_->remote_->id_);
+            info.filename = std::move(audio.audio_->file_name_);
+            info.mime_type = std::move(audio.audio_->mime_type_);
             info.file_size = audio.audio_->audio_->size_;
             info.duration = audio.audio_->duration_;
             return info;
         }
 
         case td_api::messageVoiceNote::ID: {
-            auto& voice = static_cast<const td_api::messageVoiceNote&>(content);
+            auto& voice = static_cast<td_api::messageVoiceNote&>(content);
             info.type = MediaType::VOICE;
-            info.file_id = voice.voice_note_->voice_->remote_->id_;
+            info.file_id = std::move(voice.voice_note_->voice_->remote_->id_);
             info.filename = "voice.ogg";
-            info.mime_type = voice.voice_note_->mime_type_;
+            info.mime_type = std::move(voice.voice_note_->mime_type_);
             info.file_size = voice.voice_note_->voice_->size_;
             info.duration = voice.voice_note_->duration_;
             return info;
         }
 
         case td_api::messageAnimation::ID: {
-            auto& anim = static_cast<const td_api::messageAnimation&>(content);
+            auto& anim = static_cast<td_api::messageAnimation&>(content);
             info.type = MediaType::ANIMATION;
-            info.file_id = anim.animation_->animation_->remote_->id_;
-            info.filename = anim.animation_->file_name_;
-            info.mime_type = anim.animation_->mime_type_;
+            info.file_id = std::move(anim.animation_->animation_->remote_->id_);
+            info.filename = std::move(anim.animation_->file_name_);
+            info.mime_type = std::move(anim.animation_->mime_type_);
             info.file_size = anim.animation_->animation_->size_;
             info.width = anim.animation_->width_;
             info.height = anim.animation_->height_;
@@ -187,46 +212,73 @@ std::optional<MediaInfo> extract_media_info(const td_api::MessageContent& conten
     }
 }
 
-std::string extract_message_text(const td_api::MessageContent& content) {
+// The file a document/photo/video/animation message carries (largest size for photos), or null
+const td_api::file* message_file(const td_api::MessageContent& content) {
+    switch (content.get_id()) {
+        case td_api::messageDocument::ID: {
+            auto& doc = static_cast<const td_api::messageDocument&>(content);
+            return doc.document_ ? doc.document_->document_.get() : nullptr;
+        }
+        case td_api::messagePhoto::ID: {
+            auto& photo = static_cast<const td_api::messagePhoto&>(content);
+            if (photo.photo_ && !photo.photo_->sizes_.empty()) {
+                return photo.photo_->sizes_.back()->photo_.get();
+            }
+            return nullptr;
+        }
+        case td_api::messageVideo::ID: {
+            auto& video = static_cast<const td_api::messageVideo&>(content);
+            return video.video_ ? video.video_->video_.get() : nullptr;
+        }
+        case td_api::messageAnimation::ID: {
+            auto& anim = static_cast<const td_api::messageAnimation&>(content);
+            return anim.animation_ ? anim.animation_->animation_.get() : nullptr;
+        }
+        default:
+            return nullptr;
+    }
+}
+
+std::string extract_message_text(td_api::MessageContent& content) {
     if (content.get_id() == td_api::messageText::ID) {
-        auto& text_msg = static_cast<const td_api::messageText&>(content);
-        return text_msg.text_->text_;
+        auto& text_msg = static_cast<td_api::messageText&>(content);
+        return std::move(text_msg.text_->text_);
     }
     return "";
 }
 
-Message convert_message(const td_api::message& msg) {
+Message convert_message(td_api::object_ptr<td_api::message> msg) {
     Message result;
-    result.id = msg.id_;
-    result.chat_id = msg.chat_id_;
-    result.sender_id = msg.sender_id_->get_id() == td_api::messageSenderUser::ID
-                           ? static_cast<const td_api::messageSenderUser&>(*msg.sender_id_).user_id_
+    result.id = msg->id_;
+    result.chat_id = msg->chat_id_;
+    result.sender_id = msg->sender_id_->get_id() == td_api::messageSenderUser::ID
+                           ? static_cast<const td_api::messageSenderUser&>(*msg->sender_id_).user_id_
                            : 0;
-    result.timestamp = msg.date_;
-    result.is_outgoing = msg.is_outgoing_;
+    result.timestamp = msg->date_;
+    result.is_outgoing = msg->is_outgoing_;
 
-    if (msg.content_) {
-        result.text = extract_message_text(*msg.content_);
-        result.media = extract_media_info(*msg.content_);
+    if (msg->content_) {
+        result.text = extract_message_text(*msg->content_);
+        result.media = extract_media_info(*msg->content_);
     }
 
     return result;
 }
 
-Chat convert_chat(const td_api::chat& chat) {
+Chat convert_chat(td_api::object_ptr<td_api::chat> chat) {
     Chat result;
-    result.id = chat.id_;
-    result.title = chat.title_;
-    result.type = convert_chat_type(*chat.type_);
+    result.id = chat->id_;
+    result.title = std::move(chat->title_);
+    result.type = convert_chat_type(*chat->type_);
 
-    if (chat.last_message_) {
-        result.last_message_id = chat.last_message_->id_;
-        result.last_message_timestamp = chat.last_message_->date_;
+    if (chat->last_message_) {
+        result.last_message_id = chat->last_message_->id_;
+        result.last_message_timestamp = chat->last_message_->date_;
     }
 
     // Extract permissions - check if user can send basic messages
-    if (chat.permissions_) {
-        result.can_send_messages = chat.permissions_->can_send_basic_messages_;
+    if (chat->permissions_) {
+        result.can_send_messages = chat->permissions_->can_send_basic_messages_;
     }
 
     // Extract username if available
@@ -237,13 +289,104 @@ Chat convert_chat(const td_api::chat& chat) {
     return result;
 }
 
+// td_api class name of a query (e.g. "getChatHistory"), for metric labels
+std::string query_type_name(const td_api::Function& query) {
+    const char* mangled = typeid(query).name();
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+    std::string name = status == 0 && demangled ? demangled : mangled;
+    std::free(demangled);
+
+    auto scope = name.rfind("::");
+    return scope == std::string::npos ? name : name.substr(scope + 2);
+}
+
 }  // namespace
 
+// Receive loop and update dispatcher shared by the clients of a hub
+//
+// Both threads start with the first client. The receive loop routes each
+// response by client id, calling into the client without holding the
+// client table lock; detach() waits out a call already made, so nothing
+// reaches a client once it has returned.
+class ClientHub::Impl {
+public:
+    explicit Impl(const ClientHub::Config& config);
+    ~Impl();
+
+    Executor& executor() { return *executor_; }
+    RateLimiter& rate_limiter() { return rate_limiter_; }
+
+    // Route the responses for @p client_id to @p client
+    void attach(std::int32_t client_id, TelegramClient::Impl* client);
+
+    // Stop routing to a client; no call into it is in progress once this returns
+    void detach(std::int32_t client_id);
+
+    // Queue an update for the dispatcher to apply to @p client (receive thread)
+    void dispatch(TelegramClient::Impl* client, td_api::object_ptr<td_api::Object> update);
+
+    [[nodiscard]] bool on_dispatch_thread() const { return std::this_thread::get_id() == dispatch_thread_.get_id(); }
+
+private:
+    static constexpr auto kQueryExpiryInterval = std::chrono::seconds(1);
+    static constexpr std::size_t kMaxDispatchBatch = 256;
+
+    struct QueuedUpdate {
+        TelegramClient::Impl* client;
+        td_api::object_ptr<td_api::Object> update;
+    };
+
+    // Receive thread: hands every response to its client and expires timed out queries
+    void receive_updates();
+
+    // Run @p call on the client attached as @p client_id, if any (receive thread)
+    // The client can't detach meanwhile: detach() waits for the call to return.
+    template <typename Call>
+    void call_client(std::int32_t client_id, Call&& call);
+
+    // Dispatcher thread: applies queued updates in batches until stopped and drained
+    void dispatch_updates();
+
+    static std::unique_ptr<Executor> make_executor(std::size_t threads) {
+        if (threads == 0) {
+            return std::make_unique<InlineExecutor>();
+        }
+        return std::make_unique<ThreadPoolExecutor>(threads);
+    }
+
+    std::unique_ptr<Executor> executor_;  // Resumes coroutines awaiting TDLib responses
+    RateLimiter rate_limiter_;            // Paces awaited queries (fire-and-forget ones bypass it)
+
+    std::shared_mutex clients_mutex_;  // Guards clients_ only
+    std::unordered_map<std::int32_t, TelegramClient::Impl*> clients_;
+
+    // Client the receive thread is calling into, which detach() waits for
+    TelegramClient::Impl* calling_{nullptr};
+    std::mutex calling_mutex_;
+    std::condition_variable calling_cv_;
+
+    std::thread receive_thread_;
+    std::atomic<bool> receiving_{false};
+
+    // Updates waiting for the dispatcher thread, of every client
+    MpscQueue<QueuedUpdate> updates_;
+    std::thread dispatch_thread_;
+    std::atomic<bool> dispatching_{false};
+};
+
 // Implementation class
 class TelegramClient::Impl {
 public:
-    explicit Impl(const Config& config, CacheManager* cache)
-        : config_(config), cache_(cache), client_id_(0), running_(false), auth_state_(AuthState::WAIT_PHONE) {
+    explicit Impl(const Config& config, CacheManager* cache, std::shared_ptr<ClientHub> hub)
+        : config_(config),
+          cache_(cache),
+          hub_(std::move(hub)),
+          rate_limiter_(hub_->impl_->rate_limiter()),
+          tasks_(hub_->impl_->executor()),
+          client_id_(0),
+          running_(false),
+          auth_state_(AuthState::WAIT_PHONE) {
         spdlog::info("Creating TelegramClient with database: {}", config.database_directory);
     }
 
@@ -251,6 +394,12 @@ public:
         if (running_) {
             stop();
         }
+        detach();  // stop() returns early if TDLib closed on its own
+
+        // The hub's executor outlives this client: nothing of it may run there once the members go.
+        // Then fail queries sent while closing; their coroutines resume here and find the scope closed.
+        tasks_.close();
+        expire_queries(std::chrono::steady_clock::time_point::max());
     }
 
     void start() {
@@ -264,8 +413,9 @@ public:
         running_ = true;
         client_id_ = td::ClientManager::get_manager_singleton()->create_client_id();
 
-        // Start the update handler thread
-        update_thread_ = std::thread([this]() { process_updates(); });
+        // TDLib creates the client with its first query, so nothing for it is missed
+        hub_->impl_->attach(client_id_, this);
+        attached_ = true;
 
         spdlog::info("TelegramClient started with client_id: {}", client_id_);
 
@@ -303,93 +453,353 @@ public:
             spdlog::debug("Close request acknowledged");
         });
 
-        // Wait for the update thread to finish with a timeout
-        // The update thread exits when authorizationStateClosed is received
-        if (update_thread_.joinable()) {
-            // Use a timed wait instead of blocking forever
-            auto start = std::chrono::steady_clock::now();
-            constexpr auto timeout = std::chrono::seconds(5);
-
-            while (running_ && std::chrono::steady_clock::now() - start < timeout) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            }
+        // Wait for authorizationStateClosed, the last update TDLib sends a client, with a timeout
+        auto start = std::chrono::steady_clock::now();
+        constexpr auto timeout = std::chrono::seconds(5);
 
-            // Force stop if timeout exceeded
-            if (running_) {
-                spdlog::warn("TelegramClient shutdown timeout, forcing stop");
-                running_ = false;
-            }
+        while (running_ && std::chrono::steady_clock::now() - start < timeout) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
 
-            update_thread_.join();
+        // Force stop if timeout exceeded
+        if (running_) {
+            spdlog::warn("TelegramClient shutdown timeout, forcing stop");
+            running_ = false;
         }
+        detach();
 
         spdlog::info("TelegramClient stopped");
     }
 
+    // Leave the hub: let the dispatcher apply the updates already received, then fail the waiting queries
+    void detach() {
+        if (!attached_) {
+            return;
+        }
+        attached_ = false;
+        hub_->impl_->detach(client_id_);
+        wait_for_dispatched_updates();
+
+        // No more responses will arrive - fail whatever is still waiting, sent or held back,
+        // then wait for the continuations this queues on tasks_
+        expire_queries(std::chrono::steady_clock::time_point::max());
+        tasks_.close();
+    }
+
+    // Completion callbacks are stored inline in the pending query table (see PendingQuery)
+    using QueryCallback = InplaceFunction<void(td_api::object_ptr<td_api::Object>), 48>;
+
+    static constexpr auto kDefaultQueryTimeout = std::chrono::milliseconds(5000);
+
     // Send a query to TDLib and register a callback
+    // If no response arrives within timeout, the callback gets a null object
+    // The round trip is recorded in the query type's tdlib_query_seconds histogram,
+    // and while tracing as a span of the sending thread's request
+    //
+    // Registering takes no lock and doesn't allocate: the callback goes into a
+    // free slot of pending_queries_, whose id is the query's TDLib request id.
     template <typename QueryType, typename Callback>
-    void send_query(td_api::object_ptr<QueryType> query, Callback callback) {
-        auto query_id = next_query_id_++;
-
-        {
-            std::lock_guard<std::mutex> lock(callbacks_mutex_);
-            callbacks_[query_id] = [callback](td_api::object_ptr<td_api::Object> response) {
-                callback(std::move(response));
-            };
+    void send_query(
+        td_api::object_ptr<QueryType> query,
+        Callback callback,
+        std::chrono::milliseconds timeout = std::chrono::milliseconds::max()
+    ) {
+        auto sent_at = std::chrono::steady_clock::now();
+        auto deadline = timeout == std::chrono::milliseconds::max() ? std::chrono::steady_clock::time_point::max()
+                                                                     : sent_at + timeout;
+        PendingQuery pending{
+            QueryCallback(std::move(callback)),
+            &query_metrics(*query),
+            current_trace_request(),
+            sent_at,
+            Tracer::global().enabled() ? Tracer::now_ns() : 0,
+        };
+
+        auto query_id = pending_queries_.insert(std::move(pending), deadline);
+        if (query_id == 0) {
+            // Would need kMaxPendingQueries queries in flight; fail this one as if it timed out
+            spdlog::error(
+                "Too many TDLib queries in flight ({}), dropping {}", kMaxPendingQueries, pending.metrics->trace_name
+            );
+            complete_query(pending, nullptr);
+            return;
         }
 
         td::ClientManager::get_manager_singleton()->send(client_id_, query_id, std::move(query));
     }
 
-    // Send a query and wait for response synchronously
-    template <typename QueryType>
-    td_api::object_ptr<td_api::Object> send_query_sync(td_api::object_ptr<QueryType> query, int timeout_ms = 5000) {
-        std::promise<td_api::object_ptr<td_api::Object>> result_promise;
-        auto result_future = result_promise.get_future();
+    // Awaitable TDLib request
+    //
+    // The coroutine is suspended until the response (or timeout) arrives on the
+    // receive thread, and then resumed on tasks_ - no thread waits for it.
+    // The query goes through rate_limiter_ at the priority of the awaiting
+    // thread; while the bucket is empty it is retried later on tasks_
+    // rather than blocking. The coroutine resumes with the same priority and
+    // trace request, so both carry through chains of awaited queries.
+    //
+    // The timeout covers the time held back by the rate limiter as well as
+    // the round trip. An interactive query isn't held back for a FLOOD_WAIT
+    // at all: it fails at once with RateLimitException, so a file operation
+    // returns an error instead of hanging for the whole pause. Queries still
+    // held back when the client detaches, or made after that, fail with
+    // OperationException; once tasks_ is closed a coroutine resumes on the
+    // thread completing its query instead.
+    class QueryAwaiter {
+    public:
+        QueryAwaiter(Impl& impl, td_api::object_ptr<td_api::Function> query, std::chrono::milliseconds timeout)
+            : impl_(impl),
+              query_(std::move(query)),
+              timeout_(timeout),
+              deadline_(
+                  timeout == std::chrono::milliseconds::max() ? RateLimiter::Clock::time_point::max()
+                                                              : RateLimiter::Clock::now() + timeout
+              ),
+              priority_(current_request_priority()),
+              trace_request_(current_trace_request()) {}
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            if (impl_.tasks_.closed()) {
+                error_ = std::make_exception_ptr(OperationException("Client stopped"));
+                return false;
+            }
+            handle_ = handle;
+            submit();
+            return true;
+        }
 
-        send_query(std::move(query), [&result_promise](td_api::object_ptr<td_api::Object> response) {
-            result_promise.set_value(std::move(response));
-        });
+        td_api::object_ptr<td_api::Object> await_resume() {
+            if (error_) {
+                std::rethrow_exception(error_);
+            }
+            if (!response_) {
+                throw TimeoutException("Query timeout");
+            }
+            return std::move(response_);
+        }
+
+    private:
+        void submit() {
+            auto delay = impl_.rate_limiter_.reserve(priority_);
+            if (delay != RateLimiter::Clock::duration::zero()) {
+                if (priority_ == RequestPriority::INTERACTIVE) {
+                    auto paused = impl_.rate_limiter_.paused_for();
+                    if (paused > RateLimiter::Clock::duration::zero()) {
+                        auto seconds = std::chrono::ceil<std::chrono::seconds>(paused).count();
+                        fail(std::make_exception_ptr(RateLimitException(static_cast<int>(seconds))));
+                        return;
+                    }
+                }
+                if (RateLimiter::Clock::now() + delay > deadline_) {
+                    fail(std::make_exception_ptr(TimeoutException("Query held back by the rate limiter")));
+                    return;
+                }
+                if (throttled_since_ns_ == 0 && Tracer::global().enabled()) {
+                    throttled_since_ns_ = Tracer::now_ns();
+                }
+
+                // Cancelled when the client detaches; the coroutine then resumes on the detaching thread
+                impl_.tasks_.post_after(
+                    delay,
+                    [this] { submit(); },
+                    [this] {
+                        error_ = std::make_exception_ptr(OperationException("Client stopped"));
+                        resume(handle_, priority_, trace_request_);
+                    }
+                );
+                return;
+            }
+
+            // Retries run on tasks_, so the query is sent on behalf of the awaiting request
+            TraceRequestScope trace(trace_request_);
+            if (throttled_since_ns_ != 0) {
+                Tracer::global().record("client", "rate_limit_wait", throttled_since_ns_, trace_request_);
+            }
+
+            // What's left of the timeout after waiting for the rate limiter
+            auto timeout = timeout_;
+            if (deadline_ != RateLimiter::Clock::time_point::max()) {
+                timeout = std::max(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(deadline_ - RateLimiter::Clock::now()),
+                    std::chrono::milliseconds(1)
+                );
+            }
+
+            // The callback may run (and resume the coroutine) before send_query returns,
+            // so nothing here touches the awaiter after handing the query over
+            auto* tasks = &impl_.tasks_;
+            impl_.send_query(
+                std::move(query_),
+                [this, tasks, handle = handle_, priority = priority_, request = trace_request_](
+                    td_api::object_ptr<td_api::Object> response
+                ) {
+                    impl_.check_flood_wait(response);
+                    response_ = std::move(response);
+                    if (!tasks->post([handle, priority, request] { resume(handle, priority, request); })) {
+                        resume(handle, priority, request);
+                    }
+                },
+                timeout
+            );
+        }
+
+        // Complete without sending: co_await throws @p error (on tasks_, like a response)
+        void fail(std::exception_ptr error) {
+            error_ = std::move(error);
+            auto handle = handle_;
+            auto priority = priority_;
+            auto request = trace_request_;
+            if (!impl_.tasks_.post([handle, priority, request] { resume(handle, priority, request); })) {
+                resume(handle, priority, request);
+            }
+        }
 
-        if (result_future.wait_for(std::chrono::milliseconds(timeout_ms)) == std::future_status::timeout) {
-            throw TimeoutException("Query timeout");
+        // Resume the awaiting coroutine as the request that sent the query
+        static void resume(std::coroutine_handle<> handle, RequestPriority priority, uint64_t request) {
+            RequestPriorityScope scope(priority);
+            TraceRequestScope trace(request);
+            handle.resume();
         }
 
-        return result_future.get();
+        Impl& impl_;
+        td_api::object_ptr<td_api::Function> query_;
+        std::chrono::milliseconds timeout_;
+        RateLimiter::Clock::time_point deadline_;      // Sent at creation plus the timeout (max if none)
+        RequestPriority priority_;
+        uint64_t trace_request_;                       // Trace request of the awaiting coroutine
+        int64_t throttled_since_ns_{0};                // When the rate limiter first held it back (while tracing)
+        std::coroutine_handle<> handle_;
+        td_api::object_ptr<td_api::Object> response_;
+        std::exception_ptr error_;                     // Set if the query failed without a response
+    };
+
+    // Feed FLOOD_WAIT errors back into the rate limiter
+    void check_flood_wait(const td_api::object_ptr<td_api::Object>& response) {
+        if (!response || response->get_id() != td_api::error::ID) {
+            return;
+        }
+        const auto& error = static_cast<const td_api::error&>(*response);
+        if (error.code_ != 429) {
+            return;
+        }
+        if (auto retry_after = parse_retry_after(error.message_)) {
+            rate_limiter_.report_flood_wait(*retry_after);
+        }
     }
 
-    // Process updates from TDLib
-    void process_updates() {
-        auto* manager = td::ClientManager::get_manager_singleton();
+    // co_await query(...) suspends the caller until TDLib responds
+    template <typename QueryType>
+    QueryAwaiter query(td_api::object_ptr<QueryType> query, std::chrono::milliseconds timeout = kDefaultQueryTimeout) {
+        return QueryAwaiter{*this, std::move(query), timeout};
+    }
 
-        while (running_) {
-            auto response = manager->receive(1.0);  // 1 second timeout
+    // Task form of query(), so requests can be fanned out with when_all / when_any
+    Task<td_api::object_ptr<td_api::Object>> query_task(
+        td_api::object_ptr<td_api::Function> function,
+        std::chrono::milliseconds timeout = kDefaultQueryTimeout
+    ) {
+        co_return co_await query(std::move(function), timeout);
+    }
 
-            if (!response.object) {
-                continue;
-            }
+    // Send a query and wait for response synchronously
+    // Only for code that can't be a coroutine; blocks the calling thread
+    template <typename QueryType>
+    td_api::object_ptr<td_api::Object>
+    send_query_sync(td_api::object_ptr<QueryType> query, std::chrono::milliseconds timeout = kDefaultQueryTimeout) {
+        return query_task(std::move(query), timeout).get_result();
+    }
 
-            if (response.request_id == 0) {
-                // This is an update, not a response to a query
+    // A response or update for this client, on the hub's receive thread
+    //
+    // Query responses are completed at once. Nothing here touches SQLite or
+    // runs subscriber callbacks, so a slow write or callback never delays a
+    // response. Updates that only wake waiters (authorisation, file progress
+    // and generation) are applied inline; the rest go to the hub's
+    // dispatcher in the order they arrived.
+    void receive(td::ClientManager::Response response) {
+        if (response.request_id == 0) {
+            // This is an update, not a response to a query
+            if (is_inline_update(*response.object)) {
                 process_update(std::move(response.object));
             } else {
-                // This is a response to a query
-                std::function<void(td_api::object_ptr<td_api::Object>)> callback;
+                queued_updates_.fetch_add(1, std::memory_order_relaxed);
+                hub_->impl_->dispatch(this, std::move(response.object));
+            }
+        } else {
+            // This is a response to a query (unknown once it has timed out)
+            if (auto pending = pending_queries_.take(response.request_id)) {
+                complete_query(*pending, std::move(response.object));
+            }
+        }
+    }
 
-                {
-                    std::lock_guard<std::mutex> lock(callbacks_mutex_);
-                    auto it = callbacks_.find(response.request_id);
-                    if (it != callbacks_.end()) {
-                        callback = std::move(it->second);
-                        callbacks_.erase(it);
-                    }
+    // Updates that are cheap and only wake waiters, so they skip the dispatch queue
+    static bool is_inline_update(const td_api::Object& update) {
+        switch (update.get_id()) {
+            case td_api::updateAuthorizationState::ID:
+            case td_api::updateFile::ID:
+            case td_api::updateFileGenerationStart::ID:
+            case td_api::updateFileGenerationStop::ID:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Apply one batch in arrival order, on the hub's dispatcher; only the latest updateUser of each user is applied
+    void dispatch_batch(std::vector<td_api::object_ptr<td_api::Object>>& batch) {
+        std::unordered_map<int64_t, std::size_t> latest_user;
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            if (batch[i]->get_id() == td_api::updateUser::ID) {
+                const auto& update = static_cast<const td_api::updateUser&>(*batch[i]);
+                if (update.user_) {
+                    latest_user[update.user_->id_] = i;
                 }
+            }
+        }
 
-                if (callback) {
-                    callback(std::move(response.object));
+        std::size_t coalesced = 0;
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            if (batch[i]->get_id() == td_api::updateUser::ID) {
+                const auto& update = static_cast<const td_api::updateUser&>(*batch[i]);
+                if (update.user_ && latest_user[update.user_->id_] != i) {
+                    ++coalesced;  // Superseded later in the batch
+                    continue;
                 }
             }
+            try {
+                process_update(std::move(batch[i]));
+            } catch (const std::exception& e) {
+                spdlog::error("Failed to apply TDLib update: {}", e.what());
+            }
+        }
+
+        dispatched_updates_.add(batch.size());
+        if (coalesced != 0) {
+            coalesced_updates_.add(coalesced);
+        }
+        applied_updates_.fetch_add(batch.size(), std::memory_order_release);
+        applied_updates_.notify_all();
+    }
+
+    // Block until the dispatcher has applied every update received so far
+    // Readers of what updates write (e.g. the chat list in SQLite) call this first.
+    void wait_for_dispatched_updates() {
+        if (hub_->impl_->on_dispatch_thread()) {
+            return;  // Called from a callback; everything before it is already applied
         }
+        auto target = queued_updates_.load(std::memory_order_acquire);
+        auto applied = applied_updates_.load(std::memory_order_acquire);
+        while (applied < target) {
+            applied_updates_.wait(applied, std::memory_order_acquire);
+            applied = applied_updates_.load(std::memory_order_acquire);
+        }
+    }
+
+    // Complete queries past their deadline with a null response
+    void expire_queries(std::chrono::steady_clock::time_point now) {
+        pending_queries_.expire(now, [](PendingQuery pending) { complete_query(pending, nullptr); });
     }
 
     // Process an update from TDLib
@@ -397,6 +807,7 @@ public:
         if (!update) {
             return;
         }
+        TraceSpan span("tdlib", "update");
 
         switch (update->get_id()) {
             case td_api::updateAuthorizationState::ID: {
@@ -407,8 +818,8 @@ public:
 
             case td_api::updateNewChat::ID: {
                 auto chat_update = td::move_tl_object_as<td_api::updateNewChat>(update);
-                auto chat = convert_chat(*chat_update->chat_);
-                cache_->cache_chat(chat);
+                auto chat = convert_chat(std::move(chat_update->chat_));
+                cache_->queue_chat(chat);
                 spdlog::debug(
                     "updateNewChat: id={} type={} title='{}'", chat.id, static_cast<int>(chat.type), chat.title
                 );
@@ -425,8 +836,8 @@ public:
 
             case td_api::updateNewMessage::ID: {
                 auto message_update = td::move_tl_object_as<td_api::updateNewMessage>(update);
-                auto message = convert_message(*message_update->message_);
-                cache_->cache_message(message);
+                auto message = convert_message(std::move(message_update->message_));
+                cache_->queue_message(message);
                 spdlog::debug("updateNewMessage: id={} chat={}", message.id, message.chat_id);
 
                 // Notify callback if set
@@ -441,8 +852,8 @@ public:
 
             case td_api::updateUser::ID: {
                 auto user_update = td::move_tl_object_as<td_api::updateUser>(update);
-                auto user = convert_user(*user_update->user_);
-                cache_->cache_user(user);
+                auto user = convert_user(std::move(user_update->user_));
+                cache_->queue_user(user);
                 spdlog::debug("updateUser: id={} @{} '{}'", user.id, user.username, user.display_name());
 
                 // Notify callback if set
@@ -455,14 +866,61 @@ public:
                 break;
             }
 
+            case td_api::updateUserFullInfo::ID: {
+                // Sent for users whose full info was fetched once, when it changes
+                auto full_update = td::move_tl_object_as<td_api::updateUserFullInfo>(update);
+                std::string bio;
+                if (full_update->user_full_info_ && full_update->user_full_info_->bio_) {
+                    bio = full_update->user_full_info_->bio_->text_;
+                }
+                spdlog::debug("updateUserFullInfo: id={}", full_update->user_id_);
+
+                {
+                    std::lock_guard<std::mutex> lock(user_full_info_callback_mutex_);
+                    if (user_full_info_callback_) {
+                        user_full_info_callback_(full_update->user_id_, bio);
+                    }
+                }
+                break;
+            }
+
             case td_api::updateChatLastMessage::ID: {
                 // Chat's last message updated - we can update our cache
                 auto msg_update = td::move_tl_object_as<td_api::updateChatLastMessage>(update);
                 if (msg_update->last_message_) {
-                    auto message = convert_message(*msg_update->last_message_);
-                    cache_->cache_message(message);
+                    auto message = convert_message(std::move(msg_update->last_message_));
+                    cache_->queue_message(message);
                     spdlog::debug("updateChatLastMessage: chat={} msg={}", msg_update->chat_id_, message.id);
                 }
+
+                // Notify callback if set
+                {
+                    std::lock_guard<std::mutex> lock(chat_activity_callback_mutex_);
+                    if (chat_activity_callback_) {
+                        chat_activity_callback_(msg_update->chat_id_);
+                    }
+                }
+                break;
+            }
+
+            case td_api::updateFile::ID: {
+                // Transfer progress of tracked files - wakes readers waiting for a byte range
+                auto file_update = td::move_tl_object_as<td_api::updateFile>(update);
+                if (file_update->file_) {
+                    record_file_state(*file_update->file_, false);
+                }
+                break;
+            }
+
+            case td_api::updateFileGenerationStart::ID: {
+                auto start = td::move_tl_object_as<td_api::updateFileGenerationStart>(update);
+                start_file_generation(*start);
+                break;
+            }
+
+            case td_api::updateFileGenerationStop::ID: {
+                auto stop = td::move_tl_object_as<td_api::updateFileGenerationStop>(update);
+                stop_file_generation(stop->generation_id_);
                 break;
             }
 
@@ -473,56 +931,23 @@ public:
                     "updateMessageSendSucceeded: old_id={} new_id={}", old_msg_id, send_update->message_->id_
                 );
 
+                notify_message_sent(old_msg_id, send_update->message_->id_, {});
+
                 // Clean up temp file and cache remote file ID if we were tracking this message
+                int32_t uploaded_file_id = 0;
                 {
                     std::lock_guard<std::mutex> lock(pending_uploads_mutex_);
                     auto it = pending_upload_files_.find(old_msg_id);
                     if (it != pending_upload_files_.end()) {
                         const auto& upload_info = it->second;
+                        uploaded_file_id = upload_info.file_id;
 
                         // Extract remote file ID from message content and cache it
                         if (!upload_info.file_hash.empty() && send_update->message_->content_) {
                             std::string remote_file_id;
-                            auto* content = send_update->message_->content_.get();
-
-                            // Extract file ID based on content type
-                            switch (content->get_id()) {
-                                case td_api::messageDocument::ID: {
-                                    auto* doc = static_cast<td_api::messageDocument*>(content);
-                                    if (doc->document_ && doc->document_->document_ &&
-                                        doc->document_->document_->remote_) {
-                                        remote_file_id = doc->document_->document_->remote_->id_;
-                                    }
-                                    break;
-                                }
-                                case td_api::messagePhoto::ID: {
-                                    auto* photo = static_cast<td_api::messagePhoto*>(content);
-                                    if (photo->photo_ && !photo->photo_->sizes_.empty()) {
-                                        // Use the largest size
-                                        auto& largest = photo->photo_->sizes_.back();
-                                        if (largest->photo_ && largest->photo_->remote_) {
-                                            remote_file_id = largest->photo_->remote_->id_;
-                                        }
-                                    }
-                                    break;
-                                }
-                                case td_api::messageVideo::ID: {
-                                    auto* video = static_cast<td_api::messageVideo*>(content);
-                                    if (video->video_ && video->video_->video_ && video->video_->video_->remote_) {
-                                        remote_file_id = video->video_->video_->remote_->id_;
-                                    }
-                                    break;
-                                }
-                                case td_api::messageAnimation::ID: {
-                                    auto* anim = static_cast<td_api::messageAnimation*>(content);
-                                    if (anim->animation_ && anim->animation_->animation_ &&
-                                        anim->animation_->animation_->remote_) {
-                                        remote_file_id = anim->animation_->animation_->remote_->id_;
-                                    }
-                                    break;
-                                }
-                                default:
-                                    break;
+                            auto* file = message_file(*send_update->message_->content_);
+                            if (file && file->remote_) {
+                                remote_file_id = file->remote_->id_;
                             }
 
                             if (!remote_file_id.empty()) {
@@ -537,12 +962,12 @@ public:
                         }
 
                         // Clean up temp file
-                        std::error_code ec;
-                        std::filesystem::remove(upload_info.temp_path, ec);
+                        remove_upload_file(upload_info);
                         spdlog::debug("Cleaned up temp file after upload: {}", upload_info.temp_path);
                         pending_upload_files_.erase(it);
                     }
                 }
+                forget_file_state(uploaded_file_id);
                 break;
             }
 
@@ -556,17 +981,21 @@ public:
                     fail_update->error_->message_
                 );
 
+                notify_message_sent(old_msg_id, 0, fail_update->error_->message_);
+
                 // Clean up temp file on failure too
+                int32_t failed_file_id = 0;
                 {
                     std::lock_guard<std::mutex> lock(pending_uploads_mutex_);
                     auto it = pending_upload_files_.find(old_msg_id);
                     if (it != pending_upload_files_.end()) {
-                        std::error_code ec;
-                        std::filesystem::remove(it->second.temp_path, ec);
+                        failed_file_id = it->second.file_id;
+                        remove_upload_file(it->second);
                         spdlog::debug("Cleaned up temp file after failed upload: {}", it->second.temp_path);
                         pending_upload_files_.erase(it);
                     }
                 }
+                forget_file_state(failed_file_id);
                 break;
             }
 
@@ -633,6 +1062,11 @@ public:
 
     AuthState get_auth_state() const { return auth_state_; }
 
+    bool wait_until_ready(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(auth_mutex_);
+        return auth_cv_.wait_for(lock, timeout, [this]() { return auth_state_ == AuthState::READY; });
+    }
+
     void wait_for_auth_state(AuthState desired_state, int timeout_seconds = 30) {
         std::unique_lock<std::mutex> lock(auth_mutex_);
         auto timeout = std::chrono::seconds(timeout_seconds);
@@ -664,17 +1098,19 @@ public:
     std::vector<Chat> get_all_chats_sync() {
         // TDLib populates chats via updateNewChat during startup.
         // We just read from our cache - no API calls needed.
+        wait_for_dispatched_updates();
+        cache_->flush();  // Updates are queued write-behind
         return cache_->get_all_cached_chats();
     }
 
     // Preload chats - triggers updateNewChat events for all chats
-    void preload_chats_sync(int32_t limit) {
+    Task<void> preload_chats(int32_t limit) {
         spdlog::debug("Preloading chats (limit={})", limit);
 
         // loadChats triggers TDLib to send updateNewChat events for chats
         // This is much faster than calling getChat for each chat individually
         auto response =
-            send_query_sync(td_api::make_object<td_api::loadChats>(td_api::make_object<td_api::chatListMain>(), limit));
+            co_await query(td_api::make_object<td_api::loadChats>(td_api::make_object<td_api::chatListMain>(), limit));
 
         if (response->get_id() == td_api::ok::ID) {
             spdlog::debug("loadChats completed successfully");
@@ -688,42 +1124,42 @@ public:
     }
 
     // Search for a public chat by username
-    std::optional<Chat> search_public_chat_sync(const std::string& username) {
-        auto response = send_query_sync(td_api::make_object<td_api::searchPublicChat>(username));
+    Task<std::optional<Chat>> search_public_chat(std::string username) {
+        auto response = co_await query(td_api::make_object<td_api::searchPublicChat>(username));
 
         if (response->get_id() == td_api::chat::ID) {
             auto chat_obj = td::move_tl_object_as<td_api::chat>(response);
-            auto chat = convert_chat(*chat_obj);
+            auto chat = convert_chat(std::move(chat_obj));
             cache_->cache_chat(chat);
-            return chat;
+            co_return chat;
         }
 
-        return std::nullopt;
+        co_return std::nullopt;
     }
 
     // Get chat by ID
-    std::optional<Chat> get_chat_sync(int64_t chat_id) {
-        auto response = send_query_sync(td_api::make_object<td_api::getChat>(chat_id));
+    Task<std::optional<Chat>> get_chat(int64_t chat_id) {
+        auto response = co_await query(td_api::make_object<td_api::getChat>(chat_id));
 
         if (response->get_id() == td_api::chat::ID) {
             auto chat_obj = td::move_tl_object_as<td_api::chat>(response);
-            auto chat = convert_chat(*chat_obj);
+            auto chat = convert_chat(std::move(chat_obj));
             cache_->cache_chat(chat);
-            return chat;
+            co_return chat;
         }
 
-        return std::nullopt;
+        co_return std::nullopt;
     }
 
     // Send text message
-    Message send_text_message_sync(int64_t chat_id, const std::string& text) {
+    Task<Message> send_text_message(int64_t chat_id, std::string text) {
         auto input_content = td_api::make_object<td_api::inputMessageText>(
             td_api::make_object<td_api::formattedText>(text, std::vector<td_api::object_ptr<td_api::textEntity>>()),
             nullptr,
             true
         );
 
-        auto response = send_query_sync(
+        auto response = co_await query(
             td_api::make_object<td_api::sendMessage>(
                 chat_id, nullptr, nullptr, nullptr, nullptr, std::move(input_content)
             )
@@ -731,107 +1167,157 @@ public:
 
         if (response->get_id() == td_api::message::ID) {
             auto msg_obj = td::move_tl_object_as<td_api::message>(response);
-            auto message = convert_message(*msg_obj);
+            auto message = convert_message(std::move(msg_obj));
             cache_->cache_message(message);
-            return message;
+            co_return message;
+        }
+
+        // Refused by the rate limit: callers may retry once the limiter's pause is over
+        if (response->get_id() == td_api::error::ID) {
+            const auto& error = static_cast<const td_api::error&>(*response);
+            if (error.code_ == 429) {
+                auto retry_after = parse_retry_after(error.message_).value_or(std::chrono::seconds(0));
+                throw RateLimitException(static_cast<int>(retry_after.count()));
+            }
         }
 
         throw OperationException("Failed to send message");
     }
 
     // Get chat history
-    std::vector<Message> get_chat_history_sync(int64_t chat_id, int limit) {
+    Task<std::vector<Message>> get_chat_history(int64_t chat_id, int limit) {
         std::vector<Message> result;
 
-        auto response = send_query_sync(td_api::make_object<td_api::getChatHistory>(chat_id, 0, 0, limit, false));
+        auto response = co_await query(td_api::make_object<td_api::getChatHistory>(chat_id, 0, 0, limit, false));
 
         if (response->get_id() == td_api::messages::ID) {
             auto messages_obj = td::move_tl_object_as<td_api::messages>(response);
 
             for (auto& msg_ptr : messages_obj->messages_) {
                 if (msg_ptr) {
-                    auto message = convert_message(*msg_ptr);
-                    cache_->cache_message(message);
-                    result.push_back(std::move(message));
+                    result.push_back(convert_message(std::move(msg_ptr)));
                 }
             }
+            cache_->queue_messages(result);
         }
 
-        return result;
+        co_return result;
     }
 
-    // Get chat history with pagination from a specific message
-    std::vector<Message> get_chat_history_from_sync(int64_t chat_id, int64_t from_message_id, int limit) {
-        std::vector<Message> result;
+    // History page sizes: TDLib serves at most 100 messages per getChatHistory call
+    static constexpr int32_t kMinHistoryPage = 20;
+    static constexpr int32_t kMaxHistoryPage = 100;
 
-        auto response =
-            send_query_sync(td_api::make_object<td_api::getChatHistory>(chat_id, from_message_id, 0, limit, false));
+    // Request one history page
+    Task<td_api::object_ptr<td_api::Object>>
+    fetch_history_page(int64_t chat_id, int64_t from_message_id, int32_t limit) {
+        co_return co_await query(
+            td_api::make_object<td_api::getChatHistory>(chat_id, from_message_id, 0, limit, false)
+        );
+    }
 
-        if (response->get_id() == td_api::messages::ID) {
-            auto messages_obj = td::move_tl_object_as<td_api::messages>(response);
+    using PageTask = Task<td_api::object_ptr<td_api::Object>>;
 
-            for (auto& msg_ptr : messages_obj->messages_) {
-                if (msg_ptr) {
-                    auto message = convert_message(*msg_ptr);
-                    cache_->cache_message(message);
-                    result.push_back(std::move(message));
-                }
-            }
+    // Wait for a page requested ahead before the caller gives up on the pipeline
+    // The query completes into the task's frame, so the task mustn't be destroyed while it's in flight.
+    static Task<void> drain_page(std::optional<PageTask>& next) {
+        if (!next) {
+            co_return;
+        }
+        try {
+            (void)co_await *next;
+        } catch (const std::exception& e) {
+            spdlog::debug("Dropped a page requested ahead: {}", e.what());
         }
-
-        return result;
     }
 
     // Get messages iteratively until conditions are met
-    std::vector<Message>
-    get_messages_until_sync(int64_t chat_id, std::size_t min_messages, std::chrono::seconds max_age) {
-        std::vector<Message> result;
-        int64_t from_message_id = 0;
-        constexpr int batch_size = 50;
+    //
+    // Pipelined: the request for the next page goes out as soon as the current
+    // page arrives and is in flight while that page is converted and queued to
+    // the cache (one batch per page).
+    Task<MessageBatch> get_messages_until(int64_t chat_id, std::size_t min_messages, std::chrono::seconds max_age) {
+        MessageBatch result;
 
         auto now = std::chrono::system_clock::now();
         auto cutoff = now - max_age;
         auto cutoff_ts = std::chrono::duration_cast<std::chrono::seconds>(cutoff.time_since_epoch()).count();
 
+        // Small first page for small requests, then full pages
+        auto first_page = static_cast<int32_t>(
+            std::clamp<std::size_t>(min_messages, kMinHistoryPage, kMaxHistoryPage)
+        );
+        auto pending = fetch_history_page(chat_id, 0, first_page);
+        int page_count = 0;
+
         while (true) {
-            auto batch = get_chat_history_from_sync(chat_id, from_message_id, batch_size);
+            auto response = co_await pending;
+            if (response->get_id() != td_api::messages::ID) {
+                break;
+            }
 
-            if (batch.empty()) {
+            auto page = td::move_tl_object_as<td_api::messages>(response);
+            std::erase_if(page->messages_, [](const auto& msg_ptr) { return !msg_ptr; });
+            if (page->messages_.empty()) {
                 // No more messages
                 break;
             }
-
-            for (auto& msg : batch) {
-                result.push_back(std::move(msg));
+            page_count++;
+
+            // Check termination conditions on the raw page
+            // API returns newest first, so last message in page is oldest
+            const auto& oldest = *page->messages_.back();
+            auto fetched = result.size() + page->messages_.size();
+            bool done = fetched >= min_messages && oldest.date_ < cutoff_ts;
+
+            // Continue from the oldest message while this page is processed
+            std::optional<PageTask> next;
+            if (!done) {
+                next.emplace(fetch_history_page(chat_id, oldest.id_, kMaxHistoryPage));
+                next->resume();
             }
 
-            // Check termination conditions
-            // API returns newest first, so last message in batch is oldest
-            const auto& oldest = result.back();
+            // The converted page goes to the cache queue; the caller gets copies in the batch's arena
+            std::exception_ptr failure;
+            try {
+                std::vector<Message> batch;
+                batch.reserve(page->messages_.size());
+                for (auto& msg_ptr : page->messages_) {
+                    result.push_back(batch.emplace_back(convert_message(std::move(msg_ptr))));
+                }
+                cache_->queue_messages(std::move(batch));
+            } catch (...) {
+                failure = std::current_exception();
+            }
+            if (failure) {
+                co_await drain_page(next);
+                std::rethrow_exception(failure);
+            }
 
-            // Have enough messages AND oldest is older than cutoff
-            if (result.size() >= min_messages && oldest.timestamp < cutoff_ts) {
+            if (!next) {
                 break;
             }
-
-            // Set up for next batch: continue from oldest message
-            from_message_id = oldest.id;
+            pending = std::move(*next);
         }
 
         spdlog::debug(
-            "get_messages_until_sync: chat {} fetched {} messages (min={}, max_age={}s)",
+            "get_messages_until: chat {} fetched {} messages in {} pages (min={}, max_age={}s)",
             chat_id,
             result.size(),
+            page_count,
             min_messages,
             max_age.count()
         );
 
-        return result;
+        co_return result;
     }
 
-    // Filter type for search_chat_files_sync
+    // Filter type for search_chat_files
     enum class FileSearchFilter { DOCUMENT, PHOTO, PHOTO_AND_VIDEO };
 
+    // Pause between search pages to respect rate limits
+    static constexpr auto kSearchPageDelay = std::chrono::milliseconds(50);
+
     // Max file history to search (1 year default)
     static constexpr std::chrono::seconds kMaxFileHistoryAge = std::chrono::hours{24 * 365};
 
@@ -849,12 +1335,38 @@ public:
         }
     }
 
+    // Request one page of filtered search results, optionally after a pause
+    Task<td_api::object_ptr<td_api::Object>> fetch_search_page(
+        int64_t chat_id,
+        FileSearchFilter filter_type,
+        int64_t from_message_id,
+        std::chrono::milliseconds delay
+    ) {
+        if (delay.count() > 0 && !co_await tasks_.schedule_after(delay)) {
+            throw OperationException("Client stopped");
+        }
+        co_return co_await query(
+            td_api::make_object<td_api::searchChatMessages>(
+                chat_id,
+                nullptr,  // topic_id
+                "",       // query (empty = all)
+                nullptr,  // sender_id (null = any sender)
+                from_message_id,
+                0,                               // offset
+                kMaxHistoryPage,                 // limit
+                make_search_filter(filter_type)  // filter (recreated each time)
+            )
+        );
+    }
+
     // Search chat messages with a filter (for files, photos, etc.)
-    // Iterates through history up to max_age, respecting rate limits
-    std::vector<FileListItem> search_chat_files_sync(int64_t chat_id, FileSearchFilter filter_type) {
+    // Iterates through history up to max_age, or down to after_message_id
+    // when only the files newer than an earlier sync are needed.
+    // Pipelined like get_messages_until: the next page is requested before
+    // the current one is converted.
+    Task<std::vector<FileListItem>>
+    search_chat_files(int64_t chat_id, FileSearchFilter filter_type, int64_t after_message_id = 0) {
         std::vector<FileListItem> result;
-        int64_t from_message_id = 0;
-        constexpr int32_t batch_size = 100;
         int batch_count = 0;
 
         // Calculate cutoff timestamp
@@ -863,28 +1375,20 @@ public:
         auto cutoff_ts = std::chrono::duration_cast<std::chrono::seconds>(cutoff.time_since_epoch()).count();
 
         spdlog::debug(
-            "search_chat_files_sync: searching chat {} for files newer than {} (cutoff ts: {})",
+            "search_chat_files: searching chat {} for files newer than {} (cutoff ts: {}, after message {})",
             chat_id,
             kMaxFileHistoryAge.count() / 3600 / 24,
-            cutoff_ts
+            cutoff_ts,
+            after_message_id
         );
 
+        auto pending = fetch_search_page(chat_id, filter_type, 0, std::chrono::milliseconds::zero());
+
         while (true) {
-            auto response = send_query_sync(
-                td_api::make_object<td_api::searchChatMessages>(
-                    chat_id,
-                    nullptr,  // topic_id
-                    "",       // query (empty = all)
-                    nullptr,  // sender_id (null = any sender)
-                    from_message_id,
-                    0,                               // offset
-                    batch_size,                      // limit
-                    make_search_filter(filter_type)  // filter (recreated each time)
-                )
-            );
+            auto response = co_await pending;
 
             if (response->get_id() != td_api::foundChatMessages::ID) {
-                spdlog::warn("search_chat_files_sync: unexpected response type {}", response->get_id());
+                spdlog::warn("search_chat_files: unexpected response type {}", response->get_id());
                 break;
             }
 
@@ -895,103 +1399,77 @@ public:
                 break;
             }
 
+            // Decide on the next page from the raw batch (newest first, so the last one is oldest)
             bool reached_cutoff = false;
-            for (auto& msg_ptr : found->messages_) {
-                if (!msg_ptr) continue;
-
-                auto message = convert_message(*msg_ptr);
-
-                // Check if we've gone past the cutoff
-                if (message.timestamp < cutoff_ts) {
-                    reached_cutoff = true;
+            for (auto it = found->messages_.rbegin(); it != found->messages_.rend(); ++it) {
+                if (*it) {
+                    reached_cutoff = (*it)->date_ < cutoff_ts || (*it)->id_ <= after_message_id;
                     break;
                 }
+            }
+            // Fewer messages than requested means we've reached the end
+            bool reached_end = static_cast<int32_t>(found->messages_.size()) < kMaxHistoryPage ||
+                               found->next_from_message_id_ == 0;
+
+            // Small delay between batches to respect rate limits, overlapped with processing
+            std::optional<PageTask> next;
+            if (!reached_cutoff && !reached_end) {
+                next.emplace(fetch_search_page(chat_id, filter_type, found->next_from_message_id_, kSearchPageDelay));
+                next->resume();
+            }
+
+            std::exception_ptr failure;
+            try {
+                for (auto& msg_ptr : found->messages_) {
+                    if (!msg_ptr) continue;
+
+                    auto message = convert_message(std::move(msg_ptr));
 
-                if (message.has_media()) {
-                    FileListItem item;
-                    item.message_id = message.id;
-                    item.filename = message.media->filename;
-                    item.file_size = message.media->file_size;
-                    item.timestamp = message.timestamp;
-                    item.type = message.media->type;
-                    item.file_id = message.media->file_id;
-                    result.push_back(std::move(item));
+                    // Check if we've gone past the cutoff or reached the already synced files
+                    if (message.timestamp < cutoff_ts || message.id <= after_message_id) {
+                        break;
+                    }
+
+                    if (auto item = make_file_list_item(message)) {
+                        result.push_back(std::move(*item));
+                    }
                 }
+            } catch (...) {
+                failure = std::current_exception();
+            }
+            if (failure) {
+                co_await drain_page(next);
+                std::rethrow_exception(failure);
             }
 
             if (reached_cutoff) {
-                spdlog::debug("search_chat_files_sync: reached cutoff after {} batches", batch_count);
+                spdlog::debug("search_chat_files: reached cutoff after {} batches", batch_count);
                 break;
             }
-
-            // If we got fewer messages than requested, we've reached the end
-            if (static_cast<int32_t>(found->messages_.size()) < batch_size) {
-                spdlog::debug("search_chat_files_sync: reached end of history after {} batches", batch_count);
+            if (!next) {
+                spdlog::debug("search_chat_files: reached end of history after {} batches", batch_count);
                 break;
             }
-
-            // Set up for next iteration
-            from_message_id = found->next_from_message_id_;
-            if (from_message_id == 0) {
-                break;  // No more messages
-            }
-
-            // Small delay between batches to respect rate limits (50ms)
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            pending = std::move(*next);
         }
 
         spdlog::debug(
-            "search_chat_files_sync: chat {} found {} files in {} batches", chat_id, result.size(), batch_count
+            "search_chat_files: chat {} found {} files in {} batches", chat_id, result.size(), batch_count
         );
-        return result;
+        co_return result;
     }
 
     // Send file (with optional hash for deduplication cache)
-    Message send_file_sync(
+    Task<Message> send_file(
         int64_t chat_id,
-        const std::string& path,
+        std::string path,
         SendMode mode,
-        const std::string& file_hash = "",
+        std::string file_hash = "",
         int64_t file_size = 0
     ) {
-        // Determine MIME type and whether to send as photo/video or document
-        auto mime = detect_mime_type(path);
-        auto detected_type = detect_media_type(fs::path(path).filename().string(), mime);
-
-        td_api::object_ptr<td_api::InputMessageContent> input_content;
-
-        bool send_as_media = (mode == SendMode::MEDIA) || (mode == SendMode::AUTO && is_media_type(detected_type));
-
-        if (send_as_media && detected_type == MediaType::PHOTO) {
-            auto input_file = td_api::make_object<td_api::inputFileLocal>(path);
-            input_content = td_api::make_object<td_api::inputMessagePhoto>(
-                std::move(input_file), nullptr, std::vector<int32_t>(), 0, 0, nullptr, false, nullptr, false
-            );
-        } else if (send_as_media && (detected_type == MediaType::VIDEO || detected_type == MediaType::ANIMATION)) {
-            auto input_file = td_api::make_object<td_api::inputFileLocal>(path);
-            input_content = td_api::make_object<td_api::inputMessageVideo>(
-                std::move(input_file),
-                nullptr,
-                nullptr,
-                0,
-                std::vector<int32_t>(),
-                0,
-                0,
-                0,
-                false,
-                nullptr,
-                false,
-                nullptr,
-                false
-            );
-        } else {
-            // Send as document
-            auto input_file = td_api::make_object<td_api::inputFileLocal>(path);
-            input_content =
-                td_api::make_object<td_api::inputMessageDocument>(std::move(input_file), nullptr, false, nullptr);
-        }
+        auto input_content = make_file_content(td_api::make_object<td_api::inputFileLocal>(path), path, mode);
 
-        auto response = send_query_sync(
+        auto response = co_await query(
             td_api::make_object<td_api::sendMessage>(
                 chat_id, nullptr, nullptr, nullptr, nullptr, std::move(input_content)
             )
@@ -999,13 +1477,14 @@ public:
 
         if (response->get_id() == td_api::message::ID) {
             auto msg_obj = td::move_tl_object_as<td_api::message>(response);
-            auto message = convert_message(*msg_obj);
+            auto file_id = track_sent_file(*msg_obj);
+            auto message = convert_message(std::move(msg_obj));
             cache_->cache_message(message);
 
             // Register pending upload - file cleanup and cache update happen in updateMessageSendSucceeded
             {
                 std::lock_guard<std::mutex> lock(pending_uploads_mutex_);
-                pending_upload_files_[message.id] = PendingUploadInfo{path, file_hash, file_size};
+                pending_upload_files_[message.id] = PendingUploadInfo{path, file_hash, file_size, false, file_id};
                 spdlog::debug(
                     "Registered pending upload: msg_id={} path={} hash={}",
                     message.id,
@@ -1014,7 +1493,7 @@ public:
                 );
             }
 
-            return message;
+            co_return message;
         }
 
         // Log error details if available
@@ -1028,39 +1507,215 @@ public:
         throw FileUploadException(path);
     }
 
-    // Get the current logged-in user
-    User get_me_sync() {
-        auto response = send_query_sync(td_api::make_object<td_api::getMe>());
-
-        if (response->get_id() != td_api::user::ID) {
-            throw TelegramException("Failed to get current user");
+    // Streaming uploads
+    //
+    // The file being written is registered with TDLib as a generated file
+    // (inputFileGenerated) and uploaded with preliminaryUploadFile before the
+    // message exists. When TDLib starts the generation, its destination is
+    // hard-linked to the source (or, across filesystems, filled by copying)
+    // and the written prefix is reported as it grows, so the transfer runs
+    // alongside the local copy. The message is sent with the file ID at the end.
+
+    Task<int64_t> begin_streaming_upload(std::string path, SendMode mode) {
+        auto upload = std::make_shared<StreamingUpload>();
+        upload->id = next_streaming_upload_id_++;
+        upload->source_path = path;
+        upload->conversion = kStreamingConversionPrefix + std::to_string(upload->id);
+        {
+            std::lock_guard<std::mutex> lock(streaming_uploads_mutex_);
+            streaming_uploads_[upload->id] = upload;
         }
 
-        auto user_obj = td::move_tl_object_as<td_api::user>(response);
-        return convert_user(*user_obj);
-    }
+        // Every exit but a started upload cancels it again: an error response, a throwing query
+        // or the coroutine being destroyed mid-query (a generation it began is failed, closing its files)
+        struct CancelGuard {
+            Impl* impl;
+            int64_t upload_id;
+            ~CancelGuard() {
+                if (upload_id != 0) {
+                    impl->cancel_streaming_upload(upload_id);
+                }
+            }
+        } guard{this, upload->id};
 
-    // Get user by ID
-    std::optional<User> get_user_sync(int64_t user_id) {
-        auto response = send_query_sync(td_api::make_object<td_api::getUser>(user_id));
+        auto input_file = td_api::make_object<td_api::inputFileGenerated>(path, upload->conversion, 0);
+        auto response = co_await query(
+            td_api::make_object<td_api::preliminaryUploadFile>(std::move(input_file), upload_file_type(path, mode), 1)
+        );
 
-        if (response->get_id() != td_api::user::ID) {
-            return std::nullopt;
+        if (response->get_id() == td_api::file::ID) {
+            auto& file = static_cast<const td_api::file&>(*response);
+            std::lock_guard<std::mutex> lock(upload->mutex);
+            upload->file_id = file.id_;
+            guard.upload_id = 0;
+            spdlog::debug("Streaming upload {} started: file_id={} path={}", upload->id, file.id_, path);
+            co_return upload->id;
         }
 
-        auto user_obj = td::move_tl_object_as<td_api::user>(response);
-        auto user = convert_user(*user_obj);
-
-        // Try to get full user info for bio
-        auto full_response = send_query_sync(td_api::make_object<td_api::getUserFullInfo>(user_id));
-        if (full_response->get_id() == td_api::userFullInfo::ID) {
-            auto full_info = td::move_tl_object_as<td_api::userFullInfo>(full_response);
-            if (full_info->bio_) {
-                user.bio = full_info->bio_->text_;
-            }
+        if (response->get_id() == td_api::error::ID) {
+            auto& error = static_cast<const td_api::error&>(*response);
+            spdlog::warn("Can't start streaming upload of {}: [{}] {}", path, error.code_, error.message_);
         }
-
-        return user;
+        co_return 0;
+    }
+
+    void streaming_upload_progress(int64_t upload_id, int64_t available) {
+        auto upload = find_streaming_upload(upload_id);
+        if (!upload) {
+            return;
+        }
+        auto current = upload->available.load();
+        while (available > current && !upload->available.compare_exchange_weak(current, available)) {
+        }
+        schedule_generation(upload);
+    }
+
+    void finish_streaming_upload(int64_t upload_id, int64_t size) {
+        auto upload = find_streaming_upload(upload_id);
+        if (!upload) {
+            return;
+        }
+        upload->available = size;
+        upload->final_size = size;
+        schedule_generation(upload);
+    }
+
+    void cancel_streaming_upload(int64_t upload_id) {
+        auto upload = forget_streaming_upload(upload_id);
+        if (!upload) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(upload->mutex);
+        if (upload->file_id != 0) {
+            send_query(td_api::make_object<td_api::cancelPreliminaryUploadFile>(upload->file_id), log_error_response);
+        }
+        if (upload->generation_id != 0 && !upload->done) {
+            fail_generation(*upload, "Upload cancelled");
+        }
+        spdlog::debug("Streaming upload {} cancelled", upload_id);
+    }
+
+    Task<Message> send_streaming_upload(
+        int64_t chat_id,
+        int64_t upload_id,
+        SendMode mode,
+        std::string file_hash,
+        int64_t file_size
+    ) {
+        auto upload = find_streaming_upload(upload_id);
+        int32_t file_id = 0;
+        bool generated = false;
+        if (upload) {
+            std::lock_guard<std::mutex> lock(upload->mutex);
+            file_id = upload->file_id;
+            upload->sent = true;
+            generated = upload->done;
+        }
+        if (file_id == 0) {
+            throw FileUploadException("streaming upload " + std::to_string(upload_id) + " not started");
+        }
+        // Otherwise the state stays registered until TDLib has the whole file (see advance_generation)
+        if (generated) {
+            forget_streaming_upload(upload_id);
+        }
+
+        const std::string& path = upload->source_path;
+        auto response = co_await query(
+            td_api::make_object<td_api::sendMessage>(
+                chat_id,
+                nullptr,
+                nullptr,
+                nullptr,
+                nullptr,
+                make_file_content(td_api::make_object<td_api::inputFileId>(file_id), path, mode)
+            )
+        );
+
+        if (response->get_id() == td_api::message::ID) {
+            auto msg_obj = td::move_tl_object_as<td_api::message>(response);
+            track_sent_file(*msg_obj);
+            auto message = convert_message(std::move(msg_obj));
+            cache_->cache_message(message);
+
+            // Same cleanup and cache update as send_file(); the upload's directory goes too
+            {
+                std::lock_guard<std::mutex> lock(pending_uploads_mutex_);
+                pending_upload_files_[message.id] = PendingUploadInfo{path, file_hash, file_size, true, file_id};
+            }
+            spdlog::debug("Sent streaming upload {}: msg_id={} file_id={}", upload_id, message.id, file_id);
+            co_return message;
+        }
+
+        if (response->get_id() == td_api::error::ID) {
+            auto error = td::move_tl_object_as<td_api::error>(response);
+            spdlog::error("TDLib error sending file {}: [{}] {}", path, error->code_, error->message_);
+            throw FileUploadException(path + " (TDLib error: " + error->message_ + ")");
+        }
+
+        spdlog::error("Unexpected response type {} when sending file {}", response->get_id(), path);
+        throw FileUploadException(path);
+    }
+
+    std::optional<FileUploadState> get_upload_state(int64_t message_id) {
+        FileUploadState state;
+        int32_t file_id = 0;
+        {
+            std::lock_guard<std::mutex> lock(pending_uploads_mutex_);
+            auto it = pending_upload_files_.find(message_id);
+            if (it == pending_upload_files_.end()) {
+                return std::nullopt;
+            }
+            file_id = it->second.file_id;
+            state.size = it->second.file_size;
+        }
+
+        std::lock_guard<std::mutex> lock(file_states_mutex_);
+        auto it = file_states_.find(file_id);
+        if (it != file_states_.end()) {
+            state.uploaded = it->second.uploaded;
+            if (state.size == 0) {
+                state.size = it->second.size;
+            }
+        }
+        return state;
+    }
+
+    // Get the current logged-in user
+    Task<User> get_me() {
+        auto response = co_await query(td_api::make_object<td_api::getMe>());
+
+        if (response->get_id() != td_api::user::ID) {
+            throw TelegramException("Failed to get current user");
+        }
+
+        auto user_obj = td::move_tl_object_as<td_api::user>(response);
+        co_return convert_user(std::move(user_obj));
+    }
+
+    // Get user by ID
+    Task<std::optional<User>> get_user(int64_t user_id) {
+        // Basic and full info (for the bio) are independent: fetch them in one round-trip
+        auto [response, full_response] = co_await when_all(
+            query_task(td_api::make_object<td_api::getUser>(user_id)),
+            query_task(td_api::make_object<td_api::getUserFullInfo>(user_id))
+        );
+
+        if (response->get_id() != td_api::user::ID) {
+            co_return std::nullopt;
+        }
+
+        auto user_obj = td::move_tl_object_as<td_api::user>(response);
+        auto user = convert_user(std::move(user_obj));
+
+        if (full_response->get_id() == td_api::userFullInfo::ID) {
+            auto full_info = td::move_tl_object_as<td_api::userFullInfo>(full_response);
+            if (full_info->bio_) {
+                user.bio = full_info->bio_->text_;
+            }
+        }
+
+        co_return user;
     }
 
     // Get all users from private chats (reads from cache - no API calls)
@@ -1069,6 +1724,8 @@ public:
 
         // TDLib populates our cache via updateNewChat and updateUser during startup.
         // No need to call getChats - just read from cache.
+        wait_for_dispatched_updates();
+        cache_->flush();  // Updates are queued write-behind
 
         // Read private chats from cache
         auto cached_chats = cache_->get_cached_chats_by_type(ChatType::PRIVATE);
@@ -1102,24 +1759,20 @@ public:
     }
 
     // Get user bio (separate call to avoid rate limiting during bulk load)
-    std::string get_user_bio_sync(int64_t user_id) {
-        auto response = send_query_sync(td_api::make_object<td_api::getUserFullInfo>(user_id));
+    Task<std::string> get_user_bio(int64_t user_id) {
+        auto response = co_await query(td_api::make_object<td_api::getUserFullInfo>(user_id));
         if (response->get_id() == td_api::userFullInfo::ID) {
             auto full_info = td::move_tl_object_as<td_api::userFullInfo>(response);
             if (full_info->bio_) {
-                return full_info->bio_->text_;
+                co_return full_info->bio_->text_;
             }
         }
-        return "";
+        co_return "";
     }
 
     // Send file using remote file ID (for deduplication/reuse)
-    Message send_file_by_id_sync(
-        int64_t chat_id,
-        const std::string& remote_file_id,
-        const std::string& filename,
-        SendMode mode
-    ) {
+    Task<Message>
+    send_file_by_id(int64_t chat_id, std::string remote_file_id, std::string filename, SendMode mode) {
         auto input_file = td_api::make_object<td_api::inputFileRemote>(remote_file_id);
 
         td_api::object_ptr<td_api::InputMessageContent> input_content;
@@ -1159,7 +1812,7 @@ public:
                 td_api::make_object<td_api::inputMessageDocument>(std::move(input_file), nullptr, false, nullptr);
         }
 
-        auto response = send_query_sync(
+        auto response = co_await query(
             td_api::make_object<td_api::sendMessage>(
                 chat_id, nullptr, nullptr, nullptr, nullptr, std::move(input_content)
             )
@@ -1167,18 +1820,32 @@ public:
 
         if (response->get_id() == td_api::message::ID) {
             auto msg_obj = td::move_tl_object_as<td_api::message>(response);
-            auto message = convert_message(*msg_obj);
+            auto message = convert_message(std::move(msg_obj));
             cache_->cache_message(message);
-            return message;
+            co_return message;
         }
 
         throw OperationException("Failed to send file by remote ID");
     }
 
+    // TDLib download priority (1-32) for a request made at the calling thread's priority, so
+    // speculative downloads only get the bandwidth interactive ones leave over
+    static int32_t download_priority() {
+        switch (current_request_priority()) {
+            case RequestPriority::INTERACTIVE:
+                return 32;
+            case RequestPriority::UPLOAD:
+                return 16;
+            case RequestPriority::BACKGROUND:
+                return 1;
+        }
+        return 32;
+    }
+
     // Download file using remote file ID (persistent string)
-    std::string download_file_sync(const std::string& remote_file_id, const std::string& destination_path) {
+    Task<std::string> download_file(std::string remote_file_id, std::string destination_path) {
         // First, get the file info using remote ID
-        auto file_response = send_query_sync(td_api::make_object<td_api::getRemoteFile>(remote_file_id, nullptr));
+        auto file_response = co_await query(td_api::make_object<td_api::getRemoteFile>(remote_file_id, nullptr));
 
         if (file_response->get_id() != td_api::file::ID) {
             throw FileNotFoundException(remote_file_id);
@@ -1192,18 +1859,18 @@ public:
             std::string source_path = file_obj->local_->path_;
 
             if (destination_path.empty()) {
-                return source_path;
+                co_return source_path;
             }
 
             // Copy to destination
             fs::copy_file(source_path, destination_path, fs::copy_options::overwrite_existing);
-            return destination_path;
+            co_return destination_path;
         }
 
         // Download the file using local file ID
-        auto download_response = send_query_sync(
-            td_api::make_object<td_api::downloadFile>(local_file_id, 32, 0, 0, true),
-            120000  // 2 minute timeout for downloads
+        auto download_response = co_await query(
+            td_api::make_object<td_api::downloadFile>(local_file_id, download_priority(), 0, 0, true),
+            std::chrono::minutes(2)  // Timeout for downloads
         );
 
         if (download_response->get_id() != td_api::file::ID) {
@@ -1219,15 +1886,281 @@ public:
         std::string source_path = downloaded_file->local_->path_;
 
         if (destination_path.empty()) {
-            return source_path;
+            co_return source_path;
         }
 
         // Copy to destination
         fs::copy_file(source_path, destination_path, fs::copy_options::overwrite_existing);
-        return destination_path;
+        co_return destination_path;
+    }
+
+    // Bytes TDLib keeps in the files directory
+    Task<int64_t> get_files_size() {
+        auto response = co_await query(td_api::make_object<td_api::getStorageStatisticsFast>());
+        if (response->get_id() != td_api::storageStatisticsFast::ID) {
+            throw OperationException("Failed to get storage statistics");
+        }
+        co_return static_cast<const td_api::storageStatisticsFast&>(*response).files_size_;
+    }
+
+    // Delete the local copy of a downloaded file; the message keeps it on Telegram
+    Task<bool> delete_local_file(std::string remote_file_id) {
+        auto file_response = co_await query(td_api::make_object<td_api::getRemoteFile>(remote_file_id, nullptr));
+        if (file_response->get_id() != td_api::file::ID) {
+            co_return false;
+        }
+
+        auto& file = static_cast<const td_api::file&>(*file_response);
+        if (!file.local_ || file.local_->downloaded_size_ == 0) {
+            co_return false;  // Nothing on disk
+        }
+
+        auto response = co_await query(td_api::make_object<td_api::deleteFile>(file.id_));
+        co_return response->get_id() == td_api::ok::ID;
+    }
+
+    // Let TDLib delete files until the store fits max_bytes, sparing the ones used within immunity
+    Task<int64_t> optimize_storage(int64_t max_bytes, std::chrono::seconds immunity) {
+        // No age or count limit: the defaults (-1) would also delete everything older than a day
+        constexpr int32_t kNoTtlLimit = 10 * 365 * 24 * 3600;
+        constexpr int32_t kNoCountLimit = std::numeric_limits<int32_t>::max();
+
+        auto response = co_await query(
+            td_api::make_object<td_api::optimizeStorage>(
+                max_bytes,
+                kNoTtlLimit,
+                kNoCountLimit,
+                static_cast<int32_t>(immunity.count()),
+                std::vector<td_api::object_ptr<td_api::FileType>>(),  // file_types (all)
+                std::vector<int64_t>(),                               // chat_ids (all)
+                std::vector<int64_t>(),                               // exclude_chat_ids
+                false,                                                // return_deleted_file_statistics
+                0                                                     // chat_limit
+            ),
+            std::chrono::minutes(2)
+        );
+        if (response->get_id() != td_api::storageStatistics::ID) {
+            throw OperationException("Failed to optimise storage");
+        }
+        co_return static_cast<const td_api::storageStatistics&>(*response).size_;
+    }
+
+    // Ensure [offset, offset + limit) of a file is local, downloading only that range (plus read-ahead)
+    FileDownloadState
+    download_file_range_sync(const std::string& remote_file_id, int64_t offset, int64_t limit, int64_t read_ahead) {
+        int32_t local_file_id = resolve_local_file_id(remote_file_id);
+        int64_t download_limit = limit > 0 ? limit + std::max<int64_t>(0, read_ahead) : 0;
+
+        auto stall_deadline = std::chrono::steady_clock::now() + kRangeStallTimeout;
+        int64_t last_available = -1;
+        bool requested = false;
+
+        while (true) {
+            FileDownloadState state;
+            bool active = false;
+            if (check_file_range(local_file_id, offset, limit, state, active)) {
+                return state;
+            }
+
+            // updateFile only reports the prefix of the currently active download offset;
+            // ask TDLib directly in case another reader moved it elsewhere
+            auto prefix_response =
+                send_query_sync(td_api::make_object<td_api::getFileDownloadedPrefixSize>(local_file_id, offset));
+            if (prefix_response->get_id() == td_api::fileDownloadedPrefixSize::ID) {
+                auto& prefix = static_cast<const td_api::fileDownloadedPrefixSize&>(*prefix_response);
+                state.available = prefix.size_;
+                int64_t needed = required_range_size(state.size, offset, limit);
+                if (needed >= 0 && state.available >= needed) {
+                    return state;
+                }
+            }
+
+            if (state.available > last_available) {
+                last_available = state.available;
+                stall_deadline = std::chrono::steady_clock::now() + kRangeStallTimeout;
+            } else if (std::chrono::steady_clock::now() >= stall_deadline) {
+                throw TimeoutException("download range of " + remote_file_id);
+            }
+
+            if (!requested || !active) {
+                // Non-synchronous request: progress arrives via updateFile
+                send_query(
+                    td_api::make_object<td_api::downloadFile>(local_file_id, 32, offset, download_limit, false),
+                    [this](td_api::object_ptr<td_api::Object> response) {
+                        if (response && response->get_id() == td_api::file::ID) {
+                            record_file_state(static_cast<const td_api::file&>(*response));
+                        }
+                    }
+                );
+                requested = true;
+            }
+
+            std::unique_lock<std::mutex> lock(file_states_mutex_);
+            file_states_cv_.wait_for(lock, kRangePollInterval);
+        }
+    }
+
+    // Stop tracking a file read by range; a later read looks it up again
+    void release_file_range(const std::string& remote_file_id) {
+        std::lock_guard<std::mutex> lock(file_states_mutex_);
+        auto it = remote_file_ids_.find(remote_file_id);
+        if (it == remote_file_ids_.end()) {
+            return;
+        }
+        file_states_.erase(it->second);
+        remote_file_ids_.erase(it);
     }
 
 private:
+    static constexpr auto kRangeStallTimeout = std::chrono::seconds(30);
+
+    // Queries in flight at once; beyond this send_query fails the query (the rate limiter keeps far fewer)
+    static constexpr std::size_t kMaxPendingQueries = 4096;
+
+    // Per query type: round-trip time histogram and trace span name
+    struct QueryMetrics {
+        LatencyHistogram* latency;
+        const char* trace_name;
+    };
+
+    // A sent query waiting for its response
+    struct PendingQuery {
+        QueryCallback callback;
+        const QueryMetrics* metrics;
+        uint64_t request;  // Trace request that sent it
+        std::chrono::steady_clock::time_point sent_at;
+        int64_t trace_start;  // Tracer clock when sent (0 while not tracing)
+    };
+
+    // Record a query's round trip and run its callback with @p response (null on timeout)
+    static void complete_query(PendingQuery& pending, td_api::object_ptr<td_api::Object> response) {
+        pending.metrics->latency->record(std::chrono::steady_clock::now() - pending.sent_at);
+        if (pending.trace_start != 0) {
+            Tracer::global().record("tdlib", pending.metrics->trace_name, pending.trace_start, pending.request);
+        }
+
+        // The callback runs on the receive thread, on behalf of the request that sent the query
+        TraceRequestScope scope(pending.request);
+        TraceSpan span("tdlib", "response");
+        pending.callback(std::move(response));
+    }
+
+    static constexpr auto kRangePollInterval = std::chrono::milliseconds(250);
+
+    // Local view of a file's download progress, fed by updateFile
+    struct LocalFileState {
+        std::string path;
+        int64_t size{0};
+        int64_t download_offset{0};
+        int64_t prefix_size{0};
+        int64_t uploaded{0};
+        bool active{false};
+        bool completed{false};
+    };
+
+    // Bytes that must be local for a range request, -1 if unknown
+    static int64_t required_range_size(int64_t file_size, int64_t offset, int64_t limit) {
+        if (file_size > 0) {
+            int64_t remaining = std::max<int64_t>(0, file_size - offset);
+            return limit > 0 ? std::min(limit, remaining) : remaining;
+        }
+        return limit > 0 ? limit : -1;
+    }
+
+    // Record a file's transfer state; @p track false only updates files already tracked
+    void record_file_state(const td_api::file& file, bool track = true) {
+        {
+            std::lock_guard<std::mutex> lock(file_states_mutex_);
+            auto it = file_states_.find(file.id_);
+            if (it == file_states_.end()) {
+                if (!track) {
+                    return;  // updateFile for a file nobody reads or uploads here
+                }
+                it = file_states_.emplace(file.id_, LocalFileState{}).first;
+            }
+            auto& state = it->second;
+            state.size = file.size_ != 0 ? file.size_ : file.expected_size_;
+            if (file.local_) {
+                state.path = file.local_->path_;
+                state.download_offset = file.local_->download_offset_;
+                state.prefix_size = file.local_->downloaded_prefix_size_;
+                state.active = file.local_->is_downloading_active_;
+                state.completed = file.local_->is_downloading_completed_;
+            }
+            if (file.remote_) {
+                state.uploaded = file.remote_->uploaded_size_;
+            }
+        }
+        file_states_cv_.notify_all();
+    }
+
+    // Stop tracking a file whose upload finished (0 is no file)
+    void forget_file_state(int32_t file_id) {
+        if (file_id == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(file_states_mutex_);
+        file_states_.erase(file_id);
+    }
+
+    // Record the state of the file a just-sent message uploads, so updateFile progress can be looked up
+    int32_t track_sent_file(const td_api::message& message) {
+        const td_api::file* file = message.content_ ? message_file(*message.content_) : nullptr;
+        if (!file) {
+            return 0;
+        }
+        record_file_state(*file);
+        return file->id_;
+    }
+
+    // Map a remote file ID to TDLib's local file ID, recording its current state
+    int32_t resolve_local_file_id(const std::string& remote_file_id) {
+        {
+            std::lock_guard<std::mutex> lock(file_states_mutex_);
+            auto it = remote_file_ids_.find(remote_file_id);
+            if (it != remote_file_ids_.end()) {
+                return it->second;
+            }
+        }
+
+        auto file_response = send_query_sync(td_api::make_object<td_api::getRemoteFile>(remote_file_id, nullptr));
+        if (file_response->get_id() != td_api::file::ID) {
+            throw FileNotFoundException(remote_file_id);
+        }
+
+        auto& file = static_cast<const td_api::file&>(*file_response);
+        record_file_state(file);
+
+        std::lock_guard<std::mutex> lock(file_states_mutex_);
+        remote_file_ids_[remote_file_id] = file.id_;
+        return file.id_;
+    }
+
+    // Check if the tracked state already covers the range; fills in state either way
+    bool check_file_range(int32_t local_file_id, int64_t offset, int64_t limit, FileDownloadState& out, bool& active) {
+        std::lock_guard<std::mutex> lock(file_states_mutex_);
+        const auto& state = file_states_[local_file_id];
+
+        out.local_path = state.path;
+        out.size = state.size;
+        out.completed = state.completed;
+        out.available = 0;
+        active = state.active;
+
+        if (state.completed) {
+            out.available = std::max<int64_t>(0, state.size - offset);
+            return true;
+        }
+
+        int64_t prefix_end = state.download_offset + state.prefix_size;
+        if (state.download_offset <= offset && prefix_end > offset) {
+            out.available = prefix_end - offset;
+        }
+
+        int64_t needed = required_range_size(state.size, offset, limit);
+        return needed >= 0 && out.available >= needed;
+    }
+
     void configure_tdlib_logging() {
         // Set log verbosity level
         td::ClientManager::execute(td_api::make_object<td_api::setLogVerbosityLevel>(config_.log_verbosity));
@@ -1268,19 +2201,81 @@ private:
         return "application/octet-stream";
     }
 
+    // How a file is sent: as a photo or video for MEDIA (or AUTO with a media type), otherwise as a document
+    MediaType upload_media_type(const std::string& path, SendMode mode) {
+        auto detected_type = detect_media_type(fs::path(path).filename().string(), detect_mime_type(path));
+        bool send_as_media = (mode == SendMode::MEDIA) || (mode == SendMode::AUTO && is_media_type(detected_type));
+
+        if (send_as_media && detected_type == MediaType::PHOTO) {
+            return MediaType::PHOTO;
+        }
+        if (send_as_media && (detected_type == MediaType::VIDEO || detected_type == MediaType::ANIMATION)) {
+            return MediaType::VIDEO;
+        }
+        return MediaType::DOCUMENT;
+    }
+
+    // Message content sending @p input_file, named by @p path
+    td_api::object_ptr<td_api::InputMessageContent>
+    make_file_content(td_api::object_ptr<td_api::InputFile> input_file, const std::string& path, SendMode mode) {
+        switch (upload_media_type(path, mode)) {
+            case MediaType::PHOTO:
+                return td_api::make_object<td_api::inputMessagePhoto>(
+                    std::move(input_file), nullptr, std::vector<int32_t>(), 0, 0, nullptr, false, nullptr, false
+                );
+            case MediaType::VIDEO:
+                return td_api::make_object<td_api::inputMessageVideo>(
+                    std::move(input_file),
+                    nullptr,
+                    nullptr,
+                    0,
+                    std::vector<int32_t>(),
+                    0,
+                    0,
+                    0,
+                    false,
+                    nullptr,
+                    false,
+                    nullptr,
+                    false
+                );
+            default:
+                return td_api::make_object<td_api::inputMessageDocument>(
+                    std::move(input_file), nullptr, false, nullptr
+                );
+        }
+    }
+
+    // TDLib file type matching make_file_content(), for uploads started ahead of the message
+    td_api::object_ptr<td_api::FileType> upload_file_type(const std::string& path, SendMode mode) {
+        switch (upload_media_type(path, mode)) {
+            case MediaType::PHOTO:
+                return td_api::make_object<td_api::fileTypePhoto>();
+            case MediaType::VIDEO:
+                return td_api::make_object<td_api::fileTypeVideo>();
+            default:
+                return td_api::make_object<td_api::fileTypeDocument>();
+        }
+    }
+
     Config config_;
     CacheManager* cache_;
+    std::shared_ptr<ClientHub> hub_;  // Receives and dispatches for this client
+    RateLimiter& rate_limiter_;       // The hub's: paces awaited queries (fire-and-forget ones bypass it)
+    ExecutorScope tasks_;             // Everything of this client on the hub's executor; closed before members go
     std::int32_t client_id_;
     std::atomic<bool> running_;
     std::atomic<AuthState> auth_state_;
+    bool attached_{false};  // Registered with the hub (between start() and detach())
 
-    // Thread for processing updates
-    std::thread update_thread_;
+    // Updates this client handed to the hub's dispatcher
+    std::atomic<uint64_t> queued_updates_{0};   // Pushed by the receive loop
+    std::atomic<uint64_t> applied_updates_{0};  // Applied (or coalesced away) by the dispatcher
+    Counter& dispatched_updates_{Metrics::global().counter({"tdlib_updates_total", "", ""})};
+    Counter& coalesced_updates_{Metrics::global().counter({"tdlib_updates_coalesced_total", "", ""})};
 
-    // Callback management
-    std::mutex callbacks_mutex_;
-    std::map<std::uint64_t, std::function<void(td_api::object_ptr<td_api::Object>)>> callbacks_;
-    std::atomic<std::uint64_t> next_query_id_{1};
+    // Sent queries by TDLib request id
+    CompletionTable<PendingQuery> pending_queries_{kMaxPendingQueries};
 
     // Authorization synchronisation
     mutable std::mutex auth_mutex_;
@@ -1298,15 +2293,307 @@ private:
     std::function<void(const User&)> user_callback_;
     std::mutex user_callback_mutex_;
 
+    // User full info callback (for updateUserFullInfo events)
+    TelegramClient::UserFullInfoCallback user_full_info_callback_;
+    std::mutex user_full_info_callback_mutex_;
+
+    // Chat activity callback (for updateChatLastMessage events)
+    std::function<void(int64_t)> chat_activity_callback_;
+    std::mutex chat_activity_callback_mutex_;
+
+    // Metrics of @p query's type (named after its td_api class); entries are never removed
+    // Each thread caches the entries it has used, so only its first query of a type takes the lock.
+    static const QueryMetrics& query_metrics(const td_api::Function& query) {
+        thread_local std::unordered_map<std::int32_t, const QueryMetrics*> cached;
+        if (auto it = cached.find(query.get_id()); it != cached.end()) {
+            return *it->second;
+        }
+
+        static std::unordered_map<std::int32_t, QueryMetrics> registry;  // By TDLib constructor id
+        static std::mutex registry_mutex;
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        auto it = registry.find(query.get_id());
+        if (it == registry.end()) {
+            auto name = query_type_name(query);
+            QueryMetrics metrics{
+                &Metrics::global().histogram({"tdlib_query_seconds", "query", name}), Tracer::global().intern(name)
+            };
+            it = registry.emplace(query.get_id(), metrics).first;
+        }
+        cached.emplace(query.get_id(), &it->second);
+        return it->second;
+    }
+
+    // Message send callback (for updateMessageSendSucceeded/Failed events)
+    TelegramClient::MessageSendCallback message_send_callback_;
+    std::mutex message_send_callback_mutex_;
+
+    void notify_message_sent(int64_t pending_id, int64_t message_id, const std::string& error) {
+        std::lock_guard<std::mutex> lock(message_send_callback_mutex_);
+        if (message_send_callback_) {
+            message_send_callback_(pending_id, message_id, error);
+        }
+    }
+
     // Pending upload tracking for deduplication cache
     struct PendingUploadInfo {
         std::string temp_path;
         std::string file_hash;
         int64_t file_size;
+        bool remove_directory;  // temp_path has a directory of its own, removed with it
+        int32_t file_id;        // TDLib file being uploaded, for upload progress
     };
     std::map<int64_t, PendingUploadInfo> pending_upload_files_;
     std::mutex pending_uploads_mutex_;
 
+    // Streaming uploads (see begin_streaming_upload), keyed by upload ID
+    static constexpr const char* kStreamingConversionPrefix = "tg-fuse-stream#";
+    static constexpr std::size_t kGenerationCopyChunk = 1024 * 1024;
+
+    struct StreamingUpload {
+        int64_t id{0};
+        std::string source_path;
+        std::string conversion;               // Generated file conversion, matched in updateFileGenerationStart
+        std::atomic<int64_t> available{0};    // Contiguous bytes of the source written so far
+        std::atomic<int64_t> final_size{-1};  // Source size once it is complete
+        std::atomic<bool> scheduled{false};   // advance_generation() already queued
+
+        std::mutex mutex;  // Guards the members below
+        int32_t file_id{0};
+        std::string destination_path;
+        int64_t generation_id{0};  // 0 until TDLib starts generating the file
+        bool linked{false};        // Destination is a hard link to the source
+        int source_fd{-1};         // Open while copying into an unlinked destination
+        int destination_fd{-1};    // Paired with source_fd
+        int64_t generated{0};      // Bytes reported to TDLib
+        bool done{false};          // Generation finished (or failed)
+        bool sent{false};          // Message carrying the file sent
+
+        ~StreamingUpload() { close_files(); }
+
+        void close_files() {
+            if (source_fd >= 0) {
+                ::close(source_fd);
+                source_fd = -1;
+            }
+            if (destination_fd >= 0) {
+                ::close(destination_fd);
+                destination_fd = -1;
+            }
+        }
+    };
+    std::map<int64_t, std::shared_ptr<StreamingUpload>> streaming_uploads_;
+    std::map<int64_t, int64_t> streaming_generations_;  // TDLib generation ID -> upload ID
+    std::atomic<int64_t> next_streaming_upload_id_{1};
+    std::mutex streaming_uploads_mutex_;
+
+    // Download progress for range reads (keyed by TDLib local file ID)
+    std::map<int32_t, LocalFileState> file_states_;
+    std::map<std::string, int32_t> remote_file_ids_;
+    std::mutex file_states_mutex_;
+    std::condition_variable file_states_cv_;
+
+    // Callback for requests sent without waiting: only failures are of interest
+    static void log_error_response(td_api::object_ptr<td_api::Object> response) {
+        if (response && response->get_id() == td_api::error::ID) {
+            auto& error = static_cast<const td_api::error&>(*response);
+            spdlog::debug("TDLib request failed: [{}] {}", error.code_, error.message_);
+        }
+    }
+
+    // Remove an uploaded temp file (and its directory, if it has one of its own)
+    static void remove_upload_file(const PendingUploadInfo& upload_info) {
+        std::error_code ec;
+        fs::remove(upload_info.temp_path, ec);
+        if (upload_info.remove_directory) {
+            fs::remove(fs::path(upload_info.temp_path).parent_path(), ec);
+        }
+    }
+
+    std::shared_ptr<StreamingUpload> find_streaming_upload(int64_t upload_id) {
+        std::lock_guard<std::mutex> lock(streaming_uploads_mutex_);
+        auto it = streaming_uploads_.find(upload_id);
+        return it != streaming_uploads_.end() ? it->second : nullptr;
+    }
+
+    std::shared_ptr<StreamingUpload> forget_streaming_upload(int64_t upload_id) {
+        std::lock_guard<std::mutex> lock(streaming_uploads_mutex_);
+        std::erase_if(streaming_generations_, [upload_id](const auto& entry) { return entry.second == upload_id; });
+        auto node = streaming_uploads_.extract(upload_id);
+        return node ? std::move(node.mapped()) : nullptr;
+    }
+
+    // updateFileGenerationStart: TDLib wants the file behind one of our conversions
+    void start_file_generation(const td_api::updateFileGenerationStart& start) {
+        std::shared_ptr<StreamingUpload> upload;
+        {
+            std::lock_guard<std::mutex> lock(streaming_uploads_mutex_);
+            for (const auto& [id, candidate] : streaming_uploads_) {
+                if (candidate->conversion == start.conversion_) {
+                    upload = candidate;
+                    streaming_generations_[start.generation_id_] = id;
+                    break;
+                }
+            }
+        }
+        if (!upload) {
+            // Cancelled already (or not ours); TDLib would otherwise wait for it
+            send_query(
+                td_api::make_object<td_api::finishFileGeneration>(
+                    start.generation_id_, td_api::make_object<td_api::error>(400, "Unknown file generation")
+                ),
+                log_error_response
+            );
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(upload->mutex);
+            upload->generation_id = start.generation_id_;
+            upload->destination_path = start.destination_path_;
+            upload->generated = 0;
+            upload->done = false;
+
+            // TDLib creates the destination empty; a link to the file being written replaces it,
+            // so nothing is copied. Across filesystems the written bytes are copied over instead.
+            ::unlink(upload->destination_path.c_str());
+            upload->linked = ::link(upload->source_path.c_str(), upload->destination_path.c_str()) == 0;
+            spdlog::debug(
+                "Streaming upload {}: generating {} ({})",
+                upload->id,
+                upload->destination_path,
+                upload->linked ? "linked" : "copying"
+            );
+        }
+        schedule_generation(upload);
+    }
+
+    // updateFileGenerationStop: TDLib gave up on (or is done with) a generation
+    void stop_file_generation(int64_t generation_id) {
+        std::shared_ptr<StreamingUpload> upload;
+        {
+            std::lock_guard<std::mutex> lock(streaming_uploads_mutex_);
+            auto it = streaming_generations_.find(generation_id);
+            if (it == streaming_generations_.end()) {
+                return;
+            }
+            auto upload_it = streaming_uploads_.find(it->second);
+            if (upload_it != streaming_uploads_.end()) {
+                upload = upload_it->second;
+            }
+            streaming_generations_.erase(it);
+        }
+        if (!upload) {
+            return;
+        }
+
+        // A later updateFileGenerationStart may restart it from scratch
+        std::lock_guard<std::mutex> lock(upload->mutex);
+        if (upload->generation_id == generation_id) {
+            upload->generation_id = 0;
+            upload->close_files();
+        }
+    }
+
+    void schedule_generation(const std::shared_ptr<StreamingUpload>& upload) {
+        if (!upload->scheduled.exchange(true)) {
+            tasks_.post([this, upload] { advance_generation(upload); });
+        }
+    }
+
+    // Bring the generated file up to what has been written so far, finishing it once complete
+    void advance_generation(const std::shared_ptr<StreamingUpload>& upload) {
+        upload->scheduled = false;
+
+        bool finished = false;
+        {
+            std::lock_guard<std::mutex> lock(upload->mutex);
+            if (upload->generation_id == 0 || upload->done) {
+                return;
+            }
+
+            int64_t available = upload->available;
+            int64_t final_size = upload->final_size;
+            if (!upload->linked && !copy_generated(*upload, available)) {
+                fail_generation(*upload, "Failed to copy upload");
+                finished = upload->sent;
+            } else {
+                if (available > upload->generated) {
+                    upload->generated = available;
+                    send_query(
+                        td_api::make_object<td_api::setFileGenerationProgress>(
+                            upload->generation_id, final_size >= 0 ? final_size : 0, available
+                        ),
+                        log_error_response
+                    );
+                }
+                if (final_size >= 0 && available >= final_size) {
+                    send_query(
+                        td_api::make_object<td_api::finishFileGeneration>(upload->generation_id, nullptr),
+                        log_error_response
+                    );
+                    upload->done = true;
+                    upload->close_files();
+                    finished = upload->sent;
+                    spdlog::debug("Streaming upload {}: generated {} bytes", upload->id, available);
+                }
+            }
+        }
+        if (finished) {
+            forget_streaming_upload(upload->id);
+        }
+    }
+
+    void fail_generation(StreamingUpload& upload, const std::string& message) {
+        send_query(
+            td_api::make_object<td_api::finishFileGeneration>(
+                upload.generation_id, td_api::make_object<td_api::error>(400, message)
+            ),
+            log_error_response
+        );
+        upload.done = true;
+        upload.close_files();
+    }
+
+    // Copy source bytes [generated, available) into a destination that couldn't be linked
+    static bool copy_generated(StreamingUpload& upload, int64_t available) {
+        if (upload.destination_fd < 0) {
+            upload.source_fd = ::open(upload.source_path.c_str(), O_RDONLY | O_CLOEXEC);
+            upload.destination_fd = ::open(upload.destination_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+            if (upload.source_fd < 0 || upload.destination_fd < 0) {
+                spdlog::error("Streaming upload {}: can't open files: {}", upload.id, std::strerror(errno));
+                return false;
+            }
+        }
+
+        std::vector<char> buffer(kGenerationCopyChunk);
+        int64_t offset = upload.generated;
+        while (offset < available) {
+            auto chunk = static_cast<std::size_t>(std::min<int64_t>(kGenerationCopyChunk, available - offset));
+            auto rc = ::pread(upload.source_fd, buffer.data(), chunk, offset);
+            if (rc < 0 && errno == EINTR) {
+                continue;
+            }
+            if (rc <= 0) {
+                spdlog::error("Streaming upload {}: read failed at {}", upload.id, offset);
+                return false;
+            }
+            for (ssize_t written = 0; written < rc;) {
+                auto wc = ::pwrite(upload.destination_fd, buffer.data() + written, rc - written, offset + written);
+                if (wc < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (wc < 0) {
+                    spdlog::error("Streaming upload {}: write failed: {}", upload.id, std::strerror(errno));
+                    return false;
+                }
+                written += wc;
+            }
+            offset += rc;
+        }
+        return true;
+    }
+
 public:
     void set_message_callback(std::function<void(const Message&)> callback) {
         std::lock_guard<std::mutex> lock(message_callback_mutex_);
@@ -1322,13 +2609,195 @@ public:
         std::lock_guard<std::mutex> lock(user_callback_mutex_);
         user_callback_ = std::move(callback);
     }
+
+    void set_user_full_info_callback(TelegramClient::UserFullInfoCallback callback) {
+        std::lock_guard<std::mutex> lock(user_full_info_callback_mutex_);
+        user_full_info_callback_ = std::move(callback);
+    }
+
+    void set_chat_activity_callback(std::function<void(int64_t)> callback) {
+        std::lock_guard<std::mutex> lock(chat_activity_callback_mutex_);
+        chat_activity_callback_ = std::move(callback);
+    }
+
+    void set_message_send_callback(TelegramClient::MessageSendCallback callback) {
+        std::lock_guard<std::mutex> lock(message_send_callback_mutex_);
+        message_send_callback_ = std::move(callback);
+    }
 };
 
+// ClientHub implementation
+ClientHub::Impl::Impl(const ClientHub::Config& config)
+    : executor_(make_executor(config.executor_threads)), rate_limiter_(config.rate_limits) {}
+
+ClientHub::Impl::~Impl() {
+    // Clients keep the hub alive, so all of them have detached by now
+    if (receive_thread_.joinable()) {
+        receiving_ = false;
+        receive_thread_.join();
+    }
+    if (dispatch_thread_.joinable()) {
+        dispatching_ = false;
+        updates_.notify();
+        dispatch_thread_.join();
+    }
+}
+
+void ClientHub::Impl::attach(std::int32_t client_id, TelegramClient::Impl* client) {
+    std::unique_lock lock(clients_mutex_);
+    clients_[client_id] = client;
+
+    // Start the update dispatcher, then the receive loop feeding it
+    if (!receive_thread_.joinable()) {
+        dispatching_ = true;
+        dispatch_thread_ = std::thread([this]() { dispatch_updates(); });
+        receiving_ = true;
+        receive_thread_ = std::thread([this]() { receive_updates(); });
+    }
+}
+
+void ClientHub::Impl::detach(std::int32_t client_id) {
+    TelegramClient::Impl* client = nullptr;
+    {
+        std::unique_lock lock(clients_mutex_);
+        auto it = clients_.find(client_id);
+        if (it == clients_.end()) {
+            return;
+        }
+        client = it->second;
+        clients_.erase(it);
+    }
+
+    // No new call can start now; wait out one in progress (unless this is it, detaching from a callback)
+    if (std::this_thread::get_id() == receive_thread_.get_id()) {
+        return;
+    }
+    std::unique_lock lock(calling_mutex_);
+    calling_cv_.wait(lock, [this, client]() { return calling_ != client; });
+}
+
+void ClientHub::Impl::dispatch(TelegramClient::Impl* client, td_api::object_ptr<td_api::Object> update) {
+    updates_.push(QueuedUpdate{client, std::move(update)});
+}
+
+template <typename Call>
+void ClientHub::Impl::call_client(std::int32_t client_id, Call&& call) {
+    TelegramClient::Impl* client = nullptr;
+    {
+        // Claimed under the table lock, so a detach() either comes first or waits for the call
+        std::shared_lock lock(clients_mutex_);
+        auto it = clients_.find(client_id);
+        if (it == clients_.end()) {
+            return;
+        }
+        client = it->second;
+        std::lock_guard<std::mutex> calling_lock(calling_mutex_);
+        calling_ = client;
+    }
+
+    call(*client);
+
+    {
+        std::lock_guard<std::mutex> lock(calling_mutex_);
+        calling_ = nullptr;
+    }
+    calling_cv_.notify_all();
+}
+
+void ClientHub::Impl::receive_updates() {
+    auto* manager = td::ClientManager::get_manager_singleton();
+    auto next_expiry_check = std::chrono::steady_clock::now() + kQueryExpiryInterval;
+    std::vector<std::int32_t> client_ids;
+
+    while (receiving_) {
+        auto response = manager->receive(1.0);  // 1 second timeout
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_expiry_check) {
+            client_ids.clear();
+            {
+                std::shared_lock lock(clients_mutex_);
+                for (const auto& [client_id, client] : clients_) {
+                    client_ids.push_back(client_id);
+                }
+            }
+            for (auto client_id : client_ids) {
+                call_client(client_id, [now](TelegramClient::Impl& client) { client.expire_queries(now); });
+            }
+            next_expiry_check = now + kQueryExpiryInterval;
+        }
+
+        if (!response.object) {
+            continue;
+        }
+
+        // Responses for a client that has detached (e.g. after a forced stop) are dropped
+        call_client(response.client_id, [&response](TelegramClient::Impl& client) {
+            client.receive(std::move(response));
+        });
+    }
+}
+
+void ClientHub::Impl::dispatch_updates() {
+    std::vector<QueuedUpdate> queued;
+    std::vector<td_api::object_ptr<td_api::Object>> batch;
+    queued.reserve(kMaxDispatchBatch);
+    batch.reserve(kMaxDispatchBatch);
+    while (true) {
+        auto epoch = updates_.epoch();
+        while (queued.size() < kMaxDispatchBatch) {
+            auto update = updates_.try_pop();
+            if (!update) {
+                break;
+            }
+            queued.push_back(std::move(*update));
+        }
+
+        if (queued.empty()) {
+            if (!dispatching_) {
+                break;
+            }
+            updates_.wait(epoch);
+            continue;
+        }
+
+        // Each client applies its own updates as one batch, still in the order they arrived
+        std::stable_sort(queued.begin(), queued.end(), [](const auto& a, const auto& b) {
+            return std::less<>{}(a.client, b.client);
+        });
+        for (std::size_t i = 0; i < queued.size();) {
+            auto* client = queued[i].client;
+            for (; i < queued.size() && queued[i].client == client; ++i) {
+                batch.push_back(std::move(queued[i].update));
+            }
+            client->dispatch_batch(batch);
+            batch.clear();
+        }
+        queued.clear();
+    }
+}
+
+ClientHub::ClientHub(const Config& config) : impl_(std::make_unique<Impl>(config)) {}
+
+ClientHub::~ClientHub() = default;
+
+RateLimiter& ClientHub::rate_limiter() { return impl_->rate_limiter(); }
+
+const RateLimiter& ClientHub::rate_limiter() const { return impl_->rate_limiter(); }
+
 // TelegramClient implementation
 TelegramClient::TelegramClient(const Config& config)
+    : TelegramClient(
+          config, std::make_shared<ClientHub>(ClientHub::Config{config.executor_threads, config.rate_limits})
+      ) {}
+
+TelegramClient::TelegramClient(const Config& config, std::shared_ptr<ClientHub> hub)
     : config_(config),
-      cache_(std::make_unique<CacheManager>(config.cache_directory + "/cache.db")),
-      impl_(std::make_unique<Impl>(config, cache_.get())) {}
+      cache_(std::make_unique<CacheManager>(
+          config.cache_directory + "/cache.db", CacheManager::kDefaultReaderConnections, WriteBehindConfig{},
+          config.message_store, config.maintenance
+      )),
+      impl_(std::make_unique<Impl>(config, cache_.get(), std::move(hub))) {}
 
 TelegramClient::~TelegramClient() = default;
 
@@ -1344,6 +2813,10 @@ Task<void> TelegramClient::stop() {
 
 Task<AuthState> TelegramClient::get_auth_state() { co_return impl_->get_auth_state(); }
 
+Task<bool> TelegramClient::wait_until_ready(std::chrono::milliseconds timeout) {
+    co_return impl_->wait_until_ready(timeout);
+}
+
 Task<void> TelegramClient::login(const std::string& phone) {
     impl_->send_phone_number(phone);
     co_return;
@@ -1395,8 +2868,7 @@ Task<std::vector<Chat>> TelegramClient::get_channels() {
 Task<std::vector<Chat>> TelegramClient::get_all_chats() { co_return impl_->get_all_chats_sync(); }
 
 Task<void> TelegramClient::preload_chats(int32_t limit) {
-    impl_->preload_chats_sync(limit);
-    co_return;
+    co_await impl_->preload_chats(limit);
 }
 
 Task<std::optional<Chat>> TelegramClient::resolve_username(const std::string& username) {
@@ -1406,34 +2878,34 @@ Task<std::optional<Chat>> TelegramClient::resolve_username(const std::string& us
         clean_username = clean_username.substr(1);
     }
 
-    co_return impl_->search_public_chat_sync(clean_username);
+    co_return co_await impl_->search_public_chat(std::move(clean_username));
 }
 
-Task<std::optional<Chat>> TelegramClient::get_chat(int64_t chat_id) { co_return impl_->get_chat_sync(chat_id); }
+Task<std::optional<Chat>> TelegramClient::get_chat(int64_t chat_id) { co_return co_await impl_->get_chat(chat_id); }
 
-Task<std::optional<User>> TelegramClient::get_user(int64_t user_id) { co_return impl_->get_user_sync(user_id); }
+Task<std::optional<User>> TelegramClient::get_user(int64_t user_id) { co_return co_await impl_->get_user(user_id); }
 
-Task<User> TelegramClient::get_me() { co_return impl_->get_me_sync(); }
+Task<User> TelegramClient::get_me() { co_return co_await impl_->get_me(); }
 
 Task<Message> TelegramClient::send_text(int64_t chat_id, const std::string& text) {
-    co_return impl_->send_text_message_sync(chat_id, text);
+    co_return co_await impl_->send_text_message(chat_id, text);
 }
 
 Task<std::vector<Message>> TelegramClient::get_messages(int64_t chat_id, int limit) {
-    co_return impl_->get_chat_history_sync(chat_id, limit);
+    co_return co_await impl_->get_chat_history(chat_id, limit);
 }
 
 Task<std::vector<Message>> TelegramClient::get_last_n_messages(int64_t chat_id, int n) {
     co_return co_await get_messages(chat_id, n);
 }
 
-Task<std::vector<Message>>
+Task<MessageBatch>
 TelegramClient::get_messages_until(int64_t chat_id, std::size_t min_messages, std::chrono::seconds max_age) {
-    co_return impl_->get_messages_until_sync(chat_id, min_messages, max_age);
+    co_return co_await impl_->get_messages_until(chat_id, min_messages, max_age);
 }
 
 Task<Message> TelegramClient::send_file(int64_t chat_id, const std::string& path, SendMode mode) {
-    co_return impl_->send_file_sync(chat_id, path, mode);
+    co_return co_await impl_->send_file(chat_id, path, mode);
 }
 
 Task<Message> TelegramClient::send_file(
@@ -1443,7 +2915,7 @@ Task<Message> TelegramClient::send_file(
     const std::string& file_hash,
     int64_t file_size
 ) {
-    co_return impl_->send_file_sync(chat_id, path, mode, file_hash, file_size);
+    co_return co_await impl_->send_file(chat_id, path, mode, file_hash, file_size);
 }
 
 Task<Message> TelegramClient::send_file_by_id(
@@ -1452,23 +2924,72 @@ Task<Message> TelegramClient::send_file_by_id(
     const std::string& filename,
     SendMode mode
 ) {
-    co_return impl_->send_file_by_id_sync(chat_id, remote_file_id, filename, mode);
+    co_return co_await impl_->send_file_by_id(chat_id, remote_file_id, filename, mode);
+}
+
+Task<int64_t> TelegramClient::begin_streaming_upload(const std::string& path, SendMode mode) {
+    co_return co_await impl_->begin_streaming_upload(path, mode);
 }
 
-Task<std::vector<FileListItem>> TelegramClient::list_media(int64_t chat_id) {
+void TelegramClient::streaming_upload_progress(int64_t upload_id, int64_t available) {
+    impl_->streaming_upload_progress(upload_id, available);
+}
+
+void TelegramClient::finish_streaming_upload(int64_t upload_id, int64_t size) {
+    impl_->finish_streaming_upload(upload_id, size);
+}
+
+void TelegramClient::cancel_streaming_upload(int64_t upload_id) { impl_->cancel_streaming_upload(upload_id); }
+
+Task<Message> TelegramClient::send_streaming_upload(
+    int64_t chat_id,
+    int64_t upload_id,
+    SendMode mode,
+    const std::string& file_hash,
+    int64_t file_size
+) {
+    co_return co_await impl_->send_streaming_upload(chat_id, upload_id, mode, file_hash, file_size);
+}
+
+std::optional<FileUploadState> TelegramClient::get_upload_state(int64_t message_id) {
+    return impl_->get_upload_state(message_id);
+}
+
+RateLimiter& TelegramClient::rate_limiter() { return impl_->rate_limiter_; }
+
+const RateLimiter& TelegramClient::rate_limiter() const { return impl_->rate_limiter_; }
+
+Task<std::vector<FileListItem>> TelegramClient::list_media(int64_t chat_id, int64_t after_message_id) {
     // Use searchChatMessages with photo+video filter to get ALL media in chat
-    co_return impl_->search_chat_files_sync(chat_id, Impl::FileSearchFilter::PHOTO_AND_VIDEO);
+    co_return co_await impl_->search_chat_files(chat_id, Impl::FileSearchFilter::PHOTO_AND_VIDEO, after_message_id);
 }
 
-Task<std::vector<FileListItem>> TelegramClient::list_files(int64_t chat_id) {
+Task<std::vector<FileListItem>> TelegramClient::list_files(int64_t chat_id, int64_t after_message_id) {
     // Use searchChatMessages with document filter to get ALL files in chat
-    co_return impl_->search_chat_files_sync(chat_id, Impl::FileSearchFilter::DOCUMENT);
+    co_return co_await impl_->search_chat_files(chat_id, Impl::FileSearchFilter::DOCUMENT, after_message_id);
 }
 
 Task<std::string> TelegramClient::download_file(const std::string& file_id, const std::string& destination_path) {
-    co_return impl_->download_file_sync(file_id, destination_path);
+    co_return co_await impl_->download_file(file_id, destination_path);
+}
+
+Task<int64_t> TelegramClient::get_files_size() { co_return co_await impl_->get_files_size(); }
+
+Task<bool> TelegramClient::delete_local_file(const std::string& file_id) {
+    co_return co_await impl_->delete_local_file(file_id);
+}
+
+Task<int64_t> TelegramClient::optimize_storage(int64_t max_bytes, std::chrono::seconds immunity) {
+    co_return co_await impl_->optimize_storage(max_bytes, immunity);
 }
 
+Task<FileDownloadState>
+TelegramClient::download_file_range(const std::string& file_id, int64_t offset, int64_t limit, int64_t read_ahead) {
+    co_return impl_->download_file_range_sync(file_id, offset, limit, read_ahead);
+}
+
+void TelegramClient::release_file_range(const std::string& file_id) { impl_->release_file_range(file_id); }
+
 Task<ChatStatus> TelegramClient::get_chat_status(int64_t chat_id) {
     auto chat = co_await get_chat(chat_id);
 
@@ -1479,7 +3000,7 @@ Task<ChatStatus> TelegramClient::get_chat_status(int64_t chat_id) {
     co_return ChatStatus{0, 0};
 }
 
-Task<std::string> TelegramClient::get_user_bio(int64_t user_id) { co_return impl_->get_user_bio_sync(user_id); }
+Task<std::string> TelegramClient::get_user_bio(int64_t user_id) { co_return co_await impl_->get_user_bio(user_id); }
 
 void TelegramClient::set_message_callback(MessageCallback callback) {
     impl_->set_message_callback(std::move(callback));
@@ -1489,4 +3010,16 @@ void TelegramClient::set_chat_callback(ChatCallback callback) { impl_->set_chat_
 
 void TelegramClient::set_user_callback(UserCallback callback) { impl_->set_user_callback(std::move(callback)); }
 
+void TelegramClient::set_user_full_info_callback(UserFullInfoCallback callback) {
+    impl_->set_user_full_info_callback(std::move(callback));
+}
+
+void TelegramClient::set_chat_activity_callback(ChatActivityCallback callback) {
+    impl_->set_chat_activity_callback(std::move(callback));
+}
+
+void TelegramClient::set_message_send_callback(MessageSendCallback callback) {
+    impl_->set_message_send_callback(std::move(callback));
+}
+
 }  // namespace tg
@@ -0,0 +1,208 @@
+#include "tg/executor.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+namespace tg {
+
+void InlineExecutor::post(Work work) { work(); }
+
+void InlineExecutor::post_after(Clock::duration delay, Work work) {
+    std::this_thread::sleep_for(delay);
+    work();
+}
+
+ThreadPoolExecutor::ThreadPoolExecutor(std::size_t threads) {
+    threads = std::max<std::size_t>(1, threads);
+    workers_.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back([this] { worker_loop(); });
+    }
+}
+
+ThreadPoolExecutor::~ThreadPoolExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPoolExecutor::post(Work work) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready_.push_back(std::move(work));
+    }
+    cv_.notify_one();
+}
+
+void ThreadPoolExecutor::post_after(Clock::duration delay, Work work) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        delayed_.emplace(Clock::now() + delay, std::move(work));
+    }
+    // The new deadline may be earlier than the one a worker is sleeping until
+    cv_.notify_all();
+}
+
+void ThreadPoolExecutor::worker_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        // Promote delayed work whose deadline has passed
+        auto now = Clock::now();
+        while (!delayed_.empty() && delayed_.begin()->first <= now) {
+            ready_.push_back(std::move(delayed_.begin()->second));
+            delayed_.erase(delayed_.begin());
+        }
+
+        if (!ready_.empty()) {
+            auto work = std::move(ready_.front());
+            ready_.pop_front();
+            lock.unlock();
+            try {
+                work();
+            } catch (const std::exception& e) {
+                spdlog::error("Executor: unhandled exception in posted work: {}", e.what());
+            }
+            lock.lock();
+            continue;
+        }
+
+        if (stopping_) {
+            break;
+        }
+
+        if (delayed_.empty()) {
+            cv_.wait(lock);
+        } else {
+            // Copy the deadline: another worker may run (and erase) that entry while we wait
+            auto deadline = delayed_.begin()->first;
+            cv_.wait_until(lock, deadline);
+        }
+    }
+}
+
+namespace {
+
+// Scopes whose work is running on this thread, innermost last (inline executors nest them)
+thread_local std::vector<const void*> t_running_scopes;
+
+}  // namespace
+
+struct ExecutorScope::State {
+    mutable std::mutex mutex;
+    std::condition_variable idle;
+    bool closed{false};
+    std::size_t queued{0};             // Posted work that hasn't finished running
+    std::map<uint64_t, Work> delayed;  // Cancellation of each delayed work not started yet, by id
+    uint64_t next_id{0};
+
+    // One piece of the scope's work running on this thread; it stops counting as queued when done
+    class Running {
+    public:
+        explicit Running(State& state) : state_(state) { t_running_scopes.push_back(&state_); }
+
+        ~Running() {
+            t_running_scopes.pop_back();
+            {
+                std::lock_guard<std::mutex> lock(state_.mutex);
+                --state_.queued;
+            }
+            state_.idle.notify_all();
+        }
+
+        Running(const Running&) = delete;
+        Running& operator=(const Running&) = delete;
+
+    private:
+        State& state_;
+    };
+};
+
+ExecutorScope::ExecutorScope(Executor& executor) : executor_(executor), state_(std::make_shared<State>()) {}
+
+ExecutorScope::~ExecutorScope() { close(); }
+
+bool ExecutorScope::post(Work work) {
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (state_->closed) {
+            return false;
+        }
+        ++state_->queued;
+    }
+    executor_.post([state = state_, work = std::move(work)] {
+        State::Running running(*state);
+        work();
+    });
+    return true;
+}
+
+void ExecutorScope::post_after(Clock::duration delay, Work work, Work on_cancel) {
+    uint64_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (!state_->closed) {
+            id = ++state_->next_id;
+            state_->delayed.emplace(id, std::move(on_cancel));
+        }
+    }
+    if (id == 0) {
+        if (on_cancel) {
+            on_cancel();
+        }
+        return;
+    }
+
+    // An executor destroyed before the deadline drops this, leaving the cancellation to close()
+    executor_.post_after(delay, [state = state_, id, work = std::move(work)] {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->delayed.erase(id) == 0) {
+                return;  // Cancelled by close()
+            }
+            ++state->queued;
+        }
+        State::Running running(*state);
+        work();
+    });
+}
+
+void ExecutorScope::close() {
+    std::map<uint64_t, Work> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->closed = true;
+        cancelled.swap(state_->delayed);
+    }
+    for (auto& [id, on_cancel] : cancelled) {
+        if (on_cancel) {
+            on_cancel();
+        }
+    }
+
+    // Work of this scope further up the calling thread's stack can't finish before close() returns
+    auto own = static_cast<std::size_t>(std::count(t_running_scopes.begin(), t_running_scopes.end(), state_.get()));
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    state_->idle.wait(lock, [&] { return state_->queued <= own; });
+}
+
+std::size_t ExecutorScope::pending() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->queued + state_->delayed.size();
+}
+
+bool ExecutorScope::closed() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->closed;
+}
+
+}  // namespace tg
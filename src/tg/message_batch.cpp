@@ -0,0 +1,71 @@
+#include "tg/message_batch.hpp"
+
+#include <cstring>
+#include <utility>
+
+namespace tg {
+
+MessageBatch::MessageBatch() : state_(std::make_unique<State>()) {}
+
+MessageBatch::~MessageBatch() = default;
+
+MessageBatch::MessageBatch(MessageBatch&& other) noexcept = default;
+
+MessageBatch& MessageBatch::operator=(MessageBatch&& other) noexcept = default;
+
+MessageView& MessageBatch::push_back(const MessageView& message) {
+    MessageView copy = message;
+    copy.text = store(message.text);
+    if (copy.media) {
+        auto& media = *copy.media;
+        media.file_id = store(media.file_id);
+        media.filename = intern(media.filename);
+        media.mime_type = intern(media.mime_type);
+        if (media.local_path) {
+            media.local_path = store(*media.local_path);
+        }
+    }
+    return adopt(copy);
+}
+
+MessageView& MessageBatch::adopt(const MessageView& message) { return state_->messages.emplace_back(message); }
+
+char* MessageBatch::allocate(std::size_t size) { return static_cast<char*>(state_->arena.allocate(size, 1)); }
+
+void MessageBatch::reserve(std::size_t count) { state_->messages.reserve(count); }
+
+MessageBatch::iterator MessageBatch::erase(const_iterator first, const_iterator last) {
+    auto& messages = state_->messages;
+    auto it = messages.erase(messages.begin() + (first - begin()), messages.begin() + (last - begin()));
+    return begin() + (it - messages.begin());
+}
+
+std::vector<Message> MessageBatch::to_messages() const {
+    std::vector<Message> messages;
+    messages.reserve(size());
+    for (const auto& message : *this) {
+        messages.push_back(message.to_message());
+    }
+    return messages;
+}
+
+std::string_view MessageBatch::store(std::string_view value) {
+    if (value.empty()) {
+        return {};
+    }
+    auto* data = allocate(value.size());
+    std::memcpy(data, value.data(), value.size());
+    return {data, value.size()};
+}
+
+std::string_view MessageBatch::intern(std::string_view value) {
+    if (value.empty()) {
+        return {};
+    }
+    if (auto it = state_->interned.find(value); it != state_->interned.end()) {
+        return *it;
+    }
+    return *state_->interned.insert(store(value)).first;
+}
+
+}  // namespace tg
@@ -0,0 +1,356 @@
+#include "tg/message_pages.hpp"
+
+#include "tg/exceptions.hpp"
+#include "tg/message_batch.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+
+namespace tg {
+
+namespace {
+
+constexpr uint8_t kPageVersion = 1;
+
+// Upper bound on an inflated page, so a corrupt size can't trigger a huge allocation
+constexpr uint64_t kMaxPageSize = 256 * 1024 * 1024;
+
+// Fields of a message that are present; the rest read as defaults
+enum MessageFlags : uint8_t {
+    kOutgoing = 1 << 0,
+    kHasMedia = 1 << 1,
+    kHasLocalPath = 1 << 2,
+    kHasWidth = 1 << 3,
+    kHasHeight = 1 << 4,
+    kHasDuration = 1 << 5,
+};
+
+// Samples shorter than this rarely repeat usefully; longer ones are mostly unique
+constexpr std::size_t kMinTokenLength = 4;
+constexpr std::size_t kMaxTokenLength = 64;
+
+void put_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+void put_signed(std::string& out, int64_t value) {
+    put_varint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void put_string(std::string& out, std::string_view value) {
+    put_varint(out, value.size());
+    out.append(value);
+}
+
+// Bounds-checked reader over an inflated page
+class PageReader {
+public:
+    explicit PageReader(std::string_view data) : data_(data) {}
+
+    uint8_t byte() {
+        need(1);
+        return static_cast<uint8_t>(data_[pos_++]);
+    }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            auto b = byte();
+            value |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if ((b & 0x80) == 0) {
+                return value;
+            }
+        }
+        throw DatabaseException("Corrupt message page: varint too long");
+    }
+
+    int64_t signed_varint() {
+        auto value = varint();
+        return static_cast<int64_t>((value >> 1) ^ (~(value & 1) + 1));
+    }
+
+    std::string_view string() {
+        auto size = varint();
+        need(size);
+        auto value = data_.substr(pos_, size);
+        pos_ += size;
+        return value;
+    }
+
+    [[nodiscard]] std::size_t position() const { return pos_; }
+
+private:
+    void need(uint64_t size) const {
+        if (size > data_.size() - pos_) {
+            throw DatabaseException("Corrupt message page: truncated");
+        }
+    }
+
+    std::string_view data_;
+    std::size_t pos_{0};
+};
+
+std::string serialise(const std::vector<Message>& messages) {
+    std::string out;
+    out += static_cast<char>(kPageVersion);
+    put_varint(out, messages.size());
+
+    int64_t previous_id = 0;
+    int64_t previous_timestamp = 0;
+    for (const auto& msg : messages) {
+        put_signed(out, msg.id - previous_id);
+        put_signed(out, msg.timestamp - previous_timestamp);
+        put_signed(out, msg.sender_id);
+        previous_id = msg.id;
+        previous_timestamp = msg.timestamp;
+
+        uint8_t flags = msg.is_outgoing ? kOutgoing : 0;
+        if (msg.media) {
+            flags |= kHasMedia;
+            flags |= msg.media->local_path ? kHasLocalPath : 0;
+            flags |= msg.media->width ? kHasWidth : 0;
+            flags |= msg.media->height ? kHasHeight : 0;
+            flags |= msg.media->duration ? kHasDuration : 0;
+        }
+        out += static_cast<char>(flags);
+        put_string(out, msg.text);
+
+        if (msg.media) {
+            const auto& media = *msg.media;
+            put_varint(out, static_cast<uint64_t>(media.type));
+            put_string(out, media.file_id);
+            put_string(out, media.filename);
+            put_string(out, media.mime_type);
+            put_signed(out, media.file_size);
+            if (media.local_path) {
+                put_string(out, *media.local_path);
+            }
+            for (const auto& dimension : {media.width, media.height, media.duration}) {
+                if (dimension) {
+                    put_signed(out, *dimension);
+                }
+            }
+        }
+    }
+    return out;
+}
+
+void reserve(std::vector<Message>& out, std::size_t count) { out.reserve(out.size() + count); }
+void reserve(MessageBatch& out, std::size_t count) { out.reserve(out.size() + count); }
+
+void append(std::vector<Message>& out, const MessageView& msg) { out.push_back(msg.to_message()); }
+// The inflated page lives in the batch's arena, so its views are kept as they are
+void append(MessageBatch& out, const MessageView& msg) { out.adopt(msg); }
+
+// Parse an inflated page into @p out; the messages' strings view @p data
+template <typename Out>
+void deserialise(std::string_view data, int64_t chat_id, Out& out) {
+    PageReader reader(data);
+    if (reader.byte() != kPageVersion) {
+        throw DatabaseException("Unsupported message page version");
+    }
+    auto count = reader.varint();
+    reserve(out, std::min<uint64_t>(count, data.size()));
+
+    int64_t id = 0;
+    int64_t timestamp = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        MessageView msg;
+        id += reader.signed_varint();
+        timestamp += reader.signed_varint();
+        msg.id = id;
+        msg.chat_id = chat_id;
+        msg.timestamp = timestamp;
+        msg.sender_id = reader.signed_varint();
+
+        auto flags = reader.byte();
+        msg.is_outgoing = (flags & kOutgoing) != 0;
+        msg.text = reader.string();
+
+        if (flags & kHasMedia) {
+            MediaView media;
+            media.type = static_cast<MediaType>(reader.varint());
+            media.file_id = reader.string();
+            media.filename = reader.string();
+            media.mime_type = reader.string();
+            media.file_size = reader.signed_varint();
+            if (flags & kHasLocalPath) {
+                media.local_path = reader.string();
+            }
+            if (flags & kHasWidth) {
+                media.width = static_cast<int32_t>(reader.signed_varint());
+            }
+            if (flags & kHasHeight) {
+                media.height = static_cast<int32_t>(reader.signed_varint());
+            }
+            if (flags & kHasDuration) {
+                media.duration = static_cast<int32_t>(reader.signed_varint());
+            }
+            msg.media = media;
+        }
+        append(out, msg);
+    }
+}
+
+// Inflated size of a page (from its header) and where its compressed body starts
+std::pair<uint64_t, std::size_t> page_header(std::string_view page) {
+    PageReader header(page);
+    auto raw_size = header.varint();
+    if (raw_size > kMaxPageSize) {
+        throw DatabaseException("Corrupt message page: implausible size");
+    }
+    return {raw_size, header.position()};
+}
+
+// Inflate a page body into exactly @p raw_size bytes at @p raw
+void inflate_page(std::string_view body, std::string_view dictionary, char* raw, uint64_t raw_size) {
+    z_stream stream{};
+    if (inflateInit(&stream) != Z_OK) {
+        throw DatabaseException("Failed to initialise message page decompression");
+    }
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(body.data()));
+    stream.avail_in = static_cast<uInt>(body.size());
+    stream.next_out = reinterpret_cast<Bytef*>(raw);
+    stream.avail_out = static_cast<uInt>(raw_size);
+
+    int rc = inflate(&stream, Z_FINISH);
+    if (rc == Z_NEED_DICT) {
+        if (dictionary.empty() ||
+            inflateSetDictionary(
+                &stream, reinterpret_cast<const Bytef*>(dictionary.data()), static_cast<uInt>(dictionary.size())
+            ) != Z_OK) {
+            inflateEnd(&stream);
+            throw DatabaseException("Message page needs a different dictionary");
+        }
+        rc = inflate(&stream, Z_FINISH);
+    }
+    auto inflated = stream.total_out;
+    inflateEnd(&stream);
+    if (rc != Z_STREAM_END || inflated != raw_size) {
+        throw DatabaseException("Corrupt message page: failed to decompress");
+    }
+}
+
+}  // namespace
+
+std::string encode_message_page(const std::vector<Message>& messages, std::string_view dictionary) {
+    auto raw = serialise(messages);
+
+    z_stream stream{};
+    if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        throw DatabaseException("Failed to initialise message page compression");
+    }
+    if (!dictionary.empty() &&
+        deflateSetDictionary(
+            &stream, reinterpret_cast<const Bytef*>(dictionary.data()), static_cast<uInt>(dictionary.size())
+        ) != Z_OK) {
+        deflateEnd(&stream);
+        throw DatabaseException("Failed to set message page dictionary");
+    }
+
+    // Raw size first, so decoding inflates into one exact allocation
+    std::string page;
+    put_varint(page, raw.size());
+    auto header = page.size();
+    page.resize(header + deflateBound(&stream, static_cast<uLong>(raw.size())));
+
+    stream.next_in = reinterpret_cast<Bytef*>(raw.data());
+    stream.avail_in = static_cast<uInt>(raw.size());
+    stream.next_out = reinterpret_cast<Bytef*>(page.data() + header);
+    stream.avail_out = static_cast<uInt>(page.size() - header);
+    int rc = deflate(&stream, Z_FINISH);
+    auto written = stream.total_out;
+    deflateEnd(&stream);
+    if (rc != Z_STREAM_END) {
+        throw DatabaseException("Failed to compress message page");
+    }
+
+    page.resize(header + written);
+    return page;
+}
+
+void decode_message_page(
+    std::string_view page,
+    int64_t chat_id,
+    std::vector<Message>& out,
+    std::string_view dictionary
+) {
+    auto [raw_size, header_size] = page_header(page);
+    std::string raw(raw_size, '\0');
+    inflate_page(page.substr(header_size), dictionary, raw.data(), raw_size);
+    deserialise(raw, chat_id, out);
+}
+
+void decode_message_page(std::string_view page, int64_t chat_id, MessageBatch& out, std::string_view dictionary) {
+    auto [raw_size, header_size] = page_header(page);
+    auto* raw = out.allocate(raw_size);
+    inflate_page(page.substr(header_size), dictionary, raw, raw_size);
+    deserialise(std::string_view(raw, raw_size), chat_id, out);
+}
+
+std::string train_message_dictionary(const std::vector<Message>& samples, std::size_t max_size) {
+    std::unordered_map<std::string_view, std::size_t> counts;
+    auto add = [&](std::string_view token) {
+        if (token.size() >= kMinTokenLength && token.size() <= kMaxTokenLength) {
+            ++counts[token];
+        }
+    };
+
+    for (const auto& msg : samples) {
+        std::string_view text = msg.text;
+        std::size_t start = 0;
+        for (std::size_t i = 0; i <= text.size(); ++i) {
+            if (i == text.size() || text[i] == ' ' || text[i] == '\n') {
+                add(text.substr(start, i - start));
+                start = i + 1;
+            }
+        }
+        if (msg.media) {
+            add(msg.media->mime_type);
+            auto dot = msg.media->filename.rfind('.');
+            if (dot != std::string::npos) {
+                add(std::string_view(msg.media->filename).substr(dot));
+            }
+        }
+    }
+
+    // Bytes a token saves over the samples; once-only tokens save nothing
+    std::vector<std::pair<std::size_t, std::string_view>> scored;
+    for (const auto& [token, count] : counts) {
+        if (count > 1) {
+            scored.emplace_back(count * token.size(), token);
+        }
+    }
+    std::sort(scored.begin(), scored.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+
+    std::vector<std::string_view> chosen;
+    std::size_t size = 0;
+    for (const auto& [score, token] : scored) {
+        if (size + token.size() + 1 > max_size) {
+            continue;
+        }
+        chosen.push_back(token);
+        size += token.size() + 1;
+    }
+
+    // deflate reaches the end of the dictionary with the shortest distances
+    std::string dictionary;
+    dictionary.reserve(size);
+    for (auto it = chosen.rbegin(); it != chosen.rend(); ++it) {
+        dictionary.append(*it);
+        dictionary += ' ';
+    }
+    return dictionary;
+}
+
+}  // namespace tg
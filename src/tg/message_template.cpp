@@ -0,0 +1,122 @@
+#include "tg/message_template.hpp"
+
+#include "tg/formatters.hpp"
+
+#include <iterator>
+
+namespace tg {
+
+namespace {
+
+// Budget for the variable parts of a message, used to pre-size output buffers
+constexpr std::size_t kSenderEstimate = 24;
+constexpr std::size_t kTimeEstimate = 16;
+constexpr std::size_t kMediaEstimate = 32;
+
+std::string_view trim(std::string_view text) {
+    auto begin = text.find_first_not_of(" \t");
+    if (begin == std::string_view::npos) {
+        return {};
+    }
+    auto end = text.find_last_not_of(" \t");
+    return text.substr(begin, end - begin + 1);
+}
+
+}  // namespace
+
+std::optional<MessageTemplate> MessageTemplate::compile(std::string_view source) {
+    MessageTemplate tmpl;
+
+    while (!source.empty()) {
+        auto open = source.find("{{");
+        if (open == std::string_view::npos) {
+            tmpl.add_literal(source);
+            break;
+        }
+        tmpl.add_literal(source.substr(0, open));
+        source.remove_prefix(open);
+
+        // {{{name}}} is the unescaped form of {{name}}; we never escape, so both render alike
+        bool triple = source.starts_with("{{{");
+        std::string_view close_tag = triple ? "}}}" : "}}";
+        std::size_t open_size = triple ? 3 : 2;
+        auto close = source.find(close_tag, open_size);
+        if (close == std::string_view::npos) {
+            return std::nullopt;
+        }
+
+        auto name = trim(source.substr(open_size, close - open_size));
+        source.remove_prefix(close + close_tag.size());
+
+        if (!triple && name.starts_with('&')) {
+            name = trim(name.substr(1));
+        } else if (!name.empty() && std::string_view{"#^/>!=<$"}.find(name.front()) != std::string_view::npos) {
+            // Sections, partials, comments and delimiter changes need the full engine
+            return std::nullopt;
+        }
+
+        if (name == "sender") {
+            tmpl.segments_.push_back({Emitter::SENDER});
+            tmpl.fixed_size_ += kSenderEstimate;
+        } else if (name == "time") {
+            tmpl.segments_.push_back({Emitter::TIME});
+            tmpl.fixed_size_ += kTimeEstimate;
+        } else if (name == "message") {
+            tmpl.segments_.push_back({Emitter::MESSAGE});
+            tmpl.has_message_ = true;
+        }
+        // Anything else is a variable MessageInfo doesn't expose: renders empty
+    }
+
+    if (tmpl.has_message_) {
+        tmpl.fixed_size_ += kMediaEstimate;
+    }
+    return tmpl;
+}
+
+void MessageTemplate::add_literal(std::string_view text) {
+    if (text.empty()) {
+        return;
+    }
+    segments_.push_back({Emitter::LITERAL, literals_.size(), text.size()});
+    literals_.append(text);
+    fixed_size_ += text.size();
+}
+
+void MessageTemplate::render_to(std::string& out, const MessageInfo& info) const { render(out, info, nullptr); }
+
+void MessageTemplate::render_to(std::string& out, const MessageInfo& info, std::string_view sender_name) const {
+    render(out, info, &sender_name);
+}
+
+std::string MessageTemplate::sender_name(const User& user) { return fmt::format("{:d}", user); }
+
+void MessageTemplate::render(std::string& out, const MessageInfo& info, const std::string_view* sender_name) const {
+    auto it = std::back_inserter(out);
+    for (const auto& segment : segments_) {
+        switch (segment.emitter) {
+            case Emitter::LITERAL:
+                out.append(literals_, segment.offset, segment.size);
+                break;
+            case Emitter::SENDER:
+                if (sender_name && !info.message.is_outgoing) {
+                    out.append(*sender_name);
+                } else {
+                    fmt::format_to(it, "{:s}", info);
+                }
+                break;
+            case Emitter::TIME:
+                fmt::format_to(it, "{:t}", info);
+                break;
+            case Emitter::MESSAGE:
+                fmt::format_to(it, "{:m}", info);
+                break;
+        }
+    }
+}
+
+std::size_t MessageTemplate::estimate_size(const MessageView& message) const {
+    return fixed_size_ + (has_message_ ? message.text.size() : 0);
+}
+
+}  // namespace tg
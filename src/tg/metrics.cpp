@@ -0,0 +1,236 @@
+#include "tg/metrics.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace tg {
+
+namespace {
+
+constexpr std::string_view kPrometheusPrefix = "tgfuse_";
+
+// Escape a label value for JSON strings and Prometheus label values (same rules for what we emit)
+std::string escape(std::string_view text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text) {
+        switch (c) {
+            case '"':
+                escaped += "\\\"";
+                break;
+            case '\\':
+                escaped += "\\\\";
+                break;
+            case '\n':
+                escaped += "\\n";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) >= 0x20) {
+                    escaped += c;
+                }
+        }
+    }
+    return escaped;
+}
+
+// {label="value"} (with @p extra appended inside), or just {extra} / nothing
+std::string prometheus_labels(const MetricKey& key, std::string_view extra = {}) {
+    if (key.label.empty() && extra.empty()) {
+        return {};
+    }
+    std::string labels = "{";
+    if (!key.label.empty()) {
+        labels += fmt::format("{}=\"{}\"", key.label, escape(key.value));
+    }
+    if (!extra.empty()) {
+        if (!key.label.empty()) {
+            labels += ',';
+        }
+        labels += extra;
+    }
+    labels += '}';
+    return labels;
+}
+
+// "name":..., "labels":{...} members shared by every JSON metric object
+std::string json_key(const MetricKey& key) {
+    auto json = fmt::format("\"name\":\"{}\",\"labels\":{{", escape(key.name));
+    if (!key.label.empty()) {
+        json += fmt::format("\"{}\":\"{}\"", escape(key.label), escape(key.value));
+    }
+    json += '}';
+    return json;
+}
+
+double to_seconds(uint64_t us) { return static_cast<double>(us) / 1e6; }
+
+// Values of one metric family, sorted so each family's samples are together
+template <typename Entries>
+Entries sorted_by_key(Entries entries) {
+    std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return a.key < b.key; });
+    return entries;
+}
+
+}  // namespace
+
+std::size_t detail::metric_shard() {
+    static std::atomic<std::size_t> next_shard{0};
+    thread_local std::size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+    return shard;
+}
+
+uint64_t HistogramSnapshot::quantile_us(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    auto target = static_cast<uint64_t>(std::ceil(q * static_cast<double>(count)));
+    target = std::clamp<uint64_t>(target, 1, count);
+
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < kLatencyBuckets; ++i) {
+        seen += buckets[i];
+        if (seen >= target) {
+            return bucket_bound_us(i);
+        }
+    }
+    return bucket_bound_us(kLatencyBuckets - 1);
+}
+
+void LatencyHistogram::record(Clock::duration elapsed) {
+    auto us = static_cast<uint64_t>(
+        std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count())
+    );
+    auto bucket = std::min<std::size_t>(std::bit_width(us), kLatencyBuckets - 1);
+
+    auto& shard = shards_[detail::metric_shard()];
+    shard.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    shard.sum_us.fetch_add(us, std::memory_order_relaxed);
+}
+
+HistogramSnapshot LatencyHistogram::snapshot() const {
+    HistogramSnapshot snapshot;
+    for (const auto& shard : shards_) {
+        for (std::size_t i = 0; i < kLatencyBuckets; ++i) {
+            snapshot.buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+        }
+        snapshot.sum_us += shard.sum_us.load(std::memory_order_relaxed);
+    }
+    for (auto n : snapshot.buckets) {
+        snapshot.count += n;
+    }
+    return snapshot;
+}
+
+uint64_t Counter::value() const {
+    uint64_t total = 0;
+    for (const auto& shard : shards_) {
+        total += shard.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+std::string MetricsSnapshot::to_json() const {
+    std::string json = "{\"histograms\":[";
+    for (std::size_t i = 0; i < histograms.size(); ++i) {
+        const auto& [key, data] = histograms[i];
+        json += fmt::format(
+            "{}{{{},\"count\":{},\"sum_seconds\":{},\"p50_seconds\":{},\"p90_seconds\":{},\"p99_seconds\":{}}}",
+            i > 0 ? "," : "",
+            json_key(key),
+            data.count,
+            to_seconds(data.sum_us),
+            to_seconds(data.quantile_us(0.5)),
+            to_seconds(data.quantile_us(0.9)),
+            to_seconds(data.quantile_us(0.99))
+        );
+    }
+
+    auto values = [&json](std::string_view name, const std::vector<Value>& entries) {
+        json += fmt::format("],\"{}\":[", name);
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            json += fmt::format("{}{{{},\"value\":{}}}", i > 0 ? "," : "", json_key(entries[i].key), entries[i].value);
+        }
+    };
+    values("counters", counters);
+    values("gauges", gauges);
+    json += "]}\n";
+    return json;
+}
+
+std::string MetricsSnapshot::to_prometheus() const {
+    std::string text;
+    std::string family;  // Family of the last sample, to emit each TYPE line once
+
+    for (const auto& [key, data] : sorted_by_key(histograms)) {
+        if (key.name != family) {
+            family = key.name;
+            text += fmt::format("# TYPE {}{} histogram\n", kPrometheusPrefix, key.name);
+        }
+        uint64_t cumulative = 0;
+        for (std::size_t i = 0; i < kLatencyBuckets; ++i) {
+            cumulative += data.buckets[i];
+            auto le = i + 1 < kLatencyBuckets ? fmt::format("le=\"{}\"", to_seconds(data.bucket_bound_us(i)))
+                                              : std::string("le=\"+Inf\"");
+            auto labels = prometheus_labels(key, le);
+            text += fmt::format("{}{}_bucket{} {}\n", kPrometheusPrefix, key.name, labels, cumulative);
+        }
+        auto labels = prometheus_labels(key);
+        text += fmt::format("{}{}_sum{} {}\n", kPrometheusPrefix, key.name, labels, to_seconds(data.sum_us));
+        text += fmt::format("{}{}_count{} {}\n", kPrometheusPrefix, key.name, labels, data.count);
+    }
+
+    auto values = [&text, &family](std::string_view type, const std::vector<Value>& entries) {
+        for (const auto& [key, value] : sorted_by_key(entries)) {
+            if (key.name != family) {
+                family = key.name;
+                text += fmt::format("# TYPE {}{} {}\n", kPrometheusPrefix, key.name, type);
+            }
+            text += fmt::format("{}{}{} {}\n", kPrometheusPrefix, key.name, prometheus_labels(key), value);
+        }
+    };
+    values("counter", counters);
+    values("gauge", gauges);
+    return text;
+}
+
+Metrics& Metrics::global() {
+    static Metrics metrics;
+    return metrics;
+}
+
+LatencyHistogram& Metrics::histogram(const MetricKey& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& histogram = histograms_[key];
+    if (!histogram) {
+        histogram = std::make_unique<LatencyHistogram>();
+    }
+    return *histogram;
+}
+
+Counter& Metrics::counter(const MetricKey& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& counter = counters_[key];
+    if (!counter) {
+        counter = std::make_unique<Counter>();
+    }
+    return *counter;
+}
+
+MetricsSnapshot Metrics::snapshot() const {
+    MetricsSnapshot snapshot;
+    std::lock_guard<std::mutex> lock(mutex_);
+    snapshot.histograms.reserve(histograms_.size());
+    for (const auto& [key, histogram] : histograms_) {
+        snapshot.histograms.push_back({key, histogram->snapshot()});
+    }
+    snapshot.counters.reserve(counters_.size());
+    for (const auto& [key, counter] : counters_) {
+        snapshot.counters.push_back({key, static_cast<double>(counter->value())});
+    }
+    return snapshot;
+}
+
+}  // namespace tg
@@ -2,46 +2,182 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <cctype>
+
 namespace tg {
 
+namespace {
+
+// Requests from threads that never set a priority (FUSE workers) are interactive
+thread_local RequestPriority t_request_priority = RequestPriority::INTERACTIVE;
+
+}  // namespace
+
 RateLimiter::RateLimiter(Config config)
-    : config_(std::move(config)), last_request_(std::chrono::steady_clock::now() - config_.min_interval) {}
+    : config_(std::move(config)),
+      rate_(config_.requests_per_second),
+      tokens_(static_cast<double>(config_.burst)),
+      last_refill_(Clock::now()),
+      paused_until_(last_refill_) {}
 
-void RateLimiter::acquire() {
+void RateLimiter::acquire(Priority priority) {
     std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        auto wait_time = reserve_locked(priority);
+        if (wait_time == Clock::duration::zero()) {
+            return;
+        }
 
-    auto now = std::chrono::steady_clock::now();
-    auto elapsed = now - last_request_;
-
-    if (elapsed < config_.min_interval) {
-        auto wait_time = config_.min_interval - elapsed;
         spdlog::debug(
             "RateLimiter: waiting {}ms before next request",
             std::chrono::duration_cast<std::chrono::milliseconds>(wait_time).count()
         );
         cv_.wait_for(lock, wait_time);
     }
-
-    last_request_ = std::chrono::steady_clock::now();
 }
 
-bool RateLimiter::try_acquire() {
+bool RateLimiter::try_acquire(Priority priority) { return reserve(priority) == Clock::duration::zero(); }
+
+RateLimiter::Clock::duration RateLimiter::reserve(Priority priority) {
     std::lock_guard<std::mutex> lock(mutex_);
+    return reserve_locked(priority);
+}
 
-    auto now = std::chrono::steady_clock::now();
-    auto elapsed = now - last_request_;
+RateLimiter::Clock::duration RateLimiter::reserve_locked(Priority priority) {
+    auto lane = static_cast<std::size_t>(priority);
 
-    if (elapsed < config_.min_interval) {
-        return false;
+    auto now = Clock::now();
+    refill(now);
+    if (now < paused_until_) {
+        ++stats_.delayed[lane];
+        stats_.waited[lane] += std::chrono::duration_cast<std::chrono::microseconds>(paused_until_ - now);
+        return paused_until_ - now;
     }
 
-    last_request_ = now;
-    return true;
+    double needed = 1.0 + reserve_for(priority);
+    if (tokens_ >= needed) {
+        tokens_ -= 1.0;
+        ++stats_.granted[lane];
+        return Clock::duration::zero();
+    }
+
+    ++stats_.delayed[lane];
+    auto wait = std::max<Clock::duration>(
+        std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>((needed - tokens_) / rate_)),
+        std::chrono::milliseconds(1)
+    );
+    // Callers wait this long before asking again, so the sum is the time spent held back
+    stats_.waited[lane] += std::chrono::duration_cast<std::chrono::microseconds>(wait);
+    return wait;
 }
 
-void RateLimiter::set_config(Config config) {
+void RateLimiter::report_flood_wait(std::chrono::seconds retry_after) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = Clock::now();
+        refill(now);
+        paused_until_ = std::max(paused_until_, now + retry_after);
+        rate_ = std::max(config_.requests_per_second * config_.min_rate_fraction, rate_ / 2.0);
+        tokens_ = 0.0;
+        ++stats_.flood_waits;
+        spdlog::warn(
+            "RateLimiter: FLOOD_WAIT for {}s, backing off to {:.1f} requests/s", retry_after.count(), rate_
+        );
+    }
+    cv_.notify_all();
+}
+
+RateLimiter::Clock::duration RateLimiter::paused_for() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = Clock::now();
+    return now < paused_until_ ? paused_until_ - now : Clock::duration::zero();
+}
+
+RateLimiterStats RateLimiter::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto stats = stats_;
+    stats.current_rate = rate_;
+    stats.tokens = tokens_;
+    auto now = Clock::now();
+    if (now < paused_until_) {
+        stats.paused_for = std::chrono::duration_cast<std::chrono::milliseconds>(paused_until_ - now);
+    }
+    return stats;
+}
+
+RateLimiter::Config RateLimiter::get_config() const {
     std::lock_guard<std::mutex> lock(mutex_);
-    config_ = std::move(config);
+    return config_;
+}
+
+void RateLimiter::set_config(Config config) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        config_ = std::move(config);
+        rate_ = std::min(rate_, config_.requests_per_second);
+        tokens_ = std::min(tokens_, static_cast<double>(config_.burst));
+    }
+    cv_.notify_all();
 }
 
+void RateLimiter::refill(Clock::time_point now) {
+    auto from = std::max(last_refill_, paused_until_);
+    if (now > from) {
+        double seconds = std::chrono::duration<double>(now - from).count();
+
+        // Linear recovery towards the configured rate after a back-off
+        double recovery = static_cast<double>(config_.recovery_period.count());
+        double step = recovery > 0.0 ? config_.requests_per_second * seconds / recovery : config_.requests_per_second;
+        rate_ = std::min(config_.requests_per_second, rate_ + step);
+        tokens_ = std::min(static_cast<double>(config_.burst), tokens_ + rate_ * seconds);
+    }
+    last_refill_ = std::max(last_refill_, now);
+}
+
+double RateLimiter::reserve_for(Priority priority) const {
+    // A reserve can't take the whole bucket, or the lane would never run
+    auto cap = config_.burst > 0 ? config_.burst - 1 : 0;
+    switch (priority) {
+        case Priority::INTERACTIVE:
+            return 0.0;
+        case Priority::UPLOAD:
+            return static_cast<double>(std::min(config_.upload_reserve, cap));
+        case Priority::BACKGROUND:
+            return static_cast<double>(std::min(config_.background_reserve, cap));
+    }
+    return 0.0;
+}
+
+std::optional<std::chrono::seconds> parse_retry_after(std::string_view message) {
+    static constexpr std::string_view kMarkers[] = {"FLOOD_WAIT_", "retry after "};
+
+    for (auto marker : kMarkers) {
+        auto pos = message.find(marker);
+        if (pos == std::string_view::npos) {
+            continue;
+        }
+
+        long long seconds = 0;
+        bool any = false;
+        for (auto i = pos + marker.size(); i < message.size() && std::isdigit(static_cast<unsigned char>(message[i]));
+             ++i) {
+            seconds = seconds * 10 + (message[i] - '0');
+            any = true;
+        }
+        if (any) {
+            return std::chrono::seconds(seconds);
+        }
+    }
+    return std::nullopt;
+}
+
+RequestPriority current_request_priority() { return t_request_priority; }
+
+RequestPriorityScope::RequestPriorityScope(RequestPriority priority) : previous_(t_request_priority) {
+    t_request_priority = priority;
+}
+
+RequestPriorityScope::~RequestPriorityScope() { t_request_priority = previous_; }
+
 }  // namespace tg
@@ -0,0 +1,91 @@
+#include "tg/sha256.hpp"
+
+#include <openssl/evp.h>
+
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace tg {
+
+namespace {
+
+constexpr std::size_t kFileChunkSize = 1024 * 1024;
+
+EVP_MD_CTX* new_context() {
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    if (!ctx || EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) != 1) {
+        EVP_MD_CTX_free(ctx);
+        throw std::runtime_error("Failed to initialise SHA-256 context");
+    }
+    return ctx;
+}
+
+}  // namespace
+
+struct Sha256::State {
+    EVP_MD_CTX* ctx{new_context()};
+
+    ~State() { EVP_MD_CTX_free(ctx); }
+};
+
+Sha256::Sha256() : state_(std::make_unique<State>()) {}
+
+Sha256::~Sha256() = default;
+
+Sha256::Sha256(Sha256&&) noexcept = default;
+
+Sha256& Sha256::operator=(Sha256&&) noexcept = default;
+
+void Sha256::update(const void* data, std::size_t size) {
+    if (!state_) {
+        state_ = std::make_unique<State>();  // Moved-from: start afresh
+    }
+    if (EVP_DigestUpdate(state_->ctx, data, size) != 1) {
+        throw std::runtime_error("SHA-256 update failed");
+    }
+    size_ += size;
+}
+
+std::string Sha256::finish() {
+    if (!state_) {
+        state_ = std::make_unique<State>();
+    }
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    if (EVP_DigestFinal_ex(state_->ctx, digest, &length) != 1 ||
+        EVP_DigestInit_ex(state_->ctx, EVP_sha256(), nullptr) != 1) {
+        throw std::runtime_error("SHA-256 finalisation failed");
+    }
+    size_ = 0;
+
+    static constexpr char kHex[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(length * 2);
+    for (unsigned int i = 0; i < length; ++i) {
+        hex += kHex[digest[i] >> 4];
+        hex += kHex[digest[i] & 0x0f];
+    }
+    return hex;
+}
+
+std::optional<std::string> Sha256::hash_file(const std::string& path) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) {
+        return std::nullopt;
+    }
+
+    Sha256 hasher;
+    std::vector<char> buffer(kFileChunkSize);
+    while (ifs) {
+        ifs.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        hasher.update(buffer.data(), static_cast<std::size_t>(ifs.gcount()));
+    }
+    if (ifs.bad()) {
+        return std::nullopt;
+    }
+    return hasher.finish();
+}
+
+}  // namespace tg
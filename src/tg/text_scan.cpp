@@ -0,0 +1,770 @@
+#include "tg/text_scan.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TG_TEXT_X86 1
+#include <immintrin.h>
+#define TG_TARGET_SSE42 __attribute__((target("sse4.2,popcnt")))
+#define TG_TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#elif defined(__aarch64__)
+#define TG_TEXT_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace tg {
+
+namespace {
+
+constexpr std::size_t kFileChunkSize = 1024 * 1024;
+
+/// What a kernel found in a buffer that ends on a sequence boundary
+struct KernelCounts {
+    std::size_t control_chars{0};
+    std::size_t nul_chars{0};
+    bool valid_utf8{true};
+};
+
+struct Kernels {
+    void (*scan)(const unsigned char* data, std::size_t size, KernelCounts& out);
+    std::size_t (*last_newline)(const char* data, std::size_t size);
+    std::size_t (*last_whitespace)(const char* data, std::size_t size);
+};
+
+constexpr bool is_control(unsigned char c) { return c < 0x20 && c != '\t' && c != '\n' && c != '\r'; }
+
+constexpr bool is_whitespace(char c) { return c == ' ' || c == '\n' || c == '\t'; }
+
+constexpr bool is_continuation(unsigned char c) { return (c & 0xC0) == 0x80; }
+
+/// Bytes at the end of @p data that start a sequence it stops in the middle of
+/// A malformed tail isn't one: it's left for validation to reject.
+std::size_t incomplete_tail(const unsigned char* data, std::size_t size) {
+    for (std::size_t back = 1; back <= 3 && back <= size; ++back) {
+        unsigned char c = data[size - back];
+        if (is_continuation(c)) {
+            continue;
+        }
+        if (c < 0xC2 || c > 0xF4) {
+            return 0;  // ASCII, or not a lead byte at all
+        }
+        std::size_t length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+        return length > back ? back : 0;
+    }
+    return 0;
+}
+
+// Scalar kernel: words of ASCII without control characters are skipped
+// eight bytes at a time, everything else is checked byte by byte
+
+namespace scalar {
+
+constexpr uint64_t kHighBits = 0x8080808080808080ULL;
+constexpr uint64_t kSpaces = 0x2020202020202020ULL;
+
+/// Whether any byte of an all-ASCII @p word is below 0x20
+constexpr bool has_low_byte(uint64_t word) { return ((word - kSpaces) & ~word & kHighBits) != 0; }
+
+/// Length of the well-formed sequence at data[0], or 0 if it's malformed or cut off
+std::size_t sequence_length(const unsigned char* data, std::size_t size) {
+    unsigned char c = data[0];
+    std::size_t length;
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;  // Range of the second byte; later ones are always 80..BF
+    if (c < 0xC2) {
+        return 0;
+    } else if (c < 0xE0) {
+        length = 2;
+    } else if (c < 0xF0) {
+        length = 3;
+        low = c == 0xE0 ? 0xA0 : 0x80;  // Overlong
+        high = c == 0xED ? 0x9F : 0xBF;  // Surrogates
+    } else if (c < 0xF5) {
+        length = 4;
+        low = c == 0xF0 ? 0x90 : 0x80;   // Overlong
+        high = c == 0xF4 ? 0x8F : 0xBF;  // Past U+10FFFF
+    } else {
+        return 0;
+    }
+
+    if (length > size || data[1] < low || data[1] > high) {
+        return 0;
+    }
+    for (std::size_t i = 2; i < length; ++i) {
+        if (!is_continuation(data[i])) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+void scan(const unsigned char* data, std::size_t size, KernelCounts& out) {
+    std::size_t i = 0;
+    while (i < size) {
+        if (i + 8 <= size) {
+            uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            if ((word & kHighBits) == 0 && !has_low_byte(word)) {
+                i += 8;
+                continue;
+            }
+        }
+
+        unsigned char c = data[i];
+        if (c < 0x80) {
+            out.control_chars += is_control(c) ? 1 : 0;
+            out.nul_chars += c == 0 ? 1 : 0;
+            ++i;
+            continue;
+        }
+        auto length = out.valid_utf8 ? sequence_length(data + i, size - i) : 0;
+        if (length == 0) {
+            out.valid_utf8 = false;
+            length = 1;  // Keep counting past it
+        }
+        i += length;
+    }
+}
+
+template <bool kWhitespace>
+std::size_t last_of(const char* data, std::size_t size) {
+    for (std::size_t i = size; i > 0; --i) {
+        if (kWhitespace ? is_whitespace(data[i - 1]) : data[i - 1] == '\n') {
+            return i - 1;
+        }
+    }
+    return std::string_view::npos;
+}
+
+constexpr Kernels kKernels{scan, last_of<false>, last_of<true>};
+
+}  // namespace scalar
+
+// UTF-8 validation after Keiser and Lemire, "Validating UTF-8 in less than
+// one instruction per byte" (2021). Each byte is classified by three table
+// lookups (the high and low nibble of the byte before it and the high nibble
+// of the byte itself); ANDed together the tables leave a bit for every error
+// of a two byte window. Three and four byte sequences are checked by which
+// bytes must be continuations, from the bytes two and three back.
+
+namespace utf8 {
+
+constexpr uint8_t TOO_SHORT = 1 << 0;       // 11______ 0_______ or 11______ 11______
+constexpr uint8_t TOO_LONG = 1 << 1;        // 0_______ 10______
+constexpr uint8_t OVERLONG_3 = 1 << 2;      // 11100000 100_____
+constexpr uint8_t TOO_LARGE = 1 << 3;       // 11110100 1001____ (and above)
+constexpr uint8_t SURROGATE = 1 << 4;       // 11101101 101_____
+constexpr uint8_t OVERLONG_2 = 1 << 5;      // 1100000_ 10______
+constexpr uint8_t TOO_LARGE_1000 = 1 << 6;  // 11110101 1000____ (and above)
+constexpr uint8_t OVERLONG_4 = 1 << 6;      // 11110000 1000____
+constexpr uint8_t TWO_CONTS = 1 << 7;       // 10______ 10______ (an error unless a 3/4 byte sequence)
+constexpr uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+alignas(16) constexpr uint8_t kByte1High[16] = {
+    // 0_______: ASCII
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    // 10______: continuation
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    // 1100____, 1101____: two byte lead
+    TOO_SHORT | OVERLONG_2, TOO_SHORT,
+    // 1110____: three byte lead
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    // 1111____: four byte lead
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+alignas(16) constexpr uint8_t kByte1Low[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,    // ____0000
+    CARRY | OVERLONG_2,                              // ____0001
+    CARRY,                                           // ____0010
+    CARRY,                                           // ____0011
+    CARRY | TOO_LARGE,                               // ____0100
+    CARRY | TOO_LARGE | TOO_LARGE_1000,              // ____0101
+    CARRY | TOO_LARGE | TOO_LARGE_1000,              // ____0110
+    CARRY | TOO_LARGE | TOO_LARGE_1000,              // ____0111
+    CARRY | TOO_LARGE | TOO_LARGE_1000,              // ____1000
+    CARRY | TOO_LARGE | TOO_LARGE_1000,              // ____1001
+    CARRY | TOO_LARGE | TOO_LARGE_1000,              // ____1010
+    CARRY | TOO_LARGE | TOO_LARGE_1000,              // ____1011
+    CARRY | TOO_LARGE | TOO_LARGE_1000,              // ____1100
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,  // ____1101
+    CARRY | TOO_LARGE | TOO_LARGE_1000,              // ____1110
+    CARRY | TOO_LARGE | TOO_LARGE_1000,              // ____1111
+};
+
+alignas(16) constexpr uint8_t kByte2High[16] = {
+    // 0_______: ASCII
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    // 1000____
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    // 1001____
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    // 101_____
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    // 11______: lead
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+
+/// Bytes above these in the last three positions of a block start a sequence that continues in the next one
+alignas(32) constexpr uint8_t kIncompleteMax[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF,
+};
+
+}  // namespace utf8
+
+#if TG_TEXT_X86
+
+namespace sse42 {
+
+/// Validation state carried from one 16-byte block to the next
+struct State {
+    __m128i byte_1_high;
+    __m128i byte_1_low;
+    __m128i byte_2_high;
+    __m128i incomplete_max;
+    __m128i prev_input;
+    __m128i prev_incomplete;
+    __m128i error;
+};
+
+template <int N>
+TG_TARGET_SSE42 inline __m128i prev(__m128i input, __m128i prev_input) {
+    return _mm_alignr_epi8(input, prev_input, 16 - N);
+}
+
+TG_TARGET_SSE42 inline __m128i high_nibbles(__m128i v) {
+    return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+}
+
+TG_TARGET_SSE42 inline void block(State& state, __m128i input, KernelCounts& out) {
+    auto below_space = _mm_cmpeq_epi8(_mm_min_epu8(input, _mm_set1_epi8(0x1F)), input);
+    auto blank = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(input, _mm_set1_epi8('\t')), _mm_cmpeq_epi8(input, _mm_set1_epi8('\n'))),
+        _mm_cmpeq_epi8(input, _mm_set1_epi8('\r'))
+    );
+    if (auto controls = _mm_movemask_epi8(_mm_andnot_si128(blank, below_space)); controls != 0) {
+        out.control_chars += static_cast<std::size_t>(__builtin_popcount(static_cast<unsigned>(controls)));
+        auto nuls = _mm_movemask_epi8(_mm_cmpeq_epi8(input, _mm_setzero_si128()));
+        out.nul_chars += static_cast<std::size_t>(__builtin_popcount(static_cast<unsigned>(nuls)));
+    }
+
+    if (_mm_movemask_epi8(input) == 0) {
+        state.error = _mm_or_si128(state.error, state.prev_incomplete);  // ASCII can't finish a sequence
+    } else {
+        auto prev1 = prev<1>(input, state.prev_input);
+        auto special = _mm_and_si128(
+            _mm_and_si128(
+                _mm_shuffle_epi8(state.byte_1_high, high_nibbles(prev1)),
+                _mm_shuffle_epi8(state.byte_1_low, _mm_and_si128(prev1, _mm_set1_epi8(0x0F)))
+            ),
+            _mm_shuffle_epi8(state.byte_2_high, high_nibbles(input))
+        );
+        auto third = _mm_subs_epu8(prev<2>(input, state.prev_input), _mm_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+        auto fourth = _mm_subs_epu8(prev<3>(input, state.prev_input), _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+        auto must_continue = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(static_cast<char>(0x80)));
+        state.error = _mm_or_si128(state.error, _mm_xor_si128(must_continue, special));
+        state.prev_incomplete = _mm_subs_epu8(input, state.incomplete_max);
+    }
+    state.prev_input = input;
+}
+
+TG_TARGET_SSE42 inline __m128i load_table(const uint8_t* table) {
+    return _mm_load_si128(reinterpret_cast<const __m128i*>(table));
+}
+
+TG_TARGET_SSE42 void scan(const unsigned char* data, std::size_t size, KernelCounts& out) {
+    State state{
+        load_table(utf8::kByte1High),
+        load_table(utf8::kByte1Low),
+        load_table(utf8::kByte2High),
+        load_table(utf8::kIncompleteMax + 16),
+        _mm_setzero_si128(),
+        _mm_setzero_si128(),
+        _mm_setzero_si128(),
+    };
+
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        block(state, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), out);
+    }
+    // The rest padded with spaces, which also catches a sequence cut off at the end
+    alignas(16) unsigned char last[16];
+    std::memset(last, ' ', sizeof(last));
+    if (size > i) {
+        std::memcpy(last, data + i, size - i);
+    }
+    block(state, _mm_load_si128(reinterpret_cast<const __m128i*>(last)), out);
+
+    out.valid_utf8 = out.valid_utf8 && _mm_testz_si128(state.error, state.error);
+}
+
+template <bool kWhitespace>
+TG_TARGET_SSE42 std::size_t last_of(const char* data, std::size_t size) {
+    std::size_t i = size;
+    while (i >= 16) {
+        i -= 16;
+        auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        auto match = _mm_cmpeq_epi8(input, _mm_set1_epi8('\n'));
+        if constexpr (kWhitespace) {
+            match = _mm_or_si128(
+                match,
+                _mm_or_si128(_mm_cmpeq_epi8(input, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(input, _mm_set1_epi8('\t')))
+            );
+        }
+        if (auto mask = static_cast<unsigned>(_mm_movemask_epi8(match)); mask != 0) {
+            return i + 31 - static_cast<std::size_t>(__builtin_clz(mask));
+        }
+    }
+    return scalar::last_of<kWhitespace>(data, i);
+}
+
+constexpr Kernels kKernels{scan, last_of<false>, last_of<true>};
+
+}  // namespace sse42
+
+namespace avx2 {
+
+/// Validation state carried from one 32-byte block to the next
+struct State {
+    __m256i byte_1_high;
+    __m256i byte_1_low;
+    __m256i byte_2_high;
+    __m256i incomplete_max;
+    __m256i prev_input;
+    __m256i prev_incomplete;
+    __m256i error;
+};
+
+/// @p input shifted by N bytes, the first N taken from the end of @p prev_input
+template <int N>
+TG_TARGET_AVX2 inline __m256i prev(__m256i input, __m256i prev_input) {
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev_input, input, 0x21), 16 - N);
+}
+
+TG_TARGET_AVX2 inline __m256i high_nibbles(__m256i v) {
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+TG_TARGET_AVX2 inline void block(State& state, __m256i input, KernelCounts& out) {
+    auto below_space = _mm256_cmpeq_epi8(_mm256_min_epu8(input, _mm256_set1_epi8(0x1F)), input);
+    auto blank = _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_cmpeq_epi8(input, _mm256_set1_epi8('\t')), _mm256_cmpeq_epi8(input, _mm256_set1_epi8('\n'))
+        ),
+        _mm256_cmpeq_epi8(input, _mm256_set1_epi8('\r'))
+    );
+    if (auto controls = _mm256_movemask_epi8(_mm256_andnot_si256(blank, below_space)); controls != 0) {
+        out.control_chars += static_cast<std::size_t>(__builtin_popcount(static_cast<unsigned>(controls)));
+        auto nuls = _mm256_movemask_epi8(_mm256_cmpeq_epi8(input, _mm256_setzero_si256()));
+        out.nul_chars += static_cast<std::size_t>(__builtin_popcount(static_cast<unsigned>(nuls)));
+    }
+
+    if (_mm256_movemask_epi8(input) == 0) {
+        state.error = _mm256_or_si256(state.error, state.prev_incomplete);  // ASCII can't finish a sequence
+    } else {
+        auto prev1 = prev<1>(input, state.prev_input);
+        auto special = _mm256_and_si256(
+            _mm256_and_si256(
+                _mm256_shuffle_epi8(state.byte_1_high, high_nibbles(prev1)),
+                _mm256_shuffle_epi8(state.byte_1_low, _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)))
+            ),
+            _mm256_shuffle_epi8(state.byte_2_high, high_nibbles(input))
+        );
+        auto third = _mm256_subs_epu8(
+            prev<2>(input, state.prev_input), _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80))
+        );
+        auto fourth = _mm256_subs_epu8(
+            prev<3>(input, state.prev_input), _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80))
+        );
+        auto must_continue =
+            _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+        state.error = _mm256_or_si256(state.error, _mm256_xor_si256(must_continue, special));
+        state.prev_incomplete = _mm256_subs_epu8(input, state.incomplete_max);
+    }
+    state.prev_input = input;
+}
+
+/// A 16-byte lookup table in both lanes
+TG_TARGET_AVX2 inline __m256i load_table(const uint8_t* table) {
+    return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(table)));
+}
+
+TG_TARGET_AVX2 void scan(const unsigned char* data, std::size_t size, KernelCounts& out) {
+    State state{
+        load_table(utf8::kByte1High),
+        load_table(utf8::kByte1Low),
+        load_table(utf8::kByte2High),
+        _mm256_load_si256(reinterpret_cast<const __m256i*>(utf8::kIncompleteMax)),
+        _mm256_setzero_si256(),
+        _mm256_setzero_si256(),
+        _mm256_setzero_si256(),
+    };
+
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        block(state, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), out);
+    }
+    // The rest padded with spaces, which also catches a sequence cut off at the end
+    alignas(32) unsigned char last[32];
+    std::memset(last, ' ', sizeof(last));
+    if (size > i) {
+        std::memcpy(last, data + i, size - i);
+    }
+    block(state, _mm256_load_si256(reinterpret_cast<const __m256i*>(last)), out);
+
+    out.valid_utf8 = out.valid_utf8 && _mm256_testz_si256(state.error, state.error);
+}
+
+template <bool kWhitespace>
+TG_TARGET_AVX2 std::size_t last_of(const char* data, std::size_t size) {
+    std::size_t i = size;
+    while (i >= 32) {
+        i -= 32;
+        auto input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        auto match = _mm256_cmpeq_epi8(input, _mm256_set1_epi8('\n'));
+        if constexpr (kWhitespace) {
+            match = _mm256_or_si256(
+                match,
+                _mm256_or_si256(
+                    _mm256_cmpeq_epi8(input, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(input, _mm256_set1_epi8('\t'))
+                )
+            );
+        }
+        if (auto mask = static_cast<unsigned>(_mm256_movemask_epi8(match)); mask != 0) {
+            return i + 31 - static_cast<std::size_t>(__builtin_clz(mask));
+        }
+    }
+    return scalar::last_of<kWhitespace>(data, i);
+}
+
+constexpr Kernels kKernels{scan, last_of<false>, last_of<true>};
+
+}  // namespace avx2
+
+#endif  // TG_TEXT_X86
+
+#if TG_TEXT_NEON
+
+namespace neon {
+
+/// Validation state carried from one 16-byte block to the next
+struct State {
+    uint8x16_t byte_1_high;
+    uint8x16_t byte_1_low;
+    uint8x16_t byte_2_high;
+    uint8x16_t incomplete_max;
+    uint8x16_t prev_input;
+    uint8x16_t prev_incomplete;
+    uint8x16_t error;
+};
+
+template <int N>
+inline uint8x16_t prev(uint8x16_t input, uint8x16_t prev_input) {
+    return vextq_u8(prev_input, input, 16 - N);
+}
+
+/// Number of set lanes of a comparison result
+inline std::size_t count(uint8x16_t mask) { return vaddvq_u8(vshrq_n_u8(mask, 7)); }
+
+inline void block(State& state, uint8x16_t input, KernelCounts& out) {
+    auto below_space = vcltq_u8(input, vdupq_n_u8(0x20));
+    auto blank = vorrq_u8(
+        vorrq_u8(vceqq_u8(input, vdupq_n_u8('\t')), vceqq_u8(input, vdupq_n_u8('\n'))),
+        vceqq_u8(input, vdupq_n_u8('\r'))
+    );
+    if (auto controls = vbicq_u8(below_space, blank); vmaxvq_u8(controls) != 0) {
+        out.control_chars += count(controls);
+        out.nul_chars += count(vceqzq_u8(input));
+    }
+
+    if (vmaxvq_u8(input) < 0x80) {
+        state.error = vorrq_u8(state.error, state.prev_incomplete);  // ASCII can't finish a sequence
+    } else {
+        auto prev1 = prev<1>(input, state.prev_input);
+        auto special = vandq_u8(
+            vandq_u8(
+                vqtbl1q_u8(state.byte_1_high, vshrq_n_u8(prev1, 4)),
+                vqtbl1q_u8(state.byte_1_low, vandq_u8(prev1, vdupq_n_u8(0x0F)))
+            ),
+            vqtbl1q_u8(state.byte_2_high, vshrq_n_u8(input, 4))
+        );
+        auto third = vqsubq_u8(prev<2>(input, state.prev_input), vdupq_n_u8(0xE0 - 0x80));
+        auto fourth = vqsubq_u8(prev<3>(input, state.prev_input), vdupq_n_u8(0xF0 - 0x80));
+        auto must_continue = vandq_u8(vorrq_u8(third, fourth), vdupq_n_u8(0x80));
+        state.error = vorrq_u8(state.error, veorq_u8(must_continue, special));
+        state.prev_incomplete = vqsubq_u8(input, state.incomplete_max);
+    }
+    state.prev_input = input;
+}
+
+void scan(const unsigned char* data, std::size_t size, KernelCounts& out) {
+    State state{
+        vld1q_u8(utf8::kByte1High),
+        vld1q_u8(utf8::kByte1Low),
+        vld1q_u8(utf8::kByte2High),
+        vld1q_u8(utf8::kIncompleteMax + 16),
+        vdupq_n_u8(0),
+        vdupq_n_u8(0),
+        vdupq_n_u8(0),
+    };
+
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        block(state, vld1q_u8(data + i), out);
+    }
+    // The rest padded with spaces, which also catches a sequence cut off at the end
+    unsigned char last[16];
+    std::memset(last, ' ', sizeof(last));
+    if (size > i) {
+        std::memcpy(last, data + i, size - i);
+    }
+    block(state, vld1q_u8(last), out);
+
+    out.valid_utf8 = out.valid_utf8 && vmaxvq_u8(state.error) == 0;
+}
+
+template <bool kWhitespace>
+std::size_t last_of(const char* data, std::size_t size) {
+    std::size_t i = size;
+    while (i >= 16) {
+        i -= 16;
+        auto input = vld1q_u8(reinterpret_cast<const uint8_t*>(data + i));
+        auto match = vceqq_u8(input, vdupq_n_u8('\n'));
+        if constexpr (kWhitespace) {
+            match = vorrq_u8(match, vorrq_u8(vceqq_u8(input, vdupq_n_u8(' ')), vceqq_u8(input, vdupq_n_u8('\t'))));
+        }
+        if (vmaxvq_u8(match) != 0) {
+            return i + scalar::last_of<kWhitespace>(data + i, 16);
+        }
+    }
+    return scalar::last_of<kWhitespace>(data, i);
+}
+
+constexpr Kernels kKernels{scan, last_of<false>, last_of<true>};
+
+}  // namespace neon
+
+#endif  // TG_TEXT_NEON
+
+const Kernels& kernels(TextKernel kernel) {
+    switch (kernel) {
+#if TG_TEXT_X86
+        case TextKernel::AVX2:
+            return avx2::kKernels;
+        case TextKernel::SSE42:
+            return sse42::kKernels;
+#endif
+#if TG_TEXT_NEON
+        case TextKernel::NEON:
+            return neon::kKernels;
+#endif
+        default:
+            return scalar::kKernels;
+    }
+}
+
+TextKernel detect_kernel() {
+#if TG_TEXT_X86
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("popcnt")) {
+        return TextKernel::SCALAR;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return TextKernel::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return TextKernel::SSE42;
+    }
+#elif TG_TEXT_NEON
+    return TextKernel::NEON;  // Part of every AArch64 CPU
+#endif
+    return TextKernel::SCALAR;
+}
+
+const Kernels& active_kernels() {
+    static const Kernels& active = kernels(active_text_kernel());
+    return active;
+}
+
+}  // namespace
+
+bool TextScan::is_text() const {
+    if (!valid_utf8 || incomplete_tail != 0 || nul_chars != 0) {
+        return false;
+    }
+    std::size_t threshold = size < 20 ? 1 : size / 20;
+    return control_chars <= threshold;
+}
+
+TextScan scan_text(std::string_view data) { return scan_text(data, active_text_kernel()); }
+
+TextScan scan_text(std::string_view data, TextKernel kernel) {
+    auto bytes = reinterpret_cast<const unsigned char*>(data.data());
+
+    TextScan scan;
+    scan.size = data.size();
+    scan.incomplete_tail = incomplete_tail(bytes, data.size());
+
+    // The cut-off sequence has no control characters to count: its bytes are all 0x80 and above
+    KernelCounts counts;
+    kernels(kernel).scan(bytes, data.size() - scan.incomplete_tail, counts);
+    scan.control_chars = counts.control_chars;
+    scan.nul_chars = counts.nul_chars;
+    scan.valid_utf8 = counts.valid_utf8;
+    return scan;
+}
+
+TextKernel active_text_kernel() {
+    static const TextKernel kernel = detect_kernel();
+    return kernel;
+}
+
+bool text_kernel_supported(TextKernel kernel) {
+    switch (kernel) {
+        case TextKernel::SCALAR:
+            return true;
+        case TextKernel::SSE42:
+            return active_text_kernel() == TextKernel::SSE42 || active_text_kernel() == TextKernel::AVX2;
+        case TextKernel::AVX2:
+        case TextKernel::NEON:
+            return active_text_kernel() == kernel;
+    }
+    return false;
+}
+
+std::string_view to_string(TextKernel kernel) {
+    switch (kernel) {
+        case TextKernel::SCALAR:
+            return "scalar";
+        case TextKernel::SSE42:
+            return "sse4.2";
+        case TextKernel::AVX2:
+            return "avx2";
+        case TextKernel::NEON:
+            return "neon";
+    }
+    return "unknown";
+}
+
+void TextScanner::update(const char* data, std::size_t size) {
+    if (size == 0) {
+        return;
+    }
+    if (!may_be_text()) {
+        totals_.size += size;  // Decided: only the size matters now
+        return;
+    }
+
+    auto merge = [this](const TextScan& scan) {
+        totals_.size += scan.size - scan.incomplete_tail;
+        totals_.control_chars += scan.control_chars;
+        totals_.nul_chars += scan.nul_chars;
+        totals_.valid_utf8 = totals_.valid_utf8 && scan.valid_utf8;
+    };
+
+    // Finish the sequence the last update cut off first
+    if (carry_size_ != 0) {
+        auto lead = static_cast<unsigned char>(carry_[0]);
+        std::size_t length = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : 2;
+        while (carry_size_ < length && size > 0 && is_continuation(static_cast<unsigned char>(*data))) {
+            carry_[carry_size_++] = *data++;
+            --size;
+        }
+        if (carry_size_ == length) {
+            merge(scan_text(std::string_view(carry_, carry_size_), TextKernel::SCALAR));
+        } else if (size == 0) {
+            return;  // Still cut off
+        } else {
+            totals_.size += carry_size_;
+            totals_.valid_utf8 = false;  // Cut short by a byte that can't continue it
+        }
+        carry_size_ = 0;
+        if (!may_be_text()) {
+            totals_.size += size;
+            return;
+        }
+    }
+
+    auto scan = scan_text(std::string_view(data, size));
+    merge(scan);
+    std::memcpy(carry_, data + size - scan.incomplete_tail, scan.incomplete_tail);
+    carry_size_ = scan.incomplete_tail;
+}
+
+TextScan TextScanner::result() const {
+    auto scan = totals_;
+    scan.size += carry_size_;
+    scan.incomplete_tail = carry_size_;
+    return scan;
+}
+
+std::optional<TextScan> TextScanner::scan_file(const std::string& path) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) {
+        return std::nullopt;
+    }
+
+    TextScanner scanner;
+    std::vector<char> buffer(kFileChunkSize);
+    while (ifs && scanner.may_be_text()) {
+        ifs.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        scanner.update(buffer.data(), static_cast<std::size_t>(ifs.gcount()));
+    }
+    if (ifs.bad()) {
+        return std::nullopt;
+    }
+    return scanner.result();
+}
+
+std::size_t utf8_boundary(std::string_view data, std::size_t max_pos) {
+    if (max_pos >= data.size()) {
+        return data.size();
+    }
+    std::size_t pos = max_pos;
+    while (pos > 0 && is_continuation(static_cast<unsigned char>(data[pos]))) {
+        --pos;
+    }
+    return pos;
+}
+
+std::size_t find_last_newline(std::string_view data) { return active_kernels().last_newline(data.data(), data.size()); }
+
+std::size_t find_last_whitespace(std::string_view data) {
+    return active_kernels().last_whitespace(data.data(), data.size());
+}
+
+std::vector<std::string_view> split_text(std::string_view text, std::size_t max_size) {
+    std::vector<std::string_view> chunks;
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+        auto rest = text.substr(pos);
+        if (rest.size() <= max_size) {
+            chunks.push_back(rest);
+            break;
+        }
+
+        // Cut at the last whitespace that fits, dropping it; failing that, between characters
+        std::size_t end;
+        std::size_t skip = 0;
+        if (auto space = find_last_whitespace(rest.substr(1, max_size)); space != std::string_view::npos) {
+            end = space + 1;
+            skip = 1;
+        } else {
+            end = utf8_boundary(rest, max_size);
+            if (end == 0) {
+                end = max_size;  // Not UTF-8 at all: cut anywhere
+            }
+        }
+        chunks.push_back(rest.substr(0, end));
+        pos += end + skip;
+    }
+    return chunks;
+}
+
+}  // namespace tg
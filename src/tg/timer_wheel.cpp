@@ -0,0 +1,59 @@
+#include "tg/timer_wheel.hpp"
+
+#include <algorithm>
+
+namespace tg {
+
+TimerWheel::TimerWheel(Clock::duration resolution, std::size_t slots, Clock::time_point start)
+    : resolution_(std::max(resolution, Clock::duration(1))), start_(start), slots_(std::max<std::size_t>(1, slots)) {}
+
+void TimerWheel::schedule(int64_t key, Clock::time_point deadline) {
+    // Round up, so a timer never fires before its deadline
+    uint64_t tick = next_tick_;
+    if (deadline > start_) {
+        tick = std::max<uint64_t>(tick, (deadline - start_ + resolution_ - Clock::duration(1)) / resolution_);
+    }
+
+    deadlines_[key] = tick;
+    slots_[tick % slots_.size()].push_back(Timer{key, tick});
+}
+
+void TimerWheel::cancel(int64_t key) { deadlines_.erase(key); }
+
+TimerWheel::Clock::time_point TimerWheel::next_tick() const {
+    return start_ + resolution_ * static_cast<Clock::rep>(next_tick_);
+}
+
+std::vector<int64_t> TimerWheel::advance(Clock::time_point now) {
+    std::vector<int64_t> expired;
+    if (now < next_tick()) {
+        return expired;
+    }
+
+    // Ticks up to and including last are due; a full turn visits every slot once
+    uint64_t last = static_cast<uint64_t>((now - start_) / resolution_);
+    uint64_t visits = std::min<uint64_t>(last - next_tick_ + 1, slots_.size());
+
+    for (uint64_t i = 0; i < visits; ++i) {
+        auto& slot = slots_[(next_tick_ + i) % slots_.size()];
+        auto kept = slot.begin();
+        for (auto& timer : slot) {
+            auto it = deadlines_.find(timer.key);
+            if (it == deadlines_.end() || it->second != timer.tick) {
+                continue;  // Cancelled or rescheduled
+            }
+            if (timer.tick <= last) {
+                expired.push_back(timer.key);
+                deadlines_.erase(it);
+                continue;
+            }
+            *kept++ = timer;  // Due on a later turn
+        }
+        slot.erase(kept, slot.end());
+    }
+
+    next_tick_ = last + 1;
+    return expired;
+}
+
+}  // namespace tg
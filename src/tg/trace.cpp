@@ -0,0 +1,155 @@
+#include "tg/trace.hpp"
+
+#include <fmt/format.h>
+
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+
+namespace tg {
+
+namespace {
+
+thread_local uint64_t t_trace_request = 0;
+
+// Small thread numbers read better in trace viewers than pthread ids
+uint32_t current_thread_number() {
+    static std::atomic<uint32_t> next_thread{1};
+    thread_local uint32_t thread = next_thread.fetch_add(1, std::memory_order_relaxed);
+    return thread;
+}
+
+// Span names are identifiers and SQL labels; quotes and backslashes are all that need escaping
+std::string escape(const char* text) {
+    std::string escaped;
+    for (const char* c = text ? text : ""; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            escaped += '\\';
+        }
+        if (static_cast<unsigned char>(*c) >= 0x20) {
+            escaped += *c;
+        }
+    }
+    return escaped;
+}
+
+}  // namespace
+
+Tracer& Tracer::global() {
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::enable(std::size_t capacity) {
+    if (!slots_ && capacity > 0) {
+        slots_ = std::make_unique<Slot[]>(capacity);
+        capacity_ = capacity;
+    }
+    enabled_.store(slots_ != nullptr, std::memory_order_release);
+}
+
+void Tracer::record(const char* category, const char* name, int64_t start_ns, uint64_t request) {
+    record(TraceEvent{category, name, start_ns, now_ns() - start_ns, request, current_thread_number()});
+}
+
+void Tracer::record(const TraceEvent& event) {
+    if (!enabled_.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    auto index = head_.fetch_add(1, std::memory_order_relaxed);
+    auto& slot = slots_[index % capacity_];
+
+    // Readers that see an odd sequence, or a different one after reading, skip the slot
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.category.store(event.category, std::memory_order_relaxed);
+    slot.name.store(event.name, std::memory_order_relaxed);
+    slot.start_ns.store(event.start_ns, std::memory_order_relaxed);
+    slot.duration_ns.store(event.duration_ns, std::memory_order_relaxed);
+    slot.request.store(event.request, std::memory_order_relaxed);
+    slot.thread.store(event.thread, std::memory_order_relaxed);
+    slot.sequence.store(2 * index + 2, std::memory_order_release);
+}
+
+std::vector<TraceEvent> Tracer::events() const {
+    std::vector<TraceEvent> events;
+    if (!slots_) {
+        return events;
+    }
+
+    auto head = head_.load(std::memory_order_acquire);
+    auto first = head > capacity_ ? head - capacity_ : 0;
+    events.reserve(static_cast<std::size_t>(head - first));
+    for (auto index = first; index < head; ++index) {
+        const auto& slot = slots_[index % capacity_];
+        auto sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != 2 * index + 2) {
+            continue;  // Still being written, or already overwritten
+        }
+
+        TraceEvent event;
+        event.category = slot.category.load(std::memory_order_relaxed);
+        event.name = slot.name.load(std::memory_order_relaxed);
+        event.start_ns = slot.start_ns.load(std::memory_order_relaxed);
+        event.duration_ns = slot.duration_ns.load(std::memory_order_relaxed);
+        event.request = slot.request.load(std::memory_order_relaxed);
+        event.thread = slot.thread.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == sequence) {
+            events.push_back(event);
+        }
+    }
+    return events;
+}
+
+std::string Tracer::chrome_trace_json() const {
+    auto pid = static_cast<int>(::getpid());
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (const auto& event : events()) {
+        json += fmt::format(
+            "{}\n{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":{},\"tid\":{}",
+            first ? "" : ",",
+            escape(event.name),
+            escape(event.category),
+            static_cast<double>(event.start_ns) / 1e3,
+            static_cast<double>(std::max<int64_t>(0, event.duration_ns)) / 1e3,
+            pid,
+            event.thread
+        );
+        json += event.request != 0 ? fmt::format(",\"args\":{{\"request\":{}}}}}", event.request) : "}";
+        first = false;
+    }
+    json += "\n]}\n";
+    return json;
+}
+
+const char* Tracer::intern(std::string_view name) {
+    std::lock_guard<std::mutex> lock(intern_mutex_);
+    auto it = interned_.find(name);
+    if (it == interned_.end()) {
+        it = interned_.emplace(name).first;
+    }
+    return it->c_str();
+}
+
+int64_t Tracer::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+uint64_t current_trace_request() { return t_trace_request; }
+
+TraceRequestScope::TraceRequestScope() : previous_(t_trace_request) {
+    if (Tracer::global().enabled()) {
+        t_trace_request = Tracer::global().next_request_id();
+    }
+}
+
+TraceRequestScope::TraceRequestScope(uint64_t request) : previous_(t_trace_request) { t_trace_request = request; }
+
+TraceRequestScope::~TraceRequestScope() { t_trace_request = previous_; }
+
+}  // namespace tg
@@ -105,6 +105,57 @@ std::string MediaInfo::get_extension() const {
     }
 }
 
+// View conversions
+MediaView::MediaView(const MediaInfo& media)
+    : type(media.type),
+      file_id(media.file_id),
+      filename(media.filename),
+      mime_type(media.mime_type),
+      file_size(media.file_size),
+      width(media.width),
+      height(media.height),
+      duration(media.duration) {
+    if (media.local_path) {
+        local_path = *media.local_path;
+    }
+}
+
+MediaInfo MediaView::to_media_info() const {
+    MediaInfo media{};
+    media.type = type;
+    media.file_id = file_id;
+    media.filename = filename;
+    media.mime_type = mime_type;
+    media.file_size = file_size;
+    media.width = width;
+    media.height = height;
+    media.duration = duration;
+    if (local_path) {
+        media.local_path = std::string(*local_path);
+    }
+    return media;
+}
+
+MessageView::MessageView(const Message& message)
+    : id(message.id),
+      chat_id(message.chat_id),
+      sender_id(message.sender_id),
+      timestamp(message.timestamp),
+      text(message.text),
+      is_outgoing(message.is_outgoing) {
+    if (message.media) {
+        media = *message.media;
+    }
+}
+
+Message MessageView::to_message() const {
+    Message message{id, chat_id, sender_id, timestamp, std::string(text), std::nullopt, is_outgoing};
+    if (media) {
+        message.media = media->to_media_info();
+    }
+    return message;
+}
+
 // Message methods
 std::string Message::format_for_display() const {
     std::ostringstream oss;
@@ -237,4 +288,19 @@ bool is_document_type(MediaType type) {
            type == MediaType::STICKER || type == MediaType::VIDEO_NOTE;
 }
 
+std::optional<FileListItem> make_file_list_item(const Message& message) {
+    if (!message.has_media()) {
+        return std::nullopt;
+    }
+
+    FileListItem item;
+    item.message_id = message.id;
+    item.filename = message.media->filename;
+    item.file_size = message.media->file_size;
+    item.timestamp = message.timestamp;
+    item.type = message.media->type;
+    item.file_id = message.media->file_id;
+    return item;
+}
+
 }  // namespace tg
@@ -0,0 +1,150 @@
+#include "fuse/accounts_provider.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cerrno>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace tgfuse {
+namespace {
+
+// Provider that records the paths it is asked about; every path exists, "/" is its root directory
+class RecordingProvider : public DataProvider {
+public:
+    std::vector<Entry> list_directory(std::string_view path) override {
+        paths.emplace_back(path);
+        return {Entry::file("listed", 1)};
+    }
+
+    std::optional<Entry> get_entry(std::string_view path) override {
+        paths.emplace_back(path);
+        return path == "/" ? Entry::directory("root", 0750) : Entry::file(std::string(path), 7);
+    }
+
+    bool exists(std::string_view path) override {
+        paths.emplace_back(path);
+        return true;
+    }
+
+    bool is_directory(std::string_view path) override { return path == "/"; }
+    bool is_symlink(std::string_view) override { return false; }
+
+    FileContent read_file(std::string_view path) override {
+        FileContent content;
+        content.data = "read " + std::string(path);
+        return content;
+    }
+
+    std::string read_link(std::string_view) override { return {}; }
+    std::string get_filesystem_name() const override { return "recording"; }
+
+    int create_file(std::string_view path, mode_t, uint64_t& fh) override {
+        paths.emplace_back(path);
+        fh = 42;
+        return 0;
+    }
+
+    void set_invalidate_callback(InvalidateCallback callback) override { invalidate = std::move(callback); }
+
+    std::vector<std::string> paths;
+    InvalidateCallback invalidate;
+};
+
+class AccountsProviderTest : public ::testing::Test {
+protected:
+    AccountsProviderTest() : accounts_({{"home", home_}, {"work", work_}}) {}
+
+    std::shared_ptr<RecordingProvider> home_ = std::make_shared<RecordingProvider>();
+    std::shared_ptr<RecordingProvider> work_ = std::make_shared<RecordingProvider>();
+    AccountsProvider accounts_;
+};
+
+TEST_F(AccountsProviderTest, ListsAccountsAtRoot) {
+    auto entries = accounts_.list_directory("/");
+    ASSERT_EQ(entries.size(), 2u);
+    EXPECT_EQ(entries[0].name, "home");
+    EXPECT_EQ(entries[1].name, "work");
+
+    // Named after the account, with the attributes of its provider's root
+    EXPECT_TRUE(entries[0].is_directory());
+    EXPECT_EQ(entries[0].mode, 0750u);
+
+    auto root = accounts_.get_entry("/");
+    ASSERT_TRUE(root);
+    EXPECT_TRUE(root->is_directory());
+    EXPECT_TRUE(accounts_.is_directory("/"));
+    EXPECT_TRUE(accounts_.exists(""));
+}
+
+TEST_F(AccountsProviderTest, RoutesPathsIntoTheAccount) {
+    auto entries = accounts_.list_directory("/work/users");
+    ASSERT_EQ(entries.size(), 1u);
+    EXPECT_EQ(entries[0].name, "listed");
+
+    auto entry = accounts_.get_entry("/work/users/alice");
+    ASSERT_TRUE(entry);
+    EXPECT_EQ(entry->name, "/users/alice");
+    EXPECT_EQ(accounts_.read_file("/home/self/info").data, "read /self/info");
+
+    // The account's own directory is its provider's root
+    auto account = accounts_.get_entry("/home");
+    ASSERT_TRUE(account);
+    EXPECT_EQ(account->name, "home");
+    EXPECT_TRUE(accounts_.is_directory("/home"));
+
+    EXPECT_EQ(work_->paths, (std::vector<std::string>{"/users", "/users/alice"}));
+    EXPECT_EQ(home_->paths, (std::vector<std::string>{"/"}));
+}
+
+TEST_F(AccountsProviderTest, UnknownAccountsAreNotFound) {
+    EXPECT_FALSE(accounts_.exists("/play"));
+    EXPECT_FALSE(accounts_.get_entry("/play/users"));
+    EXPECT_TRUE(accounts_.list_directory("/play").empty());
+    EXPECT_EQ(accounts_.visit_directory("/play", [](const Entry&) { return true; }), -ENOENT);
+    EXPECT_FALSE(accounts_.read_file("/play/users/alice").readable);
+    EXPECT_FALSE(accounts_.write_file("/play/users/alice/messages", "hi", 2, 0).success);
+
+    // An account name is a whole path component
+    EXPECT_FALSE(accounts_.exists("/workshop"));
+    EXPECT_TRUE(work_->paths.empty());
+}
+
+TEST_F(AccountsProviderTest, RootIsReadOnly) {
+    uint64_t fh = 0;
+    EXPECT_EQ(accounts_.create_file("/new.txt", 0644, fh), -EACCES);
+    EXPECT_FALSE(accounts_.is_writable("/"));
+
+    EXPECT_EQ(accounts_.create_file("/work/users/alice/new.txt", 0644, fh), 0);
+    EXPECT_EQ(fh, 42u);
+    EXPECT_EQ(work_->paths.back(), "/users/alice/new.txt");
+}
+
+TEST_F(AccountsProviderTest, EachAccountIsMountedInItsDirectory) {
+    accounts_.set_mount_point("/mnt/tg");
+    EXPECT_EQ(accounts_.get_mount_point(), "/mnt/tg");
+    EXPECT_EQ(home_->get_mount_point(), "/mnt/tg/home");
+    EXPECT_EQ(work_->get_mount_point(), "/mnt/tg/work");
+}
+
+TEST_F(AccountsProviderTest, InvalidationsArePrefixedWithTheAccount) {
+    std::vector<std::string> invalidated;
+    accounts_.set_invalidate_callback([&invalidated](const std::string& path) { invalidated.push_back(path); });
+    ASSERT_TRUE(work_->invalidate);
+
+    work_->invalidate("/users/alice/messages");
+    work_->invalidate("/");
+    home_->invalidate("/groups");
+    EXPECT_EQ(invalidated, (std::vector<std::string>{"/work/users/alice/messages", "/work", "/home/groups"}));
+
+    accounts_.set_invalidate_callback(nullptr);
+    EXPECT_FALSE(work_->invalidate);
+}
+
+}  // namespace
+}  // namespace tgfuse
@@ -0,0 +1,221 @@
+#include "fuse/messages_cache.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace tgfuse {
+namespace {
+
+using namespace std::chrono_literals;
+
+// Unix time @p age ago
+int64_t unix_time_ago(std::chrono::seconds age) {
+    auto then = std::chrono::system_clock::now() - age;
+    return std::chrono::duration_cast<std::chrono::seconds>(then.time_since_epoch()).count();
+}
+
+// Formats messages of one chat and one sender as their bare text, one per line
+class MessagesCacheTest : public ::testing::Test {
+protected:
+    static MessagesCacheConfig config() {
+        MessagesCacheConfig config;
+        config.message_format = "{{message}}";
+        return config;
+    }
+
+    tg::Message message(int64_t chat_id, int64_t id, std::string text, int64_t timestamp = unix_time_ago(1min)) {
+        return tg::Message{id, chat_id, user_.id, timestamp, std::move(text), std::nullopt, false};
+    }
+
+    SharedText store(FormattedMessagesCache& cache, int64_t chat_id, const std::vector<tg::Message>& messages) {
+        std::vector<tg::MessageView> views(messages.begin(), messages.end());
+        return cache.store(chat_id, views, user_resolver(), chat_resolver());
+    }
+
+    bool append(FormattedMessagesCache& cache, int64_t chat_id, const std::vector<tg::Message>& messages) {
+        std::vector<tg::MessageView> views(messages.begin(), messages.end());
+        return cache.append(chat_id, views, user_resolver(), chat_resolver());
+    }
+
+    UserResolver user_resolver() {
+        return [this](int64_t) { return &user_; };
+    }
+
+    ChatResolver chat_resolver() {
+        return [this](int64_t) -> const tg::Chat& { return chat_; };
+    }
+
+    tg::User user_{1000, "alice", "Alice", "", "", "", true, tg::UserStatus::UNKNOWN, 0, 0, 0};
+    tg::Chat chat_{1, tg::ChatType::PRIVATE, "Alice", "alice", 0, 0};
+};
+
+TEST_F(MessagesCacheTest, EvictsLeastRecentlyUsedWithinByteBudget) {
+    auto conf = config();
+    conf.max_bytes = 2500;
+    conf.cold_max_bytes = 0;
+    FormattedMessagesCache cache(conf);
+
+    store(cache, 1, {message(1, 1, std::string(1000, 'a'))});
+    store(cache, 2, {message(2, 2, std::string(1000, 'b'))});
+    ASSERT_TRUE(cache.get(1));  // Chat 2 is now the least recently used
+
+    store(cache, 3, {message(3, 3, std::string(1000, 'c'))});
+    EXPECT_TRUE(cache.contains(1));
+    EXPECT_FALSE(cache.contains(2));
+    EXPECT_TRUE(cache.contains(3));
+
+    auto stats = cache.get_stats();
+    EXPECT_EQ(stats.chat_count, 2u);
+    EXPECT_LE(stats.hot_bytes, conf.max_bytes);
+}
+
+TEST_F(MessagesCacheTest, EntryOverBudgetIsServedButNotCached) {
+    auto conf = config();
+    conf.max_bytes = 1024;
+    conf.cold_max_bytes = 0;
+    FormattedMessagesCache cache(conf);
+
+    auto text = store(cache, 1, {message(1, 1, std::string(4096, 'a'))});
+    EXPECT_EQ(text.view(), std::string(4096, 'a') + "\n");
+    EXPECT_FALSE(cache.contains(1));
+    EXPECT_EQ(cache.get_stats().hot_bytes, 0u);
+}
+
+TEST_F(MessagesCacheTest, ColdTierRoundTrip) {
+    auto conf = config();
+    conf.max_chats = 1;
+    FormattedMessagesCache cache(conf);
+
+    auto first = store(cache, 1, {message(1, 1, std::string(2000, 'a')), message(1, 2, "second")});
+    std::string expected(first.view());
+    store(cache, 2, {message(2, 3, "other chat")});
+
+    // Chat 1 was pushed out of the hot tier, compressed
+    auto stats = cache.get_stats();
+    EXPECT_EQ(stats.chat_count, 1u);
+    EXPECT_EQ(stats.cold_chat_count, 1u);
+    EXPECT_EQ(stats.cold_raw_bytes, expected.size());
+    EXPECT_GT(stats.compression_ratio, 1.0);
+    EXPECT_TRUE(cache.contains(1));
+    EXPECT_FALSE(cache.is_stale(1));
+    EXPECT_EQ(cache.get_content_size(1), expected.size());
+
+    // Served again without reformatting, swapping places with chat 2
+    auto promoted = cache.get(1);
+    ASSERT_TRUE(promoted);
+    EXPECT_EQ(promoted->view(), expected);
+    stats = cache.get_stats();
+    EXPECT_EQ(stats.cold_hit_count, 1u);
+    EXPECT_EQ(stats.chat_count, 1u);
+    EXPECT_EQ(stats.cold_chat_count, 1u);
+    EXPECT_LE(stats.hot_bytes, conf.max_bytes);
+
+    // A promoted entry takes appends like any other
+    EXPECT_TRUE(append(cache, 1, {message(1, 4, "third")}));
+    EXPECT_EQ(cache.get(1)->view(), expected + "third\n");
+}
+
+TEST_F(MessagesCacheTest, AppendDropsColdCopy) {
+    auto conf = config();
+    conf.max_chats = 1;
+    FormattedMessagesCache cache(conf);
+
+    store(cache, 1, {message(1, 1, "first")});
+    store(cache, 2, {message(2, 2, "other chat")});
+    ASSERT_EQ(cache.get_stats().cold_chat_count, 1u);
+
+    // The compressed copy would be served without the new message
+    EXPECT_FALSE(append(cache, 1, {message(1, 3, "second")}));
+    EXPECT_FALSE(cache.contains(1));
+    EXPECT_EQ(cache.get_stats().cold_bytes, 0u);
+}
+
+TEST_F(MessagesCacheTest, ColdTierKeepsItsBudget) {
+    auto conf = config();
+    conf.max_chats = 1;
+    conf.cold_max_bytes = 64;
+    FormattedMessagesCache cache(conf);
+
+    // Highly compressible, so a few fit the cold budget at a time
+    for (int64_t chat_id = 1; chat_id <= 10; ++chat_id) {
+        store(cache, chat_id, {message(chat_id, chat_id, std::string(1000, 'a'))});
+        EXPECT_LE(cache.get_stats().cold_bytes, conf.cold_max_bytes);
+    }
+    EXPECT_TRUE(cache.contains(10));
+    EXPECT_TRUE(cache.contains(9));   // Most recently demoted
+    EXPECT_FALSE(cache.contains(1));  // Dropped from the cold tier too
+}
+
+TEST_F(MessagesCacheTest, AppendAcrossTrimBoundary) {
+    auto conf = config();
+    conf.min_messages = 1;
+    FormattedMessagesCache cache(conf);
+
+    auto expired = unix_time_ago(72h);
+    auto stored =
+        store(cache, 1, {message(1, 1, "old", expired), message(1, 2, "older", expired), message(1, 3, "new")});
+
+    // Appending trims the expired head at the same time
+    EXPECT_TRUE(append(cache, 1, {message(1, 4, "newer")}));
+    EXPECT_EQ(cache.get(1)->view(), "new\nnewer\n");
+    EXPECT_EQ(cache.get_content_size(1), std::string_view("new\nnewer\n").size());
+
+    // The handle from store() still sees what it was given
+    EXPECT_EQ(stored.view(), "old\nolder\nnew\n");
+}
+
+TEST_F(MessagesCacheTest, OffsetsFollowRepeatedTrims) {
+    auto conf = config();
+    conf.min_messages = 3;
+    FormattedMessagesCache cache(conf);
+
+    // Every message is expired, so each append trims one from the head, compacting or reallocating on the way
+    auto expired = unix_time_ago(72h);
+    auto text = [](int64_t id) { return "message " + std::to_string(id); };
+    std::vector<tg::Message> initial;
+    for (int64_t id = 1; id <= 3; ++id) {
+        initial.push_back(message(1, id, text(id), expired));
+    }
+    store(cache, 1, initial);
+
+    std::vector<std::pair<SharedText, std::string>> held;
+    for (int64_t id = 4; id <= 60; ++id) {
+        ASSERT_TRUE(append(cache, 1, {message(1, id, text(id), expired)}));
+
+        auto expected = text(id - 2) + "\n" + text(id - 1) + "\n" + text(id) + "\n";
+        auto content = cache.get(1);
+        ASSERT_TRUE(content);
+        ASSERT_EQ(content->view(), expected) << "after appending " << id;
+        EXPECT_EQ(cache.get_content_size(1), expected.size());
+
+        // Keep some handles alive: the buffer can't be compacted under them
+        if (id % 7 == 0) {
+            held.emplace_back(*content, expected);
+        }
+    }
+    for (const auto& [content, expected] : held) {
+        EXPECT_EQ(content.view(), expected);
+    }
+}
+
+TEST_F(MessagesCacheTest, AppendSkipsRedeliveredAndRejectsOlder) {
+    FormattedMessagesCache cache(config());
+    store(cache, 1, {message(1, 1, "first"), message(1, 2, "second")});
+
+    EXPECT_TRUE(append(cache, 1, {message(1, 2, "second"), message(1, 3, "third")}));
+    EXPECT_EQ(cache.get(1)->view(), "first\nsecond\nthird\n");
+
+    // An older message means the cached content is out of order: it is dropped to be reformatted
+    EXPECT_FALSE(append(cache, 1, {message(1, 2, "second")}));
+    EXPECT_FALSE(cache.contains(1));
+    EXPECT_FALSE(append(cache, 1, {message(1, 4, "fourth")}));
+}
+
+}  // namespace
+}  // namespace tgfuse
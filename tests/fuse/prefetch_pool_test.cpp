@@ -0,0 +1,147 @@
+#include "fuse/background_prefetcher.hpp"
+#include "fuse/messages_cache.hpp"
+#include "tg/cache.hpp"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tgfuse {
+namespace {
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+// Wait until @p done holds (or give up after a second)
+bool wait_for(const std::function<bool()>& done) {
+    for (int i = 0; i < 1000 && !done(); ++i) {
+        std::this_thread::sleep_for(1ms);
+    }
+    return done();
+}
+
+// Two prefetchers on one pool; their loads are recorded, and chat kBlockingChat holds until released
+class PrefetchPoolTest : public ::testing::Test {
+protected:
+    static constexpr int64_t kBlockingChat = 100;
+
+    void SetUp() override {
+        db_path_ = "/tmp/tg_prefetch_pool_test_" + std::to_string(::getpid()) + ".db";
+        db_ = std::make_unique<tg::CacheManager>(db_path_);
+    }
+
+    void TearDown() override {
+        db_.reset();
+        fs::remove(db_path_);
+    }
+
+    std::unique_ptr<BackgroundPrefetcher> make_prefetcher(std::shared_ptr<PrefetchPool> pool) {
+        BackgroundPrefetcher::Config config;
+        config.pool = std::move(pool);
+        config.prefetch_interval = std::chrono::hours{1};  // No startup scan during a test
+        auto load = [this](int64_t chat_id) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                loaded_.push_back(chat_id);
+            }
+            if (chat_id == kBlockingChat) {
+                gate_.wait();
+            }
+        };
+        return std::make_unique<BackgroundPrefetcher>(cache_, *db_, load, nullptr, config);
+    }
+
+    std::vector<int64_t> loaded() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return loaded_;
+    }
+
+    void release() { open_.set_value(); }
+
+    std::string db_path_;
+    std::unique_ptr<tg::CacheManager> db_;
+    FormattedMessagesCache cache_;
+
+    mutable std::mutex mutex_;
+    std::vector<int64_t> loaded_;
+    std::promise<void> open_;
+    std::shared_future<void> gate_{open_.get_future().share()};
+};
+
+TEST_F(PrefetchPoolTest, PrefetchersTakeTurns) {
+    auto pool = std::make_shared<PrefetchPool>(1);
+    auto first = make_prefetcher(pool);
+    auto second = make_prefetcher(pool);
+    first->start();
+    second->start();
+
+    // Hold the only worker while both queue a backlog
+    first->queue_chat(kBlockingChat);
+    ASSERT_TRUE(wait_for([this]() { return loaded().size() == 1; }));
+    for (int64_t chat_id : {1, 2, 3}) {
+        first->queue_chat(chat_id);
+    }
+    for (int64_t chat_id : {11, 12, 13}) {
+        second->queue_chat(chat_id);
+    }
+
+    release();
+    ASSERT_TRUE(wait_for([this]() { return loaded().size() == 7; }));
+    EXPECT_EQ(loaded(), (std::vector<int64_t>{kBlockingChat, 11, 1, 12, 2, 13, 3}));
+}
+
+TEST_F(PrefetchPoolTest, StopWaitsForRunningJobs) {
+    auto pool = std::make_shared<PrefetchPool>(2);
+    auto prefetcher = make_prefetcher(pool);
+    prefetcher->start();
+
+    prefetcher->queue_chat(kBlockingChat);
+    ASSERT_TRUE(wait_for([this]() { return loaded().size() == 1; }));
+
+    std::atomic<bool> stopped{false};
+    std::thread stopper([&]() {
+        prefetcher->stop();
+        stopped = true;
+    });
+    std::this_thread::sleep_for(20ms);
+    EXPECT_FALSE(stopped);
+
+    release();
+    stopper.join();
+    EXPECT_TRUE(stopped);
+}
+
+TEST_F(PrefetchPoolTest, StoppedPrefetcherLeavesThePool) {
+    auto pool = std::make_shared<PrefetchPool>(1);
+    auto first = make_prefetcher(pool);
+    auto second = make_prefetcher(pool);
+    first->start();
+    second->start();
+    first->stop();
+
+    first->queue_chat(1);  // Dropped: it is stopped
+    EXPECT_EQ(first->queued(), 0u);
+    second->queue_chat(2);
+    ASSERT_TRUE(wait_for([this]() { return !loaded().empty(); }));
+    std::this_thread::sleep_for(10ms);
+    EXPECT_EQ(loaded(), (std::vector<int64_t>{2}));
+
+    // Restarting joins the pool again
+    first->start();
+    first->queue_chat(3);
+    ASSERT_TRUE(wait_for([this]() { return loaded().size() == 2; }));
+    EXPECT_EQ(loaded().back(), 3);
+}
+
+}  // namespace
+}  // namespace tgfuse
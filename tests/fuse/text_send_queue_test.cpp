@@ -0,0 +1,196 @@
+#include "fuse/text_send_queue.hpp"
+
+#include "tg/exceptions.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace tgfuse {
+namespace {
+
+using namespace std::chrono_literals;
+
+// Records every message handed over; confirms them right away unless told to hold them
+class FakeSender {
+public:
+    int64_t send(int64_t chat_id, const std::string& text) {
+        int64_t id = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sent_.emplace_back(chat_id, text);
+            id = static_cast<int64_t>(sent_.size());
+            if (hold) {
+                held_.push_back(id);
+            }
+        }
+        if (!hold) {
+            queue->confirmed(id, true);  // Beats the send's return, as a fast TDLib callback can
+        }
+        return id;
+    }
+
+    TextSendQueue::Sender callback() {
+        return [this](int64_t chat_id, const std::string& text) { return send(chat_id, text); };
+    }
+
+    std::vector<std::pair<int64_t, std::string>> sent() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return sent_;
+    }
+
+    std::size_t sent_count() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return sent_.size();
+    }
+
+    // Confirm the oldest held message
+    void confirm_one(bool ok = true) {
+        int64_t id = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ASSERT_FALSE(held_.empty());
+            id = held_.front();
+            held_.erase(held_.begin());
+        }
+        queue->confirmed(id, ok);
+    }
+
+    // Wait until @p count messages were handed over (or give up after a second)
+    bool wait_sent(std::size_t count) const {
+        for (int i = 0; i < 1000 && sent_count() < count; ++i) {
+            std::this_thread::sleep_for(1ms);
+        }
+        return sent_count() >= count;
+    }
+
+    TextSendQueue* queue{nullptr};
+    std::atomic<bool> hold{false};
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<std::pair<int64_t, std::string>> sent_;
+    std::vector<int64_t> held_;
+};
+
+TEST(TextSendQueueTest, SendsChunksInOrder) {
+    FakeSender sender;
+    TextSendQueue queue(sender.callback());
+    sender.queue = &queue;
+    queue.start();
+
+    auto first = queue.enqueue(1, {"a", "b", "c"});
+    auto second = queue.enqueue(1, {"d"});
+    EXPECT_EQ(first.get(), 0);
+    EXPECT_EQ(second.get(), 0);
+
+    auto sent = sender.sent();
+    ASSERT_EQ(sent.size(), 4u);
+    EXPECT_EQ(sent[0].second, "a");
+    EXPECT_EQ(sent[1].second, "b");
+    EXPECT_EQ(sent[2].second, "c");
+    EXPECT_EQ(sent[3].second, "d");
+    EXPECT_EQ(queue.queued_bytes(1), 0u);
+}
+
+TEST(TextSendQueueTest, WindowLimitsUnconfirmedMessages) {
+    FakeSender sender;
+    sender.hold = true;
+    TextSendQueueConfig config;
+    config.max_in_flight = 2;
+    TextSendQueue queue(sender.callback(), config);
+    sender.queue = &queue;
+    queue.start();
+
+    auto result = queue.enqueue(1, {"a", "b", "c"});
+    ASSERT_TRUE(sender.wait_sent(2));
+    std::this_thread::sleep_for(20ms);
+    EXPECT_EQ(sender.sent_count(), 2u);  // The third waits for a slot
+    EXPECT_EQ(queue.queued_bytes(1), 1u);
+
+    sender.confirm_one();
+    ASSERT_TRUE(sender.wait_sent(3));
+    sender.confirm_one();
+    sender.confirm_one();
+    EXPECT_EQ(result.get(), 0);
+}
+
+TEST(TextSendQueueTest, RefusedMessageFailsItsBatch) {
+    FakeSender sender;
+    sender.hold = true;
+    TextSendQueue queue(sender.callback());
+    sender.queue = &queue;
+    queue.start();
+
+    auto result = queue.enqueue(1, {"a", "b"});
+    ASSERT_TRUE(sender.wait_sent(2));
+    sender.confirm_one(false);
+    sender.confirm_one();
+    EXPECT_EQ(result.get(), -EIO);
+}
+
+TEST(TextSendQueueTest, RetriesRateLimitedSends) {
+    std::atomic<int> attempts{0};
+    TextSendQueue* queue_ptr = nullptr;
+    TextSendQueue queue([&](int64_t, const std::string&) -> int64_t {
+        if (++attempts < 3) {
+            throw tg::RateLimitException(1);
+        }
+        queue_ptr->confirmed(1, true);
+        return 1;
+    });
+    queue_ptr = &queue;
+    queue.start();
+
+    EXPECT_EQ(queue.enqueue(1, {"a"}).get(), 0);
+    EXPECT_EQ(attempts, 3);
+}
+
+TEST(TextSendQueueTest, GivesUpAfterMaxRetries) {
+    std::atomic<int> attempts{0};
+    TextSendQueueConfig config;
+    config.max_retries = 2;
+    TextSendQueue queue(
+        [&](int64_t, const std::string&) -> int64_t {
+            ++attempts;
+            throw tg::RateLimitException(1);
+        },
+        config
+    );
+    queue.start();
+
+    EXPECT_EQ(queue.enqueue(1, {"a"}).get(), -EIO);
+    EXPECT_EQ(attempts, 2);
+}
+
+TEST(TextSendQueueTest, StopFailsChunksBehindFullWindow) {
+    FakeSender sender;
+    sender.hold = true;
+    TextSendQueueConfig config;
+    config.max_in_flight = 1;
+    TextSendQueue queue(sender.callback(), config);
+    sender.queue = &queue;
+    queue.start();
+
+    auto result = queue.enqueue(1, {"a", "b", "c"});
+    ASSERT_TRUE(sender.wait_sent(1));
+
+    // Returns without waiting for a confirmation that would open the window
+    auto started = std::chrono::steady_clock::now();
+    queue.stop();
+    EXPECT_LT(std::chrono::steady_clock::now() - started, 500ms);
+    EXPECT_EQ(sender.sent_count(), 1u);
+    EXPECT_EQ(result.get(), -EIO);
+
+    EXPECT_EQ(queue.enqueue(1, {"d"}).get(), -ESHUTDOWN);
+}
+
+}  // namespace
+}  // namespace tgfuse
@@ -0,0 +1,222 @@
+#include "fuse/upload_queue.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace tgfuse {
+namespace {
+
+using namespace std::chrono_literals;
+
+// Wait until @p done holds (or give up after a second)
+bool wait_for(const std::function<bool()>& done) {
+    for (int i = 0; i < 1000 && !done(); ++i) {
+        std::this_thread::sleep_for(1ms);
+    }
+    return done();
+}
+
+// Jobs that record when they start and hold until let go
+class FakeUploads {
+public:
+    // Job that submits its message right away, then holds its transfer
+    UploadQueue::Job job(int index) {
+        return [this, index](UploadProgress& progress) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                started_.push_back(index);
+                max_running_ = std::max(max_running_, ++running_);
+            }
+            progress.submitted();
+            gate_.wait();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                --running_;
+            }
+            return 0;
+        };
+    }
+
+    void release() { open_.set_value(); }
+
+    std::vector<int> started() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return started_;
+    }
+
+    int max_running() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return max_running_;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<int> started_;
+    int running_{0};
+    int max_running_{0};
+    std::promise<void> open_;
+    std::shared_future<void> gate_{open_.get_future().share()};
+};
+
+TEST(UploadQueueTest, RunsAtMostMaxConcurrent) {
+    UploadQueue queue({.max_concurrent = 2});
+    queue.start();
+
+    FakeUploads uploads;
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 5; ++i) {
+        results.push_back(queue.enqueue(i + 1, 100 + i, "file", 10, uploads.job(i)));
+    }
+
+    ASSERT_TRUE(wait_for([&uploads]() { return uploads.started().size() == 2; }));
+    std::this_thread::sleep_for(20ms);
+    EXPECT_EQ(uploads.started().size(), 2u);  // The rest wait for a worker
+
+    uploads.release();
+    for (auto& result : results) {
+        EXPECT_EQ(result.get(), 0);
+    }
+    EXPECT_EQ(uploads.max_running(), 2);
+}
+
+TEST(UploadQueueTest, ChatWaitsForPreviousSubmit) {
+    UploadQueue queue({.max_concurrent = 4});
+    queue.start();
+
+    // The first upload holds before submitting its message
+    std::promise<void> submit;
+    auto submit_gate = submit.get_future().share();
+    std::atomic<bool> second_started{false};
+    auto first = queue.enqueue(1, 100, "first", 10, [submit_gate](UploadProgress& progress) {
+        submit_gate.wait();
+        progress.submitted();
+        return 0;
+    });
+    auto second = queue.enqueue(2, 100, "second", 10, [&second_started](UploadProgress&) {
+        second_started = true;
+        return 0;
+    });
+    auto other_chat = queue.enqueue(3, 200, "other", 10, [](UploadProgress&) { return 0; });
+
+    EXPECT_EQ(other_chat.get(), 0);  // Another chat is not held up
+    std::this_thread::sleep_for(20ms);
+    EXPECT_FALSE(second_started);
+
+    submit.set_value();
+    EXPECT_EQ(first.get(), 0);
+    EXPECT_EQ(second.get(), 0);
+    EXPECT_TRUE(second_started);
+}
+
+TEST(UploadQueueTest, TransfersOverlapOnceSubmitted) {
+    UploadQueue queue({.max_concurrent = 4});
+    queue.start();
+
+    FakeUploads uploads;
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 3; ++i) {
+        results.push_back(queue.enqueue(i + 1, 100, "file", 10, uploads.job(i)));
+    }
+
+    // Each submits before transferring, so all three run at once, started in queue order
+    ASSERT_TRUE(wait_for([&uploads]() { return uploads.started().size() == 3; }));
+    EXPECT_EQ(uploads.started(), (std::vector<int>{0, 1, 2}));
+
+    uploads.release();
+    for (auto& result : results) {
+        EXPECT_EQ(result.get(), 0);
+    }
+    EXPECT_EQ(uploads.max_running(), 3);
+}
+
+TEST(UploadQueueTest, FailedUploadsAreListedWithTheirError) {
+    UploadQueue queue;
+    queue.start();
+
+    auto no_space = queue.enqueue(1, 100, "full", 10, [](UploadProgress&) { return -ENOSPC; });
+    auto reported = queue.enqueue(2, 100, "reported", 10, [](UploadProgress& progress) {
+        progress.set_error("Too large");
+        return -EFBIG;
+    });
+    auto thrown = queue.enqueue(3, 100, "thrown", 10, [](UploadProgress&) -> int {
+        throw std::runtime_error("Connection lost");
+    });
+    auto sent = queue.enqueue(4, 100, "sent", 10, [](UploadProgress& progress) {
+        progress.submitted();
+        progress.set_uploaded(5);
+        return 0;
+    });
+
+    EXPECT_EQ(no_space.get(), -ENOSPC);
+    EXPECT_EQ(reported.get(), -EFBIG);
+    EXPECT_EQ(thrown.get(), -EIO);
+    EXPECT_EQ(sent.get(), 0);
+
+    auto statuses = queue.statuses();
+    ASSERT_EQ(statuses.size(), 4u);
+    EXPECT_EQ(statuses[0].state, UploadState::FAILED);
+    EXPECT_EQ(statuses[0].error, std::strerror(ENOSPC));
+    EXPECT_EQ(statuses[1].state, UploadState::FAILED);
+    EXPECT_EQ(statuses[1].error, "Too large");
+    EXPECT_EQ(statuses[2].state, UploadState::FAILED);
+    EXPECT_EQ(statuses[2].error, "Connection lost");
+    EXPECT_EQ(statuses[3].state, UploadState::DONE);
+    EXPECT_EQ(statuses[3].uploaded, 10u);  // A finished upload counts every byte
+    EXPECT_TRUE(statuses[3].error.empty());
+}
+
+TEST(UploadQueueTest, ListsUploadsInQueueOrderUntilRetentionEnds) {
+    UploadQueue queue({.max_concurrent = 1, .finished_retention = 0s});
+
+    // Not started yet: everything stays queued
+    auto first = queue.enqueue(1, 100, "first", 10, [](UploadProgress&) { return 0; });
+    auto second = queue.enqueue(2, 200, "second", 10, [](UploadProgress&) { return 0; });
+    auto statuses = queue.statuses();
+    ASSERT_EQ(statuses.size(), 2u);
+    EXPECT_EQ(statuses[0].filename, "first");
+    EXPECT_EQ(statuses[0].state, UploadState::QUEUED);
+    EXPECT_EQ(statuses[1].filename, "second");
+    EXPECT_EQ(statuses[1].state, UploadState::QUEUED);
+
+    queue.start();
+    EXPECT_EQ(first.get(), 0);
+    EXPECT_EQ(second.get(), 0);
+
+    std::this_thread::sleep_for(5ms);
+    EXPECT_TRUE(queue.statuses().empty());
+}
+
+TEST(UploadQueueTest, StopRunsWhatIsQueued) {
+    UploadQueue queue({.max_concurrent = 1});
+    queue.start();
+
+    std::atomic<int> ran{0};
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 4; ++i) {
+        results.push_back(queue.enqueue(i + 1, 100, "file", 10, [&ran](UploadProgress&) {
+            ++ran;
+            return 0;
+        }));
+    }
+    queue.stop();
+
+    EXPECT_EQ(ran, 4);
+    for (auto& result : results) {
+        EXPECT_EQ(result.wait_for(0s), std::future_status::ready);
+        EXPECT_EQ(result.get(), 0);
+    }
+}
+
+}  // namespace
+}  // namespace tgfuse
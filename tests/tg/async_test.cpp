@@ -3,7 +3,9 @@
 #include <gtest/gtest.h>
 
 #include <chrono>
+#include <string>
 #include <thread>
+#include <vector>
 
 namespace tg {
 namespace {
@@ -247,5 +249,99 @@ TEST(AsyncTest, LazyEvaluation) {
     EXPECT_EQ(result, 100);
 }
 
+// A task started with resume() can be awaited later
+TEST(AsyncTest, AwaitAlreadyStartedTask) {
+    TdPromise<int> promise;
+    auto inner = [](TdPromise<int>& p) -> Task<int> { co_return co_await p; }(promise);
+    inner.resume();
+
+    auto outer = [](Task<int>& task) -> Task<int> { co_return co_await task + 1; }(inner);
+    outer.resume();
+    EXPECT_FALSE(outer.done());
+
+    promise.set_value(41);
+    EXPECT_TRUE(outer.done());
+    EXPECT_EQ(outer.get_result(), 42);
+}
+
+TEST(AsyncTest, AwaitAlreadyCompletedTask) {
+    auto inner = simple_coroutine();
+    inner.resume();
+
+    auto outer = [](Task<int>& task) -> Task<int> { co_return co_await task; }(inner);
+    EXPECT_EQ(outer.get_result(), 42);
+}
+
+// Test when_all over tasks of different types
+Task<std::string> string_coroutine() { co_return "text"; }
+
+TEST(AsyncTest, WhenAllCollectsResultsInOrder) {
+    auto [number, text, nothing] = when_all(simple_coroutine(), string_coroutine(), void_coroutine()).get_result();
+    EXPECT_EQ(number, 42);
+    EXPECT_EQ(text, "text");
+    EXPECT_EQ(nothing, std::monostate{});
+}
+
+TEST(AsyncTest, WhenAllVector) {
+    std::vector<Task<int>> tasks;
+    for (int i = 0; i < 10; ++i) {
+        tasks.push_back(stress_coroutine(i));
+    }
+
+    auto results = when_all(std::move(tasks)).get_result();
+    ASSERT_EQ(results.size(), 10);
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(results[i], i * 2);
+    }
+
+    EXPECT_TRUE(when_all(std::vector<Task<int>>{}).get_result().empty());
+}
+
+TEST(AsyncTest, WhenAllPropagatesException) {
+    auto task = when_all(simple_coroutine(), throwing_coroutine());
+    EXPECT_THROW(task.get_result(), std::runtime_error);
+}
+
+// Children complete out of order when their promises resolve out of order
+TEST(AsyncTest, WhenAllWaitsForAllPromises) {
+    TdPromise<int> first;
+    TdPromise<int> second;
+    auto await_promise = [](TdPromise<int>& p) -> Task<int> { co_return co_await p; };
+
+    auto task = when_all(await_promise(first), await_promise(second));
+    task.resume();
+    EXPECT_FALSE(task.done());
+
+    second.set_value(2);
+    EXPECT_FALSE(task.done());
+
+    first.set_value(1);
+    EXPECT_TRUE(task.done());
+    EXPECT_EQ(task.get_result(), std::make_tuple(1, 2));
+}
+
+TEST(AsyncTest, WhenAnyReturnsFirstCompleted) {
+    TdPromise<int> slow;
+    TdPromise<int> fast;
+    auto await_promise = [](TdPromise<int>& p) -> Task<int> { co_return co_await p; };
+
+    auto task = when_any(await_promise(slow), await_promise(fast));
+    task.resume();
+    EXPECT_FALSE(task.done());
+
+    fast.set_value(7);
+    ASSERT_TRUE(task.done());
+    auto result = task.get_result();
+    EXPECT_EQ(result.index, 1);
+    EXPECT_EQ(result.value, 7);
+
+    // The loser still runs to completion in the background
+    slow.set_value(0);
+}
+
+TEST(AsyncTest, WhenAnyRequiresTasks) {
+    EXPECT_THROW(when_any(std::vector<Task<int>>{}).get_result(), std::invalid_argument);
+}
+
 }  // namespace
 }  // namespace tg
@@ -3,8 +3,10 @@
 #include "tg/exceptions.hpp"
 
 #include <gtest/gtest.h>
+#include <sqlite3.h>
 
 #include <filesystem>
+#include <limits>
 #include <thread>
 
 namespace tg {
@@ -311,6 +313,87 @@ TEST_F(CacheTest, InvalidateChatMessages) {
     EXPECT_EQ(chat2_msgs.size(), 1);
 }
 
+TEST_F(CacheTest, FileListSyncWatermark) {
+    EXPECT_FALSE(cache_->get_file_list_sync(123).has_value());
+
+    // A sync that found nothing still counts as synced
+    cache_->sync_file_list(123, {}, 0);
+    auto sync = cache_->get_file_list_sync(123);
+    ASSERT_TRUE(sync.has_value());
+    EXPECT_EQ(sync->watermark, 0);
+    EXPECT_GT(sync->synced_at, 0);
+
+    FileListItem doc{10, "doc.pdf", 512, 1234567892, MediaType::DOCUMENT, "file10"};
+    cache_->sync_file_list(123, {doc}, 15);
+    EXPECT_EQ(cache_->get_file_list_sync(123)->watermark, 15);
+    EXPECT_EQ(cache_->get_cached_file_list(123).size(), 1);
+
+    // A late, older sync doesn't move the watermark back
+    cache_->sync_file_list(123, {}, 12);
+    EXPECT_EQ(cache_->get_file_list_sync(123)->watermark, 15);
+
+    cache_->invalidate_chat_files(123);
+    EXPECT_FALSE(cache_->get_file_list_sync(123).has_value());
+    EXPECT_EQ(cache_->get_cached_file_list(123).size(), 0);
+}
+
+TEST_F(CacheTest, QueuedFileItems) {
+    FileListItem photo{1, "photo.jpg", 1024, 1234567890, MediaType::PHOTO, "file1"};
+    FileListItem doc{2, "doc.pdf", 512, 1234567891, MediaType::DOCUMENT, "file2"};
+    cache_->queue_file_item(123, photo);
+    cache_->queue_file_item(123, doc);
+    cache_->queue_file_item(123, doc);
+    cache_->flush();
+
+    EXPECT_EQ(cache_->get_cached_file_list(123).size(), 2);
+    EXPECT_FALSE(cache_->get_file_list_sync(123).has_value());  // Live items don't mark the list synced
+}
+
+TEST_F(CacheTest, DownloadAccessStats) {
+    EXPECT_EQ(cache_->get_download_stats().files, 0);
+
+    cache_->queue_download_access({"file1", 1000, 1, 100});
+    cache_->queue_download_access({"file1", 1000, 1, 150});
+    cache_->queue_download_access({"file2", 500, 0, 120});  // Read ahead, not read yet
+    cache_->flush();
+    cache_->queue_download_access({"file1", 1200, 1, 140});  // Late report of an older read
+    cache_->flush();
+
+    auto stats = cache_->get_download_stats();
+    EXPECT_EQ(stats.files, 2);
+    EXPECT_EQ(stats.bytes, 1700);
+    EXPECT_EQ(stats.hits, 3);
+
+    auto all = cache_->get_download_eviction_candidates(1'000'000, 1000);
+    ASSERT_EQ(all.size(), 2);
+    EXPECT_EQ(all[1].file_id, "file1");
+    EXPECT_EQ(all[1].hits, 3);
+    EXPECT_EQ(all[1].last_access, 150);  // Access times never move back
+
+    cache_->remove_download("file1");
+    EXPECT_EQ(cache_->get_download_stats().files, 1);
+}
+
+TEST_F(CacheTest, DownloadEvictionCandidates) {
+    cache_->queue_download_access({"old", 300, 5, 100});
+    cache_->queue_download_access({"older", 200, 1, 50});
+    cache_->queue_download_access({"recent", 400, 1, 200});
+    cache_->queue_download_access({"hot", 1000, 9, 900});
+    cache_->flush();
+
+    // Least recently read first, only as many as needed
+    auto evict = cache_->get_download_eviction_candidates(250, 800);
+    ASSERT_EQ(evict.size(), 2);
+    EXPECT_EQ(evict[0].file_id, "older");
+    EXPECT_EQ(evict[1].file_id, "old");
+
+    // Files read since the cutoff are kept even if that leaves the budget exceeded
+    evict = cache_->get_download_eviction_candidates(10'000, 800);
+    EXPECT_EQ(evict.size(), 3);
+
+    EXPECT_TRUE(cache_->get_download_eviction_candidates(0, 800).empty());
+}
+
 TEST_F(CacheTest, InvalidateChat) {
     Chat chat{123, ChatType::PRIVATE, "Test", "test", 0, 0};
     Message msg{1, 123, 456, 1234567890, "Test message", std::nullopt, false};
@@ -457,5 +540,534 @@ TEST_F(CacheTest, StressTestMessageCaching) {
     }
 }
 
+
+// More reader threads than pooled connections: readers wait for a free one
+TEST_F(CacheTest, ReaderPoolSharedAcrossThreads) {
+    cache_.reset();
+    cache_ = std::make_unique<CacheManager>(temp_db_path_, 2);
+
+    for (int i = 1; i <= 50; ++i) {
+        FileListItem item{i, "file" + std::to_string(i) + ".pdf", 1024, 1234567890 + i, MediaType::DOCUMENT, "f"};
+        cache_->cache_file_item(456, item);
+    }
+
+    std::atomic<int> complete_reads{0};
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([this, &complete_reads]() {
+            for (int j = 0; j < 200; ++j) {
+                if (cache_->get_cached_file_list(456).size() >= 50) {
+                    complete_reads++;
+                }
+            }
+        });
+    }
+
+    // Keep the writer busy while the readers run
+    threads.emplace_back([this]() {
+        for (int i = 0; i < 500; ++i) {
+            Message msg{};
+            msg.id = i;
+            msg.chat_id = 456;
+            msg.timestamp = 1234567890 + i;
+            msg.text = "Message " + std::to_string(i);
+            cache_->cache_message(msg);
+        }
+    });
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(complete_reads, 8 * 200);
+    EXPECT_EQ(cache_->get_cached_messages(456, 1000).size(), 500);
+}
+
+// In-memory databases can't be shared between connections, so reads use the writer
+TEST(CacheManagerTest, InMemoryDatabase) {
+    CacheManager cache(":memory:");
+
+    User user{7, "bob", "Bob", "", "", "", true, UserStatus::UNKNOWN, 0, 0, 0};
+    cache.cache_user(user);
+
+    auto retrieved = cache.get_cached_user(7);
+    ASSERT_TRUE(retrieved.has_value());
+    EXPECT_EQ(retrieved->username, "bob");
+}
+
+
+// Write-behind queue tests
+TEST_F(CacheTest, QueuedWritesVisibleToReads) {
+    User user{42, "queued", "Queued", "", "", "", true, UserStatus::UNKNOWN, 0, 0, 0};
+    Chat chat{456, ChatType::GROUP, "Queued Group", "", 0, 0, true};
+    Message msg{};
+    msg.id = 1;
+    msg.chat_id = 456;
+    msg.timestamp = 1234567890;
+    msg.text = "queued";
+
+    cache_.reset();
+    cache_ = std::make_unique<CacheManager>(
+        temp_db_path_, CacheManager::kDefaultReaderConnections, WriteBehindConfig{std::chrono::hours(1), 1000}
+    );
+
+    cache_->queue_user(user);
+    cache_->queue_chat(chat);
+    cache_->queue_message(msg);
+
+    // Reads commit the queue first, long before the flusher would
+    EXPECT_TRUE(cache_->get_cached_user(42).has_value());
+    EXPECT_TRUE(cache_->get_cached_chat(456).has_value());
+    EXPECT_TRUE(cache_->get_cached_message(456, 1).has_value());
+}
+
+TEST_F(CacheTest, QueuedWritesFlushInBackground) {
+    cache_.reset();
+    cache_ = std::make_unique<CacheManager>(
+        temp_db_path_, CacheManager::kDefaultReaderConnections, WriteBehindConfig{std::chrono::milliseconds(10), 1000}
+    );
+
+    User user{42, "queued", "Queued", "", "", "", true, UserStatus::UNKNOWN, 0, 0, 0};
+    cache_->queue_user(user);
+
+    // Looked up behind the cache's back: its own reads would flush the queue themselves
+    sqlite3* db = nullptr;
+    ASSERT_EQ(sqlite3_open_v2(temp_db_path_.c_str(), &db, SQLITE_OPEN_READONLY, nullptr), SQLITE_OK);
+    auto stored = [db] {
+        sqlite3_stmt* stmt = nullptr;
+        sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM users WHERE id = 42", -1, &stmt, nullptr);
+        bool found = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) == 1;
+        sqlite3_finalize(stmt);
+        return found;
+    };
+
+    bool visible = false;
+    for (int i = 0; i < 200 && !visible; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        visible = stored();
+    }
+    sqlite3_close(db);
+    EXPECT_TRUE(visible);
+}
+
+TEST_F(CacheTest, FailedFlushKeepsQueuedWrites) {
+    cache_.reset();
+    cache_ = std::make_unique<CacheManager>(
+        temp_db_path_, CacheManager::kDefaultReaderConnections, WriteBehindConfig{std::chrono::hours(1), 1000}
+    );
+
+    // Every batch touching users fails until the trigger is gone
+    sqlite3* db = nullptr;
+    ASSERT_EQ(sqlite3_open(temp_db_path_.c_str(), &db), SQLITE_OK);
+    sqlite3_exec(
+        db, "CREATE TRIGGER reject_users BEFORE INSERT ON users BEGIN SELECT RAISE(ABORT, 'rejected'); END", nullptr,
+        nullptr, nullptr
+    );
+
+    User user{42, "queued", "Old", "", "", "", true, UserStatus::UNKNOWN, 0, 0, 0};
+    Chat chat{456, ChatType::GROUP, "Queued Group", "", 0, 0, true};
+    cache_->queue_user(user);
+    cache_->queue_chat(chat);
+    cache_->flush();
+
+    // Queued after the failure, so it wins over the batch put back
+    user.first_name = "New";
+    cache_->queue_user(user);
+
+    sqlite3_exec(db, "DROP TRIGGER reject_users", nullptr, nullptr, nullptr);
+    sqlite3_close(db);
+    cache_->flush();
+
+    auto cached = cache_->get_cached_user(42);
+    ASSERT_TRUE(cached.has_value());
+    EXPECT_EQ(cached->first_name, "New");
+    EXPECT_TRUE(cache_->get_cached_chat(456).has_value());
+}
+
+TEST_F(CacheTest, ReadsSeeQueuedFileItems) {
+    cache_.reset();
+    cache_ = std::make_unique<CacheManager>(
+        temp_db_path_, CacheManager::kDefaultReaderConnections, WriteBehindConfig{std::chrono::hours(1), 1000}
+    );
+
+    FileListItem item{7, "report.pdf", 1024, 1234567890, MediaType::DOCUMENT, "remote"};
+    cache_->queue_file_item(456, item);
+
+    auto files = cache_->get_cached_file_list(456, std::nullopt);
+    ASSERT_EQ(files.size(), 1);
+    EXPECT_EQ(files[0].filename, "report.pdf");
+}
+
+TEST_F(CacheTest, QueuedWritesCoalesce) {
+    for (int i = 0; i < 3; ++i) {
+        Message msg{};
+        msg.id = 1;
+        msg.chat_id = 456;
+        msg.timestamp = 1234567890;
+        msg.text = "edit " + std::to_string(i);
+        cache_->queue_message(msg);
+    }
+    cache_->flush();
+
+    auto messages = cache_->get_cached_messages(456, 10);
+    ASSERT_EQ(messages.size(), 1);
+    EXPECT_EQ(messages[0].text, "edit 2");
+}
+
+TEST_F(CacheTest, QueuedStatsIncrements) {
+    ChatMessageStats stats;
+    stats.chat_id = 456;
+    stats.message_count = 10;
+    stats.content_size = 2048;
+    stats.last_message_time = 1000;
+    stats.oldest_message_time = 500;
+    cache_->update_chat_message_stats(stats);
+
+    for (int i = 0; i < 3; ++i) {
+        Message msg{};
+        msg.id = 100 + i;
+        msg.chat_id = 456;
+        msg.timestamp = 2000 + i;
+        cache_->queue_message_stats_increment(msg);
+    }
+    cache_->flush();
+
+    auto result = cache_->get_chat_message_stats(456);
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(result->message_count, 13);
+    EXPECT_EQ(result->content_size, 2048);
+    EXPECT_EQ(result->last_message_time, 2002);
+    EXPECT_EQ(result->oldest_message_time, 500);
+
+    // A full stats row replaces increments queued before it
+    Message late{};
+    late.chat_id = 456;
+    late.timestamp = 3000;
+    cache_->queue_message_stats_increment(late);
+    stats.message_count = 1;
+    cache_->queue_chat_message_stats(stats);
+    cache_->flush();
+
+    result = cache_->get_chat_message_stats(456);
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(result->message_count, 1);
+}
+
+TEST_F(CacheTest, SynchronousWriteAppliesQueueFirst) {
+    Message msg{};
+    msg.id = 1;
+    msg.chat_id = 456;
+    msg.timestamp = 100;
+    msg.text = "old";
+    cache_->queue_message(msg);
+
+    // Eviction must see the queued row, not race with it
+    cache_->evict_old_messages(456, 200);
+    cache_->flush();
+
+    EXPECT_FALSE(cache_->get_cached_message(456, 1).has_value());
+}
+
+TEST_F(CacheTest, QueuedWritesSurviveShutdown) {
+    cache_.reset();
+    cache_ = std::make_unique<CacheManager>(
+        temp_db_path_, CacheManager::kDefaultReaderConnections, WriteBehindConfig{std::chrono::hours(1), 1000}
+    );
+
+    User user{42, "queued", "Queued", "", "", "", true, UserStatus::UNKNOWN, 0, 0, 0};
+    cache_->queue_user(user);
+
+    cache_.reset();
+    cache_ = std::make_unique<CacheManager>(temp_db_path_);
+    EXPECT_TRUE(cache_->get_cached_user(42).has_value());
+}
+
+TEST_F(CacheTest, SettingsPersist) {
+    EXPECT_FALSE(cache_->get_setting("current_user_id").has_value());
+
+    cache_->set_setting("current_user_id", "42");
+    cache_->set_setting("current_user_id", "43");
+    cache_->clear_all();
+
+    cache_.reset();
+    cache_ = std::make_unique<CacheManager>(temp_db_path_);
+    EXPECT_EQ(cache_->get_setting("current_user_id"), "43");
+}
+
+TEST_F(CacheTest, CompactedMessagesStayReadable) {
+    MessageStoreConfig store;
+    store.compact = true;
+    store.dictionary_bytes = 4096;
+    cache_.reset();
+    cache_ = std::make_unique<CacheManager>(
+        temp_db_path_, CacheManager::kDefaultReaderConnections, WriteBehindConfig{}, store
+    );
+
+    auto now = std::time(nullptr);
+    auto sealed_start = now - 2 * 24 * 3600;
+    std::vector<Message> messages;
+    for (int i = 0; i < 300; ++i) {
+        messages.push_back({i + 1, 1, 7, sealed_start + i * 60, "Old message number " + std::to_string(i), {}, false});
+    }
+    for (int i = 0; i < 5; ++i) {
+        messages.push_back({1000 + i, 1, 7, now - 60 + i, "Recent " + std::to_string(i), {}, true});
+    }
+    cache_->cache_messages(messages);
+    cache_->compact_messages();
+
+    auto sealed = cache_->get_cached_message(1, 42);
+    ASSERT_TRUE(sealed.has_value());
+    EXPECT_EQ(sealed->text, "Old message number 41");
+    EXPECT_EQ(sealed->chat_id, 1);
+
+    auto newest = cache_->get_cached_messages(1, 10);
+    ASSERT_EQ(newest.size(), 10u);
+    EXPECT_EQ(newest[0].id, 1004);
+    EXPECT_EQ(newest[5].id, 300);
+    EXPECT_EQ(cache_->get_last_n_messages(1, 1000).size(), 305u);
+
+    auto display = cache_->get_messages_for_display(1, 3 * 24 * 3600);
+    ASSERT_EQ(display.size(), 305u);
+    EXPECT_EQ(display.front().id, 1);
+    EXPECT_EQ(display.back().id, 1004);
+
+    // An edit to a sealed message overrides the page, before and after it is folded in
+    Message edited{42, 1, 7, sealed_start + 41 * 60, "Edited", {}, false};
+    cache_->cache_message(edited);
+    EXPECT_EQ(cache_->get_cached_message(1, 42)->text, "Edited");
+    cache_->compact_messages();
+    EXPECT_EQ(cache_->get_cached_message(1, 42)->text, "Edited");
+    EXPECT_EQ(cache_->get_messages_for_display(1, 3 * 24 * 3600).size(), 305u);
+
+    // Pages are read without compaction enabled, and eviction trims them
+    cache_.reset();
+    cache_ = std::make_unique<CacheManager>(temp_db_path_);
+    cache_->evict_old_messages(1, sealed_start + 150 * 60);
+    EXPECT_FALSE(cache_->get_cached_message(1, 42).has_value());
+    EXPECT_TRUE(cache_->get_cached_message(1, 151).has_value());
+    EXPECT_EQ(cache_->get_last_n_messages(1, 1000).size(), 155u);
+}
+
+TEST_F(CacheTest, SearchMessages) {
+    auto now = std::time(nullptr);
+    Message report{1, 10, 7, now - 300, "Quarterly report is ready", {}, false};
+    Message lunch{2, 10, 7, now - 200, "Lunch at noon?", {}, true};
+    Message other{3, 20, 8, now - 100, "The report draft", {}, false};
+    Message attachment{4, 20, 8, now - 50, "", {}, false};
+    attachment.media =
+        MediaInfo{MediaType::DOCUMENT, "file-1", "budget-2024.xlsx", "application/vnd.ms-excel", 10, {}, {}, {}, {}};
+    cache_->cache_messages({report, lunch, other, attachment});
+
+    auto hits = cache_->search_messages("report");
+    ASSERT_EQ(hits.size(), 2u);
+    EXPECT_EQ(hits[0].id, 3);  // Newest first
+    EXPECT_EQ(hits[1].id, 1);
+
+    EXPECT_EQ(cache_->search_messages("report", 10).size(), 1u);
+    EXPECT_EQ(cache_->search_messages("quarter*").size(), 1u);
+    EXPECT_EQ(cache_->search_messages("report ready").size(), 1u);
+    EXPECT_EQ(cache_->search_messages("budget").size(), 1u);  // Attachment filenames are indexed
+    EXPECT_TRUE(cache_->search_messages("noon? \"quoted").empty());
+    EXPECT_TRUE(cache_->search_messages("  ").empty());
+    EXPECT_TRUE(cache_->search_messages("-").empty());
+
+    // Edits replace the indexed text
+    lunch.text = "Dinner at eight";
+    cache_->cache_message(lunch);
+    EXPECT_TRUE(cache_->search_messages("lunch").empty());
+    EXPECT_EQ(cache_->search_messages("dinner").size(), 1u);
+
+    cache_->evict_old_messages(10, now - 250);
+    EXPECT_TRUE(cache_->search_messages("quarterly").empty());
+    cache_->invalidate_chat_messages(20);
+    EXPECT_TRUE(cache_->search_messages("report").empty());
+    EXPECT_EQ(cache_->search_messages("dinner").size(), 1u);
+}
+
+TEST_F(CacheTest, SearchFindsSealedMessages) {
+    MessageStoreConfig store;
+    store.compact = true;
+    cache_.reset();
+    cache_ = std::make_unique<CacheManager>(
+        temp_db_path_, CacheManager::kDefaultReaderConnections, WriteBehindConfig{}, store
+    );
+
+    auto old = std::time(nullptr) - 2 * 24 * 3600;
+    cache_->cache_messages({
+        {1, 10, 7, old, "Archived announcement", {}, false},
+        {2, 10, 7, old + 60, "Another archived note", {}, false},
+    });
+    cache_->compact_messages();
+
+    auto hits = cache_->search_messages("archived");
+    ASSERT_EQ(hits.size(), 2u);
+    EXPECT_EQ(hits[0].text, "Another archived note");
+    EXPECT_EQ(hits[1].text, "Archived announcement");
+}
+
+TEST_F(CacheTest, MessageDayBuckets) {
+    auto today = local_day_start(std::time(nullptr));
+    auto yesterday = local_day_start(today - 1);
+    EXPECT_EQ(local_day_end(yesterday), today);
+
+    cache_->cache_messages({
+        {1, 10, 7, yesterday + 60, "Yesterday morning", {}, false},
+        {2, 10, 7, yesterday + 3600, "Yesterday later", {}, false},
+        {3, 10, 7, today + 60, "Today", {}, true},
+    });
+
+    auto buckets = cache_->get_message_buckets(10);
+    ASSERT_EQ(buckets.size(), 2u);
+    EXPECT_EQ(buckets[0].start_ts, yesterday);
+    EXPECT_EQ(buckets[0].end_ts, today);
+    EXPECT_TRUE(buckets[0].is_stale());
+
+    auto day = cache_->get_messages_in_range(10, buckets[0].start_ts, buckets[0].end_ts);
+    ASSERT_EQ(day.size(), 2u);
+    EXPECT_EQ(day[1].text, "Yesterday later");
+
+    auto sized = buckets[0];
+    sized.content_size = 123;
+    sized.message_count = day.size();
+    sized.last_message_time = day.back().timestamp;
+    EXPECT_TRUE(cache_->store_message_bucket(10, sized));
+    buckets = cache_->get_message_buckets(10);
+    EXPECT_EQ(buckets[0].content_size, 123u);
+    EXPECT_EQ(buckets[0].message_count, 2u);
+
+    // A write into the day after it was read makes the rendered size stale
+    cache_->cache_message({4, 10, 7, yesterday + 7200, "Late arrival", {}, false});
+    EXPECT_FALSE(cache_->store_message_bucket(10, sized));
+    buckets = cache_->get_message_buckets(10);
+    EXPECT_TRUE(buckets[0].is_stale());
+    EXPECT_EQ(cache_->get_message_buckets(10, today).size(), 1u);
+
+    // Eviction drops whole days and marks the one it cuts into stale
+    sized = buckets[1];
+    sized.content_size = 10;
+    ASSERT_TRUE(cache_->store_message_bucket(10, sized));
+    cache_->evict_old_messages(10, today);
+    buckets = cache_->get_message_buckets(10);
+    ASSERT_EQ(buckets.size(), 1u);
+    EXPECT_EQ(buckets[0].start_ts, today);
+    EXPECT_FALSE(buckets[0].is_stale());
+
+    cache_->invalidate_chat_messages(10);
+    EXPECT_TRUE(cache_->get_message_buckets(10).empty());
+}
+
+TEST_F(CacheTest, MessageRangeIncludesPages) {
+    MessageStoreConfig store;
+    store.compact = true;
+    cache_.reset();
+    cache_ = std::make_unique<CacheManager>(
+        temp_db_path_, CacheManager::kDefaultReaderConnections, WriteBehindConfig{}, store
+    );
+
+    auto old = local_day_start(std::time(nullptr) - 3 * 24 * 3600);
+    std::vector<Message> messages;
+    for (int i = 0; i < 48; ++i) {
+        messages.push_back({i + 1, 10, 7, old + i * 3600, "Hourly " + std::to_string(i), {}, false});
+    }
+    cache_->cache_messages(messages);
+    cache_->compact_messages();
+
+    auto first_day = cache_->get_messages_in_range(10, old, local_day_end(old));
+    ASSERT_FALSE(first_day.empty());
+    EXPECT_EQ(first_day.front().id, 1);
+    for (const auto& msg : first_day) {
+        EXPECT_LT(msg.timestamp, local_day_end(old));
+    }
+    auto rest = cache_->get_messages_in_range(10, local_day_end(old), std::numeric_limits<int64_t>::max());
+    EXPECT_EQ(first_day.size() + rest.size(), 48u);
+    EXPECT_GE(cache_->get_message_buckets(10).size(), 2u);
+}
+
+TEST_F(CacheTest, ExpireMessagesInBatches) {
+    auto now = std::time(nullptr);
+    std::vector<Message> messages;
+    for (int i = 0; i < 12; ++i) {
+        messages.push_back({i + 1, 1 + i % 2, 7, 1000 + i, "Expired " + std::to_string(i), {}, false});
+    }
+    messages.push_back({100, 1, 7, now, "Kept", {}, false});
+    cache_->cache_messages(messages);
+
+    EXPECT_EQ(cache_->expire_messages(now - 60, 5), 5u);
+    EXPECT_EQ(cache_->expire_messages(now - 60, 5), 5u);
+    EXPECT_EQ(cache_->expire_messages(now - 60, 5), 2u);
+    EXPECT_EQ(cache_->expire_messages(now - 60, 5), 0u);
+
+    auto left = cache_->get_last_n_messages(1, 100);
+    ASSERT_EQ(left.size(), 1u);
+    EXPECT_EQ(left[0].text, "Kept");
+    EXPECT_TRUE(cache_->get_last_n_messages(2, 100).empty());
+    EXPECT_TRUE(cache_->search_messages("expired").empty());
+    EXPECT_EQ(cache_->search_messages("kept").size(), 1u);
+}
+
+TEST_F(CacheTest, MaintenanceAppliesRetention) {
+    MessageStoreConfig store;
+    store.compact = true;
+    cache_.reset();
+    cache_ = std::make_unique<CacheManager>(
+        temp_db_path_, CacheManager::kDefaultReaderConnections, WriteBehindConfig{}, store
+    );
+
+    auto now = std::time(nullptr);
+    std::vector<Message> messages;
+    for (int i = 0; i < 20; ++i) {
+        messages.push_back({i + 1, 1, 7, now - 3 * 24 * 3600 + i * 3600, "Sealed", {}, false});
+    }
+    messages.push_back({100, 1, 7, now - 60, "Recent", {}, false});
+    cache_->cache_messages(messages);
+    cache_->compact_messages();  // The old ones are pages now
+
+    // Without a retention, maintenance deletes nothing
+    EXPECT_EQ(cache_->run_maintenance(), 0u);
+    EXPECT_EQ(cache_->get_last_n_messages(1, 100).size(), 21u);
+
+    cache_->set_message_retention(std::chrono::hours(24));
+    EXPECT_GT(cache_->run_maintenance(), 0u);
+    auto left = cache_->get_last_n_messages(1, 100);
+    ASSERT_EQ(left.size(), 1u);
+    EXPECT_EQ(left[0].id, 100);
+    EXPECT_EQ(cache_->run_maintenance(), 0u);
+}
+
+TEST_F(CacheTest, DatabaseUsesIncrementalVacuum) {
+    auto auto_vacuum = [this] {
+        sqlite3* db = nullptr;
+        sqlite3_open_v2(temp_db_path_.c_str(), &db, SQLITE_OPEN_READONLY, nullptr);
+        sqlite3_stmt* stmt = nullptr;
+        sqlite3_prepare_v2(db, "PRAGMA auto_vacuum", -1, &stmt, nullptr);
+        int mode = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : -1;
+        sqlite3_finalize(stmt);
+        sqlite3_close(db);
+        return mode;
+    };
+    constexpr int kIncremental = 2;
+    EXPECT_EQ(auto_vacuum(), kIncremental);
+
+    // A database created without it is left alone by maintenance ticks, and converted on request
+    cache_.reset();
+    fs::remove(temp_db_path_);
+    sqlite3* db = nullptr;
+    sqlite3_open(temp_db_path_.c_str(), &db);
+    sqlite3_exec(db, "CREATE TABLE settings (key TEXT PRIMARY KEY, value TEXT NOT NULL)", nullptr, nullptr, nullptr);
+    sqlite3_close(db);
+    ASSERT_EQ(auto_vacuum(), 0);
+
+    cache_ = std::make_unique<CacheManager>(temp_db_path_);
+    EXPECT_TRUE(cache_->vacuum_mode_pending());
+    cache_->run_maintenance();
+    EXPECT_EQ(auto_vacuum(), 0);
+
+    EXPECT_TRUE(cache_->convert_vacuum_mode());
+    EXPECT_FALSE(cache_->vacuum_mode_pending());
+    EXPECT_EQ(auto_vacuum(), kIncremental);
+    EXPECT_FALSE(cache_->convert_vacuum_mode());
+}
+
 }  // namespace
 }  // namespace tg
@@ -0,0 +1,116 @@
+#include "tg/completion_table.hpp"
+#include "tg/inplace_function.hpp"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tg {
+namespace {
+
+using Clock = CompletionTable<int>::Clock;
+
+TEST(InplaceFunctionTest, StoresMovesAndDestroysTheCallable) {
+    auto counter = std::make_shared<int>(0);
+    InplaceFunction<int(int)> add = [counter](int n) { return *counter += n; };
+    EXPECT_TRUE(add);
+    EXPECT_EQ(add(2), 2);
+
+    InplaceFunction<int(int)> moved = std::move(add);
+    EXPECT_FALSE(add);
+    EXPECT_EQ(moved(3), 5);
+    EXPECT_EQ(counter.use_count(), 2);
+
+    moved = nullptr;
+    EXPECT_FALSE(moved);
+    EXPECT_EQ(counter.use_count(), 1);
+}
+
+TEST(InplaceFunctionTest, AcceptsMoveOnlyCallablesAndFunctionPointers) {
+    auto value = std::make_unique<std::string>("payload");
+    InplaceFunction<std::string()> take = [value = std::move(value)]() { return *value; };
+    EXPECT_EQ(take(), "payload");
+
+    InplaceFunction<int(int)> negate = +[](int n) { return -n; };
+    EXPECT_EQ(negate(4), -4);
+}
+
+TEST(CompletionTableTest, TakeReturnsTheEntryOnce) {
+    CompletionTable<std::string> table(4);
+    auto id = table.insert("first");
+    ASSERT_NE(id, 0u);
+    EXPECT_EQ(table.size(), 1u);
+
+    EXPECT_EQ(table.take(id), "first");
+    EXPECT_FALSE(table.take(id).has_value());  // Duplicate completion
+    EXPECT_FALSE(table.take(0).has_value());
+    EXPECT_FALSE(table.take(12345).has_value());
+    EXPECT_EQ(table.size(), 0u);
+}
+
+TEST(CompletionTableTest, ReusedSlotsIgnoreStaleIds) {
+    CompletionTable<int> table(1);
+    auto first = table.insert(1);
+    EXPECT_EQ(table.insert(2), 0u);  // Full
+    ASSERT_TRUE(table.take(first).has_value());
+
+    auto second = table.insert(3);
+    ASSERT_NE(second, 0u);
+    EXPECT_NE(second, first);
+    EXPECT_FALSE(table.take(first).has_value());  // Late response for the old query
+    EXPECT_EQ(table.take(second), 3);
+}
+
+TEST(CompletionTableTest, ExpireTakesOnlyEntriesPastTheirDeadline) {
+    CompletionTable<int> table(8);
+    auto now = Clock::now();
+    auto soon = table.insert(1, now + std::chrono::seconds(1));
+    auto later = table.insert(2, now + std::chrono::hours(1));
+    auto never = table.insert(3);
+
+    std::vector<int> expired;
+    table.expire(now + std::chrono::seconds(2), [&](int entry) { expired.push_back(entry); });
+    EXPECT_EQ(expired, std::vector<int>{1});
+    EXPECT_FALSE(table.take(soon).has_value());
+
+    table.expire(Clock::time_point::max(), [&](int entry) { expired.push_back(entry); });
+    EXPECT_EQ(expired.size(), 3u);
+    EXPECT_FALSE(table.take(later).has_value());
+    EXPECT_FALSE(table.take(never).has_value());
+    EXPECT_EQ(table.size(), 0u);
+}
+
+TEST(CompletionTableTest, ConcurrentInsertsAndTakes) {
+    constexpr int kThreads = 8;
+    constexpr int kRounds = 5000;
+    CompletionTable<std::unique_ptr<int>> table(16);
+
+    std::atomic<int> completed{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < kRounds; ++i) {
+                uint64_t id = 0;
+                while ((id = table.insert(std::make_unique<int>(t))) == 0) {
+                    std::this_thread::yield();  // Other threads hold every slot
+                }
+                auto entry = table.take(id);
+                if (entry && **entry == t) {
+                    completed.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(completed.load(), kThreads * kRounds);
+    EXPECT_EQ(table.size(), 0u);
+}
+
+}  // namespace
+}  // namespace tg
@@ -0,0 +1,277 @@
+#include "tg/executor.hpp"
+
+#include "tg/async.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tg {
+namespace {
+
+using namespace std::chrono_literals;
+
+TEST(ExecutorTest, InlineExecutorRunsImmediately) {
+    InlineExecutor executor;
+    bool ran = false;
+    executor.post([&ran] { ran = true; });
+    EXPECT_TRUE(ran);
+}
+
+TEST(ExecutorTest, ThreadPoolRunsPostedWork) {
+    std::atomic<int> count{0};
+    {
+        ThreadPoolExecutor pool(4);
+        EXPECT_EQ(pool.size(), 4);
+        for (int i = 0; i < 1000; ++i) {
+            pool.post([&count] { count++; });
+        }
+    }  // Destructor runs everything already posted
+    EXPECT_EQ(count, 1000);
+}
+
+TEST(ExecutorTest, DelayedWorkRunsInDeadlineOrder) {
+    ThreadPoolExecutor pool(1);
+    std::mutex mutex;
+    std::vector<int> order;
+    std::atomic<int> remaining{3};
+
+    auto record = [&](int value) {
+        return [&, value] {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(value);
+            remaining--;
+        };
+    };
+
+    pool.post_after(60ms, record(3));
+    pool.post_after(20ms, record(1));
+    pool.post_after(40ms, record(2));
+
+    while (remaining > 0) {
+        std::this_thread::sleep_for(5ms);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(order, (std::vector<int>{1, 2, 3}));
+}
+
+Task<std::thread::id> continue_on(Executor& executor) {
+    co_await executor.schedule();
+    co_return std::this_thread::get_id();
+}
+
+TEST(ExecutorTest, ScheduleResumesOnPoolThread) {
+    ThreadPoolExecutor pool(1);
+    auto task = continue_on(pool);
+
+    // get_result blocks until the pool thread finishes the coroutine
+    auto thread_id = task.get_result();
+    EXPECT_NE(thread_id, std::this_thread::get_id());
+    EXPECT_TRUE(task.done());
+}
+
+Task<int> delayed_value(Executor& executor, int value) {
+    co_await executor.schedule_after(50ms);
+    co_return value;
+}
+
+Task<int> sum_delayed(Executor& executor) {
+    auto a = co_await delayed_value(executor, 1);
+    auto b = co_await delayed_value(executor, 2);
+    co_return a + b;
+}
+
+TEST(ExecutorTest, NestedAwaitsAcrossThreads) {
+    ThreadPoolExecutor pool(2);
+    auto task = sum_delayed(pool);
+    EXPECT_EQ(task.get_result(), 3);
+}
+
+// Suspended tasks don't hold a thread: many waits overlap on a small pool
+TEST(ExecutorTest, ManyTasksInFlight) {
+    ThreadPoolExecutor pool(2);
+    const int num_tasks = 100;
+
+    std::vector<Task<int>> tasks;
+    for (int i = 0; i < num_tasks; ++i) {
+        tasks.push_back(delayed_value(pool, i));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto& task : tasks) {
+        task.resume();
+    }
+
+    int sum = 0;
+    for (auto& task : tasks) {
+        sum += task.get_result();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(sum, num_tasks * (num_tasks - 1) / 2);
+    EXPECT_LT(elapsed, 2s);  // Sequential waits would take 5s
+}
+
+Task<int> failing_after_schedule(Executor& executor) {
+    co_await executor.schedule();
+    throw std::runtime_error("Async error");
+    co_return 0;
+}
+
+TEST(ExecutorTest, ExceptionPropagatesAcrossThreads) {
+    ThreadPoolExecutor pool(1);
+    auto task = failing_after_schedule(pool);
+    EXPECT_THROW(task.get_result(), std::runtime_error);
+}
+
+// Fan-out: concurrent delays overlap instead of adding up
+TEST(ExecutorTest, WhenAllRunsConcurrently) {
+    ThreadPoolExecutor pool(2);
+
+    auto start = std::chrono::steady_clock::now();
+    auto [a, b, c] =
+        when_all(delayed_value(pool, 1), delayed_value(pool, 2), delayed_value(pool, 3)).get_result();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(a + b + c, 6);
+    EXPECT_LT(elapsed, 140ms);  // Sequential awaits would take 150ms
+}
+
+Task<int> value_after(Executor& executor, std::chrono::milliseconds delay, int value) {
+    co_await executor.schedule_after(delay);
+    co_return value;
+}
+
+TEST(ExecutorTest, WhenAnyDoesNotWaitForSlowTasks) {
+    ThreadPoolExecutor pool(2);
+
+    auto start = std::chrono::steady_clock::now();
+    auto result = when_any(value_after(pool, 300ms, 1), value_after(pool, 10ms, 2)).get_result();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(result.index, 1);
+    EXPECT_EQ(result.value, 2);
+    EXPECT_LT(elapsed, 200ms);
+
+    // Let the loser finish before the pool (and its delayed work) goes away
+    std::this_thread::sleep_for(400ms);
+}
+
+TEST(ExecutorScopeTest, RunsPostedWork) {
+    ThreadPoolExecutor pool(2);
+    ExecutorScope scope(pool);
+    std::atomic<int> count{0};
+    for (int i = 0; i < 100; ++i) {
+        scope.post([&count] { count++; });
+    }
+    scope.post_after(10ms, [&count] { count += 100; });
+    scope.close();  // Waits for the queued work, cancels the delayed one
+    EXPECT_EQ(count, 100);
+    EXPECT_EQ(scope.pending(), 0u);
+}
+
+TEST(ExecutorScopeTest, DelayedWorkRunsBeforeClose) {
+    ThreadPoolExecutor pool(1);
+    ExecutorScope scope(pool);
+    std::atomic<bool> ran{false};
+    std::atomic<bool> cancelled{false};
+    scope.post_after(5ms, [&ran] { ran = true; }, [&cancelled] { cancelled = true; });
+    while (scope.pending() > 0) {
+        std::this_thread::sleep_for(1ms);
+    }
+    scope.close();
+    EXPECT_TRUE(ran);
+    EXPECT_FALSE(cancelled);
+}
+
+TEST(ExecutorScopeTest, CloseCancelsDelayedWork) {
+    ThreadPoolExecutor pool(1);
+    std::atomic<bool> ran{false};
+    int cancelled = 0;
+    {
+        ExecutorScope scope(pool);
+        scope.post_after(50ms, [&ran] { ran = true; }, [&cancelled] { ++cancelled; });
+        scope.post_after(60ms, [&ran] { ran = true; }, [&cancelled] { ++cancelled; });
+        EXPECT_EQ(scope.pending(), 2u);
+        scope.close();
+        EXPECT_EQ(cancelled, 2);  // On the closing thread, before close() returns
+
+        // Closed: plain work is dropped, delayed work is cancelled right away
+        EXPECT_FALSE(scope.post([&ran] { ran = true; }));
+        scope.post_after(1ms, [&ran] { ran = true; }, [&cancelled] { ++cancelled; });
+        EXPECT_EQ(cancelled, 3);
+        EXPECT_TRUE(scope.closed());
+    }
+    std::this_thread::sleep_for(80ms);  // The executor's copies fire after the scope is gone
+    EXPECT_FALSE(ran);
+}
+
+TEST(ExecutorScopeTest, CloseWaitsForRunningWork) {
+    ThreadPoolExecutor pool(2);
+    ExecutorScope scope(pool);
+    std::atomic<bool> started{false};
+    std::atomic<bool> finished{false};
+    scope.post([&] {
+        started = true;
+        std::this_thread::sleep_for(30ms);
+        finished = true;
+    });
+    while (!started) {
+        std::this_thread::sleep_for(1ms);
+    }
+    scope.close();
+    EXPECT_TRUE(finished);
+}
+
+TEST(ExecutorScopeTest, CloseFromItsOwnWork) {
+    ThreadPoolExecutor pool(1);
+    ExecutorScope scope(pool);
+    std::atomic<bool> closed{false};
+    scope.post([&] {
+        scope.close();  // Doesn't wait for itself
+        closed = true;
+    });
+    while (!closed) {
+        std::this_thread::sleep_for(1ms);
+    }
+    EXPECT_TRUE(scope.closed());
+}
+
+Task<bool> wait_in(ExecutorScope& scope, Executor::Clock::duration delay) {
+    co_return co_await scope.schedule_after(delay);
+}
+
+TEST(ExecutorScopeTest, ScheduleAfterCancelledByClose) {
+    ThreadPoolExecutor pool(1);
+    ExecutorScope scope(pool);
+    EXPECT_TRUE(wait_in(scope, 1ms).get_result());
+
+    // Resumed by close() on the closing thread, long before the delay
+    auto task = wait_in(scope, 1h);
+    std::thread closer([&scope] {
+        std::this_thread::sleep_for(20ms);
+        scope.close();
+    });
+    EXPECT_FALSE(task.get_result());
+    closer.join();
+}
+
+TEST(ExecutorScopeTest, InlineExecutor) {
+    InlineExecutor executor;
+    ExecutorScope scope(executor);
+    int count = 0;
+    scope.post([&] {
+        scope.post([&] { ++count; });  // Nested inline work of the same scope
+        ++count;
+    });
+    EXPECT_EQ(count, 2);
+    EXPECT_EQ(scope.pending(), 0u);
+}
+
+}  // namespace
+}  // namespace tg
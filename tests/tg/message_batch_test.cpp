@@ -0,0 +1,91 @@
+#include "tg/message_batch.hpp"
+#include "tg/message_pages.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tg {
+namespace {
+
+Message make_photo(int64_t id, std::string text) {
+    Message msg{id, 7, 1000, 1700000000 + id, std::move(text), std::nullopt, false};
+    MediaInfo media{};
+    media.type = MediaType::PHOTO;
+    media.file_id = "file-" + std::to_string(id);
+    media.filename = "photo.jpg";
+    media.mime_type = "image/jpeg";
+    media.file_size = 1024 * id;
+    media.local_path = "/tmp/photo-" + std::to_string(id) + ".jpg";
+    media.width = 1280;
+    msg.media = std::move(media);
+    return msg;
+}
+
+TEST(MessageBatchTest, CopiesOutlivePushedMessages) {
+    MessageBatch batch;
+    {
+        auto first = make_photo(1, "A caption long enough to need a heap allocation of its own");
+        auto second = make_photo(2, "");
+        batch.push_back(first);
+        batch.push_back(second);
+    }
+
+    ASSERT_EQ(batch.size(), 2u);
+    EXPECT_EQ(batch[0].text, "A caption long enough to need a heap allocation of its own");
+    EXPECT_TRUE(batch[1].text.empty());
+    ASSERT_TRUE(batch[0].media.has_value());
+    EXPECT_EQ(batch[0].media->file_id, "file-1");
+    EXPECT_EQ(batch[0].media->local_path, "/tmp/photo-1.jpg");
+    EXPECT_EQ(batch[0].media->width, 1280);
+    EXPECT_FALSE(batch[0].media->height.has_value());
+
+    // Repeated mime types and filenames share one copy
+    EXPECT_EQ(batch[0].media->mime_type.data(), batch[1].media->mime_type.data());
+    EXPECT_EQ(batch[0].media->filename.data(), batch[1].media->filename.data());
+
+    auto owned = batch.to_messages();
+    ASSERT_EQ(owned.size(), 2u);
+    EXPECT_EQ(owned[1].media->file_id, "file-2");
+    EXPECT_EQ(owned[1].media->file_size, 2048);
+}
+
+TEST(MessageBatchTest, ViewsSurviveMovesAndGrowth) {
+    MessageBatch batch;
+    batch.push_back(make_photo(1, "first"));
+    auto text = batch[0].text;
+    for (int64_t id = 2; id <= 500; ++id) {
+        batch.push_back(make_photo(id, "message " + std::to_string(id)));
+    }
+
+    MessageBatch moved = std::move(batch);
+    EXPECT_EQ(moved.size(), 500u);
+    EXPECT_EQ(text, "first");
+    EXPECT_EQ(moved.back().text, "message 500");
+
+    moved.erase(moved.begin() + 1, moved.end() - 1);
+    ASSERT_EQ(moved.size(), 2u);
+    EXPECT_EQ(moved[1].id, 500);
+}
+
+TEST(MessageBatchTest, DecodesPagesIntoTheArena) {
+    std::vector<Message> messages{make_photo(1, "one"), make_photo(2, "two")};
+    messages[1].media.reset();
+    auto page = encode_message_page(messages);
+
+    MessageBatch batch;
+    decode_message_page(page, 42, batch);
+    page.clear();  // The views point into the batch, not the page
+
+    ASSERT_EQ(batch.size(), 2u);
+    EXPECT_EQ(batch[0].chat_id, 42);
+    EXPECT_EQ(batch[0].text, "one");
+    EXPECT_EQ(batch[0].media->filename, "photo.jpg");
+    EXPECT_EQ(batch[1].text, "two");
+    EXPECT_FALSE(batch[1].has_media());
+}
+
+}  // namespace
+}  // namespace tg
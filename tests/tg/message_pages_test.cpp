@@ -0,0 +1,107 @@
+#include "tg/exceptions.hpp"
+#include "tg/message_pages.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace tg {
+namespace {
+
+Message make_message(int64_t id, int64_t timestamp, std::string text) {
+    Message msg{};
+    msg.id = id;
+    msg.chat_id = 7;
+    msg.sender_id = 1000 + id % 3;
+    msg.timestamp = timestamp;
+    msg.text = std::move(text);
+    msg.is_outgoing = id % 2 == 0;
+    return msg;
+}
+
+std::vector<Message> make_messages(int count) {
+    std::vector<Message> messages;
+    for (int i = 0; i < count; ++i) {
+        auto text = "Status update number " + std::to_string(i);
+        messages.push_back(make_message(1048576 * (i + 1), 1700000000 + 60 * i, text));
+    }
+    return messages;
+}
+
+TEST(MessagePagesTest, RoundTripsEveryField) {
+    auto messages = make_messages(3);
+    MediaInfo media{};
+    media.type = MediaType::PHOTO;
+    media.file_id = "AgACAgIAAxkBAAI";
+    media.filename = "photo.jpg";
+    media.mime_type = "image/jpeg";
+    media.file_size = 123456;
+    media.local_path = "/tmp/photo.jpg";
+    media.width = 1280;
+    media.height = 720;
+    messages[1].media = media;
+    messages[2].sender_id = -100123;  // Sent on behalf of a channel
+
+    auto page = encode_message_page(messages);
+    std::vector<Message> decoded;
+    decode_message_page(page, 42, decoded);
+
+    ASSERT_EQ(decoded.size(), messages.size());
+    for (std::size_t i = 0; i < messages.size(); ++i) {
+        EXPECT_EQ(decoded[i].id, messages[i].id);
+        EXPECT_EQ(decoded[i].chat_id, 42);
+        EXPECT_EQ(decoded[i].sender_id, messages[i].sender_id);
+        EXPECT_EQ(decoded[i].timestamp, messages[i].timestamp);
+        EXPECT_EQ(decoded[i].text, messages[i].text);
+        EXPECT_EQ(decoded[i].is_outgoing, messages[i].is_outgoing);
+        EXPECT_EQ(decoded[i].media.has_value(), messages[i].media.has_value());
+    }
+    ASSERT_TRUE(decoded[1].media.has_value());
+    EXPECT_EQ(decoded[1].media->filename, "photo.jpg");
+    EXPECT_EQ(decoded[1].media->local_path, "/tmp/photo.jpg");
+    EXPECT_EQ(decoded[1].media->width, 1280);
+    EXPECT_EQ(decoded[1].media->height, 720);
+    EXPECT_FALSE(decoded[1].media->duration.has_value());
+}
+
+TEST(MessagePagesTest, DecodeAppends) {
+    std::vector<Message> decoded;
+    decode_message_page(encode_message_page(make_messages(2)), 7, decoded);
+    decode_message_page(encode_message_page({}), 7, decoded);
+    decode_message_page(encode_message_page(make_messages(1)), 7, decoded);
+    EXPECT_EQ(decoded.size(), 3u);
+}
+
+TEST(MessagePagesTest, DictionaryShrinksSmallPages) {
+    auto samples = make_messages(200);
+    auto dictionary = train_message_dictionary(samples, 4096);
+    EXPECT_FALSE(dictionary.empty());
+    EXPECT_LE(dictionary.size(), 4096u);
+    EXPECT_NE(dictionary.find("Status"), std::string::npos);
+
+    std::vector<Message> small{make_message(5, 1700000000, "Status update number 5")};
+    auto plain = encode_message_page(small);
+    auto with_dictionary = encode_message_page(small, dictionary);
+    EXPECT_LT(with_dictionary.size(), plain.size());
+
+    std::vector<Message> decoded;
+    decode_message_page(with_dictionary, 7, decoded, dictionary);
+    ASSERT_EQ(decoded.size(), 1u);
+    EXPECT_EQ(decoded[0].text, "Status update number 5");
+
+    // Decoding without the dictionary fails loudly rather than returning garbage
+    std::vector<Message> missing;
+    EXPECT_THROW(decode_message_page(with_dictionary, 7, missing), DatabaseException);
+}
+
+TEST(MessagePagesTest, CorruptPagesThrow) {
+    auto page = encode_message_page(make_messages(10));
+    std::vector<Message> decoded;
+    EXPECT_THROW(decode_message_page(page.substr(0, page.size() / 2), 7, decoded), DatabaseException);
+    EXPECT_THROW(decode_message_page("", 7, decoded), DatabaseException);
+    EXPECT_TRUE(decoded.empty());
+}
+
+}  // namespace
+}  // namespace tg
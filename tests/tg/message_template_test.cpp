@@ -0,0 +1,113 @@
+#include "tg/message_template.hpp"
+#include "tg/types.hpp"
+
+#include <gtest/gtest.h>
+
+namespace tg {
+namespace {
+
+const User user{
+    123,
+    "johndoe",
+    "John",
+    "Doe",
+    "1234567890",
+    "I love tg-fuse",
+    true,
+    UserStatus::ONLINE,
+    1234567890,
+    1234567890
+};
+
+const Chat chat{123, ChatType::PRIVATE, "John Doe", "johndoe", 1234567890, 1234567890};
+const Message no_media_message{123, 123, 123, 1234567890, "Hello, world!", std::nullopt, false};
+const MediaInfo media_info{MediaType::PHOTO, "1234567890", "photo.jpg", "image/jpeg", 123, "photo.jpg", 800, 600};
+const Message media_message{123, 123, 123, 1234567890, "Hello, world!", media_info, false};
+const Message outgoing_message{123, 123, 123, 1234567890, "Hello, world!", std::nullopt, true};
+
+const MessageInfo no_media_message_info{no_media_message, user, chat};
+const MessageInfo media_message_info{media_message, user, chat};
+const MessageInfo outgoing_message_info{outgoing_message, user, chat};
+
+std::string render(const MessageTemplate& tmpl, const MessageInfo& info) {
+    std::string out;
+    tmpl.render_to(out, info);
+    return out;
+}
+
+// Output must match what bustache produces for the same template (see bustache_format_test)
+TEST(MessageTemplateTest, DefaultFormat) {
+    auto tmpl = MessageTemplate::compile("> **{{sender}}** [{{time}}]: {{message}}");
+    ASSERT_TRUE(tmpl.has_value());
+    EXPECT_EQ(render(*tmpl, no_media_message_info), "> **John Doe (@johndoe)** [2009-02-13 23:31]: Hello, world!");
+    EXPECT_EQ(
+        render(*tmpl, media_message_info),
+        "> **John Doe (@johndoe)** [2009-02-13 23:31]: [photo: photo.jpg] Hello, world!"
+    );
+    EXPECT_EQ(render(*tmpl, outgoing_message_info), "> **You** [2009-02-13 23:31]: Hello, world!");
+}
+
+TEST(MessageTemplateTest, RendersAppendingToBuffer) {
+    auto tmpl = MessageTemplate::compile("{{sender}}: {{message}}");
+    ASSERT_TRUE(tmpl.has_value());
+
+    std::string out = "start\n";
+    tmpl->render_to(out, outgoing_message_info);
+    out += '\n';
+    tmpl->render_to(out, no_media_message_info);
+    EXPECT_EQ(out, "start\nYou: Hello, world!\nJohn Doe (@johndoe): Hello, world!");
+}
+
+TEST(MessageTemplateTest, PrerenderedSenderName) {
+    auto tmpl = MessageTemplate::compile("{{sender}}: {{message}}");
+    ASSERT_TRUE(tmpl.has_value());
+
+    auto name = MessageTemplate::sender_name(user);
+    EXPECT_EQ(name, "John Doe (@johndoe)");
+
+    std::string out;
+    tmpl->render_to(out, no_media_message_info, name);
+    EXPECT_EQ(out, render(*tmpl, no_media_message_info));
+
+    // Outgoing messages are still rendered as "You"
+    out.clear();
+    tmpl->render_to(out, outgoing_message_info, name);
+    EXPECT_EQ(out, "You: Hello, world!");
+}
+
+TEST(MessageTemplateTest, VariableSpellings) {
+    auto tmpl = MessageTemplate::compile("{{ sender }}|{{{time}}}|{{& message}}");
+    ASSERT_TRUE(tmpl.has_value());
+    EXPECT_EQ(render(*tmpl, no_media_message_info), "John Doe (@johndoe)|2009-02-13 23:31|Hello, world!");
+}
+
+TEST(MessageTemplateTest, UnknownVariableRendersEmpty) {
+    auto tmpl = MessageTemplate::compile("[{{chat}}]{{message}}");
+    ASSERT_TRUE(tmpl.has_value());
+    EXPECT_EQ(render(*tmpl, no_media_message_info), "[]Hello, world!");
+}
+
+TEST(MessageTemplateTest, LiteralOnly) {
+    auto tmpl = MessageTemplate::compile("just text");
+    ASSERT_TRUE(tmpl.has_value());
+    EXPECT_EQ(render(*tmpl, no_media_message_info), "just text");
+}
+
+TEST(MessageTemplateTest, RejectsFullMustache) {
+    EXPECT_FALSE(MessageTemplate::compile("{{#message}}{{message}}{{/message}}").has_value());
+    EXPECT_FALSE(MessageTemplate::compile("{{^message}}empty{{/message}}").has_value());
+    EXPECT_FALSE(MessageTemplate::compile("{{> partial}}").has_value());
+    EXPECT_FALSE(MessageTemplate::compile("{{! comment }}{{message}}").has_value());
+    EXPECT_FALSE(MessageTemplate::compile("{{=<% %>=}}").has_value());
+    EXPECT_FALSE(MessageTemplate::compile("{{message").has_value());
+}
+
+TEST(MessageTemplateTest, EstimateCoversMessageText) {
+    auto tmpl = MessageTemplate::compile("> **{{sender}}** [{{time}}]: {{message}}");
+    ASSERT_TRUE(tmpl.has_value());
+    auto rendered = render(*tmpl, no_media_message_info);
+    EXPECT_GE(tmpl->estimate_size(no_media_message), rendered.size());
+}
+
+}  // namespace
+}  // namespace tg
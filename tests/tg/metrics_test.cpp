@@ -0,0 +1,101 @@
+#include "tg/metrics.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace tg {
+namespace {
+
+using namespace std::chrono_literals;
+
+TEST(MetricsTest, HistogramBucketsAndQuantiles) {
+    LatencyHistogram histogram;
+    for (int i = 0; i < 98; ++i) {
+        histogram.record(3us);  // Bucket under 4us
+    }
+    histogram.record(5ms);  // Bucket under 8.192ms
+    histogram.record(5ms);
+
+    auto snapshot = histogram.snapshot();
+    EXPECT_EQ(snapshot.count, 100u);
+    EXPECT_EQ(snapshot.sum_us, 98u * 3 + 2 * 5000);
+    EXPECT_EQ(snapshot.buckets[2], 98u);
+    EXPECT_EQ(snapshot.quantile_us(0.5), 4u);
+    EXPECT_EQ(snapshot.quantile_us(0.98), 4u);
+    EXPECT_EQ(snapshot.quantile_us(0.99), 8192u);
+}
+
+TEST(MetricsTest, SlowSamplesLandInTheLastBucket) {
+    LatencyHistogram histogram;
+    histogram.record(10min);
+    histogram.record(-1s);  // Clock skew reads as zero
+
+    auto snapshot = histogram.snapshot();
+    EXPECT_EQ(snapshot.buckets[kLatencyBuckets - 1], 1u);
+    EXPECT_EQ(snapshot.buckets[0], 1u);
+    EXPECT_EQ(HistogramSnapshot{}.quantile_us(0.99), 0u);
+}
+
+TEST(MetricsTest, StripesMergeAcrossThreads) {
+    LatencyHistogram histogram;
+    Counter counter;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 1000; ++i) {
+                histogram.record(1ms);
+                counter.add();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(histogram.snapshot().count, 8000u);
+    EXPECT_EQ(counter.value(), 8000u);
+}
+
+TEST(MetricsTest, RegistryReturnsTheSameMetric) {
+    Metrics metrics;
+    auto& a = metrics.histogram({"fuse_op_seconds", "op", "getattr"});
+    auto& b = metrics.histogram({"fuse_op_seconds", "op", "getattr"});
+    auto& c = metrics.histogram({"fuse_op_seconds", "op", "read"});
+    EXPECT_EQ(&a, &b);
+    EXPECT_NE(&a, &c);
+
+    a.record(1ms);
+    metrics.counter({"queries_total", "", ""}).add(3);
+
+    auto snapshot = metrics.snapshot();
+    ASSERT_EQ(snapshot.histograms.size(), 2u);
+    EXPECT_EQ(snapshot.histograms[0].key.value, "getattr");
+    EXPECT_EQ(snapshot.histograms[0].data.count, 1u);
+    ASSERT_EQ(snapshot.counters.size(), 1u);
+    EXPECT_DOUBLE_EQ(snapshot.counters[0].value, 3.0);
+}
+
+TEST(MetricsTest, Exports) {
+    Metrics metrics;
+    metrics.histogram({"fuse_op_seconds", "op", "getattr"}).record(3us);
+    auto snapshot = metrics.snapshot();
+    snapshot.add_gauge({"prefetch_queued", "", ""}, 7);
+
+    auto prometheus = snapshot.to_prometheus();
+    EXPECT_NE(prometheus.find("# TYPE tgfuse_fuse_op_seconds histogram\n"), std::string::npos);
+    EXPECT_NE(prometheus.find("tgfuse_fuse_op_seconds_bucket{op=\"getattr\",le=\"4e-06\"} 1\n"), std::string::npos);
+    EXPECT_NE(prometheus.find("tgfuse_fuse_op_seconds_bucket{op=\"getattr\",le=\"+Inf\"} 1\n"), std::string::npos);
+    EXPECT_NE(prometheus.find("tgfuse_fuse_op_seconds_count{op=\"getattr\"} 1\n"), std::string::npos);
+    EXPECT_NE(prometheus.find("# TYPE tgfuse_prefetch_queued gauge\ntgfuse_prefetch_queued 7\n"), std::string::npos);
+
+    auto json = snapshot.to_json();
+    EXPECT_NE(json.find("\"name\":\"fuse_op_seconds\",\"labels\":{\"op\":\"getattr\"},\"count\":1"), std::string::npos);
+    EXPECT_NE(json.find("\"gauges\":[{\"name\":\"prefetch_queued\",\"labels\":{},\"value\":7}]"), std::string::npos);
+}
+
+}  // namespace
+}  // namespace tg
@@ -0,0 +1,86 @@
+#include "tg/mpsc_queue.hpp"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tg {
+namespace {
+
+TEST(MpscQueueTest, PopsInPushOrder) {
+    MpscQueue<std::string> queue;
+    EXPECT_FALSE(queue.try_pop().has_value());
+
+    queue.push("a");
+    queue.push("b");
+    EXPECT_EQ(queue.try_pop(), "a");
+    queue.push("c");
+    EXPECT_EQ(queue.try_pop(), "b");
+    EXPECT_EQ(queue.try_pop(), "c");
+    EXPECT_FALSE(queue.try_pop().has_value());
+}
+
+TEST(MpscQueueTest, MoveOnlyItemsLeftBehindAreFreed) {
+    MpscQueue<std::unique_ptr<int>> queue;
+    queue.push(std::make_unique<int>(1));
+    queue.push(std::make_unique<int>(2));
+
+    auto first = queue.try_pop();
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(**first, 1);
+    // The second item is freed by the destructor (checked under ASan)
+}
+
+TEST(MpscQueueTest, ConcurrentProducersKeepTheirOrder) {
+    constexpr int kProducers = 4;
+    constexpr int kItems = 10000;
+    MpscQueue<std::pair<int, int>> queue;
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++p) {
+        producers.emplace_back([&queue, p]() {
+            for (int i = 0; i < kItems; ++i) {
+                queue.push({p, i});
+            }
+        });
+    }
+
+    std::vector<int> next(kProducers, 0);
+    int popped = 0;
+    while (popped < kProducers * kItems) {
+        auto epoch = queue.epoch();
+        bool drained = false;
+        while (auto item = queue.try_pop()) {
+            EXPECT_EQ(item->second, next[item->first]);
+            next[item->first] = item->second + 1;
+            ++popped;
+            drained = true;
+        }
+        if (!drained) {
+            queue.wait(epoch);
+        }
+    }
+
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    EXPECT_FALSE(queue.try_pop().has_value());
+}
+
+TEST(MpscQueueTest, NotifyWakesTheConsumer) {
+    MpscQueue<int> queue;
+    auto epoch = queue.epoch();
+
+    std::thread waker([&queue]() { queue.notify(); });
+    queue.wait(epoch);  // Returns once notified (or immediately if already notified)
+    waker.join();
+
+    EXPECT_NE(queue.epoch(), epoch);
+    EXPECT_FALSE(queue.try_pop().has_value());
+}
+
+}  // namespace
+}  // namespace tg
@@ -0,0 +1,116 @@
+#include "tg/rate_limiter.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+namespace tg {
+namespace {
+
+using namespace std::chrono_literals;
+
+RateLimiterConfig small_config() {
+    RateLimiterConfig config;
+    config.requests_per_second = 10.0;
+    config.burst = 5;
+    config.upload_reserve = 1;
+    config.background_reserve = 3;
+    return config;
+}
+
+TEST(RateLimiterTest, BurstThenDelay) {
+    RateLimiter limiter(small_config());
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(limiter.reserve(RequestPriority::INTERACTIVE), RateLimiter::Clock::duration::zero());
+    }
+
+    auto wait = limiter.reserve(RequestPriority::INTERACTIVE);
+    EXPECT_GT(wait, RateLimiter::Clock::duration::zero());
+    EXPECT_LE(wait, 100ms);
+
+    auto stats = limiter.stats();
+    EXPECT_EQ(stats.granted[0], 5u);
+    EXPECT_EQ(stats.delayed[0], 1u);
+    EXPECT_EQ(stats.waited[0], std::chrono::duration_cast<std::chrono::microseconds>(wait));
+    EXPECT_EQ(stats.waited[2], 0us);
+}
+
+TEST(RateLimiterTest, BackgroundLeavesReserve) {
+    RateLimiter limiter(small_config());
+
+    // Background stops while 3 tokens are left, uploads while 1 is
+    EXPECT_TRUE(limiter.try_acquire(RequestPriority::BACKGROUND));
+    EXPECT_TRUE(limiter.try_acquire(RequestPriority::BACKGROUND));
+    EXPECT_FALSE(limiter.try_acquire(RequestPriority::BACKGROUND));
+    EXPECT_TRUE(limiter.try_acquire(RequestPriority::UPLOAD));
+    EXPECT_TRUE(limiter.try_acquire(RequestPriority::UPLOAD));
+    EXPECT_FALSE(limiter.try_acquire(RequestPriority::UPLOAD));
+    EXPECT_TRUE(limiter.try_acquire(RequestPriority::INTERACTIVE));
+}
+
+TEST(RateLimiterTest, FloodWaitPausesAndBacksOff) {
+    RateLimiter limiter(small_config());
+    limiter.report_flood_wait(2s);
+
+    auto wait = limiter.reserve(RequestPriority::INTERACTIVE);
+    EXPECT_GT(wait, 1s);
+
+    auto stats = limiter.stats();
+    EXPECT_EQ(stats.flood_waits, 1u);
+    EXPECT_DOUBLE_EQ(stats.current_rate, 5.0);
+    EXPECT_GT(stats.paused_for, 1s);
+    EXPECT_GT(limiter.paused_for(), 1s);
+}
+
+TEST(RateLimiterTest, NoPauseWhileOnlyOutOfTokens) {
+    RateLimiter limiter(small_config());
+    while (limiter.try_acquire(RequestPriority::INTERACTIVE)) {
+    }
+    EXPECT_GT(limiter.reserve(RequestPriority::INTERACTIVE), 0s);
+    EXPECT_EQ(limiter.paused_for(), 0s);  // Waiting for a refill isn't a FLOOD_WAIT
+}
+
+TEST(RateLimiterTest, FloodWaitRespectsMinimumRate) {
+    RateLimiter limiter(small_config());
+    for (int i = 0; i < 10; ++i) {
+        limiter.report_flood_wait(0s);
+    }
+    EXPECT_NEAR(limiter.stats().current_rate, 1.0, 0.01);
+}
+
+TEST(RateLimiterTest, AcquireWaitsForRefill) {
+    RateLimiter limiter(small_config());
+    for (int i = 0; i < 5; ++i) {
+        limiter.acquire(RequestPriority::INTERACTIVE);
+    }
+
+    auto start = RateLimiter::Clock::now();
+    limiter.acquire(RequestPriority::INTERACTIVE);
+    auto elapsed = RateLimiter::Clock::now() - start;
+    EXPECT_GE(elapsed, 50ms);
+    EXPECT_LT(elapsed, 1s);
+}
+
+TEST(RateLimiterTest, ParseRetryAfter) {
+    EXPECT_EQ(parse_retry_after("FLOOD_WAIT_12"), 12s);
+    EXPECT_EQ(parse_retry_after("Too Many Requests: retry after 7"), 7s);
+    EXPECT_FALSE(parse_retry_after("CHAT_NOT_FOUND").has_value());
+    EXPECT_FALSE(parse_retry_after("FLOOD_WAIT_").has_value());
+}
+
+TEST(RateLimiterTest, PriorityScopeNests) {
+    EXPECT_EQ(current_request_priority(), RequestPriority::INTERACTIVE);
+    {
+        RequestPriorityScope background(RequestPriority::BACKGROUND);
+        EXPECT_EQ(current_request_priority(), RequestPriority::BACKGROUND);
+        {
+            RequestPriorityScope upload(RequestPriority::UPLOAD);
+            EXPECT_EQ(current_request_priority(), RequestPriority::UPLOAD);
+        }
+        EXPECT_EQ(current_request_priority(), RequestPriority::BACKGROUND);
+    }
+    EXPECT_EQ(current_request_priority(), RequestPriority::INTERACTIVE);
+}
+
+}  // namespace
+}  // namespace tg
@@ -0,0 +1,63 @@
+#include "tg/sha256.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace tg {
+namespace {
+
+TEST(Sha256Test, EmptyInput) {
+    Sha256 hasher;
+    EXPECT_EQ(hasher.finish(), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+}
+
+TEST(Sha256Test, KnownVector) {
+    Sha256 hasher;
+    hasher.update("abc");
+    EXPECT_EQ(hasher.finish(), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+}
+
+TEST(Sha256Test, ChunkedMatchesOneShot) {
+    std::string data;
+    for (int i = 0; i < 10000; ++i) {
+        data += static_cast<char>(i % 251);
+    }
+
+    Sha256 one_shot;
+    one_shot.update(data);
+
+    Sha256 chunked;
+    for (std::size_t offset = 0; offset < data.size(); offset += 777) {
+        chunked.update(std::string_view(data).substr(offset, 777));
+    }
+    EXPECT_EQ(chunked.size(), data.size());
+    EXPECT_EQ(chunked.finish(), one_shot.finish());
+}
+
+TEST(Sha256Test, FinishResets) {
+    Sha256 hasher;
+    hasher.update("something else");
+    (void)hasher.finish();
+    EXPECT_EQ(hasher.size(), 0);
+
+    hasher.update("abc");
+    EXPECT_EQ(hasher.finish(), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+}
+
+TEST(Sha256Test, HashFile) {
+    auto path = std::filesystem::temp_directory_path() / "tg_fuse_sha256_test.bin";
+    {
+        std::ofstream ofs(path, std::ios::binary);
+        ofs << "abc";
+    }
+    EXPECT_EQ(Sha256::hash_file(path.string()), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    std::filesystem::remove(path);
+
+    EXPECT_FALSE(Sha256::hash_file(path.string()).has_value());
+}
+
+}  // namespace
+}  // namespace tg
@@ -0,0 +1,233 @@
+#include "tg/single_flight.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tg {
+namespace {
+
+/// Holds fetches until release() so callers pile up behind them
+class Gate {
+public:
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return open_; });
+    }
+
+    void release() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            open_ = true;
+        }
+        cv_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool open_{false};
+};
+
+void wait_until(const std::function<bool()>& condition) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!condition() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+TEST(SingleFlightTest, SequentialCallsFetchEachTime) {
+    SingleFlight<int, std::string> flights;
+    int fetches = 0;
+    auto fetch = [&] { return std::to_string(++fetches); };
+    EXPECT_EQ(flights.run(1, fetch), "1");
+    EXPECT_EQ(flights.run(1, fetch), "2");
+    EXPECT_EQ(flights.in_flight(), 0u);
+    EXPECT_EQ(flights.shared_count(), 0u);
+}
+
+TEST(SingleFlightTest, ConcurrentCallsShareOneFetch) {
+    SingleFlight<int, std::string> flights;
+    Gate gate;
+    std::atomic<int> fetches{0};
+
+    constexpr int kCallers = 8;
+    std::vector<std::string> results(kCallers);
+    std::vector<std::thread> threads;
+    threads.emplace_back([&] {
+        results[0] = flights.run(7, [&] {
+            ++fetches;
+            gate.wait();
+            return std::string("value");
+        });
+    });
+    wait_until([&] { return flights.in_flight() == 1; });
+    for (int i = 1; i < kCallers; ++i) {
+        threads.emplace_back([&, i] {
+            results[i] = flights.run(7, [&] {
+                ++fetches;
+                return std::string("other");
+            });
+        });
+    }
+    wait_until([&] { return flights.shared_count() == kCallers - 1; });
+    gate.release();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(fetches.load(), 1);
+    for (const auto& result : results) {
+        EXPECT_EQ(result, "value");
+    }
+    EXPECT_EQ(flights.in_flight(), 0u);
+}
+
+TEST(SingleFlightTest, KeysFetchIndependently) {
+    SingleFlight<int, int> flights;
+    Gate gate;
+    int first = 0;
+    std::thread blocked([&] {
+        first = flights.run(1, [&] {
+            gate.wait();
+            return 1;
+        });
+    });
+    wait_until([&] { return flights.in_flight() == 1; });
+
+    // Another key isn't held up by the first one's fetch
+    EXPECT_EQ(flights.run(2, [] { return 2; }), 2);
+    gate.release();
+    blocked.join();
+    EXPECT_EQ(first, 1);
+}
+
+TEST(SingleFlightTest, ExceptionsReachEveryWaiter) {
+    SingleFlight<int, int> flights;
+    Gate gate;
+    std::atomic<int> failures{0};
+
+    std::thread leader([&] {
+        try {
+            flights.run(3, [&]() -> int {
+                gate.wait();
+                throw std::runtime_error("fetch failed");
+            });
+        } catch (const std::runtime_error&) {
+            ++failures;
+        }
+    });
+    wait_until([&] { return flights.in_flight() == 1; });
+    std::thread follower([&] {
+        try {
+            flights.run(3, [] { return 0; });
+        } catch (const std::runtime_error&) {
+            ++failures;
+        }
+    });
+    wait_until([&] { return flights.shared_count() == 1; });
+    gate.release();
+    leader.join();
+    follower.join();
+
+    EXPECT_EQ(failures.load(), 2);
+    EXPECT_EQ(flights.run(3, [] { return 4; }), 4);  // A failure isn't remembered
+}
+
+TEST(SingleFlightTest, UrgentCallsOvertakeLessUrgentFetches) {
+    constexpr int kUrgent = 0;
+    constexpr int kBackground = 2;
+    SingleFlight<int, std::string> flights;
+    Gate background_gate;
+    Gate urgent_gate;
+
+    std::string background;
+    std::thread prefetch([&] {
+        background = flights.run(
+            5,
+            [&] {
+                background_gate.wait();
+                return std::string("background");
+            },
+            kBackground
+        );
+    });
+    wait_until([&] { return flights.in_flight() == 1; });
+
+    // An urgent call doesn't wait behind the background fetch...
+    std::string urgent;
+    std::atomic<bool> urgent_started{false};
+    std::thread read([&] {
+        urgent = flights.run(
+            5,
+            [&] {
+                urgent_started = true;
+                urgent_gate.wait();
+                return std::string("urgent");
+            },
+            kUrgent
+        );
+    });
+    wait_until([&] { return urgent_started.load(); });
+    EXPECT_EQ(flights.shared_count(), 0u);
+
+    // ...and later calls of either rank join it
+    std::vector<std::string> joined(2);
+    std::thread late_urgent([&] { joined[0] = flights.run(5, [] { return std::string("other"); }, kUrgent); });
+    std::thread late_background([&] {
+        joined[1] = flights.run(5, [] { return std::string("other"); }, kBackground);
+    });
+    wait_until([&] { return flights.shared_count() == 2; });
+    urgent_gate.release();
+    read.join();
+    late_urgent.join();
+    late_background.join();
+    EXPECT_EQ(urgent, "urgent");
+    EXPECT_EQ(joined, (std::vector<std::string>{"urgent", "urgent"}));
+
+    // The overtaken fetch completes for its own caller without disturbing the map
+    background_gate.release();
+    prefetch.join();
+    EXPECT_EQ(background, "background");
+    EXPECT_EQ(flights.in_flight(), 0u);
+}
+
+TEST(SingleFlightTest, LessUrgentCallsJoin) {
+    SingleFlight<int, int> flights;
+    Gate gate;
+    std::atomic<int> fetches{0};
+    int first = 0;
+    std::thread leader([&] {
+        first = flights.run(
+            1,
+            [&] {
+                ++fetches;
+                gate.wait();
+                return 1;
+            },
+            0
+        );
+    });
+    wait_until([&] { return flights.in_flight() == 1; });
+    int second = 0;
+    std::thread follower([&] {
+        second = flights.run(1, [&] { return ++fetches; }, 2);
+    });
+    wait_until([&] { return flights.shared_count() == 1; });
+    gate.release();
+    leader.join();
+    follower.join();
+    EXPECT_EQ(fetches.load(), 1);
+    EXPECT_EQ(second, 1);
+}
+
+}  // namespace
+}  // namespace tg
@@ -0,0 +1,276 @@
+#include "tg/text_scan.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace tg {
+namespace {
+
+const std::vector<TextKernel>& supported_kernels() {
+    static const std::vector<TextKernel> kernels = [] {
+        std::vector<TextKernel> result;
+        for (auto kernel : {TextKernel::SCALAR, TextKernel::SSE42, TextKernel::AVX2, TextKernel::NEON}) {
+            if (text_kernel_supported(kernel)) {
+                result.push_back(kernel);
+            }
+        }
+        return result;
+    }();
+    return kernels;
+}
+
+// Every kernel must agree with the scalar one
+void expect_kernels_agree(const std::string& data) {
+    auto expected = scan_text(data, TextKernel::SCALAR);
+    for (auto kernel : supported_kernels()) {
+        auto scan = scan_text(data, kernel);
+        EXPECT_EQ(scan.valid_utf8, expected.valid_utf8) << to_string(kernel) << " on " << data.size() << " bytes";
+        EXPECT_EQ(scan.control_chars, expected.control_chars) << to_string(kernel);
+        EXPECT_EQ(scan.nul_chars, expected.nul_chars) << to_string(kernel);
+        EXPECT_EQ(scan.incomplete_tail, expected.incomplete_tail) << to_string(kernel);
+    }
+}
+
+// @p sequence at every offset of an ASCII buffer, so it straddles each block boundary
+bool valid_at_every_offset(const std::string& sequence, TextKernel kernel) {
+    bool all_valid = true;
+    for (std::size_t offset = 0; offset < 70; ++offset) {
+        auto data = std::string(offset, 'a') + sequence + std::string(40, 'b');
+        all_valid = scan_text(data, kernel).valid_utf8 && all_valid;
+    }
+    return all_valid;
+}
+
+bool invalid_at_every_offset(const std::string& sequence, TextKernel kernel) {
+    for (std::size_t offset = 0; offset < 70; ++offset) {
+        auto data = std::string(offset, 'a') + sequence + std::string(40, 'b');
+        if (scan_text(data, kernel).valid_utf8) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(TextScanTest, ActiveKernelIsSupported) {
+    EXPECT_TRUE(text_kernel_supported(active_text_kernel()));
+    EXPECT_TRUE(text_kernel_supported(TextKernel::SCALAR));
+}
+
+TEST(TextScanTest, PlainText) {
+    std::string text = "The quick brown fox\njumps over\tthe lazy dog.\r\n Съешь же ещё этих булок 🦊";
+    for (auto kernel : supported_kernels()) {
+        auto scan = scan_text(text, kernel);
+        EXPECT_TRUE(scan.valid_utf8) << to_string(kernel);
+        EXPECT_EQ(scan.control_chars, 0u);
+        EXPECT_EQ(scan.size, text.size());
+        EXPECT_TRUE(scan.is_text());
+    }
+    EXPECT_TRUE(scan_text("").is_text());
+}
+
+TEST(TextScanTest, WellFormedSequences) {
+    for (auto kernel : supported_kernels()) {
+        for (const char* sequence : {"\xC2\x80", "\xDF\xBF", "\xE0\xA0\x80", "\xED\x9F\xBF", "\xEE\x80\x80",
+                                     "\xEF\xBF\xBF", "\xF0\x90\x80\x80", "\xF4\x8F\xBF\xBF"}) {
+            EXPECT_TRUE(valid_at_every_offset(sequence, kernel)) << to_string(kernel);
+        }
+    }
+}
+
+TEST(TextScanTest, MalformedSequences) {
+    const char* malformed[] = {
+        "\x80",              // Stray continuation
+        "\xC3\xA9\xA9",      // One continuation too many
+        "\xC0\xAF",          // Overlong two byte
+        "\xC1\xBF",          // Overlong two byte
+        "\xE0\x9F\xBF",      // Overlong three byte
+        "\xF0\x8F\xBF\xBF",  // Overlong four byte
+        "\xED\xA0\x80",      // Surrogate
+        "\xF4\x90\x80\x80",  // Past U+10FFFF
+        "\xF5\x80\x80\x80",  // Invalid lead
+        "\xFF",              // Invalid lead
+        "\xC3" "a",          // Sequence cut short
+        "\xE2\x82" "a",      // Sequence cut short
+        "\xF0\x9F\x98" "a",  // Sequence cut short
+    };
+    for (auto kernel : supported_kernels()) {
+        for (const char* sequence : malformed) {
+            EXPECT_TRUE(invalid_at_every_offset(sequence, kernel)) << to_string(kernel) << " accepted a sequence";
+        }
+    }
+}
+
+TEST(TextScanTest, IncompleteTail) {
+    for (auto kernel : supported_kernels()) {
+        auto scan = scan_text(std::string(40, 'a') + "\xF0\x9F\x98", kernel);
+        EXPECT_TRUE(scan.valid_utf8) << to_string(kernel);
+        EXPECT_EQ(scan.incomplete_tail, 3u);
+        EXPECT_FALSE(scan.is_text());  // Not valid on its own
+
+        EXPECT_EQ(scan_text(std::string(40, 'a') + "\xE2\x82\xAC", kernel).incomplete_tail, 0u);
+        EXPECT_FALSE(scan_text(std::string(40, 'a') + "\xE2\x82\xAC\x80", kernel).valid_utf8);
+    }
+}
+
+TEST(TextScanTest, ControlCharacters) {
+    for (auto kernel : supported_kernels()) {
+        std::string text(100, 'x');
+        text[3] = '\x01';
+        text[50] = '\x1B';
+        text[99] = '\x7F';  // DEL isn't counted
+        auto scan = scan_text(text, kernel);
+        EXPECT_EQ(scan.control_chars, 2u) << to_string(kernel);
+        EXPECT_EQ(scan.nul_chars, 0u);
+        EXPECT_TRUE(scan.is_text());  // At most one in 20
+
+        text[70] = '\0';
+        scan = scan_text(text, kernel);
+        EXPECT_EQ(scan.control_chars, 3u);
+        EXPECT_EQ(scan.nul_chars, 1u);
+        EXPECT_FALSE(scan.is_text());
+    }
+
+    EXPECT_TRUE(scan_text("ab\x01").is_text());
+    EXPECT_FALSE(scan_text("ab\x01\x02").is_text());
+    EXPECT_FALSE(scan_text(std::string(20, '\x02')).is_text());
+}
+
+TEST(TextScanTest, KernelsAgreeOnRandomData) {
+    std::mt19937 rng(42);
+    // Mostly text with the odd multi-byte sequence, control character or random byte
+    std::vector<std::string> pieces = {"a", "b", " ", "\n", "\t", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\xA6\x8A",
+                                       "\x01", "\x00", "\x80", "\xC3", "\xED\xA0\x80", "\xF4\x90\x80\x80"};
+    for (int round = 0; round < 2000; ++round) {
+        std::string data;
+        auto length = rng() % 200;
+        auto spice = 1 + rng() % 40;  // One in `spice` pieces is something other than ASCII
+        for (std::size_t i = 0; i < length; ++i) {
+            const auto& piece = rng() % spice == 0 ? pieces[rng() % pieces.size()] : pieces[rng() % 2];
+            data.append(piece.empty() ? std::string(1, '\0') : piece);
+        }
+        expect_kernels_agree(data);
+    }
+
+    std::string noise;
+    for (int i = 0; i < 4096; ++i) {
+        noise += static_cast<char>(rng());
+    }
+    expect_kernels_agree(noise);
+}
+
+TEST(TextScanTest, ScannerAcrossUpdates) {
+    std::string text;
+    for (int i = 0; i < 200; ++i) {
+        text += "Ещё 🦊 line " + std::to_string(i) + "\n";
+    }
+
+    // Every split point, including ones inside multi-byte sequences
+    for (std::size_t split = 0; split <= text.size(); split += 7) {
+        TextScanner scanner;
+        scanner.update(std::string_view(text).substr(0, split));
+        scanner.update(std::string_view(text).substr(split));
+        EXPECT_TRUE(scanner.is_text()) << "split at " << split;
+        EXPECT_EQ(scanner.size(), text.size());
+    }
+
+    TextScanner bytewise;
+    for (char c : text) {
+        bytewise.update(&c, 1);
+    }
+    EXPECT_TRUE(bytewise.is_text());
+
+    TextScanner cut;
+    cut.update("abc\xE2\x82");
+    EXPECT_TRUE(cut.may_be_text());
+    EXPECT_FALSE(cut.is_text());  // Ends mid-sequence
+    cut.update("\xAC");
+    EXPECT_TRUE(cut.is_text());
+    cut.update("\xE2" "a");
+    EXPECT_FALSE(cut.may_be_text());
+    EXPECT_EQ(cut.size(), 8u);
+}
+
+TEST(TextScanTest, ScanFile) {
+    auto path = std::filesystem::temp_directory_path() / "tg_text_scan_test.txt";
+    {
+        std::ofstream ofs(path, std::ios::binary);
+        for (int i = 0; i < 100000; ++i) {
+            ofs << "Строка " << i << " of the file\n";
+        }
+    }
+    auto scan = TextScanner::scan_file(path.string());
+    ASSERT_TRUE(scan.has_value());
+    EXPECT_TRUE(scan->is_text());
+    EXPECT_EQ(scan->size, std::filesystem::file_size(path));
+
+    {
+        std::ofstream ofs(path, std::ios::binary | std::ios::app);
+        ofs.put('\0');
+    }
+    scan = TextScanner::scan_file(path.string());
+    ASSERT_TRUE(scan.has_value());
+    EXPECT_FALSE(scan->is_text());
+
+    std::filesystem::remove(path);
+    EXPECT_FALSE(TextScanner::scan_file(path.string()).has_value());
+}
+
+TEST(TextScanTest, FindLast) {
+    std::string text(300, 'x');
+    EXPECT_EQ(find_last_newline(text), std::string_view::npos);
+    EXPECT_EQ(find_last_whitespace(text), std::string_view::npos);
+
+    text[5] = '\n';
+    text[100] = ' ';
+    text[250] = '\t';
+    EXPECT_EQ(find_last_newline(text), 5u);
+    EXPECT_EQ(find_last_whitespace(text), 250u);
+    EXPECT_EQ(find_last_whitespace(std::string_view(text).substr(0, 250)), 100u);
+    EXPECT_EQ(find_last_newline(""), std::string_view::npos);
+}
+
+TEST(TextScanTest, Utf8Boundary) {
+    std::string text = "ab\xE2\x82\xAC" "cd";
+    EXPECT_EQ(utf8_boundary(text, 2), 2u);
+    EXPECT_EQ(utf8_boundary(text, 3), 2u);
+    EXPECT_EQ(utf8_boundary(text, 4), 2u);
+    EXPECT_EQ(utf8_boundary(text, 5), 5u);
+    EXPECT_EQ(utf8_boundary(text, 100), text.size());
+}
+
+TEST(TextScanTest, SplitText) {
+    EXPECT_TRUE(split_text("", 10).empty());
+
+    auto chunks = split_text("one two three four", 9);
+    ASSERT_EQ(chunks.size(), 3u);
+    EXPECT_EQ(chunks[0], "one two");
+    EXPECT_EQ(chunks[1], "three");
+    EXPECT_EQ(chunks[2], "four");
+
+    // Without whitespace the cut falls between characters
+    std::string euros;
+    for (int i = 0; i < 10; ++i) {
+        euros += "\xE2\x82\xAC";
+    }
+    std::size_t total = 0;
+    for (auto chunk : split_text(euros, 8)) {
+        EXPECT_LE(chunk.size(), 8u);
+        EXPECT_TRUE(scan_text(chunk).is_text());
+        total += chunk.size();
+    }
+    EXPECT_EQ(total, euros.size());
+
+    std::string long_text(10000, 'a');
+    auto pieces = split_text(long_text, 4096);
+    ASSERT_EQ(pieces.size(), 3u);
+    EXPECT_EQ(pieces[0].size(), 4096u);
+    EXPECT_EQ(pieces[0].data(), long_text.data());  // Views, not copies
+}
+
+}  // namespace
+}  // namespace tg
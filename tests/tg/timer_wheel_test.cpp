@@ -0,0 +1,81 @@
+#include "tg/timer_wheel.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace tg {
+namespace {
+
+using namespace std::chrono_literals;
+
+class TimerWheelTest : public ::testing::Test {
+protected:
+    TimerWheel::Clock::time_point start_ = TimerWheel::Clock::now();
+    TimerWheel wheel_{10s, 8, start_};
+};
+
+TEST_F(TimerWheelTest, FiresAfterDeadline) {
+    wheel_.schedule(1, start_ + 25s);
+    EXPECT_TRUE(wheel_.contains(1));
+
+    EXPECT_TRUE(wheel_.advance(start_ + 20s).empty());
+    EXPECT_EQ(wheel_.advance(start_ + 30s), std::vector<int64_t>{1});
+    EXPECT_TRUE(wheel_.empty());
+    EXPECT_TRUE(wheel_.advance(start_ + 40s).empty());
+}
+
+TEST_F(TimerWheelTest, PastDeadlineFiresOnNextAdvance) {
+    (void)wheel_.advance(start_ + 50s);
+    wheel_.schedule(1, start_ + 5s);
+    EXPECT_EQ(wheel_.advance(start_ + 60s), std::vector<int64_t>{1});
+}
+
+TEST_F(TimerWheelTest, RescheduleReplacesDeadline) {
+    wheel_.schedule(1, start_ + 10s);
+    wheel_.schedule(1, start_ + 40s);
+    EXPECT_EQ(wheel_.size(), 1u);
+
+    EXPECT_TRUE(wheel_.advance(start_ + 30s).empty());
+    EXPECT_EQ(wheel_.advance(start_ + 40s), std::vector<int64_t>{1});
+}
+
+TEST_F(TimerWheelTest, Cancel) {
+    wheel_.schedule(1, start_ + 10s);
+    wheel_.cancel(1);
+    EXPECT_FALSE(wheel_.contains(1));
+    EXPECT_TRUE(wheel_.advance(start_ + 100s).empty());
+}
+
+TEST_F(TimerWheelTest, DeadlinesBeyondOneTurn) {
+    // 8 slots of 10s: 200s wraps the ring more than twice
+    wheel_.schedule(1, start_ + 200s);
+    wheel_.schedule(2, start_ + 20s);
+
+    EXPECT_EQ(wheel_.advance(start_ + 90s), std::vector<int64_t>{2});
+    EXPECT_TRUE(wheel_.advance(start_ + 190s).empty());
+    EXPECT_EQ(wheel_.advance(start_ + 200s), std::vector<int64_t>{1});
+}
+
+TEST_F(TimerWheelTest, LongJumpCollectsEverythingDue) {
+    for (int64_t key = 0; key < 100; ++key) {
+        wheel_.schedule(key, start_ + std::chrono::seconds(key * 7));
+    }
+
+    auto expired = wheel_.advance(start_ + 350s);
+    std::sort(expired.begin(), expired.end());
+    ASSERT_EQ(expired.size(), 51u);  // Keys 0..50 (350s / 7s)
+    EXPECT_EQ(expired.front(), 0);
+    EXPECT_EQ(expired.back(), 50);
+    EXPECT_EQ(wheel_.size(), 49u);
+}
+
+TEST_F(TimerWheelTest, NextTickAdvances) {
+    EXPECT_EQ(wheel_.next_tick(), start_);
+    (void)wheel_.advance(start_ + 15s);
+    EXPECT_EQ(wheel_.next_tick(), start_ + 20s);
+}
+
+}  // namespace
+}  // namespace tg
@@ -0,0 +1,97 @@
+#include "tg/trace.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tg {
+namespace {
+
+TraceEvent make_event(const char* name, int64_t start_ns) { return TraceEvent{"test", name, start_ns, 10, 0, 1}; }
+
+TEST(TraceTest, DisabledRecordsNothing) {
+    Tracer tracer;
+    tracer.record(make_event("ignored", 1));
+    EXPECT_TRUE(tracer.events().empty());
+
+    tracer.enable(0);  // No ring, so still off
+    EXPECT_FALSE(tracer.enabled());
+}
+
+TEST(TraceTest, RingKeepsTheLatestEvents) {
+    Tracer tracer;
+    tracer.enable(4);
+    for (int64_t i = 1; i <= 6; ++i) {
+        tracer.record(make_event("span", i));
+    }
+
+    auto events = tracer.events();
+    ASSERT_EQ(events.size(), 4u);
+    EXPECT_EQ(events.front().start_ns, 3);
+    EXPECT_EQ(events.back().start_ns, 6);
+
+    tracer.disable();
+    tracer.record(make_event("span", 7));
+    EXPECT_EQ(tracer.events().back().start_ns, 6);
+}
+
+TEST(TraceTest, ConcurrentWritersFillEverySlot) {
+    Tracer tracer;
+    tracer.enable(8000);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&tracer]() {
+            for (int i = 0; i < 1000; ++i) {
+                tracer.record(make_event("span", 1));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(tracer.events().size(), 8000u);
+}
+
+TEST(TraceTest, SpansCarryTheRequest) {
+    auto& tracer = Tracer::global();
+    tracer.enable(64);
+
+    uint64_t request = 0;
+    {
+        TraceRequestScope scope;
+        request = current_trace_request();
+        EXPECT_NE(request, 0u);
+        TraceSpan span("fuse", "getattr");
+    }
+    EXPECT_EQ(current_trace_request(), 0u);
+    tracer.disable();
+
+    {
+        TraceSpan span("fuse", "untraced");  // Tracing is off again
+    }
+
+    auto events = tracer.events();
+    ASSERT_FALSE(events.empty());
+    EXPECT_STREQ(events.back().name, "getattr");
+    EXPECT_EQ(events.back().request, request);
+    EXPECT_GE(events.back().duration_ns, 0);
+
+    auto json = tracer.chrome_trace_json();
+    EXPECT_NE(json.find("\"name\":\"getattr\",\"cat\":\"fuse\",\"ph\":\"X\""), std::string::npos);
+    EXPECT_NE(json.find("\"args\":{\"request\":" + std::to_string(request) + "}"), std::string::npos);
+}
+
+TEST(TraceTest, InternedNamesAreStable) {
+    Tracer tracer;
+    std::string name = "getChatHistory";
+    const char* interned = tracer.intern(name);
+    name = "changed";
+    EXPECT_STREQ(interned, "getChatHistory");
+    EXPECT_EQ(tracer.intern("getChatHistory"), interned);
+}
+
+}  // namespace
+}  // namespace tg
@@ -305,6 +305,29 @@ TEST(TypesTest, IsDocumentType) {
     EXPECT_FALSE(is_document_type(MediaType::ANIMATION));
 }
 
+TEST(TypesTest, MakeFileListItem) {
+    Message message{};
+    message.id = 42;
+    message.timestamp = 1234567890;
+    EXPECT_FALSE(make_file_list_item(message).has_value());
+
+    MediaInfo media{};
+    media.type = MediaType::DOCUMENT;
+    media.file_id = "file42";
+    media.filename = "report.pdf";
+    media.file_size = 2048;
+    message.media = media;
+
+    auto item = make_file_list_item(message);
+    ASSERT_TRUE(item.has_value());
+    EXPECT_EQ(item->message_id, 42);
+    EXPECT_EQ(item->filename, "report.pdf");
+    EXPECT_EQ(item->file_size, 2048);
+    EXPECT_EQ(item->timestamp, 1234567890);
+    EXPECT_EQ(item->type, MediaType::DOCUMENT);
+    EXPECT_EQ(item->file_id, "file42");
+}
+
 // Stress test with random data (TDLib pattern)
 TEST(TypesTest, StressTestMediaDetection) {
     std::vector<std::pair<std::string, MediaType>> test_cases = {